@@ -22,6 +22,9 @@ add_subdirectory(${CMAKE_CURRENT_SOURCE_DIR}/third_party/imgui_builder)
 
 add_subdirectory(ltproto)
 add_subdirectory(src/transport)
+if(LT_LINUX)
+    add_subdirectory(src/relay)
+endif()
 
 #Qt
 list(APPEND CMAKE_PREFIX_PATH ${LT_QT_CMAKE_PATH})
@@ -2,6 +2,9 @@ find_package(VPL REQUIRED PATHS third_party/prebuilt/onevpl/${LT_THIRD_POSTFIX})
 find_package(PkgConfig REQUIRED)
 pkg_check_modules(GLib REQUIRED IMPORTED_TARGET GLOBAL glib-2.0)
 pkg_check_modules(X11 REQUIRED IMPORTED_TARGET GLOBAL x11)
+pkg_check_modules(Xext REQUIRED IMPORTED_TARGET GLOBAL xext)
+pkg_check_modules(Xfixes REQUIRED IMPORTED_TARGET GLOBAL xfixes)
+pkg_check_modules(Xdamage REQUIRED IMPORTED_TARGET GLOBAL xdamage)
 pkg_check_modules(Va REQUIRED IMPORTED_TARGET GLOBAL libva)
 pkg_check_modules(Va-X11 REQUIRED IMPORTED_TARGET GLOBAL libva-x11)
 pkg_check_modules(Va-Wayland REQUIRED IMPORTED_TARGET GLOBAL libva-wayland)
@@ -10,4 +13,6 @@ pkg_check_modules(Va-Drm REQUIRED IMPORTED_TARGET GLOBAL libva-drm)
 pkg_check_modules(GL REQUIRED IMPORTED_TARGET GLOBAL gl)
 pkg_check_modules(GLES REQUIRED IMPORTED_TARGET GLOBAL glesv2)
 pkg_check_modules(EGL REQUIRED IMPORTED_TARGET GLOBAL egl)
-pkg_check_modules(MFX REQUIRED IMPORTED_TARGET GLOBAL libmfx)
\ No newline at end of file
+pkg_check_modules(MFX REQUIRED IMPORTED_TARGET GLOBAL libmfx)
+# 可选, 只有test_openh264_encoder用到
+pkg_check_modules(OpenH264 IMPORTED_TARGET GLOBAL openh264)
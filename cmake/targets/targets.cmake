@@ -95,14 +95,82 @@ set(LT_VIDEO_CAPTURER_SRCS
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/dxgi/duplication_manager.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/dxgi/duplication_manager.cpp
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/dxgi/common_types.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/synthetic_video_capturer.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/synthetic_video_capturer.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/vblank_clock.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/vblank_clock.cpp
+)
+
+# Linux上只有X11和合成画面
+set(LT_VIDEO_CAPTURER_LINUX_SRCS
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/video_capturer.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/video_capturer.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/x11_video_capturer.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/x11_video_capturer.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/synthetic_video_capturer.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/synthetic_video_capturer.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/vblank_clock.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/vblank_clock.cpp
 )
 
 set(LT_VIDEO_CE_PIPELINE_SRCS
     # video->cepipeline
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/video_capture_encode_pipeline.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/video_capture_encode_pipeline.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/rate_controller.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/rate_controller.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/frame_stages.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/ltr_controller.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/ltr_controller.cpp
+)
+
+set(LT_VIDEO_H264_SRCS
+    # video->h264, 编码端和解码端共用
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/h264/h264_parser.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/h264/h264_parser.cpp
+)
+
+set(LT_VIDEO_CONVERT_SRCS
+    # video->convert
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_kernels.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_scalar.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_sse41.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_avx2.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_avx512.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_neon.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/damage_detector.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/damage_detector.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash_sse41.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash_avx2.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash_neon.cpp
 )
 
+# 每个指令集的kernel单独用对应的编译选项, 运行时再按CPU选择. 非x86上这几个文件是空的
+if (CMAKE_SYSTEM_PROCESSOR MATCHES "^(x86_64|AMD64|amd64|i.86|x86)$")
+    if (LT_WINDOWS)
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_avx2.cpp
+            PROPERTIES COMPILE_OPTIONS "/arch:AVX2")
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_avx512.cpp
+            PROPERTIES COMPILE_OPTIONS "/arch:AVX512")
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash_avx2.cpp
+            PROPERTIES COMPILE_OPTIONS "/arch:AVX2")
+    else()
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_sse41.cpp
+            PROPERTIES COMPILE_OPTIONS "-msse4.1")
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_avx2.cpp
+            PROPERTIES COMPILE_OPTIONS "-mavx2")
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_avx512.cpp
+            PROPERTIES COMPILE_OPTIONS "-mavx512f;-mavx512bw")
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash_sse41.cpp
+            PROPERTIES COMPILE_OPTIONS "-msse4.1")
+        set_source_files_properties(${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/tile_hash_avx2.cpp
+            PROPERTIES COMPILE_OPTIONS "-mavx2")
+    endif()
+endif()
+
 set(LT_VIDEO_DECODER_SRCS
     # video->decoder
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/decoder/video_decoder.h
@@ -138,6 +206,15 @@ set(LTLIB_SRCS
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/spin_mutex.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/reconnect_interval.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/reconnect_interval.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/object_pool.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/message_pool.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/message_pool.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/frame_pool.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/frame_pool.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/shared_frame_ring.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/shared_frame_ring.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/keyframe_cache.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/keyframe_cache.cpp
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/settings.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/settings.cpp
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/time_sync.h
@@ -157,6 +234,13 @@ set(LTLIB_SRCS
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/ioloop.cpp
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/types.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/buffer.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/frame_parser.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/frame_parser.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/media_frame.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/media_frame.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/ltproto_frame.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/ltproto_frame.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/payload_cipher.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/client_secure_layer.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/client_secure_layer.cpp
     ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/client_transport_layer.h
@@ -206,6 +290,8 @@ set(LT_VIDEO_DR_PIPELINE_SRCS
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/gpu_capability.cpp
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/video_statistics.h
     ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/video_statistics.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/ltr_tracker.h
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/ltr_tracker.cpp
 )
 
 
@@ -312,7 +398,9 @@ set(LT_SRCS
     ${LT_PLAT_SRCS}
     
     ${LT_VIDEO_DR_PIPELINE_SRCS}
+    ${LT_VIDEO_H264_SRCS}
     ${LT_VIDEO_DECODER_SRCS}
+    ${LT_VIDEO_CONVERT_SRCS}
     ${LT_VIDEO_RENDERER_SRCS}
     ${LT_VIDEO_WIDGET_SRCS}
     ${LT_AUDIO_PLAYER_SRCS}
@@ -339,6 +427,10 @@ if (LT_WINDOWS)
         @ONLY)
 
     set(LT_LANTHING_RC ${CMAKE_CURRENT_SOURCE_DIR}/lanthing.rc)
+elseif (LT_LINUX)
+    list(APPEND LT_SRCS
+        ${LT_VIDEO_CAPTURER_LINUX_SRCS}
+    )
 endif()
 
 add_executable(${PROJECT_NAME}
@@ -385,6 +477,9 @@ elseif(LT_LINUX)
         m
         stdc++
         PkgConfig::X11
+        PkgConfig::Xext
+        PkgConfig::Xfixes
+        PkgConfig::Xdamage
         PkgConfig::Va
         PkgConfig::Va-X11
         PkgConfig::Va-Wayland
@@ -439,4 +534,306 @@ if (LT_WINDOWS)
 endif(LT_WINDOWS)
 
 # 设置VS调试路径
-set_property(TARGET ${PROJECT_NAME} PROPERTY VS_DEBUGGER_WORKING_DIRECTORY "$<TARGET_FILE_DIR:${PROJECT_NAME}>")
\ No newline at end of file
+set_property(TARGET ${PROJECT_NAME} PROPERTY VS_DEBUGGER_WORKING_DIRECTORY "$<TARGET_FILE_DIR:${PROJECT_NAME}>")
+
+if(${LT_ENABLE_TEST})
+add_executable(test_reconnect_interval
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/reconnect_interval.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/times.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/reconnect_interval_tests.cpp
+)
+target_include_directories(test_reconnect_interval
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_reconnect_interval
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_reconnect_interval COMMAND test_reconnect_interval)
+
+add_executable(test_frame_parser
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/frame_parser.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/frame_parser_tests.cpp
+)
+target_include_directories(test_frame_parser
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_frame_parser
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_frame_parser COMMAND test_frame_parser)
+
+add_executable(test_object_pool
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/object_pool_tests.cpp
+)
+target_include_directories(test_object_pool
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_object_pool
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_object_pool COMMAND test_object_pool)
+
+add_executable(test_shared_frame_ring
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/shared_frame_ring.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/strings.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/times.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/shared_frame_ring_tests.cpp
+)
+target_include_directories(test_shared_frame_ring
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_shared_frame_ring
+    g3log
+    utf8cpp
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_shared_frame_ring COMMAND test_shared_frame_ring)
+
+add_executable(test_media_frame
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/media_frame.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/io/media_frame_tests.cpp
+)
+target_include_directories(test_media_frame
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_media_frame
+    ltproto
+    protobuf::libprotobuf-lite
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_media_frame COMMAND test_media_frame)
+
+add_executable(test_keyframe_cache
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/keyframe_cache.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/keyframe_cache_tests.cpp
+)
+target_include_directories(test_keyframe_cache
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_keyframe_cache
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_keyframe_cache COMMAND test_keyframe_cache)
+
+add_executable(test_frame_pool
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/frame_pool.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/frame_pool_tests.cpp
+)
+target_include_directories(test_frame_pool
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_frame_pool
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_frame_pool COMMAND test_frame_pool)
+
+add_executable(test_spsc_queue
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/spsc_queue_tests.cpp
+)
+target_include_directories(test_spsc_queue
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_spsc_queue
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_spsc_queue COMMAND test_spsc_queue)
+
+add_executable(test_rate_controller
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/rate_controller.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/rate_controller_tests.cpp
+)
+target_include_directories(test_rate_controller
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+# 和传输层的LayerDropper一起测, 它来自transport库
+target_link_libraries(test_rate_controller
+    transport
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_rate_controller COMMAND test_rate_controller)
+
+# 解析H264的参考关系, 以及在丢帧的环回链路上对比LTR恢复和IDR恢复
+add_executable(test_ltr_controller
+    ${LT_VIDEO_H264_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/ltr_controller.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/ltr_tracker.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/ltr_controller_tests.cpp
+)
+target_include_directories(test_ltr_controller
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_ltr_controller
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_ltr_controller COMMAND test_ltr_controller)
+
+add_executable(test_color_convert
+    ${LT_VIDEO_CONVERT_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/color_convert_tests.cpp
+)
+target_include_directories(test_color_convert
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_color_convert
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_color_convert COMMAND test_color_convert)
+
+add_executable(test_damage_detector
+    ${LT_VIDEO_CONVERT_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/convert/damage_detector_tests.cpp
+)
+target_include_directories(test_damage_detector
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_damage_detector
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_damage_detector COMMAND test_damage_detector)
+
+add_executable(test_synthetic_capturer
+    ${LT_VIDEO_CONVERT_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/times.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/frame_pool.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/video_capturer.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/synthetic_video_capturer.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/vblank_clock.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/synthetic_video_capturer_tests.cpp
+)
+target_include_directories(test_synthetic_capturer
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_synthetic_capturer
+    g3log
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_synthetic_capturer COMMAND test_synthetic_capturer)
+
+if (LT_LINUX)
+# video_capturer.cpp在Linux上会创建X11VideoCapturer
+target_sources(test_synthetic_capturer PRIVATE
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/x11_video_capturer.cpp
+)
+target_link_libraries(test_synthetic_capturer
+    PkgConfig::X11 PkgConfig::Xext PkgConfig::Xfixes PkgConfig::Xdamage
+)
+
+# 没有X server时测试会跳过, 见x11_video_capturer_tests.cpp
+add_executable(test_x11_capturer
+    ${LT_VIDEO_CONVERT_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/times.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/ltlib/frame_pool.cpp
+    ${LT_VIDEO_CAPTURER_LINUX_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/capturer/x11_video_capturer_tests.cpp
+)
+target_include_directories(test_x11_capturer
+    PRIVATE
+        ${CMAKE_CURRENT_SOURCE_DIR}/src
+)
+target_link_libraries(test_x11_capturer
+    g3log
+    PkgConfig::X11 PkgConfig::Xext PkgConfig::Xfixes PkgConfig::Xdamage
+    GTest::gtest
+    GTest::gtest_main
+)
+add_test(NAME test_x11_capturer COMMAND test_x11_capturer)
+endif() # LT_LINUX
+
+# 用到软编的测试, 找不到openh264的动态库时会跳过. Linux上没装openh264的开发包就不编
+if (LT_WINDOWS OR OpenH264_FOUND)
+if (LT_WINDOWS)
+    set(LT_TEST_SOFT_ENCODER_SRCS
+        ${LT_VIDEO_CAPTURER_SRCS}
+        ${LT_VIDEO_ENCODER_SRCS}
+    )
+    set(LT_TEST_OPENH264_DECODER_SRCS
+        ${LT_VIDEO_DECODER_SRCS}
+    )
+else()
+    # Linux上只编软编和OpenH264解码, 硬编的代码只有Windows能编
+    set(LT_TEST_SOFT_ENCODER_SRCS
+        ${LT_VIDEO_CAPTURER_LINUX_SRCS}
+        ${CMAKE_CURRENT_SOURCE_DIR}/src/video/encoder/video_encoder.cpp
+        ${CMAKE_CURRENT_SOURCE_DIR}/src/video/encoder/openh264_encoder.cpp
+        ${CMAKE_CURRENT_SOURCE_DIR}/src/video/encoder/params_helper.cpp
+    )
+    set(LT_TEST_OPENH264_DECODER_SRCS
+        ${LT_VIDEO_DECODER_SRCS}
+        ${CMAKE_CURRENT_SOURCE_DIR}/src/video/decoder/openh264_decoder.cpp
+    )
+endif()
+
+add_executable(test_openh264_encoder
+    ${LTLIB_SRCS}
+    ${LT_VIDEO_CONVERT_SRCS}
+    ${LT_VIDEO_H264_SRCS}
+    ${LT_TEST_SOFT_ENCODER_SRCS}
+    ${LT_TEST_OPENH264_DECODER_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/drpipeline/ltr_tracker.cpp
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/encoder/openh264_encoder_tests.cpp
+)
+add_test(NAME test_openh264_encoder COMMAND test_openh264_encoder)
+
+# 合成画面+OpenH264软编, 对比流水线分成几段时的吞吐
+add_executable(test_frame_stages
+    ${LTLIB_SRCS}
+    ${LT_VIDEO_CONVERT_SRCS}
+    ${LT_VIDEO_H264_SRCS}
+    ${LT_TEST_SOFT_ENCODER_SRCS}
+    ${CMAKE_CURRENT_SOURCE_DIR}/src/video/cepipeline/frame_stages_tests.cpp
+)
+add_test(NAME test_frame_stages COMMAND test_frame_stages)
+
+foreach(target test_openh264_encoder test_frame_stages)
+    target_include_directories(${target}
+        PRIVATE
+            ${CMAKE_CURRENT_SOURCE_DIR}/src
+    )
+    if (LT_LINUX)
+        # 库是运行时加载的, 只要头文件
+        target_include_directories(${target} PRIVATE ${OpenH264_INCLUDE_DIRS})
+    endif()
+    target_link_libraries(${target}
+        g3log
+        ffmpeg
+        protobuf::libprotobuf-lite
+        ltproto
+        amf
+        uv_a
+        sqlite3
+        MbedTLS::mbedtls
+        MbedTLS::mbedcrypto
+        MbedTLS::mbedx509
+        ${PLATFORM_LIBS}
+        GTest::gtest
+        GTest::gtest_main
+    )
+endforeach()
+endif() # LT_WINDOWS OR OpenH264_FOUND
+endif() # if(${LT_ENABLE_TEST})
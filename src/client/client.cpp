@@ -32,6 +32,7 @@
 
 #include <filesystem>
 #include <sstream>
+#include <utility>
 
 #include <ltproto/client2app/client_status.pb.h>
 #include <ltproto/client2service/time_sync.pb.h>
@@ -54,6 +55,7 @@
 
 #include <lt_constants.h>
 #include <ltlib/logging.h>
+#include <ltlib/message_pool.h>
 #include <ltlib/system.h>
 #include <ltlib/time_sync.h>
 
@@ -756,9 +758,10 @@ void Client::onTpData(void* user_data, const uint8_t* data, uint32_t size, bool
     auto that = reinterpret_cast<Client*>(user_data);
     (void)is_reliable;
     auto type = reinterpret_cast<const uint32_t*>(data);
-    auto msg = ltproto::create_by_type(*type);
+    auto msg = ltlib::MessagePool::local().get(*type);
     if (msg == nullptr) {
         LOG(INFO) << "Unknown message type: " << *type;
+        return;
     }
     bool success = msg->ParseFromArray(data + 4, size - 4);
     if (!success) {
@@ -777,7 +780,25 @@ void Client::onTpVideoFrame(void* user_data, const lt::VideoFrame& frame) {
         if (that->video_pipeline_ == nullptr) {
             return;
         }
-        action = that->video_pipeline_->submit(frame);
+        // 被控端显示模式变了不会再重启worker, 新的宽高跟着码流过来. 等到新分辨率的关键帧再重建
+        uint32_t width = frame.width;
+        uint32_t height = frame.height;
+        const uint32_t rotation = that->video_params_.rotation;
+        if (rotation == 90 || rotation == 270) {
+            std::swap(width, height);
+        }
+        if (width != 0 && height != 0 &&
+            (width != that->video_params_.width || height != that->video_params_.height)) {
+            if (!frame.is_keyframe) {
+                action = video::DecodeRenderPipeline::Action::REQUEST_KEY_FRAME;
+            }
+            else if (!that->recreateVideoPipeline(width, height, rotation)) {
+                return;
+            }
+        }
+        if (action == video::DecodeRenderPipeline::Action::NONE) {
+            action = that->video_pipeline_->submit(frame);
+        }
     }
     switch (action) {
     case video::DecodeRenderPipeline::Action::REQUEST_KEY_FRAME:
@@ -1077,23 +1098,10 @@ void Client::onChangeStreamingParams(std::shared_ptr<google::protobuf::MessageLi
     LOGF(INFO, "Received ChangeStreamingParams(w:%u, h:%u, r:%u), old is (w:%u, h:%u, r:%u)", width,
          height, rotation, video_params_.width, video_params_.height, video_params_.rotation);
     bool success = true;
-    if (video_params_.width != width || video_params_.height != height) {
-        video_params_.width = width;
-        video_params_.height = height;
-        video_params_.rotation = rotation;
-        {
-            std::lock_guard lg{cursor_mtx_};
-            cursors_.clear();
-        }
-        sdl_->clearCursorInfos();
-        input_capturer_->changeVideoParameters(video_params_.width, video_params_.height,
-                                               video_params_.rotation, is_stretch_);
+    {
         std::lock_guard lock{dr_mutex_};
-        video_pipeline_.reset(); // 手动reset再create，保证不同时存在两份VideoDecodeRenderPipeline
-        video_pipeline_ = video::DecodeRenderPipeline::create(video_params_);
-        if (video_pipeline_ == nullptr) {
-            success = false;
-            LOG(ERR) << "Recreate VideoDecodeRenderPipeline failed";
+        if (video_params_.width != width || video_params_.height != height) {
+            success = recreateVideoPipeline(width, height, rotation);
         }
     }
     auto ack = std::make_shared<ltproto::client2worker::ChangeStreamingParamsAck>();
@@ -1102,6 +1110,27 @@ void Client::onChangeStreamingParams(std::shared_ptr<google::protobuf::MessageLi
     sendMessageToHost(ltproto::id(ack), ack, true);
 }
 
+bool Client::recreateVideoPipeline(uint32_t width, uint32_t height, uint32_t rotation) {
+    LOGF(INFO, "Recreate VideoDecodeRenderPipeline (w:%u, h:%u, r:%u)", width, height, rotation);
+    video_params_.width = width;
+    video_params_.height = height;
+    video_params_.rotation = rotation;
+    {
+        std::lock_guard lg{cursor_mtx_};
+        cursors_.clear();
+    }
+    sdl_->clearCursorInfos();
+    input_capturer_->changeVideoParameters(video_params_.width, video_params_.height,
+                                           video_params_.rotation, is_stretch_);
+    video_pipeline_.reset(); // 手动reset再create，保证不同时存在两份VideoDecodeRenderPipeline
+    video_pipeline_ = video::DecodeRenderPipeline::create(video_params_);
+    if (video_pipeline_ == nullptr) {
+        LOG(ERR) << "Recreate VideoDecodeRenderPipeline failed";
+        return false;
+    }
+    return true;
+}
+
 void Client::onRemoteClipboard(std::shared_ptr<google::protobuf::MessageLite> msg) {
     postTask([this, msg]() {
         if (connected_to_app_) {
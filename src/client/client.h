@@ -167,6 +167,8 @@ private:
     void onRemoteFileChunkAck(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onUserSwitchStretch();
     void resetVideoPipeline();
+    // 调用者持有dr_mutex_
+    bool recreateVideoPipeline(uint32_t width, uint32_t height, uint32_t rotation);
 
 private:
     std::unique_ptr<ltlib::Settings> settings_;
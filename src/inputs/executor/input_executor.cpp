@@ -79,6 +79,13 @@ void Executor::update() {
     }
 }
 
+void Executor::changeMonitor(const ltlib::Monitor& monitor) {
+    onMonitorChanged(monitor);
+    if (touch_) {
+        touch_->changeMonitor(monitor);
+    }
+}
+
 bool Executor::init() {
     if (!registerHandlers()) {
         return false;
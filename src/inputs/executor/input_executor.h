@@ -67,10 +67,13 @@ public:
 public:
     static std::unique_ptr<Executor> create(const Params& params);
     void update();
+    // 串流过程中显示模式变了, 绝对坐标按新的分辨率换算
+    void changeMonitor(const ltlib::Monitor& monitor);
     virtual ~Executor() = default;
 
 protected:
     virtual bool initKeyMouse() = 0;
+    virtual void onMonitorChanged(const ltlib::Monitor& monitor) = 0;
     virtual void onMouseEvent(const std::shared_ptr<google::protobuf::MessageLite>&) = 0;
     virtual void onKeyboardEvent(const std::shared_ptr<google::protobuf::MessageLite>&) = 0;
 
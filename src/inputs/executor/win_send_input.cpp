@@ -208,6 +208,12 @@ bool Win32SendInput::initKeyMouse() {
     return true;
 }
 
+void Win32SendInput::onMonitorChanged(const ltlib::Monitor& monitor) {
+    screen_width_ = static_cast<uint32_t>(monitor.width);
+    screen_height_ = static_cast<uint32_t>(monitor.height);
+    monitor_ = monitor;
+}
+
 void Win32SendInput::onMouseEvent(const std::shared_ptr<google::protobuf::MessageLite>& msg) {
     auto mouse = std::static_pointer_cast<ltproto::client2worker::MouseEvent>(msg);
     INPUT inputs[1] = {};
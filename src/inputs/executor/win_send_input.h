@@ -43,6 +43,7 @@ public:
 
 private:
     bool initKeyMouse() override;
+    void onMonitorChanged(const ltlib::Monitor& monitor) override;
     void onMouseEvent(const std::shared_ptr<google::protobuf::MessageLite>&) override;
     void onKeyboardEvent(const std::shared_ptr<google::protobuf::MessageLite>&) override;
 
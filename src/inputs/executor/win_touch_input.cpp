@@ -273,6 +273,15 @@ void WinTouch::update() {
     injectSyntheticPointerInput(touch_dev_, points_, using_points_);
 }
 
+void WinTouch::changeMonitor(const ltlib::Monitor& monitor) {
+    screen_width_ = static_cast<uint32_t>(monitor.width);
+    screen_height_ = static_cast<uint32_t>(monitor.height);
+    monitor_ = monitor;
+    // 别的显示器的位置可能也跟着变了
+    offset_x_ = GetSystemMetrics(SM_XVIRTUALSCREEN);
+    offset_y_ = GetSystemMetrics(SM_YVIRTUALSCREEN);
+}
+
 bool WinTouch::injectSyntheticPointerInput(HSYNTHETICPOINTERDEVICE device,
                                            const std::vector<POINTER_TYPE_INFO>& pointerInfo,
                                            uint32_t count) {
@@ -54,6 +54,7 @@ public:
 
     bool submit(const std::shared_ptr<google::protobuf::MessageLite>& msg);
     void update();
+    void changeMonitor(const ltlib::Monitor& monitor);
 
 private:
     WinTouch(uint32_t screen_width, uint32_t screen_height, ltlib::Monitor monitor);
@@ -35,6 +35,9 @@ namespace lt {
 // Signaling Keys
 inline const char kSigCoreClose[] = "close";
 
+// 共享内存帧环的名字是这个前缀加上worker的管道名
+inline const char kFrameRingPrefix[] = "lt_frame_ring_";
+
 // xxxx
 inline const char kIgnoredNetworkAdapters[] =
     "Tailscale;Netease;Virtual;TAP-Windows;Sangfor;OpenVPN;ZeroTier";
@@ -0,0 +1,209 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame_pool.h"
+
+#include <atomic>
+
+namespace {
+
+// 最小的一级64KB, 放得下一帧P帧码流
+constexpr int kMinClassBits = 16;
+
+// size落在哪一级, 以及那一级的容量
+size_t classOf(size_t size, size_t& capacity) {
+    if (size <= (size_t{1} << kMinClassBits)) {
+        capacity = size_t{1} << kMinClassBits;
+        return 0;
+    }
+    // 2^n < size <= 2^(n+1)
+    int n = 0;
+    while ((size - 1) >> (n + 1)) {
+        n++;
+    }
+    const size_t base = size_t{1} << n;
+    const size_t step = base / 4;
+    const size_t k = (size - base + step - 1) / step;
+    capacity = base + k * step;
+    return static_cast<size_t>(n - kMinClassBits) * 4 + k;
+}
+
+} // namespace
+
+namespace ltlib {
+
+FrameBuffer::FrameBuffer(size_t capacity)
+    : data_{new uint8_t[capacity]}
+    , capacity_{capacity} {}
+
+bool FrameBuffer::setImage(Format format, uint32_t width, uint32_t height) {
+    const size_t size = imageSize(format, width, height);
+    if (size == 0 || size > capacity_) {
+        return false;
+    }
+    const size_t luma = static_cast<size_t>(width) * height;
+    format_ = format;
+    width_ = width;
+    height_ = height;
+    size_ = size;
+    switch (format) {
+    case Format::I420:
+        planes_ = 3;
+        offsets_[0] = 0;
+        offsets_[1] = luma;
+        offsets_[2] = luma + luma / 4;
+        strides_[0] = static_cast<int>(width);
+        strides_[1] = static_cast<int>(width / 2);
+        strides_[2] = static_cast<int>(width / 2);
+        break;
+    case Format::NV12:
+        planes_ = 2;
+        offsets_[0] = 0;
+        offsets_[1] = luma;
+        strides_[0] = static_cast<int>(width);
+        strides_[1] = static_cast<int>(width);
+        break;
+    case Format::BGRA:
+    default:
+        planes_ = 1;
+        offsets_[0] = 0;
+        strides_[0] = static_cast<int>(width * 4);
+        break;
+    }
+    return true;
+}
+
+bool FrameBuffer::setBytes(size_t size) {
+    if (size > capacity_) {
+        return false;
+    }
+    Clear();
+    size_ = size;
+    strides_[0] = static_cast<int>(size);
+    return true;
+}
+
+void FrameBuffer::Clear() {
+    format_ = Format::Bytes;
+    width_ = 0;
+    height_ = 0;
+    size_ = 0;
+    planes_ = 1;
+    offsets_[0] = offsets_[1] = offsets_[2] = 0;
+    strides_[0] = strides_[1] = strides_[2] = 0;
+}
+
+size_t FrameBuffer::imageSize(Format format, uint32_t width, uint32_t height) {
+    const size_t luma = static_cast<size_t>(width) * height;
+    switch (format) {
+    case Format::I420:
+    case Format::NV12:
+        // 4:2:0要求宽高都是偶数
+        if (width % 2 != 0 || height % 2 != 0) {
+            return 0;
+        }
+        return luma * 3 / 2;
+    case Format::BGRA:
+        return luma * 4;
+    case Format::Bytes:
+    default:
+        return 0;
+    }
+}
+
+FramePool::FramePool(size_t buffers_per_class)
+    : buffers_per_class_{buffers_per_class} {}
+
+std::shared_ptr<FrameBuffer> FramePool::getImage(FrameBuffer::Format format, uint32_t width,
+                                                 uint32_t height) {
+    const size_t size = FrameBuffer::imageSize(format, width, height);
+    if (size == 0) {
+        return nullptr;
+    }
+    auto buffer = get(size);
+    buffer->setImage(format, width, height);
+    return buffer;
+}
+
+std::shared_ptr<FrameBuffer> FramePool::getBytes(size_t size) {
+    auto buffer = get(size);
+    buffer->setBytes(size);
+    return buffer;
+}
+
+bool FramePool::unique(const std::shared_ptr<FrameBuffer>& buffer) const {
+    size_t capacity = 0;
+    const size_t index = classOf(buffer->capacity(), capacity);
+    const bool pooled = index < classes_.size() && classes_[index] != nullptr &&
+                        classes_[index]->contains(buffer.get());
+    if (buffer.use_count() != (pooled ? 2 : 1)) {
+        return false;
+    }
+    // 见ObjectPool::get()
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+uint64_t FramePool::allocations() const {
+    uint64_t count = 0;
+    for (const auto& pool : classes_) {
+        count += pool == nullptr ? 0 : pool->misses();
+    }
+    return count;
+}
+
+uint64_t FramePool::reuses() const {
+    uint64_t count = 0;
+    for (const auto& pool : classes_) {
+        count += pool == nullptr ? 0 : pool->hits();
+    }
+    return count;
+}
+
+size_t FramePool::classCapacity(size_t size) {
+    size_t capacity = 0;
+    classOf(size, capacity);
+    return capacity;
+}
+
+std::shared_ptr<FrameBuffer> FramePool::get(size_t size) {
+    size_t capacity = 0;
+    const size_t index = classOf(size, capacity);
+    if (index >= classes_.size()) {
+        classes_.resize(index + 1);
+    }
+    if (classes_[index] == nullptr) {
+        classes_[index] = std::make_unique<ObjectPool<FrameBuffer>>(
+            buffers_per_class_, [capacity]() { return std::make_shared<FrameBuffer>(capacity); });
+    }
+    return classes_[index]->get();
+}
+
+} // namespace ltlib
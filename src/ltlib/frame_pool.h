@@ -0,0 +1,106 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <ltlib/object_pool.h>
+
+namespace ltlib {
+
+// 一块帧内存, 放原始画面或者编码后的码流. 从FramePool拿到, 最后一个持有者释放后回到池子里
+class FrameBuffer {
+public:
+    enum class Format { Bytes, I420, NV12, BGRA };
+
+public:
+    explicit FrameBuffer(size_t capacity);
+    // 按画面格式划分平面, 平面紧挨着, stride等于一行的字节数. 装不下时返回false
+    bool setImage(Format format, uint32_t width, uint32_t height);
+    bool setBytes(size_t size);
+    // 给ObjectPool复用前调用, 不释放内存
+    void Clear();
+
+    Format format() const { return format_; }
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    uint8_t* data() { return data_.get(); }
+    const uint8_t* data() const { return data_.get(); }
+    // Bytes和BGRA一个平面, NV12两个, I420三个
+    int planes() const { return planes_; }
+    uint8_t* plane(int index) { return data_.get() + offsets_[index]; }
+    const uint8_t* plane(int index) const { return data_.get() + offsets_[index]; }
+    int stride(int index) const { return strides_[index]; }
+
+    static size_t imageSize(Format format, uint32_t width, uint32_t height);
+
+private:
+    std::unique_ptr<uint8_t[]> data_;
+    const size_t capacity_;
+    size_t size_ = 0;
+    Format format_ = Format::Bytes;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    int planes_ = 0;
+    size_t offsets_[3] = {};
+    int strides_[3] = {};
+};
+
+// 按容量分级的FrameBuffer池. 每个2的幂区间再四等分, 一次请求落到能装下它的最小那一级,
+// 浪费不超过25%. 和ObjectPool一样只能在一个线程里get(), 拿到的buffer可以被任意线程持有、
+// 释放, 不需要归还也不需要锁. 同一级同时在外面的超过buffers_per_class个时, 多出来的不进池子
+class FramePool {
+public:
+    explicit FramePool(size_t buffers_per_class = 4);
+    std::shared_ptr<FrameBuffer> getImage(FrameBuffer::Format format, uint32_t width,
+                                          uint32_t height);
+    std::shared_ptr<FrameBuffer> getBytes(size_t size);
+    // 除了buffer这一份引用之外没有人在用, 可以直接改写. 和ObjectPool一样在返回true前补acquire fence
+    bool unique(const std::shared_ptr<FrameBuffer>& buffer) const;
+    // 新分配的buffer数, 稳定状态下不应该再涨
+    uint64_t allocations() const;
+    uint64_t reuses() const;
+
+    static size_t classCapacity(size_t size);
+
+private:
+    std::shared_ptr<FrameBuffer> get(size_t size);
+
+private:
+    const size_t buffers_per_class_;
+    std::vector<std::unique_ptr<ObjectPool<FrameBuffer>>> classes_;
+};
+
+} // namespace ltlib
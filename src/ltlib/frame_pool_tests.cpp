@@ -0,0 +1,244 @@
+#include <gtest/gtest.h>
+#include <ltlib/frame_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using ltlib::FrameBuffer;
+using ltlib::FramePool;
+
+namespace {
+
+// 模拟的发送线程, 定长的环形队列, 入队出队都不分配内存
+class FakeSender {
+public:
+    struct Item {
+        std::shared_ptr<FrameBuffer> raw;
+        std::shared_ptr<FrameBuffer> encoded;
+    };
+
+    explicit FakeSender(size_t depth)
+        : items_(depth) {
+        thread_ = std::thread{[this]() { loop(); }};
+    }
+
+    ~FakeSender() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void push(Item item) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [this]() { return count_ < items_.size(); });
+        items_[(head_ + count_) % items_.size()] = std::move(item);
+        count_ += 1;
+        cv_.notify_all();
+    }
+
+    // 等发送线程把手里的帧都放掉
+    void drain() {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [this]() { return count_ == 0 && !busy_; });
+    }
+
+    uint64_t sentBytes() const { return sent_bytes_; }
+
+private:
+    void loop() {
+        while (true) {
+            Item item;
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                cv_.wait(lock, [this]() { return stop_ || count_ > 0; });
+                if (stop_) {
+                    return;
+                }
+                item = std::move(items_[head_]);
+                head_ = (head_ + 1) % items_.size();
+                count_ -= 1;
+                busy_ = true;
+            }
+            sent_bytes_ += item.encoded->size();
+            item = Item{};
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                busy_ = false;
+            }
+            cv_.notify_all();
+        }
+    }
+
+private:
+    std::vector<Item> items_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::atomic<uint64_t> sent_bytes_{0};
+    std::thread thread_;
+};
+
+// 60帧一个关键帧, 其他帧大小在几十KB之间跳, 会落在不同的级别
+size_t encodedSize(int frame) {
+    if (frame % 60 == 0) {
+        return 500'000;
+    }
+    return 30'000 + static_cast<size_t>(frame * 7919 % 70'000);
+}
+
+// 抓屏->编码->交给发送线程, 原始画面和码流都在发送完之后才释放. pool为空时每帧new
+void runPipeline(FramePool* pool, FakeSender& sender, int first_frame, int frames) {
+    constexpr size_t kI420Size = 1920 * 1080 * 3 / 2;
+    for (int i = first_frame; i < first_frame + frames; i++) {
+        auto raw = pool ? pool->getImage(FrameBuffer::Format::I420, 1920, 1080)
+                        : std::make_shared<FrameBuffer>(kI420Size);
+        memset(raw->data(), i & 0xff, kI420Size);
+        auto encoded = pool ? pool->getBytes(encodedSize(i))
+                            : std::make_shared<FrameBuffer>(encodedSize(i));
+        memset(encoded->data(), i & 0xff, encodedSize(i));
+        sender.push({std::move(raw), std::move(encoded)});
+    }
+}
+
+} // namespace
+
+TEST(FramePoolTest, SizeClasses) {
+    EXPECT_EQ(FramePool::classCapacity(1), 65536u);
+    EXPECT_EQ(FramePool::classCapacity(65536), 65536u);
+    EXPECT_EQ(FramePool::classCapacity(65537), 81920u);
+    EXPECT_EQ(FramePool::classCapacity(131072), 131072u);
+    // 1080p I420
+    EXPECT_EQ(FramePool::classCapacity(3'110'400), 3'145'728u);
+    // 4K I420
+    EXPECT_EQ(FramePool::classCapacity(12'441'600), 12'582'912u);
+    for (size_t size = 1; size < 64u << 20; size = size * 3 / 2 + 1) {
+        const size_t capacity = FramePool::classCapacity(size);
+        EXPECT_GE(capacity, size);
+        EXPECT_LE(capacity, std::max<size_t>(65536, size + size / 4 + 1)) << size;
+    }
+}
+
+TEST(FramePoolTest, ImageLayout) {
+    FramePool pool;
+    auto i420 = pool.getImage(FrameBuffer::Format::I420, 64, 32);
+    ASSERT_NE(i420, nullptr);
+    EXPECT_EQ(i420->planes(), 3);
+    EXPECT_EQ(i420->size(), 64u * 32 * 3 / 2);
+    EXPECT_EQ(i420->plane(1), i420->plane(0) + 64 * 32);
+    EXPECT_EQ(i420->plane(2), i420->plane(1) + 32 * 16);
+    EXPECT_EQ(i420->stride(0), 64);
+    EXPECT_EQ(i420->stride(2), 32);
+
+    auto nv12 = pool.getImage(FrameBuffer::Format::NV12, 64, 32);
+    ASSERT_NE(nv12, nullptr);
+    EXPECT_EQ(nv12->planes(), 2);
+    EXPECT_EQ(nv12->stride(1), 64);
+    EXPECT_EQ(nv12->plane(1), nv12->plane(0) + 64 * 32);
+
+    auto bgra = pool.getImage(FrameBuffer::Format::BGRA, 64, 32);
+    ASSERT_NE(bgra, nullptr);
+    EXPECT_EQ(bgra->planes(), 1);
+    EXPECT_EQ(bgra->stride(0), 256);
+    EXPECT_EQ(bgra->size(), 64u * 32 * 4);
+
+    EXPECT_EQ(pool.getImage(FrameBuffer::Format::I420, 63, 32), nullptr);
+    EXPECT_EQ(pool.getImage(FrameBuffer::Format::Bytes, 64, 32), nullptr);
+}
+
+TEST(FramePoolTest, ReuseAfterRelease) {
+    FramePool pool;
+    auto held = pool.getBytes(70'000);
+    held->data()[0] = 42;
+    auto another = pool.getBytes(75'000);
+    EXPECT_NE(held.get(), another.get());
+    // 同一级的大小都能复用
+    FrameBuffer* raw = another.get();
+    another.reset();
+    auto reused = pool.getBytes(80'000);
+    EXPECT_EQ(reused.get(), raw);
+    EXPECT_EQ(reused->size(), 80'000u);
+    EXPECT_EQ(held->data()[0], 42);
+    // 画面和码流共用一级
+    reused.reset();
+    auto image = pool.getImage(FrameBuffer::Format::BGRA, 100, 200);
+    EXPECT_EQ(image.get(), raw);
+    EXPECT_EQ(image->format(), FrameBuffer::Format::BGRA);
+    EXPECT_EQ(pool.allocations(), 2u);
+    EXPECT_EQ(pool.reuses(), 2u);
+}
+
+TEST(FramePoolTest, Unique) {
+    FramePool pool{1};
+    auto first = pool.getBytes(100);
+    EXPECT_TRUE(pool.unique(first));
+    auto copy = first;
+    EXPECT_FALSE(pool.unique(first));
+    copy.reset();
+    EXPECT_TRUE(pool.unique(first));
+    // 超出容量的不在池子里
+    auto second = pool.getBytes(100);
+    EXPECT_TRUE(pool.unique(second));
+    copy = second;
+    EXPECT_FALSE(pool.unique(second));
+}
+
+TEST(FramePoolTest, ReleasedOnAnotherThread) {
+    FramePool pool;
+    auto buffer = pool.getImage(FrameBuffer::Format::I420, 1920, 1080);
+    FrameBuffer* raw = buffer.get();
+    std::thread t{[buffer = std::move(buffer)]() mutable { buffer.reset(); }};
+    t.join();
+    EXPECT_EQ(pool.getImage(FrameBuffer::Format::I420, 1920, 1080).get(), raw);
+}
+
+TEST(FramePoolTest, SteadyStateNoAllocation) {
+    constexpr int kFrames = 1000;
+    FramePool pool{8};
+    FakeSender sender{3};
+    // 预热: 队列里3帧, 发送线程手里1帧, 正在生产1帧, 每一级最多同时有5个在外面.
+    // 只靠跑一段流水线的话, 能不能碰到这个峰值要看线程调度
+    std::set<size_t> classes{FramePool::classCapacity(1920 * 1080 * 3 / 2)};
+    for (int i = 0; i < 300 + kFrames; i++) {
+        classes.insert(FramePool::classCapacity(encodedSize(i)));
+    }
+    std::vector<std::shared_ptr<FrameBuffer>> held;
+    for (size_t capacity : classes) {
+        for (int i = 0; i < 5; i++) {
+            held.push_back(pool.getBytes(capacity));
+        }
+    }
+    held.clear();
+    runPipeline(&pool, sender, 0, 300);
+    sender.drain();
+    const uint64_t buffers = pool.allocations();
+    const uint64_t reuses = pool.reuses();
+    const auto start = std::chrono::steady_clock::now();
+    runPipeline(&pool, sender, 300, kFrames);
+    sender.drain();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    // 每帧的画面和码流都是复用的
+    EXPECT_EQ(pool.allocations(), buffers);
+    EXPECT_EQ(pool.reuses() - reuses, 2u * kFrames);
+
+    // 对照: 每帧new一块画面和一块码流
+    const auto start2 = std::chrono::steady_clock::now();
+    runPipeline(nullptr, sender, 300, kFrames);
+    sender.drain();
+    const auto elapsed2 = std::chrono::steady_clock::now() - start2;
+    auto us = [](auto d) { return std::chrono::duration<double, std::micro>(d).count() / kFrames; };
+    printf("1080p pipeline, pooled: %.1fus/frame %llu buffers, unpooled: %.1fus/frame\n",
+           us(elapsed), static_cast<unsigned long long>(buffers), us(elapsed2));
+}
@@ -33,6 +33,7 @@
 #include <ltproto/ltproto.h>
 #include "client_transport_layer.h"
 #include "client_secure_layer.h"
+#include "ltproto_frame.h"
 
 namespace ltlib
 {
@@ -46,31 +47,46 @@ public:
     bool send(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg, const std::function<void()>& callback);
     bool send(const std::shared_ptr<uint8_t>& data, uint32_t len, const std::function<void()>& callback);
     void reconnect();
+    void networkChanged();
 
 private:
     CTransport::Params make_transport_params(const Client::Params& cparams);
+    bool send_packet(const ltproto::Packet& pkt, const std::function<void()>& callback);
     bool on_transport_connected();
     void on_transport_closed();
     void on_transport_reconnecting();
     bool on_transport_read(const Buffer& buff);
+    bool on_transport_read_block(const std::shared_ptr<uint8_t>& block, uint32_t len);
+    bool parse_frames();
 
 private:
     bool connected_ = false;
+    // 对端是ltlib::Server时用FrameParser; 外部的服务器(信令等)保持ltproto::Parser
+    const bool peer_is_ltlib_server_;
     IOLoop* ioloop_;
     std::function<void()> on_connected_;
     std::function<void()> on_closed_;
     std::function<void()> on_reconnecting_;
     std::function<void(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>&)> on_message_;
+    std::function<void(const MediaFrame&)> on_media_;
     std::unique_ptr<CTransport> transport_;
     ltproto::Parser parser_;
+    FrameParser frame_parser_;
+    std::shared_ptr<PayloadCipher> cipher_;
+    const std::string preamble_;
 };
 
 ClientImpl::ClientImpl(const Client::Params& params)
-    : ioloop_ { params.ioloop }
+    : peer_is_ltlib_server_ { params.stype == StreamType::Pipe || params.peer_is_ltlib_server }
+    , ioloop_ { params.ioloop }
     , on_connected_ { params.on_connected }
     , on_closed_ { params.on_closed }
     , on_reconnecting_ { params.on_reconnecting }
     , on_message_ { params.on_message }
+    , on_media_ { params.on_media }
+    , frame_parser_ { ltproto_frame_params() }
+    , cipher_ { params.cipher }
+    , preamble_ { params.preamble }
 {
     if (params.is_tls) {
         transport_ = std::make_unique<MbedtlsCTransport>(make_transport_params(params));
@@ -97,16 +113,31 @@ CTransport::Params ClientImpl::make_transport_params(const Client::Params& cpara
     tparams.on_closed = std::bind(&ClientImpl::on_transport_closed, this);
     tparams.on_reconnecting = std::bind(&ClientImpl::on_transport_reconnecting, this);
     tparams.on_read = std::bind(&ClientImpl::on_transport_read, this, std::placeholders::_1);
+    if (peer_is_ltlib_server_) {
+        tparams.on_read_block = std::bind(&ClientImpl::on_transport_read_block, this,
+            std::placeholders::_1, std::placeholders::_2);
+    }
     return tparams;
 }
 
 bool ClientImpl::init()
 {
+    if ((cipher_ != nullptr || !preamble_.empty()) && !peer_is_ltlib_server_) {
+        LOG(ERR) << "PayloadCipher and preamble only work with ltlib::Server";
+        return false;
+    }
     return transport_->init();
 }
 
 bool ClientImpl::on_transport_connected()
 {
+    if (!preamble_.empty()) {
+        Buffer buff { const_cast<char*>(preamble_.data()), static_cast<uint32_t>(preamble_.size()) };
+        if (!transport_->send(&buff, 1, []() {})) {
+            LOG(ERR) << "Send preamble failed";
+            return false;
+        }
+    }
     connected_ = true;
     on_connected_();
     return true;
@@ -122,11 +153,17 @@ void ClientImpl::on_transport_reconnecting()
 {
     connected_ = false;
     parser_.clear();
+    frame_parser_.clear();
     on_reconnecting_();
 }
 
 bool ClientImpl::on_transport_read(const Buffer& buff)
 {
+    if (peer_is_ltlib_server_) {
+        // 只有TLS解密后的明文会走到这里, 需要拷贝一次
+        frame_parser_.push_buffer(reinterpret_cast<const uint8_t*>(buff.base), static_cast<uint32_t>(buff.len));
+        return parse_frames();
+    }
     parser_.push_buffer(reinterpret_cast<const uint8_t*>(buff.base), buff.len);
     if (!parser_.parse_buffer()) {
         return false;
@@ -137,6 +174,37 @@ bool ClientImpl::on_transport_read(const Buffer& buff)
     return true;
 }
 
+bool ClientImpl::on_transport_read_block(const std::shared_ptr<uint8_t>& block, uint32_t len)
+{
+    frame_parser_.push_buffer(block, len);
+    return parse_frames();
+}
+
+bool ClientImpl::parse_frames()
+{
+    if (!frame_parser_.parse_buffer()) {
+        return false;
+    }
+    while (auto frame = frame_parser_.pop_frame()) {
+        if (cipher_ != nullptr && !ltproto_open_frame(frame.value(), *cipher_)) {
+            return false;
+        }
+        if (ltproto_is_media_frame(frame.value())) {
+            auto media = ltproto_decode_media_frame(frame.value());
+            if (media.has_value() && on_media_ != nullptr) {
+                on_media_(media.value());
+            }
+            continue;
+        }
+        uint32_t type = 0;
+        auto msg = ltproto_decode_frame(frame.value(), type);
+        if (msg != nullptr) {
+            on_message_(type, msg);
+        }
+    }
+    return true;
+}
+
 bool ClientImpl::send(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg, const std::function<void()>& callback)
 {
     if (!ioloop_->isCurrentThread()) {
@@ -146,22 +214,12 @@ bool ClientImpl::send(uint32_t type, const std::shared_ptr<google::protobuf::Mes
     if (!connected_) {
         return false;
     }
-    auto packet = ltproto::Packet::create({ type, msg }, true);
+    auto packet = ltproto::Packet::create({ type, msg }, !peer_is_ltlib_server_);
     if (!packet.has_value()) {
         LOG(ERR) << "Create net packet failed, type:" << type;
         return false;
     }
-    const auto& pkt = packet.value();
-    Buffer buff[2] = {
-        { (char*)&pkt.header, sizeof(pkt.header) },
-        { (char*)pkt.payload.get(), pkt.header.payload_size }
-    };
-    return transport_->send(buff, 2, [packet, callback]() {
-        // 把packet capture进来，是为了延续内部shared_ptr的生命周期
-        if (callback != nullptr) {
-            callback();
-        }
-    });
+    return send_packet(packet.value(), callback);
 }
 
 bool ClientImpl::send(const std::shared_ptr<uint8_t>& data, uint32_t len, const std::function<void()>& callback)
@@ -173,17 +231,37 @@ bool ClientImpl::send(const std::shared_ptr<uint8_t>& data, uint32_t len, const
     if (!connected_) {
         return false;
     }
-    auto packet = ltproto::Packet::create(data, len, true);
+    auto packet = ltproto::Packet::create(data, len, !peer_is_ltlib_server_);
     if (!packet.has_value()) {
         LOG(ERR) << "Create net packet failed";
         return false;
     }
-    const auto& pkt = packet.value();
+    return send_packet(packet.value(), callback);
+}
+
+bool ClientImpl::send_packet(const ltproto::Packet& pkt, const std::function<void()>& callback)
+{
+    if (cipher_ != nullptr) {
+        auto sealed = ltproto_seal_packet(pkt, *cipher_);
+        if (sealed == nullptr) {
+            return false;
+        }
+        Buffer buff[3] = {
+            { (char*)&sealed->packet.header, sizeof(sealed->packet.header) },
+            { (char*)sealed->packet.payload.get(), pkt.header.payload_size },
+            { (char*)sealed->trailer.data(), static_cast<uint32_t>(sealed->trailer.size()) }
+        };
+        return transport_->send(buff, 3, [sealed, callback]() {
+            if (callback != nullptr) {
+                callback();
+            }
+        });
+    }
     Buffer buff[2] = {
         { (char*)&pkt.header, sizeof(pkt.header) },
         { (char*)pkt.payload.get(), pkt.header.payload_size }
     };
-    return transport_->send(buff, 2, [packet, callback]() {
+    return transport_->send(buff, 2, [pkt, callback]() {
         // 把packet capture进来，是为了延续内部shared_ptr的生命周期
         if (callback != nullptr) {
             callback();
@@ -196,6 +274,11 @@ void ClientImpl::reconnect()
     transport_->reconnect();
 }
 
+void ClientImpl::networkChanged()
+{
+    transport_->networkChanged();
+}
+
 std::unique_ptr<Client> Client::create(const Params& params)
 {
     auto impl = std::make_shared<ClientImpl>(params);
@@ -222,4 +305,9 @@ void Client::reconnect()
     impl_->reconnect();
 }
 
+void Client::networkChanged()
+{
+    impl_->networkChanged();
+}
+
 } // namespace ltlib
\ No newline at end of file
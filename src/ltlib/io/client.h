@@ -35,6 +35,8 @@
 
 #include <google/protobuf/message_lite.h>
 
+#include <ltlib/io/media_frame.h>
+#include <ltlib/io/payload_cipher.h>
 #include <ltlib/io/types.h>
 
 namespace ltlib {
@@ -51,12 +53,20 @@ public:
         std::string host;
         uint16_t port = 0;
         bool is_tls = false;
+        // 对端是本仓库的ltlib::Server. 管道的对端总是ltlib::Server, 不需要设置
+        bool peer_is_ltlib_server = false;
         std::string cert;
         std::function<void()> on_connected;
         std::function<void()> on_closed;
         std::function<void()> on_reconnecting;
         std::function<void(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>&)>
             on_message;
+        // 可选, 收到媒体帧(见media_frame.h)时回调, 需要peer_is_ltlib_server或者管道
+        std::function<void(const MediaFrame&)> on_media;
+        // 可选, 需要peer_is_ltlib_server或者管道
+        std::shared_ptr<PayloadCipher> cipher;
+        // 可选, 每次(重)连上后最先发出去的字节, 对应ltlib::Server::Params::preamble_size
+        std::string preamble;
     };
 
 public:
@@ -70,6 +80,8 @@ public:
     // 2. 第二种是上层调用bool send()我们返回false，后续由上层主动调reconnect()
     // 无论哪种重连，都会回调on_reconnecting
     void reconnect();
+    // 网络发生变化(切换网卡、Wi-Fi漫游等)时调用, 正在等待的重连会立即进行
+    void networkChanged();
 
 private:
     std::shared_ptr<ClientImpl> impl_;
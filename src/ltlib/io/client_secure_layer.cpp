@@ -225,6 +225,8 @@ CTransport::Params MbedtlsCTransport::make_uv_params(const Params& params) {
     uvparams.on_closed = std::bind(&MbedtlsCTransport::on_uv_closed, this);
     uvparams.on_reconnecting = std::bind(&MbedtlsCTransport::on_uv_reconnecting, this);
     uvparams.on_read = std::bind(&MbedtlsCTransport::on_uv_read, this, std::placeholders::_1);
+    // 收到的是密文, 必须解密后再交给上层
+    uvparams.on_read_block = nullptr;
     return uvparams;
 }
 
@@ -428,6 +430,10 @@ void MbedtlsCTransport::reconnect() {
     uvtransport_.reconnect();
 }
 
+void MbedtlsCTransport::networkChanged() {
+    uvtransport_.networkChanged();
+}
+
 WARNING_DISABLE(6011)
 WARNING_DISABLE(6001)
 BIO* BIO::create() {
@@ -63,6 +63,7 @@ public:
     bool init() override;
     bool send(Buffer buff[], uint32_t buff_count, const std::function<void()>& callback) override;
     void reconnect() override;
+    void networkChanged() override;
 
 private:
     bool tls_init_context();
@@ -74,7 +74,8 @@ LibuvCTransport::LibuvCTransport(const Params& params)
     , on_connected_{params.on_connected}
     , on_closed_{params.on_closed}
     , on_reconnecting_{params.on_reconnecting}
-    , on_read_{params.on_read} {}
+    , on_read_{params.on_read}
+    , on_read_block_{params.on_read_block} {}
 
 LibuvCTransport::~LibuvCTransport() {
     uv_handle_t* handle = nullptr;
@@ -236,18 +237,37 @@ void LibuvCTransport::reconnect() {
         uv_close(conn, &LibuvCTransport::delay_reconnect);
     }
     else {
-        auto timer = new uv_timer_t;
-        uv_timer_init(uvloop(), timer);
-        timer->data = this;
-        uv_timer_start(timer, &LibuvCTransport::do_reconnect, intervals_.next(), 0);
-        {
-            std::lock_guard lock{timer_mtx_};
-            timers_.insert(timer);
-        }
+        start_reconnect_timer();
     }
     on_reconnecting_();
 }
 
+void LibuvCTransport::networkChanged() {
+    if (!ioloop_->isCurrentThread()) {
+        ioloop_->post(std::bind(&LibuvCTransport::networkChanged, this));
+        return;
+    }
+    intervals_.networkChanged();
+    // 正在等待重连的定时器立即触发
+    std::lock_guard lock{timer_mtx_};
+    for (auto timer : timers_) {
+        uv_timer_start(timer, &LibuvCTransport::do_reconnect, 0, 0);
+    }
+}
+
+void LibuvCTransport::start_reconnect_timer() {
+    int64_t interval_ms = intervals_.next();
+    LOG(DEBUG) << "Reconnect after " << interval_ms << "ms, attempts " << intervals_.attempts();
+    auto timer = new uv_timer_t;
+    uv_timer_init(uvloop(), timer);
+    timer->data = this;
+    uv_timer_start(timer, &LibuvCTransport::do_reconnect, static_cast<uint64_t>(interval_ms), 0);
+    {
+        std::lock_guard lock{timer_mtx_};
+        timers_.insert(timer);
+    }
+}
+
 void LibuvCTransport::delay_reconnect(uv_handle_t* handle) {
     auto that = (LibuvCTransport*)handle->data;
     if (that->is_tcp()) {
@@ -258,14 +278,7 @@ void LibuvCTransport::delay_reconnect(uv_handle_t* handle) {
         auto conn = (uv_pipe_t*)handle;
         delete conn;
     }
-    auto timer = new uv_timer_t;
-    uv_timer_init(that->uvloop(), timer);
-    timer->data = that;
-    uv_timer_start(timer, &LibuvCTransport::do_reconnect, that->intervals_.next(), 0);
-    {
-        std::lock_guard lock{that->timer_mtx_};
-        that->timers_.insert(timer);
-    }
+    that->start_reconnect_timer();
 }
 
 void LibuvCTransport::do_reconnect(uv_timer_t* handle) {
@@ -287,7 +300,8 @@ void LibuvCTransport::do_reconnect(uv_timer_t* handle) {
 void LibuvCTransport::on_connected(uv_connect_t* req, int status) {
     auto that = reinterpret_cast<LibuvCTransport*>(req->data);
     if (status == 0) {
-        that->intervals_.reset();
+        // 不在这里reset, 连接要稳定一段时间才重置退避状态
+        that->intervals_.onConnected();
         if (that->stype_ == StreamType::TCP) {
             sockaddr_in addr{};
             int name_len = sizeof(addr);
@@ -338,6 +352,14 @@ void LibuvCTransport::on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t
         // 失败，应该断链
         that->reconnect();
     }
+    else if (that->on_read_block_) {
+        // 读缓冲交给引用计数管理, 上层解析出的帧可以直接引用它
+        std::shared_ptr<uint8_t> block{reinterpret_cast<uint8_t*>(uvbuf->base),
+                                       [](uint8_t* p) { delete[] reinterpret_cast<char*>(p); }};
+        if (!that->on_read_block_(block, uint32_t(nread))) {
+            that->reconnect();
+        }
+    }
     else {
         // uvbuf.len是容量，nread才是我们想要的，不能用下面这种转法
         // const Buffer* buff = reinterpret_cast<const Buffer*>(uvbuf);
@@ -58,6 +58,8 @@ public:
         std::function<void()> on_closed;
         std::function<void()> on_reconnecting;
         std::function<bool(const Buffer&)> on_read;
+        // 可选. 设置后读缓冲直接交给它, 不再走on_read, 上层可以免拷贝地引用这块内存
+        std::function<bool(const std::shared_ptr<uint8_t>&, uint32_t)> on_read_block;
     };
 
 public:
@@ -66,6 +68,7 @@ public:
     virtual bool send(Buffer buff[], uint32_t buff_count,
                       const std::function<void()>& callback) = 0;
     virtual void reconnect() = 0;
+    virtual void networkChanged() = 0;
 };
 
 class LibuvCTransport : public CTransport {
@@ -75,6 +78,7 @@ public:
     bool init() override;
     bool send(Buffer buff[], uint32_t buff_count, const std::function<void()>& callback) override;
     void reconnect() override;
+    void networkChanged() override;
     bool is_tcp() const;
     const std::string& pipe_name();
     const std::string& host();
@@ -91,6 +95,7 @@ private:
     uv_stream_t* uvstream();
     uv_handle_t* uvhandle();
     uv_handle_t* uvhandle_release();
+    void start_reconnect_timer();
     static void delay_reconnect(uv_handle_t* handle);
     static void do_reconnect(uv_timer_t* handle);
     static void on_connected(uv_connect_t* req, int status);
@@ -114,6 +119,7 @@ private:
     std::function<void()> on_closed_;
     std::function<void()> on_reconnecting_;
     std::function<bool(const Buffer&)> on_read_;
+    std::function<bool(const std::shared_ptr<uint8_t>&, uint32_t)> on_read_block_;
     ltlib::ReconnectInterval intervals_;
     std::set<uv_timer_t*> timers_;
     std::mutex timer_mtx_;
@@ -0,0 +1,150 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame_parser.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ltlib {
+
+FrameParser::FrameParser(const Params& params)
+    : params_{params}
+    , header_buff_(params.header_size) {}
+
+void FrameParser::push_buffer(const std::shared_ptr<uint8_t>& block, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+    segments_.push_back({block, 0, len});
+    buffered_size_ += len;
+}
+
+void FrameParser::push_buffer(const uint8_t* data, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+    std::shared_ptr<uint8_t> block{new uint8_t[len], std::default_delete<uint8_t[]>()};
+    memcpy(block.get(), data, len);
+    push_buffer(block, len);
+}
+
+bool FrameParser::parse_buffer() {
+    while (buffered_size_ >= params_.header_size) {
+        auto payload_size = params_.payload_size(peek_header());
+        if (!payload_size.has_value() || payload_size.value() > params_.max_payload_size) {
+            return false;
+        }
+        const uint32_t frame_size = params_.header_size + payload_size.value();
+        if (buffered_size_ < frame_size) {
+            // 帧还没收齐, 先不拼接, 等收齐了再一次性拷贝
+            break;
+        }
+        Frame frame{};
+        frame.header_size = params_.header_size;
+        frame.payload_size = payload_size.value();
+        auto& front = segments_.front();
+        if (front.len >= frame_size) {
+            // 完整落在一个读缓冲里, 共享引用计数, 不拷贝
+            frame.data = std::shared_ptr<uint8_t>{front.block, front.block.get() + front.offset};
+            consume(frame_size);
+        }
+        else {
+            std::shared_ptr<uint8_t> block{new uint8_t[frame_size],
+                                           std::default_delete<uint8_t[]>()};
+            copy_out(block.get(), frame_size);
+            frame.data = block;
+            stitched_frames_ += 1;
+            stitched_bytes_ += frame_size;
+        }
+        frames_.push_back(std::move(frame));
+    }
+    return true;
+}
+
+std::optional<Frame> FrameParser::pop_frame() {
+    if (frames_.empty()) {
+        return std::nullopt;
+    }
+    Frame frame = std::move(frames_.front());
+    frames_.pop_front();
+    return frame;
+}
+
+void FrameParser::clear() {
+    segments_.clear();
+    frames_.clear();
+    buffered_size_ = 0;
+}
+
+const uint8_t* FrameParser::peek_header() {
+    auto& front = segments_.front();
+    if (front.len >= params_.header_size) {
+        return front.block.get() + front.offset;
+    }
+    // 帧头本身跨越了读缓冲, 只拷贝帧头
+    uint32_t copied = 0;
+    for (auto& seg : segments_) {
+        uint32_t n = std::min(seg.len, params_.header_size - copied);
+        memcpy(header_buff_.data() + copied, seg.block.get() + seg.offset, n);
+        copied += n;
+        if (copied == params_.header_size) {
+            break;
+        }
+    }
+    return header_buff_.data();
+}
+
+void FrameParser::copy_out(uint8_t* dst, uint32_t len) {
+    uint32_t copied = 0;
+    while (copied < len) {
+        auto& front = segments_.front();
+        uint32_t n = std::min(front.len, len - copied);
+        memcpy(dst + copied, front.block.get() + front.offset, n);
+        copied += n;
+        consume(n);
+    }
+}
+
+void FrameParser::consume(uint32_t len) {
+    buffered_size_ -= len;
+    while (len > 0) {
+        auto& front = segments_.front();
+        if (front.len > len) {
+            front.offset += len;
+            front.len -= len;
+            return;
+        }
+        len -= front.len;
+        segments_.pop_front();
+    }
+}
+
+} // namespace ltlib
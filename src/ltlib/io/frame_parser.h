@@ -0,0 +1,96 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace ltlib {
+
+// 一个完整的帧. data指向帧头, 与它所在的读缓冲共享引用计数, 持有Frame即可保证数据有效.
+// 各个帧占用的内存互不重叠, 上层可以原地修改(比如解密)
+struct Frame {
+    std::shared_ptr<uint8_t> data;
+    uint32_t header_size = 0;
+    uint32_t payload_size = 0;
+    uint8_t* header() const { return data.get(); }
+    uint8_t* payload() const { return data.get() + header_size; }
+};
+
+// 分帧器, 直接从读缓冲里解析帧头, 不维护一个不断增长的内部缓冲:
+// 1. 完整落在一个读缓冲里的帧, 以视图的方式交给上层, 不拷贝;
+// 2. 只有跨越多个读缓冲的帧, 才会拼接到一块刚好等于帧长度的新内存里.
+class FrameParser {
+public:
+    struct Params {
+        uint32_t header_size = 0;
+        uint32_t max_payload_size = 64 * 1024 * 1024;
+        // 从帧头里取出payload长度, 帧头非法时返回std::nullopt
+        std::function<std::optional<uint32_t>(const uint8_t* header)> payload_size;
+    };
+
+public:
+    explicit FrameParser(const Params& params);
+    // block会被引用住, 直到其中所有的帧都被上层释放
+    void push_buffer(const std::shared_ptr<uint8_t>& block, uint32_t len);
+    // 借用的缓冲, 调用返回后即失效, 所以会先拷贝一份
+    void push_buffer(const uint8_t* data, uint32_t len);
+    bool parse_buffer();
+    std::optional<Frame> pop_frame();
+    void clear();
+    uint32_t header_size() const { return params_.header_size; }
+    uint64_t stitched_frames() const { return stitched_frames_; }
+    uint64_t stitched_bytes() const { return stitched_bytes_; }
+
+private:
+    struct Segment {
+        std::shared_ptr<uint8_t> block;
+        uint32_t offset;
+        uint32_t len;
+    };
+    const uint8_t* peek_header();
+    void copy_out(uint8_t* dst, uint32_t len);
+    void consume(uint32_t len);
+
+private:
+    const Params params_;
+    std::deque<Segment> segments_;
+    std::deque<Frame> frames_;
+    std::vector<uint8_t> header_buff_;
+    size_t buffered_size_ = 0;
+    uint64_t stitched_frames_ = 0;
+    uint64_t stitched_bytes_ = 0;
+};
+
+} // namespace ltlib
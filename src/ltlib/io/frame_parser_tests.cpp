@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "frame_parser.h"
+
+namespace {
+
+// 测试用的帧格式: [uint32_t magic | uint32_t payload_size | payload]
+constexpr uint32_t kMagic = 0x4C544650;
+constexpr uint32_t kHeaderSize = 8;
+
+ltlib::FrameParser::Params testParams() {
+    ltlib::FrameParser::Params params{};
+    params.header_size = kHeaderSize;
+    params.max_payload_size = 16 * 1024 * 1024;
+    params.payload_size = [](const uint8_t* header) -> std::optional<uint32_t> {
+        uint32_t magic;
+        uint32_t size;
+        memcpy(&magic, header, 4);
+        memcpy(&size, header + 4, 4);
+        if (magic != kMagic) {
+            return std::nullopt;
+        }
+        return size;
+    };
+    return params;
+}
+
+void appendFrame(std::vector<uint8_t>& stream, const std::vector<uint8_t>& payload) {
+    uint32_t size = static_cast<uint32_t>(payload.size());
+    size_t pos = stream.size();
+    stream.resize(pos + kHeaderSize + payload.size());
+    memcpy(stream.data() + pos, &kMagic, 4);
+    memcpy(stream.data() + pos + 4, &size, 4);
+    if (!payload.empty()) {
+        memcpy(stream.data() + pos + kHeaderSize, payload.data(), payload.size());
+    }
+}
+
+std::shared_ptr<uint8_t> makeBlock(const uint8_t* data, uint32_t len) {
+    std::shared_ptr<uint8_t> block{new uint8_t[len], std::default_delete<uint8_t[]>()};
+    memcpy(block.get(), data, len);
+    return block;
+}
+
+} // namespace
+
+class FrameParserTest : public testing::Test {
+protected:
+    std::vector<uint8_t> randomPayload(size_t max_size) {
+        std::uniform_int_distribution<size_t> size_dist{0, max_size};
+        std::vector<uint8_t> payload(size_dist(rand_engine_));
+        for (auto& byte : payload) {
+            byte = static_cast<uint8_t>(rand_engine_());
+        }
+        return payload;
+    }
+
+    std::mt19937 rand_engine_{20231120};
+};
+
+TEST_F(FrameParserTest, ContiguousFramesAreNotCopied) {
+    std::vector<uint8_t> stream;
+    std::vector<std::vector<uint8_t>> payloads;
+    for (int i = 0; i < 16; i++) {
+        payloads.push_back(randomPayload(512));
+        appendFrame(stream, payloads.back());
+    }
+    auto block = makeBlock(stream.data(), static_cast<uint32_t>(stream.size()));
+    ltlib::FrameParser parser{testParams()};
+    parser.push_buffer(block, static_cast<uint32_t>(stream.size()));
+    ASSERT_TRUE(parser.parse_buffer());
+    for (auto& payload : payloads) {
+        auto frame = parser.pop_frame();
+        ASSERT_TRUE(frame.has_value());
+        ASSERT_EQ(frame->payload_size, payload.size());
+        EXPECT_EQ(memcmp(frame->payload(), payload.data(), payload.size()), 0);
+        // 视图直接指向读缓冲
+        EXPECT_GE(frame->header(), block.get());
+        EXPECT_LT(frame->header(), block.get() + stream.size());
+    }
+    EXPECT_FALSE(parser.pop_frame().has_value());
+    EXPECT_EQ(parser.stitched_frames(), 0u);
+}
+
+TEST_F(FrameParserTest, FrameKeepsBufferAlive) {
+    std::vector<uint8_t> stream;
+    std::vector<uint8_t> payload(100, 0xAB);
+    appendFrame(stream, payload);
+    std::weak_ptr<uint8_t> weak;
+    std::optional<ltlib::Frame> frame;
+    {
+        ltlib::FrameParser parser{testParams()};
+        auto block = makeBlock(stream.data(), static_cast<uint32_t>(stream.size()));
+        weak = block;
+        parser.push_buffer(block, static_cast<uint32_t>(stream.size()));
+        ASSERT_TRUE(parser.parse_buffer());
+        frame = parser.pop_frame();
+    }
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_FALSE(weak.expired());
+    EXPECT_EQ(frame->payload()[99], 0xAB);
+    frame.reset();
+    EXPECT_TRUE(weak.expired());
+}
+
+TEST_F(FrameParserTest, InvalidHeader) {
+    std::vector<uint8_t> stream(64, 0xFF);
+    ltlib::FrameParser parser{testParams()};
+    parser.push_buffer(stream.data(), static_cast<uint32_t>(stream.size()));
+    EXPECT_FALSE(parser.parse_buffer());
+}
+
+TEST_F(FrameParserTest, PayloadTooLarge) {
+    std::vector<uint8_t> stream(kHeaderSize);
+    uint32_t size = 32 * 1024 * 1024;
+    memcpy(stream.data(), &kMagic, 4);
+    memcpy(stream.data() + 4, &size, 4);
+    ltlib::FrameParser parser{testParams()};
+    parser.push_buffer(stream.data(), static_cast<uint32_t>(stream.size()));
+    EXPECT_FALSE(parser.parse_buffer());
+}
+
+// 随机切分字节流, 包括把帧头切开的情况, 校验还原出的帧与原始数据一致
+TEST_F(FrameParserTest, FuzzRandomSplit) {
+    for (int round = 0; round < 200; round++) {
+        std::vector<uint8_t> stream;
+        std::vector<std::vector<uint8_t>> payloads;
+        std::uniform_int_distribution<int> count_dist{1, 64};
+        int count = count_dist(rand_engine_);
+        for (int i = 0; i < count; i++) {
+            payloads.push_back(randomPayload(round % 2 == 0 ? 64 : 8192));
+            appendFrame(stream, payloads.back());
+        }
+        ltlib::FrameParser parser{testParams()};
+        std::vector<ltlib::Frame> frames;
+        std::uniform_int_distribution<size_t> chunk_dist{1, 3 * kHeaderSize + round * 50};
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            size_t len = std::min(chunk_dist(rand_engine_), stream.size() - pos);
+            if (rand_engine_() % 2 == 0) {
+                parser.push_buffer(makeBlock(stream.data() + pos, static_cast<uint32_t>(len)),
+                                   static_cast<uint32_t>(len));
+            }
+            else {
+                parser.push_buffer(stream.data() + pos, static_cast<uint32_t>(len));
+            }
+            pos += len;
+            ASSERT_TRUE(parser.parse_buffer());
+            while (auto frame = parser.pop_frame()) {
+                frames.push_back(frame.value());
+            }
+        }
+        ASSERT_EQ(frames.size(), payloads.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            ASSERT_EQ(frames[i].payload_size, payloads[i].size());
+            EXPECT_EQ(memcmp(frames[i].payload(), payloads[i].data(), payloads[i].size()), 0);
+        }
+        EXPECT_LE(parser.stitched_frames(), payloads.size());
+    }
+}
+
+// 随机字节, 不能崩溃, 解析出来的帧长度不能越界
+TEST_F(FrameParserTest, FuzzGarbage) {
+    for (int round = 0; round < 1000; round++) {
+        ltlib::FrameParser parser{testParams()};
+        std::vector<uint8_t> stream = randomPayload(256);
+        // 一半的情况构造一个合法的magic, 让长度字段是随机的
+        if (stream.size() >= 4 && round % 2 == 0) {
+            memcpy(stream.data(), &kMagic, 4);
+        }
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            size_t len = std::min<size_t>(1 + rand_engine_() % 32, stream.size() - pos);
+            parser.push_buffer(stream.data() + pos, static_cast<uint32_t>(len));
+            pos += len;
+            if (!parser.parse_buffer()) {
+                break;
+            }
+            while (auto frame = parser.pop_frame()) {
+                EXPECT_LE(frame->header_size + frame->payload_size, stream.size());
+            }
+        }
+    }
+}
+
+TEST_F(FrameParserTest, Throughput) {
+    constexpr uint32_t kReadSize = 64 * 1024;
+    constexpr size_t kTotalBytes = 256 * 1024 * 1024;
+    for (size_t frame_size : {size_t{200}, size_t{4 * 1024}, size_t{256 * 1024}}) {
+        std::vector<uint8_t> stream;
+        while (stream.size() < 4 * kReadSize) {
+            appendFrame(stream, std::vector<uint8_t>(frame_size));
+        }
+        ltlib::FrameParser parser{testParams()};
+        size_t total = 0;
+        size_t pos = 0;
+        uint64_t frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (total < kTotalBytes) {
+            uint32_t len = static_cast<uint32_t>(std::min<size_t>(kReadSize, stream.size() - pos));
+            // 模拟传输层每次读分配一块新内存
+            parser.push_buffer(makeBlock(stream.data() + pos, len), len);
+            ASSERT_TRUE(parser.parse_buffer());
+            while (auto frame = parser.pop_frame()) {
+                frames++;
+            }
+            pos = (pos + len) % stream.size();
+            total += len;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        printf("frame:%zuB frames:%" PRIu64 " stitched:%" PRIu64 " %.1fMB/s\n", frame_size,
+               frames, parser.stitched_frames(), total / seconds / 1024 / 1024);
+    }
+}
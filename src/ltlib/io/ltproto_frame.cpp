@@ -0,0 +1,174 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ltproto_frame.h"
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+#include <ltlib/logging.h>
+#include <ltlib/message_pool.h>
+
+namespace {
+
+using PacketHeader = decltype(ltproto::Packet::header);
+static_assert(std::is_trivially_copyable_v<PacketHeader>);
+
+// ltproto没有导出magic和xor标记的定义, 拿发送端同样的Packet::create()编一个头做参照.
+// 除了payload_size, magic和xor标记这些字段每个包都一样
+std::optional<PacketHeader> makeReferenceHeader(bool xor_payload) {
+    std::shared_ptr<uint8_t> payload{new uint8_t[sizeof(uint32_t)](),
+                                     std::default_delete<uint8_t[]>()};
+    auto packet = ltproto::Packet::create(payload, sizeof(uint32_t), xor_payload);
+    if (!packet.has_value()) {
+        return std::nullopt;
+    }
+    return packet->header;
+}
+
+const std::optional<PacketHeader>& referenceHeader() {
+    static const std::optional<PacketHeader> header = makeReferenceHeader(false);
+    return header;
+}
+
+const std::optional<PacketHeader>& xorReferenceHeader() {
+    static const std::optional<PacketHeader> header = makeReferenceHeader(true);
+    return header;
+}
+
+bool sameExceptPayloadSize(const PacketHeader& lhs, const PacketHeader& rhs) {
+    constexpr size_t kBegin = offsetof(PacketHeader, payload_size);
+    constexpr size_t kEnd = kBegin + sizeof(PacketHeader::payload_size);
+    const auto l = reinterpret_cast<const uint8_t*>(&lhs);
+    const auto r = reinterpret_cast<const uint8_t*>(&rhs);
+    return memcmp(l, r, kBegin) == 0 &&
+           memcmp(l + kEnd, r + kEnd, sizeof(PacketHeader) - kEnd) == 0;
+}
+
+} // namespace
+
+namespace ltlib {
+
+FrameParser::Params ltproto_frame_params() {
+    FrameParser::Params params{};
+    params.header_size = sizeof(PacketHeader);
+    params.payload_size = [](const uint8_t* data) -> std::optional<uint32_t> {
+        PacketHeader header;
+        memcpy(&header, data, sizeof(header));
+        // magic不对说明流已经错位; 带xor的包见ltproto_is_xor_header()
+        const auto& reference = referenceHeader();
+        if (!reference.has_value() || !sameExceptPayloadSize(header, reference.value()) ||
+            header.payload_size < sizeof(uint32_t)) {
+            return std::nullopt;
+        }
+        return header.payload_size;
+    };
+    return params;
+}
+
+bool ltproto_is_xor_header(const uint8_t* data) {
+    PacketHeader header;
+    memcpy(&header, data, sizeof(header));
+    const auto& reference = xorReferenceHeader();
+    return reference.has_value() && sameExceptPayloadSize(header, reference.value());
+}
+
+std::shared_ptr<google::protobuf::MessageLite> ltproto_decode_frame(const Frame& frame,
+                                                                    uint32_t& type) {
+    memcpy(&type, frame.payload(), sizeof(type));
+    auto msg = MessagePool::local().get(type);
+    if (msg == nullptr) {
+        LOG(ERR) << "Unknown message type: " << type;
+        return nullptr;
+    }
+    const uint8_t* pb = frame.payload() + sizeof(type);
+    const int pb_size = static_cast<int>(frame.payload_size - sizeof(type));
+    if (!msg->ParseFromArray(pb, pb_size)) {
+        LOG(ERR) << "Parse message failed, type: " << type;
+        return nullptr;
+    }
+    return msg;
+}
+
+bool ltproto_is_media_frame(const Frame& frame) {
+    return is_media_frame(frame.payload(), frame.payload_size);
+}
+
+std::optional<MediaFrame> ltproto_decode_media_frame(const Frame& frame) {
+    auto media = decode_media_frame(frame.payload(), frame.payload_size);
+    if (!media.has_value()) {
+        LOG(ERR) << "Invalid media frame, size: " << frame.payload_size;
+        return std::nullopt;
+    }
+    media->holder = frame.data;
+    return media;
+}
+
+bool ltproto_encode_media_head(const MediaHeader& header, uint32_t payload_size, uint8_t* out) {
+    const auto& reference = referenceHeader();
+    if (!reference.has_value()) {
+        return false;
+    }
+    PacketHeader packet_header = reference.value();
+    packet_header.payload_size = MediaHeader::kSize + payload_size;
+    memcpy(out, &packet_header, sizeof(packet_header));
+    encode_media_header(header, payload_size, out + sizeof(packet_header));
+    return true;
+}
+
+std::shared_ptr<SealedPacket> ltproto_seal_packet(const ltproto::Packet& packet,
+                                                  PayloadCipher& cipher) {
+    auto sealed = std::make_shared<SealedPacket>();
+    sealed->packet = packet;
+    sealed->trailer.resize(cipher.overhead());
+    if (!cipher.seal(packet.payload.get(), packet.header.payload_size, sealed->trailer.data())) {
+        LOG(ERR) << "Encrypt payload failed";
+        return nullptr;
+    }
+    sealed->packet.header.payload_size += cipher.overhead();
+    return sealed;
+}
+
+bool ltproto_open_frame(Frame& frame, PayloadCipher& cipher) {
+    if (frame.payload_size < cipher.overhead() + sizeof(uint32_t)) {
+        LOG(ERR) << "Encrypted frame too small: " << frame.payload_size;
+        return false;
+    }
+    if (!cipher.open(frame.payload(), frame.payload_size)) {
+        LOG(ERR) << "Decrypt payload failed, frame tampered or replayed";
+        return false;
+    }
+    frame.payload_size -= cipher.overhead();
+    return true;
+}
+
+} // namespace ltlib
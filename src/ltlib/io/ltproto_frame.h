@@ -0,0 +1,84 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <google/protobuf/message_lite.h>
+
+#include <ltlib/io/payload_cipher.h>
+#include <ltproto/ltproto.h>
+
+#include "frame_parser.h"
+#include "media_frame.h"
+
+namespace ltlib {
+
+// ltproto::Packet的帧格式: [header | uint32_t type | protobuf]
+// 只用于两端都在本仓库内的连接(ltlib::Server与连接它的ltlib::Client),
+// 发送端使用Packet::create(..., false)
+FrameParser::Params ltproto_frame_params();
+
+// 旧版本的客户端发的是Packet::create(..., true)编出来的带xor的包, FrameParser不认,
+// 只能交给ltproto::Parser. data至少要有ltproto_frame_params().header_size个字节
+bool ltproto_is_xor_header(const uint8_t* data);
+
+std::shared_ptr<google::protobuf::MessageLite> ltproto_decode_frame(const Frame& frame,
+                                                                    uint32_t& type);
+
+// 媒体帧的magic占了type的位置, 它不走protobuf, payload整个就是媒体帧
+bool ltproto_is_media_frame(const Frame& frame);
+
+// 返回的MediaFrame持有frame的缓冲
+std::optional<MediaFrame> ltproto_decode_media_frame(const Frame& frame);
+
+// 媒体帧的包头和MediaHeader连在一起的长度, 数据可以放在另一块内存里用scatter/gather发出去
+constexpr uint32_t kLtprotoMediaHeadSize =
+    sizeof(decltype(ltproto::Packet::header)) + MediaHeader::kSize;
+
+// 往out写入kLtprotoMediaHeadSize字节, 后面跟着payload_size字节的数据就是一个完整的包
+bool ltproto_encode_media_head(const MediaHeader& header, uint32_t payload_size, uint8_t* out);
+
+// 加密后的包, 帧头里的payload_size已经包含了帧尾
+struct SealedPacket {
+    ltproto::Packet packet;
+    std::vector<uint8_t> trailer;
+};
+
+// payload原地加密
+std::shared_ptr<SealedPacket> ltproto_seal_packet(const ltproto::Packet& packet,
+                                                  PayloadCipher& cipher);
+
+// 原地解密, 成功后frame.payload_size不再包含帧尾
+bool ltproto_open_frame(Frame& frame, PayloadCipher& cipher);
+
+} // namespace ltlib
@@ -0,0 +1,122 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "media_frame.h"
+
+#include <cstring>
+
+namespace {
+
+// 所有支持的平台都是小端, 直接memcpy
+template <typename T> void store(uint8_t* out, size_t offset, T value) {
+    memcpy(out + offset, &value, sizeof(T));
+}
+
+template <typename T> T load(const uint8_t* data, size_t offset) {
+    T value;
+    memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+namespace ltlib {
+
+void encode_media_header(const MediaHeader& header, uint32_t payload_size, uint8_t* out) {
+    store<uint32_t>(out, 0, MediaHeader::kMagic);
+    store<uint8_t>(out, 4, MediaHeader::kVersion);
+    store<uint8_t>(out, 5, static_cast<uint8_t>(header.kind));
+    store<uint16_t>(out, 6, MediaHeader::kSize);
+    store<uint16_t>(out, 8, header.flags);
+    store<uint8_t>(out, 10, header.codec);
+    store<uint8_t>(out, 11, header.temporal_id);
+    store<uint32_t>(out, 12, payload_size);
+    store<uint64_t>(out, 16, header.frame_id);
+    store<int64_t>(out, 24, header.capture_timestamp_us);
+    store<int64_t>(out, 32, header.start_encode_timestamp_us);
+    store<int64_t>(out, 40, header.end_encode_timestamp_us);
+    store<uint32_t>(out, 48, header.width);
+    store<uint32_t>(out, 52, header.height);
+    store<uint32_t>(out, 56, header.fragment_offset);
+    store<uint32_t>(out, 60, header.frame_size == 0 ? payload_size : header.frame_size);
+    store<int64_t>(out, 64, header.send_timestamp_us);
+}
+
+std::shared_ptr<uint8_t> encode_media_frame(const MediaHeader& header, const uint8_t* payload,
+                                            uint32_t payload_size, uint32_t& frame_size) {
+    frame_size = MediaHeader::kSize + payload_size;
+    std::shared_ptr<uint8_t> frame{new uint8_t[frame_size], std::default_delete<uint8_t[]>()};
+    encode_media_header(header, payload_size, frame.get());
+    if (payload_size != 0) {
+        memcpy(frame.get() + MediaHeader::kSize, payload, payload_size);
+    }
+    return frame;
+}
+
+bool is_media_frame(const uint8_t* data, uint32_t size) {
+    return size >= sizeof(uint32_t) && load<uint32_t>(data, 0) == MediaHeader::kMagic;
+}
+
+void set_media_send_timestamp(uint8_t* data, int64_t send_timestamp_us) {
+    store<int64_t>(data, 64, send_timestamp_us);
+}
+
+std::optional<MediaFrame> decode_media_frame(const uint8_t* data, uint32_t size) {
+    if (size < MediaHeader::kSize || !is_media_frame(data, size)) {
+        return std::nullopt;
+    }
+    const uint8_t version = load<uint8_t>(data, 4);
+    const uint16_t header_size = load<uint16_t>(data, 6);
+    const uint32_t payload_size = load<uint32_t>(data, 12);
+    if (version != MediaHeader::kVersion || header_size < MediaHeader::kSize ||
+        header_size > size || payload_size != size - header_size) {
+        return std::nullopt;
+    }
+    MediaFrame frame{};
+    // 不认识的kind原样带出去, 由调用方跳过
+    frame.header.kind = static_cast<MediaHeader::Kind>(load<uint8_t>(data, 5));
+    frame.header.flags = load<uint16_t>(data, 8);
+    frame.header.codec = load<uint8_t>(data, 10);
+    frame.header.temporal_id = load<uint8_t>(data, 11);
+    frame.header.frame_id = load<uint64_t>(data, 16);
+    frame.header.capture_timestamp_us = load<int64_t>(data, 24);
+    frame.header.start_encode_timestamp_us = load<int64_t>(data, 32);
+    frame.header.end_encode_timestamp_us = load<int64_t>(data, 40);
+    frame.header.width = load<uint32_t>(data, 48);
+    frame.header.height = load<uint32_t>(data, 52);
+    frame.header.fragment_offset = load<uint32_t>(data, 56);
+    frame.header.frame_size = load<uint32_t>(data, 60);
+    frame.header.send_timestamp_us = load<int64_t>(data, 64);
+    frame.payload = data + header_size;
+    frame.payload_size = payload_size;
+    return frame;
+}
+
+} // namespace ltlib
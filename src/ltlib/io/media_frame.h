@@ -0,0 +1,117 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace ltlib {
+
+// 音视频帧的定长二进制头, 数据紧跟在头后面, 收发两端都不需要protobuf序列化/解析, 也不需要分配内存.
+// 布局(小端序, 共kSize字节):
+//   0  uint32_t magic          8  uint16_t flags         12 uint32_t payload_size
+//   4  uint8_t  version        10 uint8_t  codec         16 uint64_t frame_id
+//   5  uint8_t  kind           11 uint8_t  temporal_id   24 int64_t  capture_timestamp_us
+//   6  uint16_t header_size                              32 int64_t  start_encode_timestamp_us
+//                                                        40 int64_t  end_encode_timestamp_us
+//                                                        48 uint32_t width, 52 uint32_t height
+//                                                        56 uint32_t fragment_offset
+//                                                        60 uint32_t frame_size
+//                                                        64 int64_t  send_timestamp_us
+// magic正好占ltproto::Packet里type的位置, 所以媒体帧能和普通消息走同一条连接.
+// 向前兼容: 新字段只追加在末尾并增大header_size, 旧版本按header_size跳过不认识的部分,
+// 不认识的flags位直接忽略. 只有不兼容的改动才增加version.
+struct MediaHeader {
+    enum class Kind : uint8_t {
+        Video = 1,
+        Audio = 2,
+        // 传输层内部的带宽探测包, 不会交给上层
+        Probe = 3,
+        // 传输层内部的接收端时延反馈, 客户端发给服务端
+        Feedback = 4,
+        // 传输层内部的会话恢复确认, 服务端认下重连带来的resume token后发给客户端, 没有数据
+        Resumed = 5,
+    };
+    static constexpr uint32_t kMagic = 0x484D544C; // "LTMH"
+    static constexpr uint8_t kVersion = 1;
+    static constexpr uint16_t kSize = 72;
+    static constexpr uint16_t kFlagKeyframe = 0x0001;
+    // 数据不是帧本身, 而是SharedFrameRing的描述符
+    static constexpr uint16_t kFlagSharedMemory = 0x0002;
+    // 数据只是整帧的[fragment_offset, fragment_offset+payload_size)部分, 接收端按顺序拼回去
+    static constexpr uint16_t kFlagFragment = 0x0004;
+
+    Kind kind = Kind::Video;
+    uint16_t flags = 0;
+    uint8_t codec = 0;
+    // 时域分层的层号, 0是基本层
+    uint8_t temporal_id = 0;
+    uint64_t frame_id = 0;
+    int64_t capture_timestamp_us = 0;
+    int64_t start_encode_timestamp_us = 0;
+    int64_t end_encode_timestamp_us = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t fragment_offset = 0;
+    // 整帧大小, 不分片时为0, 编码时写入payload_size
+    uint32_t frame_size = 0;
+    // 这个包真正写进socket的时间(发送端时钟), 由set_media_send_timestamp()在发送前补上.
+    // 0表示发送端没有填
+    int64_t send_timestamp_us = 0;
+};
+
+struct MediaFrame {
+    MediaHeader header;
+    const uint8_t* payload = nullptr;
+    uint32_t payload_size = 0;
+    // 可选, 持有payload所在的缓冲, 需要跨线程传递时保证payload有效
+    std::shared_ptr<uint8_t> holder;
+};
+
+// 往out写入MediaHeader::kSize字节
+void encode_media_header(const MediaHeader& header, uint32_t payload_size, uint8_t* out);
+
+// 头和数据放进同一块内存, 可以直接交给Client/Server::send(data, len).
+// 会分配内存并拷贝数据, 发视频帧用Server::send(fd, MediaFrame), 头和数据分开发
+std::shared_ptr<uint8_t> encode_media_frame(const MediaHeader& header, const uint8_t* payload,
+                                            uint32_t payload_size, uint32_t& frame_size);
+
+bool is_media_frame(const uint8_t* data, uint32_t size);
+
+// 原地改写encode_media_header()编出来的头里的send_timestamp_us, 不用重新编码整个头.
+// 加上pacing之后包在队列里排过队, 编码时的时间不是发送时间
+void set_media_send_timestamp(uint8_t* data, int64_t send_timestamp_us);
+
+// 不拷贝, 返回的payload指向data内部. 数据不完整或者不合法时返回nullopt.
+// header.kind可能是对端更新的版本才有的值, 调用方按kind分发时要跳过不认识的
+std::optional<MediaFrame> decode_media_frame(const uint8_t* data, uint32_t size);
+
+} // namespace ltlib
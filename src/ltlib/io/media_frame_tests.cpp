@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <ltproto/client2worker/video_frame.pb.h>
+
+#include "media_frame.h"
+
+namespace {
+
+ltlib::MediaHeader makeHeader() {
+    ltlib::MediaHeader header{};
+    header.kind = ltlib::MediaHeader::Kind::Video;
+    header.flags = ltlib::MediaHeader::kFlagKeyframe;
+    header.codec = 2;
+    header.temporal_id = 1;
+    header.frame_id = 0x1122334455667788;
+    header.capture_timestamp_us = 1'700'000'000'000'001;
+    header.start_encode_timestamp_us = 1'700'000'000'000'002;
+    header.end_encode_timestamp_us = -3;
+    header.width = 2560;
+    header.height = 1440;
+    return header;
+}
+
+std::vector<uint8_t> encode(const ltlib::MediaHeader& header, const std::vector<uint8_t>& payload) {
+    uint32_t size = 0;
+    auto frame = ltlib::encode_media_frame(header, payload.data(),
+                                           static_cast<uint32_t>(payload.size()), size);
+    return std::vector<uint8_t>(frame.get(), frame.get() + size);
+}
+
+} // namespace
+
+class MediaFrameTest : public testing::Test {
+protected:
+    std::vector<uint8_t> randomBytes(size_t size) {
+        std::vector<uint8_t> bytes(size);
+        for (auto& byte : bytes) {
+            byte = static_cast<uint8_t>(rand_engine_());
+        }
+        return bytes;
+    }
+
+    std::mt19937 rand_engine_{20231122};
+};
+
+TEST_F(MediaFrameTest, RoundTrip) {
+    auto header = makeHeader();
+    for (size_t size : {size_t{0}, size_t{1}, size_t{1500}, size_t{300 * 1024}}) {
+        auto payload = randomBytes(size);
+        auto bytes = encode(header, payload);
+        ASSERT_EQ(bytes.size(), ltlib::MediaHeader::kSize + size);
+        ASSERT_TRUE(ltlib::is_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size())));
+        auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+        ASSERT_TRUE(frame.has_value());
+        EXPECT_EQ(frame->header.kind, header.kind);
+        EXPECT_EQ(frame->header.flags, header.flags);
+        EXPECT_EQ(frame->header.codec, header.codec);
+        EXPECT_EQ(frame->header.temporal_id, header.temporal_id);
+        EXPECT_EQ(frame->header.frame_id, header.frame_id);
+        EXPECT_EQ(frame->header.capture_timestamp_us, header.capture_timestamp_us);
+        EXPECT_EQ(frame->header.start_encode_timestamp_us, header.start_encode_timestamp_us);
+        EXPECT_EQ(frame->header.end_encode_timestamp_us, header.end_encode_timestamp_us);
+        EXPECT_EQ(frame->header.width, header.width);
+        EXPECT_EQ(frame->header.height, header.height);
+        ASSERT_EQ(frame->payload_size, size);
+        // 不拷贝, 直接指向原缓冲
+        EXPECT_EQ(frame->payload, bytes.data() + ltlib::MediaHeader::kSize);
+        if (size != 0) {
+            EXPECT_EQ(memcmp(frame->payload, payload.data(), size), 0);
+        }
+    }
+}
+
+// 模拟新版本在头后面追加了字段, 并且用了新的flags位
+TEST_F(MediaFrameTest, ForwardCompatibleExtension) {
+    auto payload = randomBytes(100);
+    auto bytes = encode(makeHeader(), payload);
+    constexpr uint16_t kExtension = 16;
+    bytes.insert(bytes.begin() + ltlib::MediaHeader::kSize, kExtension, 0xEE);
+    uint16_t header_size = ltlib::MediaHeader::kSize + kExtension;
+    memcpy(bytes.data() + 6, &header_size, 2);
+    bytes[9] |= 0x80;
+    auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_TRUE(frame->header.flags & ltlib::MediaHeader::kFlagKeyframe);
+    ASSERT_EQ(frame->payload_size, payload.size());
+    EXPECT_EQ(memcmp(frame->payload, payload.data(), payload.size()), 0);
+}
+
+TEST_F(MediaFrameTest, Fragment) {
+    auto header = makeHeader();
+    header.flags |= ltlib::MediaHeader::kFlagFragment;
+    header.fragment_offset = 32 * 1024;
+    header.frame_size = 100 * 1024;
+    auto payload = randomBytes(16 * 1024);
+    auto bytes = encode(header, payload);
+    auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_TRUE(frame->header.flags & ltlib::MediaHeader::kFlagFragment);
+    EXPECT_EQ(frame->header.fragment_offset, header.fragment_offset);
+    EXPECT_EQ(frame->header.frame_size, header.frame_size);
+    EXPECT_EQ(frame->payload_size, payload.size());
+
+    // 不分片时frame_size就是payload_size
+    bytes = encode(makeHeader(), payload);
+    frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(frame->header.fragment_offset, 0u);
+    EXPECT_EQ(frame->header.frame_size, payload.size());
+}
+
+// 比kSize短的头不再支持
+TEST_F(MediaFrameTest, RejectShortHeader) {
+    auto payload = randomBytes(100);
+    for (uint16_t old_size : {uint16_t{56}, uint16_t{64}}) {
+        auto bytes = encode(makeHeader(), payload);
+        bytes.erase(bytes.begin() + old_size, bytes.begin() + ltlib::MediaHeader::kSize);
+        memcpy(bytes.data() + 6, &old_size, 2);
+        auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+        EXPECT_FALSE(frame.has_value()) << "header_size " << old_size;
+    }
+}
+
+TEST_F(MediaFrameTest, SendTimestamp) {
+    auto header = makeHeader();
+    header.send_timestamp_us = 1'700'000'000'000'004;
+    auto payload = randomBytes(100);
+    auto bytes = encode(header, payload);
+    auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(frame->header.send_timestamp_us, header.send_timestamp_us);
+    // 发送前原地改写, 其它字段和数据不受影响
+    ltlib::set_media_send_timestamp(bytes.data(), -5);
+    frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(frame->header.send_timestamp_us, -5);
+    EXPECT_EQ(frame->header.end_encode_timestamp_us, header.end_encode_timestamp_us);
+    EXPECT_EQ(frame->header.frame_size, payload.size());
+    EXPECT_EQ(memcmp(frame->payload, payload.data(), payload.size()), 0);
+}
+
+TEST_F(MediaFrameTest, RejectInvalid) {
+    auto bytes = encode(makeHeader(), randomBytes(100));
+    auto decode = [](const std::vector<uint8_t>& b, size_t size) {
+        return ltlib::decode_media_frame(b.data(), static_cast<uint32_t>(size)).has_value();
+    };
+    EXPECT_TRUE(decode(bytes, bytes.size()));
+    // 截断
+    EXPECT_FALSE(decode(bytes, bytes.size() - 1));
+    EXPECT_FALSE(decode(bytes, ltlib::MediaHeader::kSize - 1));
+    // 多出来的字节
+    auto longer = bytes;
+    longer.push_back(0);
+    EXPECT_FALSE(decode(longer, longer.size()));
+    // magic, version, header_size
+    for (size_t pos : {size_t{0}, size_t{4}, size_t{6}}) {
+        auto copy = bytes;
+        copy[pos] ^= 0x40;
+        EXPECT_FALSE(decode(copy, copy.size())) << "pos " << pos;
+    }
+    EXPECT_FALSE(ltlib::is_media_frame(bytes.data(), 3));
+}
+
+// 新版本加的kind, 旧版本要能解出来再跳过, 不能当成坏帧把连接断掉
+TEST_F(MediaFrameTest, UnknownKindPassedThrough) {
+    auto payload = randomBytes(100);
+    auto bytes = encode(makeHeader(), payload);
+    bytes[5] = 200;
+    auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(static_cast<uint8_t>(frame->header.kind), 200);
+    EXPECT_EQ(frame->payload_size, payload.size());
+    EXPECT_EQ(memcmp(frame->payload, payload.data(), payload.size()), 0);
+}
+
+// 随机字节和随机篡改过的合法帧, 不能崩溃, 解出来的数据不能越界
+TEST_F(MediaFrameTest, FuzzDecoder) {
+    auto valid = encode(makeHeader(), randomBytes(64));
+    for (int round = 0; round < 100'000; round++) {
+        std::vector<uint8_t> bytes;
+        if (round % 2 == 0) {
+            bytes = randomBytes(rand_engine_() % 160);
+            if (bytes.size() >= 4 && round % 4 == 0) {
+                memcpy(bytes.data(), &ltlib::MediaHeader::kMagic, 4);
+            }
+        }
+        else {
+            bytes = valid;
+            for (uint32_t i = 0; i < 1 + rand_engine_() % 4; i++) {
+                bytes[rand_engine_() % bytes.size()] = static_cast<uint8_t>(rand_engine_());
+            }
+            bytes.resize(rand_engine_() % (bytes.size() + 1));
+        }
+        auto frame = ltlib::decode_media_frame(bytes.data(), static_cast<uint32_t>(bytes.size()));
+        if (frame.has_value()) {
+            EXPECT_GE(frame->payload, bytes.data() + ltlib::MediaHeader::kSize);
+            EXPECT_EQ(frame->payload + frame->payload_size, bytes.data() + bytes.size());
+        }
+    }
+}
+
+// 编码: 填字段+拷贝数据+序列化; 解码: 解析出帧数据和所有字段
+TEST_F(MediaFrameTest, BenchmarkAgainstProtobuf) {
+    constexpr int kLoops = 20'000;
+    for (size_t size : {size_t{200}, size_t{16 * 1024}, size_t{256 * 1024}}) {
+        auto payload = randomBytes(size);
+        auto header = makeHeader();
+        std::vector<uint8_t> pb_bytes;
+        std::vector<uint8_t> media_bytes;
+        uint64_t checksum = 0;
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            ltproto::client2worker::VideoFrame msg;
+            msg.set_frame(payload.data(), payload.size());
+            msg.set_is_keyframe(true);
+            msg.set_picture_id(header.frame_id + i);
+            msg.set_width(header.width);
+            msg.set_height(header.height);
+            msg.set_capture_timestamp_us(header.capture_timestamp_us);
+            msg.set_start_encode_timestamp_us(header.start_encode_timestamp_us);
+            msg.set_end_encode_timestamp_us(header.end_encode_timestamp_us);
+            pb_bytes.resize(msg.ByteSizeLong());
+            msg.SerializeToArray(pb_bytes.data(), static_cast<int>(pb_bytes.size()));
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        ltproto::client2worker::VideoFrame parsed;
+        for (int i = 0; i < kLoops; i++) {
+            parsed.ParseFromArray(pb_bytes.data(), static_cast<int>(pb_bytes.size()));
+            checksum += parsed.picture_id() + parsed.frame().size();
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            header.frame_id++;
+            uint32_t frame_size = 0;
+            auto frame = ltlib::encode_media_frame(header, payload.data(),
+                                                   static_cast<uint32_t>(size), frame_size);
+            if (i == 0) {
+                media_bytes.assign(frame.get(), frame.get() + frame_size);
+            }
+        }
+        auto t3 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            auto frame = ltlib::decode_media_frame(media_bytes.data(),
+                                                   static_cast<uint32_t>(media_bytes.size()));
+            checksum += frame->header.frame_id + frame->payload_size;
+        }
+        auto t4 = std::chrono::steady_clock::now();
+        auto ns = [](auto d) {
+            return std::chrono::duration<double, std::nano>(d).count() / kLoops;
+        };
+        printf("payload:%zuB protobuf encode:%.0fns decode:%.0fns, media encode:%.0fns "
+               "decode:%.0fns (%llu)\n",
+               size, ns(t1 - t0), ns(t2 - t1), ns(t3 - t2), ns(t4 - t3),
+               static_cast<unsigned long long>(checksum % 10));
+    }
+}
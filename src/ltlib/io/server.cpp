@@ -28,9 +28,14 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <cstring>
+
 #include <ltlib/io/server.h>
 #include <ltlib/logging.h>
+#include <ltlib/object_pool.h>
 #include <ltproto/ltproto.h>
+#include "ltproto_frame.h"
 #include "server_transport_layer.h"
 
 namespace
@@ -44,13 +49,29 @@ struct Conn
     }
     explicit Conn(uint32_t _fd)
         : fd { _fd }
-        , parser { std::make_shared<ltproto::Parser>() }
+        , parser { std::make_shared<ltlib::FrameParser>(ltlib::ltproto_frame_params()) }
     {
     }
     uint32_t fd;
-    std::shared_ptr<ltproto::Parser> parser;
+    std::shared_ptr<ltlib::FrameParser> parser;
+    // 旧版本的客户端发的是带xor的包, FrameParser不认, 只能交给ltproto::Parser
+    std::shared_ptr<ltproto::Parser> legacy_parser;
+    // 校验完preamble, 并且看到第一个包头之前收到的字节
+    std::string pending;
+    bool accepted = false;
+    bool format_known = false;
 };
 
+// 媒体帧的[包头|MediaHeader], 数据在另一块内存里
+struct MediaHead
+{
+    void Clear() { }
+    uint8_t bytes[ltlib::kLtprotoMediaHeadSize];
+};
+
+// 一般不会有这么多个包同时在socket的发送队列里, 超出的临时分配
+constexpr size_t kMediaHeadPoolSize = 64;
+
 } // namespace
 
 namespace ltlib
@@ -63,22 +84,35 @@ public:
     bool init();
     bool send(uint32_t fd, uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg, const std::function<void()>& callback);
     bool send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t len, const std::function<void()>& callback);
+    bool send(uint32_t fd, const MediaFrame& frame, const std::function<void()>& callback);
     void close(uint32_t fd);
     std::string ip();
     uint16_t port();
 
 private:
     LibuvSTransport::Params make_uv_params(const Server::Params& params);
+    bool send_packet(uint32_t fd, const ltproto::Packet& pkt, const std::function<void()>& callback);
     void on_transport_accepted(uint32_t fd);
     void on_transport_closed(uint32_t fd);
-    bool on_transport_read(uint32_t fd, const Buffer& buff);
+    bool on_transport_read(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t len);
+    bool parse(Conn& conn, const std::shared_ptr<uint8_t>& block, uint32_t len);
+    bool parse_legacy(Conn& conn, const uint8_t* data, uint32_t len);
 
 private:
     std::unique_ptr<LibuvSTransport> transport_;
     std::function<void(uint32_t)> on_accepted_;
     std::function<void(uint32_t)> on_closed_;
     std::function<void(uint32_t /*fd*/, uint32_t /*type*/, const std::shared_ptr<google::protobuf::MessageLite>&)> on_message_;
+    std::function<void(uint32_t /*fd*/, const MediaFrame&)> on_media_;
     std::map<uint32_t /*fd*/, Conn> conns_;
+    std::shared_ptr<PayloadCipher> cipher_;
+    const uint32_t preamble_size_;
+    const std::string preamble_prefix_;
+    std::function<bool(uint32_t, const std::string&)> on_preamble_;
+    // 只在网络线程里用
+    ObjectPool<MediaHead> media_heads_ {
+        kMediaHeadPoolSize, []() { return std::make_shared<MediaHead>(); }
+    };
 };
 
 ServerImpl::ServerImpl(const Server::Params& params)
@@ -86,6 +120,11 @@ ServerImpl::ServerImpl(const Server::Params& params)
     , on_accepted_ { params.on_accepted }
     , on_closed_ { params.on_closed }
     , on_message_ { params.on_message }
+    , on_media_ { params.on_media }
+    , cipher_ { params.cipher }
+    , preamble_size_ { params.preamble_size }
+    , preamble_prefix_ { params.preamble_prefix }
+    , on_preamble_ { params.on_preamble }
 {
 }
 
@@ -99,12 +138,16 @@ LibuvSTransport::Params ServerImpl::make_uv_params(const Server::Params& params)
     uvparams.bind_port = params.bind_port;
     uvparams.on_accepted = std::bind(&ServerImpl::on_transport_accepted, this, std::placeholders::_1);
     uvparams.on_closed = std::bind(&ServerImpl::on_transport_closed, this, std::placeholders::_1);
-    uvparams.on_read = std::bind(&ServerImpl::on_transport_read, this, std::placeholders::_1, std::placeholders::_2);
+    uvparams.on_read = std::bind(&ServerImpl::on_transport_read, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
     return uvparams;
 }
 
 bool ServerImpl::init()
 {
+    if (preamble_size_ != 0 && on_preamble_ == nullptr) {
+        LOG(ERR) << "Server preamble_size set without on_preamble";
+        return false;
+    }
     return transport_->init();
 }
 
@@ -120,17 +163,7 @@ bool ServerImpl::send(uint32_t fd, uint32_t type, const std::shared_ptr<google::
         LOG(ERR) << "Create net packet failed, type:" << type;
         return false;
     }
-    const auto& pkt = packet.value();
-    Buffer buffs[2] = {
-        { (char*)&pkt.header, sizeof(pkt.header) },
-        { (char*)pkt.payload.get(), pkt.header.payload_size }
-    };
-    return transport_->send(fd, buffs, 2, [packet, callback]() {
-        // 把packet capture进来，是为了延续内部shared_ptr的生命周期
-        if (callback != nullptr) {
-            callback();
-        }
-    });
+    return send_packet(fd, packet.value(), callback);
 }
 
 bool ServerImpl::send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t len, const std::function<void()>& callback)
@@ -145,12 +178,62 @@ bool ServerImpl::send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_
         LOG(ERR) << "Create net packet failed";
         return false;
     }
-    const auto& pkt = packet.value();
+    return send_packet(fd, packet.value(), callback);
+}
+
+bool ServerImpl::send(uint32_t fd, const MediaFrame& frame, const std::function<void()>& callback)
+{
+    if (cipher_ != nullptr) {
+        // 加密是原地做的, 不能改写调用方的数据, 头和数据也得在同一块内存里
+        uint32_t size = 0;
+        auto data = encode_media_frame(frame.header, frame.payload, frame.payload_size, size);
+        return send(fd, data, size, callback);
+    }
+    auto iter = conns_.find(fd);
+    if (iter == conns_.cend()) {
+        LOG(WARNING) << "Send data to invalid fd:" << fd;
+        return false;
+    }
+    auto head = media_heads_.get();
+    if (!ltproto_encode_media_head(frame.header, frame.payload_size, head->bytes)) {
+        LOG(ERR) << "Create media packet failed";
+        return false;
+    }
+    Buffer buffs[2] = {
+        { (char*)head->bytes, kLtprotoMediaHeadSize },
+        { (char*)frame.payload, frame.payload_size }
+    };
+    return transport_->send(fd, buffs, 2, [head, holder = frame.holder, callback]() {
+        // head和holder要活到写完
+        if (callback != nullptr) {
+            callback();
+        }
+    });
+}
+
+bool ServerImpl::send_packet(uint32_t fd, const ltproto::Packet& pkt, const std::function<void()>& callback)
+{
+    if (cipher_ != nullptr) {
+        auto sealed = ltproto_seal_packet(pkt, *cipher_);
+        if (sealed == nullptr) {
+            return false;
+        }
+        Buffer buffs[3] = {
+            { (char*)&sealed->packet.header, sizeof(sealed->packet.header) },
+            { (char*)sealed->packet.payload.get(), pkt.header.payload_size },
+            { (char*)sealed->trailer.data(), static_cast<uint32_t>(sealed->trailer.size()) }
+        };
+        return transport_->send(fd, buffs, 3, [sealed, callback]() {
+            if (callback != nullptr) {
+                callback();
+            }
+        });
+    }
     Buffer buffs[2] = {
         { (char*)&pkt.header, sizeof(pkt.header) },
         { (char*)pkt.payload.get(), pkt.header.payload_size }
     };
-    return transport_->send(fd, buffs, 2, [packet, callback]() {
+    return transport_->send(fd, buffs, 2, [pkt, callback]() {
         // 把packet capture进来，是为了延续内部shared_ptr的生命周期
         if (callback != nullptr) {
             callback();
@@ -176,31 +259,115 @@ uint16_t ServerImpl::port()
 void ServerImpl::on_transport_accepted(uint32_t fd)
 {
     Conn conn { fd };
+    conn.accepted = preamble_size_ == 0;
     conns_[fd] = conn;
-    on_accepted_(fd);
+    if (conn.accepted) {
+        on_accepted_(fd);
+    }
 }
 
 void ServerImpl::on_transport_closed(uint32_t fd)
 {
-    on_closed_(fd);
+    auto iter = conns_.find(fd);
+    if (iter != conns_.end() && iter->second.accepted) {
+        on_closed_(fd);
+    }
     conns_.erase(fd);
 }
 
-bool ServerImpl::on_transport_read(uint32_t fd, const Buffer& buff)
+bool ServerImpl::on_transport_read(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t len)
 {
     auto iter = conns_.find(fd);
     if (iter == conns_.cend()) {
         LOG(WARNING) << "Read data on invalid fd:" << fd;
         return false;
     }
-    auto conn = iter->second;
-    conn.parser->push_buffer(reinterpret_cast<const uint8_t*>(buff.base), buff.len);
+    auto& conn = iter->second;
+    if (conn.format_known) {
+        if (conn.legacy_parser != nullptr) {
+            return parse_legacy(conn, data.get(), len);
+        }
+        return parse(conn, data, len);
+    }
+    // 只有连接刚建立时会走到这里, 拷贝一次无所谓
+    conn.pending.append(reinterpret_cast<const char*>(data.get()), len);
+    if (!conn.accepted) {
+        const size_t n = std::min(conn.pending.size(), preamble_prefix_.size());
+        const bool has_preamble = conn.pending.compare(0, n, preamble_prefix_, 0, n) == 0;
+        if (has_preamble && conn.pending.size() < preamble_size_) {
+            return true;
+        }
+        std::string preamble = has_preamble ? conn.pending.substr(0, preamble_size_)
+                                            : std::string {};
+        if (!on_preamble_(fd, preamble)) {
+            LOG(WARNING) << "Invalid preamble on fd:" << fd;
+            return false;
+        }
+        conn.pending.erase(0, preamble.size());
+        conn.accepted = true;
+        on_accepted_(fd);
+    }
+    const uint32_t header_size = conn.parser->header_size();
+    if (conn.pending.size() < header_size) {
+        return true;
+    }
+    conn.format_known = true;
+    if (ltproto_is_xor_header(reinterpret_cast<const uint8_t*>(conn.pending.data()))) {
+        if (cipher_ != nullptr) {
+            LOG(WARNING) << "Client on fd:" << fd << " doesn't support payload cipher";
+            return false;
+        }
+        LOG(INFO) << "Client on fd:" << fd << " sends xor packets, fallback to ltproto::Parser";
+        conn.legacy_parser = std::make_shared<ltproto::Parser>();
+    }
+    std::string pending;
+    pending.swap(conn.pending);
+    const auto size = static_cast<uint32_t>(pending.size());
+    if (conn.legacy_parser != nullptr) {
+        return parse_legacy(conn, reinterpret_cast<const uint8_t*>(pending.data()), size);
+    }
+    std::shared_ptr<uint8_t> block { new uint8_t[size], std::default_delete<uint8_t[]>() };
+    memcpy(block.get(), pending.data(), size);
+    return parse(conn, block, size);
+}
+
+bool ServerImpl::parse(Conn& conn, const std::shared_ptr<uint8_t>& block, uint32_t len)
+{
+    conn.parser->push_buffer(block, len);
     if (!conn.parser->parse_buffer()) {
         LOG(ERR) << "Parse data failed";
         return false;
     }
-    while (auto msg = conn.parser->pop_message()) {
-        on_message_(fd, msg.value().type, msg.value().msg);
+    while (auto frame = conn.parser->pop_frame()) {
+        if (cipher_ != nullptr && !ltproto_open_frame(frame.value(), *cipher_)) {
+            return false;
+        }
+        if (ltproto_is_media_frame(frame.value())) {
+            auto media = ltproto_decode_media_frame(frame.value());
+            if (media.has_value() && on_media_ != nullptr) {
+                on_media_(conn.fd, media.value());
+            }
+            continue;
+        }
+        uint32_t type = 0;
+        auto msg = ltproto_decode_frame(frame.value(), type);
+        if (msg == nullptr) {
+            continue;
+        }
+        on_message_(conn.fd, type, msg);
+    }
+    return true;
+}
+
+bool ServerImpl::parse_legacy(Conn& conn, const uint8_t* data, uint32_t len)
+{
+    conn.legacy_parser->push_buffer(data, len);
+    if (!conn.legacy_parser->parse_buffer()) {
+        LOG(ERR) << "Parse data failed";
+        return false;
+    }
+    while (auto msg = conn.legacy_parser->pop_message()) {
+        on_message_(conn.fd, msg.value().type, msg.value().msg);
     }
     return true;
 }
@@ -226,6 +393,11 @@ bool Server::send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t le
     return impl_->send(fd, data, len, callback);
 }
 
+bool Server::send(uint32_t fd, const MediaFrame& frame, const std::function<void()>& callback)
+{
+    return impl_->send(fd, frame, callback);
+}
+
 void Server::close(uint32_t fd)
 {
     impl_->close(fd);
@@ -35,6 +35,8 @@
 #include <google/protobuf/message_lite.h>
 
 #include <ltlib/io/ioloop.h>
+#include <ltlib/io/media_frame.h>
+#include <ltlib/io/payload_cipher.h>
 #include <ltlib/io/types.h>
 
 namespace ltlib {
@@ -55,6 +57,17 @@ public:
         std::function<void(uint32_t /*fd*/, uint32_t /*type*/,
                            const std::shared_ptr<google::protobuf::MessageLite>&)>
             on_message;
+        // 可选, 收到媒体帧(见media_frame.h)时回调, MediaFrame::holder持有读缓冲
+        std::function<void(uint32_t /*fd*/, const MediaFrame&)> on_media;
+        // 可选, 所有连接共用
+        std::shared_ptr<PayloadCipher> cipher;
+        // 可选, 新连接最开始的preamble_size个字节交给on_preamble校验, 通过后才回调on_accepted.
+        // 校验失败的连接直接关掉, 也不会回调on_closed
+        uint32_t preamble_size = 0;
+        // 可选, preamble必须以它开头. 开头对不上的连接当作没有带preamble(比如旧版本的客户端),
+        // on_preamble收到空串, 由上层决定要不要接受. 为空时preamble是必须的
+        std::string preamble_prefix;
+        std::function<bool(uint32_t /*fd*/, const std::string& /*preamble*/)> on_preamble;
     };
 
 public:
@@ -63,6 +76,10 @@ public:
               const std::function<void()>& callback = nullptr);
     bool send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t len,
               const std::function<void()>& callback = nullptr);
+    // 头写进池子里的小块内存, 和frame.payload一起用scatter/gather发出去, 不拷贝数据.
+    // frame.holder要持有payload, 直到发送完成. 开了加密时数据要原地加密, 还是会拷贝一次
+    bool send(uint32_t fd, const MediaFrame& frame,
+              const std::function<void()>& callback = nullptr);
     // 当上层调用send()返回false时，由上层调用close()关闭这个fd。此时on_closed将被回调
     void close(uint32_t fd);
     std::string ip();
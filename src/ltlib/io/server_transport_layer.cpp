@@ -291,12 +291,12 @@ void LibuvSTransport::on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t
         that->close(conn->fd);
     }
     else {
-        // const Buffer* buff = reinterpret_cast<const Buffer*>(uvbuf);
-        Buffer buff{uvbuf->base, uint32_t(nread)};
-        if (!that->on_read_(conn->fd, buff)) {
+        // 读缓冲交给引用计数管理, 上层解析出的帧可以直接引用它
+        std::shared_ptr<uint8_t> block{reinterpret_cast<uint8_t*>(uvbuf->base),
+                                       [](uint8_t* p) { delete[] reinterpret_cast<char*>(p); }};
+        if (!that->on_read_(conn->fd, block, uint32_t(nread))) {
             that->close(conn->fd);
         }
-        delete uvbuf->base;
     }
 }
 
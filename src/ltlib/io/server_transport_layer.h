@@ -36,6 +36,7 @@
 #include <functional>
 #include <string>
 #include <map>
+#include <memory>
 #include <optional>
 #include <uv.h>
 
@@ -54,7 +55,8 @@ public:
         uint16_t bind_port;
         std::function<void(uint32_t)> on_accepted;
         std::function<void(uint32_t)> on_closed;
-        std::function<bool(uint32_t, const Buffer&)> on_read;
+        // 读缓冲带引用计数, 上层可以直接持有而不用拷贝
+        std::function<bool(uint32_t, const std::shared_ptr<uint8_t>&, uint32_t)> on_read;
     };
     struct Conn
     {
@@ -100,7 +102,7 @@ private:
     std::unique_ptr<uv_pipe_t> server_pipe_;
     std::function<void(uint32_t)> on_accepted_;
     std::function<void(uint32_t)> on_closed_;
-    std::function<bool(uint32_t, const Buffer&)> on_read_;
+    std::function<bool(uint32_t, const std::shared_ptr<uint8_t>&, uint32_t)> on_read_;
     std::map<uint32_t /*fd*/, std::shared_ptr<Conn>> conns_;
 };
 
@@ -0,0 +1,86 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/keyframe_cache.h>
+
+namespace ltlib {
+
+KeyframeCache::KeyframeCache(uint32_t max_bytes)
+    : max_bytes_{max_bytes} {}
+
+bool KeyframeCache::accepts(const MediaHeader& header, uint32_t size) const {
+    if (header.kind != MediaHeader::Kind::Video || (header.flags & MediaHeader::kFlagFragment)) {
+        return false;
+    }
+    if (header.flags & MediaHeader::kFlagKeyframe) {
+        return size <= max_bytes_;
+    }
+    return !frames_.empty() && sameFormat(header) && bytes_ + size <= max_bytes_;
+}
+
+void KeyframeCache::push(const MediaHeader& header, std::shared_ptr<const uint8_t> data,
+                         uint32_t size) {
+    if (header.kind != MediaHeader::Kind::Video || (header.flags & MediaHeader::kFlagFragment)) {
+        return;
+    }
+    if (header.flags & MediaHeader::kFlagKeyframe) {
+        // 新关键帧之前的帧都用不上了
+        frames_.clear();
+        bytes_ = 0;
+        if (data == nullptr || size > max_bytes_) {
+            invalidations_++;
+            return;
+        }
+    }
+    else if (frames_.empty()) {
+        return;
+    }
+    else if (data == nullptr || !sameFormat(header) || bytes_ + size > max_bytes_) {
+        invalidate();
+        return;
+    }
+    frames_.push_back(Frame{header, std::move(data), size});
+    bytes_ += size;
+}
+
+void KeyframeCache::invalidate() {
+    if (!frames_.empty()) {
+        invalidations_++;
+    }
+    frames_.clear();
+    bytes_ = 0;
+}
+
+bool KeyframeCache::sameFormat(const MediaHeader& header) const {
+    const MediaHeader& key = frames_.front().header;
+    return header.codec == key.codec && header.width == key.width && header.height == key.height;
+}
+
+} // namespace ltlib
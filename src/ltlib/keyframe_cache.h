@@ -0,0 +1,78 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <ltlib/io/media_frame.h>
+
+namespace ltlib {
+
+// 缓存最近一个关键帧以及之后依赖它的所有帧, 新接入或者需要恢复的接收端直接从这里起播,
+// 不用等编码器重新出一个IDR. 缓存不拷贝数据, 和调用方共享帧所在的缓冲; 线程安全由调用方保证.
+// 以下情况整个缓存失效, 直到下一个关键帧到来:
+//   1. 非关键帧的编码格式或者分辨率和缓存里的关键帧不一致
+//   2. 总字节数超过上限(依赖链缺一帧就解不出来, 不能只丢最老的)
+//   3. 调用方主动invalidate(), 比如编码器重启
+class KeyframeCache {
+public:
+    struct Frame {
+        MediaHeader header;
+        std::shared_ptr<const uint8_t> data;
+        uint32_t size;
+    };
+
+public:
+    KeyframeCache(uint32_t max_bytes);
+    // 这一帧会不会被缓存. 帧数据在临时缓冲里时, 调用方据此决定要不要先拷到能共享的缓冲里
+    bool accepts(const MediaHeader& header, uint32_t size) const;
+    // data为空表示调用方没有保留这一帧(accepts()返回false), 这时只更新缓存的状态
+    void push(const MediaHeader& header, std::shared_ptr<const uint8_t> data, uint32_t size);
+    void invalidate();
+    bool valid() const { return !frames_.empty(); }
+    // 从关键帧开始按顺序的快照, 只复制引用, 可以在锁外面慢慢发
+    std::vector<Frame> snapshot() const { return frames_; }
+    uint32_t bytes() const { return bytes_; }
+    uint32_t frames() const { return static_cast<uint32_t>(frames_.size()); }
+    uint64_t invalidations() const { return invalidations_; }
+
+private:
+    bool sameFormat(const MediaHeader& header) const;
+
+private:
+    const uint32_t max_bytes_;
+    std::vector<Frame> frames_;
+    uint32_t bytes_ = 0;
+    uint64_t invalidations_ = 0;
+};
+
+} // namespace ltlib
@@ -0,0 +1,250 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ltlib/keyframe_cache.h>
+
+namespace {
+
+constexpr uint8_t kH264 = 1;
+constexpr uint8_t kH265 = 2;
+
+ltlib::MediaHeader videoHeader(uint64_t frame_id, bool keyframe, uint32_t width = 1920,
+                               uint32_t height = 1080, uint8_t codec = kH264) {
+    ltlib::MediaHeader header{};
+    header.kind = ltlib::MediaHeader::Kind::Video;
+    header.flags = keyframe ? ltlib::MediaHeader::kFlagKeyframe : 0;
+    header.frame_id = frame_id;
+    header.width = width;
+    header.height = height;
+    header.codec = codec;
+    return header;
+}
+
+std::shared_ptr<const uint8_t> makeData(uint32_t size, uint8_t value) {
+    std::shared_ptr<uint8_t> data{new uint8_t[size], std::default_delete<uint8_t[]>()};
+    memset(data.get(), value, size);
+    return data;
+}
+
+std::vector<uint64_t> replayedIds(const ltlib::KeyframeCache& cache) {
+    std::vector<uint64_t> ids;
+    for (const auto& frame : cache.snapshot()) {
+        ids.push_back(frame.header.frame_id);
+        // 每帧的内容就是frame_id
+        EXPECT_EQ(frame.size, 100u);
+        EXPECT_EQ(frame.data.get()[0], static_cast<uint8_t>(frame.header.frame_id));
+    }
+    return ids;
+}
+
+// 和调用方一样, 先问accepts()再决定要不要准备数据
+void push(ltlib::KeyframeCache& cache, const ltlib::MediaHeader& header, uint32_t size = 100) {
+    std::shared_ptr<const uint8_t> data;
+    if (cache.accepts(header, size)) {
+        data = makeData(size, static_cast<uint8_t>(header.frame_id));
+    }
+    cache.push(header, data, size);
+}
+
+} // namespace
+
+TEST(KeyframeCacheTest, KeyframeAndDependents) {
+    ltlib::KeyframeCache cache{1024 * 1024};
+    // 没有关键帧的依赖帧没用
+    push(cache, videoHeader(1, false));
+    EXPECT_FALSE(cache.valid());
+    push(cache, videoHeader(2, true));
+    push(cache, videoHeader(3, false));
+    push(cache, videoHeader(4, false));
+    ASSERT_TRUE(cache.valid());
+    EXPECT_EQ(replayedIds(cache), (std::vector<uint64_t>{2, 3, 4}));
+    EXPECT_EQ(cache.bytes(), 300u);
+
+    // 新关键帧替换掉之前的整条链
+    push(cache, videoHeader(5, true));
+    push(cache, videoHeader(6, false));
+    EXPECT_EQ(replayedIds(cache), (std::vector<uint64_t>{5, 6}));
+    EXPECT_EQ(cache.invalidations(), 0u);
+}
+
+TEST(KeyframeCacheTest, IgnoresAudioAndFragments) {
+    ltlib::KeyframeCache cache{1024 * 1024};
+    push(cache, videoHeader(1, true));
+    auto audio = videoHeader(2, false);
+    audio.kind = ltlib::MediaHeader::Kind::Audio;
+    push(cache, audio);
+    auto fragment = videoHeader(3, false);
+    fragment.flags |= ltlib::MediaHeader::kFlagFragment;
+    push(cache, fragment);
+    EXPECT_EQ(replayedIds(cache), (std::vector<uint64_t>{1}));
+}
+
+TEST(KeyframeCacheTest, ResolutionChangeInvalidates) {
+    ltlib::KeyframeCache cache{1024 * 1024};
+    push(cache, videoHeader(1, true));
+    push(cache, videoHeader(2, false));
+    // 分辨率变了却没有关键帧, 缓存里的链已经不能用来起播
+    push(cache, videoHeader(3, false, 1280, 720));
+    EXPECT_FALSE(cache.valid());
+    EXPECT_EQ(cache.invalidations(), 1u);
+    push(cache, videoHeader(4, false, 1280, 720));
+    EXPECT_FALSE(cache.valid());
+
+    push(cache, videoHeader(5, true, 1280, 720));
+    push(cache, videoHeader(6, false, 1280, 720));
+    EXPECT_EQ(replayedIds(cache), (std::vector<uint64_t>{5, 6}));
+    for (const auto& frame : cache.snapshot()) {
+        EXPECT_EQ(frame.header.width, 1280u);
+        EXPECT_EQ(frame.header.height, 720u);
+    }
+}
+
+TEST(KeyframeCacheTest, CodecChangeInvalidates) {
+    ltlib::KeyframeCache cache{1024 * 1024};
+    push(cache, videoHeader(1, true));
+    push(cache, videoHeader(2, false, 1920, 1080, kH265));
+    EXPECT_FALSE(cache.valid());
+    EXPECT_EQ(cache.invalidations(), 1u);
+    push(cache, videoHeader(3, true, 1920, 1080, kH265));
+    EXPECT_EQ(replayedIds(cache), (std::vector<uint64_t>{3}));
+}
+
+TEST(KeyframeCacheTest, ByteLimit) {
+    ltlib::KeyframeCache cache{350};
+    push(cache, videoHeader(1, true));
+    push(cache, videoHeader(2, false));
+    push(cache, videoHeader(3, false));
+    EXPECT_EQ(cache.bytes(), 300u);
+    // 放不下的时候整条链作废, 而不是丢掉最老的
+    push(cache, videoHeader(4, false));
+    EXPECT_FALSE(cache.valid());
+    EXPECT_EQ(cache.bytes(), 0u);
+    push(cache, videoHeader(5, false));
+    EXPECT_FALSE(cache.valid());
+    // 关键帧本身就超过上限
+    EXPECT_FALSE(cache.accepts(videoHeader(6, true), 400));
+    push(cache, videoHeader(6, true), 400);
+    EXPECT_FALSE(cache.valid());
+    push(cache, videoHeader(7, true));
+    EXPECT_EQ(replayedIds(cache), (std::vector<uint64_t>{7}));
+
+    cache.invalidate();
+    EXPECT_FALSE(cache.valid());
+    EXPECT_EQ(cache.invalidations(), 3u);
+}
+
+TEST(KeyframeCacheTest, SnapshotSharesData) {
+    ltlib::KeyframeCache cache{1024 * 1024};
+    auto keyframe = makeData(100, 1);
+    auto frame = makeData(100, 2);
+    cache.push(videoHeader(1, true), keyframe, 100);
+    cache.push(videoHeader(2, false), frame, 100);
+    auto snapshot = cache.snapshot();
+    ASSERT_EQ(snapshot.size(), 2u);
+    // 不拷贝, 缓存和快照都指向调用方的缓冲
+    EXPECT_EQ(snapshot[0].data.get(), keyframe.get());
+    EXPECT_EQ(snapshot[1].data.get(), frame.get());
+    // 缓存失效之后快照还能用
+    cache.invalidate();
+    keyframe.reset();
+    EXPECT_EQ(snapshot[0].data.use_count(), 1);
+    EXPECT_EQ(snapshot[0].data.get()[0], 1);
+    // 调用方没有保留本该进缓存的帧, 依赖链断了
+    cache.push(videoHeader(3, true), makeData(100, 3), 100);
+    EXPECT_TRUE(cache.accepts(videoHeader(4, false), 100));
+    cache.push(videoHeader(4, false), nullptr, 100);
+    EXPECT_FALSE(cache.valid());
+}
+
+// 模拟一个60fps的编码器: 每帧间隔16.6ms, 普通帧编码2ms, 强制的IDR编码8ms, 关键帧间隔很长.
+// 接收端在随机时刻接入, 对比"强制IDR等它出来"和"从缓存起播"拿到第一个可解码帧的耗时.
+TEST(KeyframeCacheTest, TimeToFirstFrame) {
+    using namespace std::chrono;
+    constexpr auto kFrameInterval = microseconds{16'666};
+    constexpr auto kEncodeTime = milliseconds{2};
+    constexpr auto kIdrEncodeTime = milliseconds{8};
+    constexpr uint32_t kKeyframeSize = 200 * 1024;
+    constexpr uint32_t kFrameSize = 20 * 1024;
+    constexpr int kRounds = 10;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    ltlib::KeyframeCache cache{16 * 1024 * 1024};
+    auto keyframe = makeData(kKeyframeSize, 1);
+    auto frame = makeData(kFrameSize, 2);
+    bool stop = false;
+    bool force_idr = false;
+    uint64_t keyframes_sent = 0;
+    std::thread encoder([&]() {
+        uint64_t frame_id = 0;
+        auto next = steady_clock::now();
+        while (true) {
+            std::this_thread::sleep_until(next);
+            next += kFrameInterval;
+            bool idr;
+            {
+                std::lock_guard lock{mutex};
+                if (stop) {
+                    return;
+                }
+                idr = frame_id == 0 || force_idr;
+                force_idr = false;
+            }
+            std::this_thread::sleep_for(idr ? kIdrEncodeTime : kEncodeTime);
+            std::lock_guard lock{mutex};
+            auto header = videoHeader(frame_id++, idr);
+            cache.push(header, idr ? keyframe : frame, idr ? kKeyframeSize : kFrameSize);
+            if (idr) {
+                keyframes_sent++;
+                cv.notify_all();
+            }
+        }
+    });
+
+    double forced_ms = 0;
+    double cached_ms = 0;
+    for (int round = 0; round < kRounds; round++) {
+        std::this_thread::sleep_for(microseconds{3'000 + round * 4'700});
+        // 强制IDR: 等编码器在下一个采集周期出关键帧
+        auto start = steady_clock::now();
+        {
+            std::unique_lock lock{mutex};
+            uint64_t before = keyframes_sent;
+            force_idr = true;
+            cv.wait(lock, [&]() { return keyframes_sent > before; });
+        }
+        forced_ms += duration<double, std::milli>(steady_clock::now() - start).count();
+
+        // 从缓存起播: 锁里只取快照, 出了锁再把关键帧和依赖帧拷给接收端
+        std::this_thread::sleep_for(microseconds{3'000 + round * 4'700});
+        start = steady_clock::now();
+        std::vector<ltlib::KeyframeCache::Frame> snapshot;
+        {
+            std::lock_guard lock{mutex};
+            ASSERT_TRUE(cache.valid());
+            snapshot = cache.snapshot();
+        }
+        std::vector<uint8_t> received;
+        for (const auto& cached : snapshot) {
+            received.insert(received.end(), cached.data.get(), cached.data.get() + cached.size);
+        }
+        cached_ms += duration<double, std::milli>(steady_clock::now() - start).count();
+        EXPECT_GE(received.size(), kKeyframeSize);
+    }
+    {
+        std::lock_guard lock{mutex};
+        stop = true;
+    }
+    encoder.join();
+    printf("time to first decodable frame: forced IDR %.2fms, keyframe cache %.3fms\n",
+           forced_ms / kRounds, cached_ms / kRounds);
+    EXPECT_LT(cached_ms, forced_ms);
+}
@@ -0,0 +1,90 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/message_pool.h>
+
+#include <ltproto/ltproto.h>
+
+namespace {
+
+constexpr size_t kDefaultCapacity = 8;
+
+} // namespace
+
+namespace ltlib {
+
+MessagePool& MessagePool::local() {
+    static thread_local MessagePool pool;
+    return pool;
+}
+
+MessagePool::MessagePool() {
+    namespace ltype = ltproto::type;
+    // 按包计的高频消息
+    for (uint32_t type : {ltype::kVideoFrame, ltype::kVideoFrameAck1, ltype::kAudioData,
+                          ltype::kMouseEvent, ltype::kKeyboardEvent, ltype::kTouchEvent,
+                          ltype::kControllerStatus, ltype::kControllerAddedRemoved,
+                          ltype::kCursorInfo, ltype::kKeepAlive, ltype::kKeepAliveAck,
+                          ltype::kTimeSync, ltype::kSendSideStat}) {
+        enable(type, kDefaultCapacity);
+    }
+}
+
+void MessagePool::enable(uint32_t type, size_t capacity) {
+    pools_.erase(type);
+    pools_.emplace(type, ObjectPool<google::protobuf::MessageLite>{
+                             capacity, [type]() { return ltproto::create_by_type(type); }});
+}
+
+std::shared_ptr<google::protobuf::MessageLite> MessagePool::get(uint32_t type) {
+    auto iter = pools_.find(type);
+    if (iter == pools_.end()) {
+        return ltproto::create_by_type(type);
+    }
+    return iter->second.get();
+}
+
+uint64_t MessagePool::hits() const {
+    uint64_t hits = 0;
+    for (auto& pool : pools_) {
+        hits += pool.second.hits();
+    }
+    return hits;
+}
+
+uint64_t MessagePool::misses() const {
+    uint64_t misses = 0;
+    for (auto& pool : pools_) {
+        misses += pool.second.misses();
+    }
+    return misses;
+}
+
+} // namespace ltlib
@@ -0,0 +1,100 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ltlib {
+
+// 可复用对象池, 只能在一个线程里调用get().
+// 池子自己持有每个对象的一份引用, use_count()==1说明外面已经没有人在用, 可以复用.
+// 对象交出去之后可以被任意线程持有和释放, 不需要归还, 释放时也不需要锁.
+// use_count()是relaxed读, 看到1之后要补一个acquire fence, 和别的线程释放最后一份引用时的
+// release配对, 保证它对对象的读写都已经完成, 之后才能Clear()和复用.
+// T需要提供Clear()
+template <typename T> class ObjectPool {
+public:
+    using Factory = std::function<std::shared_ptr<T>()>;
+
+public:
+    ObjectPool(size_t capacity, const Factory& factory)
+        : capacity_{capacity}
+        , factory_{factory} {
+        objects_.reserve(capacity_);
+    }
+
+    std::shared_ptr<T> get() {
+        for (size_t i = 0; i < objects_.size(); i++) {
+            auto& obj = objects_[cursor_];
+            cursor_ = (cursor_ + 1) % objects_.size();
+            if (obj.use_count() == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                obj->Clear();
+                hits_ += 1;
+                return obj;
+            }
+        }
+        misses_ += 1;
+        auto obj = factory_();
+        if (obj != nullptr && objects_.size() < capacity_) {
+            objects_.push_back(obj);
+        }
+        return obj;
+    }
+
+    // obj是不是池子里的, 池子外的对象use_count()里没有池子自己的那一份
+    bool contains(const T* obj) const {
+        for (const auto& o : objects_) {
+            if (o.get() == obj) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const { return objects_.size(); }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+private:
+    const size_t capacity_;
+    Factory factory_;
+    std::vector<std::shared_ptr<T>> objects_;
+    size_t cursor_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+} // namespace ltlib
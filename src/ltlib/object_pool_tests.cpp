@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+#include <ltlib/object_pool.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace {
+
+struct FakeMessage {
+    void Clear() { payload.clear(); }
+    std::string payload;
+};
+
+// 模拟收包路径: 取一个消息, 填充内容, 交给上层处理
+void handleOnce(const std::shared_ptr<FakeMessage>& msg) {
+    msg->payload.assign(100, 'x');
+}
+
+} // namespace
+
+class ObjectPoolTest : public testing::Test {
+protected:
+    // 新对象只能从factory里来, 数一下它被调了几次
+    ltlib::ObjectPool<FakeMessage> pool_{4, [this]() {
+                                             created_++;
+                                             return std::make_shared<FakeMessage>();
+                                         }};
+    uint64_t created_ = 0;
+};
+
+TEST_F(ObjectPoolTest, SteadyStateNoAllocation) {
+    // 预热: 第一次会创建对象, 字符串也要分配一次
+    for (int i = 0; i < 4; i++) {
+        handleOnce(pool_.get());
+    }
+    const uint64_t created = created_;
+    const uint64_t hits = pool_.hits();
+    const char* payload = pool_.get()->payload.data();
+    for (int i = 0; i < 100'000; i++) {
+        auto msg = pool_.get();
+        handleOnce(msg);
+        // Clear()保留了容量, 字符串也没有重新分配
+        EXPECT_EQ(msg->payload.data(), payload);
+    }
+    EXPECT_EQ(created_, created);
+    EXPECT_EQ(pool_.hits() - hits, 100'001u);
+    EXPECT_EQ(pool_.size(), 1u);
+}
+
+TEST_F(ObjectPoolTest, HeldObjectNotReused) {
+    auto held = pool_.get();
+    held->payload = "held";
+    auto another = pool_.get();
+    EXPECT_NE(held.get(), another.get());
+    EXPECT_EQ(held->payload, "held");
+    another.reset();
+    auto reused = pool_.get();
+    EXPECT_NE(held.get(), reused.get());
+    EXPECT_TRUE(reused->payload.empty());
+}
+
+TEST_F(ObjectPoolTest, OverflowFallsBackToFactory) {
+    std::vector<std::shared_ptr<FakeMessage>> held;
+    for (int i = 0; i < 10; i++) {
+        held.push_back(pool_.get());
+    }
+    EXPECT_EQ(pool_.size(), 4u);
+    EXPECT_EQ(pool_.misses(), 10u);
+    held.clear();
+    pool_.get();
+    EXPECT_EQ(pool_.hits(), 1u);
+}
+
+TEST_F(ObjectPoolTest, Contains) {
+    std::vector<std::shared_ptr<FakeMessage>> held;
+    for (int i = 0; i < 5; i++) {
+        held.push_back(pool_.get());
+    }
+    EXPECT_TRUE(pool_.contains(held[0].get()));
+    EXPECT_TRUE(pool_.contains(held[3].get()));
+    EXPECT_FALSE(pool_.contains(held[4].get()));
+}
+
+TEST_F(ObjectPoolTest, ReleasedOnAnotherThread) {
+    auto msg = pool_.get();
+    FakeMessage* raw = msg.get();
+    std::thread t{[msg = std::move(msg)]() mutable { msg.reset(); }};
+    t.join();
+    EXPECT_EQ(pool_.get().get(), raw);
+}
+
+TEST_F(ObjectPoolTest, Benchmark) {
+    constexpr int kLoops = 1'000'000;
+    handleOnce(pool_.get());
+    const uint64_t created = created_;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLoops; i++) {
+        handleOnce(std::make_shared<FakeMessage>());
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLoops; i++) {
+        handleOnce(pool_.get());
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    // 预热之后每次都命中, 一个对象都没有新建
+    EXPECT_EQ(created_, created);
+    EXPECT_EQ(pool_.hits(), static_cast<uint64_t>(kLoops));
+    auto ns = [](auto d) { return std::chrono::duration<double, std::nano>(d).count() / kLoops; };
+    printf("make_shared: %.1fns/msg, pool: %.1fns/msg\n", ns(t1 - t0), ns(t2 - t1));
+}
@@ -30,19 +30,76 @@
 
 #include <ltlib/reconnect_interval.h>
 
-namespace ltlib
-{
+#include <algorithm>
 
-void ReconnectInterval::reset()
-{
-    index_ = 0;
+#include <ltlib/times.h>
+
+namespace ltlib {
+
+ReconnectInterval::ReconnectInterval()
+    : ReconnectInterval{Params{}} {}
+
+ReconnectInterval::ReconnectInterval(const Params& params)
+    : params_{params} {
+    params_.base_ms = std::max<int64_t>(params_.base_ms, 1);
+    params_.cap_ms = std::max(params_.cap_ms, params_.base_ms);
+    params_.fast_retry_ms = std::clamp<int64_t>(params_.fast_retry_ms, 0, params_.cap_ms);
+    if (params_.seed == 0) {
+        std::random_device rd;
+        rand_engine_.seed((static_cast<uint64_t>(rd()) << 32) | rd());
+    }
+    else {
+        rand_engine_.seed(params_.seed);
+    }
+}
+
+void ReconnectInterval::reset() {
+    attempts_ = 0;
+    prev_ms_ = 0;
+}
+
+int64_t ReconnectInterval::next() {
+    // 调用方不一定会调onDisconnected(), 在这里补上
+    onDisconnected();
+    attempts_ += 1;
+    if (attempts_ <= params_.fast_retries) {
+        return randomBetween(0, params_.fast_retry_ms);
+    }
+    // decorrelated jitter: sleep = min(cap, random_between(base, prev_sleep * 3))
+    int64_t upper = std::max(params_.base_ms, prev_ms_) * 3;
+    prev_ms_ = std::min(params_.cap_ms, randomBetween(params_.base_ms, upper));
+    return prev_ms_;
+}
+
+void ReconnectInterval::onConnected() {
+    connected_at_ms_ = now();
+}
+
+void ReconnectInterval::onDisconnected() {
+    if (connected_at_ms_ < 0) {
+        return;
+    }
+    if (now() - connected_at_ms_ >= params_.healthy_ms) {
+        reset();
+    }
+    connected_at_ms_ = -1;
+}
+
+void ReconnectInterval::networkChanged() {
+    // 网络变了, 之前的失败已经没有参考意义
+    reset();
+}
+
+int64_t ReconnectInterval::now() const {
+    return params_.now_ms ? params_.now_ms() : ltlib::steady_now_ms();
 }
 
-int64_t ReconnectInterval::next()
-{
-    auto interval = kIntervalsMS[index_];
-    index_ = std::min(index_ + 1, kIntervalsMS.size() - 1);
-    return interval;
+int64_t ReconnectInterval::randomBetween(int64_t min, int64_t max) {
+    if (max <= min) {
+        return min;
+    }
+    std::uniform_int_distribution<int64_t> dist{min, max};
+    return dist(rand_engine_);
 }
 
-} // namespace ltlib
\ No newline at end of file
+} // namespace ltlib
@@ -29,22 +29,52 @@
  */
 
 #pragma once
-#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <random>
 
 namespace ltlib {
 
+// 重连间隔策略:
+// 1. 刚断开时先做几次(带少量抖动的)快速重试, 应对短暂的网络抖动;
+// 2. 之后使用decorrelated jitter的指数退避, 避免大量客户端同步重连;
+// 3. 连接稳定超过healthy_ms后再断开, 才会重置退避状态, 防止'连上即断'的链路不断快速重试;
+// 4. 网络变化(切换网卡、Wi-Fi漫游等)时可以通过networkChanged()跳过当前的等待.
 class ReconnectInterval {
 public:
-    ReconnectInterval() = default;
+    struct Params {
+        uint32_t fast_retries = 2;
+        int64_t fast_retry_ms = 50;
+        int64_t base_ms = 100;
+        int64_t cap_ms = 60'000;
+        int64_t healthy_ms = 5'000;
+        // 0表示使用std::random_device生成种子
+        uint64_t seed = 0;
+        // 为空时使用ltlib::steady_now_ms(), 测试时可以注入假时钟
+        std::function<int64_t()> now_ms;
+    };
+
+public:
+    ReconnectInterval();
+    explicit ReconnectInterval(const Params& params);
     void reset();
     int64_t next();
+    void onConnected();
+    void onDisconnected();
+    void networkChanged();
+    uint32_t attempts() const { return attempts_; }
+
+private:
+    int64_t now() const;
+    int64_t randomBetween(int64_t min, int64_t max);
 
 private:
-    static constexpr std::array<int64_t, 8> kIntervalsMS{100,   500,    1'000,  2'000,
-                                                         5'000, 10'000, 30'000, 60'000};
-    size_t index_ = 0;
+    Params params_;
+    std::mt19937_64 rand_engine_;
+    uint32_t attempts_ = 0;
+    int64_t prev_ms_ = 0;
+    int64_t connected_at_ms_ = -1;
 };
 
-} // namespace ltlib
\ No newline at end of file
+} // namespace ltlib
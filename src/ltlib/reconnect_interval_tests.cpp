@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <ltlib/reconnect_interval.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+class ReconnectIntervalTest : public testing::Test {
+protected:
+    ltlib::ReconnectInterval::Params makeParams(uint64_t seed) {
+        ltlib::ReconnectInterval::Params params{};
+        params.seed = seed;
+        params.now_ms = [this]() { return now_ms_; };
+        return params;
+    }
+
+    int64_t now_ms_ = 0;
+};
+
+TEST_F(ReconnectIntervalTest, FastRetryThenBackoff) {
+    auto params = makeParams(1);
+    ltlib::ReconnectInterval intervals{params};
+    for (uint32_t i = 0; i < params.fast_retries; i++) {
+        int64_t interval = intervals.next();
+        EXPECT_GE(interval, 0);
+        EXPECT_LE(interval, params.fast_retry_ms);
+    }
+    int64_t prev = params.base_ms;
+    for (int i = 0; i < 100; i++) {
+        int64_t interval = intervals.next();
+        EXPECT_GE(interval, params.base_ms);
+        EXPECT_LE(interval, std::min(params.cap_ms, prev * 3));
+        prev = interval;
+    }
+}
+
+TEST_F(ReconnectIntervalTest, Deterministic) {
+    ltlib::ReconnectInterval a{makeParams(1234)};
+    ltlib::ReconnectInterval b{makeParams(1234)};
+    for (int i = 0; i < 50; i++) {
+        EXPECT_EQ(a.next(), b.next());
+    }
+}
+
+TEST_F(ReconnectIntervalTest, ResetOnlyAfterHealthyConnection) {
+    auto params = makeParams(1);
+    ltlib::ReconnectInterval intervals{params};
+    for (int i = 0; i < 10; i++) {
+        intervals.next();
+    }
+    // 连上马上又断, 继续退避
+    intervals.onConnected();
+    now_ms_ += params.healthy_ms / 2;
+    EXPECT_GE(intervals.next(), params.base_ms);
+    EXPECT_EQ(intervals.attempts(), 11u);
+
+    // 稳定连接一段时间后再断, 从快速重试开始
+    intervals.onConnected();
+    now_ms_ += params.healthy_ms;
+    EXPECT_LE(intervals.next(), params.fast_retry_ms);
+    EXPECT_EQ(intervals.attempts(), 1u);
+}
+
+TEST_F(ReconnectIntervalTest, NetworkChanged) {
+    auto params = makeParams(1);
+    ltlib::ReconnectInterval intervals{params};
+    for (int i = 0; i < 10; i++) {
+        intervals.next();
+    }
+    intervals.networkChanged();
+    EXPECT_LE(intervals.next(), params.fast_retry_ms);
+}
+
+// 模拟1万个客户端同时与服务器断开, 服务器kOutageMS后恢复, 统计重连的分散程度和重连耗时
+TEST_F(ReconnectIntervalTest, Simulate10kClients) {
+    constexpr size_t kClients = 10'000;
+    constexpr int64_t kOutageMS = 20'000;
+    constexpr int64_t kBucketMS = 100;
+
+    std::vector<std::unique_ptr<ltlib::ReconnectInterval>> clients;
+    using Event = std::pair<int64_t, size_t>; // <time, client index>
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    auto params = makeParams(0);
+    for (size_t i = 0; i < kClients; i++) {
+        params.seed = i + 1;
+        clients.push_back(std::make_unique<ltlib::ReconnectInterval>(params));
+        clients.back()->onConnected();
+    }
+    now_ms_ = params.healthy_ms * 2;
+    const int64_t outage_begin = now_ms_;
+    const int64_t outage_end = outage_begin + kOutageMS;
+    for (size_t i = 0; i < kClients; i++) {
+        events.push({now_ms_ + clients[i]->next(), i});
+    }
+
+    std::map<int64_t, size_t> attempts_after_recovery; // <bucket, attempts>
+    std::vector<int64_t> reconnect_delay;
+    size_t total_attempts = 0;
+    while (!events.empty()) {
+        auto [time, index] = events.top();
+        events.pop();
+        now_ms_ = time;
+        total_attempts++;
+        if (time >= outage_end) {
+            attempts_after_recovery[(time - outage_end) / kBucketMS]++;
+            reconnect_delay.push_back(time - outage_end);
+            clients[index]->onConnected();
+        }
+        else {
+            events.push({time + clients[index]->next(), index});
+        }
+    }
+
+    ASSERT_EQ(reconnect_delay.size(), kClients);
+    std::sort(reconnect_delay.begin(), reconnect_delay.end());
+    size_t peak = 0;
+    for (auto& bucket : attempts_after_recovery) {
+        peak = std::max(peak, bucket.second);
+    }
+    int64_t p50 = reconnect_delay[kClients / 2];
+    int64_t p99 = reconnect_delay[kClients * 99 / 100];
+    int64_t max = reconnect_delay.back();
+    printf("clients:%zu outage:%" PRId64 "ms attempts:%zu peak/%" PRId64 "ms:%zu p50:%" PRId64
+           "ms p99:%" PRId64 "ms max:%" PRId64 "ms\n",
+           kClients, kOutageMS, total_attempts, kBucketMS, peak, p50, p99, max);
+
+    // 旧的固定表格下所有客户端会挤在同一个bucket里
+    EXPECT_LT(peak, kClients / 20);
+    EXPECT_LE(max, params.cap_ms);
+    EXPECT_LT(p50, kOutageMS);
+}
@@ -0,0 +1,444 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "shared_frame_ring.h"
+
+#if defined(LT_WINDOWS)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // LT_WINDOWS
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <random>
+
+#include <ltlib/logging.h>
+#include <ltlib/strings.h>
+#include <ltlib/times.h>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x5253544C; // "LTSR"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kPageSize = 4096;
+// 头部占一页: 64字节的环信息, 后面每个槽64字节的槽头
+constexpr size_t kHeaderSize = kPageSize;
+constexpr size_t kSlotHeaderSize = 64;
+constexpr uint32_t kMaxSlots = static_cast<uint32_t>(kHeaderSize / kSlotHeaderSize - 1);
+// Ready状态超过这么久还没人来取, 说明描述符丢了, 生产者可以收回
+constexpr int64_t kStaleMS = 2000;
+
+constexpr uint64_t kFree = 0;
+constexpr uint64_t kWriting = 1;
+constexpr uint64_t kReady = 2;
+constexpr uint64_t kReading = 3;
+constexpr uint32_t kEpochMask = 0xFFFFFF;
+
+uint64_t pack(uint32_t generation, uint32_t epoch, uint64_t state) {
+    return (static_cast<uint64_t>(generation) << 32) |
+           (static_cast<uint64_t>(epoch & kEpochMask) << 8) | state;
+}
+
+uint32_t generationOf(uint64_t word) {
+    return static_cast<uint32_t>(word >> 32);
+}
+
+uint32_t epochOf(uint64_t word) {
+    return static_cast<uint32_t>(word >> 8) & kEpochMask;
+}
+
+uint64_t stateOf(uint64_t word) {
+    return word & 0xFF;
+}
+
+struct alignas(kSlotHeaderSize) SlotHeader {
+    std::atomic<uint64_t> word;
+    uint32_t size;
+    // commit()在CAS之前写, reclaimStale()可能在别的进程里同时读
+    std::atomic<int64_t> ready_time_ms;
+};
+static_assert(sizeof(SlotHeader) == kSlotHeaderSize);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<int64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+size_t alignToPage(size_t size) {
+    return (size + kPageSize - 1) / kPageSize * kPageSize;
+}
+
+} // namespace
+
+namespace ltlib {
+
+struct SharedFrameRing::Shared {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_id;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    std::atomic<uint32_t> producer_epoch;
+    uint8_t padding[kSlotHeaderSize - 28];
+    SlotHeader slots[kMaxSlots];
+};
+
+std::unique_ptr<SharedFrameRing> SharedFrameRing::create(const Params& params) {
+    if (params.name.empty() || params.slot_count == 0 || params.slot_count > kMaxSlots ||
+        params.slot_size == 0) {
+        LOG(ERR) << "Invalid SharedFrameRing params";
+        return nullptr;
+    }
+    std::unique_ptr<SharedFrameRing> ring{new SharedFrameRing};
+    if (!ring->map(true, params)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+std::unique_ptr<SharedFrameRing> SharedFrameRing::open(const std::string& name) {
+    Params params{};
+    params.name = name;
+    std::unique_ptr<SharedFrameRing> ring{new SharedFrameRing};
+    if (!ring->map(false, params)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+SharedFrameRing::~SharedFrameRing() {
+#if defined(LT_WINDOWS)
+    if (base_ != nullptr) {
+        ::UnmapViewOfFile(base_);
+    }
+    if (handle_ != nullptr) {
+        ::CloseHandle(handle_);
+    }
+#else
+    if (base_ != nullptr) {
+        ::munmap(base_, mapped_size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    if (is_owner_) {
+        ::shm_unlink(name_.c_str());
+    }
+#endif // LT_WINDOWS
+}
+
+bool SharedFrameRing::map(bool create, const Params& params) {
+    static_assert(sizeof(Shared) <= kHeaderSize);
+    is_owner_ = create;
+    size_t size = 0;
+    if (create) {
+        size = kHeaderSize + alignToPage(params.slot_size) * params.slot_count;
+    }
+#if defined(LT_WINDOWS)
+    // service跑在session 0, worker跑在用户session, 优先用Global命名空间
+    for (const char* prefix : {"Global\\", "Local\\"}) {
+        name_ = prefix + params.name;
+        std::wstring wname = utf8To16(name_);
+        if (create) {
+            handle_ = ::CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                           static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                           static_cast<DWORD>(size), wname.c_str());
+            if (handle_ != nullptr && ::GetLastError() == ERROR_ALREADY_EXISTS) {
+                // 名字是随机的, 撞上了说明有问题, 不要跟别人共用
+                LOG(ERR) << "File mapping " << name_ << " already exists";
+                return false;
+            }
+        }
+        else {
+            handle_ = ::OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, wname.c_str());
+        }
+        if (handle_ != nullptr) {
+            break;
+        }
+    }
+    if (handle_ == nullptr) {
+        LOG(ERR) << "Create/Open file mapping " << params.name << " failed: " << ::GetLastError();
+        return false;
+    }
+    base_ = reinterpret_cast<uint8_t*>(::MapViewOfFile(handle_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    if (base_ == nullptr) {
+        LOG(ERR) << "MapViewOfFile failed: " << ::GetLastError();
+        return false;
+    }
+    MEMORY_BASIC_INFORMATION info{};
+    ::VirtualQuery(base_, &info, sizeof(info));
+    mapped_size_ = info.RegionSize;
+#else
+    name_ = "/" + params.name;
+    if (create) {
+        fd_ = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd_ < 0 && errno == EEXIST) {
+            // 上一个service崩溃时没来得及unlink
+            ::shm_unlink(name_.c_str());
+            fd_ = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        }
+        if (fd_ >= 0 && ::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+            LOG(ERR) << "ftruncate shared memory failed";
+            return false;
+        }
+    }
+    else {
+        fd_ = ::shm_open(name_.c_str(), O_RDWR, 0600);
+        struct stat st {};
+        if (fd_ >= 0 && ::fstat(fd_, &st) == 0) {
+            size = static_cast<size_t>(st.st_size);
+        }
+    }
+    if (fd_ < 0 || size < kHeaderSize) {
+        LOG(ERR) << "Create/Open shared memory " << name_ << " failed";
+        return false;
+    }
+    void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+        LOG(ERR) << "mmap shared memory failed";
+        return false;
+    }
+    base_ = reinterpret_cast<uint8_t*>(addr);
+    mapped_size_ = size;
+#endif // LT_WINDOWS
+    shared_ = reinterpret_cast<Shared*>(base_);
+    if (create) {
+        std::random_device rd;
+        shared_->ring_id = (static_cast<uint64_t>(rd()) << 32) | rd();
+        shared_->slot_count = params.slot_count;
+        shared_->slot_size = static_cast<uint32_t>(alignToPage(params.slot_size));
+        shared_->version = kVersion;
+        for (uint32_t i = 0; i < params.slot_count; i++) {
+            new (&shared_->slots[i]) SlotHeader{};
+            shared_->slots[i].word.store(pack(0, 0, kFree));
+        }
+        new (&shared_->producer_epoch) std::atomic<uint32_t>{0};
+        ring_id_ = shared_->ring_id;
+        slot_count_ = shared_->slot_count;
+        slot_size_ = shared_->slot_size;
+        std::atomic_thread_fence(std::memory_order_release);
+        shared_->magic = kMagic;
+        return true;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shared_->magic != kMagic || shared_->version != kVersion) {
+        LOG(ERR) << "Invalid SharedFrameRing " << name_;
+        return false;
+    }
+    // 先拷出来再校验, 避免校验完之后被对方改掉
+    ring_id_ = shared_->ring_id;
+    slot_count_ = shared_->slot_count;
+    slot_size_ = shared_->slot_size;
+    if (slot_count_ == 0 || slot_count_ > kMaxSlots ||
+        kHeaderSize + static_cast<size_t>(slot_size_) * slot_count_ > mapped_size_) {
+        LOG(ERR) << "Invalid SharedFrameRing " << name_;
+        return false;
+    }
+    epoch_ = (shared_->producer_epoch.fetch_add(1) + 1) & kEpochMask;
+    reclaimStale();
+    return true;
+}
+
+std::optional<SharedFrameRing::Descriptor> SharedFrameRing::write(const uint8_t* data,
+                                                                   uint32_t size) {
+    auto slot = acquire(size);
+    if (!slot.has_value()) {
+        return std::nullopt;
+    }
+    memcpy(slot->data, data, size);
+    if (!commit(slot->desc)) {
+        return std::nullopt;
+    }
+    return slot->desc;
+}
+
+std::optional<SharedFrameRing::Slot> SharedFrameRing::acquire(uint32_t size) {
+    if (size > slot_size_) {
+        fallbacks_++;
+        return std::nullopt;
+    }
+    const uint32_t count = slot_count_;
+    for (int round = 0; round < 2; round++) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t index = (cursor_ + i) % count;
+            SlotHeader& header = shared_->slots[index];
+            uint64_t word = header.word.load(std::memory_order_acquire);
+            if (stateOf(word) != kFree) {
+                continue;
+            }
+            uint32_t generation = generationOf(word) + 1;
+            if (!header.word.compare_exchange_strong(word, pack(generation, epoch_, kWriting),
+                                                     std::memory_order_acq_rel)) {
+                continue;
+            }
+            cursor_ = (index + 1) % count;
+            header.size = size;
+            Slot slot{};
+            slot.desc.ring_id = ring_id_;
+            slot.desc.slot = index;
+            slot.desc.generation = generation;
+            slot.desc.size = size;
+            slot.data = base_ + kHeaderSize + static_cast<size_t>(slot_size_) * index;
+            return slot;
+        }
+        // 全满了, 看看有没有描述符丢失导致一直没人取的槽
+        if (reclaimStale() == 0) {
+            break;
+        }
+    }
+    fallbacks_++;
+    return std::nullopt;
+}
+
+bool SharedFrameRing::commit(const Descriptor& desc) {
+    SlotHeader& header = shared_->slots[desc.slot];
+    // 之后的CAS是acq_rel, 读到Ready的一方也能看到这个时间
+    header.ready_time_ms.store(ltlib::steady_now_ms(), std::memory_order_relaxed);
+    uint64_t expected = pack(desc.generation, epoch_, kWriting);
+    if (!header.word.compare_exchange_strong(expected, pack(desc.generation, epoch_, kReady),
+                                             std::memory_order_acq_rel)) {
+        // 被消费者当成死掉的生产者回收了
+        fallbacks_++;
+        return false;
+    }
+    return true;
+}
+
+void SharedFrameRing::abort(const Descriptor& desc) {
+    SlotHeader& header = shared_->slots[desc.slot];
+    for (uint64_t state : {kWriting, kReady}) {
+        uint64_t expected = pack(desc.generation, epoch_, state);
+        if (header.word.compare_exchange_strong(expected, pack(desc.generation, epoch_, kFree),
+                                                std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+}
+
+uint32_t SharedFrameRing::reclaimStale() {
+    // 只有一个生产者, 别的epoch留下的槽都是已经退出的生产者的; Ready太久的说明描述符丢了
+    const int64_t now = ltlib::steady_now_ms();
+    const uint32_t epoch = epoch_;
+    uint32_t reclaimed = reclaimIf([now, epoch](uint64_t word, int64_t ready_time_ms) {
+        return epochOf(word) != epoch ||
+               (stateOf(word) == kReady && now - ready_time_ms >= kStaleMS);
+    });
+    if (reclaimed != 0) {
+        LOG(WARNING) << "SharedFrameRing reclaimed " << reclaimed << " stale slots";
+    }
+    return reclaimed;
+}
+
+bool SharedFrameRing::read(const Descriptor& desc,
+                           const std::function<void(const uint8_t*, uint32_t)>& consumer) {
+    if (desc.ring_id != ring_id_ || desc.slot >= slot_count_ || desc.size > slot_size_) {
+        return false;
+    }
+    SlotHeader& header = shared_->slots[desc.slot];
+    uint64_t word = header.word.load(std::memory_order_acquire);
+    uint64_t reading = 0;
+    do {
+        if (stateOf(word) != kReady || generationOf(word) != desc.generation) {
+            // 槽已经被回收重用了
+            return false;
+        }
+        reading = pack(desc.generation, epochOf(word), kReading);
+    } while (!header.word.compare_exchange_weak(word, reading, std::memory_order_acq_rel));
+    const bool valid = header.size == desc.size;
+    if (valid) {
+        consumer(base_ + kHeaderSize + static_cast<size_t>(slot_size_) * desc.slot, desc.size);
+    }
+    header.word.store(pack(desc.generation, epochOf(reading), kFree), std::memory_order_release);
+    return valid;
+}
+
+uint32_t SharedFrameRing::reclaimDeadProducer() {
+    // 新的生产者如果已经打开并且正在写, 它的槽也会被收走, 但它commit时CAS会失败,
+    // 退回到管道直接传数据, 不会出错
+    return reclaimIf([](uint64_t, int64_t) { return true; });
+}
+
+uint32_t
+SharedFrameRing::reclaimIf(const std::function<bool(uint64_t, int64_t)>& predicate) {
+    uint32_t reclaimed = 0;
+    for (uint32_t i = 0; i < slot_count_; i++) {
+        SlotHeader& header = shared_->slots[i];
+        uint64_t word = header.word.load(std::memory_order_acquire);
+        uint64_t state = stateOf(word);
+        // Reading状态只有消费者自己会设置, 由它负责释放
+        if (state != kWriting && state != kReady) {
+            continue;
+        }
+        if (!predicate(word, header.ready_time_ms.load(std::memory_order_relaxed))) {
+            continue;
+        }
+        if (header.word.compare_exchange_strong(
+                word, pack(generationOf(word), epochOf(word), kFree), std::memory_order_acq_rel)) {
+            reclaimed++;
+        }
+    }
+    return reclaimed;
+}
+
+std::string SharedFrameRing::toBytes(const Descriptor& desc) const {
+    return std::string(reinterpret_cast<const char*>(&desc), sizeof(desc));
+}
+
+std::optional<SharedFrameRing::Descriptor>
+SharedFrameRing::fromBytes(const std::string& bytes) const {
+    return fromBytes(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+}
+
+std::optional<SharedFrameRing::Descriptor> SharedFrameRing::fromBytes(const uint8_t* data,
+                                                                      size_t size) const {
+    if (size != kDescriptorSize) {
+        return std::nullopt;
+    }
+    Descriptor desc{};
+    memcpy(&desc, data, sizeof(desc));
+    if (desc.ring_id != ring_id_) {
+        return std::nullopt;
+    }
+    return desc;
+}
+
+uint32_t SharedFrameRing::slotCount() const {
+    return slot_count_;
+}
+
+uint32_t SharedFrameRing::slotSize() const {
+    return slot_size_;
+}
+
+} // namespace ltlib
@@ -0,0 +1,120 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace ltlib {
+
+// 跨进程共享内存环, 用来把worker编码好的视频/音频交给service, 管道里只传一个很小的描述符.
+// 一个生产者(worker)一个消费者(service), 固定大小的槽. 每个槽的状态字是
+// [generation:32 | producer epoch:24 | state:8], 所有权转移都靠对它做CAS:
+//   Free --生产者--> Writing --生产者--> Ready --消费者--> Reading --消费者--> Free
+// 描述符里带着generation, 槽被回收重用后旧描述符自然失效.
+// 生产者崩溃时留下的Writing/Ready槽由消费者调用reclaimDeadProducer()回收, 新的生产者打开时
+// 也会回收不属于自己epoch的槽. commit也是CAS, 槽被回收过的话commit失败, 调用方退回到管道.
+class SharedFrameRing {
+public:
+    struct Params {
+        std::string name;
+        uint32_t slot_count = 8;
+        uint32_t slot_size = 2 * 1024 * 1024;
+    };
+    struct Descriptor {
+        uint64_t ring_id;
+        uint32_t slot;
+        uint32_t generation;
+        uint32_t size;
+        uint32_t reserved;
+    };
+    static constexpr uint32_t kDescriptorSize = sizeof(Descriptor);
+    struct Slot {
+        Descriptor desc;
+        uint8_t* data;
+    };
+
+public:
+    // 消费者(service)创建, 生命周期内一直持有这块共享内存
+    static std::unique_ptr<SharedFrameRing> create(const Params& params);
+    // 生产者(worker)打开, 每次打开epoch加一
+    static std::unique_ptr<SharedFrameRing> open(const std::string& name);
+    ~SharedFrameRing();
+
+    // 生产者. 没有空闲槽或者放不下时返回nullopt, 调用方退回到管道里直接传数据
+    std::optional<Descriptor> write(const uint8_t* data, uint32_t size);
+    std::optional<Slot> acquire(uint32_t size);
+    bool commit(const Descriptor& desc);
+    // 描述符没能发出去, 把槽还回来
+    void abort(const Descriptor& desc);
+
+    // 消费者. 描述符失效时返回false, 否则回调结束后槽立即被释放
+    bool read(const Descriptor& desc,
+              const std::function<void(const uint8_t* data, uint32_t size)>& consumer);
+    // 生产者进程退出(管道断开)后调用, 回收它没来得及交出来的槽
+    uint32_t reclaimDeadProducer();
+
+    // 描述符与字节串互转, 不是本环的描述符返回nullopt
+    std::string toBytes(const Descriptor& desc) const;
+    std::optional<Descriptor> fromBytes(const std::string& bytes) const;
+    std::optional<Descriptor> fromBytes(const uint8_t* data, size_t size) const;
+
+    uint32_t slotCount() const;
+    uint32_t slotSize() const;
+    uint64_t fallbacks() const { return fallbacks_; }
+
+private:
+    SharedFrameRing() = default;
+    bool map(bool create, const Params& params);
+    uint32_t reclaimStale();
+    uint32_t reclaimIf(const std::function<bool(uint64_t word, int64_t ready_time_ms)>& predicate);
+
+private:
+    struct Shared;
+    std::string name_;
+    bool is_owner_ = false;
+    void* handle_ = nullptr;
+    int fd_ = -1;
+    size_t mapped_size_ = 0;
+    Shared* shared_ = nullptr;
+    uint8_t* base_ = nullptr;
+    // 共享内存里的头部对方进程也能写, 映射时校验一次后留一份拷贝, 之后只用拷贝
+    uint64_t ring_id_ = 0;
+    uint32_t slot_count_ = 0;
+    uint32_t slot_size_ = 0;
+    uint32_t epoch_ = 0;
+    uint32_t cursor_ = 0;
+    uint64_t fallbacks_ = 0;
+};
+
+} // namespace ltlib
@@ -0,0 +1,299 @@
+#include <gtest/gtest.h>
+#include <ltlib/shared_frame_ring.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if !defined(LT_WINDOWS)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // LT_WINDOWS
+
+namespace {
+
+std::string ringName(const char* test) {
+#if defined(LT_WINDOWS)
+    return std::string{"lt_test_ring_"} + test;
+#else
+    return "lt_test_ring_" + std::to_string(getpid()) + "_" + test;
+#endif // LT_WINDOWS
+}
+
+std::vector<uint8_t> makePayload(uint32_t size, uint8_t seed) {
+    std::vector<uint8_t> payload(size);
+    for (uint32_t i = 0; i < size; i++) {
+        payload[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+    return payload;
+}
+
+} // namespace
+
+class SharedFrameRingTest : public testing::Test {
+protected:
+    void open(const char* test, uint32_t slot_count = 4, uint32_t slot_size = 64 * 1024) {
+        ltlib::SharedFrameRing::Params params{};
+        params.name = ringName(test);
+        params.slot_count = slot_count;
+        params.slot_size = slot_size;
+        consumer_ = ltlib::SharedFrameRing::create(params);
+        ASSERT_NE(consumer_, nullptr);
+        producer_ = ltlib::SharedFrameRing::open(params.name);
+        ASSERT_NE(producer_, nullptr);
+    }
+
+    std::unique_ptr<ltlib::SharedFrameRing> consumer_;
+    std::unique_ptr<ltlib::SharedFrameRing> producer_;
+};
+
+TEST_F(SharedFrameRingTest, RoundTrip) {
+    open("RoundTrip");
+    for (uint8_t i = 0; i < 20; i++) {
+        auto payload = makePayload(1000 + i * 1000, i);
+        auto desc = producer_->write(payload.data(), static_cast<uint32_t>(payload.size()));
+        ASSERT_TRUE(desc.has_value());
+        // 经过管道传的是字节串
+        auto bytes = producer_->toBytes(desc.value());
+        ASSERT_EQ(bytes.size(), ltlib::SharedFrameRing::kDescriptorSize);
+        auto parsed = consumer_->fromBytes(bytes);
+        ASSERT_TRUE(parsed.has_value());
+        bool called = false;
+        EXPECT_TRUE(consumer_->read(parsed.value(), [&](const uint8_t* data, uint32_t size) {
+            called = true;
+            ASSERT_EQ(size, payload.size());
+            EXPECT_EQ(memcmp(data, payload.data(), size), 0);
+        }));
+        EXPECT_TRUE(called);
+    }
+    EXPECT_EQ(producer_->fallbacks(), 0u);
+}
+
+TEST_F(SharedFrameRingTest, StaleDescriptorRejected) {
+    open("StaleDescriptorRejected", 1);
+    auto payload = makePayload(100, 1);
+    auto desc = producer_->write(payload.data(), 100);
+    ASSERT_TRUE(desc.has_value());
+    auto noop = [](const uint8_t*, uint32_t) {};
+    ASSERT_TRUE(consumer_->read(desc.value(), noop));
+    // 同一个描述符不能读两次
+    EXPECT_FALSE(consumer_->read(desc.value(), noop));
+    // 槽被重用后, 旧描述符失效
+    auto again = producer_->write(payload.data(), 100);
+    ASSERT_TRUE(again.has_value());
+    EXPECT_EQ(again->slot, desc->slot);
+    EXPECT_NE(again->generation, desc->generation);
+    EXPECT_FALSE(consumer_->read(desc.value(), noop));
+    EXPECT_TRUE(consumer_->read(again.value(), noop));
+}
+
+TEST_F(SharedFrameRingTest, FullOrOversizeFallsBack) {
+    open("FullOrOversizeFallsBack", 2, 4096);
+    auto payload = makePayload(4096, 2);
+    auto first = producer_->write(payload.data(), 4096);
+    auto second = producer_->write(payload.data(), 4096);
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+    EXPECT_FALSE(producer_->write(payload.data(), 4096).has_value());
+    EXPECT_FALSE(producer_->acquire(4097).has_value());
+    EXPECT_EQ(producer_->fallbacks(), 2u);
+    // 放弃一个描述符之后又可以写了
+    producer_->abort(first.value());
+    EXPECT_FALSE(consumer_->read(first.value(), [](const uint8_t*, uint32_t) {}));
+    EXPECT_TRUE(producer_->write(payload.data(), 4096).has_value());
+}
+
+TEST_F(SharedFrameRingTest, ForeignDescriptorRejected) {
+    open("ForeignDescriptorRejected");
+    auto payload = makePayload(100, 3);
+    auto desc = producer_->write(payload.data(), 100);
+    ASSERT_TRUE(desc.has_value());
+    auto bytes = producer_->toBytes(desc.value());
+    // 普通的编码帧, 长度凑巧一样也不会被当成描述符
+    EXPECT_FALSE(consumer_->fromBytes(std::string(bytes.size(), '\0')).has_value());
+    EXPECT_FALSE(consumer_->fromBytes(bytes.substr(1)).has_value());
+    auto raw = reinterpret_cast<const uint8_t*>(bytes.data());
+    EXPECT_TRUE(consumer_->fromBytes(raw, bytes.size()).has_value());
+    EXPECT_FALSE(consumer_->fromBytes(raw, bytes.size() - 1).has_value());
+    auto forged = desc.value();
+    forged.slot = 100;
+    EXPECT_FALSE(consumer_->read(forged, [](const uint8_t*, uint32_t) {}));
+    forged = desc.value();
+    forged.size = 101;
+    EXPECT_FALSE(consumer_->read(forged, [](const uint8_t*, uint32_t) {}));
+}
+
+TEST_F(SharedFrameRingTest, ProducerCrash) {
+    open("ProducerCrash", 2);
+    auto payload = makePayload(100, 4);
+    // 一个写了一半, 一个写完了但描述符没发出去
+    ASSERT_TRUE(producer_->acquire(100).has_value());
+    ASSERT_TRUE(producer_->write(payload.data(), 100).has_value());
+    ASSERT_FALSE(producer_->write(payload.data(), 100).has_value());
+    producer_.reset();
+    EXPECT_EQ(consumer_->reclaimDeadProducer(), 2u);
+
+    producer_ = ltlib::SharedFrameRing::open(ringName("ProducerCrash"));
+    ASSERT_NE(producer_, nullptr);
+    auto desc = producer_->write(payload.data(), 100);
+    ASSERT_TRUE(desc.has_value());
+    EXPECT_TRUE(consumer_->read(desc.value(), [](const uint8_t*, uint32_t) {}));
+    // 新的生产者在消费者回收之前就开始写了, commit失败, 退回到管道
+    auto slot = producer_->acquire(100);
+    ASSERT_TRUE(slot.has_value());
+    EXPECT_EQ(consumer_->reclaimDeadProducer(), 1u);
+    EXPECT_FALSE(producer_->commit(slot->desc));
+    EXPECT_FALSE(consumer_->read(slot->desc, [](const uint8_t*, uint32_t) {}));
+    EXPECT_TRUE(producer_->write(payload.data(), 100).has_value());
+}
+
+TEST_F(SharedFrameRingTest, NewProducerReclaimsLeftovers) {
+    open("NewProducerReclaimsLeftovers", 2);
+    ASSERT_TRUE(producer_->acquire(100).has_value());
+    ASSERT_TRUE(producer_->acquire(100).has_value());
+    producer_ = ltlib::SharedFrameRing::open(ringName("NewProducerReclaimsLeftovers"));
+    ASSERT_NE(producer_, nullptr);
+    EXPECT_TRUE(producer_->acquire(100).has_value());
+    EXPECT_TRUE(producer_->acquire(100).has_value());
+}
+
+#if !defined(LT_WINDOWS)
+
+namespace {
+
+constexpr uint32_t kFrameSize = 256 * 1024;
+constexpr int kFrames = 2000;
+
+int64_t nowUS() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    auto ptr = reinterpret_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, ptr, size);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size) {
+    auto ptr = reinterpret_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, ptr, size);
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+struct BenchResult {
+    double mb_per_second;
+    int64_t p50_us;
+    int64_t p99_us;
+};
+
+// 子进程当worker, 父进程当service. 帧的前8个字节是发送时间, 用来统计单帧延迟.
+// use_ring为false时整帧走pipe, 对应原来的管道方案
+BenchResult runBench(bool use_ring) {
+    std::string name = ringName(use_ring ? "BenchRing" : "BenchPipe");
+    ltlib::SharedFrameRing::Params params{};
+    params.name = name;
+    params.slot_count = 8;
+    params.slot_size = kFrameSize;
+    auto ring = ltlib::SharedFrameRing::create(params);
+    int fds[2];
+    if (ring == nullptr || ::pipe(fds) != 0) {
+        return {};
+    }
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        ::close(fds[0]);
+        auto producer = ltlib::SharedFrameRing::open(name);
+        std::vector<uint8_t> frame(kFrameSize, 0x5A);
+        for (int i = 0; i < kFrames; i++) {
+            int64_t now = nowUS();
+            if (use_ring) {
+                std::optional<ltlib::SharedFrameRing::Slot> slot;
+                while (!(slot = producer->acquire(kFrameSize)).has_value()) {
+                    ::usleep(50);
+                }
+                memcpy(slot->data, frame.data(), kFrameSize);
+                memcpy(slot->data, &now, sizeof(now));
+                if (!producer->commit(slot->desc)) {
+                    ::_exit(1);
+                }
+                writeAll(fds[1], &slot->desc, sizeof(slot->desc));
+            }
+            else {
+                memcpy(frame.data(), &now, sizeof(now));
+                writeAll(fds[1], frame.data(), kFrameSize);
+            }
+        }
+        ::close(fds[1]);
+        ::_exit(0);
+    }
+    ::close(fds[1]);
+    std::vector<int64_t> latency;
+    std::vector<uint8_t> received(kFrameSize);
+    int64_t start = nowUS();
+    for (int i = 0; i < kFrames; i++) {
+        int64_t sent = 0;
+        if (use_ring) {
+            ltlib::SharedFrameRing::Descriptor desc{};
+            if (!readAll(fds[0], &desc, sizeof(desc))) {
+                break;
+            }
+            // service拿到数据后还要交给传输层, 这里算一次拷贝
+            ring->read(desc, [&](const uint8_t* data, uint32_t size) {
+                memcpy(received.data(), data, size);
+            });
+        }
+        else if (!readAll(fds[0], received.data(), kFrameSize)) {
+            break;
+        }
+        memcpy(&sent, received.data(), sizeof(sent));
+        latency.push_back(nowUS() - sent);
+    }
+    int64_t elapsed = nowUS() - start;
+    ::close(fds[0]);
+    ::waitpid(pid, nullptr, 0);
+    if (latency.size() != kFrames) {
+        return {};
+    }
+    std::sort(latency.begin(), latency.end());
+    BenchResult result{};
+    result.mb_per_second = double(kFrameSize) * kFrames / elapsed;
+    result.p50_us = latency[latency.size() / 2];
+    result.p99_us = latency[latency.size() * 99 / 100];
+    return result;
+}
+
+} // namespace
+
+TEST(SharedFrameRingBench, CrossProcess) {
+    auto pipe_result = runBench(false);
+    auto ring_result = runBench(true);
+    ASSERT_GT(pipe_result.mb_per_second, 0);
+    ASSERT_GT(ring_result.mb_per_second, 0);
+    printf("frame:%uKB pipe: %.0fMB/s p50:%lldus p99:%lldus, ring: %.0fMB/s p50:%lldus "
+           "p99:%lldus\n",
+           kFrameSize / 1024, pipe_result.mb_per_second,
+           static_cast<long long>(pipe_result.p50_us), static_cast<long long>(pipe_result.p99_us),
+           ring_result.mb_per_second, static_cast<long long>(ring_result.p50_us),
+           static_cast<long long>(ring_result.p99_us));
+}
+
+#endif // LT_WINDOWS
@@ -0,0 +1,126 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace ltlib {
+
+// 有界无锁队列, 只能一个线程push()另一个线程pop().
+// 满了push()返回false, 丢掉还是等由调用方决定. pop()出去的槽会立即重置, 不会多持有一份对象
+template <typename T> class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots_(capacity + 1) {}
+
+    bool push(T value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) % slots_.size();
+        if (next == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots_[tail] = std::move(value);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> pop() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        std::optional<T> value;
+        std::swap(value.emplace(), slots_[head]);
+        head_.store((head + 1) % slots_.size(), std::memory_order_release);
+        return value;
+    }
+
+    // 生产者线程里调用是准确的, 返回false之后下一次push()一定成功
+    bool full() const {
+        const size_t next = (tail_.load(std::memory_order_relaxed) + 1) % slots_.size();
+        return next == head_.load(std::memory_order_acquire);
+    }
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return slots_.size() - 1; }
+
+private:
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// 只保留最新值的无锁槽, 一个线程put()另一个线程take(). 内部是三缓冲: 生产者和消费者各占一个,
+// 中间那个连同"有新值"的标记一起用一次exchange交换, 两边都不分配内存也不会互相等待.
+// 上一个值还没被取走时会被新值替换掉, 被替换掉的值在put()里析构
+template <typename T> class LatestSlot {
+public:
+    // 返回true表示替换掉了一个还没被取走的值
+    bool put(T value) {
+        slots_[back_] = std::move(value);
+        const uint8_t prev = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+        back_ = prev & kIndexMask;
+        if ((prev & kFresh) == 0) {
+            return false;
+        }
+        slots_[back_] = T{};
+        return true;
+    }
+
+    std::optional<T> take() {
+        if ((middle_.load(std::memory_order_relaxed) & kFresh) == 0) {
+            return std::nullopt;
+        }
+        // 只有消费者会清掉kFresh, 这里换回来的一定是新值
+        const uint8_t prev = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = prev & kIndexMask;
+        std::optional<T> value;
+        std::swap(value.emplace(), slots_[front_]);
+        return value;
+    }
+
+private:
+    static constexpr uint8_t kFresh = 0x80;
+    static constexpr uint8_t kIndexMask = 0x03;
+    T slots_[3]{};
+    // 只在生产者线程访问
+    uint8_t back_ = 0;
+    alignas(64) std::atomic<uint8_t> middle_{1};
+    // 只在消费者线程访问
+    alignas(64) uint8_t front_ = 2;
+};
+
+} // namespace ltlib
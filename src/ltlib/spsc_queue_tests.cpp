@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include <ltlib/spsc_queue.h>
+
+TEST(SpscQueueTest, FifoAndCapacity) {
+    ltlib::SpscQueue<int> queue{3};
+    EXPECT_EQ(queue.capacity(), 3u);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.pop().has_value());
+    EXPECT_TRUE(queue.push(1));
+    EXPECT_TRUE(queue.push(2));
+    EXPECT_TRUE(queue.push(3));
+    EXPECT_TRUE(queue.full());
+    EXPECT_FALSE(queue.push(4));
+    EXPECT_EQ(queue.pop().value(), 1);
+    EXPECT_FALSE(queue.full());
+    EXPECT_TRUE(queue.push(5));
+    EXPECT_EQ(queue.pop().value(), 2);
+    EXPECT_EQ(queue.pop().value(), 3);
+    EXPECT_EQ(queue.pop().value(), 5);
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscQueueTest, ReleaseOnPop) {
+    ltlib::SpscQueue<std::shared_ptr<int>> queue{2};
+    auto value = std::make_shared<int>(1);
+    queue.push(value);
+    EXPECT_EQ(value.use_count(), 2);
+    queue.pop();
+    EXPECT_EQ(value.use_count(), 1);
+}
+
+TEST(SpscQueueTest, TwoThreads) {
+    constexpr uint64_t kCount = 1'000'000;
+    ltlib::SpscQueue<uint64_t> queue{16};
+    std::thread producer{[&queue]() {
+        for (uint64_t i = 1; i <= kCount;) {
+            if (queue.push(i)) {
+                i++;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    }};
+    uint64_t expected = 1;
+    while (expected <= kCount) {
+        if (auto value = queue.pop()) {
+            ASSERT_EQ(value.value(), expected);
+            expected++;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(LatestSlotTest, ReplaceStale) {
+    ltlib::LatestSlot<std::shared_ptr<int>> slot;
+    EXPECT_FALSE(slot.take().has_value());
+    auto first = std::make_shared<int>(1);
+    EXPECT_FALSE(slot.put(first));
+    EXPECT_EQ(first.use_count(), 2);
+    EXPECT_TRUE(slot.put(std::make_shared<int>(2)));
+    // 被替换掉的值马上释放
+    EXPECT_EQ(first.use_count(), 1);
+    EXPECT_TRUE(slot.put(std::make_shared<int>(3)));
+    auto value = slot.take();
+    ASSERT_TRUE(value.has_value());
+    EXPECT_EQ(*value.value(), 3);
+    EXPECT_FALSE(slot.take().has_value());
+    EXPECT_FALSE(slot.put(std::make_shared<int>(4)));
+    EXPECT_EQ(*slot.take().value(), 4);
+}
+
+// 消费者拿到的值单调递增, 并且最后一个值一定能拿到
+TEST(LatestSlotTest, TwoThreads) {
+    constexpr uint64_t kCount = 1'000'000;
+    ltlib::LatestSlot<uint64_t> slot;
+    std::atomic<uint64_t> replaced{0};
+    std::thread producer{[&]() {
+        for (uint64_t i = 1; i <= kCount; i++) {
+            if (slot.put(i)) {
+                replaced++;
+            }
+        }
+    }};
+    uint64_t last = 0;
+    uint64_t taken = 0;
+    while (last != kCount) {
+        if (auto value = slot.take()) {
+            ASSERT_GT(value.value(), last);
+            last = value.value();
+            taken++;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_EQ(taken + replaced, kCount);
+}
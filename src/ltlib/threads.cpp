@@ -146,8 +146,10 @@ std::thread::id ThreadWatcher::mainThreadID() {
 }
 
 ThreadWatcher::ThreadWatcher(std::thread::id main_thread_id)
-    : main_thread_id_{main_thread_id}
-    , thread_{std::bind(&ThreadWatcher::checkLoop, this)} {}
+    : main_thread_id_{main_thread_id} {
+    // thread_声明在mutex_和cv_前面, 放在初始化列表里会在它们构造完之前就跑起来
+    thread_ = std::thread{std::bind(&ThreadWatcher::checkLoop, this)};
+}
 
 ThreadWatcher::~ThreadWatcher() {
     {
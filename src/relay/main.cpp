@@ -0,0 +1,162 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <signal.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/logging.h>
+
+#include "relay_server.h"
+
+namespace {
+
+std::map<std::string, std::string> parseOptions(int argc, char* argv[]) {
+    std::map<std::string, std::string> options;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (argv[i][0] == '-' && argv[i + 1][0] != '-') {
+            options[argv[i]] = argv[i + 1];
+            i++;
+        }
+    }
+    return options;
+}
+
+uint64_t getOption(const std::map<std::string, std::string>& options, const std::string& key,
+                   uint64_t default_value) {
+    auto iter = options.find(key);
+    if (iter == options.end()) {
+        return default_value;
+    }
+    return std::stoull(iter->second);
+}
+
+void printUsage() {
+    ::printf("Usage: lanthing-relay -user <name> -password <password> [-realm lanthing]\n"
+             "                      [-ip 0.0.0.0] [-port 3478] [-external-ip <ip>]\n"
+             "                      [-threads 2] [-bandwidth-mbps 0] [-stats-interval 10]\n"
+             "                      [-log-dir ./log]\n"
+             "  Configure clients with relay:<host>:<port>:<name>:<password>\n"
+             "  -bandwidth-mbps 0 means unlimited\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc == 2 && (std::string{argv[1]} == "-h" || std::string{argv[1]} == "--help")) {
+        printUsage();
+        return 0;
+    }
+    auto options = parseOptions(argc, argv);
+    lt::relay::RelayServer::Params params{};
+    uint64_t stats_interval = 10;
+    std::string log_dir = "log";
+    try {
+        if (options.count("-ip")) {
+            params.bind_ip = options["-ip"];
+        }
+        if (options.count("-external-ip")) {
+            params.external_ip = options["-external-ip"];
+        }
+        if (options.count("-realm")) {
+            params.realm = options["-realm"];
+        }
+        if (options.count("-log-dir")) {
+            log_dir = options["-log-dir"];
+        }
+        params.username = options["-user"];
+        params.password = options["-password"];
+        params.port = static_cast<uint16_t>(getOption(options, "-port", 3478));
+        params.worker_threads = static_cast<uint32_t>(getOption(options, "-threads", 2));
+        params.session_bandwidth_bps = getOption(options, "-bandwidth-mbps", 0) * 1'000'000;
+        stats_interval = getOption(options, "-stats-interval", 10);
+    } catch (const std::exception&) {
+        printUsage();
+        return 1;
+    }
+    if (params.username.empty() || params.password.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::filesystem::create_directories(log_dir);
+    auto log_worker = g3::LogWorker::createLogWorker();
+    log_worker->addSink(std::make_unique<ltlib::LogSink>("relay", log_dir, 1),
+                        &ltlib::LogSink::fileWrite);
+    g3::only_change_at_initialization::addLogLevel(ERR);
+    g3::initializeLogging(log_worker.get());
+
+    // 先屏蔽信号再创建线程, 这样只有主线程会收到
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    auto server = lt::relay::RelayServer::create(params);
+    if (server == nullptr) {
+        ::printf("Start relay server failed, see log in %s\n", log_dir.c_str());
+        return 1;
+    }
+    ::printf("Relay listening on UDP %u\n", server->port());
+    timespec timeout{static_cast<time_t>(stats_interval == 0 ? 3600 : stats_interval), 0};
+    double last_cpu = 0;
+    while (true) {
+        int sig = sigtimedwait(&signals, nullptr, &timeout);
+        if (sig == SIGINT || sig == SIGTERM) {
+            LOG(INFO) << "Received signal " << sig << ", exit";
+            break;
+        }
+        if (stats_interval == 0) {
+            continue;
+        }
+        auto stats = server->sessionStats();
+        double cpu = server->cpuSeconds();
+        LOGF(INFO, "%zu allocations, cpu %.2f%%", stats.size(),
+             (cpu - last_cpu) * 100 / stats_interval);
+        last_cpu = cpu;
+        for (const auto& s : stats) {
+            LOGF(INFO,
+                 "  %s relay:%u bytes:%" PRIu64 "/%" PRIu64 " packets:%" PRIu64 "/%" PRIu64
+                 " throttled:%" PRIu64,
+                 s.client.c_str(), s.relay_port, s.bytes[0], s.bytes[1], s.packets[0],
+                 s.packets[1], s.throttled);
+        }
+    }
+    server.reset();
+    return 0;
+}
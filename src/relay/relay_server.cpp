@@ -0,0 +1,935 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "relay_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+#include "stun.h"
+
+namespace {
+
+constexpr int kMaxEvents = 256;
+constexpr uint32_t kUdpBatch = 64;
+constexpr uint32_t kUdpBufferSize = 2048;
+constexpr uint64_t kListenTag = 0;
+constexpr uint64_t kStopTag = 1;
+constexpr int kListenBufferSize = 8 * 1024 * 1024;
+constexpr int kRelayBufferSize = 1024 * 1024;
+constexpr int64_t kPermissionLifetimeMS = 300'000;
+constexpr int64_t kChannelLifetimeMS = 600'000;
+constexpr uint32_t kProtocolUdp = 17;
+constexpr uint32_t kChannelHeaderSize = 4;
+constexpr uint16_t kMinChannel = 0x4000;
+constexpr uint16_t kMaxChannel = 0x7FFE;
+constexpr uint8_t kZeros[4] = {};
+
+int64_t threadCpuNs() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1'000'000'000LL + ts.tv_nsec;
+}
+
+uint64_t addressKey(const sockaddr_in& addr) {
+    return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+
+bool sameAddress(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+std::string toString(const sockaddr_in& addr) {
+    char ip[INET_ADDRSTRLEN]{};
+    ::inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// 本机发往dst时使用的源地址, connect()一个UDP socket只选路由, 不发包
+bool localAddressFor(const sockaddr_in& dst, in_addr& local) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    const bool ok = ::connect(fd, reinterpret_cast<const sockaddr*>(&dst), sizeof(dst)) == 0 &&
+                    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) == 0;
+    ::close(fd);
+    local = addr.sin_addr;
+    return ok;
+}
+
+// 单位是字节. 突发量给50ms, 但至少64KB
+class TokenBucket {
+public:
+    void init(uint64_t bps) {
+        rate_ = bps / 8;
+        burst_ = std::max<uint64_t>(rate_ / 20, 64 * 1024);
+        tokens_ = burst_;
+        last_us_ = ltlib::steady_now_us();
+    }
+    bool unlimited() const { return rate_ == 0; }
+    uint64_t available(int64_t now_us) {
+        if (now_us > last_us_) {
+            tokens_ = std::min(burst_, tokens_ + rate_ * (now_us - last_us_) / 1'000'000);
+            last_us_ = now_us;
+        }
+        return tokens_;
+    }
+    void consume(uint64_t bytes) { tokens_ -= std::min(tokens_, bytes); }
+
+private:
+    uint64_t rate_ = 0;
+    uint64_t burst_ = 0;
+    uint64_t tokens_ = 0;
+    int64_t last_us_ = 0;
+};
+
+} // namespace
+
+namespace lt {
+
+namespace relay {
+
+// 一个线程一个epoll, 监听socket和这个线程分配出去的所有中继socket都在里面.
+// 收到的包在收包缓冲里原地转发: 客户端->对端跳过ChannelData头或者直接指向DATA属性,
+// 对端->客户端在headers_里写好TURN头, 和负载一起作为iovec交给sendmmsg.
+class TurnWorker {
+public:
+    TurnWorker(const RelayServer::Params& params, in_addr bind_addr, in_addr external_addr,
+               const std::string& nonce);
+    ~TurnWorker();
+    // port为0时由系统分配, 后面的线程用SO_REUSEPORT绑定同一个端口
+    bool start(uint16_t port, uint32_t index);
+    uint16_t port() const { return port_; }
+    void collectStats(std::vector<RelayServer::SessionStats>& stats);
+    int64_t cpuNs() const { return cpu_ns_; }
+
+private:
+    struct Permission {
+        uint32_t ip;
+        int64_t expire_ms;
+    };
+    struct Channel {
+        uint16_t number;
+        sockaddr_in peer;
+        int64_t expire_ms;
+    };
+    struct Allocation {
+        sockaddr_in client{};
+        sockaddr_in relayed{};
+        int fd = -1;
+        stun::TransactionId transaction_id{};
+        uint32_t lifetime_s = 0;
+        int64_t expire_ms = 0;
+        std::vector<Permission> permissions;
+        std::vector<Channel> channels;
+        TokenBucket buckets[2];
+        std::atomic<uint64_t> bytes[2]{};
+        std::atomic<uint64_t> packets[2]{};
+        std::atomic<uint64_t> throttled{0};
+        int64_t start_time_ms = 0;
+    };
+
+    void loop();
+    void onClientReadable(int64_t now_ms, int64_t now_us);
+    void onPeerReadable(Allocation& alloc, int64_t now_ms, int64_t now_us);
+    void onChannelData(const uint8_t* data, uint32_t size, const sockaddr_in& from,
+                       int64_t now_ms, int64_t now_us);
+    void onSendIndication(const stun::Message& msg, const sockaddr_in& from, int64_t now_ms,
+                          int64_t now_us);
+    void onRequest(const stun::Message& msg, const uint8_t* data, const sockaddr_in& from,
+                   int64_t now_ms);
+    bool authenticate(const stun::Message& msg, const uint8_t* data, const sockaddr_in& from);
+    void onAllocate(const stun::Message& msg, const sockaddr_in& from, int64_t now_ms);
+    void onRefresh(const stun::Message& msg, Allocation& alloc, int64_t now_ms);
+    void onCreatePermission(const stun::Message& msg, Allocation& alloc, int64_t now_ms);
+    void onChannelBind(const stun::Message& msg, Allocation& alloc, int64_t now_ms);
+    void replyAllocate(const stun::Message& msg, const Allocation& alloc);
+    void reply(stun::Writer& writer, const sockaddr_in& to);
+    void replyError(const stun::Message& msg, uint16_t code, const std::string& reason,
+                    const sockaddr_in& to, bool challenge = false);
+    uint32_t lifetimeOf(const stun::Message& msg) const;
+    Allocation* findAllocation(const sockaddr_in& client, int64_t now_ms);
+    void addPermission(Allocation& alloc, uint32_t ip, int64_t now_ms);
+    bool hasPermission(const Allocation& alloc, uint32_t ip, int64_t now_ms) const;
+    bool allow(Allocation& alloc, int index, uint32_t size, int64_t now_us);
+    void queue(int fd, const sockaddr_in& to, const uint8_t* header, uint32_t header_size,
+               const uint8_t* payload, uint32_t size, uint32_t padding);
+    void flush();
+    void removeExpired(int64_t now_ms);
+
+private:
+    const RelayServer::Params params_;
+    const in_addr bind_addr_;
+    const in_addr external_addr_;
+    const std::string nonce_;
+    const stun::Key key_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int stop_fd_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stopped_{false};
+    std::atomic<int64_t> cpu_ns_{0};
+    std::thread thread_;
+    // allocations_的增删在本线程, 加锁是为了collectStats()
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Allocation>> allocations_;
+    std::unordered_map<uint64_t, Allocation*> by_client_;
+    uint64_t next_transaction_ = 0;
+
+    // 收发缓冲, 每次收一批处理完就flush(), 发送的iovec可以直接指向收包缓冲
+    std::vector<uint8_t> buffers_;
+    iovec in_iovs_[kUdpBatch];
+    sockaddr_in from_[kUdpBatch];
+    mmsghdr in_msgs_[kUdpBatch];
+    uint8_t headers_[kUdpBatch][stun::kDataIndicationHeaderSize];
+    iovec out_iovs_[kUdpBatch][3];
+    sockaddr_in out_addrs_[kUdpBatch];
+    mmsghdr out_msgs_[kUdpBatch];
+    int out_fds_[kUdpBatch];
+    uint32_t out_count_ = 0;
+};
+
+TurnWorker::TurnWorker(const RelayServer::Params& params, in_addr bind_addr,
+                       in_addr external_addr, const std::string& nonce)
+    : params_{params}
+    , bind_addr_{bind_addr}
+    , external_addr_{external_addr}
+    , nonce_{nonce}
+    , key_{stun::longTermKey(params.username, params.realm, params.password)}
+    , buffers_(kUdpBatch * kUdpBufferSize) {
+    for (uint32_t i = 0; i < kUdpBatch; i++) {
+        in_iovs_[i] = {buffers_.data() + i * kUdpBufferSize, kUdpBufferSize};
+    }
+}
+
+TurnWorker::~TurnWorker() {
+    stopped_ = true;
+    if (thread_.joinable()) {
+        const uint64_t one = 1;
+        (void)::write(stop_fd_, &one, sizeof(one));
+        thread_.join();
+    }
+    for (auto& alloc : allocations_) {
+        ::close(alloc->fd);
+    }
+    for (int fd : {listen_fd_, epoll_fd_, stop_fd_}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+bool TurnWorker::start(uint16_t port, uint32_t index) {
+    listen_fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    stop_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd_ < 0 || epoll_fd_ < 0 || stop_fd_ < 0) {
+        LOG(ERR) << "Create relay sockets failed: " << errno;
+        return false;
+    }
+    const int one = 1;
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_RCVBUF, &kListenBufferSize, sizeof(int));
+    ::setsockopt(listen_fd_, SOL_SOCKET, SO_SNDBUF, &kListenBufferSize, sizeof(int));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr = bind_addr_;
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        LOG(ERR) << "Bind UDP " << toString(addr) << " failed: " << errno;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenTag;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.data.u64 = kStopTag;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &ev);
+    thread_ = std::thread([this, index]() {
+        LOG(INFO) << "Relay worker " << index << " started";
+        loop();
+        LOG(INFO) << "Relay worker " << index << " exited";
+    });
+    return true;
+}
+
+void TurnWorker::collectStats(std::vector<RelayServer::SessionStats>& stats) {
+    std::lock_guard lock{mutex_};
+    for (auto& alloc : allocations_) {
+        RelayServer::SessionStats s{};
+        s.client = toString(alloc->client);
+        s.relay_port = ntohs(alloc->relayed.sin_port);
+        for (int i = 0; i < 2; i++) {
+            s.bytes[i] = alloc->bytes[i];
+            s.packets[i] = alloc->packets[i];
+        }
+        s.throttled = alloc->throttled;
+        s.start_time_ms = alloc->start_time_ms;
+        stats.push_back(s);
+    }
+}
+
+void TurnWorker::loop() {
+    epoll_event events[kMaxEvents];
+    int64_t last_sweep_ms = ltlib::steady_now_ms();
+    while (!stopped_) {
+        const int count = ::epoll_wait(epoll_fd_, events, kMaxEvents, 1000);
+        const int64_t now_ms = ltlib::steady_now_ms();
+        const int64_t now_us = ltlib::steady_now_us();
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u64 == kStopTag) {
+                return;
+            }
+            if (events[i].data.u64 == kListenTag) {
+                onClientReadable(now_ms, now_us);
+            }
+            else {
+                onPeerReadable(*reinterpret_cast<Allocation*>(events[i].data.ptr), now_ms,
+                               now_us);
+            }
+        }
+        // 分配只在这里释放, 上面的events里不会再有指向它的指针
+        if (now_ms - last_sweep_ms >= 1000) {
+            last_sweep_ms = now_ms;
+            removeExpired(now_ms);
+        }
+        cpu_ns_ = threadCpuNs();
+    }
+}
+
+void TurnWorker::onClientReadable(int64_t now_ms, int64_t now_us) {
+    for (uint32_t i = 0; i < kUdpBatch; i++) {
+        in_msgs_[i] = {};
+        in_msgs_[i].msg_hdr.msg_iov = &in_iovs_[i];
+        in_msgs_[i].msg_hdr.msg_iovlen = 1;
+        in_msgs_[i].msg_hdr.msg_name = &from_[i];
+        in_msgs_[i].msg_hdr.msg_namelen = sizeof(from_[i]);
+    }
+    const int count = ::recvmmsg(listen_fd_, in_msgs_, kUdpBatch, MSG_DONTWAIT, nullptr);
+    stun::Message msg;
+    for (int i = 0; i < count; i++) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(in_iovs_[i].iov_base);
+        const uint32_t size = in_msgs_[i].msg_len;
+        if (stun::isChannelData(data, size)) {
+            onChannelData(data, size, from_[i], now_ms, now_us);
+            continue;
+        }
+        if (!stun::parse(data, size, msg)) {
+            continue;
+        }
+        if (msg.cls == stun::kIndication && msg.method == stun::kSend) {
+            onSendIndication(msg, from_[i], now_ms, now_us);
+        }
+        else if (msg.cls == stun::kRequest) {
+            onRequest(msg, data, from_[i], now_ms);
+        }
+    }
+    flush();
+}
+
+void TurnWorker::onPeerReadable(Allocation& alloc, int64_t now_ms, int64_t now_us) {
+    for (uint32_t i = 0; i < kUdpBatch; i++) {
+        in_msgs_[i] = {};
+        in_msgs_[i].msg_hdr.msg_iov = &in_iovs_[i];
+        in_msgs_[i].msg_hdr.msg_iovlen = 1;
+        in_msgs_[i].msg_hdr.msg_name = &from_[i];
+        in_msgs_[i].msg_hdr.msg_namelen = sizeof(from_[i]);
+    }
+    const int count = ::recvmmsg(alloc.fd, in_msgs_, kUdpBatch, MSG_DONTWAIT, nullptr);
+    if (alloc.expire_ms <= now_ms) {
+        // 已经释放, 等removeExpired()关闭socket, 这期间的包读出来丢掉
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(in_iovs_[i].iov_base);
+        const uint32_t size = in_msgs_[i].msg_len;
+        const sockaddr_in& peer = from_[i];
+        if (!hasPermission(alloc, peer.sin_addr.s_addr, now_ms) ||
+            !allow(alloc, 1, size, now_us)) {
+            continue;
+        }
+        uint8_t* header = headers_[out_count_];
+        auto channel = std::find_if(alloc.channels.begin(), alloc.channels.end(), [&](auto& c) {
+            return c.expire_ms > now_ms && sameAddress(c.peer, peer);
+        });
+        if (channel != alloc.channels.end()) {
+            header[0] = static_cast<uint8_t>(channel->number >> 8);
+            header[1] = static_cast<uint8_t>(channel->number);
+            header[2] = static_cast<uint8_t>(size >> 8);
+            header[3] = static_cast<uint8_t>(size);
+            queue(listen_fd_, alloc.client, header, kChannelHeaderSize, data, size, 0);
+            continue;
+        }
+        stun::TransactionId transaction_id{};
+        const uint64_t sequence = next_transaction_++;
+        memcpy(transaction_id.data(), &sequence, sizeof(sequence));
+        stun::writeDataIndicationHeader(header, transaction_id, peer,
+                                        static_cast<uint16_t>(size));
+        queue(listen_fd_, alloc.client, header, stun::kDataIndicationHeaderSize, data, size,
+              (4 - size % 4) % 4);
+    }
+    flush();
+}
+
+void TurnWorker::onChannelData(const uint8_t* data, uint32_t size, const sockaddr_in& from,
+                               int64_t now_ms, int64_t now_us) {
+    Allocation* alloc = findAllocation(from, now_ms);
+    if (alloc == nullptr) {
+        return;
+    }
+    const uint16_t number = static_cast<uint16_t>((data[0] << 8) | data[1]);
+    const uint32_t length = (data[2] << 8) | data[3];
+    if (kChannelHeaderSize + length > size) {
+        return;
+    }
+    for (const auto& channel : alloc->channels) {
+        if (channel.number == number && channel.expire_ms > now_ms) {
+            if (allow(*alloc, 0, length, now_us)) {
+                queue(alloc->fd, channel.peer, nullptr, 0, data + kChannelHeaderSize, length, 0);
+            }
+            return;
+        }
+    }
+}
+
+void TurnWorker::onSendIndication(const stun::Message& msg, const sockaddr_in& from,
+                                  int64_t now_ms, int64_t now_us) {
+    Allocation* alloc = findAllocation(from, now_ms);
+    const stun::Message::Attr* peer_attr = msg.find(stun::kXorPeerAddress);
+    const stun::Message::Attr* data_attr = msg.find(stun::kDataAttr);
+    sockaddr_in peer{};
+    if (alloc == nullptr || peer_attr == nullptr || data_attr == nullptr ||
+        !stun::getXorAddress(*peer_attr, peer) ||
+        !hasPermission(*alloc, peer.sin_addr.s_addr, now_ms) ||
+        !allow(*alloc, 0, data_attr->size, now_us)) {
+        return;
+    }
+    queue(alloc->fd, peer, nullptr, 0, data_attr->value, data_attr->size, 0);
+}
+
+void TurnWorker::onRequest(const stun::Message& msg, const uint8_t* data, const sockaddr_in& from,
+                           int64_t now_ms) {
+    // 0x8000以下的属性是必须理解的, 不认识就要回420
+    static const uint16_t kKnown[] = {
+        stun::kUsername,          stun::kMessageIntegrity,       stun::kChannelNumber,
+        stun::kLifetime,          stun::kXorPeerAddress,         stun::kDataAttr,
+        stun::kRealm,             stun::kNonce,                  stun::kRequestedAddressFamily,
+        stun::kEvenPort,          stun::kRequestedTransport,     stun::kDontFragment,
+        stun::kReservationToken,  stun::kPriority,               stun::kUseCandidate,
+    };
+    std::vector<uint8_t> unknown;
+    for (uint32_t i = 0; i < msg.attr_count; i++) {
+        const uint16_t type = msg.attrs[i].type;
+        if (type < 0x8000 && std::find(std::begin(kKnown), std::end(kKnown), type) ==
+                                 std::end(kKnown)) {
+            unknown.push_back(static_cast<uint8_t>(type >> 8));
+            unknown.push_back(static_cast<uint8_t>(type));
+        }
+    }
+    if (!unknown.empty()) {
+        stun::Writer writer{msg.method, stun::kError, msg.transaction_id};
+        writer.addError(420, "Unknown Attribute");
+        writer.add(stun::kUnknownAttributes, unknown.data(), static_cast<uint16_t>(unknown.size()));
+        writer.addFingerprint();
+        reply(writer, from);
+        return;
+    }
+    if (msg.method == stun::kBinding) {
+        stun::Writer writer{stun::kBinding, stun::kSuccess, msg.transaction_id};
+        writer.addXorAddress(stun::kXorMappedAddress, from);
+        writer.addFingerprint();
+        reply(writer, from);
+        return;
+    }
+    if (!authenticate(msg, data, from)) {
+        return;
+    }
+    if (msg.method == stun::kAllocate) {
+        onAllocate(msg, from, now_ms);
+        return;
+    }
+    Allocation* alloc = findAllocation(from, now_ms);
+    if (alloc == nullptr) {
+        replyError(msg, 437, "Allocation Mismatch", from);
+        return;
+    }
+    switch (msg.method) {
+    case stun::kRefresh:
+        onRefresh(msg, *alloc, now_ms);
+        break;
+    case stun::kCreatePermission:
+        onCreatePermission(msg, *alloc, now_ms);
+        break;
+    case stun::kChannelBind:
+        onChannelBind(msg, *alloc, now_ms);
+        break;
+    default:
+        replyError(msg, 400, "Bad Request", from);
+        break;
+    }
+}
+
+bool TurnWorker::authenticate(const stun::Message& msg, const uint8_t* data,
+                              const sockaddr_in& from) {
+    if (msg.find(stun::kMessageIntegrity) == nullptr) {
+        // 第一次请求不带凭证, 回401让客户端拿REALM和NONCE重发
+        replyError(msg, 401, "Unauthorized", from, true);
+        return false;
+    }
+    const std::string username = msg.getString(stun::kUsername);
+    const std::string realm = msg.getString(stun::kRealm);
+    const std::string nonce = msg.getString(stun::kNonce);
+    if (username.empty() || realm.empty() || nonce.empty()) {
+        replyError(msg, 400, "Bad Request", from);
+        return false;
+    }
+    if (nonce != nonce_) {
+        replyError(msg, 438, "Stale Nonce", from, true);
+        return false;
+    }
+    if (username != params_.username || realm != params_.realm ||
+        !stun::checkIntegrity(data, msg, key_)) {
+        LOG(WARNING) << "Relay rejected " << toString(from) << " with username " << username;
+        replyError(msg, 401, "Unauthorized", from, true);
+        return false;
+    }
+    return true;
+}
+
+void TurnWorker::onAllocate(const stun::Message& msg, const sockaddr_in& from, int64_t now_ms) {
+    auto it = by_client_.find(addressKey(from));
+    if (it != by_client_.end()) {
+        if (it->second->transaction_id == msg.transaction_id) {
+            // 响应丢了, 客户端在重传
+            replyAllocate(msg, *it->second);
+        }
+        else {
+            replyError(msg, 437, "Allocation Mismatch", from);
+        }
+        return;
+    }
+    uint32_t transport = 0;
+    if (!msg.getUint32(stun::kRequestedTransport, transport)) {
+        replyError(msg, 400, "Bad Request", from);
+        return;
+    }
+    if ((transport >> 24) != kProtocolUdp) {
+        replyError(msg, 442, "Unsupported Transport Protocol", from);
+        return;
+    }
+    const stun::Message::Attr* family = msg.find(stun::kRequestedAddressFamily);
+    if (family != nullptr && (family->size < 1 || family->value[0] != 0x01)) {
+        replyError(msg, 440, "Address Family not Supported", from);
+        return;
+    }
+    if (msg.find(stun::kEvenPort) != nullptr || msg.find(stun::kReservationToken) != nullptr) {
+        // 不做端口预留
+        replyError(msg, 508, "Insufficient Capacity", from);
+        return;
+    }
+    auto alloc = std::make_unique<Allocation>();
+    alloc->client = from;
+    alloc->transaction_id = msg.transaction_id;
+    alloc->lifetime_s = lifetimeOf(msg);
+    alloc->expire_ms = now_ms + alloc->lifetime_s * 1000LL;
+    alloc->start_time_ms = now_ms;
+    for (auto& bucket : alloc->buckets) {
+        bucket.init(params_.session_bandwidth_bps);
+    }
+    alloc->fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr = bind_addr_;
+    socklen_t len = sizeof(addr);
+    in_addr relayed_ip = external_addr_;
+    if (alloc->fd < 0 ||
+        ::bind(alloc->fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::getsockname(alloc->fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+        (relayed_ip.s_addr == INADDR_ANY && !localAddressFor(from, relayed_ip))) {
+        LOG(ERR) << "Create relay socket for " << toString(from) << " failed: " << errno;
+        if (alloc->fd >= 0) {
+            ::close(alloc->fd);
+        }
+        replyError(msg, 508, "Insufficient Capacity", from);
+        return;
+    }
+    ::setsockopt(alloc->fd, SOL_SOCKET, SO_RCVBUF, &kRelayBufferSize, sizeof(int));
+    ::setsockopt(alloc->fd, SOL_SOCKET, SO_SNDBUF, &kRelayBufferSize, sizeof(int));
+    alloc->relayed = addr;
+    alloc->relayed.sin_addr = relayed_ip;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = alloc.get();
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, alloc->fd, &ev);
+    LOG(INFO) << "Relay allocated " << toString(alloc->relayed) << " for " << toString(from);
+    replyAllocate(msg, *alloc);
+    by_client_[addressKey(from)] = alloc.get();
+    std::lock_guard lock{mutex_};
+    allocations_.push_back(std::move(alloc));
+}
+
+void TurnWorker::onRefresh(const stun::Message& msg, Allocation& alloc, int64_t now_ms) {
+    uint32_t requested = 0;
+    uint32_t lifetime = 0;
+    if (msg.getUint32(stun::kLifetime, requested) && requested == 0) {
+        // 立即释放, socket等removeExpired()再关
+        alloc.expire_ms = 0;
+        by_client_.erase(addressKey(alloc.client));
+    }
+    else {
+        lifetime = lifetimeOf(msg);
+        alloc.expire_ms = now_ms + lifetime * 1000LL;
+    }
+    stun::Writer writer{stun::kRefresh, stun::kSuccess, msg.transaction_id};
+    writer.addUint32(stun::kLifetime, lifetime);
+    writer.addIntegrity(key_);
+    writer.addFingerprint();
+    reply(writer, alloc.client);
+}
+
+void TurnWorker::onCreatePermission(const stun::Message& msg, Allocation& alloc,
+                                    int64_t now_ms) {
+    std::vector<uint32_t> ips;
+    for (uint32_t i = 0; i < msg.attr_count; i++) {
+        if (msg.attrs[i].type != stun::kXorPeerAddress) {
+            continue;
+        }
+        sockaddr_in peer{};
+        if (!stun::getXorAddress(msg.attrs[i], peer)) {
+            replyError(msg, 400, "Bad Request", alloc.client);
+            return;
+        }
+        ips.push_back(peer.sin_addr.s_addr);
+    }
+    if (ips.empty()) {
+        replyError(msg, 400, "Bad Request", alloc.client);
+        return;
+    }
+    for (uint32_t ip : ips) {
+        addPermission(alloc, ip, now_ms);
+    }
+    stun::Writer writer{stun::kCreatePermission, stun::kSuccess, msg.transaction_id};
+    writer.addIntegrity(key_);
+    writer.addFingerprint();
+    reply(writer, alloc.client);
+}
+
+void TurnWorker::onChannelBind(const stun::Message& msg, Allocation& alloc, int64_t now_ms) {
+    const stun::Message::Attr* number_attr = msg.find(stun::kChannelNumber);
+    const stun::Message::Attr* peer_attr = msg.find(stun::kXorPeerAddress);
+    sockaddr_in peer{};
+    if (number_attr == nullptr || number_attr->size != 4 || peer_attr == nullptr ||
+        !stun::getXorAddress(*peer_attr, peer)) {
+        replyError(msg, 400, "Bad Request", alloc.client);
+        return;
+    }
+    const uint16_t number =
+        static_cast<uint16_t>((number_attr->value[0] << 8) | number_attr->value[1]);
+    if (number < kMinChannel || number > kMaxChannel) {
+        replyError(msg, 400, "Bad Request", alloc.client);
+        return;
+    }
+    Channel* bound = nullptr;
+    for (auto& channel : alloc.channels) {
+        const bool same_number = channel.number == number;
+        const bool same_peer = sameAddress(channel.peer, peer);
+        if (same_number != same_peer) {
+            // 通道号或者对端已经绑给了别人
+            replyError(msg, 400, "Bad Request", alloc.client);
+            return;
+        }
+        if (same_number) {
+            bound = &channel;
+        }
+    }
+    if (bound == nullptr) {
+        alloc.channels.push_back(Channel{number, peer, 0});
+        bound = &alloc.channels.back();
+    }
+    bound->expire_ms = now_ms + kChannelLifetimeMS;
+    addPermission(alloc, peer.sin_addr.s_addr, now_ms);
+    stun::Writer writer{stun::kChannelBind, stun::kSuccess, msg.transaction_id};
+    writer.addIntegrity(key_);
+    writer.addFingerprint();
+    reply(writer, alloc.client);
+}
+
+void TurnWorker::replyAllocate(const stun::Message& msg, const Allocation& alloc) {
+    stun::Writer writer{stun::kAllocate, stun::kSuccess, msg.transaction_id};
+    writer.addXorAddress(stun::kXorRelayedAddress, alloc.relayed);
+    writer.addUint32(stun::kLifetime, alloc.lifetime_s);
+    writer.addXorAddress(stun::kXorMappedAddress, alloc.client);
+    writer.addIntegrity(key_);
+    writer.addFingerprint();
+    reply(writer, alloc.client);
+}
+
+void TurnWorker::reply(stun::Writer& writer, const sockaddr_in& to) {
+    const auto& bytes = writer.bytes();
+    (void)::sendto(listen_fd_, bytes.data(), bytes.size(), 0,
+                   reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+}
+
+void TurnWorker::replyError(const stun::Message& msg, uint16_t code, const std::string& reason,
+                            const sockaddr_in& to, bool challenge) {
+    stun::Writer writer{msg.method, stun::kError, msg.transaction_id};
+    writer.addError(code, reason);
+    if (challenge) {
+        writer.addString(stun::kRealm, params_.realm);
+        writer.addString(stun::kNonce, nonce_);
+    }
+    writer.addFingerprint();
+    reply(writer, to);
+}
+
+// RFC 5766: 取请求值和上限中较小的那个, 但不低于默认值
+uint32_t TurnWorker::lifetimeOf(const stun::Message& msg) const {
+    uint32_t requested = 0;
+    if (!msg.getUint32(stun::kLifetime, requested)) {
+        return params_.default_lifetime_s;
+    }
+    return std::max(params_.default_lifetime_s, std::min(requested, params_.max_lifetime_s));
+}
+
+TurnWorker::Allocation* TurnWorker::findAllocation(const sockaddr_in& client, int64_t now_ms) {
+    auto it = by_client_.find(addressKey(client));
+    if (it == by_client_.end() || it->second->expire_ms <= now_ms) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+void TurnWorker::addPermission(Allocation& alloc, uint32_t ip, int64_t now_ms) {
+    for (auto& permission : alloc.permissions) {
+        if (permission.ip == ip) {
+            permission.expire_ms = now_ms + kPermissionLifetimeMS;
+            return;
+        }
+    }
+    alloc.permissions.push_back(Permission{ip, now_ms + kPermissionLifetimeMS});
+}
+
+// 一个分配通常只有几个对端, 线性查找比哈希表快
+bool TurnWorker::hasPermission(const Allocation& alloc, uint32_t ip, int64_t now_ms) const {
+    for (const auto& permission : alloc.permissions) {
+        if (permission.ip == ip) {
+            return permission.expire_ms > now_ms;
+        }
+    }
+    return false;
+}
+
+bool TurnWorker::allow(Allocation& alloc, int index, uint32_t size, int64_t now_us) {
+    TokenBucket& bucket = alloc.buckets[index];
+    if (!bucket.unlimited()) {
+        if (bucket.available(now_us) < size) {
+            alloc.throttled++;
+            return false;
+        }
+        bucket.consume(size);
+    }
+    alloc.bytes[index] += size;
+    alloc.packets[index]++;
+    return true;
+}
+
+void TurnWorker::queue(int fd, const sockaddr_in& to, const uint8_t* header,
+                       uint32_t header_size, const uint8_t* payload, uint32_t size,
+                       uint32_t padding) {
+    const uint32_t n = out_count_++;
+    size_t iov_count = 0;
+    if (header_size != 0) {
+        out_iovs_[n][iov_count++] = {const_cast<uint8_t*>(header), header_size};
+    }
+    out_iovs_[n][iov_count++] = {const_cast<uint8_t*>(payload), size};
+    if (padding != 0) {
+        out_iovs_[n][iov_count++] = {const_cast<uint8_t*>(kZeros), padding};
+    }
+    out_addrs_[n] = to;
+    out_fds_[n] = fd;
+    out_msgs_[n] = {};
+    out_msgs_[n].msg_hdr.msg_iov = out_iovs_[n];
+    out_msgs_[n].msg_hdr.msg_iovlen = iov_count;
+    out_msgs_[n].msg_hdr.msg_name = &out_addrs_[n];
+    out_msgs_[n].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+}
+
+// 同一个fd的连续一段用一次sendmmsg发出去
+void TurnWorker::flush() {
+    uint32_t begin = 0;
+    while (begin < out_count_) {
+        uint32_t end = begin + 1;
+        while (end < out_count_ && out_fds_[end] == out_fds_[begin]) {
+            end++;
+        }
+        uint32_t sent = begin;
+        while (sent < end) {
+            const int n = ::sendmmsg(out_fds_[begin], out_msgs_ + sent, end - sent, 0);
+            if (n <= 0) {
+                // 发送缓冲满了, 这一段剩下的丢掉, 跟路由器的行为一样
+                break;
+            }
+            sent += static_cast<uint32_t>(n);
+        }
+        begin = end;
+    }
+    out_count_ = 0;
+}
+
+void TurnWorker::removeExpired(int64_t now_ms) {
+    std::lock_guard lock{mutex_};
+    auto it = std::remove_if(allocations_.begin(), allocations_.end(), [&](auto& alloc) {
+        auto& permissions = alloc->permissions;
+        permissions.erase(std::remove_if(permissions.begin(), permissions.end(),
+                                         [&](auto& p) { return p.expire_ms <= now_ms; }),
+                          permissions.end());
+        auto& channels = alloc->channels;
+        channels.erase(std::remove_if(channels.begin(), channels.end(),
+                                      [&](auto& c) { return c.expire_ms <= now_ms; }),
+                       channels.end());
+        if (alloc->expire_ms > now_ms) {
+            return false;
+        }
+        LOG(INFO) << "Relay allocation " << toString(alloc->relayed) << " for "
+                  << toString(alloc->client) << " released, bytes " << alloc->bytes[0] << "/"
+                  << alloc->bytes[1];
+        auto client = by_client_.find(addressKey(alloc->client));
+        if (client != by_client_.end() && client->second == alloc.get()) {
+            by_client_.erase(client);
+        }
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, alloc->fd, nullptr);
+        ::close(alloc->fd);
+        return true;
+    });
+    allocations_.erase(it, allocations_.end());
+}
+
+//*****************************************************************************
+
+std::unique_ptr<RelayServer> RelayServer::create(const Params& params) {
+    if (params.worker_threads == 0 || params.username.empty() || params.password.empty()) {
+        LOG(ERR) << "Relay needs at least one worker thread and a username/password";
+        return nullptr;
+    }
+    std::unique_ptr<RelayServer> server{new RelayServer{params}};
+    if (!server->init()) {
+        return nullptr;
+    }
+    return server;
+}
+
+RelayServer::RelayServer(const Params& params)
+    : params_{params} {}
+
+RelayServer::~RelayServer() {
+    workers_.clear();
+}
+
+std::vector<RelayServer::SessionStats> RelayServer::sessionStats() {
+    std::vector<SessionStats> stats;
+    for (auto& worker : workers_) {
+        worker->collectStats(stats);
+    }
+    return stats;
+}
+
+double RelayServer::cpuSeconds() {
+    int64_t ns = 0;
+    for (auto& worker : workers_) {
+        ns += worker->cpuNs();
+    }
+    return ns / 1e9;
+}
+
+bool RelayServer::init() {
+    in_addr bind_addr{};
+    in_addr external_addr{};
+    if (::inet_pton(AF_INET, params_.bind_ip.c_str(), &bind_addr) != 1) {
+        LOG(ERR) << "Invalid bind ip " << params_.bind_ip;
+        return false;
+    }
+    if (!params_.external_ip.empty()) {
+        if (::inet_pton(AF_INET, params_.external_ip.c_str(), &external_addr) != 1) {
+            LOG(ERR) << "Invalid external ip " << params_.external_ip;
+            return false;
+        }
+    }
+    else {
+        external_addr = bind_addr;
+    }
+    // 所有线程共用一个nonce, 进程重启之后旧的nonce会得到438, 客户端用新的重试
+    std::random_device rd;
+    std::string nonce;
+    for (int i = 0; i < 4; i++) {
+        char hex[9];
+        ::snprintf(hex, sizeof(hex), "%08x", rd());
+        nonce += hex;
+    }
+    uint16_t port = params_.port;
+    for (uint32_t i = 0; i < params_.worker_threads; i++) {
+        auto worker = std::make_unique<TurnWorker>(params_, bind_addr, external_addr, nonce);
+        if (!worker->start(port, i)) {
+            return false;
+        }
+        port = worker->port();
+        workers_.push_back(std::move(worker));
+    }
+    port_ = port;
+    LOG(INFO) << "Relay listening on UDP " << params_.bind_ip << ":" << port_;
+    return true;
+}
+
+} // namespace relay
+
+} // namespace lt
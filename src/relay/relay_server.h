@@ -0,0 +1,102 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lt {
+
+namespace relay {
+
+class TurnWorker;
+
+// 给自建中继的部署用的TURN服务, 仅支持Linux.
+// 客户端和被控端的rtc库把"relay:host:port:user:password"当作TURN服务器, 用长期凭证鉴权,
+// 所以这里实现的是RFC 5766的一个子集: 只有UDP, 只有IPv4, 只有一组用户名密码.
+// 支持Binding, Allocate, Refresh, CreatePermission, ChannelBind, Send/Data indication和ChannelData.
+// 每个工作线程一个SO_REUSEPORT的监听socket, 内核按五元组分流, 同一个客户端总是落在同一个线程,
+// 它分配到的中继socket也归这个线程, 线程之间不共享状态.
+// recvmmsg/sendmmsg批量收发, TURN头用iovec拼在收包缓冲前面或者直接跳过, 负载不再拷贝.
+// 每个分配每个方向一个令牌桶限速, 超速丢包.
+class RelayServer {
+public:
+    struct Params {
+        std::string bind_ip = "0.0.0.0";
+        // 0表示由系统分配
+        uint16_t port = 0;
+        // 写进XOR-RELAYED-ADDRESS给对端用的地址. 为空时, bind_ip不是0.0.0.0就用bind_ip,
+        // 否则用本机发往客户端时使用的那个地址
+        std::string external_ip;
+        std::string realm = "lanthing";
+        std::string username;
+        std::string password;
+        uint32_t worker_threads = 2;
+        // 每个分配每个方向的带宽上限, 0表示不限
+        uint64_t session_bandwidth_bps = 0;
+        // 秒, 客户端没带LIFETIME时用默认值, 带了也不能超过上限
+        uint32_t default_lifetime_s = 600;
+        uint32_t max_lifetime_s = 3600;
+    };
+    struct SessionStats {
+        // 客户端的ip:port
+        std::string client;
+        uint16_t relay_port;
+        // [0]客户端发往对端, [1]反方向
+        uint64_t bytes[2];
+        uint64_t packets[2];
+        // 因为限速丢弃的包数
+        uint64_t throttled;
+        int64_t start_time_ms;
+    };
+
+public:
+    static std::unique_ptr<RelayServer> create(const Params& params);
+    ~RelayServer();
+    uint16_t port() const { return port_; }
+    std::vector<SessionStats> sessionStats();
+    // 所有工作线程消耗的CPU时间
+    double cpuSeconds();
+
+private:
+    RelayServer(const Params& params);
+    bool init();
+
+private:
+    const Params params_;
+    uint16_t port_ = 0;
+    std::vector<std::unique_ptr<TurnWorker>> workers_;
+};
+
+} // namespace relay
+
+} // namespace lt
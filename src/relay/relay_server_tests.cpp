@@ -0,0 +1,500 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "relay_server.h"
+#include "stun.h"
+
+using lt::relay::RelayServer;
+namespace stun = lt::relay::stun;
+
+namespace {
+
+constexpr char kUser[] = "user";
+constexpr char kPassword[] = "password";
+
+sockaddr_in loopback(uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+sockaddr_in localAddress(int fd) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    return addr;
+}
+
+bool sameAddress(const sockaddr_in& a, const sockaddr_in& b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+int udpSocket(int timeout_ms, uint32_t ip = INADDR_LOOPBACK) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    auto addr = loopback(0);
+    addr.sin_addr.s_addr = htonl(ip);
+    ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    timeval tv{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+std::vector<uint8_t> pattern(size_t size, uint8_t seed) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>(i * 31 + seed);
+    }
+    return data;
+}
+
+std::vector<uint8_t> recvPacket(int fd, sockaddr_in* from = nullptr) {
+    std::vector<uint8_t> data(4096);
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    ssize_t n = ::recvfrom(fd, data.data(), data.size(), 0, reinterpret_cast<sockaddr*>(&addr),
+                           &len);
+    data.resize(n > 0 ? n : 0);
+    if (from != nullptr) {
+        *from = addr;
+    }
+    return data;
+}
+
+uint16_t errorCode(const stun::Message& msg) {
+    const stun::Message::Attr* attr = msg.find(stun::kErrorCode);
+    if (attr == nullptr || attr->size < 4) {
+        return 0;
+    }
+    return attr->value[2] * 100 + attr->value[3];
+}
+
+// 按rtc库的流程走的最小TURN客户端: 先不带凭证发Allocate拿到401, 再带上REALM/NONCE重发
+class TurnClient {
+public:
+    TurnClient(uint16_t server_port, const std::string& password = kPassword)
+        : fd_{udpSocket(1000)}
+        , server_{loopback(server_port)}
+        , password_{password} {}
+    ~TurnClient() { ::close(fd_); }
+    int fd() const { return fd_; }
+    const sockaddr_in& relayed() const { return relayed_; }
+
+    stun::TransactionId newTransaction() {
+        stun::TransactionId id;
+        for (auto& byte : id) {
+            byte = static_cast<uint8_t>(rng_());
+        }
+        return id;
+    }
+
+    // 返回响应的原始字节, msg指向它
+    std::vector<uint8_t> request(stun::Writer& writer, stun::Message& msg) {
+        sendRaw(writer.bytes());
+        auto response = recvPacket(fd_);
+        if (response.empty() || !stun::parse(response.data(), response.size(), msg)) {
+            response.clear();
+        }
+        return response;
+    }
+
+    stun::Writer authed(uint16_t method) {
+        stun::Writer writer{method, stun::kRequest, newTransaction()};
+        writer.addString(stun::kUsername, kUser);
+        writer.addString(stun::kRealm, realm_);
+        writer.addString(stun::kNonce, nonce_);
+        return writer;
+    }
+
+    stun::Key key() const { return stun::longTermKey(kUser, realm_, password_); }
+
+    // 返回最后一个响应的错误码, 0表示成功
+    uint16_t allocate() {
+        stun::Writer first{stun::kAllocate, stun::kRequest, newTransaction()};
+        first.addUint32(stun::kRequestedTransport, 17u << 24);
+        stun::Message msg;
+        auto response = request(first, msg);
+        if (response.empty() || errorCode(msg) != 401) {
+            return 1;
+        }
+        realm_ = msg.getString(stun::kRealm);
+        nonce_ = msg.getString(stun::kNonce);
+        auto writer = authed(stun::kAllocate);
+        writer.addUint32(stun::kRequestedTransport, 17u << 24);
+        finish(writer);
+        response = request(writer, msg);
+        if (response.empty()) {
+            return 1;
+        }
+        if (msg.cls != stun::kSuccess) {
+            return errorCode(msg);
+        }
+        const stun::Message::Attr* relayed = msg.find(stun::kXorRelayedAddress);
+        if (relayed == nullptr || !stun::getXorAddress(*relayed, relayed_) ||
+            !stun::checkIntegrity(response.data(), msg, key())) {
+            return 1;
+        }
+        return 0;
+    }
+
+    uint16_t simple(stun::Writer& writer) {
+        finish(writer);
+        stun::Message msg;
+        auto response = request(writer, msg);
+        if (response.empty()) {
+            return 1;
+        }
+        return msg.cls == stun::kSuccess ? 0 : errorCode(msg);
+    }
+
+    uint16_t createPermission(const sockaddr_in& peer) {
+        auto writer = authed(stun::kCreatePermission);
+        writer.addXorAddress(stun::kXorPeerAddress, peer);
+        return simple(writer);
+    }
+
+    uint16_t channelBind(uint16_t channel, const sockaddr_in& peer) {
+        auto writer = authed(stun::kChannelBind);
+        writer.addUint32(stun::kChannelNumber, static_cast<uint32_t>(channel) << 16);
+        writer.addXorAddress(stun::kXorPeerAddress, peer);
+        return simple(writer);
+    }
+
+    uint16_t refresh(uint32_t lifetime) {
+        auto writer = authed(stun::kRefresh);
+        writer.addUint32(stun::kLifetime, lifetime);
+        return simple(writer);
+    }
+
+    void sendIndication(const sockaddr_in& peer, const std::vector<uint8_t>& data) {
+        stun::Writer writer{stun::kSend, stun::kIndication, newTransaction()};
+        writer.addXorAddress(stun::kXorPeerAddress, peer);
+        writer.add(stun::kDataAttr, data.data(), static_cast<uint16_t>(data.size()));
+        sendRaw(writer.bytes());
+    }
+
+    void sendChannelData(uint16_t channel, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> packet(4 + data.size());
+        packet[0] = static_cast<uint8_t>(channel >> 8);
+        packet[1] = static_cast<uint8_t>(channel);
+        packet[2] = static_cast<uint8_t>(data.size() >> 8);
+        packet[3] = static_cast<uint8_t>(data.size());
+        memcpy(packet.data() + 4, data.data(), data.size());
+        sendRaw(packet);
+    }
+
+    void sendRaw(const std::vector<uint8_t>& data) {
+        ::sendto(fd_, data.data(), data.size(), 0, reinterpret_cast<const sockaddr*>(&server_),
+                 sizeof(server_));
+    }
+
+private:
+    void finish(stun::Writer& writer) {
+        writer.addIntegrity(key());
+        writer.addFingerprint();
+    }
+
+private:
+    const int fd_;
+    const sockaddr_in server_;
+    const std::string password_;
+    std::mt19937 rng_{std::random_device{}()};
+    std::string realm_;
+    std::string nonce_;
+    sockaddr_in relayed_{};
+};
+
+RelayServer::Params testParams() {
+    RelayServer::Params params{};
+    params.bind_ip = "127.0.0.1";
+    params.username = kUser;
+    params.password = kPassword;
+    return params;
+}
+
+} // namespace
+
+TEST(StunTest, WriterAndParserAgree) {
+    stun::TransactionId id{};
+    id[0] = 0x5A;
+    stun::Writer writer{stun::kChannelBind, stun::kRequest, id};
+    writer.addString(stun::kUsername, "abc");
+    writer.addXorAddress(stun::kXorPeerAddress, loopback(4000));
+    const auto key = stun::longTermKey("abc", "realm", "pass");
+    writer.addIntegrity(key);
+    writer.addFingerprint();
+    const auto bytes = writer.bytes();
+    stun::Message msg;
+    ASSERT_TRUE(stun::parse(bytes.data(), bytes.size(), msg));
+    EXPECT_EQ(msg.method, stun::kChannelBind);
+    EXPECT_EQ(msg.cls, stun::kRequest);
+    EXPECT_EQ(msg.transaction_id, id);
+    EXPECT_EQ(msg.getString(stun::kUsername), "abc");
+    sockaddr_in peer{};
+    ASSERT_TRUE(stun::getXorAddress(*msg.find(stun::kXorPeerAddress), peer));
+    EXPECT_TRUE(sameAddress(peer, loopback(4000)));
+    EXPECT_TRUE(stun::checkIntegrity(bytes.data(), msg, key));
+    EXPECT_FALSE(stun::checkIntegrity(bytes.data(), msg, stun::longTermKey("abc", "realm", "x")));
+    uint32_t fingerprint = 0;
+    ASSERT_TRUE(msg.getUint32(stun::kFingerprint, fingerprint));
+    EXPECT_EQ(fingerprint, stun::crc32(bytes.data(), bytes.size() - 8) ^ 0x5354554E);
+    // CRC32的标准校验值
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    EXPECT_EQ(stun::crc32(check, sizeof(check)), 0xCBF43926u);
+}
+
+TEST(RelayServerTest, BindingAndAuthentication) {
+    auto server = RelayServer::create(testParams());
+    ASSERT_NE(server, nullptr);
+    TurnClient client{server->port()};
+    stun::Writer binding{stun::kBinding, stun::kRequest, client.newTransaction()};
+    stun::Message msg;
+    auto response = client.request(binding, msg);
+    ASSERT_FALSE(response.empty());
+    EXPECT_EQ(msg.cls, stun::kSuccess);
+    sockaddr_in mapped{};
+    ASSERT_TRUE(stun::getXorAddress(*msg.find(stun::kXorMappedAddress), mapped));
+    EXPECT_TRUE(sameAddress(mapped, localAddress(client.fd())));
+
+    TurnClient wrong{server->port(), "wrong"};
+    EXPECT_EQ(wrong.allocate(), 401);
+    EXPECT_EQ(client.allocate(), 0);
+    EXPECT_EQ(client.relayed().sin_addr.s_addr, htonl(INADDR_LOOPBACK));
+    // 同一个五元组再分配一次要失败
+    EXPECT_EQ(client.allocate(), 437);
+    EXPECT_EQ(server->sessionStats().size(), 1u);
+}
+
+TEST(RelayServerTest, SendAndDataIndication) {
+    auto server = RelayServer::create(testParams());
+    ASSERT_NE(server, nullptr);
+    TurnClient client{server->port()};
+    ASSERT_EQ(client.allocate(), 0);
+    int peer = udpSocket(200);
+    // 127.0.0.0/8都是本机地址, 用另一个IP模拟没有权限的对端
+    int stranger = udpSocket(200, INADDR_LOOPBACK + 1);
+    const sockaddr_in peer_addr = localAddress(peer);
+    const sockaddr_in& relayed = client.relayed();
+
+    // 没有权限时两个方向都不转发
+    auto payload = pattern(1000, 1);
+    client.sendIndication(peer_addr, payload);
+    EXPECT_TRUE(recvPacket(peer).empty());
+    ASSERT_EQ(client.createPermission(peer_addr), 0);
+    client.sendIndication(peer_addr, payload);
+    sockaddr_in from{};
+    EXPECT_EQ(recvPacket(peer, &from), payload);
+    EXPECT_TRUE(sameAddress(from, relayed));
+
+    // 长度不是4的倍数, 检查填充
+    auto reply = pattern(999, 2);
+    ::sendto(peer, reply.data(), reply.size(), 0, reinterpret_cast<const sockaddr*>(&relayed),
+             sizeof(relayed));
+    auto indication = recvPacket(client.fd());
+    stun::Message msg;
+    ASSERT_TRUE(stun::parse(indication.data(), indication.size(), msg));
+    EXPECT_EQ(msg.method, stun::kData);
+    EXPECT_EQ(msg.cls, stun::kIndication);
+    sockaddr_in data_peer{};
+    ASSERT_TRUE(stun::getXorAddress(*msg.find(stun::kXorPeerAddress), data_peer));
+    EXPECT_TRUE(sameAddress(data_peer, peer_addr));
+    const stun::Message::Attr* data = msg.find(stun::kDataAttr);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(std::vector<uint8_t>(data->value, data->value + data->size), reply);
+
+    ::sendto(stranger, reply.data(), reply.size(), 0,
+             reinterpret_cast<const sockaddr*>(&relayed), sizeof(relayed));
+    EXPECT_TRUE(recvPacket(client.fd()).empty());
+    // 权限是按IP的, 同一个IP换个端口可以通过
+    int same_ip = udpSocket(200);
+    ::sendto(same_ip, reply.data(), reply.size(), 0,
+             reinterpret_cast<const sockaddr*>(&relayed), sizeof(relayed));
+    EXPECT_FALSE(recvPacket(client.fd()).empty());
+    ::close(same_ip);
+    ::close(peer);
+    ::close(stranger);
+}
+
+TEST(RelayServerTest, ChannelData) {
+    auto server = RelayServer::create(testParams());
+    ASSERT_NE(server, nullptr);
+    TurnClient client{server->port()};
+    ASSERT_EQ(client.allocate(), 0);
+    int peer = udpSocket(1000);
+    const sockaddr_in peer_addr = localAddress(peer);
+    const sockaddr_in& relayed = client.relayed();
+    constexpr uint16_t kChannel = 0x4001;
+    EXPECT_EQ(client.channelBind(0x3FFF, peer_addr), 400);
+    ASSERT_EQ(client.channelBind(kChannel, peer_addr), 0);
+    // 同一个对端不能再绑别的通道号
+    EXPECT_EQ(client.channelBind(kChannel + 1, peer_addr), 400);
+
+    constexpr int kPackets = 200;
+    for (int i = 0; i < kPackets; i++) {
+        auto packet = pattern(1200, static_cast<uint8_t>(i));
+        if (i % 2 == 0) {
+            client.sendChannelData(kChannel, packet);
+            ASSERT_EQ(recvPacket(peer), packet);
+        }
+        else {
+            ::sendto(peer, packet.data(), packet.size(), 0,
+                     reinterpret_cast<const sockaddr*>(&relayed), sizeof(relayed));
+            auto received = recvPacket(client.fd());
+            ASSERT_EQ(received.size(), packet.size() + 4);
+            EXPECT_EQ((received[0] << 8) | received[1], kChannel);
+            EXPECT_EQ((received[2] << 8) | received[3], 1200);
+            EXPECT_TRUE(std::equal(packet.begin(), packet.end(), received.begin() + 4));
+        }
+    }
+    auto stats = server->sessionStats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].relay_port, ntohs(relayed.sin_port));
+    EXPECT_EQ(stats[0].packets[0], kPackets / 2u);
+    EXPECT_EQ(stats[0].packets[1], kPackets / 2u);
+    EXPECT_EQ(stats[0].bytes[0], kPackets / 2u * 1200);
+    ::close(peer);
+}
+
+TEST(RelayServerTest, RefreshZeroReleases) {
+    auto server = RelayServer::create(testParams());
+    ASSERT_NE(server, nullptr);
+    TurnClient client{server->port()};
+    ASSERT_EQ(client.allocate(), 0);
+    EXPECT_EQ(client.refresh(1200), 0);
+    EXPECT_EQ(client.refresh(0), 0);
+    EXPECT_EQ(client.createPermission(loopback(4000)), 437);
+    // socket在下一次清理时关闭
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{3};
+    while (!server->sessionStats().empty() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    }
+    EXPECT_TRUE(server->sessionStats().empty());
+}
+
+TEST(RelayServerTest, BandwidthCap) {
+    auto params = testParams();
+    params.session_bandwidth_bps = 16'000'000;
+    auto server = RelayServer::create(params);
+    ASSERT_NE(server, nullptr);
+    TurnClient client{server->port()};
+    ASSERT_EQ(client.allocate(), 0);
+    int peer = udpSocket(300);
+    ASSERT_EQ(client.channelBind(0x4000, localAddress(peer)), 0);
+
+    // 2MB/s的上限, 1秒内发3MB, 转发的量应该在2MB上下
+    constexpr size_t kPacketSize = 1000;
+    constexpr int kPackets = 3000;
+    auto packet = pattern(kPacketSize, 3);
+    size_t received = 0;
+    std::thread reader([&]() {
+        while (!recvPacket(peer).empty()) {
+            received += kPacketSize;
+        }
+    });
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kPackets; i++) {
+        client.sendChannelData(0x4000, packet);
+        if (i % 30 == 29) {
+            std::this_thread::sleep_until(start + std::chrono::milliseconds{(i + 1) / 3});
+        }
+    }
+    reader.join();
+    auto stats = server->sessionStats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_GT(stats[0].throttled, 0u);
+    EXPECT_GE(stats[0].bytes[0], 1'500'000u);
+    EXPECT_LE(stats[0].bytes[0], 2'600'000u);
+    EXPECT_LE(received, stats[0].bytes[0]);
+    printf("3MB in 1s at 16Mbps cap: %" PRIu64 " bytes relayed, %" PRIu64 " packets dropped\n",
+           stats[0].bytes[0], stats[0].throttled);
+    ::close(peer);
+}
+
+// 200个分配, 每个客户端用ChannelData不停地发给自己的对端, 持续2秒.
+// 打印每转发1Gbit数据relay消耗的CPU秒数. 收发两端也在本机, 只能当作相对值参考.
+TEST(RelayServerTest, LoadTest) {
+    constexpr int kSessions = 200;
+    constexpr auto kDuration = std::chrono::seconds{2};
+    constexpr uint16_t kChannel = 0x4000;
+    auto params = testParams();
+    params.worker_threads = 2;
+    auto server = RelayServer::create(params);
+    ASSERT_NE(server, nullptr);
+    std::vector<std::unique_ptr<TurnClient>> clients;
+    std::vector<int> peers;
+    for (int i = 0; i < kSessions; i++) {
+        auto client = std::make_unique<TurnClient>(server->port());
+        int peer = udpSocket(1000);
+        ASSERT_EQ(client->allocate(), 0);
+        ASSERT_EQ(client->channelBind(kChannel, localAddress(peer)), 0);
+        ::fcntl(client->fd(), F_SETFL, O_NONBLOCK);
+        ::fcntl(peer, F_SETFL, O_NONBLOCK);
+        clients.push_back(std::move(client));
+        peers.push_back(peer);
+    }
+    int epoll_fd = ::epoll_create1(0);
+    for (int i = 0; i < kSessions; i++) {
+        epoll_event ev{};
+        ev.events = EPOLLOUT;
+        ev.data.u64 = i;
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i]->fd(), &ev);
+        ev.events = EPOLLIN;
+        ev.data.u64 = kSessions + i;
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, peers[i], &ev);
+    }
+    std::vector<uint8_t> packet(1200 + 4, 0x5A);
+    packet[0] = kChannel >> 8;
+    packet[1] = kChannel & 0xFF;
+    packet[2] = 1200 >> 8;
+    packet[3] = 1200 & 0xFF;
+    const auto relay = loopback(server->port());
+    std::vector<uint8_t> buffer(2048);
+    uint64_t received = 0;
+    const double cpu_before = server->cpuSeconds();
+    const auto start = std::chrono::steady_clock::now();
+    epoll_event events[256];
+    while (std::chrono::steady_clock::now() - start < kDuration) {
+        int count = ::epoll_wait(epoll_fd, events, 256, 100);
+        for (int i = 0; i < count; i++) {
+            const uint64_t index = events[i].data.u64;
+            if (index < kSessions) {
+                (void)::sendto(clients[index]->fd(), packet.data(), packet.size(), 0,
+                               reinterpret_cast<const sockaddr*>(&relay), sizeof(relay));
+                continue;
+            }
+            ssize_t n;
+            while ((n = ::recv(peers[index - kSessions], buffer.data(), buffer.size(), 0)) > 0) {
+                received += n;
+            }
+        }
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // cpuSeconds()是各线程最后一次循环时采样的, 等它们都至少醒来一次
+    std::this_thread::sleep_for(std::chrono::milliseconds{1100});
+    const double cpu = server->cpuSeconds() - cpu_before;
+    const double gbits = received * 8 / 1e9;
+    printf("%d allocations: %.2f Gbps, relay cpu %.2fs in %.2fs, %.3f cpu seconds per Gbit\n",
+           kSessions, gbits / seconds, cpu, seconds, cpu / gbits);
+    EXPECT_GT(received, 0u);
+    EXPECT_EQ(server->sessionStats().size(), static_cast<size_t>(kSessions));
+    for (int peer : peers) {
+        ::close(peer);
+    }
+    ::close(epoll_fd);
+}
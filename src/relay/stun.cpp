@@ -0,0 +1,288 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stun.h"
+
+#include <cstring>
+
+#include <mbedtls/md.h>
+
+namespace {
+
+uint16_t readUint16(const uint8_t* data) {
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+uint32_t readUint32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+void writeUint16(uint8_t* data, uint16_t value) {
+    data[0] = static_cast<uint8_t>(value >> 8);
+    data[1] = static_cast<uint8_t>(value);
+}
+
+void writeUint32(uint8_t* data, uint32_t value) {
+    writeUint16(data, static_cast<uint16_t>(value >> 16));
+    writeUint16(data + 2, static_cast<uint16_t>(value));
+}
+
+uint32_t padded(uint32_t size) {
+    return (size + 3) & ~3u;
+}
+
+bool hmacSha1(const lt::relay::stun::Key& key, const uint8_t* data, size_t size,
+              uint8_t out[lt::relay::stun::kIntegritySize]) {
+    const mbedtls_md_info_t* info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
+    return info != nullptr && mbedtls_md_hmac(info, key.data(), key.size(), data, size, out) == 0;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace relay {
+
+namespace stun {
+
+Key longTermKey(const std::string& username, const std::string& realm,
+                const std::string& password) {
+    Key key{};
+    const std::string input = username + ":" + realm + ":" + password;
+    const mbedtls_md_info_t* info = mbedtls_md_info_from_type(MBEDTLS_MD_MD5);
+    if (info != nullptr) {
+        mbedtls_md(info, reinterpret_cast<const unsigned char*>(input.data()), input.size(),
+                   key.data());
+    }
+    return key;
+}
+
+const Message::Attr* Message::find(uint16_t type) const {
+    for (uint32_t i = 0; i < attr_count; i++) {
+        if (attrs[i].type == type) {
+            return &attrs[i];
+        }
+    }
+    return nullptr;
+}
+
+std::string Message::getString(uint16_t type) const {
+    const Attr* attr = find(type);
+    if (attr == nullptr) {
+        return "";
+    }
+    return std::string(reinterpret_cast<const char*>(attr->value), attr->size);
+}
+
+bool Message::getUint32(uint16_t type, uint32_t& value) const {
+    const Attr* attr = find(type);
+    if (attr == nullptr || attr->size != 4) {
+        return false;
+    }
+    value = readUint32(attr->value);
+    return true;
+}
+
+bool parse(const uint8_t* data, size_t size, Message& msg) {
+    if (size < kHeaderSize || (data[0] & 0xC0) != 0) {
+        return false;
+    }
+    const uint16_t type = readUint16(data);
+    const uint16_t length = readUint16(data + 2);
+    if (length % 4 != 0 || kHeaderSize + length != size ||
+        readUint32(data + 4) != kMagicCookie) {
+        return false;
+    }
+    msg.method = (type & 0x000F) | ((type & 0x00E0) >> 1) | ((type & 0x3E00) >> 2);
+    msg.cls = type & 0x0110;
+    memcpy(msg.transaction_id.data(), data + 8, kTransactionIdSize);
+    msg.attr_count = 0;
+    uint32_t offset = kHeaderSize;
+    while (offset < size) {
+        if (offset + 4 > size || msg.attr_count == kMaxAttributes) {
+            return false;
+        }
+        Message::Attr& attr = msg.attrs[msg.attr_count++];
+        attr.type = readUint16(data + offset);
+        attr.size = readUint16(data + offset + 2);
+        attr.offset = offset;
+        attr.value = data + offset + 4;
+        offset += 4 + padded(attr.size);
+        if (offset > size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool getXorAddress(const Message::Attr& attr, sockaddr_in& addr) {
+    // 0 reserved | 1 family | 2 port | 4 address
+    if (attr.size != 8 || attr.value[1] != 0x01) {
+        return false;
+    }
+    addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(readUint16(attr.value + 2) ^ (kMagicCookie >> 16));
+    addr.sin_addr.s_addr = htonl(readUint32(attr.value + 4) ^ kMagicCookie);
+    return true;
+}
+
+bool checkIntegrity(const uint8_t* data, const Message& msg, const Key& key) {
+    for (uint32_t i = 0; i < msg.attr_count; i++) {
+        if (msg.attrs[i].type != kMessageIntegrity) {
+            continue;
+        }
+        const Message::Attr& attr = msg.attrs[i];
+        if (attr.size != kIntegritySize ||
+            (i + 1 < msg.attr_count && msg.attrs[i + 1].type != kFingerprint)) {
+            return false;
+        }
+        // 计算时头部的长度字段要算到MESSAGE-INTEGRITY为止
+        std::vector<uint8_t> input(data, data + attr.offset);
+        writeUint16(input.data() + 2, static_cast<uint16_t>(attr.offset - kHeaderSize + 24));
+        uint8_t expected[kIntegritySize];
+        if (!hmacSha1(key, input.data(), input.size(), expected)) {
+            return false;
+        }
+        // 常数时间比较, 不能因为提前退出泄露匹配了多少字节
+        uint8_t diff = 0;
+        for (uint32_t j = 0; j < kIntegritySize; j++) {
+            diff |= expected[j] ^ attr.value[j];
+        }
+        return diff == 0;
+    }
+    return false;
+}
+
+uint32_t crc32(const uint8_t* data, size_t size) {
+    static const auto table = []() {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+void writeDataIndicationHeader(uint8_t* out, const TransactionId& transaction_id,
+                               const sockaddr_in& peer, uint16_t data_size) {
+    // Data indication: method 0x007, class indication
+    writeUint16(out, 0x0017);
+    writeUint16(out + 2, static_cast<uint16_t>(12 + 4 + padded(data_size)));
+    writeUint32(out + 4, kMagicCookie);
+    memcpy(out + 8, transaction_id.data(), kTransactionIdSize);
+    writeUint16(out + 20, kXorPeerAddress);
+    writeUint16(out + 22, 8);
+    out[24] = 0;
+    out[25] = 0x01;
+    writeUint16(out + 26, ntohs(peer.sin_port) ^ (kMagicCookie >> 16));
+    writeUint32(out + 28, ntohl(peer.sin_addr.s_addr) ^ kMagicCookie);
+    writeUint16(out + 32, kDataAttr);
+    writeUint16(out + 34, data_size);
+}
+
+Writer::Writer(uint16_t method, uint16_t cls, const TransactionId& transaction_id)
+    : buffer_(kHeaderSize) {
+    const uint16_t type =
+        (method & 0x000F) | ((method & 0x0070) << 1) | ((method & 0x0F80) << 2) | cls;
+    writeUint16(buffer_.data(), type);
+    writeUint32(buffer_.data() + 4, kMagicCookie);
+    memcpy(buffer_.data() + 8, transaction_id.data(), kTransactionIdSize);
+}
+
+void Writer::add(uint16_t type, const void* value, uint16_t size) {
+    const size_t offset = buffer_.size();
+    buffer_.resize(offset + 4 + padded(size), 0);
+    writeUint16(buffer_.data() + offset, type);
+    writeUint16(buffer_.data() + offset + 2, size);
+    if (size != 0) {
+        memcpy(buffer_.data() + offset + 4, value, size);
+    }
+    setLength(buffer_.size() - kHeaderSize);
+}
+
+void Writer::addString(uint16_t type, const std::string& value) {
+    add(type, value.data(), static_cast<uint16_t>(value.size()));
+}
+
+void Writer::addUint32(uint16_t type, uint32_t value) {
+    uint8_t bytes[4];
+    writeUint32(bytes, value);
+    add(type, bytes, sizeof(bytes));
+}
+
+void Writer::addXorAddress(uint16_t type, const sockaddr_in& addr) {
+    uint8_t bytes[8] = {0, 0x01};
+    writeUint16(bytes + 2, ntohs(addr.sin_port) ^ (kMagicCookie >> 16));
+    writeUint32(bytes + 4, ntohl(addr.sin_addr.s_addr) ^ kMagicCookie);
+    add(type, bytes, sizeof(bytes));
+}
+
+void Writer::addError(uint16_t code, const std::string& reason) {
+    std::vector<uint8_t> bytes(4 + reason.size(), 0);
+    bytes[2] = static_cast<uint8_t>(code / 100);
+    bytes[3] = static_cast<uint8_t>(code % 100);
+    memcpy(bytes.data() + 4, reason.data(), reason.size());
+    add(kErrorCode, bytes.data(), static_cast<uint16_t>(bytes.size()));
+}
+
+void Writer::addIntegrity(const Key& key) {
+    // 先把长度改成包含MESSAGE-INTEGRITY, 再对前面所有内容算HMAC
+    setLength(buffer_.size() - kHeaderSize + 4 + kIntegritySize);
+    uint8_t hmac[kIntegritySize]{};
+    hmacSha1(key, buffer_.data(), buffer_.size(), hmac);
+    add(kMessageIntegrity, hmac, kIntegritySize);
+}
+
+void Writer::addFingerprint() {
+    setLength(buffer_.size() - kHeaderSize + 8);
+    const uint32_t crc = crc32(buffer_.data(), buffer_.size()) ^ 0x5354554E;
+    addUint32(kFingerprint, crc);
+}
+
+void Writer::setLength(size_t body_size) {
+    writeUint16(buffer_.data() + 2, static_cast<uint16_t>(body_size));
+}
+
+} // namespace stun
+
+} // namespace relay
+
+} // namespace lt
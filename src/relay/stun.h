@@ -0,0 +1,163 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <netinet/in.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lt {
+
+namespace relay {
+
+namespace stun {
+
+// STUN(RFC 5389)和TURN(RFC 5766)用到的那一部分编解码, 只支持IPv4
+constexpr uint32_t kMagicCookie = 0x2112A442;
+constexpr uint32_t kHeaderSize = 20;
+constexpr uint32_t kTransactionIdSize = 12;
+constexpr uint32_t kKeySize = 16;
+constexpr uint32_t kIntegritySize = 20;
+constexpr uint32_t kMaxAttributes = 16;
+
+enum Method : uint16_t {
+    kBinding = 0x001,
+    kAllocate = 0x003,
+    kRefresh = 0x004,
+    kSend = 0x006,
+    kData = 0x007,
+    kCreatePermission = 0x008,
+    kChannelBind = 0x009,
+};
+
+enum Class : uint16_t {
+    kRequest = 0x0000,
+    kIndication = 0x0010,
+    kSuccess = 0x0100,
+    kError = 0x0110,
+};
+
+enum Attribute : uint16_t {
+    kUsername = 0x0006,
+    kMessageIntegrity = 0x0008,
+    kErrorCode = 0x0009,
+    kUnknownAttributes = 0x000A,
+    kChannelNumber = 0x000C,
+    kLifetime = 0x000D,
+    kXorPeerAddress = 0x0012,
+    kDataAttr = 0x0013,
+    kRealm = 0x0014,
+    kNonce = 0x0015,
+    kXorRelayedAddress = 0x0016,
+    kRequestedAddressFamily = 0x0017,
+    kEvenPort = 0x0018,
+    kRequestedTransport = 0x0019,
+    kDontFragment = 0x001A,
+    kXorMappedAddress = 0x0020,
+    kReservationToken = 0x0022,
+    kPriority = 0x0024,
+    kUseCandidate = 0x0025,
+    kSoftware = 0x8022,
+    kFingerprint = 0x8028,
+};
+
+using Key = std::array<uint8_t, kKeySize>;
+using TransactionId = std::array<uint8_t, kTransactionIdSize>;
+
+// 长期凭证的密钥: MD5(username:realm:password)
+Key longTermKey(const std::string& username, const std::string& realm,
+                const std::string& password);
+
+// 解析出来的消息, 属性的value直接指向原始数据, 原始数据要比它活得久
+struct Message {
+    struct Attr {
+        uint16_t type;
+        uint16_t size;
+        // 属性头(type/length)在消息里的偏移
+        uint32_t offset;
+        const uint8_t* value;
+    };
+    uint16_t method;
+    uint16_t cls;
+    TransactionId transaction_id;
+    uint32_t attr_count;
+    Attr attrs[kMaxAttributes];
+
+    const Attr* find(uint16_t type) const;
+    std::string getString(uint16_t type) const;
+    bool getUint32(uint16_t type, uint32_t& value) const;
+};
+
+// 前两个bit是01的是ChannelData, 00的才可能是STUN
+inline bool isChannelData(const uint8_t* data, size_t size) {
+    return size >= 4 && (data[0] & 0xC0) == 0x40;
+}
+
+// 属性超过kMaxAttributes个也当作非法
+bool parse(const uint8_t* data, size_t size, Message& msg);
+bool getXorAddress(const Message::Attr& attr, sockaddr_in& addr);
+// MESSAGE-INTEGRITY之后只允许跟FINGERPRINT
+bool checkIntegrity(const uint8_t* data, const Message& msg, const Key& key);
+uint32_t crc32(const uint8_t* data, size_t size);
+
+// Data indication的头: STUN头 + XOR-PEER-ADDRESS(4+8) + DATA的属性头(4), 后面接负载和填充.
+// 转发路径上用它原地写头, 不经过Writer的堆分配
+constexpr uint32_t kDataIndicationHeaderSize = kHeaderSize + 12 + 4;
+void writeDataIndicationHeader(uint8_t* out, const TransactionId& transaction_id,
+                               const sockaddr_in& peer, uint16_t data_size);
+
+class Writer {
+public:
+    Writer(uint16_t method, uint16_t cls, const TransactionId& transaction_id);
+    void add(uint16_t type, const void* value, uint16_t size);
+    void addString(uint16_t type, const std::string& value);
+    void addUint32(uint16_t type, uint32_t value);
+    void addXorAddress(uint16_t type, const sockaddr_in& addr);
+    void addError(uint16_t code, const std::string& reason);
+    // 这两个必须放在最后, 且MESSAGE-INTEGRITY在FINGERPRINT之前
+    void addIntegrity(const Key& key);
+    void addFingerprint();
+    const std::vector<uint8_t>& bytes() const { return buffer_; }
+
+private:
+    void setLength(size_t body_size);
+
+private:
+    std::vector<uint8_t> buffer_;
+};
+
+} // namespace stun
+
+} // namespace relay
+
+} // namespace lt
@@ -29,6 +29,7 @@
  */
 
 #include "service.h"
+#include <algorithm>
 #include <cassert>
 
 #include <ltlib/logging.h>
@@ -378,6 +379,26 @@ void Service::onOpenConnection(std::shared_ptr<google::protobuf::MessageLite> _m
     worker_params.min_port = min_port;
     worker_params.max_port = max_port;
     worker_params.ignored_nic = settings_->getString("ignored_nic").value_or("");
+    // 单位MB, 0表示不缓存. 4K高码率下关键帧加上依赖帧可能超过默认的8MB
+    int64_t keyframe_cache_mb = settings_->getInteger("keyframe_cache_mb").value_or(8);
+    worker_params.keyframe_cache_bytes =
+        static_cast<uint32_t>(std::clamp<int64_t>(keyframe_cache_mb, 0, 256)) * 1024 * 1024;
+    worker_params.force_keyframe_after_fast_start =
+        settings_->getBoolean("force_keyframe_after_fast_start").value_or(false);
+    // 旧版本的客户端不认识加密的信令, 打开之后只有新客户端能连上
+    worker_params.tcp_enable_aead = settings_->getBoolean("tcp_enable_aead").value_or(false);
+    // 比保活超时短, 切换Wi-Fi之类的短暂断线直接续上, 更长的断线还是走原来的关闭流程
+    int64_t resume_grace_ms = settings_->getInteger("tcp_resume_grace_ms").value_or(3000);
+    worker_params.tcp_resume_grace_ms =
+        static_cast<uint32_t>(std::clamp<int64_t>(resume_grace_ms, 0, 60'000));
+    // 关键帧按2.5倍码率匀速发出, 不一次性灌满Wi-Fi的缓冲. 设置里存的是百分比, 0表示不启用
+    int64_t pacing_percent = settings_->getInteger("tcp_pacing_percent").value_or(250);
+    worker_params.tcp_pacing_factor =
+        static_cast<float>(std::clamp<int64_t>(pacing_percent, 0, 1000)) / 100.f;
+    // 推流前先探一下带宽, 用来定初始码率. 0表示不探测
+    int64_t probe_timeout_ms = settings_->getInteger("tcp_probe_timeout_ms").value_or(1000);
+    worker_params.tcp_probe_timeout_ms =
+        static_cast<uint32_t>(std::clamp<int64_t>(probe_timeout_ms, 0, 5000));
     worker_params.ioloop = ioloop_.get();
     worker_params.post_task = std::bind(&Service::postTask, this, std::placeholders::_1);
     worker_params.post_delay_task =
@@ -30,6 +30,7 @@
 
 #include "worker_session.h"
 
+#include <cstring>
 #include <fstream>
 
 #include <ltlib/logging.h>
@@ -38,14 +39,14 @@
 #include <ltproto/app/file_chunk_ack.pb.h>
 #include <ltproto/app/pull_file.pb.h>
 #include <ltproto/client2service/time_sync.pb.h>
-#include <ltproto/client2worker/audio_data.pb.h>
 #include <ltproto/client2worker/change_streaming_params.pb.h>
 #include <ltproto/client2worker/mouse_event.pb.h>
 #include <ltproto/client2worker/request_keyframe.pb.h>
+#include <ltproto/client2worker/request_ltr_recovery.pb.h>
 #include <ltproto/client2worker/send_side_stat.pb.h>
 #include <ltproto/client2worker/start_transmission.pb.h>
 #include <ltproto/client2worker/start_transmission_ack.pb.h>
-#include <ltproto/client2worker/video_frame.pb.h>
+#include <ltproto/client2worker/video_frame_ack1.pb.h>
 #include <ltproto/common/keep_alive.pb.h>
 #include <ltproto/common/keep_alive_ack.pb.h>
 #include <ltproto/server/open_connection.pb.h>
@@ -62,6 +63,7 @@
 #include <ltproto/worker2service/start_working_ack.pb.h>
 #include <ltproto/worker2service/stop_working.pb.h>
 
+#include <ltlib/message_pool.h>
 #include <ltlib/system.h>
 #include <ltlib/times.h>
 
@@ -150,7 +152,13 @@ WorkerSession::WorkerSession(const Params& params)
     , transport_type_(params.transport_type)
     , min_port_(params.min_port)
     , max_port_(params.max_port)
-    , ignored_nic_(params.ignored_nic) {
+    , ignored_nic_(params.ignored_nic)
+    , keyframe_cache_bytes_(params.keyframe_cache_bytes)
+    , force_keyframe_after_fast_start_(params.force_keyframe_after_fast_start)
+    , tcp_enable_aead_(params.tcp_enable_aead)
+    , tcp_resume_grace_ms_(params.tcp_resume_grace_ms)
+    , tcp_pacing_factor_(params.tcp_pacing_factor)
+    , tcp_probe_timeout_ms_(params.tcp_probe_timeout_ms) {
     constexpr int kRandLength = 4;
     pipe_name_ = "Lanthing_worker_";
     for (int i = 0; i < kRandLength; ++i) {
@@ -337,6 +345,10 @@ bool WorkerSession::initTransport() {
     case ltproto::common::TransportType::TCP:
         LOG(INFO) << "Init transport using TCP";
         tp_server_ = createTcpServer();
+        // RTC有自己的时间戳和重传, 把旧帧再塞进去只会添乱, 只给TCP用
+        if (keyframe_cache_bytes_ != 0) {
+            keyframe_cache_ = std::make_unique<ltlib::KeyframeCache>(keyframe_cache_bytes_);
+        }
         break;
     case ltproto::common::TransportType::RTC:
         LOG(INFO) << "Init transport using RTC";
@@ -368,6 +380,12 @@ tp::Server* WorkerSession::createTcpServer() {
     params.on_accepted = &WorkerSession::onTpAccepted;
     params.on_data = &WorkerSession::onTpData;
     params.on_signaling_message = &WorkerSession::onTpSignalingMessage;
+    params.enable_aead = tcp_enable_aead_;
+    params.resume_grace_ms = tcp_resume_grace_ms_;
+    params.on_keyframe_request = &WorkerSession::onTpRequestKeyframe;
+    params.pacing_factor = tcp_pacing_factor_;
+    params.probe_timeout_ms = tcp_probe_timeout_ms_;
+    params.on_bandwidth_probe = &WorkerSession::onTpBandwidthProbe;
     auto server = lt::tp::ServerTCP::create(params);
     return server.release();
 }
@@ -709,11 +727,20 @@ bool WorkerSession::initPipeServer(ltlib::IOLoop* ioloop) {
     params.on_closed = std::bind(&WorkerSession::onPipeDisconnected, this, std::placeholders::_1);
     params.on_message = std::bind(&WorkerSession::onPipeMessage, this, std::placeholders::_1,
                                   std::placeholders::_2, std::placeholders::_3);
+    params.on_media = std::bind(&WorkerSession::onPipeMedia, this, std::placeholders::_1,
+                                std::placeholders::_2);
     pipe_server_ = ltlib::Server::create(params);
     if (pipe_server_ == nullptr) {
         LOG(ERR) << "Init pipe server failed";
         return false;
     }
+    // 共享内存帧环是可选的, 创建失败时worker打不开它, 帧数据还是走管道
+    ltlib::SharedFrameRing::Params ring_params{};
+    ring_params.name = kFrameRingPrefix + pipe_name_;
+    frame_ring_ = ltlib::SharedFrameRing::create(ring_params);
+    if (frame_ring_ == nullptr) {
+        LOG(WARNING) << "Create shared frame ring failed, fallback to pipe";
+    }
     return true;
 }
 
@@ -736,6 +763,19 @@ void WorkerSession::onPipeDisconnected(uint32_t fd) {
     }
     pipe_client_fd_ = std::numeric_limits<uint32_t>::max();
     LOGF(INFO, "Worker(%u) disconnected from pipe server", fd);
+    {
+        // 新的worker是新的编码器, 旧的帧接不上
+        std::lock_guard lock{video_mutex_};
+        if (keyframe_cache_ != nullptr) {
+            keyframe_cache_->invalidate();
+        }
+    }
+    if (frame_ring_ != nullptr) {
+        uint32_t reclaimed = frame_ring_->reclaimDeadProducer();
+        if (reclaimed != 0) {
+            LOG(INFO) << "Reclaimed " << reclaimed << " frame ring slots from dead worker";
+        }
+    }
 }
 
 void WorkerSession::onPipeMessage(uint32_t fd, uint32_t type,
@@ -753,15 +793,9 @@ void WorkerSession::onPipeMessage(uint32_t fd, uint32_t type,
     case ltype::kStartWorkingAck:
         onStartWorkingAck(msg);
         break;
-    case ltype::kVideoFrame:
-        onCapturedVideo(msg);
-        break;
     case ltype::kStreamingParams:
         onWorkerStreamingParams(msg);
         break;
-    case ltype::kAudioData:
-        onCapturedAudio(msg);
-        break;
     case ltype::kChangeStreamingParams:
         onChangeStreamingParams(msg);
         [[fallthrough]];
@@ -774,6 +808,14 @@ void WorkerSession::onPipeMessage(uint32_t fd, uint32_t type,
     }
 }
 
+void WorkerSession::onPipeMedia(uint32_t fd, const ltlib::MediaFrame& media) {
+    if (fd != pipe_client_fd_) {
+        LOG(FATAL) << "fd != pipe_client_fd_";
+        return;
+    }
+    onCapturedMedia(media);
+}
+
 void WorkerSession::startWorking() {
     // NOTE: 这是运行在transport的线程
     auto msg = std::make_shared<ltproto::worker2service::StartWorking>();
@@ -881,9 +923,10 @@ void WorkerSession::onTpData(void* user_data, const uint8_t* data, uint32_t size
     (void)reliable;
     auto type = reinterpret_cast<const uint32_t*>(data);
     // 来自client，发给server，的消息.
-    auto msg = ltproto::create_by_type(*type);
+    auto msg = ltlib::MessagePool::local().get(*type);
     if (msg == nullptr) {
         LOG(ERR) << "Unknown message type: " << *type;
+        return;
     }
     bool success = msg->ParseFromArray(data + 4, size - 4);
     if (!success) {
@@ -942,8 +985,129 @@ void WorkerSession::onTpSignalingMessage(void* user_data, const char* key, const
 
 void WorkerSession::onTpRequestKeyframe(void* user_data) {
     auto that = reinterpret_cast<WorkerSession*>(user_data);
+    that->onKeyframeRequest();
+}
+
+void WorkerSession::onKeyframeRequest() {
+    // NOTE: 跑在传输层的线程
+    if (fastStart() && !force_keyframe_after_fast_start_) {
+        return;
+    }
+    {
+        std::lock_guard lock{video_mutex_};
+        keyframe_requested_at_us_ = ltlib::steady_now_us();
+    }
     auto msg = std::make_shared<ltproto::client2worker::RequestKeyframe>();
-    that->sendToWorkerFromOtherThread(ltproto::id(msg), msg);
+    sendToWorkerFromOtherThread(ltproto::id(msg), msg);
+}
+
+bool WorkerSession::fastStart() {
+    {
+        std::lock_guard lock{video_mutex_};
+        if (keyframe_cache_ == nullptr || !keyframe_cache_->valid() || !client_connected_) {
+            return false;
+        }
+    }
+    // 回放放到发实时帧的IOLoop线程上做, 缓存里的帧自然排在之后的实时帧前面,
+    // 也不用拿着锁等传输层把帧发出去
+    postTask(std::bind(&WorkerSession::replayKeyframeCache, this));
+    return true;
+}
+
+void WorkerSession::replayKeyframeCache() {
+    // NOTE: 这是在IOLoop线程
+    std::vector<ltlib::KeyframeCache::Frame> frames;
+    std::vector<uint64_t> ltframe_ids;
+    {
+        std::lock_guard lock{video_mutex_};
+        if (keyframe_cache_ == nullptr || !client_connected_) {
+            return;
+        }
+        frames = keyframe_cache_->snapshot();
+        for (const auto& frame : frames) {
+            ltframe_ids.push_back(toClientFrameId(frame.header.frame_id, true));
+        }
+        if (frames.empty()) {
+            keyframe_requested_at_us_ = ltlib::steady_now_us();
+        }
+    }
+    if (frames.empty()) {
+        // 投递过来的路上缓存失效了, 只能等编码器出关键帧
+        auto msg = std::make_shared<ltproto::client2worker::RequestKeyframe>();
+        sendToWorker(ltproto::id(msg), msg);
+        return;
+    }
+    const int64_t start_us = ltlib::steady_now_us();
+    uint32_t bytes = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        sendVideoToClient(frames[i].header, ltframe_ids[i], frames[i].data.get(), frames[i].size);
+        bytes += frames[i].size;
+    }
+    LOGF(INFO, "Fast start from keyframe cache, %zu frames %u bytes, took %lldus", frames.size(),
+         bytes, ltlib::steady_now_us() - start_us);
+}
+
+uint64_t WorkerSession::toClientFrameId(uint64_t frame_id, bool replayed) {
+    // NOTE: 持有video_mutex_
+    if (replayed ||
+        (last_ltframe_id_.has_value() && frame_id + frame_id_offset_ <= *last_ltframe_id_)) {
+        // 回放的帧, 或者换了worker之后编码器从头编号: 接在已经发出去的帧后面,
+        // 之后的实时帧沿用新的差值
+        frame_id_offset_ = last_ltframe_id_.value_or(0) + 1 - frame_id;
+    }
+    const uint64_t ltframe_id = frame_id + frame_id_offset_;
+    last_ltframe_id_ = ltframe_id;
+    if (!frame_id_ranges_.empty() && frame_id_ranges_.back().offset == frame_id_offset_ &&
+        frame_id_ranges_.back().replayed == replayed) {
+        frame_id_ranges_.back().last_id = ltframe_id;
+        return ltframe_id;
+    }
+    // 每次回放只多出两段, 留的这些足够覆盖还在路上的ack
+    constexpr size_t kMaxRanges = 64;
+    frame_id_ranges_.push_back({ltframe_id, ltframe_id, frame_id_offset_, replayed});
+    if (frame_id_ranges_.size() > kMaxRanges) {
+        frame_id_ranges_.pop_front();
+    }
+    return ltframe_id;
+}
+
+std::optional<uint64_t> WorkerSession::toEncoderFrameId(uint64_t ltframe_id, bool& replayed) {
+    std::lock_guard lock{video_mutex_};
+    for (auto it = frame_id_ranges_.rbegin(); it != frame_id_ranges_.rend(); ++it) {
+        if (ltframe_id >= it->first_id && ltframe_id <= it->last_id) {
+            replayed = it->replayed;
+            return ltframe_id - it->offset;
+        }
+    }
+    return std::nullopt;
+}
+
+bool WorkerSession::translateFrameAck(const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+    auto msg = std::static_pointer_cast<ltproto::client2worker::VideoFrameAck1>(_msg);
+    bool replayed = false;
+    auto frame_id = toEncoderFrameId(static_cast<uint64_t>(msg->picture_id()), replayed);
+    if (!frame_id.has_value()) {
+        return false;
+    }
+    // 回放的帧编码器早就发过了, 它们的ack会让码率控制算出很大的时延
+    if (replayed) {
+        return false;
+    }
+    msg->set_picture_id(static_cast<int64_t>(frame_id.value()));
+    return true;
+}
+
+bool WorkerSession::translateLtrRecovery(
+    const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+    auto msg = std::static_pointer_cast<ltproto::client2worker::RequestLtrRecovery>(_msg);
+    // 回放的帧里的LTR编码器还认不认, 交给LtrController判断, 这里不管replayed
+    bool replayed = false;
+    auto frame_id = toEncoderFrameId(static_cast<uint64_t>(msg->ltr_picture_id()), replayed);
+    if (!frame_id.has_value()) {
+        return false;
+    }
+    msg->set_ltr_picture_id(static_cast<int64_t>(frame_id.value()));
+    return true;
 }
 
 void WorkerSession::onTpLossRateUpdate(void* user_data, float rate) {
@@ -959,6 +1123,19 @@ void WorkerSession::onTpEesimatedVideoBitreateUpdate(void* user_data, uint32_t b
     that->sendToWorkerFromOtherThread(ltproto::id(msg), msg);
 }
 
+void WorkerSession::onTpBandwidthProbe(void* user_data, uint32_t bps, uint32_t rtt_us) {
+    auto that = reinterpret_cast<WorkerSession*>(user_data);
+    // 探测结果是链路的上限, 留出余量给音频, 控制消息和关键帧
+    constexpr float kInitialBitrateRatio = 0.7f;
+    const auto bitrate = static_cast<uint32_t>(bps * kInitialBitrateRatio);
+    LOG(INFO) << "Probed bandwidth " << bps << "bps, rtt " << rtt_us << "us, initial bitrate "
+              << bitrate << "bps";
+    // 客户端不等探测结束就开始推流, 编码器先用默认码率, 探测结果到了再从这里改
+    auto msg = std::make_shared<ltproto::worker2service::ReconfigureVideoEncoder>();
+    msg->set_bitrate_bps(bitrate);
+    that->sendToWorkerFromOtherThread(ltproto::id(msg), msg);
+}
+
 void WorkerSession::onTpStat(void* user_data, uint32_t bwe_bps, uint32_t nack) {
     auto that = reinterpret_cast<WorkerSession*>(user_data);
     that->bwe_bps_ = bwe_bps;
@@ -970,44 +1147,98 @@ void WorkerSession::onTpStat(void* user_data, uint32_t bwe_bps, uint32_t nack) {
     that->postTask([that, msg]() { that->sendMessageToRemoteClient(ltproto::id(msg), msg, true); });
 }
 
-void WorkerSession::onCapturedVideo(std::shared_ptr<google::protobuf::MessageLite> _msg) {
+void WorkerSession::onCapturedMedia(const ltlib::MediaFrame& media) {
     // NOTE: 这是在IOLoop线程
-    if (!client_connected_) {
+    const uint8_t* data = media.payload;
+    uint32_t size = media.payload_size;
+    if (!(media.header.flags & ltlib::MediaHeader::kFlagSharedMemory)) {
+        sendCapturedMedia(media.header, data, size);
         return;
     }
-    auto encoded_frame = std::static_pointer_cast<ltproto::client2worker::VideoFrame>(_msg);
-    LOGF(DEBUG, "capture:%lld, start_enc:%lld, end_enc:%lld", encoded_frame->capture_timestamp_us(),
-         encoded_frame->start_encode_timestamp_us(), encoded_frame->end_encode_timestamp_us());
-    lt::VideoFrame video_frame{};
-    video_frame.capture_timestamp_us = encoded_frame->capture_timestamp_us();
-    video_frame.start_encode_timestamp_us = encoded_frame->start_encode_timestamp_us();
-    video_frame.end_encode_timestamp_us = encoded_frame->end_encode_timestamp_us();
-    video_frame.width = encoded_frame->width();
-    video_frame.height = encoded_frame->height();
-    video_frame.is_keyframe = encoded_frame->is_keyframe();
-    video_frame.data = reinterpret_cast<const uint8_t*>(encoded_frame->frame().data());
-    video_frame.size = static_cast<uint32_t>(encoded_frame->frame().size());
-    video_frame.ltframe_id = encoded_frame->picture_id();
-    tp_server_->sendVideo(video_frame);
-
-    calcVideoSpeed(video_frame.size);
-    // static std::ofstream out{"./service_stream", std::ios::binary};
-    // out.write(reinterpret_cast<const char*>(encoded_frame.data), encoded_frame.size);
-    // out.flush();
+    // 帧数据在共享内存里, 不管发不发都要读一次把槽还回去
+    std::optional<ltlib::SharedFrameRing::Descriptor> desc;
+    if (frame_ring_ != nullptr) {
+        desc = frame_ring_->fromBytes(data, size);
+    }
+    if (!desc.has_value()) {
+        LOG(WARNING) << "Received invalid frame ring descriptor";
+        return;
+    }
+    frame_ring_->read(desc.value(), [this, &media](const uint8_t* data, uint32_t size) {
+        sendCapturedMedia(media.header, data, size);
+    });
 }
 
-void WorkerSession::onCapturedAudio(std::shared_ptr<google::protobuf::MessageLite> _msg) {
+void WorkerSession::sendCapturedMedia(const ltlib::MediaHeader& header, const uint8_t* data,
+                                      uint32_t size) {
     if (!client_connected_) {
         return;
     }
-    if (!enable_audio_) {
+    if (header.kind == ltlib::MediaHeader::Kind::Audio) {
+        if (!enable_audio_) {
+            return;
+        }
+        lt::AudioData audio_data{};
+        audio_data.data = data;
+        audio_data.size = size;
+        tp_server_->sendAudio(audio_data);
         return;
     }
-    auto captured_audio = std::static_pointer_cast<ltproto::client2worker::AudioData>(_msg);
-    lt::AudioData audio_data{};
-    audio_data.data = reinterpret_cast<const uint8_t*>(captured_audio->data().c_str());
-    audio_data.size = static_cast<uint32_t>(captured_audio->data().size());
-    tp_server_->sendAudio(audio_data);
+    LOGF(DEBUG, "capture:%lld, start_enc:%lld, end_enc:%lld", header.capture_timestamp_us,
+         header.start_encode_timestamp_us, header.end_encode_timestamp_us);
+    bool cache_frame = false;
+    {
+        std::lock_guard lock{video_mutex_};
+        cache_frame = keyframe_cache_ != nullptr && keyframe_cache_->accepts(header, size);
+    }
+    // data指向管道的读缓冲或者共享内存的槽, 要进缓存只能拷出来; 锁外面拷, 之后缓存和回放共享这一份
+    std::shared_ptr<const uint8_t> shared;
+    if (cache_frame) {
+        auto buffer = frame_pool_.getBytes(size);
+        memcpy(buffer->data(), data, size);
+        shared = std::shared_ptr<const uint8_t>(buffer, buffer->data());
+    }
+    uint64_t ltframe_id = 0;
+    {
+        std::lock_guard lock{video_mutex_};
+        if (keyframe_cache_ != nullptr) {
+            keyframe_cache_->push(header, std::move(shared), size);
+        }
+        if ((header.flags & ltlib::MediaHeader::kFlagKeyframe) && keyframe_requested_at_us_ != 0) {
+            LOGF(INFO, "Keyframe arrived %lldms after request",
+                 (ltlib::steady_now_us() - keyframe_requested_at_us_) / 1000);
+            keyframe_requested_at_us_ = 0;
+        }
+        ltframe_id = toClientFrameId(header.frame_id, false);
+    }
+    sendVideoToClient(header, ltframe_id, data, size);
+}
+
+void WorkerSession::sendVideoToClient(const ltlib::MediaHeader& header, uint64_t ltframe_id,
+                                      const uint8_t* data, uint32_t size) {
+    lt::VideoFrame video_frame{};
+    video_frame.capture_timestamp_us = header.capture_timestamp_us;
+    video_frame.start_encode_timestamp_us = header.start_encode_timestamp_us;
+    video_frame.end_encode_timestamp_us = header.end_encode_timestamp_us;
+    video_frame.width = header.width;
+    video_frame.height = header.height;
+    video_frame.is_keyframe = header.flags & ltlib::MediaHeader::kFlagKeyframe;
+    video_frame.data = data;
+    video_frame.size = size;
+    video_frame.ltframe_id = ltframe_id;
+    if (transport_type_ == ltproto::common::TransportType::TCP) {
+        // 只有TCP会在积压时按时域层丢帧
+        auto tcp_svr = static_cast<lt::tp::ServerTCP*>(tp_server_);
+        tcp_svr->sendVideo(video_frame, header.temporal_id);
+    }
+    else {
+        tp_server_->sendVideo(video_frame);
+    }
+
+    calcVideoSpeed(video_frame.size);
+    // static std::ofstream out{"./service_stream", std::ios::binary};
+    // out.write(reinterpret_cast<const char*>(encoded_frame.data), encoded_frame.size);
+    // out.flush();
 }
 
 void WorkerSession::onTimeSync(std::shared_ptr<google::protobuf::MessageLite> _msg) {
@@ -1043,6 +1274,19 @@ void WorkerSession::dispatchDcMessage(uint32_t type,
     case ltype::kStartTransmission:
         onStartTransmission(msg);
         return;
+    case ltype::kRequestKeyframe:
+        onKeyframeRequest();
+        return;
+    case ltype::kVideoFrameAck1:
+        if (!translateFrameAck(msg)) {
+            return;
+        }
+        break;
+    case ltype::kRequestLtrRecovery:
+        if (!translateLtrRecovery(msg)) {
+            return;
+        }
+        break;
     case ltype::kTimeSync:
         onTimeSync(msg);
         return;
@@ -1259,6 +1503,12 @@ void WorkerSession::onChangeStreamingParams(std::shared_ptr<google::protobuf::Me
     auto width = static_cast<uint32_t>(msg->params().video_width());
     auto height = static_cast<uint32_t>(msg->params().video_height());
     auto mindex = static_cast<uint32_t>(msg->params().monitor_index());
+    {
+        std::lock_guard lock{video_mutex_};
+        if (keyframe_cache_ != nullptr) {
+            keyframe_cache_->invalidate();
+        }
+    }
     if (worker_process_) {
         // 改为不协商后，传回去的widht、height已经没多大用。不过将来可能会加回协商逻辑。。。
         worker_process_->changeResolution(width, height, mindex);
@@ -30,15 +30,21 @@
 
 #pragma once
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <set>
 
 #include <google/protobuf/message_lite.h>
 
+#include <ltlib/frame_pool.h>
 #include <ltlib/io/client.h>
 #include <ltlib/io/ioloop.h>
+#include <ltlib/io/media_frame.h>
 #include <ltlib/io/server.h>
+#include <ltlib/keyframe_cache.h>
+#include <ltlib/shared_frame_ring.h>
 #include <ltlib/threads.h>
 #include <ltlib/time_sync.h>
 #include <transport/transport.h>
@@ -54,6 +60,13 @@ class WorkerSession : public std::enable_shared_from_this<WorkerSession> {
         int64_t value;
         int64_t timestamp_ms;
     };
+    // 一段ltframe_id和编码器frame_id之间差值相同的帧
+    struct FrameIdRange {
+        uint64_t first_id;
+        uint64_t last_id;
+        uint64_t offset;
+        bool replayed;
+    };
 
 public:
     enum class CloseReason {
@@ -88,6 +101,16 @@ public:
         uint16_t min_port;
         uint16_t max_port;
         std::string ignored_nic;
+        // 缓存最近的关键帧和依赖帧, 接收端重连或者请求关键帧时直接从缓存起播. 0表示不启用,
+        // 目前只有TCP传输会用到
+        uint32_t keyframe_cache_bytes;
+        // 从缓存起播之后仍然让编码器出一个IDR
+        bool force_keyframe_after_fast_start;
+        // 以下只对TCP传输生效, 含义见ServerTCP::Params. 默认值要让旧版本的客户端还能连上
+        bool tcp_enable_aead;
+        uint32_t tcp_resume_grace_ms;
+        float tcp_pacing_factor;
+        uint32_t tcp_probe_timeout_ms;
     };
 
 public:
@@ -145,6 +168,7 @@ private:
     void onPipeDisconnected(uint32_t fd);
     void onPipeMessage(uint32_t fd, uint32_t type,
                        std::shared_ptr<google::protobuf::MessageLite> msg);
+    void onPipeMedia(uint32_t fd, const ltlib::MediaFrame& media);
     void startWorking();
     void onStartWorkingAck(std::shared_ptr<google::protobuf::MessageLite> msg);
     void sendToWorker(uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg);
@@ -163,9 +187,17 @@ private:
     static void onTpDisconnected(void* user_data);
     static void onTpSignalingMessage(void* user_data, const char* key, const char* value);
     static void onTpRequestKeyframe(void* user_data);
+    void onKeyframeRequest();
+    bool fastStart();
+    void replayKeyframeCache();
+    uint64_t toClientFrameId(uint64_t frame_id, bool replayed);
+    std::optional<uint64_t> toEncoderFrameId(uint64_t ltframe_id, bool& replayed);
+    bool translateFrameAck(const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    bool translateLtrRecovery(const std::shared_ptr<google::protobuf::MessageLite>& msg);
     static void onTpLossRateUpdate(void* user_data, float rate);
     static void onTpEesimatedVideoBitreateUpdate(void* user_data, uint32_t bps);
     static void onTpStat(void* user_data, uint32_t bwe_bps, uint32_t nack);
+    static void onTpBandwidthProbe(void* user_data, uint32_t bps, uint32_t rtt_us);
 
     // 数据通道
     void dispatchDcMessage(uint32_t type,
@@ -176,8 +208,10 @@ private:
     void onRemotePullFile(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onRemoteFileChunk(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onRemoteFileChunkAck(std::shared_ptr<google::protobuf::MessageLite> msg);
-    void onCapturedVideo(std::shared_ptr<google::protobuf::MessageLite> msg);
-    void onCapturedAudio(std::shared_ptr<google::protobuf::MessageLite> msg);
+    void onCapturedMedia(const ltlib::MediaFrame& media);
+    void sendCapturedMedia(const ltlib::MediaHeader& header, const uint8_t* data, uint32_t size);
+    void sendVideoToClient(const ltlib::MediaHeader& header, uint64_t ltframe_id,
+                           const uint8_t* data, uint32_t size);
     void onTimeSync(std::shared_ptr<google::protobuf::MessageLite> msg);
     bool sendMessageToRemoteClient(uint32_t type,
                                    const std::shared_ptr<google::protobuf::MessageLite>& msg,
@@ -208,6 +242,7 @@ private:
     std::unique_ptr<ltlib::BlockingThread> thread_;
     lt::tp::Server* tp_server_ = nullptr;
     std::unique_ptr<ltlib::Server> pipe_server_;
+    std::unique_ptr<ltlib::SharedFrameRing> frame_ring_;
     uint32_t pipe_client_fd_ = std::numeric_limits<uint32_t>::max();
     std::string pipe_name_;
     std::set<uint32_t> worker_registered_msg_;
@@ -245,6 +280,23 @@ private:
     std::string ignored_nic_;
     bool first_start_working_ack_received_ = false;
     std::vector<lt::VideoCodecType> client_video_codecs_;
+    // 保护关键帧缓存和帧号映射. 回放和实时帧都在IOLoop线程发送, 顺序由线程保证, 发送时不持锁
+    std::mutex video_mutex_;
+    std::unique_ptr<ltlib::KeyframeCache> keyframe_cache_;
+    // 缓存要保留的帧从这里拷出来, 和缓存共享. 只在IOLoop线程使用
+    ltlib::FramePool frame_pool_;
+    // 从缓存回放的帧重新编号, 接在已经发出去的帧后面, 客户端看到的ltframe_id始终递增.
+    // 客户端的ack要按这里的记录换回编码器的frame_id
+    uint64_t frame_id_offset_ = 0;
+    std::optional<uint64_t> last_ltframe_id_;
+    std::deque<FrameIdRange> frame_id_ranges_;
+    const uint32_t keyframe_cache_bytes_;
+    const bool force_keyframe_after_fast_start_;
+    const bool tcp_enable_aead_;
+    const uint32_t tcp_resume_grace_ms_;
+    const float tcp_pacing_factor_;
+    const uint32_t tcp_probe_timeout_ms_;
+    int64_t keyframe_requested_at_us_ = 0;
 
     std::atomic<bool> enable_gamepad_;
     std::atomic<bool> enable_keyboard_;
@@ -170,6 +170,7 @@ enum class LinkType {
     IPv6UDP,
     RelayUDP,
     TCP = 11,
+    SharedMemory = 21,
 };
 
 constexpr const char* toString(LinkType type) {
@@ -186,6 +187,8 @@ constexpr const char* toString(LinkType type) {
         return "RelayUDP";
     case LinkType::TCP:
         return "TCP";
+    case LinkType::SharedMemory:
+        return "SharedMemory";
     default:
         return "?";
     }
@@ -222,6 +225,9 @@ typedef void (*OnKeyframeRequest)(void*);
 typedef void (*OnVEncoderBitrateUpdate)(void*, uint32_t bps);
 typedef void (*OnLossRateUpdate)(void*, float);
 typedef void (*OnTransportStat)(void*, uint32_t /*bwe_bps*/, uint32_t /*nack*/);
+typedef void (*OnBandwidthProbe)(void*, uint32_t /*bps*/, uint32_t /*rtt_us*/);
+typedef void (*OnDelayFeedback)(void*, uint32_t /*recv_bps*/, uint32_t /*queue_delay_us*/,
+                                uint32_t /*jitter_us*/, bool /*overusing*/);
 
 class TP_API Client {
 public:
@@ -31,12 +31,16 @@
 #pragma once
 #include <transport/transport.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include <google/protobuf/message_lite.h>
 
+#include <ltlib/frame_pool.h>
 #include <ltlib/io/client.h>
 #include <ltlib/io/server.h>
 #include <ltlib/threads.h>
@@ -52,6 +56,12 @@ namespace lt {
 
 namespace tp { // transport
 
+class Pacer;
+class LayerDropper;
+class ProbeSender;
+class ProbeReceiver;
+class ArrivalTracker;
+
 class ClientTCP : public Client {
 public:
     struct Params {
@@ -84,9 +94,18 @@ private:
     void onDisconnected();
     void onReconnecting();
     void onMessage(uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg);
+    void onMedia(const ltlib::MediaFrame& media);
+    void onProbe(const ltlib::MediaFrame& media);
+    void onProbeDone(uint32_t bps, uint32_t rtt_us);
+    void onVideoPacket(const ltlib::MediaFrame& media);
+    bool reassembleFragment(const ltlib::MediaFrame& media);
     void netLoop(const std::function<void()>& i_am_alive);
     void onSignalingMessage2(const std::string& key, const std::string& value);
     void handleSigAddress(const std::string& value);
+    void handleSigAead(const std::string& value);
+    void handleSigResume(const std::string& value);
+    void onResumeTimeout(uint64_t generation);
+    void onResumeAck();
     void invokeInternal(const std::function<void()>& task);
     template <typename ReturnT, typename = std::enable_if<!std::is_void<ReturnT>::value>::type>
     ReturnT invoke(std::function<ReturnT(void)> func) {
@@ -107,6 +126,19 @@ private:
     std::unique_ptr<ltlib::Client> tcp_client_;
     std::unique_ptr<ltlib::TaskThread> task_thread_;
     std::unique_ptr<ltlib::BlockingThread> net_thread_;
+    std::shared_ptr<ltlib::PayloadCipher> cipher_;
+    // 以下只在task_thread_里访问
+    std::string resume_token_;
+    uint32_t resume_grace_ms_ = 0;
+    bool connected_once_ = false;
+    bool reconnecting_ = false;
+    uint64_t reconnect_generation_ = 0;
+    int64_t reconnecting_at_us_ = 0;
+    std::vector<uint8_t> fragments_;
+    uint64_t fragment_frame_id_ = 0;
+    // 只在网络线程访问
+    std::unique_ptr<ProbeReceiver> probe_receiver_;
+    std::unique_ptr<ArrivalTracker> arrival_tracker_;
 };
 
 class ServerTCP : public Server {
@@ -118,6 +150,22 @@ public:
         OnFailed on_failed;
         OnDisconnected on_disconnected;
         OnSignalingMessage on_signaling_message;
+        // 对每个包做AEAD加密, 密钥通过信令发给对端
+        bool enable_aead = false;
+        // 连接断开后会话保留的时长. 期间客户端带着resume token重连上来, 直接续上而不回调
+        // on_disconnected/on_accepted. 0表示不启用
+        uint32_t resume_grace_ms = 0;
+        // 可选, 续上之后请求关键帧
+        OnKeyframeRequest on_keyframe_request = nullptr;
+        // 视频帧切成小块, 按估算码率的pacing_factor倍匀速发出, 音频和控制消息不受影响.
+        // 0表示不启用, 整帧直接写进socket
+        float pacing_factor = 0.f;
+        // 首次连上后先花最多probe_timeout_ms探测带宽和RTT, 结果通过on_bandwidth_probe回调.
+        // 客户端连上就回调on_connected, 不等探测结束. 0表示不探测
+        uint32_t probe_timeout_ms = 0;
+        OnBandwidthProbe on_bandwidth_probe = nullptr;
+        // 可选, 客户端每100ms左右发回一次接收端的时延统计
+        OnDelayFeedback on_delay_feedback = nullptr;
         bool validate() const;
     };
 
@@ -128,20 +176,37 @@ public:
     bool sendData(const uint8_t* data, uint32_t size, bool is_reliable) override;
     bool sendAudio(const AudioData& audio_data) override;
     bool sendVideo(const VideoFrame& frame) override;
+    // VideoFrame要和rtc库的保持同一个布局, 时域分层的层号只能单独传进来. 积压时先丢层号大的帧,
+    // 接收端从码流里的前缀NAL自己知道层号
+    bool sendVideo(const VideoFrame& frame, uint8_t temporal_id);
     void onSignalingMessage(const char* key, const char* value) override;
 
 private:
     ServerTCP(const Params& params);
     bool init();
     bool initTcpServer();
+    bool initPacer();
+    bool sendLegacyVideo(const VideoFrame& frame);
+    std::shared_ptr<uint8_t> copyPayload(const uint8_t* data, uint32_t size);
+    void updatePacingRate(uint32_t frame_size);
+    void clearPacer();
+    void startProbe();
+    void sendProbeCluster();
+    void finishProbe(uint64_t generation);
+    void abortProbe();
     bool isNetworkThread();
     bool isTaskThread();
     void onAccepted(uint32_t fd);
+    void onResumed(uint32_t fd);
     void onDisconnected(uint32_t fd);
+    void onResumeTimeout(uint64_t generation);
+    bool onPreamble(uint32_t fd, const std::string& preamble);
     void onMessage(uint32_t fd, uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg);
+    void onMedia(uint32_t fd, const ltlib::MediaFrame& media);
+    void onDelayFeedback(const ltlib::MediaFrame& media);
     void netLoop(const std::function<void()>& i_am_alive);
     void onSignalingMessage2(const std::string& key, const std::string& value);
-    void handleSigConnect();
+    void handleSigConnect(const std::string& capabilities);
     bool gatherIP();
     void invokeInternal(const std::function<void()>& task);
     template <typename ReturnT, typename = std::enable_if<!std::is_void<ReturnT>::value>::type>
@@ -163,7 +228,34 @@ private:
     std::unique_ptr<ltlib::Server> tcp_server_;
     std::unique_ptr<ltlib::TaskThread> task_thread_;
     std::unique_ptr<ltlib::BlockingThread> net_thread_;
-    uint32_t client_fd_ = std::numeric_limits<uint32_t>::max();
+    // 在任务线程里切换, 网络线程发送时读
+    std::atomic<uint32_t> client_fd_{std::numeric_limits<uint32_t>::max()};
+    std::shared_ptr<ltlib::PayloadCipher> cipher_;
+    std::string aead_signaling_;
+    // 初始化后不再修改
+    std::string resume_token_;
+    std::atomic<bool> closed_{false};
+    // 客户端没带resume token, 断开后不再等它续上
+    std::atomic<bool> resumable_{true};
+    // 客户端认识媒体帧(见ltlib/io/media_frame.h), 否则音视频走protobuf. 收到connect信令时设置
+    std::atomic<bool> peer_media_frame_{false};
+    // 以下只在task_thread_里访问
+    bool accepted_once_ = false;
+    bool resuming_ = false;
+    bool session_expired_ = false;
+    uint64_t disconnect_generation_ = 0;
+    int64_t disconnected_at_us_ = 0;
+    // 以下只在网络线程访问
+    ltlib::FramePool frame_pool_;
+    std::unique_ptr<Pacer> pacer_;
+    std::unique_ptr<LayerDropper> layer_dropper_;
+    int64_t rate_window_start_us_ = 0;
+    uint64_t rate_window_bytes_ = 0;
+    std::unique_ptr<ProbeSender> prober_;
+    std::unique_ptr<Pacer> probe_pacer_;
+    uint64_t probe_generation_ = 0;
+    bool delay_overusing_ = false;
+    bool session_started_ = false;
 };
 
 } // namespace tp
@@ -0,0 +1,268 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "aead_cipher.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+
+#include <ltlib/logging.h>
+
+namespace {
+
+constexpr uint32_t kDirectionServerToClient = 0x53324331; // "S2C1"
+constexpr uint32_t kDirectionClientToServer = 0x43325331; // "C2S1"
+constexpr uint32_t kCounterSize = 8;
+constexpr size_t kNonceSize = 12;
+const char* kAlgAES256GCM = "aes-256-gcm";
+const char* kAlgChaCha20Poly1305 = "chacha20-poly1305";
+
+bool hasAesNiAndPclmul() {
+    uint32_t ecx = 0;
+#if defined(_M_X64) || defined(_M_IX86)
+    int info[4] = {0};
+    __cpuid(info, 1);
+    ecx = static_cast<uint32_t>(info[2]);
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, _ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &_ecx, &edx)) {
+        return false;
+    }
+    ecx = _ecx;
+#endif
+    constexpr uint32_t kPCLMULQDQ = 1 << 1;
+    constexpr uint32_t kAESNI = 1 << 25;
+    return (ecx & kPCLMULQDQ) && (ecx & kAESNI);
+}
+
+void writeU64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+uint64_t readU64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (i * 8);
+    }
+    return value;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace tp {
+
+AeadCipher::Algorithm AeadCipher::preferredAlgorithm() {
+    return hasAesNiAndPclmul() ? Algorithm::AES_256_GCM : Algorithm::ChaCha20_Poly1305;
+}
+
+bool AeadCipher::generateKey(Key& key) {
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    const char* pers = "lt_aead_key";
+    int ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                                    reinterpret_cast<const unsigned char*>(pers), strlen(pers));
+    if (ret == 0) {
+        ret = mbedtls_ctr_drbg_random(&ctr_drbg, key.data(), key.size());
+    }
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    if (ret != 0) {
+        LOG(ERR) << "Generate AEAD key failed: " << ret;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<AeadCipher> AeadCipher::create(Algorithm algorithm, const Key& key,
+                                               bool is_server) {
+    std::unique_ptr<AeadCipher> cipher{new AeadCipher{algorithm, is_server}};
+    if (!cipher->init(key)) {
+        return nullptr;
+    }
+    return cipher;
+}
+
+std::string AeadCipher::toSignaling(Algorithm algorithm, const Key& key) {
+    static const char* kHex = "0123456789abcdef";
+    std::string value =
+        algorithm == Algorithm::AES_256_GCM ? kAlgAES256GCM : kAlgChaCha20Poly1305;
+    value.push_back(':');
+    for (uint8_t byte : key) {
+        value.push_back(kHex[byte >> 4]);
+        value.push_back(kHex[byte & 0x0f]);
+    }
+    return value;
+}
+
+std::unique_ptr<AeadCipher> AeadCipher::fromSignaling(const std::string& value, bool is_server) {
+    const auto pos = value.find(':');
+    if (pos == std::string::npos || value.size() - pos - 1 != kKeySize * 2) {
+        LOG(ERR) << "Invalid AEAD signaling value";
+        return nullptr;
+    }
+    Algorithm algorithm;
+    std::string alg = value.substr(0, pos);
+    if (alg == kAlgAES256GCM) {
+        algorithm = Algorithm::AES_256_GCM;
+    }
+    else if (alg == kAlgChaCha20Poly1305) {
+        algorithm = Algorithm::ChaCha20_Poly1305;
+    }
+    else {
+        LOG(ERR) << "Unknown AEAD algorithm " << alg;
+        return nullptr;
+    }
+    auto from_hex = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    };
+    Key key;
+    for (size_t i = 0; i < kKeySize; i++) {
+        int hi = from_hex(value[pos + 1 + i * 2]);
+        int lo = from_hex(value[pos + 2 + i * 2]);
+        if (hi < 0 || lo < 0) {
+            LOG(ERR) << "Invalid AEAD key";
+            return nullptr;
+        }
+        key[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return create(algorithm, key, is_server);
+}
+
+AeadCipher::AeadCipher(Algorithm algorithm, bool is_server)
+    : algorithm_{algorithm}
+    , send_direction_{is_server ? kDirectionServerToClient : kDirectionClientToServer}
+    , recv_direction_{is_server ? kDirectionClientToServer : kDirectionServerToClient} {
+    mbedtls_gcm_init(&gcm_);
+    mbedtls_chachapoly_init(&chachapoly_);
+}
+
+AeadCipher::~AeadCipher() {
+    mbedtls_gcm_free(&gcm_);
+    mbedtls_chachapoly_free(&chachapoly_);
+}
+
+bool AeadCipher::init(const Key& key) {
+    int ret = 0;
+    if (algorithm_ == Algorithm::AES_256_GCM) {
+        ret = mbedtls_gcm_setkey(&gcm_, MBEDTLS_CIPHER_ID_AES, key.data(), kKeySize * 8);
+    }
+    else {
+        ret = mbedtls_chachapoly_setkey(&chachapoly_, key.data());
+    }
+    if (ret != 0) {
+        LOG(ERR) << "Set AEAD key failed: " << ret;
+        return false;
+    }
+    return true;
+}
+
+uint32_t AeadCipher::overhead() const {
+    return kCounterSize + kTagSize;
+}
+
+bool AeadCipher::seal(uint8_t* payload, uint32_t size, uint8_t* trailer) {
+    const uint64_t counter = ++send_counter_;
+    uint8_t nonce[kNonceSize];
+    makeNonce(send_direction_, counter, nonce);
+    writeU64(trailer, counter);
+    uint8_t* tag = trailer + kCounterSize;
+    int ret = 0;
+    if (algorithm_ == Algorithm::AES_256_GCM) {
+        ret = mbedtls_gcm_crypt_and_tag(&gcm_, MBEDTLS_GCM_ENCRYPT, size, nonce, kNonceSize,
+                                        nullptr, 0, payload, payload, kTagSize, tag);
+    }
+    else {
+        ret = mbedtls_chachapoly_encrypt_and_tag(&chachapoly_, size, nonce, nullptr, 0, payload,
+                                                 payload, tag);
+    }
+    return ret == 0;
+}
+
+bool AeadCipher::open(uint8_t* payload, uint32_t size) {
+    if (size < overhead()) {
+        return false;
+    }
+    const uint32_t body_size = size - overhead();
+    const uint8_t* trailer = payload + body_size;
+    const uint64_t counter = readU64(trailer);
+    if (counter <= recv_counter_) {
+        // 重放或者乱序
+        return false;
+    }
+    uint8_t nonce[kNonceSize];
+    makeNonce(recv_direction_, counter, nonce);
+    const uint8_t* tag = trailer + kCounterSize;
+    int ret = 0;
+    if (algorithm_ == Algorithm::AES_256_GCM) {
+        ret = mbedtls_gcm_auth_decrypt(&gcm_, body_size, nonce, kNonceSize, nullptr, 0, tag,
+                                       kTagSize, payload, payload);
+    }
+    else {
+        ret = mbedtls_chachapoly_auth_decrypt(&chachapoly_, body_size, nonce, nullptr, 0, tag,
+                                              payload, payload);
+    }
+    if (ret != 0) {
+        return false;
+    }
+    recv_counter_ = counter;
+    return true;
+}
+
+void AeadCipher::makeNonce(uint32_t direction, uint64_t counter, uint8_t nonce[12]) const {
+    nonce[0] = static_cast<uint8_t>(direction >> 24);
+    nonce[1] = static_cast<uint8_t>(direction >> 16);
+    nonce[2] = static_cast<uint8_t>(direction >> 8);
+    nonce[3] = static_cast<uint8_t>(direction);
+    writeU64(nonce + 4, counter);
+}
+
+} // namespace tp
+
+} // namespace lt
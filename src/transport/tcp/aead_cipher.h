@@ -0,0 +1,88 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <mbedtls/chachapoly.h>
+#include <mbedtls/gcm.h>
+
+#include <ltlib/io/payload_cipher.h>
+
+namespace lt {
+
+namespace tp {
+
+// ClientTCP/ServerTCP使用的轻量AEAD, 不走TLS的record层, payload原地加解密.
+// 帧尾: [uint64_t counter | 16 bytes tag], nonce = [4 bytes 方向 | counter].
+// 两个方向共用一个密钥, 靠nonce里的方向区分; 接收方要求counter严格递增, 用来防重放.
+class AeadCipher : public ltlib::PayloadCipher {
+public:
+    enum class Algorithm { AES_256_GCM, ChaCha20_Poly1305 };
+    static constexpr size_t kKeySize = 32;
+    static constexpr uint32_t kTagSize = 16;
+    using Key = std::array<uint8_t, kKeySize>;
+
+public:
+    // 有AES-NI和PCLMUL时用AES-GCM, 否则用ChaCha20-Poly1305
+    static Algorithm preferredAlgorithm();
+    static bool generateKey(Key& key);
+    static std::unique_ptr<AeadCipher> create(Algorithm algorithm, const Key& key,
+                                              bool is_server);
+    // 通过信令交换的格式: "<algorithm>:<hex key>"
+    static std::string toSignaling(Algorithm algorithm, const Key& key);
+    static std::unique_ptr<AeadCipher> fromSignaling(const std::string& value, bool is_server);
+    ~AeadCipher() override;
+    uint32_t overhead() const override;
+    bool seal(uint8_t* payload, uint32_t size, uint8_t* trailer) override;
+    bool open(uint8_t* payload, uint32_t size) override;
+    Algorithm algorithm() const { return algorithm_; }
+
+private:
+    AeadCipher(Algorithm algorithm, bool is_server);
+    bool init(const Key& key);
+    void makeNonce(uint32_t direction, uint64_t counter, uint8_t nonce[12]) const;
+
+private:
+    const Algorithm algorithm_;
+    const uint32_t send_direction_;
+    const uint32_t recv_direction_;
+    mbedtls_gcm_context gcm_;
+    mbedtls_chachapoly_context chachapoly_;
+    uint64_t send_counter_ = 0;
+    uint64_t recv_counter_ = 0;
+};
+
+} // namespace tp
+
+} // namespace lt
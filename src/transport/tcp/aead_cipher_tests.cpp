@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "aead_cipher.h"
+
+using lt::tp::AeadCipher;
+
+class AeadCipherTest : public testing::TestWithParam<AeadCipher::Algorithm> {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(AeadCipher::generateKey(key_));
+        server_ = AeadCipher::create(GetParam(), key_, /*is_server=*/true);
+        client_ = AeadCipher::create(GetParam(), key_, /*is_server=*/false);
+        ASSERT_NE(server_, nullptr);
+        ASSERT_NE(client_, nullptr);
+    }
+
+    // 返回[密文 | 帧尾], 跟网络上收到的payload一致
+    std::vector<uint8_t> seal(AeadCipher& cipher, const std::vector<uint8_t>& plain) {
+        std::vector<uint8_t> sealed(plain.size() + cipher.overhead());
+        memcpy(sealed.data(), plain.data(), plain.size());
+        EXPECT_TRUE(cipher.seal(sealed.data(), static_cast<uint32_t>(plain.size()),
+                                sealed.data() + plain.size()));
+        return sealed;
+    }
+
+    bool open(AeadCipher& cipher, std::vector<uint8_t>& sealed) {
+        return cipher.open(sealed.data(), static_cast<uint32_t>(sealed.size()));
+    }
+
+    std::vector<uint8_t> randomBytes(size_t size) {
+        std::vector<uint8_t> bytes(size);
+        for (auto& byte : bytes) {
+            byte = static_cast<uint8_t>(rand_engine_());
+        }
+        return bytes;
+    }
+
+    AeadCipher::Key key_;
+    std::unique_ptr<AeadCipher> server_;
+    std::unique_ptr<AeadCipher> client_;
+    std::mt19937 rand_engine_{20231121};
+};
+
+TEST_P(AeadCipherTest, RoundTrip) {
+    for (size_t size : {size_t{0}, size_t{1}, size_t{4}, size_t{1500}, size_t{100 * 1024}}) {
+        auto plain = randomBytes(size);
+        auto sealed = seal(*server_, plain);
+        if (size >= 16) {
+            EXPECT_NE(memcmp(sealed.data(), plain.data(), size), 0);
+        }
+        ASSERT_TRUE(open(*client_, sealed));
+        EXPECT_EQ(memcmp(sealed.data(), plain.data(), size), 0);
+
+        sealed = seal(*client_, plain);
+        ASSERT_TRUE(open(*server_, sealed));
+        EXPECT_EQ(memcmp(sealed.data(), plain.data(), size), 0);
+    }
+}
+
+TEST_P(AeadCipherTest, Tampered) {
+    auto plain = randomBytes(256);
+    auto sealed = seal(*server_, plain);
+    // 分别篡改密文, counter, tag
+    for (size_t pos : {size_t{0}, size_t{255}, size_t{256}, sealed.size() - 1}) {
+        auto copy = sealed;
+        copy[pos] ^= 0x01;
+        EXPECT_FALSE(open(*client_, copy)) << "pos " << pos;
+    }
+    EXPECT_TRUE(open(*client_, sealed));
+}
+
+TEST_P(AeadCipherTest, ReplayRejected) {
+    auto first = seal(*server_, randomBytes(64));
+    auto second = seal(*server_, randomBytes(64));
+    auto replay = second;
+    ASSERT_TRUE(open(*client_, second));
+    EXPECT_FALSE(open(*client_, replay));
+    // 比已收到的更旧的包也不接受
+    EXPECT_FALSE(open(*client_, first));
+}
+
+TEST_P(AeadCipherTest, ReflectionRejected) {
+    // 服务端发出的包被原样弹回给服务端
+    auto sealed = seal(*server_, randomBytes(64));
+    EXPECT_FALSE(open(*server_, sealed));
+}
+
+TEST_P(AeadCipherTest, WrongKey) {
+    AeadCipher::Key other;
+    ASSERT_TRUE(AeadCipher::generateKey(other));
+    auto client = AeadCipher::create(GetParam(), other, /*is_server=*/false);
+    auto sealed = seal(*server_, randomBytes(64));
+    EXPECT_FALSE(open(*client, sealed));
+}
+
+TEST_P(AeadCipherTest, Signaling) {
+    auto value = AeadCipher::toSignaling(GetParam(), key_);
+    auto client = AeadCipher::fromSignaling(value, /*is_server=*/false);
+    ASSERT_NE(client, nullptr);
+    EXPECT_EQ(client->algorithm(), GetParam());
+    auto plain = randomBytes(64);
+    auto sealed = seal(*server_, plain);
+    ASSERT_TRUE(open(*client, sealed));
+    EXPECT_EQ(memcmp(sealed.data(), plain.data(), plain.size()), 0);
+
+    EXPECT_EQ(AeadCipher::fromSignaling("", false), nullptr);
+    EXPECT_EQ(AeadCipher::fromSignaling("aes-128-cbc:" + value.substr(value.find(':') + 1), false),
+              nullptr);
+    EXPECT_EQ(AeadCipher::fromSignaling(value.substr(0, value.size() - 2), false), nullptr);
+    value.back() = 'g';
+    EXPECT_EQ(AeadCipher::fromSignaling(value, false), nullptr);
+}
+
+// 加密100Mbps码率一秒钟的数据量, 打印占用单核的百分比
+TEST_P(AeadCipherTest, Benchmark) {
+    constexpr size_t kFrameSize = 100 * 1024;
+    constexpr size_t kBytesPerSecond = 100 * 1000 * 1000 / 8;
+    auto frame = randomBytes(kFrameSize);
+    std::vector<uint8_t> trailer(server_->overhead());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t total = 0; total < kBytesPerSecond; total += kFrameSize) {
+        ASSERT_TRUE(server_->seal(frame.data(), kFrameSize, trailer.data()));
+    }
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%s: 100Mbps costs %.2f%% of one core (%.0fMB/s)\n",
+           GetParam() == AeadCipher::Algorithm::AES_256_GCM ? "AES-256-GCM" : "ChaCha20-Poly1305",
+           seconds * 100, kBytesPerSecond / seconds / 1024 / 1024);
+}
+
+INSTANTIATE_TEST_SUITE_P(Algorithms, AeadCipherTest,
+                         testing::Values(AeadCipher::Algorithm::AES_256_GCM,
+                                         AeadCipher::Algorithm::ChaCha20_Poly1305));
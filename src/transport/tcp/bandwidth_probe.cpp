@@ -0,0 +1,175 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bandwidth_probe.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <ltlib/io/media_frame.h>
+
+namespace {
+
+template <typename T> void store(uint8_t* out, size_t offset, T value) {
+    memcpy(out + offset, &value, sizeof(T));
+}
+
+template <typename T> T load(const uint8_t* data, size_t offset) {
+    T value;
+    memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace tp {
+
+std::shared_ptr<uint8_t> encodeProbeMessage(const ProbeMessage& msg, uint32_t padding_to,
+                                            uint32_t& frame_size) {
+    constexpr uint32_t kMinFrameSize = ltlib::MediaHeader::kSize + ProbeMessage::kSize;
+    frame_size = std::max(padding_to, kMinFrameSize);
+    const uint32_t payload_size = frame_size - ltlib::MediaHeader::kSize;
+    std::shared_ptr<uint8_t> frame{new uint8_t[frame_size], std::default_delete<uint8_t[]>()};
+    ltlib::MediaHeader header{};
+    header.kind = ltlib::MediaHeader::Kind::Probe;
+    ltlib::encode_media_header(header, payload_size, frame.get());
+    uint8_t* out = frame.get() + ltlib::MediaHeader::kSize;
+    store<uint8_t>(out, 0, static_cast<uint8_t>(msg.type));
+    store<uint8_t>(out, 1, msg.cluster);
+    store<uint16_t>(out, 2, msg.seq);
+    store<uint16_t>(out, 4, msg.count);
+    store<uint16_t>(out, 6, 0);
+    store<uint32_t>(out, 8, msg.bitrate_kbps);
+    store<uint32_t>(out, 12, msg.rtt_us);
+    store<int64_t>(out, 16, msg.timestamp_us);
+    memset(out + ProbeMessage::kSize, 0, payload_size - ProbeMessage::kSize);
+    return frame;
+}
+
+std::optional<ProbeMessage> decodeProbeMessage(const uint8_t* payload, uint32_t size) {
+    if (size < ProbeMessage::kSize) {
+        return std::nullopt;
+    }
+    const uint8_t type = load<uint8_t>(payload, 0);
+    if (type < static_cast<uint8_t>(ProbeMessage::Type::Ping) ||
+        type > static_cast<uint8_t>(ProbeMessage::Type::Done)) {
+        return std::nullopt;
+    }
+    ProbeMessage msg{};
+    msg.type = static_cast<ProbeMessage::Type>(type);
+    msg.cluster = load<uint8_t>(payload, 1);
+    msg.seq = load<uint16_t>(payload, 2);
+    msg.count = load<uint16_t>(payload, 4);
+    msg.bitrate_kbps = load<uint32_t>(payload, 8);
+    msg.rtt_us = load<uint32_t>(payload, 12);
+    msg.timestamp_us = load<int64_t>(payload, 16);
+    return msg;
+}
+
+ProbeSender::ProbeSender(const Params& params)
+    : params_{params} {}
+
+std::optional<ProbeSender::Cluster> ProbeSender::nextCluster() {
+    if (pending_cluster_.has_value() || finished()) {
+        return std::nullopt;
+    }
+    Cluster cluster{};
+    cluster.id = static_cast<uint8_t>(next_index_);
+    cluster.bitrate_bps = params_.bitrates_bps[next_index_];
+    const uint64_t bytes =
+        static_cast<uint64_t>(cluster.bitrate_bps) * params_.cluster_duration_us / 8'000'000;
+    // 一组至少分成十几个包, 包太少时到达间隔的抖动占比太大
+    cluster.packet_size = static_cast<uint32_t>(std::clamp<uint64_t>(
+        bytes / 16, params_.min_packet_size, params_.max_packet_size));
+    const uint64_t count = (bytes + cluster.packet_size - 1) / cluster.packet_size;
+    cluster.packet_count = static_cast<uint16_t>(std::clamp<uint64_t>(
+        count, params_.min_packets, std::numeric_limits<uint16_t>::max()));
+    next_index_++;
+    pending_cluster_ = cluster.id;
+    return cluster;
+}
+
+void ProbeSender::onPong(int64_t ping_timestamp_us, int64_t now_us) {
+    if (now_us > ping_timestamp_us) {
+        rtt_us_ = static_cast<uint32_t>(now_us - ping_timestamp_us);
+    }
+}
+
+void ProbeSender::onReport(uint8_t cluster, uint32_t delivered_bps) {
+    if (pending_cluster_ != cluster) {
+        return;
+    }
+    pending_cluster_ = std::nullopt;
+    const uint32_t target_bps = params_.bitrates_bps[cluster];
+    // 包在接收端扎堆到达时算出来的码率会虚高, 不能超过发送码率
+    estimated_bps_ = std::max(estimated_bps_, std::min(delivered_bps, target_bps));
+    if (delivered_bps < target_bps * params_.saturation_ratio) {
+        saturated_ = true;
+    }
+}
+
+bool ProbeSender::finished() const {
+    return saturated_ ||
+           (next_index_ >= params_.bitrates_bps.size() && !pending_cluster_.has_value());
+}
+
+std::optional<uint32_t> ProbeReceiver::onPadding(const ProbeMessage& msg, uint32_t frame_size,
+                                                 int64_t now_us) {
+    if (msg.seq == 0 || cluster_ != msg.cluster) {
+        cluster_ = msg.cluster;
+        first_arrival_us_ = now_us;
+        last_arrival_us_ = now_us;
+        bytes_after_first_ = 0;
+    }
+    else {
+        last_arrival_us_ = now_us;
+        bytes_after_first_ += frame_size;
+    }
+    if (msg.seq + 1 != msg.count || bytes_after_first_ == 0) {
+        return std::nullopt;
+    }
+    cluster_ = std::nullopt;
+    const int64_t duration_us = std::max<int64_t>(last_arrival_us_ - first_arrival_us_, 1);
+    const uint64_t bps = bytes_after_first_ * 8 * 1'000'000 / duration_us;
+    return static_cast<uint32_t>(std::min<uint64_t>(bps, std::numeric_limits<uint32_t>::max()));
+}
+
+void ProbeReceiver::onOtherMedia(uint32_t frame_size) {
+    if (cluster_.has_value()) {
+        bytes_after_first_ += frame_size;
+    }
+}
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,137 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace lt {
+
+namespace tp {
+
+// 连接建立后, 正式推流前的带宽/RTT探测.
+// 1. 服务端发Ping, 客户端立即回Pong, 服务端得到RTT
+// 2. 服务端按从低到高的目标码率, 每次匀速发一组(cluster)填充包
+// 3. 客户端用一组包的到达时间算出实际送达码率, 回Report
+// 4. 送达码率明显低于目标码率说明链路已经饱和, 服务端发Done结束探测
+// 探测消息放在MediaHeader(kind=Probe)后面, 布局(小端序, 共kSize字节, 填充包后面再补0):
+//   0 uint8_t type     2 uint16_t seq     6 uint16_t reserved    12 uint32_t rtt_us
+//   1 uint8_t cluster  4 uint16_t count   8 uint32_t bitrate_kbps 16 int64_t timestamp_us
+struct ProbeMessage {
+    enum class Type : uint8_t {
+        Ping = 1,
+        Pong = 2,
+        Padding = 3,
+        Report = 4,
+        Done = 5,
+    };
+    static constexpr uint32_t kSize = 24;
+
+    Type type = Type::Ping;
+    uint8_t cluster = 0;
+    uint16_t seq = 0;
+    uint16_t count = 0;
+    // Padding: 这一组的目标码率; Report: 送达码率; Done: 探测结果
+    uint32_t bitrate_kbps = 0;
+    uint32_t rtt_us = 0;
+    int64_t timestamp_us = 0;
+};
+
+// 编码成完整的媒体帧, 可以直接交给Client/Server::send(data, len).
+// 含MediaHeader不足padding_to字节时用0补齐
+std::shared_ptr<uint8_t> encodeProbeMessage(const ProbeMessage& msg, uint32_t padding_to,
+                                            uint32_t& frame_size);
+
+// 只解析MediaHeader之后的部分
+std::optional<ProbeMessage> decodeProbeMessage(const uint8_t* payload, uint32_t size);
+
+// 服务端的探测逻辑, 不涉及IO和线程, 由ServerTCP在网络线程里驱动
+class ProbeSender {
+public:
+    struct Params {
+        std::vector<uint32_t> bitrates_bps = {2'000'000, 8'000'000, 32'000'000, 128'000'000,
+                                              512'000'000};
+        int64_t cluster_duration_us = 30'000;
+        // 送达码率低于目标码率的这个比例, 就不再往上探
+        float saturation_ratio = 0.8f;
+        uint32_t min_packet_size = 1200;
+        uint32_t max_packet_size = 16 * 1024;
+        uint16_t min_packets = 5;
+    };
+    struct Cluster {
+        uint8_t id;
+        uint32_t bitrate_bps;
+        uint32_t packet_size;
+        uint16_t packet_count;
+    };
+
+public:
+    explicit ProbeSender(const Params& params);
+    // 还没收到上一组的Report, 或者已经探完了, 返回nullopt
+    std::optional<Cluster> nextCluster();
+    void onPong(int64_t ping_timestamp_us, int64_t now_us);
+    void onReport(uint8_t cluster, uint32_t delivered_bps);
+    bool finished() const;
+    // 链路能稳定送达的码率, 一组都没探完时为0
+    uint32_t estimatedBps() const { return estimated_bps_; }
+    // 还没收到Pong时为0
+    uint32_t rttUs() const { return rtt_us_; }
+
+private:
+    Params params_;
+    size_t next_index_ = 0;
+    std::optional<uint8_t> pending_cluster_;
+    bool saturated_ = false;
+    uint32_t estimated_bps_ = 0;
+    uint32_t rtt_us_ = 0;
+};
+
+// 客户端统计每一组填充包的送达码率
+class ProbeReceiver {
+public:
+    // frame_size含MediaHeader. 收齐一组时返回这一组的送达码率
+    std::optional<uint32_t> onPadding(const ProbeMessage& msg, uint32_t frame_size,
+                                      int64_t now_us);
+    // 探测期间上层已经在推流, 同一条链路上的音视频也算进这一组的送达字节数
+    void onOtherMedia(uint32_t frame_size);
+
+private:
+    std::optional<uint8_t> cluster_;
+    int64_t first_arrival_us_ = 0;
+    int64_t last_arrival_us_ = 0;
+    // 第一个包之后收到的字节数, 第一个包的到达时间只是起点
+    uint64_t bytes_after_first_ = 0;
+};
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,207 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+#include <ltlib/io/media_frame.h>
+
+#include "bandwidth_probe.h"
+
+using lt::tp::ProbeMessage;
+using lt::tp::ProbeReceiver;
+using lt::tp::ProbeSender;
+
+namespace {
+
+// 单向时延加瓶颈带宽的链路, 包排队依次通过瓶颈
+class SimulatedLink {
+public:
+    SimulatedLink(uint32_t bottleneck_bps, int64_t one_way_delay_us)
+        : bottleneck_bps_{bottleneck_bps}
+        , delay_us_{one_way_delay_us} {}
+
+    // 返回到达时间
+    int64_t send(int64_t now_us, uint32_t size) {
+        const int64_t start = std::max(now_us, link_free_us_);
+        link_free_us_ = start + static_cast<int64_t>(size) * 8 * 1'000'000 / bottleneck_bps_;
+        return link_free_us_ + delay_us_;
+    }
+
+    int64_t delay() const { return delay_us_; }
+
+private:
+    const uint32_t bottleneck_bps_;
+    const int64_t delay_us_;
+    int64_t link_free_us_ = 0;
+};
+
+struct ProbeResult {
+    uint32_t bps;
+    uint32_t rtt_us;
+    int64_t elapsed_us;
+};
+
+// 按ServerTCP/ClientTCP的流程把收发两端串起来, 包按目标码率匀速发出
+ProbeResult runProbe(SimulatedLink& link) {
+    ProbeSender sender{ProbeSender::Params{}};
+    ProbeReceiver receiver;
+    int64_t now = 0;
+    const int64_t ping_arrival = link.send(now, 100);
+    now = ping_arrival + link.delay();
+    sender.onPong(0, now);
+    while (auto cluster = sender.nextCluster()) {
+        const int64_t interval_us = static_cast<int64_t>(cluster->packet_size) * 8 * 1'000'000 /
+                                    cluster->bitrate_bps;
+        std::optional<uint32_t> delivered;
+        int64_t arrival = now;
+        for (uint16_t seq = 0; seq < cluster->packet_count; seq++) {
+            ProbeMessage msg{};
+            msg.type = ProbeMessage::Type::Padding;
+            msg.cluster = cluster->id;
+            msg.seq = seq;
+            msg.count = cluster->packet_count;
+            arrival = link.send(now + seq * interval_us, cluster->packet_size);
+            delivered = receiver.onPadding(msg, cluster->packet_size, arrival);
+        }
+        EXPECT_TRUE(delivered.has_value());
+        now = arrival + link.delay();
+        sender.onReport(cluster->id, delivered.value_or(0));
+    }
+    EXPECT_TRUE(sender.finished());
+    return {sender.estimatedBps(), sender.rttUs(), now};
+}
+
+} // namespace
+
+TEST(BandwidthProbeTest, MessageRoundTrip) {
+    ProbeMessage msg{};
+    msg.type = ProbeMessage::Type::Padding;
+    msg.cluster = 3;
+    msg.seq = 17;
+    msg.count = 30;
+    msg.bitrate_kbps = 128'000;
+    msg.rtt_us = 2345;
+    msg.timestamp_us = 1234567890123;
+    uint32_t size = 0;
+    auto data = lt::tp::encodeProbeMessage(msg, 1200, size);
+    ASSERT_EQ(size, 1200u);
+    auto frame = ltlib::decode_media_frame(data.get(), size);
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(frame->header.kind, ltlib::MediaHeader::Kind::Probe);
+    auto decoded = lt::tp::decodeProbeMessage(frame->payload, frame->payload_size);
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_EQ(decoded->type, msg.type);
+    EXPECT_EQ(decoded->cluster, msg.cluster);
+    EXPECT_EQ(decoded->seq, msg.seq);
+    EXPECT_EQ(decoded->count, msg.count);
+    EXPECT_EQ(decoded->bitrate_kbps, msg.bitrate_kbps);
+    EXPECT_EQ(decoded->rtt_us, msg.rtt_us);
+    EXPECT_EQ(decoded->timestamp_us, msg.timestamp_us);
+
+    // 不要求填充时只有头
+    lt::tp::encodeProbeMessage(msg, 0, size);
+    EXPECT_EQ(size, ltlib::MediaHeader::kSize + ProbeMessage::kSize);
+    EXPECT_FALSE(lt::tp::decodeProbeMessage(frame->payload, ProbeMessage::kSize - 1).has_value());
+    std::vector<uint8_t> bad(frame->payload, frame->payload + ProbeMessage::kSize);
+    bad[0] = 0;
+    EXPECT_FALSE(lt::tp::decodeProbeMessage(bad.data(), ProbeMessage::kSize).has_value());
+}
+
+TEST(BandwidthProbeTest, StopAtSaturation) {
+    ProbeSender sender{ProbeSender::Params{}};
+    auto first = sender.nextCluster();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->bitrate_bps, 2'000'000u);
+    EXPECT_GE(first->packet_count, 5);
+    // 没收到Report之前不发下一组
+    EXPECT_FALSE(sender.nextCluster().has_value());
+    // 不认识的Report不算数
+    sender.onReport(first->id + 1, 2'000'000);
+    EXPECT_FALSE(sender.nextCluster().has_value());
+    // 扎堆到达算出的码率不会超过发送码率
+    sender.onReport(first->id, 9'000'000);
+    EXPECT_EQ(sender.estimatedBps(), 2'000'000u);
+
+    auto second = sender.nextCluster();
+    ASSERT_TRUE(second.has_value());
+    EXPECT_EQ(second->bitrate_bps, 8'000'000u);
+    sender.onReport(second->id, 5'000'000);
+    EXPECT_TRUE(sender.finished());
+    EXPECT_FALSE(sender.nextCluster().has_value());
+    EXPECT_EQ(sender.estimatedBps(), 5'000'000u);
+}
+
+TEST(BandwidthProbeTest, ReceiverMeasuresArrivalRate) {
+    ProbeReceiver receiver;
+    ProbeMessage msg{};
+    msg.type = ProbeMessage::Type::Padding;
+    msg.count = 11;
+    std::optional<uint32_t> bps;
+    // 每1ms到一个1250字节的包, 即10Mbps
+    for (uint16_t seq = 0; seq < msg.count; seq++) {
+        msg.seq = seq;
+        bps = receiver.onPadding(msg, 1250, 5'000'000 + seq * 1000);
+        if (seq + 1 < msg.count) {
+            EXPECT_FALSE(bps.has_value());
+        }
+    }
+    ASSERT_TRUE(bps.has_value());
+    EXPECT_EQ(bps.value(), 10'000'000u);
+
+    // 新的一组中途开始, 之前没收齐的丢掉
+    msg.cluster = 1;
+    msg.seq = 0;
+    EXPECT_FALSE(receiver.onPadding(msg, 1250, 0).has_value());
+    msg.cluster = 2;
+    msg.seq = 9;
+    EXPECT_FALSE(receiver.onPadding(msg, 1250, 100).has_value());
+    msg.seq = 10;
+    bps = receiver.onPadding(msg, 1250, 1100);
+    ASSERT_TRUE(bps.has_value());
+    EXPECT_EQ(bps.value(), 10'000'000u);
+}
+
+TEST(BandwidthProbeTest, ReceiverCountsOtherMedia) {
+    ProbeReceiver receiver;
+    // 两组之间收到的不算
+    receiver.onOtherMedia(100'000);
+    ProbeMessage msg{};
+    msg.type = ProbeMessage::Type::Padding;
+    msg.count = 11;
+    std::optional<uint32_t> bps;
+    // 填充包只占一半, 另一半是同时在推的视频, 链路一共送达10Mbps
+    for (uint16_t seq = 0; seq < msg.count; seq++) {
+        msg.seq = seq;
+        if (seq != 0) {
+            receiver.onOtherMedia(625);
+        }
+        bps = receiver.onPadding(msg, 625, seq * 1000);
+    }
+    ASSERT_TRUE(bps.has_value());
+    EXPECT_EQ(bps.value(), 10'000'000u);
+}
+
+TEST(BandwidthProbeTest, ThrottledLinks) {
+    struct Case {
+        uint32_t bottleneck_bps;
+        int64_t one_way_delay_us;
+    };
+    for (auto c : {Case{5'000'000, 20'000}, Case{50'000'000, 5'000}, Case{300'000'000, 1'000},
+                   Case{1'000'000'000, 200}}) {
+        SimulatedLink link{c.bottleneck_bps, c.one_way_delay_us};
+        auto result = runProbe(link);
+        printf("bottleneck %uMbps delay %lldus: estimated %.1fMbps rtt %uus in %lldms\n",
+               c.bottleneck_bps / 1'000'000, static_cast<long long>(c.one_way_delay_us),
+               result.bps / 1e6, result.rtt_us, static_cast<long long>(result.elapsed_us / 1000));
+        // 比最高一档还快的链路只能探到最高一档
+        const double expected =
+            std::min(c.bottleneck_bps, ProbeSender::Params{}.bitrates_bps.back());
+        EXPECT_GT(result.bps, expected * 0.7);
+        EXPECT_LT(result.bps, expected * 1.3);
+        EXPECT_GE(result.rtt_us, 2 * c.one_way_delay_us);
+        EXPECT_LT(result.rtt_us, 2 * c.one_way_delay_us + 1000);
+        // 探测阶段不能明显拖慢出画面
+        EXPECT_LT(result.elapsed_us, 1'000'000);
+    }
+}
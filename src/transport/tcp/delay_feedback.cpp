@@ -0,0 +1,294 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "delay_feedback.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <ltlib/io/media_frame.h>
+
+namespace {
+
+constexpr uint32_t kMaxNumDeltas = 60;
+constexpr double kThresholdUp = 0.0087;
+constexpr double kThresholdDown = 0.039;
+constexpr double kMaxAdaptOffsetMs = 15.0;
+constexpr double kMinThreshold = 6.0;
+constexpr double kMaxThreshold = 600.0;
+constexpr int64_t kOveruseTimeUs = 10'000;
+constexpr double kJitterGain = 1.0 / 16;
+
+template <typename T> void store(uint8_t* out, size_t offset, T value) {
+    memcpy(out + offset, &value, sizeof(T));
+}
+
+template <typename T> T load(const uint8_t* data, size_t offset) {
+    T value;
+    memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace tp {
+
+std::shared_ptr<uint8_t> encodeDelayFeedback(const DelayFeedback& feedback,
+                                             uint32_t& frame_size) {
+    frame_size = ltlib::MediaHeader::kSize + DelayFeedback::kSize;
+    std::shared_ptr<uint8_t> frame{new uint8_t[frame_size], std::default_delete<uint8_t[]>()};
+    ltlib::MediaHeader header{};
+    header.kind = ltlib::MediaHeader::Kind::Feedback;
+    ltlib::encode_media_header(header, DelayFeedback::kSize, frame.get());
+    uint8_t* out = frame.get() + ltlib::MediaHeader::kSize;
+    store<uint32_t>(out, 0, feedback.seq);
+    store<uint16_t>(out, 4, feedback.packets);
+    store<uint16_t>(out, 6, feedback.frames);
+    store<uint32_t>(out, 8, feedback.bytes);
+    store<uint32_t>(out, 12, feedback.interval_us);
+    store<int32_t>(out, 16, feedback.queue_delay_us);
+    store<uint32_t>(out, 20, feedback.jitter_us);
+    store<int32_t>(out, 24, feedback.trend_x1000);
+    store<uint8_t>(out, 28, static_cast<uint8_t>(feedback.usage));
+    memset(out + 29, 0, 3);
+    store<uint64_t>(out, 32, feedback.last_frame_id);
+    return frame;
+}
+
+std::optional<DelayFeedback> decodeDelayFeedback(const uint8_t* payload, uint32_t size) {
+    if (size < DelayFeedback::kSize) {
+        return std::nullopt;
+    }
+    const uint8_t usage = load<uint8_t>(payload, 28);
+    if (usage > static_cast<uint8_t>(DelayFeedback::Usage::Underusing)) {
+        return std::nullopt;
+    }
+    DelayFeedback feedback{};
+    feedback.seq = load<uint32_t>(payload, 0);
+    feedback.packets = load<uint16_t>(payload, 4);
+    feedback.frames = load<uint16_t>(payload, 6);
+    feedback.bytes = load<uint32_t>(payload, 8);
+    feedback.interval_us = load<uint32_t>(payload, 12);
+    feedback.queue_delay_us = load<int32_t>(payload, 16);
+    feedback.jitter_us = load<uint32_t>(payload, 20);
+    feedback.trend_x1000 = load<int32_t>(payload, 24);
+    feedback.usage = static_cast<DelayFeedback::Usage>(usage);
+    feedback.last_frame_id = load<uint64_t>(payload, 32);
+    return feedback;
+}
+
+TrendlineEstimator::TrendlineEstimator(const Params& params)
+    : params_{params}
+    , threshold_{params.initial_threshold} {}
+
+void TrendlineEstimator::update(double delay_delta_ms, int64_t arrival_us) {
+    if (first_arrival_us_ < 0) {
+        first_arrival_us_ = arrival_us;
+    }
+    num_deltas_ = std::min(num_deltas_ + 1, kMaxNumDeltas);
+    accumulated_delay_ms_ += delay_delta_ms;
+    smoothed_delay_ms_ = params_.smoothing_coef * smoothed_delay_ms_ +
+                         (1 - params_.smoothing_coef) * accumulated_delay_ms_;
+    samples_.push_back({(arrival_us - first_arrival_us_) / 1000.0, smoothed_delay_ms_});
+    if (samples_.size() > params_.window_size) {
+        samples_.pop_front();
+    }
+    if (samples_.size() < params_.window_size) {
+        return;
+    }
+    // 最小二乘拟合时延随到达时间的斜率
+    double sum_x = 0;
+    double sum_y = 0;
+    for (auto& sample : samples_) {
+        sum_x += sample.arrival_ms;
+        sum_y += sample.smoothed_delay_ms;
+    }
+    const double avg_x = sum_x / samples_.size();
+    const double avg_y = sum_y / samples_.size();
+    double numerator = 0;
+    double denominator = 0;
+    for (auto& sample : samples_) {
+        numerator += (sample.arrival_ms - avg_x) * (sample.smoothed_delay_ms - avg_y);
+        denominator += (sample.arrival_ms - avg_x) * (sample.arrival_ms - avg_x);
+    }
+    const double slope = denominator == 0 ? 0 : numerator / denominator;
+    const double modified_trend = num_deltas_ * slope * params_.threshold_gain;
+    detect(modified_trend, arrival_us);
+    updateThreshold(modified_trend, arrival_us);
+}
+
+void TrendlineEstimator::detect(double modified_trend, int64_t now_us) {
+    if (modified_trend > threshold_) {
+        if (overuse_count_ == 0) {
+            overuse_start_us_ = now_us;
+        }
+        overuse_count_++;
+        // 持续一段时间, 并且还在变大, 才算过载, 单个尖峰不算
+        if (now_us - overuse_start_us_ >= kOveruseTimeUs && overuse_count_ > 1 &&
+            modified_trend >= prev_modified_trend_) {
+            usage_ = DelayFeedback::Usage::Overusing;
+        }
+    }
+    else if (modified_trend < -threshold_) {
+        overuse_count_ = 0;
+        usage_ = DelayFeedback::Usage::Underusing;
+    }
+    else {
+        overuse_count_ = 0;
+        usage_ = DelayFeedback::Usage::Normal;
+    }
+    prev_modified_trend_ = modified_trend;
+}
+
+// 阈值跟着trend走, 和其它TCP流竞争时不会一直判定过载
+void TrendlineEstimator::updateThreshold(double modified_trend, int64_t now_us) {
+    if (last_threshold_update_us_ < 0) {
+        last_threshold_update_us_ = now_us;
+    }
+    const double abs_trend = std::fabs(modified_trend);
+    if (abs_trend > threshold_ + kMaxAdaptOffsetMs) {
+        // 突发的尖峰不参与调整
+        last_threshold_update_us_ = now_us;
+        return;
+    }
+    const double k = abs_trend < threshold_ ? kThresholdDown : kThresholdUp;
+    const double elapsed_ms = std::min((now_us - last_threshold_update_us_) / 1000.0, 100.0);
+    threshold_ += k * (abs_trend - threshold_) * elapsed_ms;
+    threshold_ = std::clamp(threshold_, kMinThreshold, kMaxThreshold);
+    last_threshold_update_us_ = now_us;
+}
+
+ArrivalTracker::ArrivalTracker(const Params& params)
+    : params_{params}
+    , trendline_{params.trendline} {}
+
+void ArrivalTracker::onPacket(uint64_t frame_id, int64_t send_time_us, int64_t arrival_us,
+                              uint32_t size, bool frame_end) {
+    packets_++;
+    bytes_ += size;
+    last_frame_id_ = frame_id;
+    updateDelay(send_time_us, arrival_us);
+    if (frame_end) {
+        frames_++;
+        onFrameEnd(send_time_us, arrival_us);
+    }
+    if (current_group_.has_value() && send_time_us < current_group_->first_send_us) {
+        // TCP不会乱序, 只有发送端时钟跳变才会走到这里, 从头开始分组
+        current_group_.reset();
+        prev_group_.reset();
+    }
+    if (!current_group_.has_value()) {
+        current_group_ = PacketGroup{send_time_us, send_time_us, arrival_us, arrival_us};
+        return;
+    }
+    if (belongsToGroup(send_time_us, arrival_us)) {
+        current_group_->last_send_us = std::max(current_group_->last_send_us, send_time_us);
+        current_group_->last_arrival_us = arrival_us;
+        return;
+    }
+    // 当前组结束, 和上一组比较
+    if (prev_group_.has_value()) {
+        const int64_t send_delta = current_group_->last_send_us - prev_group_->last_send_us;
+        const int64_t arrival_delta =
+            current_group_->last_arrival_us - prev_group_->last_arrival_us;
+        trendline_.update((arrival_delta - send_delta) / 1000.0,
+                          current_group_->last_arrival_us);
+    }
+    prev_group_ = current_group_;
+    current_group_ = PacketGroup{send_time_us, send_time_us, arrival_us, arrival_us};
+}
+
+bool ArrivalTracker::belongsToGroup(int64_t send_time_us, int64_t arrival_us) const {
+    if (send_time_us - current_group_->first_send_us <= params_.burst_us) {
+        return true;
+    }
+    // 接收端一次read读出好几个包, 到达时间挤在一起, 到达间隔比发送间隔还小的也算同一组
+    const int64_t arrival_delta = arrival_us - current_group_->last_arrival_us;
+    const int64_t send_delta = send_time_us - current_group_->last_send_us;
+    return arrival_delta < params_.burst_us && arrival_delta - send_delta < 0;
+}
+
+void ArrivalTracker::updateDelay(int64_t send_time_us, int64_t arrival_us) {
+    // 含两端时钟的偏差, 只有减掉最小值之后的部分有意义
+    const int64_t delay_us = arrival_us - send_time_us;
+    if (min_delay_window_start_us_ < 0 ||
+        arrival_us - min_delay_window_start_us_ >= params_.min_delay_window_us) {
+        prev_min_delay_us_ = min_delay_window_start_us_ < 0 ? delay_us : min_delay_us_;
+        min_delay_us_ = delay_us;
+        min_delay_window_start_us_ = arrival_us;
+    }
+    else {
+        min_delay_us_ = std::min(min_delay_us_, delay_us);
+    }
+    queue_delay_us_ = delay_us - std::min(prev_min_delay_us_, min_delay_us_);
+}
+
+void ArrivalTracker::onFrameEnd(int64_t send_time_us, int64_t arrival_us) {
+    if (prev_frame_send_us_.has_value()) {
+        const int64_t d =
+            (arrival_us - prev_frame_arrival_us_) - (send_time_us - *prev_frame_send_us_);
+        jitter_us_ += (std::fabs(static_cast<double>(d)) - jitter_us_) * kJitterGain;
+    }
+    prev_frame_send_us_ = send_time_us;
+    prev_frame_arrival_us_ = arrival_us;
+}
+
+std::optional<DelayFeedback> ArrivalTracker::poll(int64_t now_us) {
+    if (last_report_us_ < 0) {
+        last_report_us_ = now_us;
+        return std::nullopt;
+    }
+    if (now_us - last_report_us_ < params_.report_interval_us || packets_ == 0) {
+        return std::nullopt;
+    }
+    DelayFeedback feedback{};
+    feedback.seq = seq_++;
+    feedback.packets = packets_;
+    feedback.frames = frames_;
+    feedback.bytes = bytes_;
+    feedback.interval_us = static_cast<uint32_t>(now_us - last_report_us_);
+    feedback.queue_delay_us = static_cast<int32_t>(queue_delay_us_);
+    feedback.jitter_us = static_cast<uint32_t>(jitter_us_);
+    feedback.trend_x1000 = static_cast<int32_t>(trendline_.modifiedTrend() * 1000);
+    feedback.usage = trendline_.usage();
+    feedback.last_frame_id = last_frame_id_;
+    packets_ = 0;
+    frames_ = 0;
+    bytes_ = 0;
+    last_report_us_ = now_us;
+    return feedback;
+}
+
+} // namespace tp
+
+} // namespace lt
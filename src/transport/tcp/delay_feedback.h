@@ -0,0 +1,174 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+
+namespace lt {
+
+namespace tp {
+
+// 接收端定期发回发送端的时延反馈. 光看单帧的到达时间分不清时延变大是排队还是抖动,
+// 这里带上单向时延梯度的趋势, 持续为正才是瓶颈处在排队.
+// 反馈放在MediaHeader(kind=Feedback)后面, 布局(小端序, 共kSize字节):
+//   0 uint32_t seq       8 uint32_t bytes        16 int32_t  queue_delay_us  24 int32_t trend_x1000
+//   4 uint16_t packets  12 uint32_t interval_us  20 uint32_t jitter_us       28 uint8_t usage
+//   6 uint16_t frames                                                        32 uint64_t last_frame_id
+struct DelayFeedback {
+    enum class Usage : uint8_t {
+        Normal = 0,
+        Overusing = 1,
+        Underusing = 2,
+    };
+    static constexpr uint32_t kSize = 40;
+
+    uint32_t seq = 0;
+    // 距上一次反馈收到的包数, 帧数, 字节数
+    uint16_t packets = 0;
+    uint16_t frames = 0;
+    uint32_t bytes = 0;
+    // 距上一次反馈的时长(接收端时钟)
+    uint32_t interval_us = 0;
+    // 单向时延相对最近一段时间最小值多出来的部分
+    int32_t queue_delay_us = 0;
+    // RFC 3550的帧间到达抖动
+    uint32_t jitter_us = 0;
+    // 放大后的时延梯度斜率, 单位ms, 和阈值比较得出usage
+    int32_t trend_x1000 = 0;
+    Usage usage = Usage::Normal;
+    uint64_t last_frame_id = 0;
+};
+
+// 编码成完整的媒体帧, 可以直接交给Client/Server::send(data, len)
+std::shared_ptr<uint8_t> encodeDelayFeedback(const DelayFeedback& feedback, uint32_t& frame_size);
+
+// 只解析MediaHeader之后的部分
+std::optional<DelayFeedback> decodeDelayFeedback(const uint8_t* payload, uint32_t size);
+
+// 对时延变化量做平滑后线性拟合, 斜率持续超过自适应阈值判定为过载. 参数取自GCC的trendline.
+class TrendlineEstimator {
+public:
+    struct Params {
+        size_t window_size = 20;
+        double smoothing_coef = 0.9;
+        double threshold_gain = 4.0;
+        double initial_threshold = 12.5;
+    };
+
+public:
+    explicit TrendlineEstimator(const Params& params);
+    // delay_delta_ms: 相邻两组包的(到达间隔 - 发送间隔)
+    void update(double delay_delta_ms, int64_t arrival_us);
+    DelayFeedback::Usage usage() const { return usage_; }
+    double modifiedTrend() const { return prev_modified_trend_; }
+    double threshold() const { return threshold_; }
+
+private:
+    void updateThreshold(double modified_trend, int64_t now_us);
+    void detect(double modified_trend, int64_t now_us);
+
+private:
+    struct Sample {
+        double arrival_ms;
+        double smoothed_delay_ms;
+    };
+    const Params params_;
+    std::deque<Sample> samples_;
+    int64_t first_arrival_us_ = -1;
+    double accumulated_delay_ms_ = 0;
+    double smoothed_delay_ms_ = 0;
+    uint32_t num_deltas_ = 0;
+    double prev_modified_trend_ = 0;
+    double threshold_;
+    int64_t last_threshold_update_us_ = -1;
+    DelayFeedback::Usage usage_ = DelayFeedback::Usage::Normal;
+    uint32_t overuse_count_ = 0;
+    int64_t overuse_start_us_ = 0;
+};
+
+// 客户端在网络线程里记录每个包的到达时间. 发送时间相近的包归为一组(和GCC一样按5ms),
+// 用组与组之间的时延变化量驱动TrendlineEstimator. 不涉及IO和线程.
+class ArrivalTracker {
+public:
+    struct Params {
+        int64_t burst_us = 5'000;
+        int64_t report_interval_us = 100'000;
+        int64_t min_delay_window_us = 5'000'000;
+        TrendlineEstimator::Params trendline;
+    };
+
+public:
+    explicit ArrivalTracker(const Params& params);
+    // send_time_us是发送端时钟, arrival_us是本地时钟, 两者只用差值
+    void onPacket(uint64_t frame_id, int64_t send_time_us, int64_t arrival_us, uint32_t size,
+                  bool frame_end);
+    // 到了发反馈的时间, 并且期间收到过包时返回
+    std::optional<DelayFeedback> poll(int64_t now_us);
+    const TrendlineEstimator& trendline() const { return trendline_; }
+
+private:
+    struct PacketGroup {
+        int64_t first_send_us;
+        int64_t last_send_us;
+        int64_t first_arrival_us;
+        int64_t last_arrival_us;
+    };
+    bool belongsToGroup(int64_t send_time_us, int64_t arrival_us) const;
+    void updateDelay(int64_t send_time_us, int64_t arrival_us);
+    void onFrameEnd(int64_t send_time_us, int64_t arrival_us);
+
+private:
+    const Params params_;
+    TrendlineEstimator trendline_;
+    std::optional<PacketGroup> current_group_;
+    std::optional<PacketGroup> prev_group_;
+    // 单向时延的最小值, 两个窗口轮换, 路由变了之后能跟着变
+    int64_t min_delay_us_ = 0;
+    int64_t prev_min_delay_us_ = 0;
+    int64_t min_delay_window_start_us_ = -1;
+    int64_t queue_delay_us_ = 0;
+    std::optional<int64_t> prev_frame_send_us_;
+    int64_t prev_frame_arrival_us_ = 0;
+    double jitter_us_ = 0;
+    // 当前反馈周期
+    uint32_t seq_ = 0;
+    int64_t last_report_us_ = -1;
+    uint16_t packets_ = 0;
+    uint16_t frames_ = 0;
+    uint32_t bytes_ = 0;
+    uint64_t last_frame_id_ = 0;
+};
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+
+#include <ltlib/io/media_frame.h>
+
+#include "delay_feedback.h"
+
+using lt::tp::ArrivalTracker;
+using lt::tp::DelayFeedback;
+
+namespace {
+
+constexpr int64_t kClientClockOffsetUs = 987'654'321;
+constexpr uint32_t kChunkSize = 16 * 1024;
+
+// 合成的到达时间: 发送端按帧切块匀速发出, 经过瓶颈链路, 再加上单向时延和抖动.
+// TCP不乱序, 后发的包不会比先发的包先到
+struct TraceParams {
+    uint32_t send_bps;
+    uint32_t bottleneck_bps;
+    int64_t delay_us;
+    // 均匀分布的抖动上限
+    int64_t jitter_us = 0;
+    // 接收端攒够这么久才读一次socket, 到达时间挤在一起
+    int64_t read_interval_us = 0;
+    int64_t duration_us = 5'000'000;
+    uint32_t fps = 60;
+};
+
+struct TraceResult {
+    std::vector<DelayFeedback> feedbacks;
+    uint32_t overusing = 0;
+    uint32_t underusing = 0;
+    int64_t max_queue_delay_us = 0;
+};
+
+TraceResult runTrace(const TraceParams& params) {
+    ArrivalTracker tracker{ArrivalTracker::Params{}};
+    TraceResult result;
+    std::mt19937 rng{20231120};
+    std::uniform_int_distribution<int64_t> jitter{0, params.jitter_us};
+    const int64_t frame_interval_us = 1'000'000 / params.fps;
+    const uint32_t frame_size = params.send_bps / 8 / params.fps;
+    int64_t link_free_us = 0;
+    int64_t last_arrival_us = 0;
+    int64_t next_poll_us = 0;
+    uint64_t frame_id = 0;
+    for (int64_t frame_start = 0; frame_start < params.duration_us;
+         frame_start += frame_interval_us, frame_id++) {
+        int64_t send_us = frame_start;
+        for (uint32_t offset = 0; offset < frame_size; offset += kChunkSize) {
+            const uint32_t size = std::min(kChunkSize, frame_size - offset);
+            const bool frame_end = offset + kChunkSize >= frame_size;
+            link_free_us = std::max(link_free_us, send_us) +
+                           static_cast<int64_t>(size) * 8 * 1'000'000 / params.bottleneck_bps;
+            int64_t arrival_us = link_free_us + params.delay_us + jitter(rng);
+            if (params.read_interval_us != 0) {
+                arrival_us += params.read_interval_us - arrival_us % params.read_interval_us;
+            }
+            arrival_us = std::max(arrival_us, last_arrival_us);
+            last_arrival_us = arrival_us;
+            while (next_poll_us <= arrival_us) {
+                if (auto feedback = tracker.poll(next_poll_us)) {
+                    result.feedbacks.push_back(feedback.value());
+                    result.max_queue_delay_us =
+                        std::max<int64_t>(result.max_queue_delay_us, feedback->queue_delay_us);
+                    if (feedback->usage == DelayFeedback::Usage::Overusing) {
+                        result.overusing++;
+                    }
+                    else if (feedback->usage == DelayFeedback::Usage::Underusing) {
+                        result.underusing++;
+                    }
+                }
+                next_poll_us += 10'000;
+            }
+            tracker.onPacket(frame_id, send_us, arrival_us + kClientClockOffsetUs, size,
+                             frame_end);
+            // 和Pacer一样按2倍码率匀速发
+            send_us += static_cast<int64_t>(size) * 8 * 1'000'000 / params.send_bps / 2;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+TEST(DelayFeedbackTest, MessageRoundTrip) {
+    DelayFeedback feedback{};
+    feedback.seq = 0x01020304;
+    feedback.packets = 123;
+    feedback.frames = 6;
+    feedback.bytes = 1'234'567;
+    feedback.interval_us = 100'321;
+    feedback.queue_delay_us = -15;
+    feedback.jitter_us = 2'345;
+    feedback.trend_x1000 = -45'678;
+    feedback.usage = DelayFeedback::Usage::Overusing;
+    feedback.last_frame_id = 0x1122334455667788;
+    uint32_t size = 0;
+    auto data = lt::tp::encodeDelayFeedback(feedback, size);
+    EXPECT_EQ(size, ltlib::MediaHeader::kSize + DelayFeedback::kSize);
+    auto media = ltlib::decode_media_frame(data.get(), size);
+    ASSERT_TRUE(media.has_value());
+    EXPECT_EQ(media->header.kind, ltlib::MediaHeader::Kind::Feedback);
+    auto decoded = lt::tp::decodeDelayFeedback(media->payload, media->payload_size);
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_EQ(decoded->seq, feedback.seq);
+    EXPECT_EQ(decoded->packets, feedback.packets);
+    EXPECT_EQ(decoded->frames, feedback.frames);
+    EXPECT_EQ(decoded->bytes, feedback.bytes);
+    EXPECT_EQ(decoded->interval_us, feedback.interval_us);
+    EXPECT_EQ(decoded->queue_delay_us, feedback.queue_delay_us);
+    EXPECT_EQ(decoded->jitter_us, feedback.jitter_us);
+    EXPECT_EQ(decoded->trend_x1000, feedback.trend_x1000);
+    EXPECT_EQ(decoded->usage, feedback.usage);
+    EXPECT_EQ(decoded->last_frame_id, feedback.last_frame_id);
+
+    EXPECT_FALSE(lt::tp::decodeDelayFeedback(media->payload, DelayFeedback::kSize - 1));
+    std::vector<uint8_t> bad(media->payload, media->payload + DelayFeedback::kSize);
+    bad[28] = 7;
+    EXPECT_FALSE(lt::tp::decodeDelayFeedback(bad.data(), DelayFeedback::kSize));
+}
+
+TEST(DelayFeedbackTest, ReportEveryInterval) {
+    ArrivalTracker tracker{ArrivalTracker::Params{}};
+    EXPECT_FALSE(tracker.poll(0).has_value());
+    tracker.onPacket(1, 0, 10'000, 1000, false);
+    tracker.onPacket(1, 1'000, 11'000, 500, true);
+    EXPECT_FALSE(tracker.poll(50'000).has_value());
+    auto feedback = tracker.poll(100'000);
+    ASSERT_TRUE(feedback.has_value());
+    EXPECT_EQ(feedback->seq, 0u);
+    EXPECT_EQ(feedback->packets, 2u);
+    EXPECT_EQ(feedback->frames, 1u);
+    EXPECT_EQ(feedback->bytes, 1500u);
+    EXPECT_EQ(feedback->interval_us, 100'000u);
+    EXPECT_EQ(feedback->last_frame_id, 1u);
+    // 期间没收到包不发
+    EXPECT_FALSE(tracker.poll(250'000).has_value());
+    tracker.onPacket(2, 16'000, 26'000, 800, true);
+    feedback = tracker.poll(260'000);
+    ASSERT_TRUE(feedback.has_value());
+    EXPECT_EQ(feedback->seq, 1u);
+    EXPECT_EQ(feedback->packets, 1u);
+    EXPECT_EQ(feedback->interval_us, 160'000u);
+}
+
+// 链路带宽足够, 时延恒定
+TEST(DelayFeedbackTest, ConstantDelay) {
+    TraceParams params{};
+    params.send_bps = 20'000'000;
+    params.bottleneck_bps = 100'000'000;
+    params.delay_us = 20'000;
+    auto result = runTrace(params);
+    ASSERT_GT(result.feedbacks.size(), 40u);
+    EXPECT_EQ(result.overusing, 0u);
+    EXPECT_LT(result.max_queue_delay_us, 5'000);
+    EXPECT_LT(result.feedbacks.back().jitter_us, 1'000u);
+    EXPECT_LT(std::abs(result.feedbacks.back().trend_x1000), 6'000);
+}
+
+// 发送码率超过瓶颈带宽, 队列一直在涨
+TEST(DelayFeedbackTest, QueueGrowth) {
+    TraceParams params{};
+    params.send_bps = 20'000'000;
+    params.bottleneck_bps = 16'000'000;
+    params.delay_us = 20'000;
+    params.duration_us = 3'000'000;
+    auto result = runTrace(params);
+    ASSERT_GT(result.feedbacks.size(), 20u);
+    // 3秒内多出来的数据要排大约600ms
+    EXPECT_GT(result.max_queue_delay_us, 400'000);
+    // 第一秒之内就能发现
+    bool detected = false;
+    for (size_t i = 0; i < 10; i++) {
+        detected |= result.feedbacks[i].usage == DelayFeedback::Usage::Overusing;
+    }
+    EXPECT_TRUE(detected);
+    // 发送端一直不降码率时阈值会慢慢追上来, 但趋势始终远大于抖动的情况
+    for (size_t i = 5; i < result.feedbacks.size(); i++) {
+        EXPECT_GT(result.feedbacks[i].trend_x1000, 20'000) << "feedback " << i;
+    }
+}
+
+// 时延随机抖动但不持续变大, 不能误判为过载
+TEST(DelayFeedbackTest, Jitter) {
+    TraceParams params{};
+    params.send_bps = 20'000'000;
+    params.bottleneck_bps = 100'000'000;
+    params.delay_us = 20'000;
+    params.jitter_us = 10'000;
+    params.duration_us = 10'000'000;
+    auto result = runTrace(params);
+    EXPECT_LT(result.overusing, result.feedbacks.size() / 20);
+    for (auto& feedback : result.feedbacks) {
+        EXPECT_LT(std::abs(feedback.trend_x1000), 6'000);
+    }
+    EXPECT_GT(result.feedbacks.back().jitter_us, 1'000u);
+    EXPECT_LT(result.feedbacks.back().jitter_us, 10'000u);
+}
+
+// 接收端一次读出好几个包, 到达时间挤在一起
+TEST(DelayFeedbackTest, BurstyReads) {
+    TraceParams params{};
+    params.send_bps = 20'000'000;
+    params.bottleneck_bps = 100'000'000;
+    params.delay_us = 5'000;
+    params.read_interval_us = 8'000;
+    auto result = runTrace(params);
+    EXPECT_EQ(result.overusing, 0u);
+}
@@ -0,0 +1,87 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "layer_dropper.h"
+
+#include <algorithm>
+
+namespace lt {
+
+namespace tp {
+
+LayerDropper::LayerDropper(const Params& params)
+    : params_{params} {}
+
+bool LayerDropper::onFrame(uint8_t temporal_id, bool is_keyframe, uint32_t size,
+                           int64_t queue_delay_us, bool overusing) {
+    if (is_keyframe) {
+        // 编码器可能重新配置过层数
+        highest_temporal_id_ = 0;
+    }
+    if (is_keyframe || temporal_id == 0) {
+        drop_from_ = 0;
+        return send();
+    }
+    highest_temporal_id_ = std::max(highest_temporal_id_, temporal_id);
+    if (temporal_id < drop_from_) {
+        // 比被丢的层都低, 不会参考它们, 后面的帧改成参考这一帧
+        drop_from_ = 0;
+    }
+    uint8_t threshold = 0;
+    if (queue_delay_us >= params_.drop_all_layers_delay_us) {
+        threshold = 1;
+    }
+    else if (queue_delay_us >= params_.drop_top_layer_delay_us || overusing) {
+        threshold = highest_temporal_id_;
+    }
+    const bool depends_on_dropped = drop_from_ != 0 && temporal_id >= drop_from_;
+    if (!depends_on_dropped && (threshold == 0 || temporal_id < threshold)) {
+        return send();
+    }
+    drop_from_ = drop_from_ == 0 ? temporal_id : std::min(drop_from_, temporal_id);
+    stats_.dropped_frames++;
+    stats_.dropped_bytes += size;
+    return false;
+}
+
+LayerDropper::Stats LayerDropper::takeStats() {
+    Stats stats = stats_;
+    stats_ = Stats{};
+    return stats;
+}
+
+bool LayerDropper::send() {
+    stats_.sent_frames++;
+    return true;
+}
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,78 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+namespace lt {
+
+namespace tp {
+
+// 发送端积压时按时域分层丢视频帧, 先丢最高层, 积压更严重时只发基本层, 被丢的帧没有人参考,
+// 接收端照样能解码. OpenH264的分层结构里增强层只参考比自己低的层, 所以丢了第k层的一帧之后,
+// 后面>=k层的帧都可能直接或间接参考它, 要跟着丢, 直到出现一个比k低的层.
+// 关键帧和基本层从不丢. 非线程安全
+class LayerDropper {
+public:
+    struct Params {
+        // 发送队列里最老的包等了这么久, 开始丢最高层
+        int64_t drop_top_layer_delay_us = 50'000;
+        // 等了这么久, 丢掉所有增强层
+        int64_t drop_all_layers_delay_us = 150'000;
+    };
+    struct Stats {
+        uint64_t sent_frames = 0;
+        uint64_t dropped_frames = 0;
+        uint64_t dropped_bytes = 0;
+    };
+
+public:
+    explicit LayerDropper(const Params& params);
+    // 返回false表示这一帧不要发. overusing是接收端反馈的时延在持续变大, 按轻度积压处理
+    bool onFrame(uint8_t temporal_id, bool is_keyframe, uint32_t size, int64_t queue_delay_us,
+                 bool overusing);
+    // 返回上次调用以来的统计
+    Stats takeStats();
+
+private:
+    bool send();
+
+private:
+    const Params params_;
+    // 上一个关键帧以来见过的最高层
+    uint8_t highest_temporal_id_ = 0;
+    // 还要跟着丢的最低层, 0表示没有
+    uint8_t drop_from_ = 0;
+    Stats stats_;
+};
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "layer_dropper.h"
+
+using lt::tp::LayerDropper;
+
+namespace {
+
+constexpr int64_t kNoDelay = 0;
+constexpr int64_t kModerateDelay = 80'000;
+constexpr int64_t kSevereDelay = 200'000;
+
+// OpenH264的分层结构, GOP为2^(layers-1)帧: 2层是T0 T1 T0 T1..., 3层是T0 T2 T1 T2...
+uint8_t temporalId(uint32_t layers, uint32_t index) {
+    const uint32_t gop = 1u << (layers - 1);
+    uint32_t position = index % gop;
+    if (position == 0) {
+        return 0;
+    }
+    uint8_t id = static_cast<uint8_t>(layers - 1);
+    while ((position & 1) == 0) {
+        position >>= 1;
+        id--;
+    }
+    return id;
+}
+
+// 按固定的积压程度跑frames帧, 返回发出去的帧数
+uint32_t run(LayerDropper& dropper, uint32_t layers, uint32_t frames, int64_t queue_delay_us) {
+    uint32_t sent = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        if (dropper.onFrame(temporalId(layers, i), i == 0, 1000, queue_delay_us, false)) {
+            sent++;
+        }
+    }
+    return sent;
+}
+
+} // namespace
+
+TEST(LayerDropperTest, Pattern) {
+    const std::vector<uint8_t> two = {0, 1, 0, 1};
+    const std::vector<uint8_t> three = {0, 2, 1, 2, 0, 2, 1, 2};
+    for (uint32_t i = 0; i < two.size(); i++) {
+        EXPECT_EQ(temporalId(2, i), two[i]);
+    }
+    for (uint32_t i = 0; i < three.size(); i++) {
+        EXPECT_EQ(temporalId(3, i), three[i]);
+    }
+}
+
+TEST(LayerDropperTest, NoBackpressure) {
+    LayerDropper dropper{LayerDropper::Params{}};
+    EXPECT_EQ(run(dropper, 3, 120, kNoDelay), 120u);
+    auto stats = dropper.takeStats();
+    EXPECT_EQ(stats.sent_frames, 120u);
+    EXPECT_EQ(stats.dropped_frames, 0u);
+}
+
+// 2层时丢掉增强层正好减半帧率
+TEST(LayerDropperTest, TwoLayersHalveFrameRate) {
+    LayerDropper dropper{LayerDropper::Params{}};
+    EXPECT_EQ(run(dropper, 2, 120, kModerateDelay), 60u);
+    auto stats = dropper.takeStats();
+    EXPECT_EQ(stats.dropped_frames, 60u);
+    EXPECT_EQ(stats.dropped_bytes, 60'000u);
+    // 积压消失后恢复
+    EXPECT_TRUE(dropper.onFrame(0, false, 1000, kModerateDelay, false));
+    EXPECT_TRUE(dropper.onFrame(1, false, 1000, kNoDelay, false));
+}
+
+// 3层时先丢最高层, 更严重时只剩基本层
+TEST(LayerDropperTest, ThreeLayers) {
+    LayerDropper dropper{LayerDropper::Params{}};
+    EXPECT_EQ(run(dropper, 3, 120, kModerateDelay), 60u);
+    EXPECT_EQ(run(dropper, 3, 120, kSevereDelay), 30u);
+    // 接收端反馈时延变大按轻度积压处理
+    uint32_t sent = 0;
+    for (uint32_t i = 0; i < 120; i++) {
+        sent += dropper.onFrame(temporalId(3, i), false, 1000, kNoDelay, true) ? 1 : 0;
+    }
+    EXPECT_EQ(sent, 60u);
+}
+
+TEST(LayerDropperTest, KeyframeNeverDropped) {
+    LayerDropper dropper{LayerDropper::Params{}};
+    run(dropper, 2, 10, kNoDelay);
+    EXPECT_FALSE(dropper.onFrame(1, false, 1000, kSevereDelay, false));
+    EXPECT_TRUE(dropper.onFrame(0, true, 100'000, kSevereDelay, false));
+    EXPECT_TRUE(dropper.onFrame(0, false, 1000, kSevereDelay, false));
+}
+
+// 丢了T1之后积压马上消失, 参考它的T2也要丢
+TEST(LayerDropperTest, DropDependents) {
+    LayerDropper dropper{LayerDropper::Params{}};
+    EXPECT_TRUE(dropper.onFrame(0, true, 1000, kNoDelay, false));
+    EXPECT_TRUE(dropper.onFrame(2, false, 1000, kNoDelay, false));
+    EXPECT_FALSE(dropper.onFrame(1, false, 1000, kSevereDelay, false));
+    EXPECT_FALSE(dropper.onFrame(2, false, 1000, kNoDelay, false));
+    EXPECT_TRUE(dropper.onFrame(0, false, 1000, kNoDelay, false));
+    EXPECT_TRUE(dropper.onFrame(2, false, 1000, kNoDelay, false));
+}
+
+// 积压程度随机变化, 发出去的每一帧参考的帧都发出去了
+TEST(LayerDropperTest, SentFramesDecodable) {
+    std::mt19937 rng{20231210};
+    const int64_t delays[] = {kNoDelay, kModerateDelay, kSevereDelay};
+    for (uint32_t layers : {2u, 3u, 4u}) {
+        LayerDropper dropper{LayerDropper::Params{}};
+        // 每一层最近一帧有没有发出去
+        std::vector<std::optional<bool>> last_sent(layers);
+        uint32_t sent = 0;
+        for (uint32_t i = 0; i < 3000; i++) {
+            const uint8_t temporal_id = temporalId(layers, i);
+            const bool keyframe = i % 600 == 0;
+            const bool ok = dropper.onFrame(temporal_id, keyframe, 1000, delays[rng() % 3], false);
+            if (temporal_id == 0) {
+                EXPECT_TRUE(ok);
+            }
+            if (ok && !keyframe) {
+                // 参考比自己低的层里最近的一帧, T0参考上一个T0. 关键帧不参考别的帧
+                const uint32_t ref_layer = temporal_id == 0 ? 0u : temporal_id - 1u;
+                std::optional<bool> ref;
+                for (int32_t layer = static_cast<int32_t>(ref_layer); layer >= 0; layer--) {
+                    if (last_sent[layer].has_value()) {
+                        ref = last_sent[layer];
+                        break;
+                    }
+                }
+                EXPECT_TRUE(ref.value_or(true)) << "layers " << layers << " frame " << i;
+            }
+            // 更高层后面的帧改成参考这一帧
+            for (uint32_t layer = temporal_id + 1u; layer < layers; layer++) {
+                last_sent[layer].reset();
+            }
+            last_sent[temporal_id] = ok;
+            sent += ok ? 1 : 0;
+        }
+        EXPECT_LT(sent, 3000u);
+        EXPECT_GT(sent, 3000u >> (layers - 1));
+    }
+}
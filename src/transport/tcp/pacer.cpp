@@ -0,0 +1,162 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <ltlib/logging.h>
+
+namespace lt {
+
+namespace tp {
+
+std::unique_ptr<Pacer> Pacer::create(const Params& params) {
+    if (params.now_us == nullptr || params.post_delay == nullptr || params.send == nullptr ||
+        params.pacing_factor <= 0 || params.max_chunk_size == 0) {
+        LOG(ERR) << "Invalid Pacer params";
+        return nullptr;
+    }
+    std::unique_ptr<Pacer> pacer{new Pacer{params}};
+    return pacer;
+}
+
+Pacer::Pacer(const Params& params)
+    : params_{params}
+    , last_refill_us_{params.now_us()} {
+    tokens_ = capacity();
+}
+
+void Pacer::enqueue(const ltlib::MediaFrame& frame) {
+    const uint32_t size = ltlib::MediaHeader::kSize + frame.payload_size;
+    queue_.push_back({frame, size, params_.now_us()});
+    queued_bytes_ += size;
+    if (!timer_pending_) {
+        process();
+    }
+}
+
+void Pacer::setBitrate(uint32_t bitrate_bps) {
+    // 先按旧的码率把令牌补上
+    refill(params_.now_us());
+    params_.bitrate_bps = bitrate_bps;
+    tokens_ = std::min(tokens_, static_cast<double>(capacity()));
+}
+
+void Pacer::clear() {
+    queue_.clear();
+    queued_bytes_ = 0;
+}
+
+Pacer::Stats Pacer::takeStats() {
+    Stats stats = stats_;
+    if (stats.sent_packets != 0) {
+        stats.avg_queue_delay_us =
+            total_queue_delay_us_ / static_cast<int64_t>(stats.sent_packets);
+    }
+    stats.queued_bytes = queued_bytes_;
+    stats_ = Stats{};
+    total_queue_delay_us_ = 0;
+    return stats;
+}
+
+uint32_t Pacer::capacity() const {
+    double window_bytes = bytesPerUs() * static_cast<double>(params_.burst_window_us);
+    return std::max(params_.max_chunk_size, static_cast<uint32_t>(window_bytes));
+}
+
+int64_t Pacer::oldestQueueDelayUs() const {
+    if (queue_.empty()) {
+        return 0;
+    }
+    return params_.now_us() - queue_.front().enqueue_time_us;
+}
+
+void Pacer::process() {
+    timer_pending_ = false;
+    const int64_t now = params_.now_us();
+    refill(now);
+    while (!queue_.empty()) {
+        // 超过桶容量的块也要能发出去, 最多等桶满
+        const double need = std::min(queue_.front().size, capacity());
+        if (tokens_ < need) {
+            break;
+        }
+        Packet packet = std::move(queue_.front());
+        queue_.pop_front();
+        queued_bytes_ -= packet.size;
+        tokens_ -= packet.size;
+        const int64_t delay = now - packet.enqueue_time_us;
+        stats_.sent_packets++;
+        stats_.sent_bytes += packet.size;
+        stats_.max_queue_delay_us = std::max(stats_.max_queue_delay_us, delay);
+        total_queue_delay_us_ += delay;
+        if (!params_.send(packet.frame)) {
+            // 发送失败由上层处理连接, 剩下的块已经没有意义
+            clear();
+            return;
+        }
+    }
+    if (!queue_.empty()) {
+        schedule();
+    }
+}
+
+void Pacer::refill(int64_t now) {
+    const int64_t elapsed = std::max<int64_t>(0, now - last_refill_us_);
+    last_refill_us_ = now;
+    tokens_ = std::min(static_cast<double>(capacity()), tokens_ + elapsed * bytesPerUs());
+}
+
+void Pacer::schedule() {
+    if (timer_pending_) {
+        return;
+    }
+    // 刚好攒够下一块需要的令牌时再来
+    const double need = std::min(queue_.front().size, capacity()) - tokens_;
+    const int64_t delay_us = static_cast<int64_t>(std::ceil(need / bytesPerUs()));
+    timer_pending_ = true;
+    std::weak_ptr<bool> alive = alive_;
+    params_.post_delay(std::max<int64_t>(1, delay_us), [alive, this]() {
+        if (alive.lock() != nullptr) {
+            process();
+        }
+    });
+}
+
+double Pacer::bytesPerUs() const {
+    const uint32_t bitrate = std::max(params_.bitrate_bps, params_.min_bitrate_bps);
+    return bitrate * static_cast<double>(params_.pacing_factor) / 8 / 1'000'000;
+}
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,108 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include <ltlib/io/media_frame.h>
+
+namespace lt {
+
+namespace tp {
+
+// 令牌桶pacer. 视频帧切成小块后放进来, 按目标码率的pacing_factor倍匀速发出,
+// 避免一个几百KB的关键帧瞬间灌进socket, 把路由器/Wi-Fi的浅缓冲打爆.
+// 每块是一个媒体帧分片, 数据由MediaFrame::holder持有, 排队时不拷贝; 头在发出时才编码.
+// 不经过pacer的包(音频, 输入, 控制消息)自然就插在两块之间, 相当于优先发送.
+// 非线程安全, 所有调用和定时器回调都要在同一个线程.
+class Pacer {
+public:
+    struct Params {
+        uint32_t bitrate_bps = 8'000'000;
+        uint32_t min_bitrate_bps = 1'000'000;
+        float pacing_factor = 2.5f;
+        // 桶容量至少是多少微秒的数据量, 也不能小于一块的大小
+        int64_t burst_window_us = 2'000;
+        uint32_t max_chunk_size = 16 * 1024;
+        std::function<int64_t()> now_us;
+        std::function<void(int64_t /*delay_us*/, const std::function<void()>&)> post_delay;
+        std::function<bool(const ltlib::MediaFrame& frame)> send;
+    };
+    struct Stats {
+        uint64_t sent_packets = 0;
+        uint64_t sent_bytes = 0;
+        int64_t avg_queue_delay_us = 0;
+        int64_t max_queue_delay_us = 0;
+        uint32_t queued_bytes = 0;
+    };
+
+public:
+    static std::unique_ptr<Pacer> create(const Params& params);
+    // 按MediaHeader::kSize+payload_size计入码率
+    void enqueue(const ltlib::MediaFrame& frame);
+    void setBitrate(uint32_t bitrate_bps);
+    // 连接换了或者断了, 没发出去的都丢掉
+    void clear();
+    // 返回上次调用以来的统计
+    Stats takeStats();
+    uint32_t capacity() const;
+    int64_t oldestQueueDelayUs() const;
+
+private:
+    explicit Pacer(const Params& params);
+    void process();
+    void refill(int64_t now);
+    void schedule();
+    double bytesPerUs() const;
+
+private:
+    struct Packet {
+        ltlib::MediaFrame frame;
+        uint32_t size;
+        int64_t enqueue_time_us;
+    };
+    Params params_;
+    std::deque<Packet> queue_;
+    uint32_t queued_bytes_ = 0;
+    double tokens_ = 0;
+    int64_t last_refill_us_ = 0;
+    bool timer_pending_ = false;
+    Stats stats_;
+    int64_t total_queue_delay_us_ = 0;
+    // 定时器回调可能在pacer析构之后才到, 用它的弱引用判断
+    std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+};
+
+} // namespace tp
+
+} // namespace lt
@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "pacer.h"
+
+using lt::tp::Pacer;
+
+class PacerTest : public testing::Test {
+protected:
+    struct Sent {
+        int64_t time_us;
+        uint32_t size;
+    };
+
+    std::unique_ptr<Pacer> createPacer(uint32_t bitrate_bps, float factor = 2.5f) {
+        Pacer::Params params{};
+        params.bitrate_bps = bitrate_bps;
+        params.pacing_factor = factor;
+        params.max_chunk_size = kChunkSize;
+        params.now_us = [this]() { return now_us_; };
+        params.post_delay = [this](int64_t delay_us, const std::function<void()>& task) {
+            timers_.emplace(now_us_ + delay_us, task);
+        };
+        params.send = [this](const ltlib::MediaFrame& frame) {
+            sent_.push_back({now_us_, ltlib::MediaHeader::kSize + frame.payload_size});
+            return send_result_;
+        };
+        return Pacer::create(params);
+    }
+
+    // 连头一共size字节的分片
+    static ltlib::MediaFrame makeChunk(uint32_t size) {
+        ltlib::MediaFrame chunk{};
+        chunk.payload_size = size - ltlib::MediaHeader::kSize;
+        chunk.holder.reset(new uint8_t[chunk.payload_size], std::default_delete<uint8_t[]>());
+        chunk.payload = chunk.holder.get();
+        return chunk;
+    }
+
+    void enqueueFrame(Pacer& pacer, uint32_t frame_size) {
+        for (uint32_t offset = 0; offset < frame_size; offset += kChunkSize) {
+            pacer.enqueue(makeChunk(std::min(kChunkSize, frame_size - offset)));
+        }
+    }
+
+    // 推进时钟, 执行到期的定时器
+    void runUntil(int64_t time_us) {
+        while (!timers_.empty() && timers_.begin()->first <= time_us) {
+            auto iter = timers_.begin();
+            now_us_ = iter->first;
+            auto task = iter->second;
+            timers_.erase(iter);
+            task();
+        }
+        now_us_ = time_us;
+    }
+
+    static constexpr uint32_t kChunkSize = 16 * 1024;
+    int64_t now_us_ = 1'000'000;
+    std::multimap<int64_t, std::function<void()>> timers_;
+    std::vector<Sent> sent_;
+    bool send_result_ = true;
+};
+
+// 30Mbps的400KB关键帧: 第一下最多发出桶容量, 之后每块的间隔等于块大小/(码率*倍数)
+TEST_F(PacerTest, KeyframeIsPaced) {
+    constexpr uint32_t kBitrate = 30'000'000;
+    constexpr uint32_t kFrameSize = 400 * 1024;
+    auto pacer = createPacer(kBitrate);
+    ASSERT_NE(pacer, nullptr);
+    const double bytes_per_us = kBitrate * 2.5 / 8 / 1'000'000;
+    const int64_t start = now_us_;
+    enqueueFrame(*pacer, kFrameSize);
+
+    uint32_t burst = 0;
+    for (auto& sent : sent_) {
+        burst += sent.size;
+    }
+    EXPECT_LE(burst, pacer->capacity());
+    EXPECT_GE(burst, kChunkSize);
+
+    runUntil(start + 1'000'000);
+    uint32_t total = 0;
+    for (auto& sent : sent_) {
+        total += sent.size;
+    }
+    ASSERT_EQ(total, kFrameSize);
+    const size_t first_paced = burst / kChunkSize;
+    const double expected_gap = kChunkSize / bytes_per_us;
+    for (size_t i = first_paced + 1; i < sent_.size(); i++) {
+        int64_t gap = sent_[i].time_us - sent_[i - 1].time_us;
+        EXPECT_NEAR(static_cast<double>(gap), expected_gap, 2.0) << "chunk " << i;
+    }
+    // 整帧发完的时间
+    const double expected_duration = (kFrameSize - burst) / bytes_per_us;
+    EXPECT_NEAR(static_cast<double>(sent_.back().time_us - start), expected_duration,
+                expected_duration * 0.01);
+}
+
+TEST_F(PacerTest, IdlePacketSentImmediately) {
+    auto pacer = createPacer(8'000'000);
+    pacer->enqueue(makeChunk(1000));
+    ASSERT_EQ(sent_.size(), 1u);
+    EXPECT_EQ(sent_[0].time_us, now_us_);
+    EXPECT_TRUE(timers_.empty());
+    auto stats = pacer->takeStats();
+    EXPECT_EQ(stats.sent_packets, 1u);
+    EXPECT_EQ(stats.max_queue_delay_us, 0);
+}
+
+TEST_F(PacerTest, ReportsQueueDelay) {
+    constexpr uint32_t kBitrate = 10'000'000;
+    auto pacer = createPacer(kBitrate);
+    enqueueFrame(*pacer, 200 * 1024);
+    EXPECT_GT(pacer->oldestQueueDelayUs(), -1);
+    runUntil(now_us_ + 500);
+    EXPECT_EQ(pacer->oldestQueueDelayUs(), 500);
+    runUntil(now_us_ + 1'000'000);
+    auto stats = pacer->takeStats();
+    EXPECT_EQ(stats.sent_bytes, 200u * 1024);
+    EXPECT_EQ(stats.queued_bytes, 0u);
+    // 最后一块等的时间约等于整帧减去第一下突发的发送时间
+    const double bytes_per_us = kBitrate * 2.5 / 8 / 1'000'000;
+    EXPECT_NEAR(static_cast<double>(stats.max_queue_delay_us),
+                (200 * 1024 - pacer->capacity()) / bytes_per_us, 20.0);
+    EXPECT_GT(stats.avg_queue_delay_us, 0);
+    EXPECT_LT(stats.avg_queue_delay_us, stats.max_queue_delay_us);
+    EXPECT_EQ(pacer->takeStats().sent_packets, 0u);
+}
+
+TEST_F(PacerTest, BitrateChangesSpacing) {
+    auto pacer = createPacer(10'000'000);
+    enqueueFrame(*pacer, 1024 * 1024);
+    runUntil(now_us_ + 20'000);
+    size_t before = sent_.size();
+    int64_t slow_gap = sent_[before - 1].time_us - sent_[before - 2].time_us;
+    pacer->setBitrate(40'000'000);
+    runUntil(now_us_ + 20'000);
+    ASSERT_GT(sent_.size(), before + 2);
+    int64_t fast_gap = sent_.back().time_us - sent_[sent_.size() - 2].time_us;
+    EXPECT_NEAR(static_cast<double>(slow_gap) / fast_gap, 4.0, 0.1);
+}
+
+TEST_F(PacerTest, ClearAndSendFailure) {
+    auto pacer = createPacer(10'000'000);
+    enqueueFrame(*pacer, 400 * 1024);
+    size_t burst = sent_.size();
+    pacer->clear();
+    runUntil(now_us_ + 1'000'000);
+    EXPECT_EQ(sent_.size(), burst);
+    EXPECT_EQ(pacer->takeStats().queued_bytes, 0u);
+
+    // 发送失败后剩下的块直接丢掉
+    enqueueFrame(*pacer, 400 * 1024);
+    sent_.clear();
+    send_result_ = false;
+    runUntil(now_us_ + 1'000'000);
+    EXPECT_EQ(sent_.size(), 1u);
+    EXPECT_EQ(pacer->takeStats().queued_bytes, 0u);
+}
+
+TEST_F(PacerTest, TimerAfterDestroyed) {
+    auto pacer = createPacer(10'000'000);
+    enqueueFrame(*pacer, 400 * 1024);
+    size_t burst = sent_.size();
+    pacer.reset();
+    runUntil(now_us_ + 1'000'000);
+    EXPECT_EQ(sent_.size(), burst);
+}
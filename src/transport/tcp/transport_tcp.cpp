@@ -30,18 +30,76 @@
 
 #include <transport/transport_tcp.h>
 
+#include <random>
+
 #include <uv.h>
 
 #include <ltlib/logging.h>
+#include <ltlib/times.h>
 
 #include <ltproto/client2worker/audio_data.pb.h>
 #include <ltproto/client2worker/video_frame.pb.h>
 #include <ltproto/ltproto.h>
 
+#include "aead_cipher.h"
+#include "bandwidth_probe.h"
+#include "delay_feedback.h"
+#include "layer_dropper.h"
+#include "pacer.h"
+
 namespace {
 
 const char* kKeyConnect = "connect";
 const char* kKeyAddress = "address";
+const char* kKeyAead = "aead";
+const char* kKeyResume = "resume";
+// 新版本的ClientTCP在connect信令里带上的能力, 逗号分隔. 旧版本带的是空串, 只认protobuf的
+// VideoFrame/AudioData, 也不认识加密/续连/探测的信令
+const char* kCapMediaFrame = "media_frame";
+constexpr uint32_t kResumeTokenSize = 32;
+// 带resume token的连接最先发"LTRS"+token. 旧版本的客户端不认识resume信令, 什么都不带
+const std::string kResumePreambleMagic = "LTRS";
+// 开启pacing时视频分片的大小(含MediaHeader), 块之间可以插入音频和控制消息
+constexpr uint32_t kPacingChunkSize = 16 * 1024;
+constexpr uint32_t kMaxReassembledFrameSize = 32 * 1024 * 1024;
+constexpr int64_t kPacingRateWindowUs = 1'000'000;
+
+std::string generateResumeToken() {
+    static const char* kHex = "0123456789abcdef";
+    std::random_device rd;
+    std::string token;
+    for (uint32_t i = 0; i < kResumeTokenSize; i++) {
+        token.push_back(kHex[rd() & 0x0f]);
+    }
+    return token;
+}
+
+// 比较完所有字节再出结果, 耗时跟第一个不同的字节在哪里无关
+bool constantTimeEquals(const std::string& lhs, const std::string& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    uint8_t diff = 0;
+    for (size_t i = 0; i < lhs.size(); i++) {
+        diff |= static_cast<uint8_t>(lhs[i] ^ rhs[i]);
+    }
+    return diff == 0;
+}
+
+bool hasCapability(const std::string& capabilities, const std::string& capability) {
+    size_t begin = 0;
+    while (begin <= capabilities.size()) {
+        size_t end = capabilities.find(',', begin);
+        if (end == std::string::npos) {
+            end = capabilities.size();
+        }
+        if (capabilities.compare(begin, end - begin, capability) == 0) {
+            return true;
+        }
+        begin = end + 1;
+    }
+    return false;
+}
 
 } // namespace
 
@@ -82,7 +140,7 @@ bool ClientTCP::connect() {
         task_thread_->post(std::bind(&ClientTCP::connect, this));
         return true;
     }
-    params_.on_signaling_message(params_.user_data, kKeyConnect, "");
+    params_.on_signaling_message(params_.user_data, kKeyConnect, kCapMediaFrame);
     return true;
 }
 
@@ -125,11 +183,17 @@ bool ClientTCP::initTcpClient(const std::string& ip, uint16_t port) {
     params.host = ip;
     params.port = port;
     params.is_tls = false;
+    params.peer_is_ltlib_server = true;
+    params.cipher = cipher_;
+    if (!resume_token_.empty()) {
+        params.preamble = kResumePreambleMagic + resume_token_;
+    }
     params.on_connected = std::bind(&ClientTCP::onConnected, this);
     params.on_closed = std::bind(&ClientTCP::onDisconnected, this);
     params.on_reconnecting = std::bind(&ClientTCP::onReconnecting, this);
     params.on_message =
         std::bind(&ClientTCP::onMessage, this, std::placeholders::_1, std::placeholders::_2);
+    params.on_media = std::bind(&ClientTCP::onMedia, this, std::placeholders::_1);
     tcp_client_ = ltlib::Client::create(params);
     if (tcp_client_ == nullptr) {
         LOG(ERR) << "Init ClientTCP tcp client failed";
@@ -154,7 +218,14 @@ void ClientTCP::onConnected() {
         task_thread_->post(std::bind(&ClientTCP::onConnected, this));
         return;
     }
-    params_.on_connected(params_.user_data, LinkType::TCP);
+    if (resume_token_.empty() || !connected_once_) {
+        // 不等带宽探测, 探测结果到了服务端再改编码码率. 探测期间的音视频也算进送达码率里
+        connected_once_ = true;
+        params_.on_connected(params_.user_data, LinkType::TCP);
+        return;
+    }
+    // TCP连上了不代表会话还在(服务端可能已经超时或者重启), 等服务端确认收下了resume token
+    LOG(INFO) << "ClientTCP reconnected, waiting for resume ack";
 }
 
 void ClientTCP::onDisconnected() {
@@ -166,7 +237,40 @@ void ClientTCP::onDisconnected() {
 }
 
 void ClientTCP::onReconnecting() {
+    if (!isTaskThread()) {
+        task_thread_->post(std::bind(&ClientTCP::onReconnecting, this));
+        return;
+    }
     LOG(WARNING) << "ClientTCP reconnecting...";
+    if (resume_token_.empty() || reconnecting_) {
+        return;
+    }
+    reconnecting_ = true;
+    reconnecting_at_us_ = ltlib::steady_now_us();
+    // 断开前没收齐的分片不会再来了
+    fragments_.clear();
+    uint64_t generation = ++reconnect_generation_;
+    task_thread_->post_delay(ltlib::TimeDelta{resume_grace_ms_ * 1000LL},
+                             std::bind(&ClientTCP::onResumeTimeout, this, generation));
+}
+
+void ClientTCP::onResumeTimeout(uint64_t generation) {
+    if (!reconnecting_ || generation != reconnect_generation_) {
+        return;
+    }
+    LOG(WARNING) << "ClientTCP resume timeout";
+    reconnecting_ = false;
+    params_.on_disconnected(params_.user_data);
+}
+
+void ClientTCP::onResumeAck() {
+    if (!reconnecting_) {
+        return;
+    }
+    // 服务端还保留着会话, 对上层来说连接从来没断过
+    reconnecting_ = false;
+    LOG(INFO) << "ClientTCP resumed after "
+              << (ltlib::steady_now_us() - reconnecting_at_us_) / 1000 << "ms";
 }
 
 void ClientTCP::onMessage(uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg) {
@@ -229,6 +333,163 @@ void ClientTCP::onMessage(uint32_t type, std::shared_ptr<google::protobuf::Messa
     }
 }
 
+void ClientTCP::onMedia(const ltlib::MediaFrame& media) {
+    if (media.header.kind == ltlib::MediaHeader::Kind::Probe) {
+        // 到达时间要在网络线程里取, 绕到任务线程再取就不准了
+        onProbe(media);
+        return;
+    }
+    if (probe_receiver_ != nullptr && isNetworkThread()) {
+        probe_receiver_->onOtherMedia(ltlib::MediaHeader::kSize + media.payload_size);
+    }
+    if (media.header.kind == ltlib::MediaHeader::Kind::Resumed) {
+        task_thread_->post(std::bind(&ClientTCP::onResumeAck, this));
+        return;
+    }
+    if (media.header.kind == ltlib::MediaHeader::Kind::Video &&
+        media.header.send_timestamp_us != 0 && isNetworkThread()) {
+        onVideoPacket(media);
+    }
+    if (!isTaskThread()) {
+        // holder保证跨线程后payload依然有效
+        task_thread_->post(std::bind(&ClientTCP::onMedia, this, media));
+        return;
+    }
+    if (media.header.kind == ltlib::MediaHeader::Kind::Video) {
+        const bool fragmented = media.header.flags & ltlib::MediaHeader::kFlagFragment;
+        if (fragmented && !reassembleFragment(media)) {
+            return;
+        }
+        lt::VideoFrame video_frame{};
+        video_frame.is_keyframe = media.header.flags & ltlib::MediaHeader::kFlagKeyframe;
+        video_frame.ltframe_id = media.header.frame_id;
+        video_frame.data = media.payload;
+        video_frame.size = media.payload_size;
+        if (fragmented) {
+            video_frame.data = fragments_.data();
+            video_frame.size = static_cast<uint32_t>(fragments_.size());
+        }
+        video_frame.width = media.header.width;
+        video_frame.height = media.header.height;
+        video_frame.capture_timestamp_us = media.header.capture_timestamp_us;
+        video_frame.start_encode_timestamp_us = media.header.start_encode_timestamp_us;
+        video_frame.end_encode_timestamp_us = media.header.end_encode_timestamp_us;
+        params_.on_video(params_.user_data, video_frame);
+    }
+    else if (media.header.kind == ltlib::MediaHeader::Kind::Audio) {
+        lt::AudioData ad{};
+        ad.data = media.payload;
+        ad.size = media.payload_size;
+        params_.on_audio(params_.user_data, ad);
+    }
+    else {
+        // 更新的服务端才有的kind
+        LOG(DEBUG) << "Skipping unknown media kind " << static_cast<int>(media.header.kind);
+    }
+}
+
+void ClientTCP::onProbe(const ltlib::MediaFrame& media) {
+    const int64_t now = ltlib::steady_now_us();
+    auto msg = decodeProbeMessage(media.payload, media.payload_size);
+    if (!msg.has_value()) {
+        LOG(WARNING) << "ClientTCP received invalid probe message";
+        return;
+    }
+    ProbeMessage reply{};
+    switch (msg->type) {
+    case ProbeMessage::Type::Ping:
+        reply.type = ProbeMessage::Type::Pong;
+        reply.timestamp_us = msg->timestamp_us;
+        break;
+    case ProbeMessage::Type::Padding:
+    {
+        if (probe_receiver_ == nullptr) {
+            probe_receiver_ = std::make_unique<ProbeReceiver>();
+        }
+        auto bps = probe_receiver_->onPadding(
+            msg.value(), ltlib::MediaHeader::kSize + media.payload_size, now);
+        if (!bps.has_value()) {
+            return;
+        }
+        reply.type = ProbeMessage::Type::Report;
+        reply.cluster = msg->cluster;
+        reply.bitrate_kbps = bps.value() / 1000;
+        break;
+    }
+    case ProbeMessage::Type::Done:
+        probe_receiver_.reset();
+        task_thread_->post(std::bind(&ClientTCP::onProbeDone, this, msg->bitrate_kbps * 1000,
+                                     msg->rtt_us));
+        return;
+    default:
+        return;
+    }
+    uint32_t size = 0;
+    auto data = encodeProbeMessage(reply, 0, size);
+    tcp_client_->send(data, size);
+}
+
+// 发送端没填send_timestamp_us(为0)时不会走到这里
+void ClientTCP::onVideoPacket(const ltlib::MediaFrame& media) {
+    const int64_t now = ltlib::steady_now_us();
+    if (arrival_tracker_ == nullptr) {
+        arrival_tracker_ = std::make_unique<ArrivalTracker>(ArrivalTracker::Params{});
+    }
+    const ltlib::MediaHeader& header = media.header;
+    const bool frame_end = !(header.flags & ltlib::MediaHeader::kFlagFragment) ||
+                           header.fragment_offset + media.payload_size >= header.frame_size;
+    arrival_tracker_->onPacket(header.frame_id, header.send_timestamp_us, now,
+                               ltlib::MediaHeader::kSize + media.payload_size, frame_end);
+    auto feedback = arrival_tracker_->poll(now);
+    if (!feedback.has_value()) {
+        return;
+    }
+    uint32_t size = 0;
+    auto data = encodeDelayFeedback(feedback.value(), size);
+    tcp_client_->send(data, size);
+}
+
+void ClientTCP::onProbeDone(uint32_t bps, uint32_t rtt_us) {
+    if (bps == 0) {
+        LOG(WARNING) << "ClientTCP bandwidth probe got no result";
+    }
+    else {
+        LOG(INFO) << "ClientTCP bandwidth probe " << bps << "bps, rtt " << rtt_us << "us";
+    }
+}
+
+// TCP保证分片按顺序到达, 只需要拼到末尾. 收齐整帧时返回true
+bool ClientTCP::reassembleFragment(const ltlib::MediaFrame& media) {
+    const ltlib::MediaHeader& header = media.header;
+    if (header.fragment_offset == 0) {
+        if (header.frame_size > kMaxReassembledFrameSize) {
+            LOG(WARNING) << "ClientTCP received fragmented video frame too large("
+                         << header.frame_size << " bytes)";
+            fragments_.clear();
+            return false;
+        }
+        fragments_.clear();
+        fragments_.reserve(header.frame_size);
+        fragment_frame_id_ = header.frame_id;
+    }
+    else if (header.frame_id != fragment_frame_id_ || header.fragment_offset != fragments_.size()) {
+        if (!fragments_.empty()) {
+            LOG(WARNING) << "ClientTCP dropped incomplete video frame " << fragment_frame_id_;
+            fragments_.clear();
+        }
+        return false;
+    }
+    if (header.fragment_offset + media.payload_size > header.frame_size) {
+        LOG(WARNING) << "ClientTCP received invalid video fragment, offset "
+                     << header.fragment_offset << ", size " << media.payload_size
+                     << ", frame size " << header.frame_size;
+        fragments_.clear();
+        return false;
+    }
+    fragments_.insert(fragments_.end(), media.payload, media.payload + media.payload_size);
+    return fragments_.size() == header.frame_size;
+}
+
 void ClientTCP::netLoop(const std::function<void()>& i_am_alive) {
     LOG(INFO) << "ClientTCP enter net loop";
     ioloop_->run(i_am_alive);
@@ -243,6 +504,12 @@ void ClientTCP::onSignalingMessage2(const std::string& key, const std::string& v
     if (key == kKeyAddress) {
         handleSigAddress(value);
     }
+    else if (key == kKeyAead) {
+        handleSigAead(value);
+    }
+    else if (key == kKeyResume) {
+        handleSigResume(value);
+    }
     else {
         LOG(WARNING) << "Unknown signaling message " << key;
     }
@@ -263,6 +530,27 @@ void ClientTCP::handleSigAddress(const std::string& value) {
     initTcpClient(ip_str, port);
 }
 
+void ClientTCP::handleSigAead(const std::string& value) {
+    // 服务端在发地址之前先发密钥
+    cipher_ = AeadCipher::fromSignaling(value, /*is_server=*/false);
+    if (cipher_ == nullptr) {
+        LOG(ERR) << "ClientTCP parse aead key failed";
+        params_.on_failed(params_.user_data);
+    }
+}
+
+void ClientTCP::handleSigResume(const std::string& value) {
+    // "<grace_ms>:<token>", 同样在地址之前发过来
+    const auto pos = value.find(':');
+    if (pos == std::string::npos || value.size() - pos - 1 != kResumeTokenSize) {
+        LOG(ERR) << "ClientTCP received invalid resume token";
+        params_.on_failed(params_.user_data);
+        return;
+    }
+    resume_grace_ms_ = static_cast<uint32_t>(std::atoi(value.substr(0, pos).c_str()));
+    resume_token_ = value.substr(pos + 1);
+}
+
 void ClientTCP::invokeInternal(const std::function<void()>& task) {
     std::promise<void> promise;
     ioloop_->post([&promise, task]() {
@@ -298,10 +586,13 @@ ServerTCP::~ServerTCP() {
         std::lock_guard lock{mutex_};
         tcp_server_.reset();
         ioloop_.reset();
+        pacer_.reset();
+        probe_pacer_.reset();
     }
 }
 
 void ServerTCP::close() {
+    closed_ = true;
     tcp_server_->close(client_fd_);
 }
 
@@ -327,19 +618,79 @@ bool ServerTCP::sendAudio(const AudioData& audio_data) {
     if (client_fd_ == std::numeric_limits<uint32_t>::max()) {
         return false;
     }
-    auto msg = std::make_shared<ltproto::client2worker::AudioData>();
-    msg->set_data(audio_data.data, audio_data.size);
-    return tcp_server_->send(client_fd_, ltproto::type::kAudioData, msg);
+    if (!peer_media_frame_) {
+        auto msg = std::make_shared<ltproto::client2worker::AudioData>();
+        msg->set_data(audio_data.data, audio_data.size);
+        return tcp_server_->send(client_fd_, ltproto::type::kAudioData, msg);
+    }
+    ltlib::MediaFrame media{};
+    media.header.kind = ltlib::MediaHeader::Kind::Audio;
+    media.holder = copyPayload(reinterpret_cast<const uint8_t*>(audio_data.data), audio_data.size);
+    media.payload = media.holder.get();
+    media.payload_size = audio_data.size;
+    return tcp_server_->send(client_fd_, media);
 }
 
 bool ServerTCP::sendVideo(const VideoFrame& frame) {
+    return sendVideo(frame, 0);
+}
+
+bool ServerTCP::sendVideo(const VideoFrame& frame, uint8_t temporal_id) {
     if (!isNetworkThread()) {
-        std::function<bool()> task = std::bind(&ServerTCP::sendVideo, this, frame);
+        std::function<bool()> task = [this, frame, temporal_id]() {
+            return sendVideo(frame, temporal_id);
+        };
         return invoke(task);
     }
     if (client_fd_ == std::numeric_limits<uint32_t>::max()) {
         return false;
     }
+    if (!peer_media_frame_) {
+        return sendLegacyVideo(frame);
+    }
+    const int64_t queue_delay_us = pacer_ == nullptr ? 0 : pacer_->oldestQueueDelayUs();
+    if (!layer_dropper_->onFrame(temporal_id, frame.is_keyframe, frame.size, queue_delay_us,
+                                 delay_overusing_)) {
+        return true;
+    }
+    // 调用方的数据只在这次调用里有效, 拷贝一次到池子里的内存. 之后头和数据分开发, 分片也不再拷贝
+    ltlib::MediaFrame media{};
+    media.holder = copyPayload(frame.data, frame.size);
+    ltlib::MediaHeader& header = media.header;
+    header.kind = ltlib::MediaHeader::Kind::Video;
+    header.flags = frame.is_keyframe ? ltlib::MediaHeader::kFlagKeyframe : 0;
+    header.temporal_id = temporal_id;
+    header.frame_id = frame.ltframe_id;
+    header.width = frame.width;
+    header.height = frame.height;
+    header.capture_timestamp_us = frame.capture_timestamp_us;
+    header.start_encode_timestamp_us = frame.start_encode_timestamp_us;
+    header.end_encode_timestamp_us = frame.end_encode_timestamp_us;
+    media.payload = media.holder.get();
+    media.payload_size = frame.size;
+    if (pacer_ == nullptr) {
+        header.send_timestamp_us = ltlib::steady_now_us();
+        return tcp_server_->send(client_fd_, media);
+    }
+    updatePacingRate(frame.size);
+    constexpr uint32_t kMaxFragmentSize = kPacingChunkSize - ltlib::MediaHeader::kSize;
+    if (frame.size <= kMaxFragmentSize) {
+        pacer_->enqueue(media);
+        return true;
+    }
+    header.flags |= ltlib::MediaHeader::kFlagFragment;
+    header.frame_size = frame.size;
+    for (uint32_t offset = 0; offset < frame.size; offset += kMaxFragmentSize) {
+        header.fragment_offset = offset;
+        media.payload = media.holder.get() + offset;
+        media.payload_size = std::min(kMaxFragmentSize, frame.size - offset);
+        pacer_->enqueue(media);
+    }
+    return true;
+}
+
+// 旧版本的ClientTCP只认protobuf
+bool ServerTCP::sendLegacyVideo(const VideoFrame& frame) {
     auto video_frame = std::make_shared<ltproto::client2worker::VideoFrame>();
     video_frame->set_frame(frame.data, frame.size);
     video_frame->set_is_keyframe(frame.is_keyframe);
@@ -352,6 +703,15 @@ bool ServerTCP::sendVideo(const VideoFrame& frame) {
     return tcp_server_->send(client_fd_, ltproto::type::kVideoFrame, video_frame);
 }
 
+std::shared_ptr<uint8_t> ServerTCP::copyPayload(const uint8_t* data, uint32_t size) {
+    auto buffer = frame_pool_.getBytes(size);
+    if (size != 0) {
+        memcpy(buffer->data(), data, size);
+    }
+    // 别名构造, 引用计数还是buffer的, 最后一个分片发完buffer回到池子里
+    return std::shared_ptr<uint8_t>{buffer, buffer->data()};
+}
+
 void ServerTCP::onSignalingMessage(const char* _key, const char* _value) {
     std::string key = _key;
     std::string value = _value;
@@ -359,6 +719,9 @@ void ServerTCP::onSignalingMessage(const char* _key, const char* _value) {
 }
 
 bool ServerTCP::init() {
+    if (params_.resume_grace_ms != 0) {
+        resume_token_ = generateResumeToken();
+    }
     ioloop_ = ltlib::IOLoop::create();
     if (ioloop_ == nullptr) {
         LOG(ERR) << "Init ServerTCP IOLoop failed";
@@ -367,6 +730,10 @@ bool ServerTCP::init() {
     if (!initTcpServer()) {
         return false;
     }
+    if (params_.pacing_factor > 0 && !initPacer()) {
+        return false;
+    }
+    layer_dropper_ = std::make_unique<LayerDropper>(LayerDropper::Params{});
     net_thread_ = ltlib::BlockingThread::create(
         "lt_ServerTCP_net",
         [this](const std::function<void()>& i_am_alive) { netLoop(i_am_alive); });
@@ -378,15 +745,41 @@ bool ServerTCP::init() {
 }
 
 bool ServerTCP::initTcpServer() {
+    if (params_.enable_aead) {
+        AeadCipher::Key key;
+        if (!AeadCipher::generateKey(key)) {
+            return false;
+        }
+        auto algorithm = AeadCipher::preferredAlgorithm();
+        cipher_ = AeadCipher::create(algorithm, key, /*is_server=*/true);
+        if (cipher_ == nullptr) {
+            return false;
+        }
+        aead_signaling_ = AeadCipher::toSignaling(algorithm, key);
+        LOG(INFO) << "ServerTCP enable aead "
+                  << (algorithm == AeadCipher::Algorithm::AES_256_GCM ? "AES-256-GCM"
+                                                                      : "ChaCha20-Poly1305");
+    }
     ltlib::Server::Params params{};
     params.stype = ltlib::StreamType::TCP;
     params.ioloop = ioloop_.get();
     params.bind_ip = "0.0.0.0";
     params.bind_port = 0;
+    params.cipher = cipher_;
+    if (!resume_token_.empty()) {
+        // 不带token的连接只能当作新会话, 会话建立之后就只接受带着正确token的连接
+        params.preamble_size =
+            static_cast<uint32_t>(kResumePreambleMagic.size()) + kResumeTokenSize;
+        params.preamble_prefix = kResumePreambleMagic;
+        params.on_preamble = std::bind(&ServerTCP::onPreamble, this, std::placeholders::_1,
+                                       std::placeholders::_2);
+    }
     params.on_accepted = std::bind(&ServerTCP::onAccepted, this, std::placeholders::_1);
     params.on_closed = std::bind(&ServerTCP::onDisconnected, this, std::placeholders::_1);
     params.on_message = std::bind(&ServerTCP::onMessage, this, std::placeholders::_1,
                                   std::placeholders::_2, std::placeholders::_3);
+    params.on_media =
+        std::bind(&ServerTCP::onMedia, this, std::placeholders::_1, std::placeholders::_2);
     tcp_server_ = ltlib::Server::create(params);
     if (tcp_server_ == nullptr) {
         LOG(ERR) << "Init ServerTCP tcp server failed";
@@ -395,6 +788,151 @@ bool ServerTCP::initTcpServer() {
     return true;
 }
 
+bool ServerTCP::initPacer() {
+    Pacer::Params params{};
+    params.pacing_factor = params_.pacing_factor;
+    params.max_chunk_size = kPacingChunkSize;
+    params.now_us = []() { return ltlib::steady_now_us(); };
+    params.post_delay = [this](int64_t delay_us, const std::function<void()>& task) {
+        ioloop_->postDelay((delay_us + 999) / 1000, task);
+    };
+    params.send = [this](const ltlib::MediaFrame& frame) {
+        if (client_fd_ == std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        // 在队列里排过队, 真正发出去时才打发送时间
+        ltlib::MediaFrame media = frame;
+        media.header.send_timestamp_us = ltlib::steady_now_us();
+        return tcp_server_->send(client_fd_, media);
+    };
+    pacer_ = Pacer::create(params);
+    if (pacer_ == nullptr) {
+        LOG(ERR) << "Init ServerTCP pacer failed";
+        return false;
+    }
+    LOG(INFO) << "ServerTCP enable pacing, factor " << params_.pacing_factor;
+    return true;
+}
+
+// ServerTCP拿不到编码器的目标码率, 用最近一段时间实际送进来的视频数据量代替
+void ServerTCP::updatePacingRate(uint32_t frame_size) {
+    const int64_t now = ltlib::steady_now_us();
+    if (rate_window_start_us_ == 0) {
+        rate_window_start_us_ = now;
+    }
+    rate_window_bytes_ += frame_size;
+    const int64_t elapsed = now - rate_window_start_us_;
+    if (elapsed < kPacingRateWindowUs) {
+        return;
+    }
+    const auto bitrate = static_cast<uint32_t>(rate_window_bytes_ * 8 * 1'000'000 / elapsed);
+    pacer_->setBitrate(bitrate);
+    auto stats = pacer_->takeStats();
+    LOG(DEBUG) << "ServerTCP pacing bitrate " << bitrate << "bps, sent " << stats.sent_packets
+               << " packets, queue delay avg " << stats.avg_queue_delay_us << "us max "
+               << stats.max_queue_delay_us << "us, queued " << stats.queued_bytes << " bytes";
+    auto drop_stats = layer_dropper_->takeStats();
+    if (drop_stats.dropped_frames != 0) {
+        LOG(INFO) << "ServerTCP dropped " << drop_stats.dropped_frames
+                  << " enhancement layer frames(" << drop_stats.dropped_bytes << " bytes), sent "
+                  << drop_stats.sent_frames;
+    }
+    rate_window_start_us_ = now;
+    rate_window_bytes_ = 0;
+}
+
+void ServerTCP::clearPacer() {
+    if (pacer_ == nullptr) {
+        return;
+    }
+    ioloop_->post([this]() { pacer_->clear(); });
+}
+
+void ServerTCP::startProbe() {
+    const ProbeSender::Params probe_params{};
+    Pacer::Params params{};
+    // 探测包按目标码率原样发出, 不再乘系数
+    params.pacing_factor = 1.f;
+    params.min_bitrate_bps = probe_params.bitrates_bps.front();
+    params.max_chunk_size = probe_params.max_packet_size;
+    params.now_us = []() { return ltlib::steady_now_us(); };
+    params.post_delay = [this](int64_t delay_us, const std::function<void()>& task) {
+        ioloop_->postDelay((delay_us + 999) / 1000, task);
+    };
+    params.send = [this](const ltlib::MediaFrame& frame) {
+        if (client_fd_ == std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        return tcp_server_->send(client_fd_, frame);
+    };
+    probe_pacer_ = Pacer::create(params);
+    if (probe_pacer_ == nullptr || client_fd_ == std::numeric_limits<uint32_t>::max()) {
+        probe_pacer_.reset();
+        return;
+    }
+    prober_ = std::make_unique<ProbeSender>(probe_params);
+    const uint64_t generation = ++probe_generation_;
+    ioloop_->postDelay(params_.probe_timeout_ms,
+                       std::bind(&ServerTCP::finishProbe, this, generation));
+    // 先量RTT, 收到Pong再开始发填充包
+    ProbeMessage ping{};
+    ping.type = ProbeMessage::Type::Ping;
+    ping.timestamp_us = ltlib::steady_now_us();
+    uint32_t size = 0;
+    auto data = encodeProbeMessage(ping, 0, size);
+    tcp_server_->send(client_fd_, data, size);
+}
+
+void ServerTCP::sendProbeCluster() {
+    auto cluster = prober_->nextCluster();
+    if (!cluster.has_value()) {
+        return;
+    }
+    probe_pacer_->setBitrate(cluster->bitrate_bps);
+    ProbeMessage msg{};
+    msg.type = ProbeMessage::Type::Padding;
+    msg.cluster = cluster->id;
+    msg.count = cluster->packet_count;
+    msg.bitrate_kbps = cluster->bitrate_bps / 1000;
+    for (uint16_t seq = 0; seq < cluster->packet_count; seq++) {
+        msg.seq = seq;
+        uint32_t size = 0;
+        auto data = encodeProbeMessage(msg, cluster->packet_size, size);
+        auto media = ltlib::decode_media_frame(data.get(), size);
+        media->holder = data;
+        probe_pacer_->enqueue(media.value());
+    }
+}
+
+// 正常探完, 或者超时. 超时的话用已经探完的那几组的结果
+void ServerTCP::finishProbe(uint64_t generation) {
+    if (prober_ == nullptr || generation != probe_generation_) {
+        return;
+    }
+    const uint32_t bps = prober_->estimatedBps();
+    const uint32_t rtt_us = prober_->rttUs();
+    abortProbe();
+    LOG(INFO) << "ServerTCP bandwidth probe " << bps << "bps, rtt " << rtt_us << "us";
+    if (client_fd_ != std::numeric_limits<uint32_t>::max()) {
+        ProbeMessage done{};
+        done.type = ProbeMessage::Type::Done;
+        done.bitrate_kbps = bps / 1000;
+        done.rtt_us = rtt_us;
+        uint32_t size = 0;
+        auto data = encodeProbeMessage(done, 0, size);
+        tcp_server_->send(client_fd_, data, size);
+    }
+    if (bps != 0 && params_.on_bandwidth_probe != nullptr) {
+        params_.on_bandwidth_probe(params_.user_data, bps, rtt_us);
+    }
+}
+
+void ServerTCP::abortProbe() {
+    // 还在pacer里没发出去的填充包一起丢掉
+    probe_pacer_.reset();
+    prober_.reset();
+}
+
 bool ServerTCP::isNetworkThread() {
     return net_thread_->is_current_thread();
 }
@@ -408,32 +946,122 @@ void ServerTCP::onAccepted(uint32_t fd) {
         task_thread_->post(std::bind(&ServerTCP::onAccepted, this, fd));
         return;
     }
+    if (!resume_token_.empty() && accepted_once_) {
+        onResumed(fd);
+        return;
+    }
     if (client_fd_ != std::numeric_limits<uint32_t>::max()) {
         LOG(ERR) << "New ClientTCP(" << fd << ") connected to the ServerTCP, but another ClientTCP("
                  << fd << ") already being serve";
-        tcp_server_->close(fd);
+        ioloop_->post([this, fd]() { tcp_server_->close(fd); });
         return;
     }
+    const bool first_accept = !accepted_once_;
     client_fd_ = fd;
+    accepted_once_ = true;
     LOG(INFO) << "ServerTCP accpeted ClientTCP(" << fd << ")";
+    if (first_accept && params_.probe_timeout_ms != 0 && peer_media_frame_) {
+        ioloop_->post(std::bind(&ServerTCP::startProbe, this));
+    }
     params_.on_accepted(params_.user_data, LinkType::TCP);
 }
 
+void ServerTCP::onResumed(uint32_t fd) {
+    // ltlib::Server只能在网络线程里用, 加密的计数器也不能跟视频的发送抢
+    if (session_expired_ || closed_) {
+        LOG(WARNING) << "ClientTCP(" << fd << ") tries to resume an expired session";
+        ioloop_->post([this, fd]() { tcp_server_->close(fd); });
+        return;
+    }
+    const uint32_t stale_fd = client_fd_;
+    if (stale_fd != std::numeric_limits<uint32_t>::max()) {
+        // 旧连接还没发现自己已经断了(比如切换了Wi-Fi), 以带着token的新连接为准
+        LOG(INFO) << "ClientTCP(" << fd << ") replaces stale ClientTCP(" << stale_fd << ")";
+        ioloop_->post([this, stale_fd]() { tcp_server_->close(stale_fd); });
+    }
+    else {
+        LOG(INFO) << "ClientTCP(" << fd << ") resumed after "
+                  << (ltlib::steady_now_us() - disconnected_at_us_) / 1000 << "ms";
+    }
+    client_fd_ = fd;
+    resuming_ = false;
+    // 客户端收到这个确认才认为会话续上了
+    ioloop_->post([this, fd]() {
+        ltlib::MediaHeader header{};
+        header.kind = ltlib::MediaHeader::Kind::Resumed;
+        uint32_t size = 0;
+        auto data = ltlib::encode_media_frame(header, nullptr, 0, size);
+        tcp_server_->send(fd, data, size);
+    });
+    // 旧连接上没发完的分片接不上了
+    clearPacer();
+    // 断开期间的帧都丢了, 从关键帧开始续上
+    if (params_.on_keyframe_request != nullptr) {
+        params_.on_keyframe_request(params_.user_data);
+    }
+}
+
 void ServerTCP::onDisconnected(uint32_t fd) {
     if (!isTaskThread()) {
         task_thread_->post(std::bind(&ServerTCP::onDisconnected, this, fd));
         return;
     }
     if (client_fd_ != fd) {
-        LOG(FATAL) << "ClientTCP(" << fd << ") disconnected, but we are serving ClientTCP("
-                   << client_fd_ << ")";
+        if (resume_token_.empty()) {
+            LOG(FATAL) << "ClientTCP(" << fd << ") disconnected, but we are serving ClientTCP("
+                       << client_fd_.load() << ")";
+        }
+        // 被新连接顶替掉的旧连接
         return;
     }
     client_fd_ = std::numeric_limits<uint32_t>::max();
+    clearPacer();
+    if (params_.probe_timeout_ms != 0) {
+        ioloop_->post(std::bind(&ServerTCP::abortProbe, this));
+    }
     LOGF(INFO, "ClientTCP(%d) disconnected from pipe server", fd);
+    if (resume_token_.empty() || closed_ || !resumable_) {
+        params_.on_disconnected(params_.user_data);
+        return;
+    }
+    resuming_ = true;
+    disconnected_at_us_ = ltlib::steady_now_us();
+    uint64_t generation = ++disconnect_generation_;
+    task_thread_->post_delay(ltlib::TimeDelta{params_.resume_grace_ms * 1000LL},
+                             std::bind(&ServerTCP::onResumeTimeout, this, generation));
+}
+
+void ServerTCP::onResumeTimeout(uint64_t generation) {
+    if (!resuming_ || generation != disconnect_generation_) {
+        return;
+    }
+    LOG(WARNING) << "ServerTCP resume timeout";
+    resuming_ = false;
+    session_expired_ = true;
     params_.on_disconnected(params_.user_data);
 }
 
+bool ServerTCP::onPreamble(uint32_t fd, const std::string& preamble) {
+    // 跑在网络线程, resume_token_初始化后不再修改
+    if (preamble.empty()) {
+        // 旧版本的客户端, 只能当作新会话, 断开之后也续不上
+        if (session_started_) {
+            LOG(WARNING) << "ClientTCP(" << fd << ") without resume token rejected";
+            return false;
+        }
+        LOG(INFO) << "ClientTCP(" << fd << ") doesn't support resume";
+        session_started_ = true;
+        resumable_ = false;
+        return true;
+    }
+    if (!constantTimeEquals(preamble.substr(kResumePreambleMagic.size()), resume_token_)) {
+        LOG(WARNING) << "ClientTCP(" << fd << ") sent wrong resume token";
+        return false;
+    }
+    session_started_ = true;
+    return true;
+}
+
 void ServerTCP::onMessage(uint32_t fd, uint32_t type,
                           std::shared_ptr<google::protobuf::MessageLite> msg) {
     if (!isTaskThread()) {
@@ -441,7 +1069,9 @@ void ServerTCP::onMessage(uint32_t fd, uint32_t type,
         return;
     }
     if (fd != client_fd_) {
-        LOG(FATAL) << "fd != client_fd_";
+        if (resume_token_.empty()) {
+            LOG(FATAL) << "fd != client_fd_";
+        }
         return;
     }
     // 写的时候偷懒，让运行的时候多绕一圈
@@ -459,6 +1089,66 @@ void ServerTCP::onMessage(uint32_t fd, uint32_t type,
     params_.on_data(params_.user_data, data.data(), static_cast<uint32_t>(data.size()), true);
 }
 
+void ServerTCP::onMedia(uint32_t fd, const ltlib::MediaFrame& media) {
+    // 跑在网络线程. 客户端只会发探测消息和时延反馈过来
+    if (fd != client_fd_) {
+        return;
+    }
+    if (media.header.kind == ltlib::MediaHeader::Kind::Feedback) {
+        onDelayFeedback(media);
+        return;
+    }
+    if (media.header.kind != ltlib::MediaHeader::Kind::Probe || prober_ == nullptr) {
+        return;
+    }
+    auto msg = decodeProbeMessage(media.payload, media.payload_size);
+    if (!msg.has_value()) {
+        LOG(WARNING) << "ServerTCP received invalid probe message";
+        return;
+    }
+    switch (msg->type) {
+    case ProbeMessage::Type::Pong:
+        prober_->onPong(msg->timestamp_us, ltlib::steady_now_us());
+        sendProbeCluster();
+        break;
+    case ProbeMessage::Type::Report:
+        prober_->onReport(msg->cluster, msg->bitrate_kbps * 1000);
+        if (prober_->finished()) {
+            finishProbe(probe_generation_);
+        }
+        else {
+            sendProbeCluster();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ServerTCP::onDelayFeedback(const ltlib::MediaFrame& media) {
+    auto feedback = decodeDelayFeedback(media.payload, media.payload_size);
+    if (!feedback.has_value()) {
+        LOG(WARNING) << "ServerTCP received invalid delay feedback";
+        return;
+    }
+    const bool overusing = feedback->usage == DelayFeedback::Usage::Overusing;
+    const uint32_t queue_delay_us = static_cast<uint32_t>(std::max(feedback->queue_delay_us, 0));
+    if (overusing != delay_overusing_) {
+        delay_overusing_ = overusing;
+        LOG(DEBUG) << "ServerTCP delay " << (overusing ? "overusing" : "back to normal")
+                   << ", queue delay " << queue_delay_us << "us, trend "
+                   << feedback->trend_x1000 / 1000.0 << "ms, jitter " << feedback->jitter_us
+                   << "us";
+    }
+    if (params_.on_delay_feedback == nullptr || feedback->interval_us == 0) {
+        return;
+    }
+    const auto recv_bps =
+        static_cast<uint32_t>(uint64_t{feedback->bytes} * 8 * 1'000'000 / feedback->interval_us);
+    params_.on_delay_feedback(params_.user_data, recv_bps, queue_delay_us, feedback->jitter_us,
+                              overusing);
+}
+
 void ServerTCP::netLoop(const std::function<void()>& i_am_alive) {
     LOG(INFO) << "ServerTCP enter net loop";
     ioloop_->run(i_am_alive);
@@ -471,14 +1161,35 @@ void ServerTCP::onSignalingMessage2(const std::string& key, const std::string& v
         return;
     }
     if (key == kKeyConnect) {
-        handleSigConnect();
+        handleSigConnect(value);
     }
     else {
         LOG(WARNING) << "Unknown signaling message " << key;
     }
 }
 
-void ServerTCP::handleSigConnect() {
+void ServerTCP::handleSigConnect(const std::string& capabilities) {
+    peer_media_frame_ = hasCapability(capabilities, kCapMediaFrame);
+    if (!peer_media_frame_) {
+        // 旧版本的ClientTCP: 音视频退回protobuf, 不续连也不探测
+        LOG(INFO) << "ClientTCP doesn't support media frame, fallback to protobuf";
+        if (cipher_ != nullptr) {
+            LOG(ERR) << "ClientTCP doesn't support aead, disable tcp_enable_aead for it";
+            params_.on_failed(params_.user_data);
+            return;
+        }
+        if (!gatherIP()) {
+            params_.on_failed(params_.user_data);
+        }
+        return;
+    }
+    if (!aead_signaling_.empty()) {
+        params_.on_signaling_message(params_.user_data, kKeyAead, aead_signaling_.c_str());
+    }
+    if (!resume_token_.empty()) {
+        std::string value = std::to_string(params_.resume_grace_ms) + ":" + resume_token_;
+        params_.on_signaling_message(params_.user_data, kKeyResume, value.c_str());
+    }
     if (!gatherIP()) {
         params_.on_failed(params_.user_data);
     }
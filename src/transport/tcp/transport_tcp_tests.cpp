@@ -0,0 +1,677 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <uv.h>
+
+#include <ltlib/io/client.h>
+#include <ltlib/io/ioloop.h>
+#include <ltlib/threads.h>
+#include <ltproto/client2worker/audio_data.pb.h>
+#include <ltproto/ltproto.h>
+#include <transport/transport_tcp.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 插在ClientTCP与ServerTCP之间的TCP代理, kill()模拟网络闪断: 两端的socket同时被关掉.
+// setLink()之后模拟一条慢链路: 两个方向都加上单向时延, 服务端到客户端方向限速.
+// blackhole()之后新连接只在代理这里接下, 不再连服务端, 模拟连上了一个不认识这个会话的对端
+class TcpProxy {
+public:
+    void setLink(uint32_t downstream_bps, int64_t one_way_delay_ms) {
+        downstream_bps_ = downstream_bps;
+        delay_us_ = one_way_delay_ms * 1000;
+    }
+
+    bool start(uint16_t upstream_port) {
+        upstream_port_ = upstream_port;
+        uv_loop_init(&loop_);
+        uv_tcp_init(&loop_, &listener_);
+        listener_.data = this;
+        sockaddr_in addr;
+        uv_ip4_addr("127.0.0.1", 0, &addr);
+        if (uv_tcp_bind(&listener_, reinterpret_cast<const sockaddr*>(&addr), 0) != 0 ||
+            uv_listen(reinterpret_cast<uv_stream_t*>(&listener_), 8, &TcpProxy::onAccept) != 0) {
+            return false;
+        }
+        sockaddr_storage bound;
+        int len = sizeof(bound);
+        uv_tcp_getsockname(&listener_, reinterpret_cast<sockaddr*>(&bound), &len);
+        port_ = ntohs(reinterpret_cast<sockaddr_in*>(&bound)->sin_port);
+        uv_async_init(&loop_, &kill_async_, &TcpProxy::onKill);
+        kill_async_.data = this;
+        uv_async_init(&loop_, &stop_async_, &TcpProxy::onStop);
+        stop_async_.data = this;
+        uv_timer_init(&loop_, &link_timer_);
+        link_timer_.data = this;
+        if (downstream_bps_ != 0 || delay_us_ != 0) {
+            uv_timer_start(&link_timer_, &TcpProxy::onLinkTimer, 1, 1);
+        }
+        thread_ = std::thread([this]() { uv_run(&loop_, UV_RUN_DEFAULT); });
+        return true;
+    }
+
+    void stop() {
+        if (thread_.joinable()) {
+            uv_async_send(&stop_async_);
+            thread_.join();
+            uv_loop_close(&loop_);
+        }
+    }
+
+    void kill() { uv_async_send(&kill_async_); }
+    void blackhole() { blackhole_ = true; }
+    uint16_t port() const { return port_; }
+    int connections() const { return connections_; }
+
+private:
+    struct Chunk {
+        int64_t release_us;
+        std::vector<char> data;
+    };
+
+    struct Pipe {
+        TcpProxy* proxy;
+        uv_tcp_t* downstream;
+        uv_tcp_t* upstream;
+        bool closed = false;
+        // 在慢链路上还没送到的数据
+        std::deque<Chunk> to_downstream;
+        std::deque<Chunk> to_upstream;
+        int64_t link_free_us = 0;
+    };
+
+    static int64_t nowUs() { return static_cast<int64_t>(uv_hrtime() / 1000); }
+
+    static void onAccept(uv_stream_t* listener, int status) {
+        auto that = reinterpret_cast<TcpProxy*>(listener->data);
+        if (status != 0) {
+            return;
+        }
+        if (that->blackhole_) {
+            auto client = new uv_tcp_t;
+            uv_tcp_init(&that->loop_, client);
+            uv_accept(listener, reinterpret_cast<uv_stream_t*>(client));
+            that->blackholed_.push_back(client);
+            return;
+        }
+        that->connections_++;
+        auto pipe = new Pipe{that, new uv_tcp_t, new uv_tcp_t};
+        uv_tcp_init(&that->loop_, pipe->downstream);
+        uv_tcp_init(&that->loop_, pipe->upstream);
+        pipe->downstream->data = pipe;
+        pipe->upstream->data = pipe;
+        uv_accept(listener, reinterpret_cast<uv_stream_t*>(pipe->downstream));
+        that->pipes_.insert(pipe);
+        sockaddr_in addr;
+        uv_ip4_addr("127.0.0.1", that->upstream_port_, &addr);
+        auto req = new uv_connect_t;
+        req->data = pipe;
+        uv_tcp_connect(req, pipe->upstream, reinterpret_cast<const sockaddr*>(&addr),
+                       &TcpProxy::onUpstreamConnected);
+    }
+
+    static void onUpstreamConnected(uv_connect_t* req, int status) {
+        auto pipe = reinterpret_cast<Pipe*>(req->data);
+        delete req;
+        if (status != 0 || pipe->closed) {
+            closePipe(pipe);
+            return;
+        }
+        uv_read_start(reinterpret_cast<uv_stream_t*>(pipe->downstream), &TcpProxy::onAlloc,
+                      &TcpProxy::onRead);
+        uv_read_start(reinterpret_cast<uv_stream_t*>(pipe->upstream), &TcpProxy::onAlloc,
+                      &TcpProxy::onRead);
+    }
+
+    static void onAlloc(uv_handle_t*, size_t size, uv_buf_t* buf) {
+        buf->base = new char[size];
+        buf->len = static_cast<decltype(buf->len)>(size);
+    }
+
+    static void onRead(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+        auto pipe = reinterpret_cast<Pipe*>(stream->data);
+        if (nread < 0) {
+            delete[] buf->base;
+            closePipe(pipe);
+            return;
+        }
+        if (nread == 0) {
+            delete[] buf->base;
+            return;
+        }
+        auto peer = stream == reinterpret_cast<uv_stream_t*>(pipe->downstream) ? pipe->upstream
+                                                                                  : pipe->downstream;
+        auto that = pipe->proxy;
+        if (that->downstream_bps_ != 0 || that->delay_us_ != 0) {
+            that->enqueue(pipe, peer == pipe->downstream, buf->base, static_cast<size_t>(nread));
+            delete[] buf->base;
+            return;
+        }
+        write(peer, buf->base, static_cast<size_t>(nread));
+    }
+
+    // 接管data
+    static void write(uv_tcp_t* peer, char* data, size_t size) {
+        auto req = new uv_write_t;
+        req->data = data;
+        uv_buf_t out = uv_buf_init(data, static_cast<unsigned int>(size));
+        if (uv_write(req, reinterpret_cast<uv_stream_t*>(peer), &out, 1,
+                     [](uv_write_t* req, int) {
+                         delete[] reinterpret_cast<char*>(req->data);
+                         delete req;
+                     }) != 0) {
+            delete[] data;
+            delete req;
+        }
+    }
+
+    // 切成以太网包大小再排队, 限速才不会一次放出一大块
+    void enqueue(Pipe* pipe, bool to_downstream, const char* data, size_t size) {
+        constexpr size_t kMtu = 1500;
+        const int64_t now = nowUs();
+        for (size_t offset = 0; offset < size; offset += kMtu) {
+            const size_t len = std::min(kMtu, size - offset);
+            Chunk chunk{now + delay_us_, std::vector<char>(data + offset, data + offset + len)};
+            if (to_downstream && downstream_bps_ != 0) {
+                pipe->link_free_us = std::max(pipe->link_free_us, now) +
+                                     static_cast<int64_t>(len) * 8 * 1'000'000 / downstream_bps_;
+                chunk.release_us = pipe->link_free_us + delay_us_;
+            }
+            (to_downstream ? pipe->to_downstream : pipe->to_upstream).push_back(std::move(chunk));
+        }
+    }
+
+    static void onLinkTimer(uv_timer_t* handle) {
+        auto that = reinterpret_cast<TcpProxy*>(handle->data);
+        const int64_t now = nowUs();
+        auto flush = [now](std::deque<Chunk>& queue, uv_tcp_t* peer) {
+            while (!queue.empty() && queue.front().release_us <= now) {
+                auto& chunk = queue.front();
+                char* data = new char[chunk.data.size()];
+                memcpy(data, chunk.data.data(), chunk.data.size());
+                write(peer, data, chunk.data.size());
+                queue.pop_front();
+            }
+        };
+        for (auto pipe : that->pipes_) {
+            flush(pipe->to_downstream, pipe->downstream);
+            flush(pipe->to_upstream, pipe->upstream);
+        }
+    }
+
+    static void closePipe(Pipe* pipe) {
+        if (pipe->closed) {
+            return;
+        }
+        pipe->closed = true;
+        pipe->proxy->pipes_.erase(pipe);
+        auto close_cb = [](uv_handle_t* handle) { delete reinterpret_cast<uv_tcp_t*>(handle); };
+        // 用RST关掉, 跟网络闪断时对端看到的一样
+        uv_tcp_close_reset(pipe->downstream, close_cb);
+        uv_tcp_close_reset(pipe->upstream, close_cb);
+        delete pipe;
+    }
+
+    static void onKill(uv_async_t* handle) {
+        auto that = reinterpret_cast<TcpProxy*>(handle->data);
+        auto pipes = that->pipes_;
+        for (auto pipe : pipes) {
+            closePipe(pipe);
+        }
+    }
+
+    static void onStop(uv_async_t* handle) {
+        auto that = reinterpret_cast<TcpProxy*>(handle->data);
+        onKill(handle);
+        for (auto client : that->blackholed_) {
+            uv_close(reinterpret_cast<uv_handle_t*>(client),
+                     [](uv_handle_t* handle) { delete reinterpret_cast<uv_tcp_t*>(handle); });
+        }
+        that->blackholed_.clear();
+        uv_close(reinterpret_cast<uv_handle_t*>(&that->listener_), nullptr);
+        uv_close(reinterpret_cast<uv_handle_t*>(&that->kill_async_), nullptr);
+        uv_close(reinterpret_cast<uv_handle_t*>(&that->stop_async_), nullptr);
+        uv_close(reinterpret_cast<uv_handle_t*>(&that->link_timer_), nullptr);
+    }
+
+private:
+    uv_loop_t loop_;
+    uv_tcp_t listener_;
+    uv_async_t kill_async_;
+    uv_async_t stop_async_;
+    uv_timer_t link_timer_;
+    std::thread thread_;
+    std::set<Pipe*> pipes_;
+    std::atomic<bool> blackhole_{false};
+    std::atomic<int> connections_{0};
+    std::vector<uv_tcp_t*> blackholed_;
+    uint16_t upstream_port_ = 0;
+    uint16_t port_ = 0;
+    uint32_t downstream_bps_ = 0;
+    int64_t delay_us_ = 0;
+};
+
+} // namespace
+
+class TransportTCPTest : public testing::Test {
+protected:
+    // 传输层的线程都要向ThreadWatcher注册
+    static void SetUpTestSuite() { ltlib::ThreadWatcher::init(std::this_thread::get_id()); }
+    static void TearDownTestSuite() { ltlib::ThreadWatcher::uninit(); }
+
+    void SetUp() override { createTransport(0); }
+
+    void createTransport(uint32_t probe_timeout_ms) {
+        lt::tp::ServerTCP::Params sparams{};
+        sparams.user_data = this;
+        sparams.on_data = [](void*, const uint8_t*, uint32_t, bool) {};
+        sparams.on_accepted = [](void* user_data, lt::LinkType) {
+            static_cast<TransportTCPTest*>(user_data)->accepted_++;
+        };
+        sparams.on_failed = [](void* user_data) {
+            static_cast<TransportTCPTest*>(user_data)->failed_ = true;
+        };
+        sparams.on_disconnected = [](void* user_data) {
+            static_cast<TransportTCPTest*>(user_data)->server_disconnected_++;
+        };
+        sparams.on_signaling_message = &TransportTCPTest::onServerSignaling;
+        sparams.on_keyframe_request = [](void* user_data) {
+            static_cast<TransportTCPTest*>(user_data)->keyframe_requested_ = true;
+        };
+        sparams.enable_aead = true;
+        sparams.resume_grace_ms = 3000;
+        sparams.probe_timeout_ms = probe_timeout_ms;
+        sparams.on_bandwidth_probe = [](void* user_data, uint32_t bps, uint32_t rtt_us) {
+            auto that = static_cast<TransportTCPTest*>(user_data);
+            that->probe_rtt_us_ = rtt_us;
+            that->probe_bps_ = bps;
+        };
+        server_ = lt::tp::ServerTCP::create(sparams);
+        ASSERT_NE(server_, nullptr);
+
+        lt::tp::ClientTCP::Params cparams{};
+        cparams.user_data = this;
+        cparams.on_data = [](void*, const uint8_t*, uint32_t, bool) {};
+        cparams.on_video = &TransportTCPTest::onVideo;
+        cparams.on_audio = [](void*, const lt::AudioData&) {};
+        cparams.on_connected = [](void* user_data, lt::LinkType) {
+            static_cast<TransportTCPTest*>(user_data)->connected_++;
+        };
+        cparams.on_failed = [](void* user_data) {
+            static_cast<TransportTCPTest*>(user_data)->failed_ = true;
+        };
+        cparams.on_disconnected = [](void* user_data) {
+            static_cast<TransportTCPTest*>(user_data)->client_disconnected_++;
+        };
+        cparams.on_signaling_message = [](void* user_data, const char* key, const char* value) {
+            static_cast<TransportTCPTest*>(user_data)->server_->onSignalingMessage(key, value);
+        };
+        client_ = lt::tp::ClientTCP::create(cparams);
+        ASSERT_NE(client_, nullptr);
+    }
+
+    void TearDown() override {
+        stop_sending_ = true;
+        if (sender_.joinable()) {
+            sender_.join();
+        }
+        client_.reset();
+        server_.reset();
+        proxy_.stop();
+    }
+
+    // 把ServerTCP发出的地址换成代理的地址
+    static void onServerSignaling(void* user_data, const char* _key, const char* _value) {
+        auto that = static_cast<TransportTCPTest*>(user_data);
+        std::string key = _key;
+        std::string value = _value;
+        if (key == "address") {
+            auto port = static_cast<uint16_t>(std::atoi(value.substr(value.find(':') + 1).c_str()));
+            if (!that->proxy_.start(port)) {
+                that->failed_ = true;
+                return;
+            }
+            value = "127.0.0.1:" + std::to_string(that->proxy_.port());
+        }
+        that->client_->onSignalingMessage(key.c_str(), value.c_str());
+    }
+
+    static void onVideo(void* user_data, const lt::VideoFrame& frame) {
+        auto that = static_cast<TransportTCPTest*>(user_data);
+        std::lock_guard lock{that->mutex_};
+        that->frames_.push_back({Clock::now(), frame.is_keyframe});
+        that->cv_.notify_all();
+    }
+
+    void startSending(std::chrono::milliseconds interval = std::chrono::milliseconds{5}) {
+        sender_ = std::thread([this, interval]() {
+            std::vector<uint8_t> payload(20 * 1024, 0x5A);
+            int64_t frame_id = 0;
+            while (!stop_sending_) {
+                lt::VideoFrame frame{};
+                frame.is_keyframe = frame_id == 0 || keyframe_requested_.exchange(false);
+                frame.ltframe_id = frame_id++;
+                frame.data = payload.data();
+                frame.size = static_cast<uint32_t>(payload.size());
+                frame.width = 1920;
+                frame.height = 1080;
+                server_->sendVideo(frame);
+                std::this_thread::sleep_for(interval);
+            }
+        });
+    }
+
+    // 等待since之后收到满足条件的第一帧, 返回耗时
+    std::optional<Clock::duration> waitFrameAfter(Clock::time_point since, bool keyframe) {
+        std::unique_lock lock{mutex_};
+        std::optional<Clock::duration> result;
+        cv_.wait_for(lock, std::chrono::seconds{5}, [&]() {
+            for (auto& f : frames_) {
+                if (f.time > since && (!keyframe || f.is_keyframe)) {
+                    result = f.time - since;
+                    return true;
+                }
+            }
+            return false;
+        });
+        return result;
+    }
+
+    struct ReceivedFrame {
+        Clock::time_point time;
+        bool is_keyframe;
+    };
+
+    std::unique_ptr<lt::tp::ServerTCP> server_;
+    std::unique_ptr<lt::tp::ClientTCP> client_;
+    TcpProxy proxy_;
+    std::thread sender_;
+    std::atomic<bool> stop_sending_{false};
+    std::atomic<bool> keyframe_requested_{false};
+    std::atomic<bool> failed_{false};
+    std::atomic<int> accepted_{0};
+    std::atomic<int> connected_{0};
+    std::atomic<int> server_disconnected_{0};
+    std::atomic<int> client_disconnected_{0};
+    std::atomic<uint32_t> probe_bps_{0};
+    std::atomic<uint32_t> probe_rtt_us_{0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<ReceivedFrame> frames_;
+};
+
+TEST_F(TransportTCPTest, ResumeAfterSocketKilled) {
+    ASSERT_TRUE(client_->connect());
+    startSending();
+    auto first = waitFrameAfter(Clock::time_point{}, false);
+    if (!first.has_value() && failed_) {
+        GTEST_SKIP() << "No usable non-loopback interface for ServerTCP";
+    }
+    ASSERT_TRUE(first.has_value());
+
+    for (int round = 0; round < 3; round++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{200});
+        auto killed_at = Clock::now();
+        proxy_.kill();
+        // 续上之后的第一个关键帧才是客户端能解出来的第一帧
+        auto first_keyframe = waitFrameAfter(killed_at, true);
+        ASSERT_TRUE(first_keyframe.has_value());
+        double ms = std::chrono::duration<double, std::milli>(first_keyframe.value()).count();
+        printf("round %d: first frame after resume %.1fms\n", round, ms);
+        EXPECT_LT(first_keyframe.value(), std::chrono::seconds{1});
+    }
+
+    // 上层既不知道断过, 也不需要重新走信令
+    EXPECT_EQ(accepted_, 1);
+    EXPECT_EQ(connected_, 1);
+    EXPECT_EQ(server_disconnected_, 0);
+    EXPECT_EQ(client_disconnected_, 0);
+    EXPECT_FALSE(failed_);
+}
+
+TEST_F(TransportTCPTest, ResumeWhileStreaming) {
+    ASSERT_TRUE(client_->connect());
+    // 尽量让续上的确认跟视频在网络线程里挤在一起, 两边抢加密计数器的话客户端会解密失败断开
+    startSending(std::chrono::milliseconds{1});
+    auto first = waitFrameAfter(Clock::time_point{}, false);
+    if (!first.has_value() && failed_) {
+        GTEST_SKIP() << "No usable non-loopback interface for ServerTCP";
+    }
+    ASSERT_TRUE(first.has_value());
+
+    constexpr int kKills = 10;
+    for (int round = 0; round < kKills; round++) {
+        auto killed_at = Clock::now();
+        proxy_.kill();
+        ASSERT_TRUE(waitFrameAfter(killed_at, true).has_value()) << "round " << round;
+        // 续上之后还要能继续收到帧
+        ASSERT_TRUE(waitFrameAfter(Clock::now(), false).has_value()) << "round " << round;
+    }
+
+    // 每次kill只重连一次, 没有因为解密失败多断开的
+    EXPECT_EQ(proxy_.connections(), kKills + 1);
+    EXPECT_EQ(accepted_, 1);
+    EXPECT_EQ(connected_, 1);
+    EXPECT_EQ(server_disconnected_, 0);
+    EXPECT_EQ(client_disconnected_, 0);
+    EXPECT_FALSE(failed_);
+}
+
+TEST_F(TransportTCPTest, NoResumeWithoutServerAck) {
+    ASSERT_TRUE(client_->connect());
+    startSending();
+    auto first = waitFrameAfter(Clock::time_point{}, false);
+    if (!first.has_value() && failed_) {
+        GTEST_SKIP() << "No usable non-loopback interface for ServerTCP";
+    }
+    ASSERT_TRUE(first.has_value());
+
+    // 客户端的TCP重连能成功, 但服务端永远看不到resume token, 不能当成已经续上了
+    proxy_.blackhole();
+    auto killed_at = Clock::now();
+    proxy_.kill();
+    while (client_disconnected_ == 0 && Clock::now() - killed_at < std::chrono::seconds{5}) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    EXPECT_EQ(client_disconnected_, 1);
+    // 宽限期到了才报断开
+    EXPECT_GE(Clock::now() - killed_at, std::chrono::milliseconds{2900});
+    EXPECT_EQ(connected_, 1);
+}
+
+class TransportTCPProbeTest : public TransportTCPTest {
+protected:
+    void SetUp() override { createTransport(kProbeTimeoutMs); }
+
+    void expectProbe(uint32_t link_bps, int64_t one_way_delay_ms) {
+        proxy_.setLink(link_bps, one_way_delay_ms);
+        auto start = Clock::now();
+        std::optional<Clock::duration> connected_after;
+        ASSERT_TRUE(client_->connect());
+        while ((connected_ == 0 || probe_bps_ == 0) && !failed_ &&
+               Clock::now() - start < std::chrono::seconds{5}) {
+            if (connected_ != 0 && !connected_after.has_value()) {
+                connected_after = Clock::now() - start;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+        if (connected_ != 0 && !connected_after.has_value()) {
+            connected_after = Clock::now() - start;
+        }
+        if (connected_ == 0 && failed_) {
+            GTEST_SKIP() << "No usable non-loopback interface for ServerTCP";
+        }
+        ASSERT_EQ(connected_, 1);
+        ASSERT_TRUE(connected_after.has_value());
+        double ms = std::chrono::duration<double, std::milli>(connected_after.value()).count();
+        double probe_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        printf("link %uMbps delay %lldms: connected in %.1fms, probed %.1fMbps rtt %.1fms in "
+               "%.1fms\n",
+               link_bps / 1'000'000, static_cast<long long>(one_way_delay_ms), ms,
+               probe_bps_ / 1e6, probe_rtt_us_ / 1e3, probe_ms);
+        EXPECT_GT(probe_bps_, link_bps * 0.7);
+        EXPECT_LT(probe_bps_, link_bps * 1.3);
+        EXPECT_GE(probe_rtt_us_, 2 * one_way_delay_ms * 1000);
+        EXPECT_LT(probe_rtt_us_, 2 * one_way_delay_ms * 1000 + 20'000);
+        // 客户端连上就回调on_connected, 不等探测; 探测结果在超时之内到达服务端
+        EXPECT_LT(connected_after.value(), std::chrono::milliseconds{kProbeTimeoutMs / 2});
+        EXPECT_LT(Clock::now() - start, std::chrono::milliseconds{kProbeTimeoutMs + 500});
+        EXPECT_FALSE(failed_);
+    }
+
+    static constexpr uint32_t kProbeTimeoutMs = 1000;
+};
+
+TEST_F(TransportTCPProbeTest, SlowWiFi) {
+    expectProbe(5'000'000, 20);
+}
+
+TEST_F(TransportTCPProbeTest, FastLan) {
+    expectProbe(50'000'000, 2);
+}
+
+// 用ltlib::Client模拟旧版本的ClientTCP: 不认识新的信令, 发的是带xor的包
+class TransportTCPLegacyClientTest : public testing::Test {
+protected:
+    static void SetUpTestSuite() { ltlib::ThreadWatcher::init(std::this_thread::get_id()); }
+    static void TearDownTestSuite() { ltlib::ThreadWatcher::uninit(); }
+
+    void SetUp() override {
+        lt::tp::ServerTCP::Params params{};
+        params.user_data = this;
+        params.on_data = [](void* user_data, const uint8_t* data, uint32_t size, bool) {
+            auto that = static_cast<TransportTCPLegacyClientTest*>(user_data);
+            if (size >= sizeof(uint32_t)) {
+                memcpy(&that->server_received_type_, data, sizeof(uint32_t));
+            }
+        };
+        params.on_accepted = [](void* user_data, lt::LinkType) {
+            static_cast<TransportTCPLegacyClientTest*>(user_data)->accepted_++;
+        };
+        params.on_failed = [](void* user_data) {
+            static_cast<TransportTCPLegacyClientTest*>(user_data)->failed_ = true;
+        };
+        params.on_disconnected = [](void*) {};
+        params.on_signaling_message = [](void* user_data, const char* key, const char* value) {
+            auto that = static_cast<TransportTCPLegacyClientTest*>(user_data);
+            if (std::string{key} == "address") {
+                std::lock_guard lock{that->mutex_};
+                that->address_ = value;
+            }
+        };
+        // 新版本的服务端默认开着续连, 旧客户端不会带resume token
+        params.resume_grace_ms = 3000;
+        server_ = lt::tp::ServerTCP::create(params);
+        ASSERT_NE(server_, nullptr);
+    }
+
+    void TearDown() override {
+        client_.reset();
+        ioloop_.reset();
+        net_thread_.reset();
+        server_.reset();
+    }
+
+    template <typename Pred> bool waitFor(Pred pred) {
+        auto start = Clock::now();
+        while (!pred() && Clock::now() - start < std::chrono::seconds{5}) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+        return pred();
+    }
+
+    std::unique_ptr<lt::tp::ServerTCP> server_;
+    std::unique_ptr<ltlib::IOLoop> ioloop_;
+    std::unique_ptr<ltlib::Client> client_;
+    std::unique_ptr<ltlib::BlockingThread> net_thread_;
+    std::mutex mutex_;
+    std::string address_;
+    std::atomic<bool> failed_{false};
+    std::atomic<int> accepted_{0};
+    std::atomic<uint32_t> server_received_type_{0};
+    std::atomic<uint32_t> client_received_type_{0};
+};
+
+TEST_F(TransportTCPLegacyClientTest, XorPacketsAndProtobufMediaAreServed) {
+    server_->onSignalingMessage("connect", "");
+    std::string address;
+    waitFor([&]() {
+        std::lock_guard lock{mutex_};
+        address = address_;
+        return !address.empty() || failed_;
+    });
+    if (address.empty() && failed_) {
+        GTEST_SKIP() << "No usable non-loopback interface for ServerTCP";
+    }
+    ASSERT_FALSE(address.empty());
+
+    ioloop_ = ltlib::IOLoop::create();
+    ASSERT_NE(ioloop_, nullptr);
+    ltlib::Client::Params params{};
+    params.stype = ltlib::StreamType::TCP;
+    params.ioloop = ioloop_.get();
+    params.host = address.substr(0, address.find(':'));
+    params.port = static_cast<uint16_t>(std::atoi(address.substr(address.find(':') + 1).c_str()));
+    // 旧版本的ClientTCP就是这样连ServerTCP的: 发带xor的包, 用ltproto::Parser收
+    params.peer_is_ltlib_server = false;
+    params.on_connected = []() {};
+    params.on_closed = []() {};
+    params.on_reconnecting = []() {};
+    params.on_message = [this](uint32_t type,
+                               const std::shared_ptr<google::protobuf::MessageLite>&) {
+        client_received_type_ = type;
+    };
+    client_ = ltlib::Client::create(params);
+    ASSERT_NE(client_, nullptr);
+    net_thread_ = ltlib::BlockingThread::create(
+        "test_legacy_client",
+        [this](const std::function<void()>& i_am_alive) { ioloop_->run(i_am_alive); });
+    ASSERT_TRUE(waitFor([this]() { return accepted_ == 1; }));
+
+    ioloop_->post([this]() {
+        auto msg = std::make_shared<ltproto::client2worker::AudioData>();
+        msg->set_data("legacy");
+        client_->send(ltproto::type::kAudioData, msg);
+    });
+    EXPECT_TRUE(waitFor([this]() { return server_received_type_ == ltproto::type::kAudioData; }));
+
+    ltproto::client2worker::AudioData reply;
+    reply.set_data("reply");
+    std::vector<uint8_t> data(sizeof(uint32_t) + reply.ByteSizeLong());
+    const uint32_t type = ltproto::type::kAudioData;
+    memcpy(data.data(), &type, sizeof(type));
+    ASSERT_TRUE(reply.SerializeToArray(data.data() + sizeof(type),
+                                       static_cast<int>(data.size() - sizeof(type))));
+    EXPECT_TRUE(server_->sendData(data.data(), static_cast<uint32_t>(data.size()), true));
+    EXPECT_TRUE(waitFor([this]() { return client_received_type_ == ltproto::type::kAudioData; }));
+
+    // connect信令里没带能力, 音视频退回protobuf
+    std::vector<uint8_t> payload(1000, 0x5A);
+    lt::VideoFrame frame{};
+    frame.is_keyframe = true;
+    frame.data = payload.data();
+    frame.size = static_cast<uint32_t>(payload.size());
+    EXPECT_TRUE(server_->sendVideo(frame));
+    EXPECT_TRUE(waitFor([this]() { return client_received_type_ == ltproto::type::kVideoFrame; }));
+    lt::AudioData audio{};
+    audio.data = payload.data();
+    audio.size = 100;
+    EXPECT_TRUE(server_->sendAudio(audio));
+    EXPECT_TRUE(waitFor([this]() { return client_received_type_ == ltproto::type::kAudioData; }));
+    EXPECT_FALSE(failed_);
+}
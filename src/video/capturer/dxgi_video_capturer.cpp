@@ -33,7 +33,8 @@
 #include <d3d11.h>
 #include <dxgi.h>
 
-#include <rtc/rtc.h>
+#include <algorithm>
+#include <thread>
 
 #include <ltlib/logging.h>
 #include <ltlib/strings.h>
@@ -156,15 +157,20 @@ std::optional<Capturer::Frame> DxgiVideoCapturer::capture() {
     if (hr == DUPL_RETURN::DUPL_RETURN_SUCCESS && !timeout) {
         RECORD_T(point2);
         Capturer::Frame out_frame{};
+        D3D11_TEXTURE2D_DESC desc{};
+        frame.Frame->GetDesc(&desc);
+        out_frame.width = desc.Width;
+        out_frame.height = desc.Height;
         if (capture_foramt_ == CaptureFormat::D3D11_BGRA) {
             out_frame.data = frame.Frame;
         }
         else {
-            auto mem_data = toI420(frame.Frame);
-            if (mem_data == nullptr) {
+            auto buffer = toI420(frame.Frame, out_frame.damage);
+            if (buffer == nullptr) {
                 return {};
             }
-            out_frame.data = mem_data;
+            out_frame.data = buffer->data();
+            out_frame.buffer = std::move(buffer);
         }
         out_frame.capture_timestamp_us = ltlib::steady_now_us();
         saveCursorInfo(&frame.FrameInfo);
@@ -177,9 +183,22 @@ std::optional<CursorInfo> DxgiVideoCapturer::cursorInfo() {
     return cursor_info_;
 }
 
-uint8_t* DxgiVideoCapturer::toI420(ID3D11Texture2D* frame) {
+std::shared_ptr<ltlib::FrameBuffer>
+DxgiVideoCapturer::toI420(ID3D11Texture2D* frame,
+                          std::optional<std::vector<DamageRect>>& damage) {
     D3D11_TEXTURE2D_DESC desc{};
     frame->GetDesc(&desc);
+    if (stage_texture_ != nullptr) {
+        // 显示模式变了, DuplicationManager重建之后出来的纹理换了尺寸
+        D3D11_TEXTURE2D_DESC stage_desc{};
+        stage_texture_->GetDesc(&stage_desc);
+        if (stage_desc.Width != desc.Width || stage_desc.Height != desc.Height) {
+            LOGF(INFO, "DxgiVideoCapturer resolution changed from %ux%u to %ux%u",
+                 stage_desc.Width, stage_desc.Height, desc.Width, desc.Height);
+            stage_texture_ = nullptr;
+            damage_detector_ = nullptr;
+        }
+    }
     if (stage_texture_ == nullptr) {
         D3D11_TEXTURE2D_DESC desc2{};
         desc2.Width = desc.Width;
@@ -211,23 +230,69 @@ uint8_t* DxgiVideoCapturer::toI420(ID3D11Texture2D* frame) {
         LOGF(ERR, "ID3D11DeviceContext::Map failed %#x", hr);
         return nullptr;
     }
-    size_t need_size = desc.Width * desc.Height * 3 / 2;
-    if (mem_buff_.size() < need_size) {
-        mem_buff_.resize(need_size);
+    if (converter_ == nullptr) {
+        // 软编时CPU还要留给编码器, 转换最多用4个线程
+        ColorConverter::Params params{};
+        params.threads = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+        converter_ = ColorConverter::create(params);
+        LOG(INFO) << "DxgiVideoCapturer color converter using "
+                  << simdLevelToString(converter_->simdLevel()) << " with "
+                  << converter_->threads() << " threads";
+    }
+    if (damage_detector_ == nullptr) {
+        DamageDetector::Params params{};
+        params.width = desc.Width;
+        params.height = desc.Height;
+        damage_detector_ = DamageDetector::create(params);
+        if (damage_detector_ == nullptr) {
+            LOGF(WARNING, "Create DamageDetector(%ux%u) failed, convert whole frame", desc.Width,
+                 desc.Height);
+        }
+    }
+    // buffer里留着上一帧的转换结果, 只需要转换变化了的区域. tile的边长是偶数,
+    // 区域的起点对色度平面也是对齐的
+    auto buffer = writableI420(desc.Width, desc.Height, damage_detector_ != nullptr);
+    if (buffer == nullptr) {
+        d3d11_ctx_->Unmap(stage_texture_.Get(), subres);
+        return nullptr;
+    }
+    const uint8_t* bgra = reinterpret_cast<const uint8_t*>(mapped.pData);
+    std::vector<DamageRect> rects{DamageRect{0, 0, desc.Width, desc.Height}};
+    if (damage_detector_ != nullptr) {
+        rects = damage_detector_->detect(bgra, static_cast<int>(mapped.RowPitch));
     }
-    // 其实是libyuv，但是rtc.dll已经集成了，就不再单独编译一份libyuv，二次导出即可
     int width = static_cast<int>(desc.Width);
     int height = static_cast<int>(desc.Height);
-    int ret = rtc::ARGBToI420(reinterpret_cast<BYTE*>(mapped.pData), mapped.RowPitch,
-                              mem_buff_.data(), width, mem_buff_.data() + width * height, width / 2,
-                              mem_buff_.data() + width * height + width * height / 4, width / 2,
-                              width, height);
+    uint8_t* y = buffer->data();
+    uint8_t* u = y + width * height;
+    uint8_t* v = u + width * height / 4;
+    bool success = true;
+    for (const auto& rect : rects) {
+        const size_t offset = static_cast<size_t>(rect.y) * desc.Width + rect.x;
+        const size_t uv_offset = static_cast<size_t>(rect.y / 2) * (desc.Width / 2) + rect.x / 2;
+        success = converter_->bgraToI420(
+            bgra + static_cast<size_t>(rect.y) * mapped.RowPitch + rect.x * 4,
+            static_cast<int>(mapped.RowPitch), y + offset, width, u + uv_offset, width / 2,
+            v + uv_offset, width / 2, static_cast<int>(rect.width),
+            static_cast<int>(rect.height));
+        if (!success) {
+            break;
+        }
+    }
     d3d11_ctx_->Unmap(stage_texture_.Get(), subres);
-    if (ret != 0) {
-        LOG(ERR) << "rtc::ARGBToI420 failed " << ret;
+    if (!success) {
+        LOGF(ERR, "ColorConverter::bgraToI420 failed, w:%d, h:%d, pitch:%u", width, height,
+             mapped.RowPitch);
+        // 这一帧的哈希已经记下了, 但buffer没有跟上
+        if (damage_detector_ != nullptr) {
+            damage_detector_->reset();
+        }
         return nullptr;
     }
-    return mem_buff_.data();
+    if (damage_detector_ != nullptr) {
+        damage = std::move(rects);
+    }
+    return buffer;
 }
 
 void DxgiVideoCapturer::saveCursorInfo(DXGI_OUTDUPL_FRAME_INFO* frame_info) {
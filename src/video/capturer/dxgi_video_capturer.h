@@ -39,6 +39,8 @@
 
 #include <video/capturer/dxgi/duplication_manager.h>
 #include <video/capturer/video_capturer.h>
+#include <video/convert/color_convert.h>
+#include <video/convert/damage_detector.h>
 
 namespace lt {
 
@@ -64,7 +66,8 @@ public:
 
 private:
     bool initD3D11();
-    uint8_t* toI420(ID3D11Texture2D* frame);
+    std::shared_ptr<ltlib::FrameBuffer> toI420(ID3D11Texture2D* frame,
+                                               std::optional<std::vector<DamageRect>>& damage);
     void saveCursorInfo(DXGI_OUTDUPL_FRAME_INFO* frame_info);
 
 private:
@@ -73,7 +76,8 @@ private:
     Microsoft::WRL::ComPtr<ID3D11Device> d3d11_dev_;
     Microsoft::WRL::ComPtr<ID3D11DeviceContext> d3d11_ctx_;
     Microsoft::WRL::ComPtr<ID3D11Texture2D> stage_texture_;
-    std::vector<uint8_t> mem_buff_;
+    std::unique_ptr<ColorConverter> converter_;
+    std::unique_ptr<DamageDetector> damage_detector_;
     int64_t luid_ = 0;
     uint32_t vendor_id_ = 0;
     ltlib::Monitor monitor_;
@@ -0,0 +1,531 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "synthetic_video_capturer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+namespace {
+
+using lt::video::CursorFormat;
+using lt::video::CursorInfo;
+
+constexpr uint32_t kCursorSize = 32;
+// 光标转一圈的帧数
+constexpr uint32_t kCursorOrbitFrames = 240;
+// ScrollingText每帧滚动的行数和文字的行高
+constexpr uint32_t kScrollRowsPerFrame = 3;
+constexpr uint32_t kTextLineHeight = 24;
+constexpr uint32_t kGlyphWidth = 12;
+
+uint64_t nextRandom(uint64_t& state) {
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+std::string lowerExtension(const std::string& path) {
+    const size_t pos = path.find_last_of('.');
+    if (pos == std::string::npos) {
+        return "";
+    }
+    std::string ext = path.substr(pos);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext;
+}
+
+// 黑边白底的箭头
+CursorInfo makeArrowCursor() {
+    CursorInfo info{};
+    info.format = CursorFormat::Color;
+    info.w = kCursorSize;
+    info.h = kCursorSize;
+    info.pitch = kCursorSize * 4;
+    info.data.resize(kCursorSize * kCursorSize * 4);
+    for (uint32_t y = 0; y < kCursorSize; y++) {
+        for (uint32_t x = 0; x < kCursorSize; x++) {
+            uint8_t* pixel = info.data.data() + (y * kCursorSize + x) * 4;
+            const bool inside = x <= y && y < 24 && x < 16;
+            if (!inside) {
+                continue;
+            }
+            const bool border = x == 0 || x == y || y == 23 || x == 15;
+            const uint8_t color = border ? 0 : 255;
+            pixel[0] = pixel[1] = pixel[2] = color;
+            pixel[3] = 255;
+        }
+    }
+    return info;
+}
+
+// 和DXGI一样, 单色光标是上半AND掩码加下半XOR掩码, 高度是形状的两倍
+CursorInfo makeCrossCursor() {
+    CursorInfo info{};
+    info.format = CursorFormat::MonoChrome;
+    info.w = kCursorSize;
+    info.h = kCursorSize * 2;
+    info.pitch = kCursorSize / 8;
+    info.hot_x = kCursorSize / 2;
+    info.hot_y = kCursorSize / 2;
+    info.data.assign(info.pitch * info.h, 0);
+    std::fill(info.data.begin(), info.data.begin() + info.pitch * kCursorSize, 0xFF);
+    uint8_t* xor_mask = info.data.data() + info.pitch * kCursorSize;
+    for (uint32_t y = 0; y < kCursorSize; y++) {
+        for (uint32_t x = 0; x < kCursorSize; x++) {
+            if (x == kCursorSize / 2 || y == kCursorSize / 2) {
+                xor_mask[y * info.pitch + x / 8] |= static_cast<uint8_t>(0x80 >> (x % 8));
+            }
+        }
+    }
+    return info;
+}
+
+// alpha为0xFF的像素和屏幕做异或, 竖线上异或白色, 其它地方异或黑色等于不变
+CursorInfo makeIBeamCursor() {
+    CursorInfo info{};
+    info.format = CursorFormat::MaskedColor;
+    info.w = kCursorSize;
+    info.h = kCursorSize;
+    info.pitch = kCursorSize * 4;
+    info.hot_x = kCursorSize / 2;
+    info.hot_y = kCursorSize / 2;
+    info.data.resize(kCursorSize * kCursorSize * 4);
+    for (uint32_t y = 0; y < kCursorSize; y++) {
+        for (uint32_t x = 0; x < kCursorSize; x++) {
+            uint8_t* pixel = info.data.data() + (y * kCursorSize + x) * 4;
+            const bool beam = (x == kCursorSize / 2 && y >= 4 && y < 28) ||
+                              ((y == 4 || y == 27) && x >= 12 && x <= 20);
+            const uint8_t color = beam ? 255 : 0;
+            pixel[0] = pixel[1] = pixel[2] = color;
+            pixel[3] = 255;
+        }
+    }
+    return info;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+std::unique_ptr<SyntheticVideoCapturer> SyntheticVideoCapturer::create(const Params& params) {
+    std::unique_ptr<SyntheticVideoCapturer> capturer{new SyntheticVideoCapturer(params)};
+    if (!capturer->init()) {
+        return nullptr;
+    }
+    return capturer;
+}
+
+SyntheticVideoCapturer::SyntheticVideoCapturer(const Params& params)
+    : params_{params}
+    , width_{params.width}
+    , height_{params.height}
+    , rng_state_{params.seed == 0 ? 1 : params.seed}
+    , vblank_clock_{params.fps} {}
+
+SyntheticVideoCapturer::~SyntheticVideoCapturer() = default;
+
+bool SyntheticVideoCapturer::init() {
+    if (!params_.file.empty()) {
+        if (!openFile()) {
+            return false;
+        }
+    }
+    else if (width_ == 0 || height_ == 0 || width_ % 2 != 0 || height_ % 2 != 0) {
+        LOGF(ERR, "SyntheticVideoCapturer: invalid resolution %ux%u", width_, height_);
+        return false;
+    }
+    else {
+        resize(width_, height_);
+    }
+    if (params_.cursor) {
+        cursor_shapes_ = {makeArrowCursor(), makeCrossCursor(), makeIBeamCursor()};
+    }
+    return true;
+}
+
+bool SyntheticVideoCapturer::openFile() {
+    file_.open(params_.file, std::ios::binary);
+    if (!file_.is_open()) {
+        LOG(ERR) << "SyntheticVideoCapturer: open '" << params_.file << "' failed";
+        return false;
+    }
+    uint32_t width = params_.width;
+    uint32_t height = params_.height;
+    y4m_ = lowerExtension(params_.file) == ".y4m";
+    if (y4m_) {
+        std::string header;
+        std::getline(file_, header);
+        if (header.rfind("YUV4MPEG2 ", 0) != 0) {
+            LOG(ERR) << "SyntheticVideoCapturer: '" << params_.file << "' is not a y4m file";
+            return false;
+        }
+        std::istringstream tokens{header.substr(10)};
+        std::string token;
+        while (tokens >> token) {
+            switch (token[0]) {
+            case 'W':
+                width = static_cast<uint32_t>(std::atoi(token.c_str() + 1));
+                break;
+            case 'H':
+                height = static_cast<uint32_t>(std::atoi(token.c_str() + 1));
+                break;
+            case 'C':
+                // C420jpeg, C420paldv, C420mpeg2只是色度的采样位置不同
+                if (token.compare(1, 3, "420") != 0) {
+                    LOG(ERR) << "SyntheticVideoCapturer: unsupported y4m colorspace " << token;
+                    return false;
+                }
+                break;
+            case 'F':
+                LOG(INFO) << "SyntheticVideoCapturer: y4m frame rate " << token.substr(1)
+                          << ", replay at " << params_.fps << "fps";
+                break;
+            default:
+                break;
+            }
+        }
+        first_frame_offset_ = file_.tellg();
+    }
+    if (width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0) {
+        LOGF(ERR, "SyntheticVideoCapturer: invalid resolution %ux%u in '%s'", width, height,
+             params_.file.c_str());
+        return false;
+    }
+    resize(width, height);
+    if (!readFileFrame()) {
+        return false;
+    }
+    // 上面只是确认至少有一帧, 回到开头
+    file_.clear();
+    file_.seekg(first_frame_offset_);
+    return true;
+}
+
+bool SyntheticVideoCapturer::readFileFrame() {
+    const std::streamsize frame_size = static_cast<std::streamsize>(frame_size_);
+    for (int i = 0; i < 2; i++) {
+        if (y4m_) {
+            std::string line;
+            if (std::getline(file_, line) && line.rfind("FRAME", 0) == 0 &&
+                file_.read(reinterpret_cast<char*>(frame_), frame_size)) {
+                return true;
+            }
+        }
+        else if (file_.read(reinterpret_cast<char*>(frame_), frame_size)) {
+            return true;
+        }
+        // 读到结尾或者最后一帧不完整, 从第一帧重新开始
+        file_.clear();
+        file_.seekg(first_frame_offset_);
+    }
+    LOG(ERR) << "SyntheticVideoCapturer: read frame from '" << params_.file << "' failed";
+    return false;
+}
+
+void SyntheticVideoCapturer::resize(uint32_t width, uint32_t height) {
+    width_ = width;
+    height_ = height;
+    auto buffer = writableI420(width, height, false);
+    frame_ = buffer->data();
+    frame_size_ = buffer->size();
+    memset(frame_, 128, frame_size_);
+    DamageDetector::Params params{};
+    params.width = width;
+    params.height = height;
+    params.bytes_per_pixel = 1;
+    damage_detector_ = DamageDetector::create(params);
+    text_page_.clear();
+    if (!params_.file.empty()) {
+        return;
+    }
+    switch (params_.pattern) {
+    case Pattern::ScrollingText:
+    {
+        // 两屏高的一页文字, 循环滚动. 左边1/6是纯色的侧栏, 不随文字滚动
+        const uint32_t page_height =
+            (height * 2 + kTextLineHeight - 1) / kTextLineHeight * kTextLineHeight;
+        const uint32_t panel_width = width / 6;
+        text_page_.assign(static_cast<size_t>(width) * page_height, 240);
+        for (uint32_t line = 0; line < page_height / kTextLineHeight; line++) {
+            const uint32_t glyphs = static_cast<uint32_t>(nextRandom(rng_state_) % 80);
+            for (uint32_t g = 0; g < glyphs; g++) {
+                const uint64_t bits = nextRandom(rng_state_);
+                const uint32_t x0 = panel_width + 8 + g * kGlyphWidth;
+                if (x0 + kGlyphWidth > width || bits % 7 == 0) {
+                    continue;
+                }
+                // 每个字是8x14的点阵, 用随机数的位决定笔画
+                for (uint32_t gy = 0; gy < 14; gy++) {
+                    uint8_t* row = text_page_.data() +
+                                   static_cast<size_t>(line * kTextLineHeight + 5 + gy) * width;
+                    for (uint32_t gx = 0; gx < 8; gx++) {
+                        if ((bits >> ((gy / 2) * 8 + gx)) & 1) {
+                            row[x0 + gx] = 40;
+                        }
+                    }
+                }
+            }
+        }
+        for (uint32_t y = 0; y < page_height; y++) {
+            memset(text_page_.data() + static_cast<size_t>(y) * width, 60, panel_width);
+        }
+        break;
+    }
+    case Pattern::Static:
+        drawStatic();
+        break;
+    default:
+        break;
+    }
+}
+
+std::optional<Capturer::Frame> SyntheticVideoCapturer::capture() {
+    std::optional<std::pair<uint32_t, uint32_t>> resolution;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        resolution = pending_resolution_;
+        pending_resolution_.reset();
+    }
+    if (resolution.has_value()) {
+        LOGF(INFO, "SyntheticVideoCapturer: resolution changed from %ux%u to %ux%u", width_,
+             height_, resolution->first, resolution->second);
+        resize(resolution->first, resolution->second);
+    }
+    // Static只在resize()里画一次, 要把上一帧带过来, 其他的每帧整帧重画
+    const bool keep_content = params_.file.empty() && params_.pattern == Pattern::Static;
+    auto buffer = writableI420(width_, height_, keep_content);
+    if (buffer == nullptr) {
+        return std::nullopt;
+    }
+    frame_ = buffer->data();
+    if (!params_.file.empty()) {
+        if (!readFileFrame()) {
+            return std::nullopt;
+        }
+    }
+    else {
+        switch (params_.pattern) {
+        case Pattern::Gradient:
+            drawGradient();
+            break;
+        case Pattern::ScrollingText:
+            drawScrollingText();
+            break;
+        case Pattern::Noise:
+            drawNoise();
+            break;
+        case Pattern::Static:
+        default:
+            break;
+        }
+    }
+    Capturer::Frame frame{};
+    frame.data = frame_;
+    frame.buffer = std::move(buffer);
+    frame.width = width_;
+    frame.height = height_;
+    frame.capture_timestamp_us = (params_.fps == 0 || vblank_clock_.last() == 0)
+                                     ? ltlib::steady_now_us()
+                                     : vblank_clock_.last();
+    // 生成的画面亮度和色度总是一起变, 只比较Y平面就够了
+    if (damage_detector_ != nullptr) {
+        frame.damage = damage_detector_->detect(frame_, static_cast<int>(width_));
+    }
+    updateCursor();
+    frame_no_ += 1;
+    return frame;
+}
+
+void SyntheticVideoCapturer::drawGradient() {
+    uint8_t* y_plane = frame_;
+    uint8_t* u_plane = y_plane + static_cast<size_t>(width_) * height_;
+    uint8_t* v_plane = u_plane + static_cast<size_t>(width_ / 2) * (height_ / 2);
+    const uint32_t shift = static_cast<uint32_t>(frame_no_ * 2);
+    for (uint32_t y = 0; y < height_; y++) {
+        uint8_t* row = y_plane + static_cast<size_t>(y) * width_;
+        for (uint32_t x = 0; x < width_; x++) {
+            row[x] = static_cast<uint8_t>(x + y + shift);
+        }
+    }
+    for (uint32_t y = 0; y < height_ / 2; y++) {
+        uint8_t* u_row = u_plane + static_cast<size_t>(y) * (width_ / 2);
+        uint8_t* v_row = v_plane + static_cast<size_t>(y) * (width_ / 2);
+        for (uint32_t x = 0; x < width_ / 2; x++) {
+            u_row[x] = static_cast<uint8_t>(x * 2 + shift);
+            v_row[x] = static_cast<uint8_t>(y * 2 - shift);
+        }
+    }
+}
+
+void SyntheticVideoCapturer::drawScrollingText() {
+    const uint32_t page_height = static_cast<uint32_t>(text_page_.size() / width_);
+    const uint32_t scroll = static_cast<uint32_t>(frame_no_ * kScrollRowsPerFrame % page_height);
+    for (uint32_t y = 0; y < height_; y++) {
+        const uint32_t src_y = (y + scroll) % page_height;
+        memcpy(frame_ + static_cast<size_t>(y) * width_,
+               text_page_.data() + static_cast<size_t>(src_y) * width_, width_);
+    }
+}
+
+void SyntheticVideoCapturer::drawNoise() {
+    size_t i = 0;
+    for (; i + 8 <= frame_size_; i += 8) {
+        const uint64_t value = nextRandom(rng_state_);
+        memcpy(frame_ + i, &value, 8);
+    }
+    for (; i < frame_size_; i++) {
+        frame_[i] = static_cast<uint8_t>(nextRandom(rng_state_));
+    }
+}
+
+// 竖直渐变的桌面背景上放两个窗口
+void SyntheticVideoCapturer::drawStatic() {
+    uint8_t* y_plane = frame_;
+    uint8_t* u_plane = y_plane + static_cast<size_t>(width_) * height_;
+    uint8_t* v_plane = u_plane + static_cast<size_t>(width_ / 2) * (height_ / 2);
+    for (uint32_t y = 0; y < height_; y++) {
+        memset(y_plane + static_cast<size_t>(y) * width_, 80 + y * 60 / height_, width_);
+    }
+    memset(u_plane, 150, static_cast<size_t>(width_ / 2) * (height_ / 2));
+    memset(v_plane, 110, static_cast<size_t>(width_ / 2) * (height_ / 2));
+    const uint32_t windows[2][4] = {
+        {width_ / 10, height_ / 8, width_ / 2, height_ / 2},
+        {width_ * 4 / 10, height_ * 3 / 8, width_ / 2, height_ / 2},
+    };
+    for (auto& window : windows) {
+        const uint32_t right = std::min(window[0] + window[2], width_);
+        const uint32_t bottom = std::min(window[1] + window[3], height_);
+        for (uint32_t y = window[1]; y < bottom; y++) {
+            const uint8_t luma = y < window[1] + 32 ? 120 : 220;
+            memset(y_plane + static_cast<size_t>(y) * width_ + window[0], luma, right - window[0]);
+        }
+        for (uint32_t y = window[1] / 2; y < bottom / 2; y++) {
+            memset(u_plane + static_cast<size_t>(y) * (width_ / 2) + window[0] / 2, 128,
+                   (right - window[0]) / 2);
+            memset(v_plane + static_cast<size_t>(y) * (width_ / 2) + window[0] / 2, 128,
+                   (right - window[0]) / 2);
+        }
+    }
+}
+
+// 形状和DXGI一样只在变化的那一帧带上数据
+void SyntheticVideoCapturer::updateCursor() {
+    if (cursor_shapes_.empty()) {
+        return;
+    }
+    const uint32_t interval = params_.cursor_shape_interval;
+    const size_t shape = interval == 0 ? 0 : (frame_no_ / interval) % cursor_shapes_.size();
+    const bool shape_changed = frame_no_ == 0 || (interval != 0 && frame_no_ % interval == 0);
+    const double angle =
+        2 * 3.14159265358979 * static_cast<double>(frame_no_ % kCursorOrbitFrames) /
+        kCursorOrbitFrames;
+    const double radius = std::min(width_, height_) / 4.0;
+    CursorInfo info{};
+    if (shape_changed) {
+        info = cursor_shapes_[shape];
+    }
+    info.x = static_cast<int32_t>(width_ / 2 + radius * std::cos(angle));
+    info.y = static_cast<int32_t>(height_ / 2 + radius * std::sin(angle));
+    info.visible = true;
+    cursor_info_ = info;
+}
+
+std::optional<CursorInfo> SyntheticVideoCapturer::cursorInfo() {
+    return cursor_info_;
+}
+
+bool SyntheticVideoCapturer::start() {
+    return true;
+}
+
+void SyntheticVideoCapturer::doneWithFrame() {}
+
+void SyntheticVideoCapturer::waitForVBlank() {
+    vblank_clock_.wait();
+}
+
+Capturer::Backend SyntheticVideoCapturer::backend() const {
+    return Backend::Synthetic;
+}
+
+void* SyntheticVideoCapturer::device() {
+    return nullptr;
+}
+
+void* SyntheticVideoCapturer::deviceContext() {
+    return nullptr;
+}
+
+uint32_t SyntheticVideoCapturer::vendorID() {
+    return 0;
+}
+
+bool SyntheticVideoCapturer::defaultOutput() {
+    return true;
+}
+
+bool SyntheticVideoCapturer::setCaptureFormat(CaptureFormat format) {
+    if (format != CaptureFormat::MEM_I420) {
+        LOG(ERR) << "SyntheticVideoCapturer only supports MEM_I420";
+        return false;
+    }
+    return true;
+}
+
+bool SyntheticVideoCapturer::changeResolution(uint32_t width, uint32_t height) {
+    if (!params_.file.empty()) {
+        LOG(ERR) << "SyntheticVideoCapturer: can't change resolution while replaying a file";
+        return false;
+    }
+    if (width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0) {
+        LOGF(ERR, "SyntheticVideoCapturer: invalid resolution %ux%u", width, height);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    pending_resolution_ = std::make_pair(width, height);
+    return true;
+}
+
+} // namespace video
+
+} // namespace lt
@@ -0,0 +1,135 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <video/capturer/vblank_clock.h>
+#include <video/capturer/video_capturer.h>
+#include <video/convert/damage_detector.h>
+
+namespace lt {
+
+namespace video {
+
+// 不依赖真实桌面的抓屏, 按程序生成的画面或者从文件回放, 只输出MEM_I420.
+// 用来在没有显示器的机器上跑抓屏->编码的benchmark和回归测试.
+// capture_timestamp_us是waitForVBlank()等到的那个名义上的vblank时间, 不受线程调度抖动影响
+class SyntheticVideoCapturer : public Capturer {
+public:
+    enum class Pattern {
+        // 整屏斜向移动的渐变, 每帧全变
+        Gradient,
+        // 左边固定的侧栏, 右边不停向上滚动的文字
+        ScrollingText,
+        // 每帧全屏随机噪声, 编码器的最坏情况
+        Noise,
+        // 不会变的桌面
+        Static,
+    };
+    struct Params {
+        // 必须是偶数
+        uint32_t width = 1920;
+        uint32_t height = 1080;
+        // 0表示不限速, waitForVBlank()直接返回, 给benchmark用
+        uint32_t fps = 60;
+        Pattern pattern = Pattern::Gradient;
+        // 不为空时回放文件, 忽略pattern. .y4m的宽高从文件头读, 只支持4:2:0;
+        // 其他后缀当作裸I420, 宽高用width和height. 读到结尾后从头循环
+        std::string file;
+        // 光标绕着画面中心转圈, 每隔cursor_shape_interval帧换一种形状, 0表示不换
+        bool cursor = true;
+        uint32_t cursor_shape_interval = 120;
+        uint32_t seed = 1;
+    };
+
+public:
+    static std::unique_ptr<SyntheticVideoCapturer> create(const Params& params);
+    ~SyntheticVideoCapturer() override;
+    bool start() override;
+    std::optional<Capturer::Frame> capture() override;
+    std::optional<CursorInfo> cursorInfo() override;
+    void doneWithFrame() override;
+    void waitForVBlank() override;
+    Backend backend() const override;
+    void* device() override;
+    void* deviceContext() override;
+    uint32_t vendorID() override;
+    bool defaultOutput() override;
+    bool setCaptureFormat(CaptureFormat format) override;
+
+    // 从下一次capture()开始换分辨率, 可以在别的线程调用. 回放文件时不支持
+    bool changeResolution(uint32_t width, uint32_t height);
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
+    uint64_t frameCount() const { return frame_no_; }
+
+private:
+    SyntheticVideoCapturer(const Params& params);
+    bool init() override;
+    bool openFile();
+    bool readFileFrame();
+    void resize(uint32_t width, uint32_t height);
+    void drawGradient();
+    void drawScrollingText();
+    void drawNoise();
+    void drawStatic();
+    void updateCursor();
+
+private:
+    const Params params_;
+    std::mutex mutex_;
+    std::optional<std::pair<uint32_t, uint32_t>> pending_resolution_;
+    // 以下只在抓屏线程访问
+    uint32_t width_;
+    uint32_t height_;
+    // 指向currentI420()
+    uint8_t* frame_ = nullptr;
+    size_t frame_size_ = 0;
+    std::vector<uint8_t> text_page_;
+    std::unique_ptr<DamageDetector> damage_detector_;
+    std::ifstream file_;
+    bool y4m_ = false;
+    std::streamoff first_frame_offset_ = 0;
+    uint64_t frame_no_ = 0;
+    uint64_t rng_state_;
+    VBlankClock vblank_clock_;
+    std::vector<CursorInfo> cursor_shapes_;
+    std::optional<CursorInfo> cursor_info_;
+};
+
+} // namespace video
+
+} // namespace lt
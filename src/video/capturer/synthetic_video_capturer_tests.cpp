@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ltlib/times.h>
+
+#include "synthetic_video_capturer.h"
+
+using lt::video::Capturer;
+using lt::video::CaptureFormat;
+using lt::video::CursorFormat;
+using lt::video::SyntheticVideoCapturer;
+
+namespace {
+
+SyntheticVideoCapturer::Params makeParams(SyntheticVideoCapturer::Pattern pattern) {
+    SyntheticVideoCapturer::Params params{};
+    params.width = 640;
+    params.height = 360;
+    params.fps = 0;
+    params.pattern = pattern;
+    return params;
+}
+
+std::vector<uint8_t> copyFrame(const Capturer::Frame& frame, uint32_t width, uint32_t height) {
+    const uint8_t* data = static_cast<const uint8_t*>(frame.data);
+    return std::vector<uint8_t>(data, data + width * height * 3 / 2);
+}
+
+// 每帧的Y/U/V分别填成固定的值, 方便认出是第几帧
+std::string writeTestFile(const std::string& name, const std::string& header, uint32_t width,
+                          uint32_t height, int frames) {
+    const std::string path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    file << header;
+    for (int i = 0; i < frames; i++) {
+        if (!header.empty()) {
+            file << "FRAME\n";
+        }
+        file << std::string(width * height, static_cast<char>(10 + i))
+             << std::string(width * height / 4, static_cast<char>(100 + i))
+             << std::string(width * height / 4, static_cast<char>(200 + i));
+    }
+    return path;
+}
+
+} // namespace
+
+TEST(SyntheticVideoCapturerTest, InvalidParams) {
+    auto params = makeParams(SyntheticVideoCapturer::Pattern::Gradient);
+    params.width = 641;
+    EXPECT_EQ(SyntheticVideoCapturer::create(params), nullptr);
+    params.width = 640;
+    params.file = "/this/file/does/not/exist.y4m";
+    EXPECT_EQ(SyntheticVideoCapturer::create(params), nullptr);
+    params.file.clear();
+    auto capturer = SyntheticVideoCapturer::create(params);
+    ASSERT_NE(capturer, nullptr);
+    EXPECT_EQ(capturer->backend(), Capturer::Backend::Synthetic);
+    EXPECT_TRUE(capturer->setCaptureFormat(CaptureFormat::MEM_I420));
+    EXPECT_FALSE(capturer->setCaptureFormat(CaptureFormat::D3D11_BGRA));
+    EXPECT_FALSE(capturer->changeResolution(1279, 720));
+}
+
+TEST(SyntheticVideoCapturerTest, Patterns) {
+    using Pattern = SyntheticVideoCapturer::Pattern;
+    for (auto pattern : {Pattern::Gradient, Pattern::ScrollingText, Pattern::Noise}) {
+        auto capturer = SyntheticVideoCapturer::create(makeParams(pattern));
+        ASSERT_NE(capturer, nullptr);
+        auto frame0 = capturer->capture();
+        ASSERT_TRUE(frame0.has_value());
+        ASSERT_TRUE(frame0->damage.has_value());
+        ASSERT_EQ(frame0->damage->size(), 1u);
+        auto data0 = copyFrame(frame0.value(), 640, 360);
+        auto frame1 = capturer->capture();
+        ASSERT_TRUE(frame1.has_value());
+        EXPECT_NE(data0, copyFrame(frame1.value(), 640, 360)) << static_cast<int>(pattern);
+        EXPECT_FALSE(frame1->damage->empty()) << static_cast<int>(pattern);
+    }
+    // 同样的种子生成同样的画面
+    auto a = SyntheticVideoCapturer::create(makeParams(Pattern::Noise));
+    auto b = SyntheticVideoCapturer::create(makeParams(Pattern::Noise));
+    EXPECT_EQ(copyFrame(a->capture().value(), 640, 360), copyFrame(b->capture().value(), 640, 360));
+}
+
+TEST(SyntheticVideoCapturerTest, StaticDesktop) {
+    auto capturer =
+        SyntheticVideoCapturer::create(makeParams(SyntheticVideoCapturer::Pattern::Static));
+    ASSERT_NE(capturer, nullptr);
+    auto first = capturer->capture();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->damage->size(), 1u);
+    auto data = copyFrame(first.value(), 640, 360);
+    for (int i = 0; i < 10; i++) {
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        ASSERT_TRUE(frame->damage.has_value());
+        EXPECT_TRUE(frame->damage->empty());
+        EXPECT_EQ(copyFrame(frame.value(), 640, 360), data);
+    }
+}
+
+TEST(SyntheticVideoCapturerTest, ScrollingTextKeepsPanel) {
+    auto params = makeParams(SyntheticVideoCapturer::Pattern::ScrollingText);
+    params.width = 1920;
+    params.height = 1080;
+    auto capturer = SyntheticVideoCapturer::create(params);
+    capturer->capture();
+    auto frame = capturer->capture();
+    ASSERT_TRUE(frame.has_value());
+    ASSERT_FALSE(frame->damage->empty());
+    // 左边1/6的侧栏不动, 第一个tile是0~63列
+    for (auto& rect : frame->damage.value()) {
+        EXPECT_GE(rect.x, 256u);
+    }
+}
+
+TEST(SyntheticVideoCapturerTest, ChangeResolution) {
+    auto capturer =
+        SyntheticVideoCapturer::create(makeParams(SyntheticVideoCapturer::Pattern::Static));
+    capturer->capture();
+    EXPECT_TRUE(capturer->capture()->damage->empty());
+    ASSERT_TRUE(capturer->changeResolution(1280, 720));
+    EXPECT_EQ(capturer->width(), 640u);
+    auto frame = capturer->capture();
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_EQ(capturer->width(), 1280u);
+    EXPECT_EQ(capturer->height(), 720u);
+    EXPECT_EQ(frame->width, 1280u);
+    EXPECT_EQ(frame->height, 720u);
+    ASSERT_EQ(frame->damage->size(), 1u);
+    EXPECT_EQ(frame->damage->front().width, 1280u);
+    EXPECT_EQ(frame->damage->front().height, 720u);
+}
+
+TEST(SyntheticVideoCapturerTest, FrameBufferHandle) {
+    auto capturer =
+        SyntheticVideoCapturer::create(makeParams(SyntheticVideoCapturer::Pattern::Gradient));
+    auto first = capturer->capture();
+    ASSERT_TRUE(first.has_value());
+    ASSERT_NE(first->buffer, nullptr);
+    EXPECT_EQ(first->data, first->buffer->data());
+    EXPECT_EQ(first->buffer->width(), 640u);
+    EXPECT_EQ(first->buffer->format(), ltlib::FrameBuffer::Format::I420);
+    // 拿着的帧不会被下一帧覆盖
+    auto data = copyFrame(first.value(), 640, 360);
+    auto second = capturer->capture();
+    ASSERT_TRUE(second.has_value());
+    EXPECT_NE(second->data, first->data);
+    EXPECT_EQ(copyFrame(first.value(), 640, 360), data);
+    EXPECT_NE(copyFrame(second.value(), 640, 360), data);
+    // 没人拿着时原地复用
+    first.reset();
+    void* reused = second->data;
+    second.reset();
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(capturer->capture()->data, reused);
+    }
+}
+
+TEST(SyntheticVideoCapturerTest, Pacing) {
+    auto params = makeParams(SyntheticVideoCapturer::Pattern::Gradient);
+    params.fps = 100;
+    auto capturer = SyntheticVideoCapturer::create(params);
+    const int64_t start_us = ltlib::steady_now_us();
+    std::vector<int64_t> timestamps;
+    for (int i = 0; i < 20; i++) {
+        capturer->waitForVBlank();
+        timestamps.push_back(capturer->capture()->capture_timestamp_us);
+    }
+    const int64_t elapsed_us = ltlib::steady_now_us() - start_us;
+    EXPECT_GE(elapsed_us, 190'000);
+    // 时间戳是名义上的vblank时间, 没有调度抖动
+    for (size_t i = 1; i < timestamps.size(); i++) {
+        const int64_t delta = timestamps[i] - timestamps[i - 1];
+        if (delta > 20'000) {
+            // 线程被饿住错过了vblank, 重新计时
+            continue;
+        }
+        EXPECT_EQ(delta, 10'000) << i;
+    }
+}
+
+TEST(SyntheticVideoCapturerTest, Cursor) {
+    auto params = makeParams(SyntheticVideoCapturer::Pattern::Static);
+    params.cursor_shape_interval = 4;
+    auto capturer = SyntheticVideoCapturer::create(params);
+    const CursorFormat expected[] = {CursorFormat::Color, CursorFormat::MonoChrome,
+                                     CursorFormat::MaskedColor, CursorFormat::Color};
+    std::pair<int32_t, int32_t> last_pos{-1, -1};
+    for (int i = 0; i < 16; i++) {
+        capturer->capture();
+        auto cursor = capturer->cursorInfo();
+        ASSERT_TRUE(cursor.has_value());
+        EXPECT_TRUE(cursor->visible);
+        // 光标一直在动
+        EXPECT_NE(std::make_pair(cursor->x, cursor->y), last_pos);
+        last_pos = {cursor->x, cursor->y};
+        if (i % 4 != 0) {
+            EXPECT_TRUE(cursor->data.empty()) << i;
+            continue;
+        }
+        ASSERT_FALSE(cursor->data.empty()) << i;
+        EXPECT_EQ(cursor->format, expected[i / 4]);
+        EXPECT_EQ(cursor->data.size(), static_cast<size_t>(cursor->pitch) * cursor->h);
+        if (cursor->format == CursorFormat::MonoChrome) {
+            EXPECT_EQ(cursor->h, cursor->w * 2);
+        }
+    }
+    params.cursor = false;
+    capturer = SyntheticVideoCapturer::create(params);
+    capturer->capture();
+    EXPECT_FALSE(capturer->cursorInfo().has_value());
+}
+
+TEST(SyntheticVideoCapturerTest, Y4MReplay) {
+    const std::string path =
+        writeTestFile("lt_synthetic_capturer.y4m", "YUV4MPEG2 W64 H32 F30:1 Ip A1:1 C420jpeg\n",
+                      64, 32, 3);
+    SyntheticVideoCapturer::Params params{};
+    params.file = path;
+    params.fps = 0;
+    auto capturer = SyntheticVideoCapturer::create(params);
+    ASSERT_NE(capturer, nullptr);
+    EXPECT_EQ(capturer->width(), 64u);
+    EXPECT_EQ(capturer->height(), 32u);
+    EXPECT_FALSE(capturer->changeResolution(128, 64));
+    // 读到结尾后从头循环
+    for (int i = 0; i < 7; i++) {
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        auto data = copyFrame(frame.value(), 64, 32);
+        EXPECT_EQ(data[0], 10 + i % 3) << i;
+        EXPECT_EQ(data[64 * 32], 100 + i % 3) << i;
+        EXPECT_EQ(data.back(), 200 + i % 3) << i;
+    }
+    std::filesystem::remove(path);
+
+    const std::string bad = writeTestFile("lt_synthetic_capturer_444.y4m",
+                                          "YUV4MPEG2 W64 H32 F30:1 C444\n", 64, 32, 1);
+    params.file = bad;
+    EXPECT_EQ(SyntheticVideoCapturer::create(params), nullptr);
+    std::filesystem::remove(bad);
+}
+
+TEST(SyntheticVideoCapturerTest, RawReplay) {
+    // 最后半帧不完整, 应该被跳过
+    std::string path = writeTestFile("lt_synthetic_capturer.yuv", "", 64, 32, 2);
+    {
+        std::ofstream file{path, std::ios::binary | std::ios::app};
+        file << std::string(100, '\x7f');
+    }
+    SyntheticVideoCapturer::Params params{};
+    params.file = path;
+    params.width = 64;
+    params.height = 32;
+    params.fps = 0;
+    auto capturer = SyntheticVideoCapturer::create(params);
+    ASSERT_NE(capturer, nullptr);
+    for (int i = 0; i < 5; i++) {
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        EXPECT_EQ(copyFrame(frame.value(), 64, 32)[0], 10 + i % 2) << i;
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SyntheticVideoCapturerTest, Benchmark) {
+    using Pattern = SyntheticVideoCapturer::Pattern;
+    constexpr int kFrames = 30;
+    const std::pair<Pattern, const char*> patterns[] = {{Pattern::Gradient, "gradient"},
+                                                        {Pattern::ScrollingText, "text"},
+                                                        {Pattern::Noise, "noise"},
+                                                        {Pattern::Static, "static"}};
+    for (auto& pattern : patterns) {
+        auto params = makeParams(pattern.first);
+        params.width = 1920;
+        params.height = 1080;
+        auto capturer = SyntheticVideoCapturer::create(params);
+        const int64_t start_us = ltlib::steady_now_us();
+        for (int i = 0; i < kFrames; i++) {
+            capturer->capture();
+        }
+        const int64_t elapsed_us = ltlib::steady_now_us() - start_us;
+        printf("%-8s 1920x1080 %.2fms per frame\n", pattern.second,
+               elapsed_us / 1000.0 / kFrames);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vblank_clock.h"
+
+#include <chrono>
+#include <thread>
+
+#include <ltlib/times.h>
+
+namespace lt {
+
+namespace video {
+
+VBlankClock::VBlankClock(uint32_t fps)
+    : fps_{fps} {}
+
+int64_t VBlankClock::wait() {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (fps_ == 0) {
+        vblank_us_ = now_us;
+        return vblank_us_;
+    }
+    const int64_t interval_us = 1'000'000 / fps_;
+    // 用帧数乘出来, 1'000'000/fps除不尽时也不会累积误差
+    const int64_t next_us = base_us_ + static_cast<int64_t>((count_ + 1) * 1'000'000 / fps_);
+    if (base_us_ == 0 || now_us - next_us > interval_us) {
+        base_us_ = now_us;
+        count_ = 0;
+        vblank_us_ = now_us;
+        return vblank_us_;
+    }
+    if (next_us > now_us) {
+        std::this_thread::sleep_for(std::chrono::microseconds{next_us - now_us});
+    }
+    count_ += 1;
+    vblank_us_ = next_us;
+    return vblank_us_;
+}
+
+} // namespace video
+
+} // namespace lt
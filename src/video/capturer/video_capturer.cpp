@@ -30,17 +30,38 @@
 
 #include "video_capturer.h"
 
+#include <cstring>
+
 #include <ltlib/logging.h>
 
 #include <ltlib/times.h>
 
+#if defined(LT_WINDOWS)
 #include "dxgi_video_capturer.h"
+#endif // LT_WINDOWS
+#if defined(LT_LINUX)
+#include "x11_video_capturer.h"
+#endif // LT_LINUX
+#include "synthetic_video_capturer.h"
 
 namespace lt {
 
 namespace video {
 
 std::unique_ptr<Capturer> Capturer::create(Backend backend, ltlib::Monitor monitor) {
+    if (backend == Backend::Synthetic) {
+        // 按显示器的参数生成画面, 更细的控制直接用SyntheticVideoCapturer::create()
+        SyntheticVideoCapturer::Params params{};
+        if (monitor.width > 0 && monitor.height > 0) {
+            params.width = static_cast<uint32_t>(monitor.width) & ~1u;
+            params.height = static_cast<uint32_t>(monitor.height) & ~1u;
+        }
+        if (monitor.frequency > 0) {
+            params.fps = static_cast<uint32_t>(monitor.frequency);
+        }
+        return SyntheticVideoCapturer::create(params);
+    }
+#if defined(LT_WINDOWS)
     if (backend != Backend::Dxgi) {
         LOG(FATAL) << "Only support dxgi video capturer!";
         return nullptr;
@@ -50,12 +71,48 @@ std::unique_ptr<Capturer> Capturer::create(Backend backend, ltlib::Monitor monit
         return nullptr;
     }
     return capturer;
+#elif defined(LT_LINUX)
+    if (backend != Backend::X11) {
+        LOG(ERR) << "Unsupported video capturer backend " << static_cast<int>(backend);
+        return nullptr;
+    }
+    auto capturer = std::make_unique<X11VideoCapturer>(monitor);
+    if (!capturer->init()) {
+        return nullptr;
+    }
+    return capturer;
+#else  // LT_WINDOWS
+    (void)monitor;
+    LOG(ERR) << "Unsupported video capturer backend " << static_cast<int>(backend);
+    return nullptr;
+#endif // LT_WINDOWS
 }
 
 Capturer::Capturer() = default;
 
 Capturer::~Capturer() = default;
 
+std::shared_ptr<ltlib::FrameBuffer> Capturer::writableI420(uint32_t width, uint32_t height,
+                                                           bool keep_content) {
+    if (i420_ != nullptr && i420_->width() == width && i420_->height() == height) {
+        if (frame_pool_.unique(i420_)) {
+            return i420_;
+        }
+        // 编码器或者发送线程还拿着上一帧
+        auto buffer = frame_pool_.getImage(ltlib::FrameBuffer::Format::I420, width, height);
+        if (buffer != nullptr && keep_content) {
+            memcpy(buffer->data(), i420_->data(), i420_->size());
+        }
+        i420_ = buffer;
+        return i420_;
+    }
+    i420_ = frame_pool_.getImage(ltlib::FrameBuffer::Format::I420, width, height);
+    if (i420_ == nullptr) {
+        LOGF(ERR, "Get I420 frame buffer (%ux%u) failed", width, height);
+    }
+    return i420_;
+}
+
 } // namespace video
 
 } // namespace lt
\ No newline at end of file
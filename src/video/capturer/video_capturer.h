@@ -34,9 +34,13 @@
 #include <future>
 #include <memory>
 #include <optional>
+#include <vector>
 
+#include <ltlib/frame_pool.h>
 #include <ltlib/system.h>
 
+#include <video/convert/damage_detector.h>
+
 namespace lt {
 
 namespace video {
@@ -66,10 +70,23 @@ class Capturer {
 public:
     enum class Backend {
         Dxgi,
+        // 程序生成的画面或者文件回放, 见SyntheticVideoCapturer
+        Synthetic,
+        // Linux上用MIT-SHM抓X11, 见X11VideoCapturer
+        X11,
     };
     struct Frame {
         void* data;
         int64_t capture_timestamp_us;
+        // 这一帧的实际分辨率, 显示模式变了之后和开始抓屏时不一样. 0表示不知道
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // 和上一次capture()相比变化了的区域, 目前只有MEM_I420会检测.
+        // 没有值表示不知道, 当作整帧都变了
+        std::optional<std::vector<DamageRect>> damage;
+        // MEM_I420时data所在的内存, 持有它就可以在下一次capture()之后继续读这一帧.
+        // 不持有时data只保证到下一次capture()之前有效
+        std::shared_ptr<ltlib::FrameBuffer> buffer;
     };
 
 public:
@@ -91,6 +108,17 @@ public:
 protected:
     Capturer();
     virtual bool init() = 0;
+    // MEM_I420输出要写入的内存. 上一帧没有人拿着时原样返回, 否则从池子里换一块新的,
+    // keep_content为true时把上一帧的内容拷过去, 只转换变化区域的抓屏靠这个保持画面完整.
+    // 分辨率变了时返回的内容是无效的. 返回的buffer由Capturer持有, 子类不要另外保存
+    std::shared_ptr<ltlib::FrameBuffer> writableI420(uint32_t width, uint32_t height,
+                                                     bool keep_content);
+    // 最近一次writableI420()返回的buffer
+    const std::shared_ptr<ltlib::FrameBuffer>& currentI420() const { return i420_; }
+
+private:
+    ltlib::FramePool frame_pool_;
+    std::shared_ptr<ltlib::FrameBuffer> i420_;
 };
 
 } // namespace video
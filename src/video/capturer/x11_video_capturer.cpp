@@ -0,0 +1,534 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "x11_video_capturer.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+namespace {
+
+// 变化区域太碎时逐块转换的开销比多转换一点像素还大, 直接转换外接矩形
+constexpr size_t kMaxDamageRects = 16;
+
+int g_x_error = 0;
+
+int onXError(Display*, XErrorEvent* event) {
+    g_x_error = event->error_code;
+    return 0;
+}
+
+// Xlib默认的错误处理会直接退出进程, 可能出错的请求都放在ErrorTrap的作用域里
+class ErrorTrap {
+public:
+    ErrorTrap()
+        : old_handler_{XSetErrorHandler(onXError)} {
+        g_x_error = 0;
+    }
+    ~ErrorTrap() { XSetErrorHandler(old_handler_); }
+    // 没有reply的请求要先XSync才能确定有没有出错
+    int error(Display* display, bool sync) {
+        if (sync) {
+            XSync(display, False);
+        }
+        return g_x_error;
+    }
+
+private:
+    XErrorHandler old_handler_;
+};
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+class X11VideoCapturer::Impl {
+public:
+    ~Impl();
+    bool init(int32_t left, int32_t top, uint32_t width, uint32_t height);
+    void drainEvents();
+    // 返回true表示拿到了damage, rects是相对抓取区域的坐标
+    bool fetchDamage(std::vector<DamageRect>& rects);
+    bool getImage();
+    bool queryPointer(int32_t& x, int32_t& y);
+    bool getCursorImage(CursorInfo& info);
+
+    Display* display = nullptr;
+    Window root = 0;
+    XImage* image = nullptr;
+    XShmSegmentInfo shm{};
+    bool shm_attached = false;
+    bool has_damage = false;
+    int damage_event_base = 0;
+    Damage damage = 0;
+    XserverRegion region = 0;
+    bool has_fixes = false;
+    int fixes_event_base = 0;
+    bool cursor_changed = true;
+
+private:
+    bool initShm(uint32_t width, uint32_t height);
+    void initDamage();
+
+private:
+    int32_t left_ = 0;
+    int32_t top_ = 0;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+};
+
+X11VideoCapturer::Impl::~Impl() {
+    if (display == nullptr) {
+        return;
+    }
+    if (damage != 0) {
+        XDamageDestroy(display, damage);
+    }
+    if (region != 0) {
+        XFixesDestroyRegion(display, region);
+    }
+    if (shm_attached) {
+        XShmDetach(display, &shm);
+        XSync(display, False);
+    }
+    if (image != nullptr) {
+        // XShmCreateImage出来的XImage销毁时不会释放data
+        XDestroyImage(image);
+    }
+    if (shm.shmaddr != nullptr) {
+        shmdt(shm.shmaddr);
+    }
+    XCloseDisplay(display);
+}
+
+bool X11VideoCapturer::Impl::init(int32_t left, int32_t top, uint32_t width, uint32_t height) {
+    left_ = left;
+    top_ = top;
+    width_ = width;
+    height_ = height;
+    if (!initShm(width, height)) {
+        return false;
+    }
+    initDamage();
+    return true;
+}
+
+bool X11VideoCapturer::Impl::initShm(uint32_t width, uint32_t height) {
+    if (!XShmQueryExtension(display)) {
+        LOG(ERR) << "X server doesn't support MIT-SHM";
+        return false;
+    }
+    XWindowAttributes attrs{};
+    XGetWindowAttributes(display, root, &attrs);
+    Visual* visual = attrs.visual;
+    if (attrs.depth < 24 || visual->c_class != TrueColor || visual->red_mask != 0xff0000 ||
+        visual->green_mask != 0xff00 || visual->blue_mask != 0xff) {
+        LOGF(ERR, "Unsupported X11 visual, depth:%d, masks:%#lx %#lx %#lx", attrs.depth,
+             visual->red_mask, visual->green_mask, visual->blue_mask);
+        return false;
+    }
+    image = XShmCreateImage(display, visual, static_cast<unsigned>(attrs.depth), ZPixmap,
+                            nullptr, &shm, width, height);
+    if (image == nullptr) {
+        LOG(ERR) << "XShmCreateImage failed";
+        return false;
+    }
+    if (image->bits_per_pixel != 32) {
+        LOG(ERR) << "Unsupported XImage bits_per_pixel " << image->bits_per_pixel;
+        return false;
+    }
+    shm.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(image->bytes_per_line) * image->height,
+                       IPC_CREAT | 0600);
+    if (shm.shmid == -1) {
+        LOGF(ERR, "shmget failed: %s", strerror(errno));
+        return false;
+    }
+    void* addr = shmat(shm.shmid, nullptr, 0);
+    if (addr == reinterpret_cast<void*>(-1)) {
+        LOGF(ERR, "shmat failed: %s", strerror(errno));
+        shmctl(shm.shmid, IPC_RMID, nullptr);
+        return false;
+    }
+    shm.shmaddr = static_cast<char*>(addr);
+    shm.readOnly = False;
+    image->data = shm.shmaddr;
+    ErrorTrap trap;
+    XShmAttach(display, &shm);
+    int error = trap.error(display, true);
+    // 两边都attach之后就可以标记删除, 进程异常退出也不会留下共享内存
+    shmctl(shm.shmid, IPC_RMID, nullptr);
+    if (error != 0) {
+        LOG(ERR) << "XShmAttach failed with X error " << error;
+        return false;
+    }
+    shm_attached = true;
+    return true;
+}
+
+void X11VideoCapturer::Impl::initDamage() {
+    int error_base = 0;
+    has_fixes = XFixesQueryExtension(display, &fixes_event_base, &error_base);
+    if (!has_fixes) {
+        LOG(WARNING) << "X server doesn't support XFixes, no damage and cursor shape";
+        return;
+    }
+    XFixesSelectCursorInput(display, root, XFixesDisplayCursorNotifyMask);
+    if (!XDamageQueryExtension(display, &damage_event_base, &error_base)) {
+        LOG(WARNING) << "X server doesn't support XDamage, capture whole screen every frame";
+        return;
+    }
+    ErrorTrap trap;
+    damage = XDamageCreate(display, root, XDamageReportNonEmpty);
+    region = XFixesCreateRegion(display, nullptr, 0);
+    if (trap.error(display, true) != 0) {
+        LOG(WARNING) << "XDamageCreate failed, capture whole screen every frame";
+        damage = 0;
+        region = 0;
+        return;
+    }
+    has_damage = true;
+}
+
+void X11VideoCapturer::Impl::drainEvents() {
+    // 变化区域每帧主动去取, 事件只用来知道光标有没有换, 其它的取出来丢掉免得越积越多
+    while (XPending(display) > 0) {
+        XEvent event;
+        XNextEvent(display, &event);
+        if (has_fixes && event.type == fixes_event_base + XFixesCursorNotify) {
+            cursor_changed = true;
+        }
+    }
+}
+
+bool X11VideoCapturer::Impl::fetchDamage(std::vector<DamageRect>& rects) {
+    rects.clear();
+    if (!has_damage) {
+        return false;
+    }
+    XDamageSubtract(display, damage, None, region);
+    int count = 0;
+    XRectangle* xrects = XFixesFetchRegion(display, region, &count);
+    if (xrects == nullptr) {
+        return false;
+    }
+    const int32_t right = left_ + static_cast<int32_t>(width_);
+    const int32_t bottom = top_ + static_cast<int32_t>(height_);
+    for (int i = 0; i < count; i++) {
+        int32_t x0 = std::max<int32_t>(xrects[i].x, left_) - left_;
+        int32_t y0 = std::max<int32_t>(xrects[i].y, top_) - top_;
+        int32_t x1 = std::min<int32_t>(xrects[i].x + xrects[i].width, right) - left_;
+        int32_t y1 = std::min<int32_t>(xrects[i].y + xrects[i].height, bottom) - top_;
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+        // I420的色度平面是2x2采样, 对齐到偶数
+        x0 &= ~1;
+        y0 &= ~1;
+        x1 = std::min<int32_t>((x1 + 1) & ~1, static_cast<int32_t>(width_));
+        y1 = std::min<int32_t>((y1 + 1) & ~1, static_cast<int32_t>(height_));
+        rects.push_back(DamageRect{static_cast<uint32_t>(x0), static_cast<uint32_t>(y0),
+                                   static_cast<uint32_t>(x1 - x0),
+                                   static_cast<uint32_t>(y1 - y0)});
+    }
+    XFree(xrects);
+    if (rects.size() > kMaxDamageRects) {
+        uint32_t x0 = width_, y0 = height_, x1 = 0, y1 = 0;
+        for (const auto& rect : rects) {
+            x0 = std::min(x0, rect.x);
+            y0 = std::min(y0, rect.y);
+            x1 = std::max(x1, rect.x + rect.width);
+            y1 = std::max(y1, rect.y + rect.height);
+        }
+        rects = {DamageRect{x0, y0, x1 - x0, y1 - y0}};
+    }
+    return true;
+}
+
+bool X11VideoCapturer::Impl::getImage() {
+    // 分辨率变小之后抓取区域会超出root窗口, 这时会收到BadMatch
+    ErrorTrap trap;
+    Bool success = XShmGetImage(display, root, image, left_, top_, AllPlanes);
+    int error = trap.error(display, false);
+    if (!success || error != 0) {
+        LOGF(ERR, "XShmGetImage(%d,%d %ux%u) failed, X error %d", left_, top_, width_, height_,
+             error);
+        return false;
+    }
+    return true;
+}
+
+bool X11VideoCapturer::Impl::queryPointer(int32_t& x, int32_t& y) {
+    Window root_return = 0;
+    Window child_return = 0;
+    int root_x = 0, root_y = 0, win_x = 0, win_y = 0;
+    unsigned int mask = 0;
+    if (!XQueryPointer(display, root, &root_return, &child_return, &root_x, &root_y, &win_x,
+                       &win_y, &mask)) {
+        // 指针在另一个screen上
+        return false;
+    }
+    x = root_x;
+    y = root_y;
+    return true;
+}
+
+bool X11VideoCapturer::Impl::getCursorImage(CursorInfo& info) {
+    if (!has_fixes) {
+        return false;
+    }
+    XFixesCursorImage* cursor = XFixesGetCursorImage(display);
+    if (cursor == nullptr) {
+        return false;
+    }
+    info.id = static_cast<int32_t>(cursor->cursor_serial);
+    info.hot_x = cursor->xhot;
+    info.hot_y = cursor->yhot;
+    info.format = CursorFormat::Color;
+    info.w = cursor->width;
+    info.h = cursor->height;
+    info.pitch = static_cast<uint16_t>(cursor->width * 4);
+    info.data.resize(static_cast<size_t>(cursor->width) * cursor->height * 4);
+    // 每个像素是一个long里放着的预乘ARGB, 64位系统上long是8字节, 不能直接memcpy
+    uint8_t* dst = info.data.data();
+    for (size_t i = 0; i < static_cast<size_t>(cursor->width) * cursor->height; i++) {
+        const auto argb = static_cast<uint32_t>(cursor->pixels[i]);
+        dst[i * 4 + 0] = static_cast<uint8_t>(argb);
+        dst[i * 4 + 1] = static_cast<uint8_t>(argb >> 8);
+        dst[i * 4 + 2] = static_cast<uint8_t>(argb >> 16);
+        dst[i * 4 + 3] = static_cast<uint8_t>(argb >> 24);
+    }
+    XFree(cursor);
+    return true;
+}
+
+X11VideoCapturer::X11VideoCapturer(ltlib::Monitor monitor)
+    : impl_{std::make_unique<Impl>()}
+    , monitor_{monitor}
+    , vblank_clock_{monitor.frequency > 0 ? static_cast<uint32_t>(monitor.frequency) : 60} {}
+
+X11VideoCapturer::~X11VideoCapturer() = default;
+
+bool X11VideoCapturer::init() {
+    // 用DISPLAY环境变量指定的X server
+    impl_->display = XOpenDisplay(nullptr);
+    if (impl_->display == nullptr) {
+        const char* name = getenv("DISPLAY");
+        LOG(ERR) << "XOpenDisplay failed, DISPLAY=" << (name ? name : "");
+        return false;
+    }
+    impl_->root = DefaultRootWindow(impl_->display);
+    XWindowAttributes attrs{};
+    if (!XGetWindowAttributes(impl_->display, impl_->root, &attrs)) {
+        LOG(ERR) << "XGetWindowAttributes failed";
+        return false;
+    }
+    // 没指定显示器时抓整个root窗口
+    int32_t right = attrs.width;
+    int32_t bottom = attrs.height;
+    if (monitor_.width > 0 && monitor_.height > 0) {
+        left_ = std::max(monitor_.left, 0);
+        top_ = std::max(monitor_.top, 0);
+        right = std::min(monitor_.left + monitor_.width, attrs.width);
+        bottom = std::min(monitor_.top + monitor_.height, attrs.height);
+    }
+    if (right - left_ < 2 || bottom - top_ < 2) {
+        LOGF(ERR, "Monitor(%d,%d %dx%d) is outside of X11 root window(%dx%d)", monitor_.left,
+             monitor_.top, monitor_.width, monitor_.height, attrs.width, attrs.height);
+        return false;
+    }
+    width_ = static_cast<uint32_t>(right - left_) & ~1u;
+    height_ = static_cast<uint32_t>(bottom - top_) & ~1u;
+    if (!impl_->init(left_, top_, width_, height_)) {
+        return false;
+    }
+    LOGF(INFO, "X11VideoCapturer capturing (%d,%d %ux%u), damage:%d, xfixes:%d", left_, top_,
+         width_, height_, impl_->has_damage, impl_->has_fixes);
+    return true;
+}
+
+bool X11VideoCapturer::start() {
+    return true;
+}
+
+std::optional<Capturer::Frame> X11VideoCapturer::capture() {
+    impl_->drainEvents();
+    std::vector<DamageRect> rects;
+    const bool has_damage = impl_->fetchDamage(rects);
+    Capturer::Frame frame{};
+    frame.width = width_;
+    frame.height = height_;
+    if (!first_frame_ && has_damage && rects.empty()) {
+        // 画面没变, 还是上一帧
+        frame.buffer = currentI420();
+        frame.data = frame.buffer->data();
+        frame.capture_timestamp_us = ltlib::steady_now_us();
+        frame.damage = std::move(rects);
+        return frame;
+    }
+    if (!impl_->getImage()) {
+        return std::nullopt;
+    }
+    frame.capture_timestamp_us = ltlib::steady_now_us();
+    if (first_frame_ || !has_damage) {
+        rects = {DamageRect{0, 0, width_, height_}};
+    }
+    auto buffer = writableI420(width_, height_, !first_frame_);
+    if (buffer == nullptr) {
+        return std::nullopt;
+    }
+    const auto* bgra = reinterpret_cast<const uint8_t*>(impl_->image->data);
+    if (!toI420(bgra, impl_->image->bytes_per_line, rects, buffer->data())) {
+        // buffer没跟上, 下一帧整帧重来
+        first_frame_ = true;
+        return std::nullopt;
+    }
+    first_frame_ = false;
+    frame.data = buffer->data();
+    frame.buffer = std::move(buffer);
+    if (has_damage) {
+        frame.damage = std::move(rects);
+    }
+    return frame;
+}
+
+bool X11VideoCapturer::toI420(const uint8_t* bgra, int stride,
+                              const std::vector<DamageRect>& rects, uint8_t* i420) {
+    if (converter_ == nullptr) {
+        // 软编时CPU还要留给编码器, 转换最多用4个线程
+        ColorConverter::Params params{};
+        params.threads = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+        converter_ = ColorConverter::create(params);
+        LOG(INFO) << "X11VideoCapturer color converter using "
+                  << simdLevelToString(converter_->simdLevel()) << " with "
+                  << converter_->threads() << " threads";
+    }
+    const int width = static_cast<int>(width_);
+    const int height = static_cast<int>(height_);
+    uint8_t* y = i420;
+    uint8_t* u = y + width * height;
+    uint8_t* v = u + width * height / 4;
+    for (const auto& rect : rects) {
+        const size_t offset = static_cast<size_t>(rect.y) * width_ + rect.x;
+        const size_t uv_offset = static_cast<size_t>(rect.y / 2) * (width_ / 2) + rect.x / 2;
+        if (!converter_->bgraToI420(bgra + static_cast<size_t>(rect.y) * stride + rect.x * 4,
+                                    stride, y + offset, width, u + uv_offset, width / 2,
+                                    v + uv_offset, width / 2, static_cast<int>(rect.width),
+                                    static_cast<int>(rect.height))) {
+            LOGF(ERR, "ColorConverter::bgraToI420 failed, w:%d, h:%d, stride:%d", width, height,
+                 stride);
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<CursorInfo> X11VideoCapturer::cursorInfo() {
+    impl_->drainEvents();
+    CursorInfo info{};
+    if (cursor_info_.has_value()) {
+        info = cursor_info_.value();
+        info.data.clear();
+    }
+    // 形状只在变了的时候带上
+    if (impl_->cursor_changed) {
+        impl_->cursor_changed = false;
+        if (!impl_->getCursorImage(info) && !cursor_info_.has_value()) {
+            return std::nullopt;
+        }
+    }
+    int32_t x = 0;
+    int32_t y = 0;
+    if (impl_->queryPointer(x, y)) {
+        info.x = x - left_ - info.hot_x;
+        info.y = y - top_ - info.hot_y;
+        info.visible = x >= left_ && y >= top_ && x < left_ + static_cast<int32_t>(width_) &&
+                       y < top_ + static_cast<int32_t>(height_);
+    }
+    else {
+        info.visible = false;
+    }
+    cursor_info_ = info;
+    return info;
+}
+
+void X11VideoCapturer::doneWithFrame() {}
+
+void X11VideoCapturer::waitForVBlank() {
+    vblank_clock_.wait();
+}
+
+Capturer::Backend X11VideoCapturer::backend() const {
+    return Backend::X11;
+}
+
+void* X11VideoCapturer::device() {
+    return nullptr;
+}
+
+void* X11VideoCapturer::deviceContext() {
+    return nullptr;
+}
+
+uint32_t X11VideoCapturer::vendorID() {
+    return 0;
+}
+
+bool X11VideoCapturer::defaultOutput() {
+    return left_ == 0 && top_ == 0;
+}
+
+bool X11VideoCapturer::setCaptureFormat(CaptureFormat format) {
+    if (format == CaptureFormat::MEM_I420) {
+        return true;
+    }
+    LOG(ERR) << "X11VideoCapturer only support CaptureFormat::MEM_I420, got " << (int)format;
+    return false;
+}
+
+} // namespace video
+
+} // namespace lt
@@ -0,0 +1,88 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <ltlib/system.h>
+
+#include <video/capturer/vblank_clock.h>
+#include <video/capturer/video_capturer.h>
+#include <video/convert/color_convert.h>
+
+namespace lt {
+
+namespace video {
+
+// Linux上用MIT-SHM抓X11的root窗口, 只输出MEM_I420.
+// 有XDamage时每次只转换X server报告变化了的区域, 画面没变时连XShmGetImage都省掉.
+// 光标图像和位置来自XFixes. X11的调用都在impl_里, Xlib的宏不会漏到别的文件
+class X11VideoCapturer : public Capturer {
+public:
+    X11VideoCapturer(ltlib::Monitor monitor);
+    ~X11VideoCapturer() override;
+    bool init() override;
+    bool start() override;
+    std::optional<Capturer::Frame> capture() override;
+    std::optional<CursorInfo> cursorInfo() override;
+    void doneWithFrame() override;
+    void waitForVBlank() override;
+    Backend backend() const override;
+    void* device() override;
+    void* deviceContext() override;
+    uint32_t vendorID() override;
+    bool defaultOutput() override;
+    bool setCaptureFormat(CaptureFormat format) override;
+
+private:
+    bool toI420(const uint8_t* bgra, int stride, const std::vector<DamageRect>& rects,
+                uint8_t* i420);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+    ltlib::Monitor monitor_;
+    // 在root窗口里抓取的区域
+    int32_t left_ = 0;
+    int32_t top_ = 0;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    bool first_frame_ = true;
+    std::unique_ptr<ColorConverter> converter_;
+    VBlankClock vblank_clock_;
+    std::optional<CursorInfo> cursor_info_;
+};
+
+} // namespace video
+
+} // namespace lt
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+
+#include <X11/Xlib.h>
+
+#include <ltlib/times.h>
+
+#include "x11_video_capturer.h"
+
+// 需要X server, 没有时全部跳过. 无头环境下可以这样跑:
+//   Xvfb :99 -screen 0 3840x2160x24 &
+//   DISPLAY=:99 ./test_x11_capturer
+
+using lt::video::Capturer;
+using lt::video::DamageRect;
+
+namespace {
+
+class X11CapturerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        display_ = XOpenDisplay(nullptr);
+        if (display_ == nullptr) {
+            GTEST_SKIP() << "No X server, run under Xvfb";
+        }
+        root_ = DefaultRootWindow(display_);
+        XWindowAttributes attrs{};
+        XGetWindowAttributes(display_, root_, &attrs);
+        root_width_ = attrs.width;
+        root_height_ = attrs.height;
+        gc_ = XCreateGC(display_, root_, 0, nullptr);
+    }
+
+    void TearDown() override {
+        if (display_ != nullptr) {
+            XFreeGC(display_, gc_);
+            XCloseDisplay(display_);
+        }
+    }
+
+    void fill(uint32_t rgb, int x, int y, int w, int h) {
+        XSetForeground(display_, gc_, rgb);
+        XFillRectangle(display_, root_, gc_, x, y, static_cast<unsigned>(w),
+                       static_cast<unsigned>(h));
+        XSync(display_, False);
+    }
+
+    std::unique_ptr<Capturer> create(int32_t width = 0, int32_t height = 0) {
+        ltlib::Monitor monitor{};
+        monitor.width = width;
+        monitor.height = height;
+        monitor.right = width;
+        monitor.bottom = height;
+        return Capturer::create(Capturer::Backend::X11, monitor);
+    }
+
+    Display* display_ = nullptr;
+    Window root_ = 0;
+    GC gc_ = nullptr;
+    int root_width_ = 0;
+    int root_height_ = 0;
+};
+
+// BT.601 limited range
+uint8_t refY(uint32_t rgb) {
+    const int r = (rgb >> 16) & 0xff;
+    const int g = (rgb >> 8) & 0xff;
+    const int b = rgb & 0xff;
+    return static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 128) / 256 + 16);
+}
+
+} // namespace
+
+TEST_F(X11CapturerTest, SolidColor) {
+    fill(0x3366cc, 0, 0, root_width_, root_height_);
+    auto capturer = create();
+    ASSERT_NE(capturer, nullptr);
+    EXPECT_EQ(capturer->backend(), Capturer::Backend::X11);
+    EXPECT_TRUE(capturer->setCaptureFormat(lt::video::CaptureFormat::MEM_I420));
+    EXPECT_FALSE(capturer->setCaptureFormat(lt::video::CaptureFormat::D3D11_BGRA));
+    auto frame = capturer->capture();
+    ASSERT_TRUE(frame.has_value());
+    const auto* y = static_cast<const uint8_t*>(frame->data);
+    const size_t width = static_cast<size_t>(root_width_) & ~size_t{1};
+    EXPECT_NEAR(y[0], refY(0x3366cc), 1);
+    EXPECT_NEAR(y[width * 10 + 100], refY(0x3366cc), 1);
+}
+
+TEST_F(X11CapturerTest, DamageRects) {
+    fill(0x000000, 0, 0, root_width_, root_height_);
+    auto capturer = create();
+    ASSERT_NE(capturer, nullptr);
+    auto frame = capturer->capture();
+    ASSERT_TRUE(frame.has_value());
+    if (!frame->damage.has_value()) {
+        GTEST_SKIP() << "X server doesn't support XDamage";
+    }
+    // 第一帧整帧都算变化
+    ASSERT_EQ(frame->damage->size(), 1u);
+    EXPECT_EQ(frame->damage->front().width, static_cast<uint32_t>(root_width_) & ~1u);
+
+    frame = capturer->capture();
+    ASSERT_TRUE(frame.has_value());
+    ASSERT_TRUE(frame->damage.has_value());
+    EXPECT_TRUE(frame->damage->empty());
+
+    fill(0xffffff, 101, 51, 40, 30);
+    frame = capturer->capture();
+    ASSERT_TRUE(frame.has_value());
+    ASSERT_TRUE(frame->damage.has_value());
+    ASSERT_FALSE(frame->damage->empty());
+    uint32_t x0 = UINT32_MAX, y0 = UINT32_MAX, x1 = 0, y1 = 0;
+    for (const DamageRect& rect : frame->damage.value()) {
+        EXPECT_EQ(rect.x % 2, 0u);
+        EXPECT_EQ(rect.y % 2, 0u);
+        x0 = std::min(x0, rect.x);
+        y0 = std::min(y0, rect.y);
+        x1 = std::max(x1, rect.x + rect.width);
+        y1 = std::max(y1, rect.y + rect.height);
+    }
+    EXPECT_LE(x0, 101u);
+    EXPECT_LE(y0, 51u);
+    EXPECT_GE(x1, 141u);
+    EXPECT_GE(y1, 81u);
+    // 远小于整帧
+    EXPECT_LT((x1 - x0) * (y1 - y0), 100u * 100u);
+    const auto* y = static_cast<const uint8_t*>(frame->data);
+    const size_t width = static_cast<size_t>(root_width_) & ~size_t{1};
+    EXPECT_NEAR(y[width * 60 + 110], refY(0xffffff), 1);
+    EXPECT_NEAR(y[width * 10 + 10], refY(0x000000), 1);
+}
+
+TEST_F(X11CapturerTest, Cursor) {
+    auto capturer = create();
+    ASSERT_NE(capturer, nullptr);
+    ASSERT_TRUE(capturer->capture().has_value());
+    auto cursor = capturer->cursorInfo();
+    if (!cursor.has_value()) {
+        GTEST_SKIP() << "X server doesn't support XFixes";
+    }
+    EXPECT_EQ(cursor->format, lt::video::CursorFormat::Color);
+    EXPECT_GT(cursor->w, 0u);
+    EXPECT_EQ(cursor->data.size(), cursor->w * cursor->h * 4);
+    // 形状没变时只有位置
+    XWarpPointer(display_, None, root_, 0, 0, 0, 0, 200, 100);
+    XSync(display_, False);
+    auto cursor2 = capturer->cursorInfo();
+    ASSERT_TRUE(cursor2.has_value());
+    EXPECT_TRUE(cursor2->data.empty());
+    EXPECT_EQ(cursor2->id, cursor->id);
+    EXPECT_TRUE(cursor2->visible);
+    EXPECT_EQ(cursor2->x, 200 - cursor2->hot_x);
+    EXPECT_EQ(cursor2->y, 100 - cursor2->hot_y);
+}
+
+// 每帧都整屏变化时抓取+转换的耗时和CPU占用, 以及画面静止时的开销
+TEST_F(X11CapturerTest, Benchmark) {
+    const struct {
+        int32_t width;
+        int32_t height;
+    } sizes[] = {{1920, 1080}, {3840, 2160}};
+    for (auto size : sizes) {
+        if (size.width > root_width_ || size.height > root_height_) {
+            printf("%dx%d: skipped, root window is %dx%d\n", size.width, size.height,
+                   root_width_, root_height_);
+            continue;
+        }
+        auto capturer = create(size.width, size.height);
+        ASSERT_NE(capturer, nullptr);
+        ASSERT_TRUE(capturer->capture().has_value());
+        constexpr int kFrames = 60;
+        int64_t busy_us = 0;
+        int64_t idle_us = 0;
+        std::clock_t busy_cpu = 0;
+        std::clock_t idle_cpu = 0;
+        for (int i = 0; i < kFrames; i++) {
+            fill(i % 2 ? 0x204080 : 0x804020, 0, 0, size.width, size.height);
+            std::clock_t cpu = std::clock();
+            int64_t start = ltlib::steady_now_us();
+            ASSERT_TRUE(capturer->capture().has_value());
+            busy_us += ltlib::steady_now_us() - start;
+            busy_cpu += std::clock() - cpu;
+
+            cpu = std::clock();
+            start = ltlib::steady_now_us();
+            ASSERT_TRUE(capturer->capture().has_value());
+            idle_us += ltlib::steady_now_us() - start;
+            idle_cpu += std::clock() - cpu;
+        }
+        // 测试进程的CPU时间包括了转换线程, 不包括X server拷贝到共享内存的那部分
+        printf("%dx%d: full damage %.2fms/frame cpu %.2fms, static %.3fms/frame cpu %.3fms\n",
+               size.width, size.height, busy_us / 1000.0 / kFrames,
+               busy_cpu * 1000.0 / CLOCKS_PER_SEC / kFrames, idle_us / 1000.0 / kFrames,
+               idle_cpu * 1000.0 / CLOCKS_PER_SEC / kFrames);
+    }
+}
@@ -0,0 +1,330 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <ltlib/spsc_queue.h>
+#include <ltlib/threads.h>
+#include <ltlib/times.h>
+
+#include <video/capturer/video_capturer.h>
+
+namespace lt {
+
+namespace video {
+
+// 把抓屏, 编码, 发送拆成流水线, 帧率取决于最慢的那一段而不是几段耗时加起来.
+// 抓屏->编码之间是只保留最新一帧的LatestSlot, 编码跟不上时还没编的旧帧直接被新帧替换;
+// 编码->发送之间是有界的SpscQueue, 已经编出来的帧不能丢, 所以队列满时这一帧不编.
+// stages为1时和原来一样全在抓屏线程里做, 为2时只把发送拆出去, 为3时三段各一个线程.
+// 抓屏线程本身由调用方提供, 每轮调一次tick(), 抓到要编的帧时调push().
+// 帧在编码线程里用的时候抓屏线程已经开始抓下一帧了, 所以stages为3时帧必须带着buffer
+// 显示模式变了时流水线不停, 编码线程拿到新分辨率的第一帧时通过on_resolution_changed换编码器
+template <typename Packet> class FrameStages {
+public:
+    struct Params {
+        uint32_t stages = 3;
+        uint32_t send_queue_size = 4;
+        // 在编码所在的线程里每轮调一次, 编码器和码控只在这个线程里访问
+        std::function<void()> on_encode_loop;
+        // 返回nullptr表示没编出来
+        std::function<Packet(const Capturer::Frame&)> encode;
+        std::function<void(const Packet&)> send;
+        // 可选, 在编码所在的线程里调用. 要编的帧和上一帧分辨率不一样时先调它换编码器,
+        // 返回false表示没换成, 这一帧不编. 第一帧也会调一次, 和编码器一样大时直接返回true.
+        // 帧不知道自己的分辨率时不检查
+        std::function<bool(uint32_t width, uint32_t height)> on_resolution_changed;
+        std::string thread_prefix = "lt_video";
+    };
+    struct Timing {
+        uint64_t frames = 0;
+        int64_t total_us = 0;
+        int64_t max_us = 0;
+        double avgMs() const { return frames == 0 ? 0 : total_us / 1000.0 / frames; }
+    };
+    struct Stats {
+        Timing capture;
+        Timing encode;
+        Timing send;
+        // 从抓屏时间戳到发送完
+        Timing latency;
+        // 还没来得及编就被新帧替换掉的
+        uint64_t replaced = 0;
+        // 发送队列满了没编的
+        uint64_t send_queue_full = 0;
+        // 流水线没停, 中途换了几次分辨率
+        uint64_t resolution_changes = 0;
+    };
+
+public:
+    static std::unique_ptr<FrameStages> create(const Params& params) {
+        if (params.stages < 1 || params.stages > 3 || params.send_queue_size == 0 ||
+            params.on_encode_loop == nullptr || params.encode == nullptr ||
+            params.send == nullptr) {
+            return nullptr;
+        }
+        return std::unique_ptr<FrameStages>{new FrameStages{params}};
+    }
+
+    ~FrameStages() { stop(); }
+
+    bool start() {
+        stopped_ = false;
+        if (params_.stages >= 2) {
+            send_thread_ = ltlib::BlockingThread::create(
+                params_.thread_prefix + "_send",
+                [this](const std::function<void()>& i_am_alive) { sendLoop(i_am_alive); });
+            if (send_thread_ == nullptr) {
+                return false;
+            }
+        }
+        if (params_.stages == 3) {
+            encode_thread_ = ltlib::BlockingThread::create(
+                params_.thread_prefix + "_encode",
+                [this](const std::function<void()>& i_am_alive) { encodeLoop(i_am_alive); });
+            if (encode_thread_ == nullptr) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void stop() {
+        stopped_ = true;
+        encode_wakeup_.notify();
+        send_wakeup_.notify();
+        encode_thread_.reset();
+        send_thread_.reset();
+    }
+
+    uint32_t stages() const { return params_.stages; }
+
+    // 以下在抓屏线程调用
+    void tick() {
+        if (params_.stages < 3) {
+            params_.on_encode_loop();
+        }
+    }
+
+    void recordCapture(int64_t capture_us) { capture_.add(capture_us); }
+
+    void push(Capturer::Frame frame) {
+        if (params_.stages < 3) {
+            encodeOne(frame);
+            return;
+        }
+        if (pending_frame_.put(std::move(frame))) {
+            replaced_.fetch_add(1, std::memory_order_relaxed);
+        }
+        encode_wakeup_.notify();
+    }
+
+    // 取出上一次调用以来的统计
+    Stats takeStats() {
+        Stats stats;
+        stats.capture = capture_.take();
+        stats.encode = encode_.take();
+        stats.send = send_.take();
+        stats.latency = latency_.take();
+        stats.replaced = replaced_.exchange(0, std::memory_order_relaxed);
+        stats.send_queue_full = send_queue_full_.exchange(0, std::memory_order_relaxed);
+        stats.resolution_changes = resolution_changes_.exchange(0, std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Encoded {
+        Packet packet;
+        int64_t capture_timestamp_us = 0;
+    };
+
+    class AtomicTiming {
+    public:
+        void add(int64_t us) {
+            frames_.fetch_add(1, std::memory_order_relaxed);
+            total_us_.fetch_add(us, std::memory_order_relaxed);
+            int64_t max_us = max_us_.load(std::memory_order_relaxed);
+            while (us > max_us &&
+                   !max_us_.compare_exchange_weak(max_us, us, std::memory_order_relaxed)) {
+            }
+        }
+        Timing take() {
+            Timing timing;
+            timing.frames = frames_.exchange(0, std::memory_order_relaxed);
+            timing.total_us = total_us_.exchange(0, std::memory_order_relaxed);
+            timing.max_us = max_us_.exchange(0, std::memory_order_relaxed);
+            return timing;
+        }
+
+    private:
+        std::atomic<uint64_t> frames_{0};
+        std::atomic<int64_t> total_us_{0};
+        std::atomic<int64_t> max_us_{0};
+    };
+
+    // 队列本身无锁, 这个只用来在没东西可做时睡眠, 通知是粘滞的不会丢
+    class Wakeup {
+    public:
+        void notify() {
+            {
+                std::lock_guard lock{mutex_};
+                notified_ = true;
+            }
+            cv_.notify_one();
+        }
+        void waitFor(std::chrono::microseconds timeout) {
+            std::unique_lock lock{mutex_};
+            cv_.wait_for(lock, timeout, [this]() { return notified_; });
+            notified_ = false;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool notified_ = false;
+    };
+
+private:
+    FrameStages(const Params& params)
+        : params_{params}
+        , encoded_{params.send_queue_size} {}
+
+    void encodeOne(const Capturer::Frame& frame) {
+        // 发送队列只有编码线程在push, 这里看到没满, 编完一定放得进去
+        if (params_.stages >= 2 && encoded_.full()) {
+            send_queue_full_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (!checkResolution(frame)) {
+            return;
+        }
+        const int64_t start_us = ltlib::steady_now_us();
+        Packet packet = params_.encode(frame);
+        encode_.add(ltlib::steady_now_us() - start_us);
+        if (packet == nullptr) {
+            return;
+        }
+        if (params_.stages == 1) {
+            sendOne(packet, frame.capture_timestamp_us);
+            return;
+        }
+        encoded_.push(Encoded{std::move(packet), frame.capture_timestamp_us});
+        send_wakeup_.notify();
+    }
+
+    bool checkResolution(const Capturer::Frame& frame) {
+        if (frame.width == 0 || frame.height == 0 ||
+            (frame.width == width_ && frame.height == height_)) {
+            return true;
+        }
+        if (params_.on_resolution_changed != nullptr &&
+            !params_.on_resolution_changed(frame.width, frame.height)) {
+            return false;
+        }
+        // 第一帧只是记下来
+        if (width_ != 0) {
+            resolution_changes_.fetch_add(1, std::memory_order_relaxed);
+        }
+        width_ = frame.width;
+        height_ = frame.height;
+        return true;
+    }
+
+    void sendOne(const Packet& packet, int64_t capture_timestamp_us) {
+        const int64_t start_us = ltlib::steady_now_us();
+        params_.send(packet);
+        const int64_t end_us = ltlib::steady_now_us();
+        send_.add(end_us - start_us);
+        latency_.add(end_us - capture_timestamp_us);
+    }
+
+    void encodeLoop(const std::function<void()>& i_am_alive) {
+        // 没有新帧时也要定期醒来处理编码器和码控的任务
+        constexpr std::chrono::microseconds kIdleWait{5'000};
+        while (!stopped_) {
+            i_am_alive();
+            params_.on_encode_loop();
+            auto frame = pending_frame_.take();
+            if (frame.has_value()) {
+                encodeOne(frame.value());
+            }
+            else {
+                encode_wakeup_.waitFor(kIdleWait);
+            }
+        }
+    }
+
+    void sendLoop(const std::function<void()>& i_am_alive) {
+        constexpr std::chrono::microseconds kIdleWait{100'000};
+        while (!stopped_) {
+            i_am_alive();
+            auto encoded = encoded_.pop();
+            if (encoded.has_value()) {
+                sendOne(encoded->packet, encoded->capture_timestamp_us);
+            }
+            else {
+                send_wakeup_.waitFor(kIdleWait);
+            }
+        }
+    }
+
+private:
+    const Params params_;
+    std::atomic<bool> stopped_{true};
+    std::unique_ptr<ltlib::BlockingThread> encode_thread_;
+    std::unique_ptr<ltlib::BlockingThread> send_thread_;
+    ltlib::LatestSlot<Capturer::Frame> pending_frame_;
+    ltlib::SpscQueue<Encoded> encoded_;
+    Wakeup encode_wakeup_;
+    Wakeup send_wakeup_;
+    AtomicTiming capture_;
+    AtomicTiming encode_;
+    AtomicTiming send_;
+    AtomicTiming latency_;
+    std::atomic<uint64_t> replaced_{0};
+    std::atomic<uint64_t> send_queue_full_{0};
+    std::atomic<uint64_t> resolution_changes_{0};
+    // 只在编码所在的线程访问, 最近一次编的帧的分辨率
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+};
+
+} // namespace video
+
+} // namespace lt
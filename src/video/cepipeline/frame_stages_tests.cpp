@@ -0,0 +1,364 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <ltproto/client2worker/video_frame.pb.h>
+
+#include <ltlib/threads.h>
+#include <ltlib/times.h>
+#include <video/capturer/synthetic_video_capturer.h>
+#include <video/encoder/openh264_encoder.h>
+
+#include "frame_stages.h"
+
+using lt::video::Capturer;
+using lt::video::EncodeParamsHelper;
+using lt::video::OpenH264Encoder;
+using lt::video::SyntheticVideoCapturer;
+
+namespace {
+
+struct Packet {
+    uint64_t id;
+};
+using PacketPtr = std::shared_ptr<Packet>;
+using Stages = lt::video::FrameStages<PacketPtr>;
+// 和VCEPipeline一样, 流水线里传的是编码器吐出来的消息
+using VideoFramePtr = std::shared_ptr<ltproto::client2worker::VideoFrame>;
+using VideoStages = lt::video::FrameStages<VideoFramePtr>;
+
+// 用capture_timestamp_us当帧号
+Capturer::Frame makeFrame(int64_t id) {
+    static uint8_t dummy[16]{};
+    Capturer::Frame frame{};
+    frame.data = dummy;
+    frame.capture_timestamp_us = id;
+    return frame;
+}
+
+void sleepUs(int64_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds{us});
+}
+
+// 软编, 选项和worker的默认值一样: 单线程, 一帧一个slice
+std::unique_ptr<OpenH264Encoder> makeEncoder(uint32_t width, uint32_t height) {
+    EncodeParamsHelper params{nullptr, nullptr, -1,        lt::VideoCodecType::H264_420_SOFT,
+                              width,   height,  60,        8'000'000, true};
+    return OpenH264Encoder::create(params);
+}
+
+} // namespace
+
+class FrameStagesTest : public ::testing::Test {
+protected:
+    // 流水线的线程是BlockingThread, 要向ThreadWatcher注册
+    static void SetUpTestSuite() { ltlib::ThreadWatcher::init(std::this_thread::get_id()); }
+    static void TearDownTestSuite() { ltlib::ThreadWatcher::uninit(); }
+};
+
+TEST_F(FrameStagesTest, InvalidParams) {
+    Stages::Params params{};
+    params.on_encode_loop = []() {};
+    params.encode = [](const Capturer::Frame&) { return nullptr; };
+    params.send = [](const PacketPtr&) {};
+    params.stages = 0;
+    EXPECT_EQ(Stages::create(params), nullptr);
+    params.stages = 4;
+    EXPECT_EQ(Stages::create(params), nullptr);
+    params.stages = 3;
+    params.send = nullptr;
+    EXPECT_EQ(Stages::create(params), nullptr);
+}
+
+// 编码和发送都跟得上时, 不管几段每一帧都按顺序发出去
+TEST_F(FrameStagesTest, NoLossWhenFast) {
+    for (uint32_t stages = 1; stages <= 3; stages++) {
+        std::vector<uint64_t> sent;
+        std::atomic<uint64_t> sent_count{0};
+        Stages::Params params{};
+        params.stages = stages;
+        params.on_encode_loop = []() {};
+        params.encode = [](const Capturer::Frame& frame) {
+            auto packet = std::make_shared<Packet>();
+            packet->id = static_cast<uint64_t>(frame.capture_timestamp_us);
+            return packet;
+        };
+        params.send = [&](const PacketPtr& packet) {
+            sent.push_back(packet->id);
+            sent_count++;
+        };
+        auto pipeline = Stages::create(params);
+        ASSERT_NE(pipeline, nullptr);
+        ASSERT_TRUE(pipeline->start());
+        constexpr uint64_t kFrames = 50;
+        for (uint64_t i = 0; i < kFrames; i++) {
+            pipeline->tick();
+            pipeline->push(makeFrame(static_cast<int64_t>(i)));
+            // 给编码线程留出时间, 模拟60帧的间隔
+            for (int wait = 0; wait < 1000 && sent_count <= i; wait++) {
+                sleepUs(100);
+            }
+        }
+        pipeline->stop();
+        ASSERT_EQ(sent.size(), kFrames) << "stages " << stages;
+        for (uint64_t i = 0; i < kFrames; i++) {
+            EXPECT_EQ(sent[i], i);
+        }
+        auto stats = pipeline->takeStats();
+        EXPECT_EQ(stats.encode.frames, kFrames);
+        EXPECT_EQ(stats.send.frames, kFrames);
+        EXPECT_EQ(stats.replaced, 0u);
+        EXPECT_EQ(stats.send_queue_full, 0u);
+    }
+}
+
+// 编码慢的时候还没编的帧被新帧替换, 编出来的帧号单调递增, 最后一帧一定会编
+TEST_F(FrameStagesTest, ReplaceStaleFrames) {
+    std::vector<uint64_t> sent;
+    std::atomic<uint64_t> last_sent{0};
+    Stages::Params params{};
+    params.stages = 3;
+    params.on_encode_loop = []() {};
+    params.encode = [](const Capturer::Frame& frame) {
+        sleepUs(10'000);
+        auto packet = std::make_shared<Packet>();
+        packet->id = static_cast<uint64_t>(frame.capture_timestamp_us);
+        return packet;
+    };
+    params.send = [&](const PacketPtr& packet) {
+        sent.push_back(packet->id);
+        last_sent = packet->id;
+    };
+    auto pipeline = Stages::create(params);
+    ASSERT_TRUE(pipeline->start());
+    constexpr uint64_t kFrames = 100;
+    for (uint64_t i = 1; i <= kFrames; i++) {
+        pipeline->push(makeFrame(static_cast<int64_t>(i)));
+        sleepUs(1'000);
+    }
+    for (int wait = 0; wait < 1000 && last_sent != kFrames; wait++) {
+        sleepUs(1'000);
+    }
+    pipeline->stop();
+    ASSERT_FALSE(sent.empty());
+    EXPECT_EQ(sent.back(), kFrames);
+    for (size_t i = 1; i < sent.size(); i++) {
+        EXPECT_GT(sent[i], sent[i - 1]);
+    }
+    auto stats = pipeline->takeStats();
+    EXPECT_GT(stats.replaced, 0u);
+    EXPECT_EQ(stats.replaced + stats.encode.frames, kFrames);
+}
+
+// 发送慢的时候队列满了就不编, 编出来的包一个都不丢
+TEST_F(FrameStagesTest, SendBackpressure) {
+    std::atomic<uint64_t> encoded{0};
+    std::atomic<uint64_t> sent{0};
+    Stages::Params params{};
+    params.stages = 2;
+    params.send_queue_size = 2;
+    params.on_encode_loop = []() {};
+    params.encode = [&](const Capturer::Frame&) {
+        auto packet = std::make_shared<Packet>();
+        packet->id = encoded++;
+        return packet;
+    };
+    params.send = [&](const PacketPtr& packet) {
+        EXPECT_EQ(packet->id, sent.load());
+        sleepUs(5'000);
+        sent++;
+    };
+    auto pipeline = Stages::create(params);
+    ASSERT_TRUE(pipeline->start());
+    for (int i = 0; i < 50; i++) {
+        pipeline->tick();
+        pipeline->push(makeFrame(i));
+        sleepUs(500);
+    }
+    for (int wait = 0; wait < 1000 && sent != encoded; wait++) {
+        sleepUs(1'000);
+    }
+    pipeline->stop();
+    EXPECT_EQ(sent.load(), encoded.load());
+    auto stats = pipeline->takeStats();
+    EXPECT_GT(stats.send_queue_full, 0u);
+    EXPECT_EQ(stats.send_queue_full + stats.encode.frames, 50u);
+}
+
+// 编码器相关的任务跑在编码所在的线程里
+TEST_F(FrameStagesTest, EncodeLoopThread) {
+    for (uint32_t stages = 1; stages <= 3; stages++) {
+        std::atomic<bool> on_capture_thread{false};
+        std::atomic<bool> on_other_thread{false};
+        const auto capture_thread = std::this_thread::get_id();
+        Stages::Params params{};
+        params.stages = stages;
+        params.on_encode_loop = [&]() {
+            if (std::this_thread::get_id() == capture_thread) {
+                on_capture_thread = true;
+            }
+            else {
+                on_other_thread = true;
+            }
+        };
+        params.encode = [](const Capturer::Frame&) { return nullptr; };
+        params.send = [](const PacketPtr&) {};
+        auto pipeline = Stages::create(params);
+        ASSERT_TRUE(pipeline->start());
+        for (int i = 0; i < 10; i++) {
+            pipeline->tick();
+            sleepUs(2'000);
+        }
+        pipeline->stop();
+        EXPECT_EQ(on_capture_thread.load(), stages < 3) << "stages " << stages;
+        EXPECT_EQ(on_other_thread.load(), stages == 3) << "stages " << stages;
+    }
+}
+
+// 抓屏中途换分辨率, 流水线不停, 编码线程在新分辨率的第一帧前给编码器换分辨率
+TEST_F(FrameStagesTest, ResolutionChange) {
+    if (makeEncoder(640, 360) == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    for (uint32_t stages = 1; stages <= 3; stages++) {
+        SyntheticVideoCapturer::Params capture_params{};
+        capture_params.width = 640;
+        capture_params.height = 360;
+        capture_params.fps = 0;
+        auto capturer = SyntheticVideoCapturer::create(capture_params);
+        ASSERT_NE(capturer, nullptr);
+        // 以下只在编码线程访问, stop()之后才在这里读
+        auto encoder = makeEncoder(640, 360);
+        ASSERT_NE(encoder, nullptr);
+        std::vector<std::pair<uint32_t, uint32_t>> changes;
+        std::vector<uint32_t> encoded_widths;
+        std::atomic<uint64_t> encoded{0};
+        std::atomic<uint64_t> sent{0};
+        // 只在发送线程访问
+        std::vector<bool> sent_keyframes;
+        VideoStages::Params params{};
+        params.stages = stages;
+        params.on_encode_loop = []() {};
+        params.on_resolution_changed = [&](uint32_t width, uint32_t height) {
+            changes.emplace_back(width, height);
+            if (width == encoder->width() && height == encoder->height()) {
+                return true;
+            }
+            // 和VCEPipeline一样, OpenH264不用重建, 下一帧是新分辨率的IDR
+            return encoder->changeResolution(width, height);
+        };
+        params.encode = [&](const Capturer::Frame& frame) {
+            EXPECT_EQ(frame.width, encoder->width());
+            encoded_widths.push_back(frame.width);
+            auto encoded_frame = encoder->encode(frame);
+            if (encoded_frame != nullptr) {
+                encoded++;
+            }
+            return encoded_frame;
+        };
+        params.send = [&](const VideoFramePtr& frame) {
+            sent_keyframes.push_back(frame->is_keyframe());
+            sent++;
+        };
+        auto pipeline = VideoStages::create(params);
+        ASSERT_TRUE(pipeline->start());
+        constexpr int kFrames = 60;
+        for (int i = 0; i < kFrames; i++) {
+            if (i == kFrames / 2) {
+                ASSERT_TRUE(capturer->changeResolution(1280, 720));
+            }
+            pipeline->tick();
+            auto frame = capturer->capture();
+            ASSERT_TRUE(frame.has_value());
+            pipeline->push(std::move(frame.value()));
+            capturer->doneWithFrame();
+            for (int wait = 0; wait < 1000 && sent.load() <= static_cast<uint64_t>(i); wait++) {
+                sleepUs(100);
+            }
+        }
+        pipeline->stop();
+        ASSERT_EQ(changes.size(), 2u) << "stages " << stages;
+        EXPECT_EQ(changes[0], std::make_pair(640u, 360u));
+        EXPECT_EQ(changes[1], std::make_pair(1280u, 720u));
+        ASSERT_EQ(encoded_widths.size(), static_cast<size_t>(kFrames));
+        for (int i = 0; i < kFrames; i++) {
+            EXPECT_EQ(encoded_widths[i], i < kFrames / 2 ? 640u : 1280u) << "frame " << i;
+        }
+        EXPECT_EQ(sent.load(), encoded.load());
+        ASSERT_EQ(sent_keyframes.size(), static_cast<size_t>(kFrames));
+        for (int i = 0; i < kFrames; i++) {
+            EXPECT_EQ(sent_keyframes[i], i == 0 || i == kFrames / 2) << "frame " << i;
+        }
+        auto stats = pipeline->takeStats();
+        EXPECT_EQ(stats.resolution_changes, 1u);
+        EXPECT_EQ(stats.encode.frames, static_cast<uint64_t>(kFrames));
+    }
+}
+
+// 1080p合成画面+OpenH264软编, 不限帧率跑满, 对比不同段数的吞吐
+TEST_F(FrameStagesTest, Throughput) {
+    constexpr uint32_t kWidth = 1920;
+    constexpr uint32_t kHeight = 1080;
+    constexpr int64_t kDurationUs = 2'000'000;
+    if (makeEncoder(kWidth, kHeight) == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    double fps_by_stages[4]{};
+    double encode_ms_by_stages[4]{};
+    printf("%7s %8s %12s %12s %12s %14s %9s\n", "stages", "fps", "capture(ms)", "encode(ms)",
+           "send(ms)", "latency(ms)", "replaced");
+    for (uint32_t stages = 1; stages <= 3; stages++) {
+        SyntheticVideoCapturer::Params capture_params{};
+        capture_params.width = kWidth;
+        capture_params.height = kHeight;
+        capture_params.fps = 0;
+        capture_params.pattern = SyntheticVideoCapturer::Pattern::ScrollingText;
+        auto capturer = SyntheticVideoCapturer::create(capture_params);
+        ASSERT_NE(capturer, nullptr);
+        auto encoder = makeEncoder(kWidth, kHeight);
+        ASSERT_NE(encoder, nullptr);
+        std::string wire;
+        VideoStages::Params params{};
+        params.stages = stages;
+        params.on_encode_loop = []() {};
+        params.encode = [&](const Capturer::Frame& frame) { return encoder->encode(frame); };
+        // 序列化成消息, 代替写socket
+        params.send = [&wire](const VideoFramePtr& frame) { frame->SerializeToString(&wire); };
+        auto pipeline = VideoStages::create(params);
+        ASSERT_TRUE(pipeline->start());
+        const int64_t start_us = ltlib::steady_now_us();
+        while (ltlib::steady_now_us() - start_us < kDurationUs) {
+            pipeline->tick();
+            const int64_t capture_start_us = ltlib::steady_now_us();
+            auto frame = capturer->capture();
+            ASSERT_TRUE(frame.has_value());
+            // 合成画面的时间戳是名义上的vblank时间, 这里用真实的抓屏时间
+            frame->capture_timestamp_us = capture_start_us;
+            pipeline->recordCapture(ltlib::steady_now_us() - capture_start_us);
+            pipeline->push(std::move(frame.value()));
+            capturer->doneWithFrame();
+        }
+        pipeline->stop();
+        auto stats = pipeline->takeStats();
+        fps_by_stages[stages] = stats.send.frames * 1e6 / kDurationUs;
+        encode_ms_by_stages[stages] = stats.encode.avgMs();
+        printf("%7u %8.1f %12.2f %12.2f %12.2f %14.2f %9llu\n", stages, fps_by_stages[stages],
+               stats.capture.avgMs(), stats.encode.avgMs(), stats.send.avgMs(),
+               stats.latency.avgMs(), static_cast<unsigned long long>(stats.replaced));
+        EXPECT_GT(stats.send.frames, 0u);
+    }
+    // 软编比抓屏和发送慢得多, 分成三段后帧率只受编码耗时限制, 抓屏和发送的时间都藏起来了.
+    // 核数不够时几段挤在同一个核上, 看不出差别
+    if (std::thread::hardware_concurrency() >= 3) {
+        EXPECT_GT(fps_by_stages[3], 1000.0 / encode_ms_by_stages[3] * 0.9);
+        EXPECT_GE(fps_by_stages[3], fps_by_stages[1]);
+    }
+}
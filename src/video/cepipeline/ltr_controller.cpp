@@ -0,0 +1,110 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ltr_controller.h"
+
+#include <algorithm>
+
+namespace lt {
+
+namespace video {
+
+LtrController::LtrController(const Params& params)
+    : params_{params} {}
+
+void LtrController::onEncoded(int64_t picture_id, const uint8_t* data, size_t size) {
+    auto info = parser_.parse(data, size);
+    if (!info.has_value()) {
+        return;
+    }
+    current_frame_num_ = info->frame_num;
+    if (info->idr) {
+        // 新的IDR周期里之前的LTR都作废了
+        marks_.clear();
+        idr_pic_id_ = info->idr_pic_id;
+    }
+    if (!info->long_term_mark) {
+        return;
+    }
+    marks_.push_back({picture_id, Ref{info->idr_pic_id, info->frame_num}, false});
+    stats_.marked++;
+    while (marks_.size() > params_.max_marks) {
+        marks_.pop_front();
+    }
+}
+
+std::vector<LtrController::MarkFeedback> LtrController::onAck(int64_t picture_id) {
+    std::vector<MarkFeedback> feedbacks;
+    for (auto iter = marks_.begin(); iter != marks_.end();) {
+        if (iter->acked || iter->picture_id > picture_id) {
+            ++iter;
+            continue;
+        }
+        if (iter->picture_id == picture_id) {
+            iter->acked = true;
+            feedbacks.push_back({iter->ref, true});
+            stats_.acked++;
+            ++iter;
+        }
+        else {
+            // ack是按顺序回来的, 后面的帧都收到了它还没收到, 这一帧丢了
+            feedbacks.push_back({iter->ref, false});
+            stats_.lost++;
+            iter = marks_.erase(iter);
+        }
+    }
+    return feedbacks;
+}
+
+std::optional<LtrController::Recovery> LtrController::onRecoveryRequest(int64_t ltr_picture_id) {
+    auto iter = std::find_if(marks_.begin(), marks_.end(), [ltr_picture_id](const Mark& mark) {
+        return mark.picture_id == ltr_picture_id;
+    });
+    if (ltr_picture_id < 0 || iter == marks_.end() || !iter->acked ||
+        iter->ref.idr_pic_id != idr_pic_id_) {
+        stats_.idr_fallback++;
+        return std::nullopt;
+    }
+    // 出错之后标记的LTR客户端没能正确解码, 不能再拿来恢复
+    const Ref ref = iter->ref;
+    marks_.erase(iter + 1, marks_.end());
+    stats_.recovered++;
+    return Recovery{ref, current_frame_num_};
+}
+
+LtrController::Stats LtrController::takeStats() {
+    Stats stats = stats_;
+    stats_ = Stats{};
+    return stats;
+}
+
+} // namespace video
+
+} // namespace lt
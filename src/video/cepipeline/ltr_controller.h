@@ -0,0 +1,103 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#include <video/h264/h264_parser.h>
+
+namespace lt {
+
+namespace video {
+
+// 长期参考帧(LTR)的标记和确认. 编码器隔一段时间把一帧标记成LTR, 客户端对这一帧回的
+// VideoFrameAck1就当作标记成功, 之后的ack越过了它还没等到就当作标记失败. 客户端解码出错时
+// 带着最后一个正确解码的LTR请求恢复, 编码器参考这个LTR编一个P帧, 代替IDR.
+// 不涉及IO和线程, 由VCEPipeline在编码线程驱动
+class LtrController {
+public:
+    struct Params {
+        // 最多记住多少个标记过的LTR, 编码器自己一般只留2个
+        size_t max_marks = 8;
+    };
+    struct Ref {
+        uint32_t idr_pic_id;
+        uint32_t frame_num;
+    };
+    struct MarkFeedback {
+        Ref ref;
+        bool success;
+    };
+    struct Recovery {
+        Ref ltr;
+        // 编码器最新一帧的frame_num
+        uint32_t current_frame_num;
+    };
+    struct Stats {
+        uint64_t marked = 0;
+        uint64_t acked = 0;
+        uint64_t lost = 0;
+        uint64_t recovered = 0;
+        uint64_t idr_fallback = 0;
+    };
+
+public:
+    explicit LtrController(const Params& params);
+    // 编码输出的每一帧都要喂进来, 解析出来的frame_num和标记情况要跟码流对得上
+    void onEncoded(int64_t picture_id, const uint8_t* data, size_t size);
+    // 返回需要反馈给编码器的标记结果
+    std::vector<MarkFeedback> onAck(int64_t picture_id);
+    // ltr_picture_id为负数, 或者这个LTR已经不可用时返回空, 只能发IDR
+    std::optional<Recovery> onRecoveryRequest(int64_t ltr_picture_id);
+    Stats takeStats();
+
+private:
+    struct Mark {
+        int64_t picture_id;
+        Ref ref;
+        bool acked;
+    };
+
+private:
+    const Params params_;
+    H264RefParser parser_;
+    std::deque<Mark> marks_;
+    std::optional<uint32_t> idr_pic_id_;
+    uint32_t current_frame_num_ = 0;
+    Stats stats_;
+};
+
+} // namespace video
+
+} // namespace lt
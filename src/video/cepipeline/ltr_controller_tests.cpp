@@ -0,0 +1,988 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include <video/drpipeline/ltr_tracker.h>
+#include <video/h264/h264_parser.h>
+
+#include "ltr_controller.h"
+
+using lt::video::H264RefParser;
+using lt::video::LtrController;
+using lt::video::LtrTracker;
+
+namespace {
+
+constexpr uint32_t kLog2MaxFrameNum = 16;
+constexpr uint32_t kLog2MaxPocLsb = 8;
+constexpr uint8_t kNalSlice = 1;
+constexpr uint8_t kNalIdrSlice = 5;
+constexpr uint8_t kNalSps = 7;
+constexpr uint8_t kNalPps = 8;
+
+class BitWriter {
+public:
+    void u(uint64_t value, uint32_t bits) {
+        for (uint32_t i = bits; i > 0; i--) {
+            bit(static_cast<uint32_t>((value >> (i - 1)) & 1));
+        }
+    }
+
+    void flag(bool value) { bit(value ? 1 : 0); }
+
+    void byte(uint8_t value) {
+        if (bits_ == 0) {
+            bytes_.push_back(value);
+            return;
+        }
+        bytes_.back() |= static_cast<uint8_t>(value >> bits_);
+        bytes_.push_back(static_cast<uint8_t>(value << (8 - bits_)));
+    }
+
+    void ue(uint32_t value) {
+        const uint64_t coded = static_cast<uint64_t>(value) + 1;
+        uint32_t bits = 0;
+        while ((coded >> (bits + 1)) != 0) {
+            bits++;
+        }
+        u(0, bits);
+        u(coded, bits + 1);
+    }
+
+    void se(int32_t value) {
+        ue(value > 0 ? static_cast<uint32_t>(value) * 2 - 1 : static_cast<uint32_t>(-value) * 2);
+    }
+
+    // rbsp_trailing_bits()
+    std::vector<uint8_t> finish() {
+        bit(1);
+        while (bits_ != 0) {
+            bit(0);
+        }
+        return std::move(bytes_);
+    }
+
+private:
+    void bit(uint32_t value) {
+        if (bits_ == 0) {
+            bytes_.push_back(0);
+        }
+        bytes_.back() |= static_cast<uint8_t>(value << (7 - bits_));
+        bits_ = (bits_ + 1) % 8;
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    uint32_t bits_ = 0;
+};
+
+// 加上起始码和NAL头, 插入防竞争字节
+void appendNal(std::vector<uint8_t>& out, uint8_t nal_ref_idc, uint8_t nal_type,
+               const std::vector<uint8_t>& rbsp) {
+    out.insert(out.end(), {0, 0, 0, 1, static_cast<uint8_t>((nal_ref_idc << 5) | nal_type)});
+    uint32_t zeros = 0;
+    for (uint8_t byte : rbsp) {
+        if (zeros >= 2 && byte <= 3) {
+            out.push_back(3);
+            zeros = 0;
+        }
+        out.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+}
+
+struct SliceDesc {
+    bool idr = false;
+    uint32_t idr_pic_id = 0;
+    uint32_t frame_num = 0;
+    // 把这一帧标记成长期参考帧时用的long_term_frame_idx
+    std::optional<uint32_t> ltr_index;
+    // 参考列表重排时引用的long_term_pic_num
+    std::optional<uint32_t> ref_ltr;
+    // 时域分层时slice前面带的前缀NAL
+    std::optional<uint8_t> temporal_id;
+    // slice头后面的假数据
+    uint32_t payload_bytes = 32;
+};
+
+// 按OpenH264的风格写出只有一个slice的帧, IDR前面带SPS/PPS. slice头以后是随机数据
+class StreamWriter {
+public:
+    StreamWriter(uint32_t profile_idc = 66, uint32_t poc_type = 2)
+        : profile_idc_{profile_idc}
+        , poc_type_{poc_type} {}
+
+    std::vector<uint8_t> frame(const SliceDesc& desc) {
+        std::vector<uint8_t> out;
+        if (desc.idr) {
+            appendNal(out, 3, kNalSps, sps());
+            appendNal(out, 3, kNalPps, pps());
+        }
+        if (desc.temporal_id.has_value()) {
+            auto prefix = lt::video::makeH264PrefixNal(desc.temporal_id.value(), 3, desc.idr);
+            out.insert(out.end(), prefix.begin(), prefix.end());
+        }
+        appendNal(out, 3, desc.idr ? kNalIdrSlice : kNalSlice, slice(desc));
+        return out;
+    }
+
+private:
+    std::vector<uint8_t> sps() {
+        BitWriter writer;
+        writer.u(profile_idc_, 8);
+        writer.u(0, 8);
+        writer.u(40, 8);
+        writer.ue(0);
+        if (profile_idc_ == 100) {
+            writer.ue(1);
+            writer.ue(0);
+            writer.ue(0);
+            writer.flag(false);
+            writer.flag(true);
+            for (int i = 0; i < 8; i++) {
+                writer.flag(i < 2);
+                if (i == 0) {
+                    // 第一个delta就归零, 使用默认矩阵
+                    writer.se(-8);
+                }
+                else if (i == 1) {
+                    for (int j = 0; j < 16; j++) {
+                        writer.se(1);
+                    }
+                }
+            }
+        }
+        writer.ue(kLog2MaxFrameNum - 4);
+        writer.ue(poc_type_);
+        if (poc_type_ == 0) {
+            writer.ue(kLog2MaxPocLsb - 4);
+        }
+        writer.ue(3);
+        writer.flag(false);
+        writer.ue(119);
+        writer.ue(67);
+        writer.flag(true);
+        writer.flag(true);
+        writer.flag(false);
+        writer.flag(false);
+        return writer.finish();
+    }
+
+    std::vector<uint8_t> pps() {
+        BitWriter writer;
+        writer.ue(0);
+        writer.ue(0);
+        writer.flag(false);
+        writer.flag(false);
+        writer.ue(0);
+        writer.ue(0);
+        writer.ue(0);
+        writer.flag(false);
+        writer.u(0, 2);
+        writer.se(0);
+        writer.se(0);
+        writer.se(0);
+        writer.flag(true);
+        writer.flag(false);
+        writer.flag(false);
+        return writer.finish();
+    }
+
+    std::vector<uint8_t> slice(const SliceDesc& desc) {
+        BitWriter writer;
+        writer.ue(0);
+        writer.ue(desc.idr ? 7 : 5);
+        writer.ue(0);
+        writer.u(desc.frame_num, kLog2MaxFrameNum);
+        if (desc.idr) {
+            writer.ue(desc.idr_pic_id);
+        }
+        if (poc_type_ == 0) {
+            writer.u(desc.frame_num * 2, kLog2MaxPocLsb);
+        }
+        if (!desc.idr) {
+            writer.flag(false);
+            writer.flag(desc.ref_ltr.has_value());
+            if (desc.ref_ltr.has_value()) {
+                writer.ue(2);
+                writer.ue(desc.ref_ltr.value());
+                writer.ue(3);
+            }
+        }
+        if (desc.idr) {
+            writer.flag(false);
+            writer.flag(desc.ltr_index.has_value());
+        }
+        else {
+            writer.flag(desc.ltr_index.has_value());
+            if (desc.ltr_index.has_value()) {
+                writer.ue(4);
+                writer.ue(2);
+                writer.ue(6);
+                writer.ue(desc.ltr_index.value());
+                writer.ue(0);
+            }
+        }
+        writer.se(0);
+        writer.ue(0);
+        for (uint32_t i = 0; i < desc.payload_bytes; i++) {
+            // xorshift32, 大量的假数据用mt19937太慢
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 17;
+            state_ ^= state_ << 5;
+            writer.byte(static_cast<uint8_t>(state_));
+        }
+        return writer.finish();
+    }
+
+private:
+    const uint32_t profile_idc_;
+    const uint32_t poc_type_;
+    uint32_t state_ = 20231201;
+};
+
+SliceDesc idrDesc(uint32_t idr_pic_id, bool ltr = false) {
+    SliceDesc desc{};
+    desc.idr = true;
+    desc.idr_pic_id = idr_pic_id;
+    if (ltr) {
+        desc.ltr_index = 0;
+    }
+    return desc;
+}
+
+SliceDesc pDesc(uint32_t frame_num) {
+    SliceDesc desc{};
+    desc.frame_num = frame_num;
+    return desc;
+}
+
+} // namespace
+
+TEST(H264RefParserTest, IdrAndP) {
+    StreamWriter writer;
+    H264RefParser parser;
+    auto idr = writer.frame(idrDesc(5));
+    auto info = parser.parse(idr.data(), idr.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_TRUE(info->idr);
+    EXPECT_TRUE(info->reference);
+    EXPECT_EQ(info->idr_pic_id, 5u);
+    EXPECT_EQ(info->frame_num, 0u);
+    EXPECT_FALSE(info->long_term_mark);
+    EXPECT_FALSE(info->refs_long_term);
+
+    auto p = writer.frame(pDesc(1));
+    info = parser.parse(p.data(), p.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_FALSE(info->idr);
+    EXPECT_EQ(info->idr_pic_id, 5u);
+    EXPECT_EQ(info->frame_num, 1u);
+    EXPECT_FALSE(info->long_term_mark);
+}
+
+TEST(H264RefParserTest, LongTermReference) {
+    StreamWriter writer;
+    H264RefParser parser;
+    auto idr = writer.frame(idrDesc(1, true));
+    auto info = parser.parse(idr.data(), idr.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_TRUE(info->long_term_mark);
+
+    SliceDesc mark = pDesc(30);
+    mark.ltr_index = 1;
+    auto frame = writer.frame(mark);
+    info = parser.parse(frame.data(), frame.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_EQ(info->frame_num, 30u);
+    EXPECT_TRUE(info->long_term_mark);
+    EXPECT_FALSE(info->refs_long_term);
+
+    SliceDesc recover = pDesc(45);
+    recover.ref_ltr = 1;
+    frame = writer.frame(recover);
+    info = parser.parse(frame.data(), frame.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_EQ(info->frame_num, 45u);
+    EXPECT_FALSE(info->long_term_mark);
+    EXPECT_TRUE(info->refs_long_term);
+}
+
+TEST(H264RefParserTest, HighProfilePocType0) {
+    StreamWriter writer{100, 0};
+    H264RefParser parser;
+    auto idr = writer.frame(idrDesc(7, true));
+    auto info = parser.parse(idr.data(), idr.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_EQ(info->idr_pic_id, 7u);
+    EXPECT_TRUE(info->long_term_mark);
+    SliceDesc desc = pDesc(3);
+    desc.ref_ltr = 0;
+    desc.ltr_index = 1;
+    auto p = writer.frame(desc);
+    info = parser.parse(p.data(), p.size());
+    ASSERT_TRUE(info.has_value());
+    EXPECT_EQ(info->frame_num, 3u);
+    EXPECT_TRUE(info->long_term_mark);
+    EXPECT_TRUE(info->refs_long_term);
+}
+
+// slice头里有连续的0时会插入防竞争字节, 解析时要跳过
+TEST(H264RefParserTest, EmulationPrevention) {
+    StreamWriter writer;
+    uint32_t escaped = 0;
+    for (uint32_t idr_pic_id : {0u, 1u, 255u, 65535u, 100000u, 1u << 20}) {
+        for (uint32_t frame_num : {0u, 1u, 256u, 0xffffu}) {
+            H264RefParser parser;
+            auto idr = writer.frame(idrDesc(idr_pic_id));
+            auto info = parser.parse(idr.data(), idr.size());
+            ASSERT_TRUE(info.has_value());
+            EXPECT_EQ(info->idr_pic_id, idr_pic_id);
+            auto p = writer.frame(pDesc(frame_num));
+            info = parser.parse(p.data(), p.size());
+            ASSERT_TRUE(info.has_value());
+            EXPECT_EQ(info->frame_num, frame_num);
+            for (auto* frame : {&idr, &p}) {
+                for (size_t i = 4; i + 2 < frame->size() && i < 40; i++) {
+                    escaped += (*frame)[i] == 0 && (*frame)[i + 1] == 0 && (*frame)[i + 2] == 3;
+                }
+            }
+        }
+    }
+    EXPECT_GT(escaped, 0u);
+}
+
+TEST(H264RefParserTest, BadInput) {
+    StreamWriter writer;
+    H264RefParser parser;
+    auto idr = writer.frame(idrDesc(1));
+    auto p = writer.frame(pDesc(1));
+    // 没见过SPS/PPS
+    EXPECT_FALSE(parser.parse(p.data(), p.size()).has_value());
+    EXPECT_FALSE(parser.parse(nullptr, 0).has_value());
+    ASSERT_TRUE(parser.parse(idr.data(), idr.size()).has_value());
+    // slice头被截断
+    EXPECT_FALSE(parser.parse(p.data(), 7).has_value());
+    std::mt19937 rng{1};
+    std::vector<uint8_t> garbage(4096);
+    for (int i = 0; i < 100; i++) {
+        for (auto& byte : garbage) {
+            byte = static_cast<uint8_t>(rng() & 0xff);
+        }
+        garbage[0] = garbage[1] = garbage[2] = 0;
+        garbage[3] = 1;
+        parser.parse(garbage.data(), garbage.size());
+    }
+    // 乱码没有把状态搞坏
+    ASSERT_TRUE(parser.parse(idr.data(), idr.size()).has_value());
+    EXPECT_TRUE(parser.parse(p.data(), p.size()).has_value());
+}
+
+TEST(H264RefParserTest, TemporalIdPrefixNal) {
+    StreamWriter writer;
+    H264RefParser parser;
+    auto idr = writer.frame(idrDesc(1));
+    EXPECT_FALSE(lt::video::parseH264TemporalId(idr.data(), idr.size()).has_value());
+    auto prefix = lt::video::makeH264PrefixNal(0, 3, true);
+    // IDR的idr_flag
+    EXPECT_NE(prefix[5] & 0x40, 0);
+    std::vector<uint8_t> frame(prefix.begin(), prefix.end());
+    frame.insert(frame.end(), idr.begin(), idr.end());
+    EXPECT_EQ(lt::video::parseH264TemporalId(frame.data(), frame.size()), 0);
+    ASSERT_TRUE(parser.parse(frame.data(), frame.size()).has_value());
+    for (uint8_t temporal_id = 0; temporal_id < 4; temporal_id++) {
+        for (uint8_t nal_ref_idc : {0, 2}) {
+            auto nal = lt::video::makeH264PrefixNal(temporal_id, nal_ref_idc, false);
+            EXPECT_EQ(nal[4] & 0x1f, 14);
+            EXPECT_EQ((nal[4] >> 5) & 0x03, nal_ref_idc);
+            // discardable_flag
+            EXPECT_EQ((nal[7] & 0x08) != 0, nal_ref_idc == 0);
+            auto p = writer.frame(pDesc(temporal_id + 1u));
+            frame.assign(nal.begin(), nal.end());
+            frame.insert(frame.end(), p.begin(), p.end());
+            EXPECT_EQ(lt::video::parseH264TemporalId(frame.data(), frame.size()), temporal_id);
+            // 不认识的NAL直接跳过
+            auto info = parser.parse(frame.data(), frame.size());
+            ASSERT_TRUE(info.has_value());
+            EXPECT_EQ(info->frame_num, temporal_id + 1u);
+            // 只看第一个slice之前的
+            p.insert(p.end(), nal.begin(), nal.end());
+            EXPECT_FALSE(lt::video::parseH264TemporalId(p.data(), p.size()).has_value());
+        }
+    }
+}
+
+TEST(LtrControllerTest, AckConfirmsMark) {
+    StreamWriter writer;
+    LtrController controller{LtrController::Params{}};
+    auto idr = writer.frame(idrDesc(3));
+    controller.onEncoded(0, idr.data(), idr.size());
+    for (uint32_t i = 1; i <= 40; i++) {
+        SliceDesc desc = pDesc(i);
+        if (i == 30) {
+            desc.ltr_index = 0;
+        }
+        auto frame = writer.frame(desc);
+        controller.onEncoded(i, frame.data(), frame.size());
+    }
+    EXPECT_TRUE(controller.onAck(29).empty());
+    // 还没确认的LTR不能拿来恢复
+    EXPECT_FALSE(controller.onRecoveryRequest(30).has_value());
+    auto feedbacks = controller.onAck(30);
+    ASSERT_EQ(feedbacks.size(), 1u);
+    EXPECT_TRUE(feedbacks[0].success);
+    EXPECT_EQ(feedbacks[0].ref.idr_pic_id, 3u);
+    EXPECT_EQ(feedbacks[0].ref.frame_num, 30u);
+    EXPECT_TRUE(controller.onAck(31).empty());
+    auto recovery = controller.onRecoveryRequest(30);
+    ASSERT_TRUE(recovery.has_value());
+    EXPECT_EQ(recovery->ltr.frame_num, 30u);
+    EXPECT_EQ(recovery->current_frame_num, 40u);
+    EXPECT_FALSE(controller.onRecoveryRequest(-1).has_value());
+    auto stats = controller.takeStats();
+    EXPECT_EQ(stats.marked, 1u);
+    EXPECT_EQ(stats.acked, 1u);
+    EXPECT_EQ(stats.recovered, 1u);
+    EXPECT_EQ(stats.idr_fallback, 2u);
+}
+
+TEST(LtrControllerTest, LostMark) {
+    StreamWriter writer;
+    LtrController controller{LtrController::Params{}};
+    auto idr = writer.frame(idrDesc(0));
+    controller.onEncoded(0, idr.data(), idr.size());
+    SliceDesc desc = pDesc(1);
+    desc.ltr_index = 0;
+    auto mark = writer.frame(desc);
+    controller.onEncoded(1, mark.data(), mark.size());
+    auto p = writer.frame(pDesc(2));
+    controller.onEncoded(2, p.data(), p.size());
+    // 1号帧的ack没有回来
+    auto feedbacks = controller.onAck(2);
+    ASSERT_EQ(feedbacks.size(), 1u);
+    EXPECT_FALSE(feedbacks[0].success);
+    EXPECT_EQ(feedbacks[0].ref.frame_num, 1u);
+    EXPECT_FALSE(controller.onRecoveryRequest(1).has_value());
+    EXPECT_EQ(controller.takeStats().lost, 1u);
+}
+
+TEST(LtrControllerTest, MarksExpire) {
+    StreamWriter writer;
+    LtrController controller{LtrController::Params{}};
+    auto idr = writer.frame(idrDesc(0, true));
+    controller.onEncoded(0, idr.data(), idr.size());
+    EXPECT_EQ(controller.onAck(0).size(), 1u);
+    for (uint32_t i = 1; i <= 20; i++) {
+        SliceDesc desc = pDesc(i);
+        if (i % 10 == 0) {
+            desc.ltr_index = i / 10 % 2;
+        }
+        auto frame = writer.frame(desc);
+        controller.onEncoded(i, frame.data(), frame.size());
+        EXPECT_EQ(controller.onAck(i).size(), i % 10 == 0 ? 1u : 0u);
+    }
+    // 从10号恢复之后, 20号是在出错之后标记的, 不能再用
+    ASSERT_TRUE(controller.onRecoveryRequest(10).has_value());
+    EXPECT_FALSE(controller.onRecoveryRequest(20).has_value());
+    // 新的IDR周期里旧的LTR都作废
+    auto new_idr = writer.frame(idrDesc(1));
+    controller.onEncoded(21, new_idr.data(), new_idr.size());
+    EXPECT_FALSE(controller.onRecoveryRequest(0).has_value());
+}
+
+TEST(LtrTrackerTest, UnsupportedStream) {
+    StreamWriter writer;
+    LtrTracker tracker{LtrTracker::Params{}};
+    auto idr = writer.frame(idrDesc(0));
+    EXPECT_TRUE(tracker.onFrame(0, idr.data(), idr.size(), 0));
+    tracker.onDecoded(0, true, 0);
+    // 码流里没有LTR标记时丢帧也照常显示, 解码失败由调用方按原来的方式请求关键帧
+    auto p = writer.frame(pDesc(1));
+    EXPECT_TRUE(tracker.onFrame(5, p.data(), p.size(), 1000));
+    tracker.onDecoded(5, false, 1000);
+    EXPECT_FALSE(tracker.supported());
+    EXPECT_FALSE(tracker.poll(2000).has_value());
+}
+
+TEST(LtrTrackerTest, RecoverFromLtr) {
+    StreamWriter writer;
+    LtrTracker::Params params{};
+    LtrTracker tracker{params};
+    int64_t now_us = 0;
+    auto feed = [&](int64_t picture_id, const SliceDesc& desc) {
+        auto frame = writer.frame(desc);
+        bool render = tracker.onFrame(picture_id, frame.data(), frame.size(), now_us);
+        tracker.onDecoded(picture_id, true, now_us);
+        return render;
+    };
+    EXPECT_TRUE(feed(0, idrDesc(0, true)));
+    EXPECT_TRUE(tracker.supported());
+    EXPECT_EQ(tracker.lastGoodLtr(), 0);
+    EXPECT_TRUE(feed(1, pDesc(1)));
+    // 2号丢了
+    now_us = 50'000;
+    EXPECT_FALSE(feed(3, pDesc(3)));
+    EXPECT_TRUE(tracker.broken());
+    auto request = tracker.poll(now_us);
+    ASSERT_TRUE(request.has_value());
+    EXPECT_EQ(request->type, LtrTracker::Request::Type::Recovery);
+    EXPECT_EQ(request->ltr_picture_id, 0);
+    EXPECT_FALSE(tracker.poll(now_us + 1000).has_value());
+    // 出错之后标记的LTR不算
+    SliceDesc mark = pDesc(4);
+    mark.ltr_index = 1;
+    EXPECT_FALSE(feed(4, mark));
+    EXPECT_EQ(tracker.lastGoodLtr(), 0);
+    request = tracker.poll(now_us + params.retry_interval_us);
+    ASSERT_TRUE(request.has_value());
+    EXPECT_EQ(request->ltr_picture_id, 0);
+    SliceDesc recover = pDesc(5);
+    recover.ref_ltr = 0;
+    EXPECT_TRUE(feed(5, recover));
+    EXPECT_FALSE(tracker.broken());
+    EXPECT_TRUE(feed(6, pDesc(6)));
+    EXPECT_FALSE(tracker.poll(now_us + 2 * params.retry_interval_us).has_value());
+}
+
+// 主机按时域层丢掉的帧没有人参考, 不算丢帧. 3层时层号依次是0 2 1 2, 基本层帧之间隔4帧
+TEST(LtrTrackerTest, TemporalLayerDrop) {
+    StreamWriter writer;
+    LtrTracker tracker{LtrTracker::Params{}};
+    uint32_t frame_num = 0;
+    auto feed = [&](int64_t picture_id, uint8_t temporal_id) {
+        SliceDesc desc = picture_id == 0 ? idrDesc(0, true) : pDesc(++frame_num);
+        desc.temporal_id = temporal_id;
+        auto frame = writer.frame(desc);
+        bool render = tracker.onFrame(picture_id, frame.data(), frame.size(), 0);
+        tracker.onDecoded(picture_id, true, 0);
+        return render;
+    };
+    EXPECT_TRUE(feed(0, 0));
+    // 增强层全丢了, 这时还不知道周期
+    EXPECT_TRUE(feed(4, 0));
+    // 从这一帧推出周期是4, 参考的是4号
+    EXPECT_TRUE(feed(5, 2));
+    // 6号(T1)和参考它的7号(T2)都丢了
+    EXPECT_TRUE(feed(8, 0));
+    EXPECT_TRUE(feed(10, 1));
+    EXPECT_TRUE(feed(11, 2));
+    EXPECT_FALSE(tracker.broken());
+    // 12号基本层帧是真的丢了, 参考它的13号不能显示
+    EXPECT_FALSE(feed(13, 2));
+    EXPECT_TRUE(tracker.broken());
+}
+
+TEST(LtrTrackerTest, KeyframeFallback) {
+    StreamWriter writer;
+    LtrTracker::Params params{};
+    LtrTracker tracker{params};
+    auto idr = writer.frame(idrDesc(0, true));
+    tracker.onFrame(0, idr.data(), idr.size(), 0);
+    tracker.onDecoded(0, true, 0);
+    auto p = writer.frame(pDesc(1));
+    tracker.onFrame(1, p.data(), p.size(), 10'000);
+    tracker.onDecoded(1, false, 10'000);
+    ASSERT_TRUE(tracker.broken());
+    int recoveries = 0;
+    int keyframes = 0;
+    for (int64_t now_us = 10'000; now_us < 10'000 + 2 * params.keyframe_timeout_us;
+         now_us += 1'000) {
+        if (auto request = tracker.poll(now_us)) {
+            if (request->type == LtrTracker::Request::Type::Recovery) {
+                recoveries++;
+                EXPECT_LT(now_us - 10'000, params.keyframe_timeout_us);
+            }
+            else {
+                keyframes++;
+                EXPECT_GE(now_us - 10'000, params.keyframe_timeout_us);
+            }
+        }
+    }
+    EXPECT_EQ(recoveries, params.keyframe_timeout_us / params.retry_interval_us);
+    EXPECT_EQ(keyframes, 1);
+    auto new_idr = writer.frame(idrDesc(1));
+    EXPECT_TRUE(tracker.onFrame(2, new_idr.data(), new_idr.size(), 3'000'000));
+    EXPECT_FALSE(tracker.broken());
+    // 新的IDR没有标记LTR, 再出错只能请求关键帧
+    tracker.onDecoded(2, false, 3'000'000);
+    auto request = tracker.poll(3'000'000);
+    ASSERT_TRUE(request.has_value());
+    EXPECT_EQ(request->type, LtrTracker::Request::Type::Keyframe);
+}
+
+namespace {
+
+struct LoopbackParams {
+    bool ltr_recovery = true;
+    uint32_t fps = 60;
+    uint32_t bandwidth_bps = 20'000'000;
+    int64_t one_way_delay_us = 20'000;
+    // 按帧丢, 模拟传输层重传也没救回来的帧
+    double frame_loss = 0.01;
+    int64_t duration_us = 60'000'000;
+    uint32_t p_frame_bytes = 20'000;
+    // IDR和参考LTR的恢复帧相对普通P帧的大小
+    double idr_ratio = 8.0;
+    double ltr_recovery_ratio = 2.0;
+    uint32_t ltr_mark_period = 30;
+};
+
+struct LoopbackResult {
+    uint32_t lost = 0;
+    uint32_t idr_frames = 0;
+    uint32_t ltr_frames = 0;
+    // 恢复帧(出错后的IDR, 参考LTR的P帧)比普通P帧多出来的字节
+    uint64_t recovery_bytes = 0;
+    // 每次出错后, 从上一帧正确的画面到恢复后第一帧正确画面的间隔
+    std::vector<int64_t> freezes_us;
+    uint32_t corrupt_rendered = 0;
+
+    double avgFreezeMs() const {
+        if (freezes_us.empty()) {
+            return 0;
+        }
+        return std::accumulate(freezes_us.begin(), freezes_us.end(), 0.0) / freezes_us.size() /
+               1000.0;
+    }
+};
+
+// 按OpenH264打开LTR时的行为建模: 隔ltr_mark_period帧把一帧标记成LTR, 两个槽位轮流用,
+// 收到标记成功的反馈才算确认. 恢复时挑frame_num不超过请求的、最新的已确认LTR来参考,
+// 没有就编IDR. 码流只有slice头是真的, 帧大小按参数合成
+class ModelEncoder {
+public:
+    struct Frame {
+        std::vector<uint8_t> data;
+        bool idr = false;
+        bool recovery = false;
+        // 参考的LTR是哪一帧
+        int64_t ref_picture_id = -1;
+        std::optional<uint32_t> ltr_index;
+    };
+
+    explicit ModelEncoder(const LoopbackParams& params)
+        : params_{params} {}
+
+    void requestKeyframe() { idr_pending_ = true; }
+
+    void onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success) {
+        for (auto& slot : slots_) {
+            if (slot.valid && idr_pic_id == idr_pic_id_ && slot.frame_num == frame_num) {
+                slot.confirmed = success;
+                slot.valid = success;
+            }
+        }
+    }
+
+    void requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num) {
+        std::optional<uint32_t> best;
+        for (uint32_t i = 0; i < slots_.size(); i++) {
+            const Slot& slot = slots_[i];
+            if (idr_pic_id != idr_pic_id_ || !slot.valid || !slot.confirmed ||
+                slot.frame_num > ltr_frame_num) {
+                continue;
+            }
+            if (!best.has_value() || slot.frame_num > slots_[best.value()].frame_num) {
+                best = i;
+            }
+        }
+        if (best.has_value()) {
+            recover_slot_ = best;
+        }
+        else {
+            idr_pending_ = true;
+        }
+    }
+
+    Frame encode(int64_t picture_id) {
+        Frame frame;
+        SliceDesc desc{};
+        double ratio = noise_(rng_);
+        if (idr_pending_) {
+            idr_pending_ = false;
+            recover_slot_ = std::nullopt;
+            idr_pic_id_++;
+            frame_num_ = 0;
+            slots_ = {};
+            desc = idrDesc(idr_pic_id_, true);
+            frame.idr = true;
+            frame.ltr_index = 0;
+            slots_[0] = {true, false, 0, picture_id};
+            next_slot_ = 1;
+            since_mark_ = 0;
+            ratio *= params_.idr_ratio;
+        }
+        else {
+            frame_num_++;
+            desc = pDesc(frame_num_);
+            if (recover_slot_.has_value()) {
+                frame.recovery = true;
+                frame.ref_picture_id = slots_[recover_slot_.value()].picture_id;
+                desc.ref_ltr = recover_slot_.value();
+                recover_slot_ = std::nullopt;
+                ratio *= params_.ltr_recovery_ratio;
+            }
+            if (++since_mark_ >= params_.ltr_mark_period) {
+                since_mark_ = 0;
+                desc.ltr_index = next_slot_;
+                frame.ltr_index = next_slot_;
+                slots_[next_slot_] = {true, false, frame_num_, picture_id};
+                next_slot_ = (next_slot_ + 1) % static_cast<uint32_t>(slots_.size());
+            }
+        }
+        desc.payload_bytes = static_cast<uint32_t>(params_.p_frame_bytes * ratio);
+        frame.data = writer_.frame(desc);
+        return frame;
+    }
+
+    uint32_t idrPicId() const { return idr_pic_id_; }
+
+private:
+    struct Slot {
+        bool valid;
+        bool confirmed;
+        uint32_t frame_num;
+        int64_t picture_id;
+    };
+
+private:
+    const LoopbackParams params_;
+    StreamWriter writer_;
+    std::mt19937 rng_{20231202};
+    std::uniform_real_distribution<double> noise_{0.8, 1.2};
+    std::array<Slot, 2> slots_{};
+    uint32_t next_slot_ = 0;
+    uint32_t since_mark_ = 0;
+    uint32_t idr_pic_id_ = 0;
+    uint32_t frame_num_ = 0;
+    bool idr_pending_ = true;
+    std::optional<uint32_t> recover_slot_;
+};
+
+// 主机编码 -> 瓶颈链路(整帧随机丢) -> 客户端LtrTracker + 解码器模型, 客户端的ack和
+// 恢复请求经过同样的单向时延回到主机. 1ms一步
+class LossyLoopback {
+public:
+    explicit LossyLoopback(const LoopbackParams& params)
+        : params_{params}
+        , encoder_{params}
+        , controller_{LtrController::Params{}}
+        , tracker_{LtrTracker::Params{}} {}
+
+    LoopbackResult run() {
+        const int64_t frame_interval_us = 1'000'000 / params_.fps;
+        int64_t next_frame_us = 0;
+        int64_t picture_id = 0;
+        for (int64_t now_us = 0; now_us < params_.duration_us; now_us += 1'000) {
+            deliverUplink(now_us);
+            if (now_us >= next_frame_us) {
+                next_frame_us += frame_interval_us;
+                sendFrame(picture_id++);
+            }
+            drainLink(now_us);
+            deliverDownlink(now_us);
+            if (auto request = tracker_.poll(now_us)) {
+                uplink_.push_back({now_us + params_.one_way_delay_us, request->type,
+                                   request->ltr_picture_id, false});
+            }
+        }
+        return std::move(result_);
+    }
+
+private:
+    struct Packet {
+        int64_t picture_id;
+        ModelEncoder::Frame frame;
+        bool lost;
+        int64_t arrive_us = 0;
+    };
+    struct Message {
+        int64_t arrive_us;
+        LtrTracker::Request::Type type;
+        int64_t picture_id;
+        bool ack;
+    };
+    struct LtrSlot {
+        int64_t picture_id = -1;
+        bool correct = false;
+    };
+
+    void sendFrame(int64_t picture_id) {
+        ModelEncoder::Frame frame = encoder_.encode(picture_id);
+        const uint32_t size = static_cast<uint32_t>(frame.data.size());
+        const uint32_t normal = params_.p_frame_bytes;
+        if ((frame.idr && picture_id != 0) || frame.recovery) {
+            result_.recovery_bytes += size > normal ? size - normal : 0;
+            result_.idr_frames += frame.idr;
+            result_.ltr_frames += frame.recovery;
+        }
+        if (params_.ltr_recovery) {
+            controller_.onEncoded(picture_id, frame.data.data(), frame.data.size());
+        }
+        // 第一个IDR不丢, 让两种方式从同一个起点开始
+        const bool lost = picture_id != 0 && loss_(rng_) < params_.frame_loss;
+        result_.lost += lost;
+        link_.push_back({picture_id, std::move(frame), lost});
+    }
+
+    void drainLink(int64_t now_us) {
+        credit_bytes_ += params_.bandwidth_bps / 8.0 / 1000.0;
+        while (!link_.empty() && credit_bytes_ >= link_.front().frame.data.size()) {
+            credit_bytes_ -= link_.front().frame.data.size();
+            Packet packet = std::move(link_.front());
+            link_.pop_front();
+            if (!packet.lost) {
+                packet.arrive_us = now_us + params_.one_way_delay_us;
+                in_flight_.push_back(std::move(packet));
+            }
+        }
+        if (link_.empty()) {
+            credit_bytes_ = std::min(credit_bytes_, 1500.0);
+        }
+    }
+
+    void deliverDownlink(int64_t now_us) {
+        while (!in_flight_.empty() && in_flight_.front().arrive_us <= now_us) {
+            onClientFrame(in_flight_.front(), now_us);
+            in_flight_.pop_front();
+        }
+    }
+
+    // 解码器模型: IDR总是对的, 参考LTR的帧看那个LTR槽位里是不是那一帧且是对的,
+    // 其他P帧看上一帧有没有收到且是对的
+    void onClientFrame(const Packet& packet, int64_t now_us) {
+        const ModelEncoder::Frame& frame = packet.frame;
+        const bool render =
+            tracker_.onFrame(packet.picture_id, frame.data.data(), frame.data.size(), now_us);
+        bool correct = false;
+        if (frame.idr) {
+            correct = true;
+            client_slots_ = {};
+        }
+        else if (frame.ref_picture_id >= 0) {
+            correct = std::any_of(client_slots_.begin(), client_slots_.end(),
+                                  [&frame](const LtrSlot& slot) {
+                                      return slot.picture_id == frame.ref_picture_id &&
+                                             slot.correct;
+                                  });
+        }
+        else {
+            correct = last_picture_id_ + 1 == packet.picture_id && last_correct_;
+        }
+        if (frame.ltr_index.has_value()) {
+            client_slots_[frame.ltr_index.value()] = {packet.picture_id, correct};
+        }
+        last_picture_id_ = packet.picture_id;
+        last_correct_ = correct;
+        tracker_.onDecoded(packet.picture_id, true, now_us);
+        uplink_.push_back({now_us + params_.one_way_delay_us,
+                           LtrTracker::Request::Type::Recovery, packet.picture_id, true});
+        if (!render) {
+            return;
+        }
+        if (!correct) {
+            result_.corrupt_rendered++;
+            return;
+        }
+        const int64_t frame_interval_us = 1'000'000 / params_.fps;
+        if (last_render_us_ >= 0 && now_us - last_render_us_ > frame_interval_us * 3 / 2) {
+            result_.freezes_us.push_back(now_us - last_render_us_);
+        }
+        last_render_us_ = now_us;
+    }
+
+    void deliverUplink(int64_t now_us) {
+        while (!uplink_.empty() && uplink_.front().arrive_us <= now_us) {
+            const Message msg = uplink_.front();
+            uplink_.pop_front();
+            if (msg.ack) {
+                if (!params_.ltr_recovery) {
+                    continue;
+                }
+                for (auto& feedback : controller_.onAck(msg.picture_id)) {
+                    encoder_.onLtrMarked(feedback.ref.idr_pic_id, feedback.ref.frame_num,
+                                         feedback.success);
+                }
+            }
+            else if (msg.type == LtrTracker::Request::Type::Keyframe || !params_.ltr_recovery) {
+                encoder_.requestKeyframe();
+            }
+            else if (auto recovery = controller_.onRecoveryRequest(msg.picture_id)) {
+                encoder_.requestLtrRecovery(recovery->ltr.idr_pic_id, recovery->ltr.frame_num);
+            }
+            else {
+                encoder_.requestKeyframe();
+            }
+        }
+    }
+
+private:
+    const LoopbackParams params_;
+    ModelEncoder encoder_;
+    LtrController controller_;
+    LtrTracker tracker_;
+    std::mt19937 rng_{20231203};
+    std::uniform_real_distribution<double> loss_{0, 1};
+    std::deque<Packet> link_;
+    std::deque<Packet> in_flight_;
+    std::deque<Message> uplink_;
+    double credit_bytes_ = 0;
+    std::array<LtrSlot, 2> client_slots_{};
+    int64_t last_picture_id_ = -1;
+    bool last_correct_ = false;
+    int64_t last_render_us_ = -1;
+    LoopbackResult result_;
+};
+
+void printResult(const char* name, const LoopbackResult& result) {
+    printf("%-12s lost %3u, idr %3u, ltr recovery %3u, recovery bytes %8.1fKB, "
+           "freezes %3zu avg %6.1fms max %6.1fms, corrupt rendered %u\n",
+           name, result.lost, result.idr_frames, result.ltr_frames,
+           result.recovery_bytes / 1024.0, result.freezes_us.size(), result.avgFreezeMs(),
+           result.freezes_us.empty()
+               ? 0.0
+               : *std::max_element(result.freezes_us.begin(), result.freezes_us.end()) / 1000.0,
+           result.corrupt_rendered);
+}
+
+void compareRecovery(LoopbackParams params) {
+    params.ltr_recovery = false;
+    const LoopbackResult idr = LossyLoopback{params}.run();
+    params.ltr_recovery = true;
+    const LoopbackResult ltr = LossyLoopback{params}.run();
+    printResult("idr", idr);
+    printResult("ltr", ltr);
+    ASSERT_GT(idr.lost, 10u);
+    // 两种方式都不能把花屏显示出来
+    EXPECT_EQ(idr.corrupt_rendered, 0u);
+    EXPECT_EQ(ltr.corrupt_rendered, 0u);
+    // 绝大多数错误都靠LTR恢复
+    EXPECT_LT(ltr.idr_frames * 5, ltr.ltr_frames);
+    EXPECT_LT(ltr.recovery_bytes * 3, idr.recovery_bytes);
+    EXPECT_LT(ltr.avgFreezeMs(), idr.avgFreezeMs());
+}
+
+} // namespace
+
+TEST(LtrRecoveryTest, RandomLoss) {
+    LoopbackParams params{};
+    compareRecovery(params);
+}
+
+// 带宽紧张时IDR要在瓶颈处排更久, 卡顿更明显
+TEST(LtrRecoveryTest, ConstrainedLink) {
+    LoopbackParams params{};
+    params.bandwidth_bps = 12'000'000;
+    params.p_frame_bytes = 15'000;
+    params.one_way_delay_us = 40'000;
+    params.frame_loss = 0.02;
+    compareRecovery(params);
+}
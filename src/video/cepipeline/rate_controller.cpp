@@ -0,0 +1,441 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rate_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int64_t kUpdateIntervalUs = 100'000;
+// 降码率后至少隔这么久才能再降, 给编码器和队列反应的时间
+constexpr int64_t kDecreaseIntervalUs = 300'000;
+constexpr int64_t kSentHistoryUs = 2'000'000;
+constexpr int64_t kAckedWindowUs = 500'000;
+constexpr int64_t kMinAckedSpanUs = 100'000;
+
+// trendline的参数取自GCC
+constexpr size_t kTrendWindowSize = 20;
+constexpr double kSmoothingCoef = 0.9;
+constexpr double kTrendGain = 4.0;
+constexpr uint32_t kMaxNumDeltas = 60;
+constexpr double kThresholdUp = 0.0087;
+constexpr double kThresholdDown = 0.039;
+constexpr double kMaxAdaptOffsetMs = 15.0;
+constexpr double kMinThreshold = 6.0;
+constexpr double kMaxThreshold = 600.0;
+constexpr int64_t kOveruseTimeUs = 10'000;
+
+constexpr int64_t kMaxQueueDelayUs = 150'000;
+// 最老的未确认帧等了这么久还没有ack, 链路大概是卡住了
+constexpr int64_t kStallUs = 500'000;
+constexpr int64_t kMinLatencyWindowUs = 5'000'000;
+
+constexpr int64_t kLossWindowUs = 1'000'000;
+constexpr uint32_t kMinLossSamples = 10;
+constexpr float kHighLossRate = 0.1f;
+constexpr float kLowLossRate = 0.02f;
+
+constexpr double kBeta = 0.85;
+constexpr double kNearCongestionRange = 1.15;
+constexpr double kNearIncreasePerSecond = 0.04;
+constexpr double kFarIncreasePerSecond = 0.15;
+constexpr double kMaxIncreaseStepS = 0.5;
+constexpr uint32_t kAckedHeadroomBps = 1'000'000;
+
+constexpr double kMinChangeRatio = 0.05;
+constexpr int64_t kMinIncreaseIntervalUs = 500'000;
+
+constexpr double kEwmaAlpha = 0.1;
+constexpr int64_t kOverloadUs = 1'000'000;
+constexpr int64_t kHealthyUs = 5'000'000;
+constexpr double kOverloadEncodeRatio = 0.85;
+constexpr double kHealthyEncodeRatio = 0.7;
+constexpr double kMaxUndecodedFrames = 2.0;
+constexpr uint32_t kLowBitrateBps = 2'000'000;
+constexpr uint32_t kLowBitrateRecoverBps = 3'000'000;
+constexpr uint32_t kLowBitrateFps = 30;
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+RateController::RateController(const Params& params)
+    : params_{params}
+    , bitrate_bps_{std::clamp(params.start_bitrate_bps, params.min_bitrate_bps,
+                              params.max_bitrate_bps)}
+    , fps_{params.max_fps}
+    , applied_bitrate_bps_{bitrate_bps_}
+    , applied_fps_{params.max_fps}
+    , fps_cap_{params.max_fps} {}
+
+void RateController::onFrameSent(int64_t frame_id, uint32_t size, uint8_t temporal_id,
+                                 int64_t encode_time_us, int64_t now_us) {
+    sent_frames_.push_back({frame_id, size, now_us, temporal_id, false});
+    encode_time_us_ = encode_time_us_ == 0
+                          ? encode_time_us
+                          : (1 - kEwmaAlpha) * encode_time_us_ + kEwmaAlpha * encode_time_us;
+    while (!sent_frames_.empty() && sent_frames_.front().send_time_us + kSentHistoryUs < now_us) {
+        // 比最新ack还新的帧在收到ack时才算丢没丢, 这里老到要淘汰的都算丢了
+        if (countsAsLost(sent_frames_.front())) {
+            lost_frames_++;
+        }
+        sent_frames_.pop_front();
+    }
+}
+
+void RateController::onFrameAck(int64_t frame_id, int64_t recv_time_us, int32_t undecoded_frames,
+                                int64_t now_us) {
+    undecoded_frames_ =
+        (1 - kEwmaAlpha) * undecoded_frames_ + kEwmaAlpha * std::max(undecoded_frames, 0);
+    auto iter = std::lower_bound(
+        sent_frames_.begin(), sent_frames_.end(), frame_id,
+        [](const SentFrame& frame, int64_t id) { return frame.id < id; });
+    if (iter == sent_frames_.end() || iter->id != frame_id || iter->acked) {
+        return;
+    }
+    iter->acked = true;
+    acked_frames_++;
+    last_ack_us_ = now_us;
+    if (frame_id > last_acked_id_) {
+        // 中间没收到ack的都算丢了
+        for (auto it = sent_frames_.begin(); it != iter; ++it) {
+            if (countsAsLost(*it)) {
+                lost_frames_++;
+            }
+        }
+        last_acked_id_ = frame_id;
+    }
+    else if (iter->temporal_id == 0 && lost_frames_ > 0) {
+        // 乱序到达, 之前按丢帧算了
+        lost_frames_--;
+    }
+    acked_bytes_.push_back({recv_time_us, iter->size});
+    while (acked_bytes_.front().recv_time_us + kAckedWindowUs < recv_time_us) {
+        acked_bytes_.pop_front();
+    }
+    updateAckLatency(now_us - iter->send_time_us, now_us);
+    updateTrendline(*iter, recv_time_us, now_us);
+}
+
+void RateController::resetBitrate(uint32_t bitrate_bps, int64_t now_us) {
+    bitrate_bps_ = clampBitrate(bitrate_bps);
+    applied_bitrate_bps_ = bitrate_bps_;
+    last_apply_us_ = now_us;
+    state_ = State::Hold;
+    congestion_bps_ = 0;
+}
+
+std::optional<RateController::Target> RateController::poll(int64_t now_us) {
+    // 对端不回ack时什么都不做
+    if (last_acked_id_ < 0 || now_us - last_update_us_ < kUpdateIntervalUs) {
+        return std::nullopt;
+    }
+    updateLoss(now_us);
+    updateBitrate(currentUsage(now_us), now_us);
+    updateFps(now_us);
+    last_update_us_ = now_us;
+
+    const double change = static_cast<double>(bitrate_bps_) / applied_bitrate_bps_ - 1.0;
+    const bool bitrate_changed =
+        change <= -kMinChangeRatio ||
+        (change >= kMinChangeRatio && now_us - last_apply_us_ >= kMinIncreaseIntervalUs);
+    if (!bitrate_changed && fps_ == applied_fps_) {
+        return std::nullopt;
+    }
+    applied_bitrate_bps_ = bitrate_bps_;
+    applied_fps_ = fps_;
+    last_apply_us_ = now_us;
+    return Target{bitrate_bps_, fps_};
+}
+
+bool RateController::countsAsLost(const SentFrame& frame) const {
+    // 增强层的帧可能是发送端按层丢掉的, 对端不会回ack. 基本层从来不会被故意丢
+    return !frame.acked && frame.id > last_acked_id_ && frame.temporal_id == 0;
+}
+
+void RateController::updateTrendline(const SentFrame& frame, int64_t recv_time_us,
+                                     int64_t now_us) {
+    if (!prev_acked_frame_.has_value()) {
+        prev_acked_frame_ = frame;
+        prev_recv_time_us_ = recv_time_us;
+        first_recv_time_us_ = recv_time_us;
+        return;
+    }
+    if (frame.id <= prev_acked_frame_->id) {
+        return;
+    }
+    // 两端时钟的偏差在差值里抵消掉了
+    const double delta_ms = ((recv_time_us - prev_recv_time_us_) -
+                             (frame.send_time_us - prev_acked_frame_->send_time_us)) /
+                            1000.0;
+    prev_acked_frame_ = frame;
+    prev_recv_time_us_ = recv_time_us;
+    num_deltas_ = std::min(num_deltas_ + 1, kMaxNumDeltas);
+    accumulated_delay_ms_ += delta_ms;
+    smoothed_delay_ms_ =
+        kSmoothingCoef * smoothed_delay_ms_ + (1 - kSmoothingCoef) * accumulated_delay_ms_;
+    trend_samples_.push_back(
+        {(recv_time_us - first_recv_time_us_) / 1000.0, smoothed_delay_ms_});
+    if (trend_samples_.size() > kTrendWindowSize) {
+        trend_samples_.pop_front();
+    }
+    if (trend_samples_.size() < kTrendWindowSize) {
+        return;
+    }
+    // 最小二乘拟合时延随到达时间的斜率
+    double sum_x = 0;
+    double sum_y = 0;
+    for (auto& sample : trend_samples_) {
+        sum_x += sample.arrival_ms;
+        sum_y += sample.smoothed_delay_ms;
+    }
+    const double avg_x = sum_x / trend_samples_.size();
+    const double avg_y = sum_y / trend_samples_.size();
+    double numerator = 0;
+    double denominator = 0;
+    for (auto& sample : trend_samples_) {
+        numerator += (sample.arrival_ms - avg_x) * (sample.smoothed_delay_ms - avg_y);
+        denominator += (sample.arrival_ms - avg_x) * (sample.arrival_ms - avg_x);
+    }
+    const double slope = denominator == 0 ? 0 : numerator / denominator;
+    const double modified_trend = num_deltas_ * slope * kTrendGain;
+    if (modified_trend > threshold_) {
+        if (overuse_count_ == 0) {
+            overuse_start_us_ = now_us;
+        }
+        overuse_count_++;
+        if (now_us - overuse_start_us_ >= kOveruseTimeUs && overuse_count_ > 1 &&
+            modified_trend >= prev_modified_trend_) {
+            trend_usage_ = Usage::Over;
+        }
+    }
+    else if (modified_trend < -threshold_) {
+        overuse_count_ = 0;
+        trend_usage_ = Usage::Under;
+    }
+    else {
+        overuse_count_ = 0;
+        trend_usage_ = Usage::Normal;
+    }
+    prev_modified_trend_ = modified_trend;
+    updateThreshold(modified_trend, now_us);
+}
+
+// 阈值跟着trend走, 和其它TCP流竞争时不会一直判定过载而饿死
+void RateController::updateThreshold(double modified_trend, int64_t now_us) {
+    if (last_threshold_update_us_ == 0) {
+        last_threshold_update_us_ = now_us;
+    }
+    const double abs_trend = std::fabs(modified_trend);
+    if (abs_trend > threshold_ + kMaxAdaptOffsetMs) {
+        // 突发的尖峰不参与调整
+        last_threshold_update_us_ = now_us;
+        return;
+    }
+    const double k = abs_trend < threshold_ ? kThresholdDown : kThresholdUp;
+    const double elapsed_ms = std::min((now_us - last_threshold_update_us_) / 1000.0, 100.0);
+    threshold_ += k * (abs_trend - threshold_) * elapsed_ms;
+    threshold_ = std::clamp(threshold_, kMinThreshold, kMaxThreshold);
+    last_threshold_update_us_ = now_us;
+}
+
+void RateController::updateAckLatency(int64_t latency_us, int64_t now_us) {
+    // 两个窗口轮换着取最小值, 路由变了之后基准时延也能跟着变
+    if (min_latency_window_start_us_ == 0 ||
+        now_us - min_latency_window_start_us_ >= kMinLatencyWindowUs) {
+        prev_min_latency_us_ = min_latency_us_ == 0 ? latency_us : min_latency_us_;
+        min_latency_us_ = latency_us;
+        min_latency_window_start_us_ = now_us;
+    }
+    else {
+        min_latency_us_ = std::min(min_latency_us_, latency_us);
+    }
+    base_latency_us_ = std::min(prev_min_latency_us_, min_latency_us_);
+    queue_delay_us_ = latency_us - base_latency_us_;
+}
+
+void RateController::updateLoss(int64_t now_us) {
+    if (loss_window_start_us_ == 0) {
+        loss_window_start_us_ = now_us;
+    }
+    if (now_us - loss_window_start_us_ < kLossWindowUs) {
+        return;
+    }
+    const uint32_t total = lost_frames_ + acked_frames_;
+    loss_rate_ = total < kMinLossSamples ? 0.f : static_cast<float>(lost_frames_) / total;
+    lost_frames_ = 0;
+    acked_frames_ = 0;
+    loss_window_start_us_ = now_us;
+}
+
+RateController::Usage RateController::currentUsage(int64_t now_us) const {
+    if (queue_delay_us_ > kMaxQueueDelayUs) {
+        return Usage::Over;
+    }
+    // 被传输层丢掉的增强层帧永远等不到ack, 只看基本层
+    for (auto& frame : sent_frames_) {
+        if (frame.id > last_acked_id_ && frame.temporal_id == 0) {
+            if (now_us - frame.send_time_us > base_latency_us_ + kStallUs) {
+                return Usage::Over;
+            }
+            break;
+        }
+    }
+    return trend_usage_;
+}
+
+void RateController::updateBitrate(Usage usage, int64_t now_us) {
+    const uint32_t acked_bps = ackedBitrate();
+    if (loss_rate_ > kHighLossRate) {
+        if (now_us - last_decrease_us_ >= kDecreaseIntervalUs) {
+            bitrate_bps_ = clampBitrate(bitrate_bps_ * (1.0 - 0.5 * loss_rate_));
+            last_decrease_us_ = now_us;
+            state_ = State::Decrease;
+            // 一个统计周期的丢帧只降一次
+            loss_rate_ = 0.f;
+        }
+        return;
+    }
+    switch (usage) {
+    case Usage::Over:
+        if (now_us - last_decrease_us_ >= kDecreaseIntervalUs) {
+            // 按实际送达码率降. 队列还没排空时送达码率就是瓶颈带宽, 连续几次过载也不会越降越低.
+            // 很久没收到ack时送达码率已经不可信, 只能按当前码率一步步降
+            const bool acked_fresh = now_us - last_ack_us_ < kAckedWindowUs;
+            const uint32_t delivered =
+                acked_bps == 0 || !acked_fresh ? bitrate_bps_ : acked_bps;
+            bitrate_bps_ = std::min(bitrate_bps_, clampBitrate(kBeta * delivered));
+            congestion_bps_ = delivered;
+            last_decrease_us_ = now_us;
+            state_ = State::Decrease;
+        }
+        return;
+    case Usage::Under:
+        // 队列正在排空, 先不动
+        state_ = State::Hold;
+        return;
+    case Usage::Normal:
+    default:
+        break;
+    }
+    if (state_ == State::Decrease || loss_rate_ > kLowLossRate) {
+        state_ = State::Hold;
+        return;
+    }
+    state_ = State::Increase;
+    if (congestion_bps_ != 0 && bitrate_bps_ > congestion_bps_ * kNearCongestionRange) {
+        congestion_bps_ = 0;
+    }
+    // 降得比上次拥塞点低很多时(比如连续过载), 也按远离拥塞点的速度涨回去
+    const bool near_congestion =
+        congestion_bps_ != 0 && bitrate_bps_ * kNearCongestionRange >= congestion_bps_;
+    const double rate = near_congestion ? kNearIncreasePerSecond : kFarIncreasePerSecond;
+    const double elapsed_s =
+        last_update_us_ == 0 ? 0 : std::min((now_us - last_update_us_) / 1e6, kMaxIncreaseStepS);
+    double target = bitrate_bps_ * (1.0 + rate * elapsed_s);
+    // 画面静止或者编码器跟不上时送达码率远低于目标, 再往上加也没有意义
+    if (acked_bps != 0) {
+        target = std::min(
+            target, std::max<double>(bitrate_bps_, 1.5 * acked_bps + kAckedHeadroomBps));
+    }
+    bitrate_bps_ = clampBitrate(target);
+}
+
+void RateController::updateFps(int64_t now_us) {
+    const bool overloaded = encode_time_us_ > kOverloadEncodeRatio * 1e6 / fps_cap_ ||
+                            undecoded_frames_ > kMaxUndecodedFrames;
+    const uint32_t next_fps_cap = std::min(params_.max_fps, fps_cap_ * 4 / 3);
+    // 升帧率之后编码耗时依然要有余量, 否则会来回跳
+    const bool healthy = encode_time_us_ < kHealthyEncodeRatio * 1e6 / next_fps_cap &&
+                         undecoded_frames_ < kMaxUndecodedFrames / 2;
+    if (overloaded) {
+        healthy_since_us_ = 0;
+        if (overload_since_us_ == 0) {
+            overload_since_us_ = now_us;
+        }
+        else if (now_us - overload_since_us_ >= kOverloadUs) {
+            fps_cap_ = std::max(params_.min_fps, fps_cap_ * 3 / 4);
+            overload_since_us_ = now_us;
+        }
+    }
+    else {
+        overload_since_us_ = 0;
+        if (!healthy || fps_cap_ >= params_.max_fps) {
+            healthy_since_us_ = 0;
+        }
+        else if (healthy_since_us_ == 0) {
+            healthy_since_us_ = now_us;
+        }
+        else if (now_us - healthy_since_us_ >= kHealthyUs) {
+            fps_cap_ = std::max(next_fps_cap, fps_cap_ + 1);
+            healthy_since_us_ = now_us;
+        }
+    }
+    // 码率太低时降帧率, 把码率留给每一帧的画质
+    if (!low_bitrate_ && bitrate_bps_ < kLowBitrateBps) {
+        low_bitrate_ = true;
+    }
+    else if (low_bitrate_ && bitrate_bps_ > kLowBitrateRecoverBps) {
+        low_bitrate_ = false;
+    }
+    fps_ = fps_cap_;
+    if (low_bitrate_) {
+        fps_ = std::min(fps_, std::max(kLowBitrateFps, params_.min_fps));
+    }
+}
+
+uint32_t RateController::ackedBitrate() const {
+    if (acked_bytes_.size() < 2) {
+        return 0;
+    }
+    const int64_t span_us = acked_bytes_.back().recv_time_us - acked_bytes_.front().recv_time_us;
+    if (span_us < kMinAckedSpanUs) {
+        return 0;
+    }
+    // 第一帧的到达时间只是起点
+    uint64_t bytes = 0;
+    for (size_t i = 1; i < acked_bytes_.size(); i++) {
+        bytes += acked_bytes_[i].size;
+    }
+    return static_cast<uint32_t>(std::min<uint64_t>(bytes * 8 * 1'000'000 / span_us, UINT32_MAX));
+}
+
+uint32_t RateController::clampBitrate(double bitrate_bps) const {
+    return static_cast<uint32_t>(std::clamp<double>(bitrate_bps, params_.min_bitrate_bps,
+                                                    params_.max_bitrate_bps));
+}
+
+} // namespace video
+
+} // namespace lt
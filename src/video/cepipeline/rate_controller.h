@@ -0,0 +1,177 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+namespace lt {
+
+namespace video {
+
+// 根据客户端回的VideoFrameAck1闭环调整编码码率和帧率. 不涉及IO和线程, 由VCEPipeline驱动.
+// 拥塞信号:
+//   1. 帧间到达间隔减去发送间隔的累积值的斜率(trendline), 持续上升说明瓶颈处在排队
+//   2. ack相对最小ack时延多出来的部分, 即排队时延. 慢慢堆起来的队列斜率不一定明显
+//   3. ack序号的空洞, 即丢帧. 时域分层时传输层积压会故意丢增强层的帧,
+//      所以只统计基本层的空洞
+// 码率按AIMD状态机调整: 过载时降到实际送达码率的85%, 空闲时先保持, 正常时增加,
+// 离上次拥塞点近时慢慢加, 远时按比例加. 编码耗时超过帧间隔或者客户端解码排队时降帧率,
+// 码率太低时也降帧率换取单帧质量. 变化太小的结果不输出, 避免频繁重配编码器.
+class RateController {
+public:
+    struct Params {
+        uint32_t start_bitrate_bps = 4'000'000;
+        uint32_t min_bitrate_bps = 500'000;
+        uint32_t max_bitrate_bps = 100'000'000;
+        uint32_t max_fps = 60;
+        uint32_t min_fps = 20;
+    };
+    enum class State : uint8_t {
+        Hold,
+        Increase,
+        Decrease,
+    };
+    struct Target {
+        uint32_t bitrate_bps;
+        uint32_t fps;
+    };
+
+public:
+    explicit RateController(const Params& params);
+    // temporal_id是时域分层的层号, 不分层时填0
+    void onFrameSent(int64_t frame_id, uint32_t size, uint8_t temporal_id, int64_t encode_time_us,
+                     int64_t now_us);
+    // recv_time_us是客户端的时钟, 只用它的差值
+    void onFrameAck(int64_t frame_id, int64_t recv_time_us, int32_t undecoded_frames,
+                    int64_t now_us);
+    // 码率被外部(用户, 传输层的BWE, 带宽探测)改掉了, 从这个码率接着调
+    void resetBitrate(uint32_t bitrate_bps, int64_t now_us);
+    // 需要重配编码器时返回新的目标
+    std::optional<Target> poll(int64_t now_us);
+    State state() const { return state_; }
+    uint32_t bitrate() const { return bitrate_bps_; }
+    uint32_t fps() const { return fps_; }
+    // 最近一次的排队时延估计
+    int64_t queueDelayUs() const { return queue_delay_us_; }
+
+private:
+    enum class Usage : uint8_t {
+        Normal,
+        Over,
+        Under,
+    };
+    struct SentFrame {
+        int64_t id;
+        uint32_t size;
+        int64_t send_time_us;
+        uint8_t temporal_id;
+        bool acked;
+    };
+    struct TrendSample {
+        double arrival_ms;
+        double smoothed_delay_ms;
+    };
+    struct AckedBytes {
+        int64_t recv_time_us;
+        uint32_t size;
+    };
+
+    bool countsAsLost(const SentFrame& frame) const;
+    void updateTrendline(const SentFrame& frame, int64_t recv_time_us, int64_t now_us);
+    void updateThreshold(double modified_trend, int64_t now_us);
+    void updateAckLatency(int64_t latency_us, int64_t now_us);
+    void updateLoss(int64_t now_us);
+    Usage currentUsage(int64_t now_us) const;
+    void updateBitrate(Usage usage, int64_t now_us);
+    void updateFps(int64_t now_us);
+    uint32_t ackedBitrate() const;
+    uint32_t clampBitrate(double bitrate_bps) const;
+
+private:
+    const Params params_;
+    State state_ = State::Hold;
+    uint32_t bitrate_bps_;
+    uint32_t fps_;
+    // 编码器当前实际用的值
+    uint32_t applied_bitrate_bps_;
+    uint32_t applied_fps_;
+    int64_t last_apply_us_ = 0;
+    int64_t last_update_us_ = 0;
+    int64_t last_decrease_us_ = 0;
+    // 上次拥塞时的送达码率, 0表示离拥塞点很远
+    uint32_t congestion_bps_ = 0;
+
+    std::deque<SentFrame> sent_frames_;
+    int64_t last_acked_id_ = -1;
+    int64_t last_ack_us_ = 0;
+    std::optional<SentFrame> prev_acked_frame_;
+    int64_t prev_recv_time_us_ = 0;
+    int64_t first_recv_time_us_ = 0;
+    std::deque<AckedBytes> acked_bytes_;
+
+    // trendline
+    std::deque<TrendSample> trend_samples_;
+    double accumulated_delay_ms_ = 0;
+    double smoothed_delay_ms_ = 0;
+    double prev_modified_trend_ = 0;
+    uint32_t num_deltas_ = 0;
+    double threshold_ = 12.5;
+    int64_t last_threshold_update_us_ = 0;
+    Usage trend_usage_ = Usage::Normal;
+    uint32_t overuse_count_ = 0;
+    int64_t overuse_start_us_ = 0;
+
+    // ack时延 = 发送到收到ack的主机时间, 减去窗口内的最小值就是排队时延
+    int64_t min_latency_us_ = 0;
+    int64_t prev_min_latency_us_ = 0;
+    int64_t min_latency_window_start_us_ = 0;
+    int64_t base_latency_us_ = 0;
+    int64_t queue_delay_us_ = 0;
+
+    // 丢帧统计, 每个周期算一次
+    uint32_t lost_frames_ = 0;
+    uint32_t acked_frames_ = 0;
+    float loss_rate_ = 0.f;
+    int64_t loss_window_start_us_ = 0;
+
+    // 帧率
+    double encode_time_us_ = 0;
+    double undecoded_frames_ = 0;
+    uint32_t fps_cap_;
+    int64_t overload_since_us_ = 0;
+    int64_t healthy_since_us_ = 0;
+    bool low_bitrate_ = false;
+};
+
+} // namespace video
+
+} // namespace lt
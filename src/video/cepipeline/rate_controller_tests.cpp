@@ -0,0 +1,332 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <transport/tcp/layer_dropper.h>
+
+#include "rate_controller.h"
+
+using lt::tp::LayerDropper;
+using lt::video::RateController;
+
+namespace {
+
+// 一段时间内恒定的链路参数, 多段拼起来模拟带宽变化
+struct TraceStep {
+    int64_t duration_ms;
+    uint32_t bandwidth_bps;
+    int64_t one_way_delay_ms;
+    // 按帧丢, 模拟整帧重传失败或者被丢弃
+    double frame_loss;
+};
+
+// 按真实网络的特征合成的几段trace
+const std::vector<TraceStep> kLanStable = {
+    {30'000, 80'000'000, 2, 0},
+};
+const std::vector<TraceStep> kWifiFluctuating = {
+    {8'000, 40'000'000, 5, 0},  {6'000, 15'000'000, 8, 0}, {6'000, 30'000'000, 5, 0},
+    {6'000, 8'000'000, 10, 0}, {10'000, 25'000'000, 5, 0},
+};
+const std::vector<TraceStep> kSuddenDrop = {
+    {15'000, 30'000'000, 10, 0},
+    {10'000, 3'000'000, 10, 0},
+    {25'000, 30'000'000, 10, 0},
+};
+const std::vector<TraceStep> kLossyWan = {
+    {30'000, 12'000'000, 30, 0.03},
+};
+
+struct SimStats {
+    // 每秒一个点
+    std::vector<uint32_t> sent_bps;
+    std::vector<uint32_t> capacity_bps;
+    std::vector<uint32_t> target_bps;
+    std::vector<int64_t> frame_delays_ms;
+    uint32_t reconfigures = 0;
+    uint32_t final_fps = 0;
+};
+
+// 瓶颈处是一个尾部丢弃的FIFO, 帧切成1200字节的包排队通过. 编码器按目标码率出帧, 大小有抖动.
+// 客户端收齐一帧后回ack, 带上客户端时钟的到达时间
+class Simulator {
+public:
+    Simulator(const std::vector<TraceStep>& trace, const RateController::Params& params)
+        : trace_{trace}
+        , controller_{params}
+        , bitrate_bps_{params.start_bitrate_bps}
+        , fps_{params.max_fps} {}
+
+    SimStats run(double encode_time_ms = 1.0) {
+        SimStats stats;
+        int64_t end_ms = 0;
+        for (auto& step : trace_) {
+            end_ms += step.duration_ms;
+        }
+        double next_frame_ms = 0;
+        uint64_t second_bytes = 0;
+        int64_t frame_id = 0;
+        for (int64_t now_ms = 0; now_ms < end_ms; now_ms++) {
+            const TraceStep& step = stepAt(now_ms);
+            const int64_t now_us = now_ms * 1000;
+            if (now_ms >= next_frame_ms) {
+                next_frame_ms += 1000.0 / fps_;
+                const uint32_t size = frameSize();
+                sendFrame(frame_id, size, now_us, step);
+                controller_.onFrameSent(frame_id, size, 0,
+                                        static_cast<int64_t>(encode_time_ms * 1000), now_us);
+                frame_id++;
+                second_bytes += size;
+            }
+            drainLink(now_us, step);
+            deliverAcks(now_us);
+            if (auto target = controller_.poll(now_us)) {
+                bitrate_bps_ = target->bitrate_bps;
+                fps_ = target->fps;
+                stats.reconfigures++;
+            }
+            if (now_ms % 1000 == 999) {
+                stats.sent_bps.push_back(static_cast<uint32_t>(second_bytes * 8));
+                stats.capacity_bps.push_back(step.bandwidth_bps);
+                stats.target_bps.push_back(bitrate_bps_);
+                second_bytes = 0;
+            }
+        }
+        stats.frame_delays_ms = std::move(frame_delays_ms_);
+        stats.final_fps = fps_;
+        return stats;
+    }
+
+private:
+    struct Packet {
+        int64_t frame_id;
+        uint32_t size;
+        bool last;
+        int64_t send_time_us;
+    };
+    struct Ack {
+        int64_t frame_id;
+        int64_t client_recv_us;
+        int64_t host_arrive_us;
+    };
+    static constexpr uint32_t kPacketSize = 1200;
+    // 客户端时钟和主机时钟没有同步
+    static constexpr int64_t kClientClockOffsetUs = 123'456'789;
+
+    const TraceStep& stepAt(int64_t now_ms) const {
+        for (auto& step : trace_) {
+            if (now_ms < step.duration_ms) {
+                return step;
+            }
+            now_ms -= step.duration_ms;
+        }
+        return trace_.back();
+    }
+
+    uint32_t frameSize() {
+        std::uniform_real_distribution<double> noise{0.8, 1.2};
+        return static_cast<uint32_t>(bitrate_bps_ / 8.0 / fps_ * noise(rng_));
+    }
+
+    void sendFrame(int64_t frame_id, uint32_t size, int64_t now_us, const TraceStep& step) {
+        std::uniform_real_distribution<double> dice{0, 1};
+        const bool lost = dice(rng_) < step.frame_loss;
+        // 大约能排500ms的数据, 放不下的帧整帧丢掉
+        const uint64_t queue_limit =
+            std::max<uint64_t>(64 * 1024, static_cast<uint64_t>(step.bandwidth_bps) / 16);
+        if (queue_bytes_ + size > queue_limit) {
+            return;
+        }
+        for (uint32_t offset = 0; offset < size; offset += kPacketSize) {
+            const uint32_t packet_size = std::min(kPacketSize, size - offset);
+            const bool last = offset + kPacketSize >= size;
+            queue_.push_back({frame_id, packet_size, last && !lost, now_us});
+            queue_bytes_ += packet_size;
+        }
+    }
+
+    void drainLink(int64_t now_us, const TraceStep& step) {
+        credit_bytes_ += step.bandwidth_bps / 8.0 / 1000.0;
+        while (!queue_.empty() && credit_bytes_ >= queue_.front().size) {
+            const Packet packet = queue_.front();
+            queue_.pop_front();
+            queue_bytes_ -= packet.size;
+            credit_bytes_ -= packet.size;
+            if (packet.last) {
+                const int64_t arrive_us = now_us + step.one_way_delay_ms * 1000;
+                frame_delays_ms_.push_back((arrive_us - packet.send_time_us) / 1000);
+                acks_.push_back({packet.frame_id, arrive_us + kClientClockOffsetUs,
+                                 arrive_us + step.one_way_delay_ms * 1000});
+            }
+        }
+        if (queue_.empty()) {
+            credit_bytes_ = std::min(credit_bytes_, static_cast<double>(kPacketSize));
+        }
+    }
+
+    void deliverAcks(int64_t now_us) {
+        while (!acks_.empty() && acks_.front().host_arrive_us <= now_us) {
+            controller_.onFrameAck(acks_.front().frame_id, acks_.front().client_recv_us, 0,
+                                   now_us);
+            acks_.pop_front();
+        }
+    }
+
+private:
+    const std::vector<TraceStep> trace_;
+    RateController controller_;
+    uint32_t bitrate_bps_;
+    uint32_t fps_;
+    std::mt19937 rng_{20231115};
+    std::deque<Packet> queue_;
+    uint64_t queue_bytes_ = 0;
+    double credit_bytes_ = 0;
+    std::deque<Ack> acks_;
+    std::vector<int64_t> frame_delays_ms_;
+};
+
+double utilization(const SimStats& stats, size_t from_s, size_t to_s) {
+    double sent = 0;
+    double capacity = 0;
+    for (size_t i = from_s; i < to_s && i < stats.sent_bps.size(); i++) {
+        sent += std::min(stats.sent_bps[i], stats.capacity_bps[i]);
+        capacity += stats.capacity_bps[i];
+    }
+    return capacity == 0 ? 0 : sent / capacity;
+}
+
+int64_t p95Delay(SimStats stats) {
+    if (stats.frame_delays_ms.empty()) {
+        return 0;
+    }
+    auto nth = stats.frame_delays_ms.begin() + stats.frame_delays_ms.size() * 95 / 100;
+    std::nth_element(stats.frame_delays_ms.begin(), nth, stats.frame_delays_ms.end());
+    return *nth;
+}
+
+void printStats(const char* name, const SimStats& stats) {
+    printf("%s: p95 delay %lldms, reconfigures %u\n", name,
+           static_cast<long long>(p95Delay(stats)), stats.reconfigures);
+    for (size_t i = 0; i < stats.sent_bps.size(); i++) {
+        printf("  %2zus sent %6.2fMbps target %6.2fMbps capacity %6.2fMbps\n", i + 1,
+               stats.sent_bps[i] / 1e6, stats.target_bps[i] / 1e6, stats.capacity_bps[i] / 1e6);
+    }
+}
+
+} // namespace
+
+TEST(RateControllerTest, NoFeedbackNoChange) {
+    RateController controller{RateController::Params{}};
+    for (int64_t now_us = 0; now_us < 5'000'000; now_us += 16'000) {
+        controller.onFrameSent(now_us / 16'000, 10'000, 0, 1'000, now_us);
+        EXPECT_FALSE(controller.poll(now_us).has_value());
+    }
+    EXPECT_EQ(controller.bitrate(), RateController::Params{}.start_bitrate_bps);
+}
+
+TEST(RateControllerTest, LanStable) {
+    Simulator sim{kLanStable, RateController::Params{}};
+    SimStats stats = sim.run();
+    printStats("lan_stable", stats);
+    EXPECT_GT(utilization(stats, 20, 30), 0.6);
+    EXPECT_LT(p95Delay(stats), 100);
+    // 平均每秒不超过2次重配编码器
+    EXPECT_LT(stats.reconfigures, 60u);
+}
+
+TEST(RateControllerTest, WifiFluctuating) {
+    Simulator sim{kWifiFluctuating, RateController::Params{}};
+    SimStats stats = sim.run();
+    printStats("wifi_fluctuating", stats);
+    EXPECT_GT(utilization(stats, 0, stats.sent_bps.size()), 0.4);
+    EXPECT_LT(p95Delay(stats), 300);
+}
+
+TEST(RateControllerTest, SuddenDrop) {
+    RateController::Params params{};
+    params.start_bitrate_bps = 20'000'000;
+    Simulator sim{kSuddenDrop, params};
+    SimStats stats = sim.run();
+    printStats("sudden_drop", stats);
+    // 带宽掉到3Mbps后2秒内降下来
+    for (size_t i = 17; i < 25; i++) {
+        EXPECT_LT(stats.target_bps[i], 3'300'000u) << "second " << i + 1;
+    }
+    // 带宽恢复后能重新涨上去
+    EXPECT_GT(stats.target_bps.back(), 12'000'000u);
+}
+
+TEST(RateControllerTest, LossyWan) {
+    RateController::Params params{};
+    params.start_bitrate_bps = 8'000'000;
+    Simulator sim{kLossyWan, params};
+    SimStats stats = sim.run();
+    printStats("lossy_wan", stats);
+    // 随机丢包不是拥塞, 码率不能一路掉下去
+    EXPECT_GT(utilization(stats, 10, 30), 0.5);
+    EXPECT_LT(p95Delay(stats), 200);
+}
+
+TEST(RateControllerTest, EncoderOverload) {
+    Simulator sim{kLanStable, RateController::Params{}};
+    // 60帧时每帧只有16ms, 编码要25ms
+    SimStats stats = sim.run(25.0);
+    EXPECT_LE(stats.final_fps, 40u);
+    EXPECT_GE(stats.final_fps, RateController::Params{}.min_fps);
+
+    // 编码变快后帧率慢慢恢复
+    RateController controller{RateController::Params{}};
+    int64_t now_us = 0;
+    int64_t id = 0;
+    auto run_for = [&](int64_t duration_us, int64_t encode_time_us) {
+        const int64_t end_us = now_us + duration_us;
+        for (; now_us < end_us; now_us += 1'000'000 / controller.fps()) {
+            controller.onFrameSent(id, 20'000, 0, encode_time_us, now_us);
+            controller.onFrameAck(id, now_us + 2'000, 0, now_us + 4'000);
+            id++;
+            controller.poll(now_us + 4'000);
+        }
+    };
+    run_for(5'000'000, 25'000);
+    EXPECT_LT(controller.fps(), 60u);
+    run_for(30'000'000, 3'000);
+    EXPECT_EQ(controller.fps(), 60u);
+}
+
+TEST(RateControllerTest, ClientDecodeBacklog) {
+    RateController controller{RateController::Params{}};
+    int64_t now_us = 0;
+    for (int64_t id = 0; id < 300; id++, now_us += 16'667) {
+        controller.onFrameSent(id, 20'000, 0, 2'000, now_us);
+        controller.onFrameAck(id, now_us + 2'000, 5, now_us + 4'000);
+        controller.poll(now_us + 4'000);
+    }
+    EXPECT_LT(controller.fps(), 60u);
+}
+
+TEST(RateControllerTest, LayerDroppedFramesAreNotLost) {
+    RateController controller{RateController::Params{}};
+    LayerDropper dropper{LayerDropper::Params{}};
+    int64_t now_us = 0;
+    uint64_t dropped = 0;
+    for (int64_t id = 0; id < 600; id++, now_us += 16'667) {
+        // 两层, 发送队列一直有积压, 增强层全被传输层丢掉, 基本层的ack都正常
+        const uint8_t temporal_id = id % 2;
+        controller.onFrameSent(id, 20'000, temporal_id, 2'000, now_us);
+        if (dropper.onFrame(temporal_id, id == 0, 20'000, 80'000, false)) {
+            controller.onFrameAck(id, now_us + 2'000, 0, now_us + 4'000);
+        }
+        else {
+            dropped++;
+        }
+        controller.poll(now_us + 4'000);
+        ASSERT_NE(controller.state(), RateController::State::Decrease) << "frame " << id;
+    }
+    EXPECT_EQ(dropped, 300u);
+    EXPECT_GT(controller.bitrate(), RateController::Params{}.start_bitrate_bps);
+}
@@ -37,6 +37,7 @@
 #include <cstdint>
 #include <deque>
 #include <future>
+#include <optional>
 #include <unordered_map>
 
 #include <google/protobuf/message_lite.h>
@@ -44,6 +45,7 @@
 #include <ltproto/client2worker/change_streaming_params.pb.h>
 #include <ltproto/client2worker/cursor_info.pb.h>
 #include <ltproto/client2worker/request_keyframe.pb.h>
+#include <ltproto/client2worker/request_ltr_recovery.pb.h>
 #include <ltproto/client2worker/video_frame_ack1.pb.h>
 #include <ltproto/ltproto.h>
 #include <ltproto/worker2service/network_changed.pb.h>
@@ -55,9 +57,19 @@
 
 #include <video/capturer/video_capturer.h>
 #include <video/encoder/video_encoder.h>
+#include <video/h264/h264_parser.h>
+
+#include "frame_stages.h"
+#include "ltr_controller.h"
+#include "rate_controller.h"
 
 namespace {
 
+// 画面静止时不编码, 但至少隔这么久编一帧, 客户端的统计和码控不会断掉
+constexpr int64_t kStaticRefreshIntervalUs = 500'000;
+// 流水线各段耗时的统计间隔
+constexpr int64_t kStageStatsIntervalUs = 10'000'000;
+
 void addHistory(std::deque<int64_t>& history) {
     int64_t now = ltlib::steady_now_us();
     const int64_t kOneSecond = 1'000'000;
@@ -125,6 +137,8 @@ std::unique_ptr<VCEPipeline2> VCEPipeline2::create(const CaptureEncodePipeline::
 // #endif // LT_WINDOWS
 
 class VCEPipeline : public CaptureEncodePipeline {
+    using VideoFrameStages = FrameStages<std::shared_ptr<ltproto::client2worker::VideoFrame>>;
+
 public:
     static std::unique_ptr<VCEPipeline> create(const CaptureEncodePipeline::Params& params);
     ~VCEPipeline() override;
@@ -136,21 +150,33 @@ public:
 private:
     VCEPipeline(const CaptureEncodePipeline::Params& params);
     bool init();
+    bool initStages();
     void mainLoop(const std::function<void()>& i_am_alive, std::promise<bool>& start_promise);
     void loadSystemCursor();
     bool registerHandlers();
     void consumeTasks();
     void captureAndSendCursor();
     void captureAndSendVideoFrame();
+    void onEncodeLoop();
+    auto encodeFrame(const Capturer::Frame& frame)
+        -> std::shared_ptr<ltproto::client2worker::VideoFrame>;
+    void sendVideoFrame(const std::shared_ptr<ltproto::client2worker::VideoFrame>& frame);
+    void reportStageStats();
+    void recoverFromLtr(int64_t ltr_picture_id);
+    void adjustBitrate();
     auto resolutionChanged() -> std::optional<ltlib::DisplayOutputDesc>;
+    bool changeEncoderResolution(uint32_t width, uint32_t height);
+    auto recreateEncoder(uint32_t width, uint32_t height) -> std::unique_ptr<Encoder>;
     void sendChangeStreamingParams(ltlib::DisplayOutputDesc desc);
     bool shouldEncodeFrame();
+    bool isStaticFrame(const Capturer::Frame& frame);
     auto getDxgiCursorInfo() -> std::shared_ptr<google::protobuf::MessageLite>;
     auto getWin32CursorInfo() -> std::shared_ptr<google::protobuf::MessageLite>;
 
     // 从service收到的消息
     void onReconfigure(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onRequestKeyframe(std::shared_ptr<google::protobuf::MessageLite> msg);
+    void onRequestLtrRecovery(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onNetworkEvent(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onVideoFrameAck1(std::shared_ptr<google::protobuf::MessageLite> msg);
 
@@ -159,16 +185,28 @@ private:
     uint32_t height_;
     uint32_t client_refresh_rate_;
     uint32_t max_fps_;
-    uint32_t target_fps_;
+    // 编码线程里改, 抓屏线程里读
+    std::atomic<uint32_t> target_fps_;
     uint32_t max_bps_;
+    const uint32_t soft_encoder_threads_;
+    const bool enable_ltr_;
+    const uint32_t temporal_layers_;
     ltlib::Monitor monitor_;
     std::function<bool(uint32_t, const MessageHandler&)> register_message_handler_;
     std::function<bool(uint32_t, const std::shared_ptr<google::protobuf::MessageLite>&)>
         send_message_;
+    std::function<void(uint32_t, uint32_t)> on_resolution_changed_;
     std::vector<VideoCodecType> client_supported_codecs_;
     std::unique_ptr<ltlib::BlockingThread> thread_;
     std::unique_ptr<Capturer> capturer_;
     std::unique_ptr<Encoder> encoder_;
+    // 编码器当前的码率, 中途重建编码器时接着用
+    uint32_t encoder_bitrate_bps_ = 0;
+    std::unique_ptr<RateController> rate_controller_;
+    // 编码器不支持LTR时为空
+    std::unique_ptr<LtrController> ltr_;
+    std::unique_ptr<VideoFrameStages> stages_;
+    int64_t last_stage_stats_us_ = 0;
     uint64_t frame_no_ = 0;
     std::atomic<bool> stoped_{true};
     std::unique_ptr<std::promise<void>> stop_promise_;
@@ -179,7 +217,9 @@ private:
     bool get_win32_cursor_failed_ = false;
     std::deque<int64_t> capture_history_;
     int64_t last_encode_time_us_ = 0;
-    bool half_fps_ = false;
+    std::atomic<bool> half_fps_{false};
+    std::atomic<bool> keyframe_requested_{false};
+    uint64_t static_frames_ = 0;
     std::map<std::string, int32_t> cursors_map_;
     int32_t latest_cursor_id_ = 0;
 };
@@ -192,9 +232,13 @@ VCEPipeline::VCEPipeline(const CaptureEncodePipeline::Params& params)
     , target_fps_{params.client_refresh_rate}
     , max_bps_{(params.max_mbps == 0 || params.max_mbps > 100) ? (100 * 1000 * 1000)
                                                                : (params.max_mbps * 1000 * 1000)}
+    , soft_encoder_threads_{params.soft_encoder_threads}
+    , enable_ltr_{params.enable_ltr}
+    , temporal_layers_{params.temporal_layers}
     , monitor_{params.monitor}
     , register_message_handler_{params.register_message_handler}
     , send_message_{params.send_message}
+    , on_resolution_changed_{params.on_resolution_changed}
     , client_supported_codecs_{params.codecs} {}
 
 std::unique_ptr<VCEPipeline> VCEPipeline::create(const CaptureEncodePipeline::Params& params) {
@@ -242,6 +286,9 @@ bool VCEPipeline::init() {
     encode_params.device = capturer->device();
     encode_params.context = capturer->deviceContext();
     encode_params.vendor_id = capturer->vendorID();
+    encode_params.soft_threads = soft_encoder_threads_;
+    encode_params.ltr = enable_ltr_;
+    encode_params.temporal_layers = temporal_layers_;
     std::unique_ptr<Encoder> encoder;
     // try hard first
     for (auto codec : client_supported_codecs_) {
@@ -280,13 +327,44 @@ bool VCEPipeline::init() {
         if (!capturer->setCaptureFormat(encoder->captureFormat())) {
             return false;
         }
+        RateController::Params rc_params{};
+        rc_params.start_bitrate_bps = encode_params.bitrate_bps;
+        rc_params.max_bitrate_bps = max_bps_;
+        rc_params.min_bitrate_bps = std::min(rc_params.min_bitrate_bps, max_bps_);
+        rc_params.max_fps = max_fps_;
+        rc_params.min_fps = std::min(rc_params.min_fps, max_fps_);
+        rate_controller_ = std::make_unique<RateController>(rc_params);
+        if (encoder->ltrEnabled()) {
+            ltr_ = std::make_unique<LtrController>(LtrController::Params{});
+        }
+        encoder_bitrate_bps_ = encode_params.bitrate_bps;
         encoder_ = std::move(encoder);
         capturer_ = std::move(capturer);
-        return true;
+        return initStages();
     }
     return false;
 }
 
+// 硬件编码和抓屏共用同一个D3D11 immediate context, 只能待在一个线程里, 只把发送拆出去.
+// 内存里的I420帧带着引用计数的buffer, 抓屏线程可以在编码还没结束时就去抓下一帧
+bool VCEPipeline::initStages() {
+    VideoFrameStages::Params params{};
+    params.stages = encoder_->captureFormat() == CaptureFormat::MEM_I420 ? 3 : 2;
+    params.on_encode_loop = std::bind(&VCEPipeline::onEncodeLoop, this);
+    params.encode = std::bind(&VCEPipeline::encodeFrame, this, std::placeholders::_1);
+    params.send = std::bind(&VCEPipeline::sendVideoFrame, this, std::placeholders::_1);
+    params.on_resolution_changed = std::bind(&VCEPipeline::changeEncoderResolution, this,
+                                             std::placeholders::_1, std::placeholders::_2);
+    params.thread_prefix = "lt_video";
+    stages_ = VideoFrameStages::create(params);
+    if (stages_ == nullptr) {
+        LOG(ERR) << "Create FrameStages failed";
+        return false;
+    }
+    LOG(INFO) << "CaptureEncodePipeline uses " << params.stages << " stages";
+    return true;
+}
+
 bool VCEPipeline::start() {
     std::promise<bool> start_promise;
     thread_ = ltlib::BlockingThread::create(
@@ -329,24 +407,43 @@ void VCEPipeline::mainLoop(const std::function<void()>& i_am_alive,
         start_promise.set_value(false);
         return;
     }
+    if (!stages_->start()) {
+        LOG(ERR) << "Start FrameStages failed";
+        stages_->stop();
+        start_promise.set_value(false);
+        return;
+    }
     start_promise.set_value(true);
     stop_promise_ = std::make_unique<std::promise<void>>();
     stoped_ = false;
+    last_stage_stats_us_ = ltlib::steady_now_us();
     LOG(INFO) << "CaptureEncodePipeline start";
     while (!stoped_) {
         i_am_alive();
         // vblank后应该第一时间抓屏还是消费任务？
-        consumeTasks();
+        // 编码不在这个线程时, 任务和码控由编码线程自己处理
+        stages_->tick();
         auto resolution = resolutionChanged();
         if (resolution.has_value()) {
-            sendChangeStreamingParams(resolution.value());
-            stoped_ = true;
-            break;
+            if (resolution->rotation != monitor_.rotation) {
+                // 旋转方向没有跟着码流走, 还是要客户端重建流水线, worker重启
+                sendChangeStreamingParams(resolution.value());
+                stoped_ = true;
+                break;
+            }
+            // 流水线不停, 编码线程拿到新分辨率的第一帧时再换编码器, 新的宽高跟着码流带给客户端
+            width_ = static_cast<uint32_t>(resolution->width);
+            height_ = static_cast<uint32_t>(resolution->height);
+            if (on_resolution_changed_ != nullptr) {
+                on_resolution_changed_(width_, height_);
+            }
         }
         capturer_->waitForVBlank();
         captureAndSendVideoFrame();
         captureAndSendCursor();
+        reportStageStats();
     }
+    stages_->stop();
     stop_promise_->set_value();
     LOG(INFO) << "CaptureEncodePipeline stoped";
 }
@@ -379,6 +476,7 @@ bool VCEPipeline::registerHandlers() {
     const std::pair<uint32_t, MessageHandler> handlers[] = {
         {ltype::kReconfigureVideoEncoder, std::bind(&VCEPipeline::onReconfigure, this, ph::_1)},
         {ltype::kRequestKeyframe, std::bind(&VCEPipeline::onRequestKeyframe, this, ph::_1)},
+        {ltype::kRequestLtrRecovery, std::bind(&VCEPipeline::onRequestLtrRecovery, this, ph::_1)},
         {ltype::kNetworkChanged, std::bind(&VCEPipeline::onNetworkEvent, this, ph::_1)},
         {ltype::kVideoFrameAck1, std::bind(&VCEPipeline::onVideoFrameAck1, this, ph::_1)}};
     for (auto& handler : handlers) {
@@ -426,28 +524,131 @@ void VCEPipeline::captureAndSendCursor() {
 }
 
 void VCEPipeline::captureAndSendVideoFrame() {
+    const int64_t start_capture = ltlib::steady_now_us();
     auto captured_frame = capturer_->capture();
+    stages_->recordCapture(ltlib::steady_now_us() - start_capture);
     if (!captured_frame.has_value()) {
         return;
     }
     if (encoder_->doneFrame1()) {
         capturer_->doneWithFrame();
     }
-    if (!shouldEncodeFrame()) {
+    if (isStaticFrame(captured_frame.value()) || !shouldEncodeFrame()) {
         if (encoder_->doneFrame2()) {
             capturer_->doneWithFrame();
         }
         return;
     }
-    auto encoded_frame = encoder_->encode(captured_frame.value());
+    // 2段时在这里同步编码, 3段时交给编码线程, 编码线程还没来得及编的上一帧会被替换掉
+    stages_->push(std::move(captured_frame.value()));
     if (encoder_->doneFrame2()) {
         capturer_->doneWithFrame();
     }
+}
+
+void VCEPipeline::onEncodeLoop() {
+    consumeTasks();
+    adjustBitrate();
+}
+
+std::shared_ptr<ltproto::client2worker::VideoFrame>
+VCEPipeline::encodeFrame(const Capturer::Frame& frame) {
+    auto encoded_frame = encoder_->encode(frame);
     if (encoded_frame == nullptr) {
-        return;
+        return nullptr;
+    }
+    keyframe_requested_ = false;
+    if (ltr_ != nullptr) {
+        const std::string& bitstream = encoded_frame->frame();
+        ltr_->onEncoded(encoded_frame->picture_id(),
+                        reinterpret_cast<const uint8_t*>(bitstream.data()), bitstream.size());
+    }
+    // 传输层积压时会丢增强层的帧, 这些帧没有ack, 码控要知道它们在哪一层
+    uint8_t temporal_id = 0;
+    if (isAVC(encoder_->codecType())) {
+        const std::string& bitstream = encoded_frame->frame();
+        temporal_id = parseH264TemporalId(reinterpret_cast<const uint8_t*>(bitstream.data()),
+                                          bitstream.size())
+                          .value_or(0);
     }
     // TODO: 计算编码完成距离上一次vblank时间
-    send_message_(ltproto::id(encoded_frame), encoded_frame);
+    rate_controller_->onFrameSent(
+        encoded_frame->picture_id(), static_cast<uint32_t>(encoded_frame->frame().size()),
+        temporal_id,
+        encoded_frame->end_encode_timestamp_us() - encoded_frame->start_encode_timestamp_us(),
+        ltlib::steady_now_us());
+    return encoded_frame;
+}
+
+void VCEPipeline::sendVideoFrame(
+    const std::shared_ptr<ltproto::client2worker::VideoFrame>& frame) {
+    send_message_(ltproto::id(frame), frame);
+}
+
+void VCEPipeline::reportStageStats() {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (now_us - last_stage_stats_us_ < kStageStatsIntervalUs) {
+        return;
+    }
+    last_stage_stats_us_ = now_us;
+    auto stats = stages_->takeStats();
+    LOGF(INFO,
+         "Video stages(%u) capture %.2f/%.2fms, encode %.2f/%.2fms, send %.2f/%.2fms, "
+         "latency %.2f/%.2fms, sent %llu, replaced %llu, send queue full %llu",
+         stages_->stages(), stats.capture.avgMs(), stats.capture.max_us / 1000.0,
+         stats.encode.avgMs(), stats.encode.max_us / 1000.0, stats.send.avgMs(),
+         stats.send.max_us / 1000.0, stats.latency.avgMs(), stats.latency.max_us / 1000.0,
+         static_cast<unsigned long long>(stats.send.frames),
+         static_cast<unsigned long long>(stats.replaced),
+         static_cast<unsigned long long>(stats.send_queue_full));
+    if (stats.resolution_changes != 0) {
+        LOG(INFO) << "Video stages changed resolution " << stats.resolution_changes
+                  << " times without restart";
+    }
+    if (ltr_ != nullptr) {
+        auto ltr_stats = ltr_->takeStats();
+        LOGF(INFO, "LTR marked %llu, acked %llu, lost %llu, recovered %llu, idr fallback %llu",
+             static_cast<unsigned long long>(ltr_stats.marked),
+             static_cast<unsigned long long>(ltr_stats.acked),
+             static_cast<unsigned long long>(ltr_stats.lost),
+             static_cast<unsigned long long>(ltr_stats.recovered),
+             static_cast<unsigned long long>(ltr_stats.idr_fallback));
+    }
+}
+
+void VCEPipeline::recoverFromLtr(int64_t ltr_picture_id) {
+    auto recovery = ltr_ == nullptr ? std::nullopt : ltr_->onRecoveryRequest(ltr_picture_id);
+    if (recovery.has_value()) {
+        LOG(INFO) << "Recover from LTR " << ltr_picture_id;
+        encoder_->requestLtrRecovery(recovery->ltr.idr_pic_id, recovery->ltr.frame_num,
+                                     recovery->current_frame_num);
+    }
+    else {
+        LOG(INFO) << "Can't recover from LTR " << ltr_picture_id << ", request keyframe";
+        encoder_->requestKeyframe();
+    }
+    // 画面静止时也要编出这一帧
+    keyframe_requested_ = true;
+}
+
+void VCEPipeline::adjustBitrate() {
+    if (manual_bitrate_) {
+        return;
+    }
+    auto target = rate_controller_->poll(ltlib::steady_now_us());
+    if (!target.has_value()) {
+        return;
+    }
+    LOG(DEBUG) << "Adjust bitrate " << target->bitrate_bps << " fps " << target->fps
+               << ", queue delay " << rate_controller_->queueDelayUs() << "us";
+    Encoder::ReconfigureParams params{};
+    params.bitrate_bps = target->bitrate_bps;
+    if (target->fps != target_fps_) {
+        params.fps = target->fps;
+        target_fps_ = target->fps;
+    }
+    encoder_bitrate_bps_ = target->bitrate_bps;
+    encoder_->reconfigure(params);
 }
 
 std::optional<ltlib::DisplayOutputDesc> VCEPipeline::resolutionChanged() {
@@ -461,6 +662,66 @@ std::optional<ltlib::DisplayOutputDesc> VCEPipeline::resolutionChanged() {
     return std::nullopt;
 }
 
+// 在编码所在的线程里调用, 要编的帧和编码器的分辨率不一样
+bool VCEPipeline::changeEncoderResolution(uint32_t width, uint32_t height) {
+    if (stoped_) {
+        return false;
+    }
+    if (width == encoder_->width() && height == encoder_->height()) {
+        return true;
+    }
+    LOGF(INFO, "Change encoder resolution from %ux%u to %ux%u", encoder_->width(),
+         encoder_->height(), width, height);
+    if (!encoder_->changeResolution(width, height)) {
+        // 编码单独一个线程时抓屏线程也在用encoder_, 不能在这里换掉
+        auto encoder = stages_->stages() < 3 ? recreateEncoder(width, height) : nullptr;
+        if (encoder == nullptr) {
+            // 退回到原来的做法, 让客户端重建流水线, worker重启
+            LOG(ERR) << "Recreate encoder failed, restart streaming";
+            sendChangeStreamingParams(ltlib::getDisplayOutputDesc(monitor_.name));
+            stoped_ = true;
+            return false;
+        }
+        encoder->continueFrom(*encoder_);
+        encoder_ = std::move(encoder);
+        ltr_ = encoder_->ltrEnabled() ? std::make_unique<LtrController>(LtrController::Params{})
+                                      : nullptr;
+    }
+    // 旧分辨率下标记的LTR在新的IDR之后由LtrController自己作废
+    encoder_->requestKeyframe();
+    keyframe_requested_ = true;
+    return true;
+}
+
+std::unique_ptr<Encoder> VCEPipeline::recreateEncoder(uint32_t width, uint32_t height) {
+    Encoder::InitParams params{};
+    params.luid = capturer_->luid();
+    params.device = capturer_->device();
+    params.context = capturer_->deviceContext();
+    params.vendor_id = capturer_->vendorID();
+    params.width = width;
+    params.height = height;
+    params.bitrate_bps = encoder_bitrate_bps_;
+    params.freq = max_fps_;
+    params.soft_threads = soft_encoder_threads_;
+    params.ltr = enable_ltr_;
+    params.temporal_layers = temporal_layers_;
+    std::unique_ptr<Encoder> encoder;
+    if (encoder_->codecType() == VideoCodecType::H264_420_SOFT) {
+        params.codec_type = VideoCodecType::H264_420;
+        encoder = Encoder::createSoft(params);
+    }
+    else {
+        params.codec_type = encoder_->codecType();
+        encoder = Encoder::createHard(params);
+    }
+    if (encoder != nullptr && encoder->captureFormat() != encoder_->captureFormat()) {
+        LOG(ERR) << "Recreated encoder uses a different capture format";
+        return nullptr;
+    }
+    return encoder;
+}
+
 // 当前只关注分辨率
 void VCEPipeline::sendChangeStreamingParams(ltlib::DisplayOutputDesc desc) {
     auto msg = std::make_shared<ltproto::client2worker::ChangeStreamingParams>();
@@ -475,7 +736,7 @@ void VCEPipeline::sendChangeStreamingParams(ltlib::DisplayOutputDesc desc) {
 bool VCEPipeline::shouldEncodeFrame() {
     addHistory(capture_history_);
     const size_t capture_fps = capture_history_.size();
-    const uint32_t target_fps = half_fps_ ? (target_fps_ / 2) : target_fps_;
+    const uint32_t target_fps = half_fps_ ? (target_fps_.load() / 2) : target_fps_.load();
     const uint32_t interval_us = 1'000'000 / target_fps;
     const int64_t now_us = ltlib::steady_now_us();
     if (capture_fps > target_fps + 2) {
@@ -488,6 +749,22 @@ bool VCEPipeline::shouldEncodeFrame() {
     return true;
 }
 
+// 只有能给出变化区域的抓屏方式才会跳过, 对方请求关键帧时马上编
+bool VCEPipeline::isStaticFrame(const Capturer::Frame& frame) {
+    const bool changed = !frame.damage.has_value() || !frame.damage->empty();
+    const int64_t now_us = ltlib::steady_now_us();
+    if (changed || keyframe_requested_ ||
+        now_us - last_encode_time_us_ >= kStaticRefreshIntervalUs) {
+        if (static_frames_ != 0) {
+            LOG(DEBUG) << "Skipped " << static_frames_ << " static frames";
+            static_frames_ = 0;
+        }
+        return false;
+    }
+    static_frames_ += 1;
+    return true;
+}
+
 std::shared_ptr<google::protobuf::MessageLite> VCEPipeline::getDxgiCursorInfo() {
     auto info = capturer_->cursorInfo();
     if (!info.has_value()) {
@@ -693,6 +970,9 @@ void VCEPipeline::onReconfigure(std::shared_ptr<google::protobuf::MessageLite> _
             params.bitrate_bps = msg->bitrate_bps();
             if (!manual_bitrate_) {
                 params.bitrate_bps = std::min(params.bitrate_bps.value(), max_bps_);
+                // 传输层的带宽估计或者探测结果, 自适应码率从这里接着调
+                rate_controller_->resetBitrate(params.bitrate_bps.value(),
+                                               ltlib::steady_now_us());
             }
             changed = true;
         }
@@ -701,6 +981,9 @@ void VCEPipeline::onReconfigure(std::shared_ptr<google::protobuf::MessageLite> _
             changed = true;
         }
         if (changed) {
+            if (params.bitrate_bps.has_value()) {
+                encoder_bitrate_bps_ = params.bitrate_bps.value();
+            }
             encoder_->reconfigure(params);
         }
     });
@@ -709,7 +992,18 @@ void VCEPipeline::onReconfigure(std::shared_ptr<google::protobuf::MessageLite> _
 void VCEPipeline::onRequestKeyframe(std::shared_ptr<google::protobuf::MessageLite> msg) {
     (void)msg;
     std::lock_guard lock{mutex_};
-    tasks_.push_back([this] { encoder_->requestKeyframe(); });
+    tasks_.push_back([this] {
+        encoder_->requestKeyframe();
+        keyframe_requested_ = true;
+    });
+}
+
+void VCEPipeline::onRequestLtrRecovery(std::shared_ptr<google::protobuf::MessageLite> _msg) {
+    std::lock_guard lock{mutex_};
+    tasks_.push_back([this, _msg] {
+        auto msg = std::static_pointer_cast<ltproto::client2worker::RequestLtrRecovery>(_msg);
+        recoverFromLtr(msg->ltr_picture_id());
+    });
 }
 
 void VCEPipeline::onNetworkEvent(std::shared_ptr<google::protobuf::MessageLite> _msg) {
@@ -736,7 +1030,15 @@ void VCEPipeline::onVideoFrameAck1(std::shared_ptr<google::protobuf::MessageLite
     std::lock_guard lock{mutex_};
     tasks_.push_back([this, _msg] {
         auto msg = std::static_pointer_cast<ltproto::client2worker::VideoFrameAck1>(_msg);
-        // TODO:
+        rate_controller_->onFrameAck(msg->picture_id(), msg->recv_time(), msg->undecoded_num(),
+                                     ltlib::steady_now_us());
+        if (ltr_ == nullptr) {
+            return;
+        }
+        for (auto& feedback : ltr_->onAck(msg->picture_id())) {
+            encoder_->onLtrMarked(feedback.ref.idr_pic_id, feedback.ref.frame_num,
+                                  feedback.success);
+        }
     });
 }
 
@@ -50,10 +50,16 @@ public:
         uint32_t height;
         uint32_t client_refresh_rate;
         uint32_t max_mbps;
+        // 软编的可选特性, 默认都不开, 见Encoder::InitParams
+        uint32_t soft_encoder_threads = 1;
+        bool enable_ltr = false;
+        uint32_t temporal_layers = 1;
         ltlib::Monitor monitor;
         std::function<bool(uint32_t, const MessageHandler&)> register_message_handler;
         std::function<bool(uint32_t, const std::shared_ptr<google::protobuf::MessageLite>&)>
             send_message;
+        // 可选, 显示模式变了而流水线自己接着串流时在抓屏线程里回调新的分辨率
+        std::function<void(uint32_t width, uint32_t height)> on_resolution_changed;
     };
 
 public:
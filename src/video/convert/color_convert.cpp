@@ -0,0 +1,397 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "color_convert.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "color_convert_kernels.h"
+
+#if LT_CONVERT_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif // LT_CONVERT_X86
+
+namespace {
+
+using namespace lt::video;
+using namespace lt::video::detail;
+
+// 每块至少这么多行, 太小的帧切多了反而更慢
+constexpr int kMinBandRows = 32;
+
+#if LT_CONVERT_X86
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; i++) {
+        regs[i] = static_cast<uint32_t>(info[i]);
+    }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// 操作系统是否保存了对应的寄存器状态
+uint64_t xcr0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax = 0;
+    uint32_t edx = 0;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif // LT_CONVERT_X86
+
+std::vector<SimdLevel> detectSimdLevels() {
+    std::vector<SimdLevel> levels{SimdLevel::Scalar};
+#if LT_CONVERT_X86
+    uint32_t regs[4] = {0};
+    cpuid(0, 0, regs);
+    const uint32_t max_leaf = regs[0];
+    cpuid(1, 0, regs);
+    const bool sse41 = (regs[2] & (1u << 19)) != 0;
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    const bool avx = (regs[2] & (1u << 28)) != 0;
+    const uint64_t xcr = osxsave ? xcr0() : 0;
+    // XMM|YMM, 再加上opmask|ZMM_Hi256|Hi16_ZMM
+    const bool ymm_enabled = (xcr & 0x06) == 0x06;
+    const bool zmm_enabled = (xcr & 0xE6) == 0xE6;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (max_leaf >= 7) {
+        cpuid(7, 0, regs);
+        avx2 = (regs[1] & (1u << 5)) != 0;
+        // AVX-512F和AVX-512BW
+        avx512 = (regs[1] & (1u << 16)) != 0 && (regs[1] & (1u << 30)) != 0;
+    }
+    if (sse41 && sse41Kernels() != nullptr) {
+        levels.push_back(SimdLevel::SSE41);
+    }
+    if (avx && avx2 && ymm_enabled && avx2Kernels() != nullptr) {
+        levels.push_back(SimdLevel::AVX2);
+    }
+    if (avx512 && zmm_enabled && avx512Kernels() != nullptr) {
+        levels.push_back(SimdLevel::AVX512);
+    }
+#endif // LT_CONVERT_X86
+    if (neonKernels() != nullptr) {
+        levels.push_back(SimdLevel::NEON);
+    }
+    return levels;
+}
+
+const ConvertKernels* kernelsFor(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return scalarKernels();
+    case SimdLevel::SSE41:
+        return sse41Kernels();
+    case SimdLevel::AVX2:
+        return avx2Kernels();
+    case SimdLevel::AVX512:
+        return avx512Kernels();
+    case SimdLevel::NEON:
+        return neonKernels();
+    default:
+        return nullptr;
+    }
+}
+
+bool validPlane(const void* data, int stride, int min_stride) {
+    return data != nullptr && stride >= min_stride;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+const char* simdLevelToString(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return "Scalar";
+    case SimdLevel::SSE41:
+        return "SSE4.1";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    case SimdLevel::NEON:
+        return "NEON";
+    default:
+        return "Unknown";
+    }
+}
+
+const std::vector<SimdLevel>& supportedSimdLevels() {
+    static const std::vector<SimdLevel> levels = detectSimdLevels();
+    return levels;
+}
+
+// 常驻的工作线程, 每次run()所有线程各执行一次task, 调用线程自己执行第0份
+class ColorConverter::Workers {
+public:
+    using Task = std::function<void(uint32_t /*index*/)>;
+
+public:
+    explicit Workers(uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            threads_.emplace_back([this, i]() { loop(i + 1); });
+        }
+    }
+
+    ~Workers() {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stoped_ = true;
+        }
+        cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    uint32_t size() const { return static_cast<uint32_t>(threads_.size()) + 1; }
+
+    void run(const Task& task) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            task_ = &task;
+            pending_ = threads_.size();
+            generation_ += 1;
+        }
+        cv_.notify_all();
+        task(0);
+        std::unique_lock<std::mutex> lock{mutex_};
+        done_cv_.wait(lock, [this]() { return pending_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    void loop(uint32_t index) {
+        uint64_t generation = 0;
+        while (true) {
+            const Task* task = nullptr;
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                cv_.wait(lock, [this, generation]() {
+                    return stoped_ || generation_ != generation;
+                });
+                if (stoped_) {
+                    return;
+                }
+                generation = generation_;
+                task = task_;
+            }
+            (*task)(index);
+            std::lock_guard<std::mutex> lock{mutex_};
+            pending_ -= 1;
+            if (pending_ == 0) {
+                done_cv_.notify_one();
+            }
+        }
+    }
+
+private:
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    const Task* task_ = nullptr;
+    size_t pending_ = 0;
+    uint64_t generation_ = 0;
+    bool stoped_ = false;
+};
+
+std::unique_ptr<ColorConverter> ColorConverter::create(const Params& params) {
+    const auto& supported = supportedSimdLevels();
+    SimdLevel level = supported.back();
+    if (params.simd.has_value()) {
+        if (std::find(supported.begin(), supported.end(), params.simd.value()) ==
+            supported.end()) {
+            return nullptr;
+        }
+        level = params.simd.value();
+    }
+    std::unique_ptr<ColorConverter> converter{new ColorConverter};
+    converter->level_ = level;
+    converter->kernels_ = kernelsFor(level);
+    if (params.threads > 1) {
+        converter->workers_ = std::make_unique<Workers>(params.threads - 1);
+    }
+    return converter;
+}
+
+ColorConverter::~ColorConverter() = default;
+
+uint32_t ColorConverter::threads() const {
+    return workers_ == nullptr ? 1 : workers_->size();
+}
+
+void ColorConverter::parallelFor(int rows, int align, const std::function<void(int, int)>& task) {
+    const int bands = workers_ == nullptr ? 1 : static_cast<int>(workers_->size());
+    int band_rows = std::max((rows + bands - 1) / bands, kMinBandRows);
+    band_rows = (band_rows + align - 1) / align * align;
+    if (band_rows >= rows) {
+        task(0, rows);
+        return;
+    }
+    workers_->run([&](uint32_t index) {
+        const int begin = static_cast<int>(index) * band_rows;
+        const int end = std::min(begin + band_rows, rows);
+        if (begin < end) {
+            task(begin, end);
+        }
+    });
+}
+
+bool ColorConverter::bgraToI420(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride,
+                                uint8_t* u, int u_stride, uint8_t* v, int v_stride, int width,
+                                int height) {
+    const int chroma_width = (width + 1) / 2;
+    if (width <= 0 || height <= 0 || !validPlane(bgra, bgra_stride, width * 4) ||
+        !validPlane(y, y_stride, width) || !validPlane(u, u_stride, chroma_width) ||
+        !validPlane(v, v_stride, chroma_width)) {
+        return false;
+    }
+    parallelFor(height, 2, [&](int begin, int end) {
+        for (int row = begin; row < end; row += 2) {
+            const uint8_t* src0 = bgra + static_cast<ptrdiff_t>(row) * bgra_stride;
+            const uint8_t* src1 = row + 1 < height ? src0 + bgra_stride : src0;
+            kernels_->bgra_to_y(src0, y + static_cast<ptrdiff_t>(row) * y_stride, width);
+            if (row + 1 < height) {
+                kernels_->bgra_to_y(src1, y + static_cast<ptrdiff_t>(row + 1) * y_stride, width);
+            }
+            kernels_->bgra_to_uv(src0, src1, u + static_cast<ptrdiff_t>(row / 2) * u_stride,
+                                 v + static_cast<ptrdiff_t>(row / 2) * v_stride, width);
+        }
+    });
+    return true;
+}
+
+bool ColorConverter::bgraToNV12(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride,
+                                uint8_t* uv, int uv_stride, int width, int height) {
+    if (width <= 0 || height <= 0 || !validPlane(bgra, bgra_stride, width * 4) ||
+        !validPlane(y, y_stride, width) || !validPlane(uv, uv_stride, (width + 1) / 2 * 2)) {
+        return false;
+    }
+    parallelFor(height, 2, [&](int begin, int end) {
+        for (int row = begin; row < end; row += 2) {
+            const uint8_t* src0 = bgra + static_cast<ptrdiff_t>(row) * bgra_stride;
+            const uint8_t* src1 = row + 1 < height ? src0 + bgra_stride : src0;
+            kernels_->bgra_to_y(src0, y + static_cast<ptrdiff_t>(row) * y_stride, width);
+            if (row + 1 < height) {
+                kernels_->bgra_to_y(src1, y + static_cast<ptrdiff_t>(row + 1) * y_stride, width);
+            }
+            kernels_->bgra_to_uv_interleaved(
+                src0, src1, uv + static_cast<ptrdiff_t>(row / 2) * uv_stride, width);
+        }
+    });
+    return true;
+}
+
+bool ColorConverter::bgraToI444(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride,
+                                uint8_t* u, int u_stride, uint8_t* v, int v_stride, int width,
+                                int height) {
+    if (width <= 0 || height <= 0 || !validPlane(bgra, bgra_stride, width * 4) ||
+        !validPlane(y, y_stride, width) || !validPlane(u, u_stride, width) ||
+        !validPlane(v, v_stride, width)) {
+        return false;
+    }
+    parallelFor(height, 1, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            const uint8_t* src = bgra + static_cast<ptrdiff_t>(row) * bgra_stride;
+            kernels_->bgra_to_y(src, y + static_cast<ptrdiff_t>(row) * y_stride, width);
+            kernels_->bgra_to_uv_full(src, u + static_cast<ptrdiff_t>(row) * u_stride,
+                                      v + static_cast<ptrdiff_t>(row) * v_stride, width);
+        }
+    });
+    return true;
+}
+
+bool ColorConverter::i420ToNV12(const uint8_t* src_y, int src_y_stride, const uint8_t* src_u,
+                                int src_u_stride, const uint8_t* src_v, int src_v_stride,
+                                uint8_t* y, int y_stride, uint8_t* uv, int uv_stride, int width,
+                                int height) {
+    const int chroma_width = (width + 1) / 2;
+    if (width <= 0 || height <= 0 || !validPlane(src_y, src_y_stride, width) ||
+        !validPlane(src_u, src_u_stride, chroma_width) ||
+        !validPlane(src_v, src_v_stride, chroma_width) || !validPlane(y, y_stride, width) ||
+        !validPlane(uv, uv_stride, chroma_width * 2)) {
+        return false;
+    }
+    parallelFor(height, 2, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            memcpy(y + static_cast<ptrdiff_t>(row) * y_stride,
+                   src_y + static_cast<ptrdiff_t>(row) * src_y_stride, width);
+            if (row % 2 == 0) {
+                const ptrdiff_t chroma_row = row / 2;
+                kernels_->merge_uv(src_u + chroma_row * src_u_stride,
+                                   src_v + chroma_row * src_v_stride, uv + chroma_row * uv_stride,
+                                   chroma_width);
+            }
+        }
+    });
+    return true;
+}
+
+bool ColorConverter::nv12ToBgra(const uint8_t* y, int y_stride, const uint8_t* uv, int uv_stride,
+                                uint8_t* bgra, int bgra_stride, int width, int height) {
+    if (width <= 0 || height <= 0 || !validPlane(y, y_stride, width) ||
+        !validPlane(uv, uv_stride, (width + 1) / 2 * 2) ||
+        !validPlane(bgra, bgra_stride, width * 4)) {
+        return false;
+    }
+    parallelFor(height, 2, [&](int begin, int end) {
+        for (int row = begin; row < end; row++) {
+            kernels_->nv12_to_bgra(y + static_cast<ptrdiff_t>(row) * y_stride,
+                                   uv + static_cast<ptrdiff_t>(row / 2) * uv_stride,
+                                   bgra + static_cast<ptrdiff_t>(row) * bgra_stride, width);
+        }
+    });
+    return true;
+}
+
+} // namespace video
+
+} // namespace lt
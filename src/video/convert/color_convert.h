@@ -0,0 +1,105 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+struct ConvertKernels;
+} // namespace detail
+
+enum class SimdLevel : uint8_t {
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512,
+    NEON,
+};
+
+const char* simdLevelToString(SimdLevel level);
+
+// 编进来了并且当前CPU支持的指令集, 从低到高, 第一个总是Scalar
+const std::vector<SimdLevel>& supportedSimdLevels();
+
+// 软件路径上的颜色空间转换, BT.601 limited range. 按运行时检测到的指令集选择实现,
+// 可以把一帧按行切块, 分给内部的线程并行转换.
+// 目标内存都由调用者提供, 可以直接转进池化的缓冲区, 不做额外的拷贝.
+// 宽高为奇数时, 色度平面的宽高向上取整.
+// 转换函数不能在多个线程里同时调用, 参数不合法时返回false
+class ColorConverter {
+public:
+    struct Params {
+        // 含调用线程在内的并行线程数, 小于等于1时只在调用线程里转换
+        uint32_t threads = 1;
+        // 指定指令集, 主要给测试和benchmark用. 不指定时用支持的最高级
+        std::optional<SimdLevel> simd;
+    };
+
+public:
+    static std::unique_ptr<ColorConverter> create(const Params& params);
+    ~ColorConverter();
+    SimdLevel simdLevel() const { return level_; }
+    uint32_t threads() const;
+
+    bool bgraToI420(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* u,
+                    int u_stride, uint8_t* v, int v_stride, int width, int height);
+    bool bgraToNV12(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* uv,
+                    int uv_stride, int width, int height);
+    bool bgraToI444(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* u,
+                    int u_stride, uint8_t* v, int v_stride, int width, int height);
+    bool i420ToNV12(const uint8_t* src_y, int src_y_stride, const uint8_t* src_u,
+                    int src_u_stride, const uint8_t* src_v, int src_v_stride, uint8_t* y,
+                    int y_stride, uint8_t* uv, int uv_stride, int width, int height);
+    bool nv12ToBgra(const uint8_t* y, int y_stride, const uint8_t* uv, int uv_stride,
+                    uint8_t* bgra, int bgra_stride, int width, int height);
+
+private:
+    class Workers;
+    ColorConverter() = default;
+    // 把[0, rows)按align的整数倍切块, task(begin, end)在各个线程里并行执行, 全部完成后返回
+    void parallelFor(int rows, int align, const std::function<void(int, int)>& task);
+
+private:
+    SimdLevel level_ = SimdLevel::Scalar;
+    const detail::ConvertKernels* kernels_ = nullptr;
+    std::unique_ptr<Workers> workers_;
+};
+
+} // namespace video
+
+} // namespace lt
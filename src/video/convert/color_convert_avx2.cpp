@@ -0,0 +1,264 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "color_convert_kernels.h"
+
+#if LT_CONVERT_X86
+#include <immintrin.h>
+
+// 和SSE4.1版本相同的算法, 一次处理两倍的像素. AVX2的pack只在128位的lane内进行,
+// 打包之后要用permute4x64把顺序换回来
+
+namespace {
+
+using namespace lt::video::detail;
+
+// 16个BGRA像素拆成B/G/R, 每个分量16位
+inline void loadBgr16(const uint8_t* src, __m256i& b, __m256i& g, __m256i& r) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    const __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+    b = _mm256_packus_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask));
+    g = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+                            _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask));
+    r = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+                            _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask));
+    b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0));
+    g = _mm256_permute4x64_epi64(g, _MM_SHUFFLE(3, 1, 2, 0));
+    r = _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// 两个16位向量打包成32个字节
+inline __m256i packU8(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// 两个32位向量打包成16个16位
+inline __m256i packU16(__m256i lo, __m256i hi) {
+    return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+inline __m256i pairSum(__m256i x) {
+    return _mm256_add_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0xFFFF)),
+                            _mm256_srli_epi32(x, 16));
+}
+
+// 两行各32个像素, 按2x2取平均得到16个B/G/R
+inline void loadBgrAvg32(const uint8_t* row0, const uint8_t* row1, __m256i& b, __m256i& g,
+                         __m256i& r) {
+    __m256i b0, g0, r0, b1, g1, r1;
+    loadBgr16(row0, b0, g0, r0);
+    loadBgr16(row1, b1, g1, r1);
+    const __m256i b_lo = pairSum(_mm256_add_epi16(b0, b1));
+    const __m256i g_lo = pairSum(_mm256_add_epi16(g0, g1));
+    const __m256i r_lo = pairSum(_mm256_add_epi16(r0, r1));
+    loadBgr16(row0 + 64, b0, g0, r0);
+    loadBgr16(row1 + 64, b1, g1, r1);
+    const __m256i b_hi = pairSum(_mm256_add_epi16(b0, b1));
+    const __m256i g_hi = pairSum(_mm256_add_epi16(g0, g1));
+    const __m256i r_hi = pairSum(_mm256_add_epi16(r0, r1));
+    const __m256i two = _mm256_set1_epi16(2);
+    b = _mm256_srli_epi16(_mm256_add_epi16(packU16(b_lo, b_hi), two), 2);
+    g = _mm256_srli_epi16(_mm256_add_epi16(packU16(g_lo, g_hi), two), 2);
+    r = _mm256_srli_epi16(_mm256_add_epi16(packU16(r_lo, r_hi), two), 2);
+}
+
+inline __m256i toY(__m256i b, __m256i g, __m256i r) {
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+    y = _mm256_srli_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(128)), 8);
+    return _mm256_add_epi16(y, _mm256_set1_epi16(16));
+}
+
+inline __m256i toU(__m256i b, __m256i g, __m256i r) {
+    __m256i u = _mm256_sub_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(112)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(74)));
+    u = _mm256_sub_epi16(u, _mm256_mullo_epi16(r, _mm256_set1_epi16(38)));
+    u = _mm256_srai_epi16(_mm256_add_epi16(u, _mm256_set1_epi16(128)), 8);
+    return _mm256_add_epi16(u, _mm256_set1_epi16(128));
+}
+
+inline __m256i toV(__m256i b, __m256i g, __m256i r) {
+    __m256i v = _mm256_sub_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(112)),
+                                 _mm256_mullo_epi16(g, _mm256_set1_epi16(94)));
+    v = _mm256_sub_epi16(v, _mm256_mullo_epi16(b, _mm256_set1_epi16(18)));
+    v = _mm256_srai_epi16(_mm256_add_epi16(v, _mm256_set1_epi16(128)), 8);
+    return _mm256_add_epi16(v, _mm256_set1_epi16(128));
+}
+
+inline __m256i clamp255(__m256i x) {
+    return _mm256_min_epi32(_mm256_max_epi32(x, _mm256_setzero_si256()),
+                            _mm256_set1_epi32(255));
+}
+
+void bgraToYRow(const uint8_t* bgra, uint8_t* y, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i b, g, r;
+        loadBgr16(bgra + x * 4, b, g, r);
+        const __m256i y0 = toY(b, g, r);
+        loadBgr16(bgra + x * 4 + 64, b, g, r);
+        const __m256i y1 = toY(b, g, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x), packU8(y0, y1));
+    }
+    bgraToYRowC(bgra + x * 4, y + x, width - x);
+}
+
+void bgraToUVRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i b, g, r;
+        loadBgrAvg32(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        const __m256i u16 = packU8(toU(b, g, r), _mm256_setzero_si256());
+        const __m256i v16 = packU8(toV(b, g, r), _mm256_setzero_si256());
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2), _mm256_castsi256_si128(u16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2), _mm256_castsi256_si128(v16));
+    }
+    bgraToUVRowC(bgra0 + x * 4, bgra1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+void bgraToUVInterleavedRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv,
+                            int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i b, g, r;
+        loadBgrAvg32(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        const __m256i uv32 =
+            _mm256_or_si256(toU(b, g, r), _mm256_slli_epi16(toV(b, g, r), 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + x), uv32);
+    }
+    bgraToUVInterleavedRowC(bgra0 + x * 4, bgra1 + x * 4, uv + x, width - x);
+}
+
+void bgraToUVFullRow(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i b, g, r;
+        loadBgr16(bgra + x * 4, b, g, r);
+        const __m256i u0 = toU(b, g, r);
+        const __m256i v0 = toV(b, g, r);
+        loadBgr16(bgra + x * 4 + 64, b, g, r);
+        const __m256i u1 = toU(b, g, r);
+        const __m256i v1 = toV(b, g, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x), packU8(u0, u1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x), packU8(v0, v1));
+    }
+    bgraToUVFullRowC(bgra + x * 4, u + x, v + x, width - x);
+}
+
+void mergeUVRow(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i u16 = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x)));
+        const __m256i v16 = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + x * 2),
+                            _mm256_or_si256(u16, _mm256_slli_epi16(v16, 8)));
+    }
+    mergeUVRowC(u + x, v + x, uv + x * 2, width - x);
+}
+
+void nv12ToBgraRow(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        // 每个128位的lane里是u0 v0 u1 v1, 刚好对应这个lane的4个像素
+        const __m256i uv32 =
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(uv + x)));
+        const __m256i d = _mm256_sub_epi32(
+            _mm256_shuffle_epi32(uv32, _MM_SHUFFLE(2, 2, 0, 0)), _mm256_set1_epi32(128));
+        const __m256i e = _mm256_sub_epi32(
+            _mm256_shuffle_epi32(uv32, _MM_SHUFFLE(3, 3, 1, 1)), _mm256_set1_epi32(128));
+        __m256i c = _mm256_sub_epi32(
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x))),
+            _mm256_set1_epi32(16));
+        c = _mm256_add_epi32(_mm256_mullo_epi32(c, _mm256_set1_epi32(298)),
+                             _mm256_set1_epi32(128));
+        __m256i b = _mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516)));
+        __m256i g = _mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(100)));
+        g = _mm256_sub_epi32(g, _mm256_mullo_epi32(e, _mm256_set1_epi32(208)));
+        __m256i r = _mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409)));
+        b = clamp255(_mm256_srai_epi32(b, 8));
+        g = clamp255(_mm256_srai_epi32(g, 8));
+        r = clamp255(_mm256_srai_epi32(r, 8));
+        __m256i out = _mm256_or_si256(b, _mm256_slli_epi32(g, 8));
+        out = _mm256_or_si256(out, _mm256_slli_epi32(r, 16));
+        out = _mm256_or_si256(out, _mm256_set1_epi32(static_cast<int32_t>(0xFF000000)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + x * 4), out);
+    }
+    nv12ToBgraRowC(y + x, uv + x / 2 * 2, bgra + x * 4, width - x);
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* avx2Kernels() {
+    static const ConvertKernels kernels{
+        bgraToYRow,
+        bgraToUVRow,
+        bgraToUVInterleavedRow,
+        bgraToUVFullRow,
+        mergeUVRow,
+        nv12ToBgraRow,
+    };
+    return &kernels;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#else // LT_CONVERT_X86
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* avx2Kernels() {
+    return nullptr;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#endif // LT_CONVERT_X86
@@ -0,0 +1,257 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "color_convert_kernels.h"
+
+#if LT_CONVERT_X86
+// GCC 12的AVX-512头文件里用_mm512_undefined_*()做掩码的源操作数, 会误报这两个警告
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+
+// 需要AVX-512F和AVX-512BW. 和SSE4.1版本相同的算法, 窄化用vpmovdw/vpmovwb, 不会打乱顺序
+
+namespace {
+
+using namespace lt::video::detail;
+
+inline __m256i narrow8(__m512i p, int shift) {
+    return _mm512_cvtepi32_epi16(
+        _mm512_and_si512(_mm512_srli_epi32(p, shift), _mm512_set1_epi32(0xFF)));
+}
+
+inline __m512i concat(__m256i lo, __m256i hi) {
+    return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+}
+
+// 32个BGRA像素拆成B/G/R, 每个分量16位
+inline void loadBgr32(const uint8_t* src, __m512i& b, __m512i& g, __m512i& r) {
+    const __m512i p0 = _mm512_loadu_si512(src);
+    const __m512i p1 = _mm512_loadu_si512(src + 64);
+    b = concat(narrow8(p0, 0), narrow8(p1, 0));
+    g = concat(narrow8(p0, 8), narrow8(p1, 8));
+    r = concat(narrow8(p0, 16), narrow8(p1, 16));
+}
+
+// 相邻两个像素的分量相加, 结果窄化成16位
+inline __m256i pairSum(__m512i x) {
+    return _mm512_cvtepi32_epi16(_mm512_add_epi32(
+        _mm512_and_si512(x, _mm512_set1_epi32(0xFFFF)), _mm512_srli_epi32(x, 16)));
+}
+
+// 两行各64个像素, 按2x2取平均得到32个B/G/R
+inline void loadBgrAvg64(const uint8_t* row0, const uint8_t* row1, __m512i& b, __m512i& g,
+                         __m512i& r) {
+    __m512i b0, g0, r0, b1, g1, r1;
+    loadBgr32(row0, b0, g0, r0);
+    loadBgr32(row1, b1, g1, r1);
+    const __m256i b_lo = pairSum(_mm512_add_epi16(b0, b1));
+    const __m256i g_lo = pairSum(_mm512_add_epi16(g0, g1));
+    const __m256i r_lo = pairSum(_mm512_add_epi16(r0, r1));
+    loadBgr32(row0 + 128, b0, g0, r0);
+    loadBgr32(row1 + 128, b1, g1, r1);
+    const __m256i b_hi = pairSum(_mm512_add_epi16(b0, b1));
+    const __m256i g_hi = pairSum(_mm512_add_epi16(g0, g1));
+    const __m256i r_hi = pairSum(_mm512_add_epi16(r0, r1));
+    const __m512i two = _mm512_set1_epi16(2);
+    b = _mm512_srli_epi16(_mm512_add_epi16(concat(b_lo, b_hi), two), 2);
+    g = _mm512_srli_epi16(_mm512_add_epi16(concat(g_lo, g_hi), two), 2);
+    r = _mm512_srli_epi16(_mm512_add_epi16(concat(r_lo, r_hi), two), 2);
+}
+
+inline __m512i toY(__m512i b, __m512i g, __m512i r) {
+    __m512i y = _mm512_add_epi16(_mm512_mullo_epi16(r, _mm512_set1_epi16(66)),
+                                 _mm512_mullo_epi16(g, _mm512_set1_epi16(129)));
+    y = _mm512_add_epi16(y, _mm512_mullo_epi16(b, _mm512_set1_epi16(25)));
+    y = _mm512_srli_epi16(_mm512_add_epi16(y, _mm512_set1_epi16(128)), 8);
+    return _mm512_add_epi16(y, _mm512_set1_epi16(16));
+}
+
+inline __m512i toU(__m512i b, __m512i g, __m512i r) {
+    __m512i u = _mm512_sub_epi16(_mm512_mullo_epi16(b, _mm512_set1_epi16(112)),
+                                 _mm512_mullo_epi16(g, _mm512_set1_epi16(74)));
+    u = _mm512_sub_epi16(u, _mm512_mullo_epi16(r, _mm512_set1_epi16(38)));
+    u = _mm512_srai_epi16(_mm512_add_epi16(u, _mm512_set1_epi16(128)), 8);
+    return _mm512_add_epi16(u, _mm512_set1_epi16(128));
+}
+
+inline __m512i toV(__m512i b, __m512i g, __m512i r) {
+    __m512i v = _mm512_sub_epi16(_mm512_mullo_epi16(r, _mm512_set1_epi16(112)),
+                                 _mm512_mullo_epi16(g, _mm512_set1_epi16(94)));
+    v = _mm512_sub_epi16(v, _mm512_mullo_epi16(b, _mm512_set1_epi16(18)));
+    v = _mm512_srai_epi16(_mm512_add_epi16(v, _mm512_set1_epi16(128)), 8);
+    return _mm512_add_epi16(v, _mm512_set1_epi16(128));
+}
+
+inline __m512i clamp255(__m512i x) {
+    return _mm512_min_epi32(_mm512_max_epi32(x, _mm512_setzero_si512()),
+                            _mm512_set1_epi32(255));
+}
+
+void bgraToYRow(const uint8_t* bgra, uint8_t* y, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m512i b, g, r;
+        loadBgr32(bgra + x * 4, b, g, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x),
+                            _mm512_cvtepi16_epi8(toY(b, g, r)));
+    }
+    bgraToYRowC(bgra + x * 4, y + x, width - x);
+}
+
+void bgraToUVRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 64 <= width; x += 64) {
+        __m512i b, g, r;
+        loadBgrAvg64(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x / 2),
+                            _mm512_cvtepi16_epi8(toU(b, g, r)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x / 2),
+                            _mm512_cvtepi16_epi8(toV(b, g, r)));
+    }
+    bgraToUVRowC(bgra0 + x * 4, bgra1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+void bgraToUVInterleavedRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv,
+                            int width) {
+    int x = 0;
+    for (; x + 64 <= width; x += 64) {
+        __m512i b, g, r;
+        loadBgrAvg64(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        _mm512_storeu_si512(uv + x,
+                            _mm512_or_si512(toU(b, g, r), _mm512_slli_epi16(toV(b, g, r), 8)));
+    }
+    bgraToUVInterleavedRowC(bgra0 + x * 4, bgra1 + x * 4, uv + x, width - x);
+}
+
+void bgraToUVFullRow(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m512i b, g, r;
+        loadBgr32(bgra + x * 4, b, g, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x),
+                            _mm512_cvtepi16_epi8(toU(b, g, r)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x),
+                            _mm512_cvtepi16_epi8(toV(b, g, r)));
+    }
+    bgraToUVFullRowC(bgra + x * 4, u + x, v + x, width - x);
+}
+
+void mergeUVRow(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m512i u32 = _mm512_cvtepu8_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + x)));
+        const __m512i v32 = _mm512_cvtepu8_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + x)));
+        _mm512_storeu_si512(uv + x * 2, _mm512_or_si512(u32, _mm512_slli_epi16(v32, 8)));
+    }
+    mergeUVRowC(u + x, v + x, uv + x * 2, width - x);
+}
+
+void nv12ToBgraRow(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        // 每个128位的lane里是u0 v0 u1 v1, 刚好对应这个lane的4个像素
+        const __m512i uv32 =
+            _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x)));
+        const __m512i d = _mm512_sub_epi32(
+            _mm512_shuffle_epi32(uv32, static_cast<_MM_PERM_ENUM>(_MM_SHUFFLE(2, 2, 0, 0))),
+            _mm512_set1_epi32(128));
+        const __m512i e = _mm512_sub_epi32(
+            _mm512_shuffle_epi32(uv32, static_cast<_MM_PERM_ENUM>(_MM_SHUFFLE(3, 3, 1, 1))),
+            _mm512_set1_epi32(128));
+        __m512i c = _mm512_sub_epi32(
+            _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x))),
+            _mm512_set1_epi32(16));
+        c = _mm512_add_epi32(_mm512_mullo_epi32(c, _mm512_set1_epi32(298)),
+                             _mm512_set1_epi32(128));
+        __m512i b = _mm512_add_epi32(c, _mm512_mullo_epi32(d, _mm512_set1_epi32(516)));
+        __m512i g = _mm512_sub_epi32(c, _mm512_mullo_epi32(d, _mm512_set1_epi32(100)));
+        g = _mm512_sub_epi32(g, _mm512_mullo_epi32(e, _mm512_set1_epi32(208)));
+        __m512i r = _mm512_add_epi32(c, _mm512_mullo_epi32(e, _mm512_set1_epi32(409)));
+        b = clamp255(_mm512_srai_epi32(b, 8));
+        g = clamp255(_mm512_srai_epi32(g, 8));
+        r = clamp255(_mm512_srai_epi32(r, 8));
+        __m512i out = _mm512_or_si512(b, _mm512_slli_epi32(g, 8));
+        out = _mm512_or_si512(out, _mm512_slli_epi32(r, 16));
+        out = _mm512_or_si512(out, _mm512_set1_epi32(static_cast<int32_t>(0xFF000000)));
+        _mm512_storeu_si512(bgra + x * 4, out);
+    }
+    nv12ToBgraRowC(y + x, uv + x / 2 * 2, bgra + x * 4, width - x);
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* avx512Kernels() {
+    static const ConvertKernels kernels{
+        bgraToYRow,
+        bgraToUVRow,
+        bgraToUVInterleavedRow,
+        bgraToUVFullRow,
+        mergeUVRow,
+        nv12ToBgraRow,
+    };
+    return &kernels;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#else // LT_CONVERT_X86
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* avx512Kernels() {
+    return nullptr;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#endif // LT_CONVERT_X86
@@ -0,0 +1,92 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+// 各指令集的行转换函数, 只给color_convert.cpp用.
+// 每个指令集一个cpp, 用各自的编译选项编译. 为了不让高指令集的代码通过inline函数混进别的编译单元,
+// 这里只放声明, 也不要在这里include标准库的模板.
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define LT_CONVERT_X86 1
+#else
+#define LT_CONVERT_X86 0
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+#define LT_CONVERT_NEON 1
+#else
+#define LT_CONVERT_NEON 0
+#endif
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+// width都是像素数, 输出行的长度由调用者保证. SIMD版本处理完整的块, 剩下的尾巴交给C版本
+struct ConvertKernels {
+    // 一行BGRA转Y
+    void (*bgra_to_y)(const uint8_t* bgra, uint8_t* y, int width);
+    // 两行BGRA按2x2取平均转一行U和V, 宽度为奇数时最后一列和自己取平均
+    void (*bgra_to_uv)(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v,
+                       int width);
+    // 同上, 输出NV12的UV交错
+    void (*bgra_to_uv_interleaved)(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv,
+                                   int width);
+    // 一行BGRA转不降采样的U和V
+    void (*bgra_to_uv_full)(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width);
+    // width个U和width个V交错成2*width个字节
+    void (*merge_uv)(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+    // 一行Y加上对应的一行UV转BGRA, A固定为255
+    void (*nv12_to_bgra)(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width);
+};
+
+void bgraToYRowC(const uint8_t* bgra, uint8_t* y, int width);
+void bgraToUVRowC(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v, int width);
+void bgraToUVInterleavedRowC(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv, int width);
+void bgraToUVFullRowC(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width);
+void mergeUVRowC(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width);
+void nv12ToBgraRowC(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width);
+
+const ConvertKernels* scalarKernels();
+// 没有编进来的指令集返回nullptr, 是否能在当前CPU上跑由调用者判断
+const ConvertKernels* sse41Kernels();
+const ConvertKernels* avx2Kernels();
+const ConvertKernels* avx512Kernels();
+const ConvertKernels* neonKernels();
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
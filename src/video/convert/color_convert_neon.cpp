@@ -0,0 +1,235 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "color_convert_kernels.h"
+
+#if LT_CONVERT_NEON
+#include <arm_neon.h>
+
+// aarch64上NEON总是可用. vld4/vst4直接完成BGRA的拆分和合并, 其余和SSE4.1版本相同
+
+namespace {
+
+using namespace lt::video::detail;
+
+inline uint8x8_t toY(uint8x8_t b, uint8x8_t g, uint8x8_t r) {
+    uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+    y = vmlal_u8(y, g, vdup_n_u8(129));
+    y = vmlal_u8(y, b, vdup_n_u8(25));
+    return vadd_u8(vrshrn_n_u16(y, 8), vdup_n_u8(16));
+}
+
+inline uint8x8_t toU(int16x8_t b, int16x8_t g, int16x8_t r) {
+    int16x8_t u = vmulq_n_s16(b, 112);
+    u = vmlsq_n_s16(u, g, 74);
+    u = vmlsq_n_s16(u, r, 38);
+    u = vshrq_n_s16(vaddq_s16(u, vdupq_n_s16(128)), 8);
+    return vqmovun_s16(vaddq_s16(u, vdupq_n_s16(128)));
+}
+
+inline uint8x8_t toV(int16x8_t b, int16x8_t g, int16x8_t r) {
+    int16x8_t v = vmulq_n_s16(r, 112);
+    v = vmlsq_n_s16(v, g, 94);
+    v = vmlsq_n_s16(v, b, 18);
+    v = vshrq_n_s16(vaddq_s16(v, vdupq_n_s16(128)), 8);
+    return vqmovun_s16(vaddq_s16(v, vdupq_n_s16(128)));
+}
+
+inline int16x8_t widen(uint8x8_t x) {
+    return vreinterpretq_s16_u16(vmovl_u8(x));
+}
+
+// 两行各16个像素, 按2x2取平均得到8个B/G/R
+inline void loadBgrAvg16(const uint8_t* row0, const uint8_t* row1, int16x8_t& b, int16x8_t& g,
+                         int16x8_t& r) {
+    const uint8x16x4_t p0 = vld4q_u8(row0);
+    const uint8x16x4_t p1 = vld4q_u8(row1);
+    b = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]), 2));
+    g = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+    r = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]), 2));
+}
+
+// 4个像素的一个分量, (x+128)>>8后饱和到0~65535
+inline uint16x4_t descale(int32x4_t x) {
+    return vqrshrun_n_s32(x, 8);
+}
+
+// 8个像素的YUV转BGR, u和v已经按像素展开
+inline void toBgr8(uint8x8_t y, uint8x8_t u, uint8x8_t v, uint8x8_t& b, uint8x8_t& g,
+                   uint8x8_t& r) {
+    const int16x8_t c = vsubq_s16(widen(y), vdupq_n_s16(16));
+    const int16x8_t d = vsubq_s16(widen(u), vdupq_n_s16(128));
+    const int16x8_t e = vsubq_s16(widen(v), vdupq_n_s16(128));
+    const int32x4_t c_lo = vmull_n_s16(vget_low_s16(c), 298);
+    const int32x4_t c_hi = vmull_n_s16(vget_high_s16(c), 298);
+    const int32x4_t b_lo = vmlal_n_s16(c_lo, vget_low_s16(d), 516);
+    const int32x4_t b_hi = vmlal_n_s16(c_hi, vget_high_s16(d), 516);
+    const int32x4_t g_lo =
+        vmlsl_n_s16(vmlsl_n_s16(c_lo, vget_low_s16(d), 100), vget_low_s16(e), 208);
+    const int32x4_t g_hi =
+        vmlsl_n_s16(vmlsl_n_s16(c_hi, vget_high_s16(d), 100), vget_high_s16(e), 208);
+    const int32x4_t r_lo = vmlal_n_s16(c_lo, vget_low_s16(e), 409);
+    const int32x4_t r_hi = vmlal_n_s16(c_hi, vget_high_s16(e), 409);
+    b = vqmovn_u16(vcombine_u16(descale(b_lo), descale(b_hi)));
+    g = vqmovn_u16(vcombine_u16(descale(g_lo), descale(g_hi)));
+    r = vqmovn_u16(vcombine_u16(descale(r_lo), descale(r_hi)));
+}
+
+void bgraToYRow(const uint8_t* bgra, uint8_t* y, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x4_t p = vld4q_u8(bgra + x * 4);
+        const uint8x8_t y0 =
+            toY(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2]));
+        const uint8x8_t y1 =
+            toY(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2]));
+        vst1q_u8(y + x, vcombine_u8(y0, y1));
+    }
+    bgraToYRowC(bgra + x * 4, y + x, width - x);
+}
+
+void bgraToUVRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        int16x8_t b, g, r;
+        loadBgrAvg16(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        vst1_u8(u + x / 2, toU(b, g, r));
+        vst1_u8(v + x / 2, toV(b, g, r));
+    }
+    bgraToUVRowC(bgra0 + x * 4, bgra1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+void bgraToUVInterleavedRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv,
+                            int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        int16x8_t b, g, r;
+        loadBgrAvg16(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        uint8x8x2_t uv8;
+        uv8.val[0] = toU(b, g, r);
+        uv8.val[1] = toV(b, g, r);
+        vst2_u8(uv + x, uv8);
+    }
+    bgraToUVInterleavedRowC(bgra0 + x * 4, bgra1 + x * 4, uv + x, width - x);
+}
+
+void bgraToUVFullRow(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16x4_t p = vld4q_u8(bgra + x * 4);
+        const int16x8_t b0 = widen(vget_low_u8(p.val[0]));
+        const int16x8_t g0 = widen(vget_low_u8(p.val[1]));
+        const int16x8_t r0 = widen(vget_low_u8(p.val[2]));
+        const int16x8_t b1 = widen(vget_high_u8(p.val[0]));
+        const int16x8_t g1 = widen(vget_high_u8(p.val[1]));
+        const int16x8_t r1 = widen(vget_high_u8(p.val[2]));
+        vst1q_u8(u + x, vcombine_u8(toU(b0, g0, r0), toU(b1, g1, r1)));
+        vst1q_u8(v + x, vcombine_u8(toV(b0, g0, r0), toV(b1, g1, r1)));
+    }
+    bgraToUVFullRowC(bgra + x * 4, u + x, v + x, width - x);
+}
+
+void mergeUVRow(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t uv16;
+        uv16.val[0] = vld1q_u8(u + x);
+        uv16.val[1] = vld1q_u8(v + x);
+        vst2q_u8(uv + x * 2, uv16);
+    }
+    mergeUVRowC(u + x, v + x, uv + x * 2, width - x);
+}
+
+void nv12ToBgraRow(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16_t y16 = vld1q_u8(y + x);
+        const uint8x8x2_t uv8 = vld2_u8(uv + x);
+        // 每个U/V给相邻两个像素用
+        const uint8x8x2_t u16 = vzip_u8(uv8.val[0], uv8.val[0]);
+        const uint8x8x2_t v16 = vzip_u8(uv8.val[1], uv8.val[1]);
+        uint8x8_t b0, g0, r0, b1, g1, r1;
+        toBgr8(vget_low_u8(y16), u16.val[0], v16.val[0], b0, g0, r0);
+        toBgr8(vget_high_u8(y16), u16.val[1], v16.val[1], b1, g1, r1);
+        uint8x16x4_t out;
+        out.val[0] = vcombine_u8(b0, b1);
+        out.val[1] = vcombine_u8(g0, g1);
+        out.val[2] = vcombine_u8(r0, r1);
+        out.val[3] = vdupq_n_u8(255);
+        vst4q_u8(bgra + x * 4, out);
+    }
+    nv12ToBgraRowC(y + x, uv + x / 2 * 2, bgra + x * 4, width - x);
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* neonKernels() {
+    static const ConvertKernels kernels{
+        bgraToYRow,
+        bgraToUVRow,
+        bgraToUVInterleavedRow,
+        bgraToUVFullRow,
+        mergeUVRow,
+        nv12ToBgraRow,
+    };
+    return &kernels;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#else // LT_CONVERT_NEON
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* neonKernels() {
+    return nullptr;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#endif // LT_CONVERT_NEON
@@ -0,0 +1,143 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "color_convert_kernels.h"
+
+// BT.601 limited range, 定点系数和libyuv的C实现一致. SIMD版本必须和这里逐字节相同
+
+namespace {
+
+inline uint8_t clamp255(int32_t x) {
+    return static_cast<uint8_t>(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+inline uint8_t rgbToY(int32_t r, int32_t g, int32_t b) {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+inline uint8_t rgbToU(int32_t r, int32_t g, int32_t b) {
+    return static_cast<uint8_t>(((112 * b - 74 * g - 38 * r + 128) >> 8) + 128);
+}
+
+inline uint8_t rgbToV(int32_t r, int32_t g, int32_t b) {
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// 2x2四个像素某个分量的平均值, x1是右边一列
+inline int32_t avg4(const uint8_t* row0, const uint8_t* row1, int x0, int x1, int channel) {
+    return (row0[x0 * 4 + channel] + row0[x1 * 4 + channel] + row1[x0 * 4 + channel] +
+            row1[x1 * 4 + channel] + 2) >>
+           2;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+void bgraToYRowC(const uint8_t* bgra, uint8_t* y, int width) {
+    for (int x = 0; x < width; x++) {
+        y[x] = rgbToY(bgra[x * 4 + 2], bgra[x * 4 + 1], bgra[x * 4]);
+    }
+}
+
+void bgraToUVRowC(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v,
+                  int width) {
+    for (int x = 0; x < width; x += 2) {
+        const int x1 = x + 1 < width ? x + 1 : x;
+        const int32_t b = avg4(bgra0, bgra1, x, x1, 0);
+        const int32_t g = avg4(bgra0, bgra1, x, x1, 1);
+        const int32_t r = avg4(bgra0, bgra1, x, x1, 2);
+        u[x / 2] = rgbToU(r, g, b);
+        v[x / 2] = rgbToV(r, g, b);
+    }
+}
+
+void bgraToUVInterleavedRowC(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv,
+                             int width) {
+    for (int x = 0; x < width; x += 2) {
+        const int x1 = x + 1 < width ? x + 1 : x;
+        const int32_t b = avg4(bgra0, bgra1, x, x1, 0);
+        const int32_t g = avg4(bgra0, bgra1, x, x1, 1);
+        const int32_t r = avg4(bgra0, bgra1, x, x1, 2);
+        uv[x] = rgbToU(r, g, b);
+        uv[x + 1] = rgbToV(r, g, b);
+    }
+}
+
+void bgraToUVFullRowC(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width) {
+    for (int x = 0; x < width; x++) {
+        const int32_t b = bgra[x * 4];
+        const int32_t g = bgra[x * 4 + 1];
+        const int32_t r = bgra[x * 4 + 2];
+        u[x] = rgbToU(r, g, b);
+        v[x] = rgbToV(r, g, b);
+    }
+}
+
+void mergeUVRowC(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    for (int x = 0; x < width; x++) {
+        uv[x * 2] = u[x];
+        uv[x * 2 + 1] = v[x];
+    }
+}
+
+void nv12ToBgraRowC(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    for (int x = 0; x < width; x++) {
+        const int32_t c = (y[x] - 16) * 298 + 128;
+        const int32_t d = uv[x / 2 * 2] - 128;
+        const int32_t e = uv[x / 2 * 2 + 1] - 128;
+        bgra[x * 4] = clamp255((c + 516 * d) >> 8);
+        bgra[x * 4 + 1] = clamp255((c - 100 * d - 208 * e) >> 8);
+        bgra[x * 4 + 2] = clamp255((c + 409 * e) >> 8);
+        bgra[x * 4 + 3] = 255;
+    }
+}
+
+const ConvertKernels* scalarKernels() {
+    static const ConvertKernels kernels{
+        bgraToYRowC,
+        bgraToUVRowC,
+        bgraToUVInterleavedRowC,
+        bgraToUVFullRowC,
+        mergeUVRowC,
+        nv12ToBgraRowC,
+    };
+    return &kernels;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
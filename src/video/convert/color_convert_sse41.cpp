@@ -0,0 +1,250 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "color_convert_kernels.h"
+
+#if LT_CONVERT_X86
+#include <smmintrin.h>
+
+#include <cstring>
+
+// 算法和C版本一一对应: 分量扩展到16位, RGB->YUV的中间结果都在int16范围内, 不会溢出.
+// YUV->RGB的中间结果超过int16, 用32位算
+
+namespace {
+
+using namespace lt::video::detail;
+
+// 8个BGRA像素拆成B/G/R, 每个分量16位
+inline void loadBgr8(const uint8_t* src, __m128i& b, __m128i& g, __m128i& r) {
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    b = _mm_packus_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    g = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                         _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    r = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                         _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+// 相邻两个像素的分量相加, 结果是32位
+inline __m128i pairSum(__m128i x) {
+    return _mm_add_epi32(_mm_and_si128(x, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(x, 16));
+}
+
+// 两行各16个像素, 按2x2取平均得到8个B/G/R
+inline void loadBgrAvg16(const uint8_t* row0, const uint8_t* row1, __m128i& b, __m128i& g,
+                         __m128i& r) {
+    __m128i b0, g0, r0, b1, g1, r1;
+    loadBgr8(row0, b0, g0, r0);
+    loadBgr8(row1, b1, g1, r1);
+    const __m128i b_lo = pairSum(_mm_add_epi16(b0, b1));
+    const __m128i g_lo = pairSum(_mm_add_epi16(g0, g1));
+    const __m128i r_lo = pairSum(_mm_add_epi16(r0, r1));
+    loadBgr8(row0 + 32, b0, g0, r0);
+    loadBgr8(row1 + 32, b1, g1, r1);
+    const __m128i b_hi = pairSum(_mm_add_epi16(b0, b1));
+    const __m128i g_hi = pairSum(_mm_add_epi16(g0, g1));
+    const __m128i r_hi = pairSum(_mm_add_epi16(r0, r1));
+    const __m128i two = _mm_set1_epi16(2);
+    b = _mm_srli_epi16(_mm_add_epi16(_mm_packus_epi32(b_lo, b_hi), two), 2);
+    g = _mm_srli_epi16(_mm_add_epi16(_mm_packus_epi32(g_lo, g_hi), two), 2);
+    r = _mm_srli_epi16(_mm_add_epi16(_mm_packus_epi32(r_lo, r_hi), two), 2);
+}
+
+inline __m128i toY(__m128i b, __m128i g, __m128i r) {
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(y, _mm_set1_epi16(16));
+}
+
+inline __m128i toU(__m128i b, __m128i g, __m128i r) {
+    __m128i u = _mm_sub_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(74)));
+    u = _mm_sub_epi16(u, _mm_mullo_epi16(r, _mm_set1_epi16(38)));
+    u = _mm_srai_epi16(_mm_add_epi16(u, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(u, _mm_set1_epi16(128));
+}
+
+inline __m128i toV(__m128i b, __m128i g, __m128i r) {
+    __m128i v = _mm_sub_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                              _mm_mullo_epi16(g, _mm_set1_epi16(94)));
+    v = _mm_sub_epi16(v, _mm_mullo_epi16(b, _mm_set1_epi16(18)));
+    v = _mm_srai_epi16(_mm_add_epi16(v, _mm_set1_epi16(128)), 8);
+    return _mm_add_epi16(v, _mm_set1_epi16(128));
+}
+
+inline __m128i clamp255(__m128i x) {
+    return _mm_min_epi32(_mm_max_epi32(x, _mm_setzero_si128()), _mm_set1_epi32(255));
+}
+
+void bgraToYRow(const uint8_t* bgra, uint8_t* y, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b, g, r;
+        loadBgr8(bgra + x * 4, b, g, r);
+        const __m128i y0 = toY(b, g, r);
+        loadBgr8(bgra + x * 4 + 32, b, g, r);
+        const __m128i y1 = toY(b, g, r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), _mm_packus_epi16(y0, y1));
+    }
+    bgraToYRowC(bgra + x * 4, y + x, width - x);
+}
+
+void bgraToUVRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b, g, r;
+        loadBgrAvg16(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        const __m128i u8 = toU(b, g, r);
+        const __m128i v8 = toV(b, g, r);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), _mm_packus_epi16(u8, u8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_packus_epi16(v8, v8));
+    }
+    bgraToUVRowC(bgra0 + x * 4, bgra1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+void bgraToUVInterleavedRow(const uint8_t* bgra0, const uint8_t* bgra1, uint8_t* uv,
+                            int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b, g, r;
+        loadBgrAvg16(bgra0 + x * 4, bgra1 + x * 4, b, g, r);
+        const __m128i uv16 = _mm_or_si128(toU(b, g, r), _mm_slli_epi16(toV(b, g, r), 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), uv16);
+    }
+    bgraToUVInterleavedRowC(bgra0 + x * 4, bgra1 + x * 4, uv + x, width - x);
+}
+
+void bgraToUVFullRow(const uint8_t* bgra, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i b, g, r;
+        loadBgr8(bgra + x * 4, b, g, r);
+        const __m128i u0 = toU(b, g, r);
+        const __m128i v0 = toV(b, g, r);
+        loadBgr8(bgra + x * 4 + 32, b, g, r);
+        const __m128i u1 = toU(b, g, r);
+        const __m128i v1 = toV(b, g, r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + x), _mm_packus_epi16(u0, u1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + x), _mm_packus_epi16(v0, v1));
+    }
+    bgraToUVFullRowC(bgra + x * 4, u + x, v + x, width - x);
+}
+
+void mergeUVRow(const uint8_t* u, const uint8_t* v, uint8_t* uv, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i u16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x));
+        const __m128i v16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x * 2), _mm_unpacklo_epi8(u16, v16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x * 2 + 16),
+                         _mm_unpackhi_epi8(u16, v16));
+    }
+    mergeUVRowC(u + x, v + x, uv + x * 2, width - x);
+}
+
+void nv12ToBgraRow(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        int32_t y4;
+        int32_t uv4;
+        memcpy(&y4, y + x, 4);
+        memcpy(&uv4, uv + x, 4);
+        // u0 v0 u1 v1 -> u0 u0 u1 u1, v0 v0 v1 v1
+        const __m128i uv32 = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(uv4));
+        const __m128i d = _mm_sub_epi32(_mm_shuffle_epi32(uv32, _MM_SHUFFLE(2, 2, 0, 0)),
+                                        _mm_set1_epi32(128));
+        const __m128i e = _mm_sub_epi32(_mm_shuffle_epi32(uv32, _MM_SHUFFLE(3, 3, 1, 1)),
+                                        _mm_set1_epi32(128));
+        __m128i c = _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(y4)), _mm_set1_epi32(16));
+        c = _mm_add_epi32(_mm_mullo_epi32(c, _mm_set1_epi32(298)), _mm_set1_epi32(128));
+        __m128i b = _mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516)));
+        __m128i g = _mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(100)));
+        g = _mm_sub_epi32(g, _mm_mullo_epi32(e, _mm_set1_epi32(208)));
+        __m128i r = _mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409)));
+        b = clamp255(_mm_srai_epi32(b, 8));
+        g = clamp255(_mm_srai_epi32(g, 8));
+        r = clamp255(_mm_srai_epi32(r, 8));
+        __m128i out = _mm_or_si128(b, _mm_slli_epi32(g, 8));
+        out = _mm_or_si128(out, _mm_slli_epi32(r, 16));
+        out = _mm_or_si128(out, _mm_set1_epi32(static_cast<int32_t>(0xFF000000)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + x * 4), out);
+    }
+    nv12ToBgraRowC(y + x, uv + x / 2 * 2, bgra + x * 4, width - x);
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* sse41Kernels() {
+    static const ConvertKernels kernels{
+        bgraToYRow,
+        bgraToUVRow,
+        bgraToUVInterleavedRow,
+        bgraToUVFullRow,
+        mergeUVRow,
+        nv12ToBgraRow,
+    };
+    return &kernels;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#else // LT_CONVERT_X86
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+const ConvertKernels* sse41Kernels() {
+    return nullptr;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#endif // LT_CONVERT_X86
@@ -0,0 +1,363 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "color_convert.h"
+
+using lt::video::ColorConverter;
+using lt::video::SimdLevel;
+
+namespace {
+
+// 参考实现直接照着公式写, 不和被测代码共享任何函数
+uint8_t clamp255(int x) {
+    return static_cast<uint8_t>(std::min(255, std::max(0, x)));
+}
+
+uint8_t refY(int r, int g, int b) {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+uint8_t refU(int r, int g, int b) {
+    return static_cast<uint8_t>(((112 * b - 74 * g - 38 * r + 128) >> 8) + 128);
+}
+
+uint8_t refV(int r, int g, int b) {
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+struct Image {
+    int width;
+    int height;
+    int stride;
+    std::vector<uint8_t> data;
+
+    Image(int w, int h, int bytes_per_pixel, int padding = 0)
+        : width{w}
+        , height{h}
+        , stride{w * bytes_per_pixel + padding}
+        , data(static_cast<size_t>(stride) * h, 0xCD) {}
+    uint8_t* row(int y) { return data.data() + static_cast<size_t>(y) * stride; }
+    const uint8_t* row(int y) const { return data.data() + static_cast<size_t>(y) * stride; }
+};
+
+void fillRandom(Image& image, uint32_t seed) {
+    std::mt19937 rng{seed};
+    for (auto& byte : image.data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+}
+
+// 比较有效区域, 顺便检查行尾的padding没有被写坏
+void expectSame(const Image& expected, const Image& actual, int bytes_per_row, const char* what) {
+    for (int y = 0; y < expected.height; y++) {
+        for (int x = 0; x < bytes_per_row; x++) {
+            ASSERT_EQ(expected.row(y)[x], actual.row(y)[x])
+                << what << " x:" << x << " y:" << y << " size:" << expected.width << "x"
+                << expected.height;
+        }
+        for (int x = bytes_per_row; x < actual.stride; x++) {
+            ASSERT_EQ(actual.row(y)[x], 0xCD) << what << " padding overwritten";
+        }
+    }
+}
+
+struct Yuv420 {
+    Image y;
+    Image u;
+    Image v;
+    Yuv420(int w, int h, int padding)
+        : y{w, h, 1, padding}
+        , u{(w + 1) / 2, (h + 1) / 2, 1, padding}
+        , v{(w + 1) / 2, (h + 1) / 2, 1, padding} {}
+};
+
+void refBgraToI420(const Image& bgra, Yuv420& out) {
+    const int w = bgra.width;
+    const int h = bgra.height;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const uint8_t* p = bgra.row(y) + x * 4;
+            out.y.row(y)[x] = refY(p[2], p[1], p[0]);
+        }
+    }
+    for (int y = 0; y < h; y += 2) {
+        for (int x = 0; x < w; x += 2) {
+            int sum[3] = {0, 0, 0};
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    const uint8_t* p =
+                        bgra.row(std::min(y + dy, h - 1)) + std::min(x + dx, w - 1) * 4;
+                    for (int c = 0; c < 3; c++) {
+                        sum[c] += p[c];
+                    }
+                }
+            }
+            const int b = (sum[0] + 2) / 4;
+            const int g = (sum[1] + 2) / 4;
+            const int r = (sum[2] + 2) / 4;
+            out.u.row(y / 2)[x / 2] = refU(r, g, b);
+            out.v.row(y / 2)[x / 2] = refV(r, g, b);
+        }
+    }
+}
+
+void refBgraToI444(const Image& bgra, Image& y_plane, Image& u_plane, Image& v_plane) {
+    for (int y = 0; y < bgra.height; y++) {
+        for (int x = 0; x < bgra.width; x++) {
+            const uint8_t* p = bgra.row(y) + x * 4;
+            y_plane.row(y)[x] = refY(p[2], p[1], p[0]);
+            u_plane.row(y)[x] = refU(p[2], p[1], p[0]);
+            v_plane.row(y)[x] = refV(p[2], p[1], p[0]);
+        }
+    }
+}
+
+void refNV12ToBgra(const Image& y_plane, const Image& uv_plane, Image& bgra) {
+    for (int y = 0; y < bgra.height; y++) {
+        for (int x = 0; x < bgra.width; x++) {
+            const int c = y_plane.row(y)[x] - 16;
+            const int d = uv_plane.row(y / 2)[x / 2 * 2] - 128;
+            const int e = uv_plane.row(y / 2)[x / 2 * 2 + 1] - 128;
+            uint8_t* p = bgra.row(y) + x * 4;
+            p[0] = clamp255((298 * c + 516 * d + 128) >> 8);
+            p[1] = clamp255((298 * c - 100 * d - 208 * e + 128) >> 8);
+            p[2] = clamp255((298 * c + 409 * e + 128) >> 8);
+            p[3] = 255;
+        }
+    }
+}
+
+struct Size {
+    int width;
+    int height;
+};
+
+// 覆盖各个指令集的整块, 尾巴, 奇数宽高, 以及多线程切块的边界
+const Size kSizes[] = {{1, 1},     {2, 2},    {3, 5},      {15, 3},     {17, 4},
+                       {31, 7},    {33, 9},   {63, 2},     {64, 64},    {65, 33},
+                       {127, 129}, {130, 66}, {333, 77},   {640, 360},  {1001, 101},
+                       {1920, 1080}};
+
+std::vector<std::unique_ptr<ColorConverter>> allConverters() {
+    std::vector<std::unique_ptr<ColorConverter>> converters;
+    for (auto level : lt::video::supportedSimdLevels()) {
+        for (uint32_t threads : {1u, 4u}) {
+            ColorConverter::Params params{};
+            params.threads = threads;
+            params.simd = level;
+            auto converter = ColorConverter::create(params);
+            if (converter != nullptr) {
+                converters.push_back(std::move(converter));
+            }
+        }
+    }
+    return converters;
+}
+
+} // namespace
+
+TEST(ColorConvertTest, SupportedLevels) {
+    const auto& levels = lt::video::supportedSimdLevels();
+    ASSERT_FALSE(levels.empty());
+    EXPECT_EQ(levels.front(), SimdLevel::Scalar);
+    for (auto level : levels) {
+        printf("supported: %s\n", lt::video::simdLevelToString(level));
+    }
+    auto converter = ColorConverter::create(ColorConverter::Params{});
+    ASSERT_NE(converter, nullptr);
+    EXPECT_EQ(converter->simdLevel(), levels.back());
+    EXPECT_EQ(converter->threads(), 1u);
+}
+
+TEST(ColorConvertTest, InvalidArguments) {
+    auto converter = ColorConverter::create(ColorConverter::Params{});
+    std::vector<uint8_t> buffer(64 * 64 * 4);
+    uint8_t* p = buffer.data();
+    EXPECT_FALSE(converter->bgraToI420(p, 64 * 4, p, 64, p, 32, p, 32, 0, 64));
+    EXPECT_FALSE(converter->bgraToI420(p, 63 * 4, p, 64, p, 32, p, 32, 64, 64));
+    EXPECT_FALSE(converter->bgraToI420(p, 64 * 4, p, 64, p, 31, p, 32, 64, 64));
+    EXPECT_FALSE(converter->bgraToNV12(p, 64 * 4, nullptr, 64, p, 64, 64, 64));
+    EXPECT_FALSE(converter->nv12ToBgra(p, 64, p, 63, p, 64 * 4, 64, 64));
+}
+
+TEST(ColorConvertTest, BgraToI420) {
+    auto converters = allConverters();
+    for (auto size : kSizes) {
+        Image bgra{size.width, size.height, 4, 12};
+        fillRandom(bgra, size.width * 1000 + size.height);
+        Yuv420 expected{size.width, size.height, 0};
+        refBgraToI420(bgra, expected);
+        for (auto& converter : converters) {
+            Yuv420 actual{size.width, size.height, 7};
+            ASSERT_TRUE(converter->bgraToI420(bgra.data.data(), bgra.stride, actual.y.row(0),
+                                              actual.y.stride, actual.u.row(0), actual.u.stride,
+                                              actual.v.row(0), actual.v.stride, size.width,
+                                              size.height));
+            const char* name = lt::video::simdLevelToString(converter->simdLevel());
+            expectSame(expected.y, actual.y, size.width, name);
+            expectSame(expected.u, actual.u, expected.u.width, name);
+            expectSame(expected.v, actual.v, expected.v.width, name);
+        }
+    }
+}
+
+TEST(ColorConvertTest, BgraToNV12) {
+    auto converters = allConverters();
+    for (auto size : kSizes) {
+        Image bgra{size.width, size.height, 4, 4};
+        fillRandom(bgra, size.width * 2000 + size.height);
+        Yuv420 planar{size.width, size.height, 0};
+        refBgraToI420(bgra, planar);
+        Image expected_uv{planar.u.width * 2, planar.u.height, 1};
+        for (int y = 0; y < planar.u.height; y++) {
+            for (int x = 0; x < planar.u.width; x++) {
+                expected_uv.row(y)[x * 2] = planar.u.row(y)[x];
+                expected_uv.row(y)[x * 2 + 1] = planar.v.row(y)[x];
+            }
+        }
+        for (auto& converter : converters) {
+            Image y_plane{size.width, size.height, 1, 5};
+            Image uv_plane{planar.u.width * 2, planar.u.height, 1, 3};
+            ASSERT_TRUE(converter->bgraToNV12(bgra.data.data(), bgra.stride, y_plane.row(0),
+                                              y_plane.stride, uv_plane.row(0), uv_plane.stride,
+                                              size.width, size.height));
+            const char* name = lt::video::simdLevelToString(converter->simdLevel());
+            expectSame(planar.y, y_plane, size.width, name);
+            expectSame(expected_uv, uv_plane, expected_uv.width, name);
+        }
+    }
+}
+
+TEST(ColorConvertTest, BgraToI444) {
+    auto converters = allConverters();
+    for (auto size : kSizes) {
+        Image bgra{size.width, size.height, 4};
+        fillRandom(bgra, size.width * 3000 + size.height);
+        Image expected_y{size.width, size.height, 1};
+        Image expected_u{size.width, size.height, 1};
+        Image expected_v{size.width, size.height, 1};
+        refBgraToI444(bgra, expected_y, expected_u, expected_v);
+        for (auto& converter : converters) {
+            Image y_plane{size.width, size.height, 1, 1};
+            Image u_plane{size.width, size.height, 1, 2};
+            Image v_plane{size.width, size.height, 1, 3};
+            ASSERT_TRUE(converter->bgraToI444(bgra.data.data(), bgra.stride, y_plane.row(0),
+                                              y_plane.stride, u_plane.row(0), u_plane.stride,
+                                              v_plane.row(0), v_plane.stride, size.width,
+                                              size.height));
+            const char* name = lt::video::simdLevelToString(converter->simdLevel());
+            expectSame(expected_y, y_plane, size.width, name);
+            expectSame(expected_u, u_plane, size.width, name);
+            expectSame(expected_v, v_plane, size.width, name);
+        }
+    }
+}
+
+TEST(ColorConvertTest, I420ToNV12) {
+    auto converters = allConverters();
+    for (auto size : kSizes) {
+        Yuv420 src{size.width, size.height, 9};
+        fillRandom(src.y, 1);
+        fillRandom(src.u, 2);
+        fillRandom(src.v, 3);
+        Image expected_uv{src.u.width * 2, src.u.height, 1};
+        for (int y = 0; y < src.u.height; y++) {
+            for (int x = 0; x < src.u.width; x++) {
+                expected_uv.row(y)[x * 2] = src.u.row(y)[x];
+                expected_uv.row(y)[x * 2 + 1] = src.v.row(y)[x];
+            }
+        }
+        for (auto& converter : converters) {
+            Image y_plane{size.width, size.height, 1, 6};
+            Image uv_plane{src.u.width * 2, src.u.height, 1, 2};
+            ASSERT_TRUE(converter->i420ToNV12(
+                src.y.row(0), src.y.stride, src.u.row(0), src.u.stride, src.v.row(0),
+                src.v.stride, y_plane.row(0), y_plane.stride, uv_plane.row(0), uv_plane.stride,
+                size.width, size.height));
+            const char* name = lt::video::simdLevelToString(converter->simdLevel());
+            expectSame(src.y, y_plane, size.width, name);
+            expectSame(expected_uv, uv_plane, expected_uv.width, name);
+        }
+    }
+}
+
+TEST(ColorConvertTest, NV12ToBgra) {
+    auto converters = allConverters();
+    for (auto size : kSizes) {
+        // 随机的YUV会大量越界, 正好覆盖饱和的情况
+        Image y_plane{size.width, size.height, 1, 3};
+        Image uv_plane{(size.width + 1) / 2 * 2, (size.height + 1) / 2, 1, 5};
+        fillRandom(y_plane, 4);
+        fillRandom(uv_plane, 5);
+        Image expected{size.width, size.height, 4};
+        refNV12ToBgra(y_plane, uv_plane, expected);
+        for (auto& converter : converters) {
+            Image bgra{size.width, size.height, 4, 8};
+            ASSERT_TRUE(converter->nv12ToBgra(y_plane.row(0), y_plane.stride, uv_plane.row(0),
+                                              uv_plane.stride, bgra.row(0), bgra.stride,
+                                              size.width, size.height));
+            const char* name = lt::video::simdLevelToString(converter->simdLevel());
+            expectSame(expected, bgra, size.width * 4, name);
+        }
+    }
+}
+
+// 4K下每个指令集每个转换的耗时, 以及4线程切块的效果
+TEST(ColorConvertTest, Benchmark) {
+    constexpr int kWidth = 3840;
+    constexpr int kHeight = 2160;
+    constexpr int kLoops = 5;
+    Image bgra{kWidth, kHeight, 4};
+    fillRandom(bgra, 6);
+    Yuv420 i420{kWidth, kHeight, 0};
+    Image y444{kWidth, kHeight, 1};
+    Image u444{kWidth, kHeight, 1};
+    Image v444{kWidth, kHeight, 1};
+    Image nv12_y{kWidth, kHeight, 1};
+    Image nv12_uv{kWidth, kHeight / 2, 1};
+    Image bgra_out{kWidth, kHeight, 4};
+    auto ms = [](auto d) {
+        return std::chrono::duration<double, std::milli>(d).count() / kLoops;
+    };
+    for (auto& converter : allConverters()) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            converter->bgraToI420(bgra.row(0), bgra.stride, i420.y.row(0), i420.y.stride,
+                                  i420.u.row(0), i420.u.stride, i420.v.row(0), i420.v.stride,
+                                  kWidth, kHeight);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            converter->bgraToNV12(bgra.row(0), bgra.stride, nv12_y.row(0), nv12_y.stride,
+                                  nv12_uv.row(0), nv12_uv.stride, kWidth, kHeight);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            converter->bgraToI444(bgra.row(0), bgra.stride, y444.row(0), y444.stride,
+                                  u444.row(0), u444.stride, v444.row(0), v444.stride, kWidth,
+                                  kHeight);
+        }
+        auto t3 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            converter->i420ToNV12(i420.y.row(0), i420.y.stride, i420.u.row(0), i420.u.stride,
+                                  i420.v.row(0), i420.v.stride, nv12_y.row(0), nv12_y.stride,
+                                  nv12_uv.row(0), nv12_uv.stride, kWidth, kHeight);
+        }
+        auto t4 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            converter->nv12ToBgra(nv12_y.row(0), nv12_y.stride, nv12_uv.row(0), nv12_uv.stride,
+                                  bgra_out.row(0), bgra_out.stride, kWidth, kHeight);
+        }
+        auto t5 = std::chrono::steady_clock::now();
+        printf("%-8s threads:%u bgra->i420:%.2fms bgra->nv12:%.2fms bgra->i444:%.2fms "
+               "i420->nv12:%.2fms nv12->bgra:%.2fms\n",
+               lt::video::simdLevelToString(converter->simdLevel()), converter->threads(),
+               ms(t1 - t0), ms(t2 - t1), ms(t3 - t2), ms(t4 - t3), ms(t5 - t4));
+    }
+}
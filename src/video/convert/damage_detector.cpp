@@ -0,0 +1,226 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "damage_detector.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "tile_hash.h"
+
+namespace {
+
+using namespace lt::video;
+using namespace lt::video::detail;
+
+constexpr uint32_t kPrime32_1 = 0x9E3779B1u;
+constexpr uint32_t kPrime32_2 = 0x85EBCA77u;
+constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ull;
+
+inline uint32_t round32(uint32_t acc, uint32_t input) {
+    acc += input * kPrime32_2;
+    acc = (acc << 13) | (acc >> 19);
+    return acc * kPrime32_1;
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// 和xxHash64一样的收尾, 让每个输入位都影响到所有输出位
+uint64_t foldLanes(const uint32_t lanes[kTileHashLanes], uint64_t seed) {
+    uint64_t h = seed;
+    for (int i = 0; i < kTileHashLanes; i++) {
+        h ^= lanes[i] * kPrime64_1;
+        h = rotl64(h, 27) * kPrime64_1 + kPrime64_4;
+    }
+    h ^= h >> 33;
+    h *= kPrime64_2;
+    h ^= h >> 29;
+    h *= kPrime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+HashTileFunc hashFuncFor(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return hashTileC;
+    case SimdLevel::SSE41:
+        return hashTileSSE41();
+    // 哈希基本被内存带宽卡住, AVX-512没有比AVX2快, 直接用AVX2的实现
+    case SimdLevel::AVX2:
+    case SimdLevel::AVX512:
+        return hashTileAVX2();
+    case SimdLevel::NEON:
+        return hashTileNEON();
+    default:
+        return nullptr;
+    }
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+void hashTileC(const uint8_t* data, int stride, int row_bytes, int rows,
+               uint32_t lanes[kTileHashLanes]) {
+    const int blocks = (row_bytes + 31) / 32;
+    for (int row = 0; row < rows; row++) {
+        const uint8_t* src = data + static_cast<ptrdiff_t>(row) * stride;
+        for (int c = 0; c < blocks; c++) {
+            uint8_t block[32] = {0};
+            memcpy(block, src + c * 32, std::min(32, row_bytes - c * 32));
+            uint32_t* acc = lanes + (c % 8) * 8;
+            for (int i = 0; i < 8; i++) {
+                uint32_t input;
+                memcpy(&input, block + i * 4, 4);
+                acc[i] = round32(acc[i], input);
+            }
+        }
+    }
+}
+
+} // namespace detail
+
+std::unique_ptr<DamageDetector> DamageDetector::create(const Params& params) {
+    if (params.width == 0 || params.height == 0 || params.bytes_per_pixel == 0 ||
+        params.tile_size < 2 || params.tile_size % 2 != 0) {
+        return nullptr;
+    }
+    const auto& supported = supportedSimdLevels();
+    SimdLevel level = supported.back();
+    if (params.simd.has_value()) {
+        level = params.simd.value();
+        if (std::find(supported.begin(), supported.end(), level) == supported.end()) {
+            return nullptr;
+        }
+    }
+    HashTileFunc func = hashFuncFor(level);
+    if (func == nullptr) {
+        return nullptr;
+    }
+    std::unique_ptr<DamageDetector> detector{new DamageDetector(params)};
+    detector->level_ = level;
+    detector->hash_func_ = func;
+    return detector;
+}
+
+DamageDetector::DamageDetector(const Params& params)
+    : width_{params.width}
+    , height_{params.height}
+    , bytes_per_pixel_{params.bytes_per_pixel}
+    , tile_size_{params.tile_size}
+    , tiles_x_{(params.width + params.tile_size - 1) / params.tile_size}
+    , tiles_y_{(params.height + params.tile_size - 1) / params.tile_size}
+    , hashes_(tiles_x_ * tiles_y_) {}
+
+const std::vector<DamageRect>& DamageDetector::detect(const uint8_t* data, int stride) {
+    rects_.clear();
+    last_row_rects_.clear();
+    dirty_tiles_ = 0;
+    std::vector<uint8_t> dirty(tiles_x_);
+    for (uint32_t ty = 0; ty < tiles_y_; ty++) {
+        for (uint32_t tx = 0; tx < tiles_x_; tx++) {
+            const uint64_t hash = hashTile(data, stride, tx, ty);
+            uint64_t& previous = hashes_[ty * tiles_x_ + tx];
+            dirty[tx] = !has_previous_ || hash != previous;
+            dirty_tiles_ += dirty[tx];
+            previous = hash;
+        }
+        mergeRow(ty, dirty);
+    }
+    has_previous_ = true;
+    return rects_;
+}
+
+void DamageDetector::reset() {
+    has_previous_ = false;
+}
+
+uint64_t DamageDetector::hashTile(const uint8_t* data, int stride, uint32_t tx,
+                                  uint32_t ty) const {
+    const uint32_t x = tx * tile_size_;
+    const uint32_t y = ty * tile_size_;
+    const int row_bytes =
+        static_cast<int>((std::min(x + tile_size_, width_) - x) * bytes_per_pixel_);
+    const int rows = static_cast<int>(std::min(y + tile_size_, height_) - y);
+    uint32_t lanes[kTileHashLanes];
+    for (int i = 0; i < kTileHashLanes; i++) {
+        lanes[i] = kPrime32_1 + static_cast<uint32_t>(i) * kPrime32_2;
+    }
+    hash_func_(data + static_cast<ptrdiff_t>(y) * stride + x * bytes_per_pixel_, stride,
+               row_bytes, rows, lanes);
+    return foldLanes(lanes, (static_cast<uint64_t>(row_bytes) << 32) | static_cast<uint32_t>(rows));
+}
+
+void DamageDetector::mergeRow(uint32_t ty, const std::vector<uint8_t>& dirty) {
+    std::vector<size_t> row_rects;
+    const uint32_t y = ty * tile_size_;
+    const uint32_t height = std::min(y + tile_size_, height_) - y;
+    uint32_t tx = 0;
+    while (tx < tiles_x_) {
+        if (!dirty[tx]) {
+            tx++;
+            continue;
+        }
+        uint32_t end = tx;
+        while (end < tiles_x_ && dirty[end]) {
+            end++;
+        }
+        const uint32_t x = tx * tile_size_;
+        const uint32_t width = std::min(end * tile_size_, width_) - x;
+        tx = end;
+        auto above = std::find_if(last_row_rects_.begin(), last_row_rects_.end(), [&](size_t i) {
+            return rects_[i].x == x && rects_[i].width == width;
+        });
+        if (above != last_row_rects_.end()) {
+            rects_[*above].height += height;
+            row_rects.push_back(*above);
+        }
+        else {
+            rects_.push_back(DamageRect{x, y, width, height});
+            row_rects.push_back(rects_.size() - 1);
+        }
+    }
+    last_row_rects_ = std::move(row_rects);
+}
+
+} // namespace video
+
+} // namespace lt
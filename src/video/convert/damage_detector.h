@@ -0,0 +1,106 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <video/convert/color_convert.h>
+
+namespace lt {
+
+namespace video {
+
+// 以像素为单位
+struct DamageRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// 把画面切成固定大小的tile, 每个tile算一个64位哈希和上一帧比较, 得到变化了的区域.
+// 哈希相同就当作没变, 碰撞的概率可以忽略, 真碰上了也会被调用者的定期刷新补上.
+// 只比较一个平面, 内存路径上直接对抓到的BGRA做, 转换之前就能知道哪里要转.
+// 参数不合法或者指定的指令集不支持时create()返回nullptr
+class DamageDetector {
+public:
+    struct Params {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t bytes_per_pixel = 4;
+        // 必须是偶数, 这样变化区域的坐标对I420的色度平面也是对齐的
+        uint32_t tile_size = 64;
+        // 同ColorConverter::Params::simd
+        std::optional<SimdLevel> simd;
+    };
+
+public:
+    static std::unique_ptr<DamageDetector> create(const Params& params);
+    SimdLevel simdLevel() const { return level_; }
+    uint32_t tileCount() const { return tiles_x_ * tiles_y_; }
+    // 上一次detect()里变化了的tile数
+    uint32_t dirtyTiles() const { return dirty_tiles_; }
+
+    // 返回和上一次detect()相比变化了的区域. 区域按tile对齐, 右边和下边裁到画面以内,
+    // 同一行相邻的tile合成一个矩形, 上下相邻且左右边界相同的矩形再合并.
+    // 第一次调用或者reset()之后整帧都算变化. 返回的引用在下一次调用前有效
+    const std::vector<DamageRect>& detect(const uint8_t* data, int stride);
+
+    // 上一帧的哈希作废, 比如调用者没能用上这次的检测结果
+    void reset();
+
+private:
+    DamageDetector(const Params& params);
+    uint64_t hashTile(const uint8_t* data, int stride, uint32_t tx, uint32_t ty) const;
+    void mergeRow(uint32_t ty, const std::vector<uint8_t>& dirty);
+
+private:
+    const uint32_t width_;
+    const uint32_t height_;
+    const uint32_t bytes_per_pixel_;
+    const uint32_t tile_size_;
+    const uint32_t tiles_x_;
+    const uint32_t tiles_y_;
+    SimdLevel level_ = SimdLevel::Scalar;
+    void (*hash_func_)(const uint8_t*, int, int, int, uint32_t*) = nullptr;
+    bool has_previous_ = false;
+    uint32_t dirty_tiles_ = 0;
+    std::vector<uint64_t> hashes_;
+    std::vector<DamageRect> rects_;
+    // 上一行tile里产生的矩形在rects_里的下标, 用来做上下合并
+    std::vector<size_t> last_row_rects_;
+};
+
+} // namespace video
+
+} // namespace lt
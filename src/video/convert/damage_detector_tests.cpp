@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "damage_detector.h"
+#include "tile_hash.h"
+
+using lt::video::DamageDetector;
+using lt::video::DamageRect;
+using lt::video::SimdLevel;
+
+namespace {
+
+struct Frame {
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    int stride;
+    std::vector<uint8_t> data;
+
+    Frame(uint32_t w, uint32_t h, uint32_t bpp = 4, int padding = 0)
+        : width{w}
+        , height{h}
+        , bytes_per_pixel{bpp}
+        , stride{static_cast<int>(w * bpp) + padding}
+        , data(static_cast<size_t>(stride) * h) {}
+
+    uint8_t* pixel(uint32_t x, uint32_t y) {
+        return data.data() + static_cast<size_t>(y) * stride + x * bytes_per_pixel;
+    }
+};
+
+void fillRandom(Frame& frame, uint32_t seed) {
+    std::mt19937 rng{seed};
+    for (auto& b : frame.data) {
+        b = static_cast<uint8_t>(rng());
+    }
+}
+
+std::unique_ptr<DamageDetector> makeDetector(const Frame& frame, uint32_t tile_size = 64,
+                                             std::optional<SimdLevel> simd = std::nullopt) {
+    DamageDetector::Params params{};
+    params.width = frame.width;
+    params.height = frame.height;
+    params.bytes_per_pixel = frame.bytes_per_pixel;
+    params.tile_size = tile_size;
+    params.simd = simd;
+    return DamageDetector::create(params);
+}
+
+bool operator==(const DamageRect& a, const DamageRect& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+std::string toString(const std::vector<DamageRect>& rects) {
+    std::string str;
+    for (auto& r : rects) {
+        str += "{" + std::to_string(r.x) + "," + std::to_string(r.y) + "," +
+               std::to_string(r.width) + "," + std::to_string(r.height) + "}";
+    }
+    return str;
+}
+
+} // namespace
+
+TEST(DamageDetectorTest, InvalidParams) {
+    DamageDetector::Params params{};
+    EXPECT_EQ(DamageDetector::create(params), nullptr);
+    params.width = 1920;
+    params.height = 1080;
+    params.tile_size = 63;
+    EXPECT_EQ(DamageDetector::create(params), nullptr);
+    params.tile_size = 64;
+    EXPECT_NE(DamageDetector::create(params), nullptr);
+}
+
+TEST(DamageDetectorTest, FirstFrameAndStatic) {
+    Frame frame{1920, 1080};
+    fillRandom(frame, 1);
+    auto detector = makeDetector(frame);
+    ASSERT_NE(detector, nullptr);
+    EXPECT_EQ(detector->tileCount(), 30u * 17u);
+    // 第一帧整帧变化, 所有行的矩形上下合并成一个
+    auto rects = detector->detect(frame.data.data(), frame.stride);
+    ASSERT_EQ(rects.size(), 1u);
+    EXPECT_TRUE(rects[0] == (DamageRect{0, 0, 1920, 1080})) << toString(rects);
+    EXPECT_EQ(detector->dirtyTiles(), detector->tileCount());
+    EXPECT_TRUE(detector->detect(frame.data.data(), frame.stride).empty());
+    EXPECT_EQ(detector->dirtyTiles(), 0u);
+    // 不同的内存, 内容一样
+    std::vector<uint8_t> copy = frame.data;
+    EXPECT_TRUE(detector->detect(copy.data(), frame.stride).empty());
+    detector->reset();
+    EXPECT_EQ(detector->detect(frame.data.data(), frame.stride).size(), 1u);
+}
+
+TEST(DamageDetectorTest, SinglePixel) {
+    Frame frame{1920, 1080};
+    fillRandom(frame, 2);
+    auto detector = makeDetector(frame);
+    detector->detect(frame.data.data(), frame.stride);
+    // 一个像素里只改一位
+    frame.pixel(100, 200)[2] ^= 0x10;
+    auto rects = detector->detect(frame.data.data(), frame.stride);
+    ASSERT_EQ(rects.size(), 1u);
+    EXPECT_TRUE(rects[0] == (DamageRect{64, 192, 64, 64})) << toString(rects);
+    EXPECT_EQ(detector->dirtyTiles(), 1u);
+    EXPECT_TRUE(detector->detect(frame.data.data(), frame.stride).empty());
+}
+
+TEST(DamageDetectorTest, MergeAndClip) {
+    // 宽高都不是tile的整数倍, 行尾还有padding
+    Frame frame{1000, 700, 4, 48};
+    fillRandom(frame, 3);
+    auto detector = makeDetector(frame);
+    detector->detect(frame.data.data(), frame.stride);
+    // 2x2个tile的方块
+    frame.pixel(130, 70)[0] ^= 1;
+    frame.pixel(250, 70)[0] ^= 1;
+    frame.pixel(130, 190)[0] ^= 1;
+    frame.pixel(250, 190)[0] ^= 1;
+    // 同一行不相邻的一个tile
+    frame.pixel(500, 100)[1] ^= 1;
+    // 右下角被裁掉的tile
+    frame.pixel(999, 699)[3] ^= 1;
+    // padding不算画面的一部分
+    frame.data[frame.stride - 1] ^= 1;
+    auto rects = detector->detect(frame.data.data(), frame.stride);
+    const std::vector<DamageRect> expected = {
+        {128, 64, 128, 128},
+        {448, 64, 64, 64},
+        {960, 640, 40, 60},
+    };
+    ASSERT_EQ(rects.size(), expected.size()) << toString(rects);
+    for (size_t i = 0; i < rects.size(); i++) {
+        EXPECT_TRUE(rects[i] == expected[i]) << toString(rects);
+    }
+    EXPECT_EQ(detector->dirtyTiles(), 6u);
+}
+
+TEST(DamageDetectorTest, ScrollingRegion) {
+    // 模拟滚动的文本区域: 中间一列每帧都变, 上下合并成一个竖条
+    Frame frame{1280, 720};
+    fillRandom(frame, 4);
+    auto detector = makeDetector(frame, 32);
+    detector->detect(frame.data.data(), frame.stride);
+    for (uint32_t y = 100; y < 600; y++) {
+        frame.pixel(400, y)[0] += 1;
+    }
+    auto rects = detector->detect(frame.data.data(), frame.stride);
+    ASSERT_EQ(rects.size(), 1u);
+    EXPECT_TRUE(rects[0] == (DamageRect{384, 96, 32, 512})) << toString(rects);
+}
+
+// 所有指令集的tile哈希必须逐位相同, 覆盖各种行长度和不满32字节的尾巴
+TEST(DamageDetectorTest, KernelsBitExact) {
+    using namespace lt::video::detail;
+    std::mt19937 rng{5};
+    std::vector<uint8_t> data(300 * 64 + 64);
+    for (auto& b : data) {
+        b = static_cast<uint8_t>(rng());
+    }
+    for (auto level : lt::video::supportedSimdLevels()) {
+        if (level == SimdLevel::Scalar) {
+            continue;
+        }
+        HashTileFunc func = level == SimdLevel::SSE41  ? hashTileSSE41()
+                            : level == SimdLevel::NEON ? hashTileNEON()
+                                                       : hashTileAVX2();
+        for (int row_bytes = 1; row_bytes <= 300; row_bytes++) {
+            for (int rows : {1, 3, 64}) {
+                uint32_t expected[kTileHashLanes];
+                uint32_t actual[kTileHashLanes];
+                for (int i = 0; i < kTileHashLanes; i++) {
+                    expected[i] = actual[i] = static_cast<uint32_t>(i * 0x01000193);
+                }
+                hashTileC(data.data() + 1, 300, row_bytes, rows, expected);
+                func(data.data() + 1, 300, row_bytes, rows, actual);
+                for (int i = 0; i < kTileHashLanes; i++) {
+                    ASSERT_EQ(expected[i], actual[i])
+                        << lt::video::simdLevelToString(level) << " row_bytes " << row_bytes
+                        << " rows " << rows << " lane " << i;
+                }
+            }
+        }
+    }
+}
+
+TEST(DamageDetectorTest, AllLevelsAgree) {
+    Frame frame{1001, 333, 1};
+    fillRandom(frame, 6);
+    std::mt19937 rng{7};
+    for (auto level : lt::video::supportedSimdLevels()) {
+        auto reference = makeDetector(frame, 64, SimdLevel::Scalar);
+        auto detector = makeDetector(frame, 64, level);
+        ASSERT_NE(detector, nullptr) << lt::video::simdLevelToString(level);
+        Frame current = frame;
+        for (int i = 0; i < 20; i++) {
+            auto expected = reference->detect(current.data.data(), current.stride);
+            auto actual = detector->detect(current.data.data(), current.stride);
+            EXPECT_EQ(toString(expected), toString(actual)) << lt::video::simdLevelToString(level);
+            for (int j = 0; j < i % 4; j++) {
+                current.pixel(rng() % current.width, rng() % current.height)[0] ^= 0x80;
+            }
+        }
+    }
+}
+
+TEST(DamageDetectorTest, Benchmark) {
+    constexpr int kLoops = 10;
+    Frame frame{3840, 2160};
+    fillRandom(frame, 8);
+    for (auto level : lt::video::supportedSimdLevels()) {
+        auto detector = makeDetector(frame, 64, level);
+        ASSERT_NE(detector, nullptr);
+        detector->detect(frame.data.data(), frame.stride);
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoops; i++) {
+            detector->detect(frame.data.data(), frame.stride);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        const double ms = std::chrono::duration<double, std::milli>(t1 - t0).count() / kLoops;
+        printf("%-8s 3840x2160 BGRA tile hash %.2fms, %.2fGB/s\n",
+               lt::video::simdLevelToString(level), ms, frame.data.size() / ms / 1e6);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include "color_convert_kernels.h"
+
+// DamageDetector用的tile哈希, 和color_convert一样每个指令集一个cpp.
+// 算法是64路并行的xxHash32轮函数: 每行切成32字节的块, 最后一块不满32字节的补0,
+// 第c块的8个uint32(小端)分别累加进第(c%8)组的8个累加器. 8组之间没有依赖, 乘法的延迟能被藏住.
+// 所有指令集的结果必须逐位相同
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+constexpr int kTileHashLanes = 64;
+
+// lanes既是输入也是输出, 调用者负责初始化和最后的折叠
+using HashTileFunc = void (*)(const uint8_t* data, int stride, int row_bytes, int rows,
+                              uint32_t lanes[kTileHashLanes]);
+
+void hashTileC(const uint8_t* data, int stride, int row_bytes, int rows,
+               uint32_t lanes[kTileHashLanes]);
+
+// 没有编进来的指令集返回nullptr
+HashTileFunc hashTileSSE41();
+HashTileFunc hashTileAVX2();
+HashTileFunc hashTileNEON();
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
@@ -0,0 +1,118 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tile_hash.h"
+
+#if LT_CONVERT_X86
+#include <immintrin.h>
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+using namespace lt::video::detail;
+
+inline void round(__m256i& acc, const uint8_t* block) {
+    const __m256i prime1 = _mm256_set1_epi32(static_cast<int>(0x9E3779B1u));
+    const __m256i prime2 = _mm256_set1_epi32(static_cast<int>(0x85EBCA77u));
+    const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(input, prime2));
+    acc = _mm256_or_si256(_mm256_slli_epi32(acc, 13), _mm256_srli_epi32(acc, 19));
+    acc = _mm256_mullo_epi32(acc, prime1);
+}
+
+void hashTile(const uint8_t* data, int stride, int row_bytes, int rows,
+              uint32_t lanes[kTileHashLanes]) {
+    __m256i acc[8];
+    for (int i = 0; i < 8; i++) {
+        acc[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes + i * 8));
+    }
+    const int blocks = row_bytes / 32;
+    const int tail = row_bytes % 32;
+    for (int row = 0; row < rows; row++) {
+        const uint8_t* src = data + static_cast<ptrdiff_t>(row) * stride;
+        int c = 0;
+        for (; c + 8 <= blocks; c += 8) {
+            for (int i = 0; i < 8; i++) {
+                round(acc[i], src + (c + i) * 32);
+            }
+        }
+        for (; c < blocks; c++) {
+            round(acc[c % 8], src + c * 32);
+        }
+        if (tail != 0) {
+            uint8_t buff[32] = {0};
+            memcpy(buff, src + blocks * 32, tail);
+            round(acc[blocks % 8], buff);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + i * 8), acc[i]);
+    }
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+HashTileFunc hashTileAVX2() {
+    return hashTile;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#else // LT_CONVERT_X86
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+HashTileFunc hashTileAVX2() {
+    return nullptr;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#endif // LT_CONVERT_X86
@@ -0,0 +1,123 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tile_hash.h"
+
+#if LT_CONVERT_X86
+#include <smmintrin.h>
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+using namespace lt::video::detail;
+
+// 每组8个累加器占两个寄存器
+inline void round(__m128i& acc, __m128i input) {
+    const __m128i prime1 = _mm_set1_epi32(static_cast<int>(0x9E3779B1u));
+    const __m128i prime2 = _mm_set1_epi32(static_cast<int>(0x85EBCA77u));
+    acc = _mm_add_epi32(acc, _mm_mullo_epi32(input, prime2));
+    acc = _mm_or_si128(_mm_slli_epi32(acc, 13), _mm_srli_epi32(acc, 19));
+    acc = _mm_mullo_epi32(acc, prime1);
+}
+
+inline void roundBlock(__m128i* acc, const uint8_t* block) {
+    round(acc[0], _mm_loadu_si128(reinterpret_cast<const __m128i*>(block)));
+    round(acc[1], _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16)));
+}
+
+void hashTile(const uint8_t* data, int stride, int row_bytes, int rows,
+              uint32_t lanes[kTileHashLanes]) {
+    __m128i acc[16];
+    for (int i = 0; i < 16; i++) {
+        acc[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + i * 4));
+    }
+    const int blocks = row_bytes / 32;
+    const int tail = row_bytes % 32;
+    for (int row = 0; row < rows; row++) {
+        const uint8_t* src = data + static_cast<ptrdiff_t>(row) * stride;
+        int c = 0;
+        for (; c + 8 <= blocks; c += 8) {
+            for (int i = 0; i < 8; i++) {
+                roundBlock(acc + i * 2, src + (c + i) * 32);
+            }
+        }
+        for (; c < blocks; c++) {
+            roundBlock(acc + (c % 8) * 2, src + c * 32);
+        }
+        if (tail != 0) {
+            uint8_t buff[32] = {0};
+            memcpy(buff, src + blocks * 32, tail);
+            roundBlock(acc + (blocks % 8) * 2, buff);
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + i * 4), acc[i]);
+    }
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+HashTileFunc hashTileSSE41() {
+    return hashTile;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#else // LT_CONVERT_X86
+
+namespace lt {
+
+namespace video {
+
+namespace detail {
+
+HashTileFunc hashTileSSE41() {
+    return nullptr;
+}
+
+} // namespace detail
+
+} // namespace video
+
+} // namespace lt
+
+#endif // LT_CONVERT_X86
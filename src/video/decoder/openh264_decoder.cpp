@@ -32,7 +32,8 @@
 
 #include <wels/codec_api.h>
 
-#include <rtc/rtc.h>
+#include <algorithm>
+#include <thread>
 
 #include <ltlib/load_library.h>
 #include <ltlib/logging.h>
@@ -84,6 +85,10 @@ bool OpenH264Decoder::init() {
     openh264_init_success_ = true;
     auto size = width() * height() * 3 / 2;
     frame_.resize(size);
+    // 解码线程之外再借几个核, 4K下单线程拷贝要好几毫秒
+    ColorConverter::Params converter_params{};
+    converter_params.threads = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+    converter_ = ColorConverter::create(converter_params);
     LOGF(INFO, "OpenH264Decoder initialized with w:%u, h:%u, framesize:%llu", width(), height(),
          frame_.size());
     return true;
@@ -114,12 +119,19 @@ DecodedFrame OpenH264Decoder::decode(const uint8_t* data, uint32_t size) {
     }
     auto w = static_cast<int>(width());
     auto h = static_cast<int>(height());
-    int ret = rtc::I420ToNV12(outputs[0], info.UsrData.sSystemBuffer.iStride[0], outputs[1],
-                              info.UsrData.sSystemBuffer.iStride[1], outputs[2],
-                              info.UsrData.sSystemBuffer.iStride[1], frame_.data(), w,
-                              frame_.data() + w * h, w, w, h);
-    if (ret != 0) {
-        LOG(ERR) << "rtc::I420ToNV12 failed " << ret;
+    const auto& buffer = info.UsrData.sSystemBuffer;
+    if (buffer.iWidth != w || buffer.iHeight != h) {
+        // 分辨率中途变了, 要重建解码器, 不能按旧的宽高去读
+        LOGF(ERR, "OpenH264Decoder got %dx%d frame, expect %dx%d", buffer.iWidth, buffer.iHeight, w,
+             h);
+        frame.status = DecodeStatus::Failed;
+        return frame;
+    }
+    bool success = converter_->i420ToNV12(outputs[0], buffer.iStride[0], outputs[1],
+                                          buffer.iStride[1], outputs[2], buffer.iStride[1],
+                                          frame_.data(), w, frame_.data() + w * h, w, w, h);
+    if (!success) {
+        LOG(ERR) << "ColorConverter::i420ToNV12 failed";
         frame.status = DecodeStatus::Failed;
         return frame;
     }
@@ -139,7 +151,12 @@ DecodedFormat OpenH264Decoder::decodedFormat() const {
 }
 
 bool OpenH264Decoder::loadApi() {
+#if defined(LT_WINDOWS)
     const std::string kLibName = "openh264-2.4.0-win64.dll";
+#else  // defined(LT_WINDOWS)
+    // 结构体的布局跟着版本变, 要加载和编译时的头文件同一个包里的库
+    const std::string kLibName = "libopenh264.so";
+#endif // defined(LT_WINDOWS)
     openh264_lib_ = ltlib::DynamicLibrary::load(kLibName);
     if (openh264_lib_ == nullptr) {
         LOG(ERR) << "Load library " << kLibName << " failed";
@@ -32,6 +32,7 @@
 
 #include <ltlib/load_library.h>
 
+#include <video/convert/color_convert.h>
 #include <video/decoder/video_decoder.h>
 #include <video/types.h>
 
@@ -58,6 +59,7 @@ private:
     std::shared_ptr<OpenH264DecoderContext> ctx_;
     bool openh264_init_success_ = false;
     std::vector<uint8_t> frame_;
+    std::unique_ptr<ColorConverter> converter_;
 };
 
 } // namespace video
@@ -0,0 +1,151 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ltr_tracker.h"
+
+namespace lt {
+
+namespace video {
+
+LtrTracker::LtrTracker(const Params& params)
+    : params_{params} {
+    last_good_.fill(-1);
+}
+
+bool LtrTracker::onFrame(int64_t picture_id, const uint8_t* data, size_t size, int64_t now_us) {
+    auto info = parser_.parse(data, size);
+    auto temporal_id = parseH264TemporalId(data, size);
+    const bool reference_lost = last_picture_id_ >= 0 && info.has_value() && !info->idr &&
+                                !referenceDecoded(picture_id, temporal_id);
+    last_picture_id_ = picture_id;
+    pending_ltr_ = -1;
+    pending_temporal_id_ = temporal_id.value_or(0);
+    if (pending_temporal_id_ == 0) {
+        last_base_layer_ = picture_id;
+    }
+    if (!info.has_value()) {
+        return !broken_;
+    }
+    if (info->idr) {
+        // 上一个IDR周期的LTR在解码器里已经没了
+        last_good_ltr_ = -1;
+    }
+    if (info->long_term_mark) {
+        supported_ = true;
+        pending_ltr_ = picture_id;
+    }
+    if (reference_lost && supported_) {
+        markBroken(now_us);
+    }
+    if (broken_ && (info->idr || info->refs_long_term)) {
+        broken_ = false;
+    }
+    return !broken_;
+}
+
+void LtrTracker::onDecoded(int64_t picture_id, bool success, int64_t now_us) {
+    if (!success) {
+        if (supported_) {
+            markBroken(now_us);
+        }
+        return;
+    }
+    if (broken_) {
+        return;
+    }
+    last_good_[pending_temporal_id_] = picture_id;
+    if (picture_id == pending_ltr_) {
+        last_good_ltr_ = picture_id;
+    }
+}
+
+std::optional<LtrTracker::Request> LtrTracker::poll(int64_t now_us) {
+    if (!broken_) {
+        return std::nullopt;
+    }
+    if (last_good_ltr_ >= 0 && now_us - broken_since_us_ < params_.keyframe_timeout_us) {
+        if (last_recovery_us_.has_value() &&
+            now_us - last_recovery_us_.value() < params_.retry_interval_us) {
+            return std::nullopt;
+        }
+        last_recovery_us_ = now_us;
+        return Request{Request::Type::Recovery, last_good_ltr_};
+    }
+    if (last_keyframe_us_.has_value() &&
+        now_us - last_keyframe_us_.value() < params_.keyframe_timeout_us) {
+        return std::nullopt;
+    }
+    last_keyframe_us_ = now_us;
+    return Request{Request::Type::Keyframe, -1};
+}
+
+// 不分层时每一帧参考上一帧. OpenH264的时域分层是二分结构, 基本层参考上一个基本层帧, 第t层
+// 参考往前P>>t帧的那一帧(P是相邻基本层帧的间隔), 那一帧的层号比t低. 中间那些帧被丢了不影响
+bool LtrTracker::referenceDecoded(int64_t picture_id, std::optional<uint8_t> temporal_id) {
+    if (!temporal_id.has_value()) {
+        return last_good_[0] == picture_id - 1;
+    }
+    if (temporal_id.value() == 0) {
+        // 还不知道P的时候只能假设中间没丢基本层帧
+        const int64_t reference =
+            temporal_period_ > 0 ? picture_id - temporal_period_ : last_base_layer_;
+        return reference >= 0 && last_good_[0] == reference;
+    }
+    if (last_base_layer_ < 0 || picture_id <= last_base_layer_) {
+        return false;
+    }
+    // 离基本层帧的距离是P>>t的奇数倍, 中间丢了几个基本层帧只会多出P的整数倍
+    const int64_t offset = picture_id - last_base_layer_;
+    const int64_t distance = offset & -offset;
+    temporal_period_ = distance << temporal_id.value();
+    const int64_t reference = picture_id - distance;
+    for (uint8_t layer = 0; layer < temporal_id.value(); layer++) {
+        if (last_good_[layer] == reference) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LtrTracker::markBroken(int64_t now_us) {
+    if (broken_) {
+        return;
+    }
+    broken_ = true;
+    // 出错之前解码的帧不能再当作参考是对的, 要等IDR或者参考LTR的帧重新开始
+    last_good_.fill(-1);
+    broken_since_us_ = now_us;
+    last_recovery_us_ = std::nullopt;
+    last_keyframe_us_ = std::nullopt;
+}
+
+} // namespace video
+
+} // namespace lt
@@ -0,0 +1,103 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <video/h264/h264_parser.h>
+
+namespace lt {
+
+namespace video {
+
+// 客户端这边的长期参考帧(LTR)跟踪, 配合主机的LtrController. 码流里出现过LTR标记才认为主机
+// 支持按LTR恢复. 一帧参考的帧没收到或者解码失败之后, 在收到IDR或者参考了LTR的P帧之前,
+// 解出来的画面都是花的, 不显示, 同时带着最后一个正确解码的LTR向主机请求恢复.
+// 时域分层时按前缀NAL里的temporal_id推出每一帧参考的是哪一帧, 主机按层丢掉的帧没有人参考,
+// picture_id不连续也不算丢帧. 只在解码线程里用
+class LtrTracker {
+public:
+    struct Params {
+        // 还没恢复时多久重发一次恢复请求
+        int64_t retry_interval_us = 200'000;
+        // 这么久还没恢复就改成请求关键帧, 也兼容不认识恢复请求的主机
+        int64_t keyframe_timeout_us = 1'000'000;
+    };
+    struct Request {
+        enum class Type {
+            Recovery,
+            Keyframe,
+        };
+        Type type;
+        int64_t ltr_picture_id;
+    };
+
+public:
+    explicit LtrTracker(const Params& params);
+    // 解码前调用, 返回false表示这一帧解出来也不能显示
+    bool onFrame(int64_t picture_id, const uint8_t* data, size_t size, int64_t now_us);
+    void onDecoded(int64_t picture_id, bool success, int64_t now_us);
+    std::optional<Request> poll(int64_t now_us);
+    bool supported() const { return supported_; }
+    bool broken() const { return broken_; }
+    int64_t lastGoodLtr() const { return last_good_ltr_; }
+
+private:
+    bool referenceDecoded(int64_t picture_id, std::optional<uint8_t> temporal_id);
+    void markBroken(int64_t now_us);
+
+private:
+    const Params params_;
+    H264RefParser parser_;
+    bool supported_ = false;
+    bool broken_ = false;
+    int64_t broken_since_us_ = 0;
+    std::optional<int64_t> last_recovery_us_;
+    std::optional<int64_t> last_keyframe_us_;
+    int64_t last_picture_id_ = -1;
+    int64_t last_good_ltr_ = -1;
+    // 正在解码的这一帧是不是LTR
+    int64_t pending_ltr_ = -1;
+    uint8_t pending_temporal_id_ = 0;
+    // 最近收到的基本层帧, 时域分层的结构从它开始数
+    int64_t last_base_layer_ = -1;
+    // 相邻两个基本层帧隔了几帧, 从收到的增强层帧推出来, 0表示还不知道. IDR之后不清零,
+    // 编码器很少中途改层数
+    int64_t temporal_period_ = 0;
+    // 每一层最近一个正确解码的帧, 下标是temporal_id
+    std::array<int64_t, 8> last_good_;
+};
+
+} // namespace video
+
+} // namespace lt
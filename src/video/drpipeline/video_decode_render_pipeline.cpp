@@ -45,6 +45,7 @@
 #undef Success
 #endif
 
+#include <ltproto/client2worker/request_ltr_recovery.pb.h>
 #include <ltproto/client2worker/switch_monitor.pb.h>
 #include <ltproto/client2worker/video_frame_ack1.pb.h>
 #include <ltproto/client2worker/video_frame_ack2.pb.h>
@@ -56,8 +57,10 @@
 
 #include <video/decoder/video_decoder.h>
 #include <video/drpipeline/ct_smoother.h>
+#include <video/drpipeline/ltr_tracker.h>
 #include <video/drpipeline/video_statistics.h>
 #include <video/renderer/video_renderer.h>
+#include <video/types.h>
 #include <video/widgets/widgets_manager.h>
 
 namespace {
@@ -152,6 +155,7 @@ private:
                        std::chrono::microseconds max_delay);
     bool waitForRender(std::chrono::microseconds ms);
     void onStat();
+    void requestLtrRecovery();
     void onUserSetBitrate(uint32_t bps);
     void onUserSwitchMonitor();
     void onUserSwitchStretchOrOrigin();
@@ -186,6 +190,8 @@ private:
 
     std::unique_ptr<Renderer> video_renderer_;
     std::unique_ptr<Decoder> video_decoder_;
+    // 只在解码线程里访问, 非H264时为空
+    std::unique_ptr<LtrTracker> ltr_tracker_;
     CTSmoother smoother_;
     std::atomic<bool> stoped_{true};
     std::unique_ptr<ltlib::BlockingThread> decode_thread_;
@@ -303,6 +309,9 @@ bool VDRPipeline::init() {
 
         return false;
     }
+    if (decode_codec_type_ == VideoCodecType::H264_420) {
+        ltr_tracker_ = std::make_unique<LtrTracker>(LtrTracker::Params{});
+    }
     if (for_test_) {
         return true;
     }
@@ -448,14 +457,28 @@ void VDRPipeline::decodeLoop(const std::function<void()>& i_am_alive) {
         i_am_alive();
         std::vector<VideoFrameInternal> frames;
         waitForDecode(frames, 5ms);
+        requestLtrRecovery();
         if (frames.empty()) {
             continue;
         }
         for (auto& frame : frames) {
+            const auto picture_id = static_cast<int64_t>(frame.ltframe_id);
             auto start = ltlib::steady_now_us();
+            const bool can_render =
+                ltr_tracker_ == nullptr ||
+                ltr_tracker_->onFrame(picture_id, frame.data, frame.size, start);
             DecodedFrame decoded_frame = video_decoder_->decode(frame.data, frame.size);
             auto end = ltlib::steady_now_us();
+            if (ltr_tracker_ != nullptr) {
+                ltr_tracker_->onDecoded(picture_id, decoded_frame.status == DecodeStatus::Success2,
+                                        end);
+            }
             if (decoded_frame.status == DecodeStatus::Failed) {
+                if (ltr_tracker_ != nullptr && ltr_tracker_->supported()) {
+                    // 接着解后面的帧, 等主机参考LTR编出来的恢复帧
+                    LOG(ERR) << "Failed to call decode(), request LTR recovery";
+                    continue;
+                }
                 LOG(ERR) << "Failed to call decode(), reqesut i frame";
                 // TODO: send decode failed
                 request_i_frame_ = true;
@@ -469,6 +492,9 @@ void VDRPipeline::decodeLoop(const std::function<void()>& i_am_alive) {
                 LOG(ERR) << "Decode return NeedReset, reset pipeline";
                 reset_pipeline_();
             }
+            else if (!can_render) {
+                LOG(DEBUG) << "Drop broken frame " << picture_id;
+            }
             else {
                 LOG(DEBUG) << "CAPTURE-AFTER_DECODE "
                            << ltlib::steady_now_us() - frame.capture_timestamp_us - time_diff_;
@@ -487,6 +513,26 @@ void VDRPipeline::decodeLoop(const std::function<void()>& i_am_alive) {
     }
 }
 
+// 不认识RequestLtrRecovery的主机会忽略它, 超时后LtrTracker会改成请求关键帧
+void VDRPipeline::requestLtrRecovery() {
+    if (ltr_tracker_ == nullptr) {
+        return;
+    }
+    auto request = ltr_tracker_->poll(ltlib::steady_now_us());
+    if (!request.has_value()) {
+        return;
+    }
+    if (request->type == LtrTracker::Request::Type::Keyframe) {
+        LOG(INFO) << "LTR recovery timeout, request keyframe";
+        request_i_frame_ = true;
+        return;
+    }
+    LOG(INFO) << "Request recovery from LTR " << request->ltr_picture_id;
+    auto msg = std::make_shared<ltproto::client2worker::RequestLtrRecovery>();
+    msg->set_ltr_picture_id(request->ltr_picture_id);
+    send_message_to_host_(ltproto::id(msg), msg, true);
+}
+
 bool VDRPipeline::waitForRender(std::chrono::microseconds ms) {
     std::unique_lock<std::mutex> lock(render_mtx_);
     bool ret = waiting_for_render_.wait_for(
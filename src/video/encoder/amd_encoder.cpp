@@ -159,6 +159,7 @@ private:
     amf::AMFComponentPtr encoder_ = nullptr;
     AMF_RESULT last_submit_error_ = AMF_OK;
     AmfParamsHelper params_;
+    VideoFramePool frame_pool_ = makeVideoFramePool();
 };
 
 AmdEncoderImpl::AmdEncoderImpl(const EncodeParamsHelper& params)
@@ -299,7 +300,7 @@ AmdEncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
         return nullptr;
     }
     amf::AMFBufferPtr buffer{outdata};
-    auto out_frame = std::make_shared<ltproto::client2worker::VideoFrame>();
+    auto out_frame = frame_pool_.get();
     out_frame->set_is_keyframe(isKeyFrame(outdata));
     out_frame->set_frame(buffer->GetNative(), static_cast<uint32_t>(buffer->GetSize()));
     return out_frame;
@@ -275,6 +275,7 @@ private:
     mfxExtCodingOption enc_coding_opt_{};
     std::vector<mfxExtBuffer*> enc_ext_buffers_;
     VplParamsHelper params_;
+    VideoFramePool frame_pool_ = makeVideoFramePool();
 };
 
 IntelEncoderImpl::IntelEncoderImpl(const EncodeParamsHelper& params)
@@ -442,7 +443,7 @@ IntelEncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
         }
     }
     bool is_keyframe = (bs.FrameType & MFX_FRAMETYPE_I) || (bs.FrameType & MFX_FRAMETYPE_IDR);
-    auto out_frame = std::make_shared<ltproto::client2worker::VideoFrame>();
+    auto out_frame = frame_pool_.get();
     out_frame->set_frame(bitstream_.data(), bs.DataLength);
     out_frame->set_is_keyframe(is_keyframe);
     return out_frame;
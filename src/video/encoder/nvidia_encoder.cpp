@@ -186,6 +186,7 @@ private:
     };
     std::vector<EncodeResource> resources_;
     NvEncParamsHelper params_;
+    VideoFramePool frame_pool_ = makeVideoFramePool();
 };
 
 NvD3d11EncoderImpl::NvD3d11EncoderImpl(const EncodeParamsHelper& params)
@@ -333,7 +334,7 @@ NvD3d11EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
         LOG(ERR) << "nvEncLockBitstream failed with " << status;
         return nullptr;
     }
-    auto out_frame = std::make_shared<ltproto::client2worker::VideoFrame>();
+    auto out_frame = frame_pool_.get();
     out_frame->set_frame(lbs.bitstreamBufferPtr, lbs.bitstreamSizeInBytes);
     status = nvfuncs_.nvEncUnlockBitstream(nvencoder_, lbs.outputBitstream);
     if (status != NV_ENC_SUCCESS) {
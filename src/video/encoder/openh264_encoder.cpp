@@ -30,31 +30,58 @@
 
 #include "openh264_encoder.h"
 
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <thread>
+
 #include <wels/codec_api.h>
 
 #include <ltlib/load_library.h>
 #include <ltlib/logging.h>
 #include <ltlib/times.h>
+#include <video/h264/h264_parser.h>
 
 namespace {
 
 constexpr int kMaxFPS = 30;
+// OpenH264编码器最多4个线程(MAX_THREADS_NUM)
+constexpr uint32_t kMaxThreads = 4;
+// 固定slice数时的上限(MAX_SLICES_NUM_TMP)
+constexpr uint32_t kMaxSlices = 35;
+// CAMERA_VIDEO_REAL_TIME下LTR的上限(LONG_TERM_REF_NUM)
+constexpr uint32_t kMaxLtr = 2;
+// 时域分层数的上限(MAX_TEMPORAL_LAYER_NUM)
+constexpr uint32_t kMaxTemporalLayers = 4;
+// OpenH264输出的NAL都带4字节起始码
+constexpr size_t kStartCodeSize = 4;
+constexpr uint8_t kNalIdrSlice = 5;
+constexpr uint8_t kNalPrefix = 14;
 
 class OpenH264ParamsHelper {
 public:
     OpenH264ParamsHelper(const lt::video::EncodeParamsHelper& params)
-        : params_{params} {}
+        : params_{params}
+        , width_{params.width()}
+        , height_{params.height()} {}
 
     int fps() const { return std::min(params_.fps(), kMaxFPS); }
-    uint32_t width() const { return params_.width(); }
-    uint32_t height() const { return params_.height(); }
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
     uint32_t bitrate() const { return params_.bitrate(); }
     uint32_t maxbitrate() const { return params_.maxbitrate(); }
     void set_bitrate(uint32_t bps) { params_.set_bitrate(bps); }
     void set_fps(int f) { params_.set_fps(f); }
+    void set_resolution(uint32_t w, uint32_t h) {
+        width_ = w;
+        height_ = h;
+    }
 
 private:
     lt::video::EncodeParamsHelper params_;
+    // EncodeParamsHelper的分辨率是创建时定死的, 换分辨率时只改这里
+    uint32_t width_;
+    uint32_t height_;
 };
 } // namespace
 
@@ -64,17 +91,25 @@ namespace video {
 
 class OpenH264EncoderImpl {
 public:
-    OpenH264EncoderImpl(const EncodeParamsHelper& params);
+    OpenH264EncoderImpl(const EncodeParamsHelper& params, const OpenH264Encoder::Options& options);
     ~OpenH264EncoderImpl();
     bool init();
     void reconfigure(const Encoder::ReconfigureParams& params);
+    bool changeResolution(uint32_t width, uint32_t height);
     uint32_t width() const { return params_.width(); }
     uint32_t height() const { return params_.height(); }
-    std::shared_ptr<ltproto::client2worker::VideoFrame> encodeOneFrame(void* input_frame,
-                                                                       bool request_iframe);
+    uint32_t threads() const { return options_.threads; }
+    OpenH264Encoder::SliceMode sliceMode() const { return options_.slice_mode; }
+    bool ltrEnabled() const { return options_.ltr; }
+    void onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success);
+    bool requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num,
+                            uint32_t current_frame_num);
+    std::shared_ptr<ltproto::client2worker::VideoFrame>
+    encodeOneFrame(void* input_frame, bool request_iframe);
 
 private:
     bool loadApi();
+    void resolveOptions();
     void generateEncodeParams(const OpenH264ParamsHelper& helper, SEncParamExt& params);
 
 private:
@@ -86,11 +121,15 @@ private:
     decltype(&WelsDestroySVCEncoder) destroy_encoder_ = nullptr;
     bool encoder_init_success_ = false;
     OpenH264ParamsHelper params_;
+    OpenH264Encoder::Options options_;
+    VideoFramePool frame_pool_ = makeVideoFramePool();
 };
 
-OpenH264EncoderImpl::OpenH264EncoderImpl(const EncodeParamsHelper& params)
+OpenH264EncoderImpl::OpenH264EncoderImpl(const EncodeParamsHelper& params,
+                                         const OpenH264Encoder::Options& options)
     : codec_type_{params.codec()}
-    , params_{params} {}
+    , params_{params}
+    , options_{options} {}
 
 OpenH264EncoderImpl::~OpenH264EncoderImpl() {
     if (encoder_ != nullptr) {
@@ -120,12 +159,20 @@ bool OpenH264EncoderImpl::init() {
         LOG(ERR) << "ISVCEncoder::GetDefaultParams failed " << ret;
         return false;
     }
+    resolveOptions();
     generateEncodeParams(params_, init_params_);
     ret = encoder_->InitializeExt(&init_params_);
     if (ret != 0) {
         LOG(ERR) << "ISVCEncoder::InitializeExt failed " << ret;
         return false;
     }
+    LOGF(INFO,
+         "OpenH264 encoder %ux%u, threads:%u, slice mode:%d, slices:%u, max slice bytes:%u, "
+         "ltr:%u, ltr mark period:%u, temporal layers:%u",
+         params_.width(), params_.height(), options_.threads,
+         static_cast<int>(options_.slice_mode), options_.slice_count, options_.max_slice_bytes,
+         options_.ltr ? options_.ltr_count : 0u, options_.ltr_mark_period,
+         options_.temporal_layers);
     encoder_init_success_ = true;
     int option = EVideoFormatType::videoFormatI420;
     ret = encoder_->SetOption(ENCODER_OPTION_DATAFORMAT, &option);
@@ -160,6 +207,62 @@ void OpenH264EncoderImpl::reconfigure(const Encoder::ReconfigureParams& params)
     }
 }
 
+bool OpenH264EncoderImpl::changeResolution(uint32_t width, uint32_t height) {
+    OpenH264ParamsHelper helper = params_;
+    helper.set_resolution(width, height);
+    SEncParamExt params = init_params_;
+    generateEncodeParams(helper, params);
+    // 分辨率变了OpenH264会在内部重新初始化, 线程, slice和LTR的设置不变,
+    // 下一帧是带新SPS/PPS的IDR
+    int ret = encoder_->SetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, &params);
+    if (ret != 0) {
+        LOGF(ERR, "ISVCEncoder::SetOption(ENCODER_OPTION_SVC_ENCODE_PARAM_EXT, %ux%u) failed %d",
+             width, height, ret);
+        return false;
+    }
+    int option = EVideoFormatType::videoFormatI420;
+    ret = encoder_->SetOption(ENCODER_OPTION_DATAFORMAT, &option);
+    if (ret != 0) {
+        LOG(ERR) << "ISVCEncoder::SetOption(ENCODER_OPTION_DATAFORMAT, videoFormatI420) failed "
+                 << ret;
+        return false;
+    }
+    LOGF(INFO, "OpenH264 encoder resolution changed from %ux%u to %ux%u", params_.width(),
+         params_.height(), width, height);
+    params_.set_resolution(width, height);
+    init_params_ = params;
+    return true;
+}
+
+void OpenH264EncoderImpl::onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success) {
+    SLTRMarkingFeedback feedback{};
+    feedback.uiFeedbackType = success ? LTR_MARKING_SUCCESS : LTR_MARKING_FAILED;
+    feedback.uiIDRPicId = idr_pic_id;
+    feedback.iLTRFrameNum = static_cast<int>(frame_num);
+    feedback.iLayerId = 0;
+    int ret = encoder_->SetOption(ENCODER_LTR_MARKING_FEEDBACK, &feedback);
+    if (ret != 0) {
+        LOG(ERR) << "ISVCEncoder::SetOption(ENCODER_LTR_MARKING_FEEDBACK) failed " << ret;
+    }
+}
+
+bool OpenH264EncoderImpl::requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num,
+                                             uint32_t current_frame_num) {
+    // 编码器会挑一个frame_num不大于iLastCorrectFrameNum的已确认LTR来参考, 没有的话自己编IDR
+    SLTRRecoverRequest request{};
+    request.uiFeedbackType = LTR_RECOVERY_REQUEST;
+    request.uiIDRPicId = idr_pic_id;
+    request.iLastCorrectFrameNum = static_cast<int>(ltr_frame_num);
+    request.iCurrentFrameNum = static_cast<int>(current_frame_num);
+    request.iLayerId = 0;
+    int ret = encoder_->SetOption(ENCODER_LTR_RECOVERY_REQUEST, &request);
+    if (ret != 0) {
+        LOG(ERR) << "ISVCEncoder::SetOption(ENCODER_LTR_RECOVERY_REQUEST) failed " << ret;
+        return false;
+    }
+    return true;
+}
+
 std::shared_ptr<ltproto::client2worker::VideoFrame>
 OpenH264EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
     SSourcePicture src{};
@@ -185,7 +288,7 @@ OpenH264EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
         LOG(ERR) << "ISVCEncoder::EncodeFrame failed " << ret;
         return nullptr;
     }
-    auto out_frame = std::make_shared<ltproto::client2worker::VideoFrame>();
+    auto out_frame = frame_pool_.get();
     switch (info.eFrameType) {
     case EVideoFrameType::videoFrameTypeIDR:
     case EVideoFrameType::videoFrameTypeI:
@@ -202,6 +305,8 @@ OpenH264EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
                  << (int)info.eFrameType;
         return nullptr;
     }
+    // 单空间层的AVC码流里没有temporal_id, 分层时在每个VCL层的第一个slice前面补一个前缀NAL
+    std::array<std::optional<H264PrefixNal>, MAX_LAYER_NUM_OF_FRAME> prefixes;
     // credit: WebRTC
     size_t required_capacity = 0;
     size_t fragments_count = 0;
@@ -210,9 +315,22 @@ OpenH264EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
         for (int nal = 0; nal < layerInfo.iNalCount; ++nal, ++fragments_count) {
             required_capacity += layerInfo.pNalLengthInByte[nal];
         }
+        if (options_.temporal_layers > 1 && layerInfo.uiLayerType == VIDEO_CODING_LAYER &&
+            layerInfo.iNalCount > 0 &&
+            static_cast<size_t>(layerInfo.pNalLengthInByte[0]) > kStartCodeSize) {
+            const uint8_t nal_header = layerInfo.pBsBuf[kStartCodeSize];
+            const auto nal_type = static_cast<uint8_t>(nal_header & 0x1f);
+            if (nal_type != kNalPrefix) {
+                prefixes[layer] = makeH264PrefixNal(
+                    layerInfo.uiTemporalId, static_cast<uint8_t>((nal_header >> 5) & 0x03),
+                    nal_type == kNalIdrSlice);
+                required_capacity += prefixes[layer]->size();
+            }
+        }
     }
-    std::vector<uint8_t> buff;
-    buff.resize(required_capacity);
+    // 直接拷进消息里, 池子里的消息保留着上次的容量
+    std::string* bitstream = out_frame->mutable_frame();
+    bitstream->resize(required_capacity);
     size_t copied = 0;
     for (int layer = 0; layer < info.iLayerNum; ++layer) {
         const SLayerBSInfo& layerInfo = info.sLayerInfo[layer];
@@ -221,16 +339,25 @@ OpenH264EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
         for (int nal = 0; nal < layerInfo.iNalCount; ++nal) {
             layer_len += layerInfo.pNalLengthInByte[nal];
         }
+        if (prefixes[layer].has_value()) {
+            const H264PrefixNal& prefix = prefixes[layer].value();
+            memcpy(bitstream->data() + copied, prefix.data(), prefix.size());
+            copied += prefix.size();
+        }
         // Copy the entire layer's data (including start codes).
-        memcpy(buff.data() + copied, layerInfo.pBsBuf, layer_len);
+        memcpy(bitstream->data() + copied, layerInfo.pBsBuf, layer_len);
         copied += layer_len;
     }
-    out_frame->set_frame(buff.data(), copied);
     return out_frame;
 }
 
 bool OpenH264EncoderImpl::loadApi() {
+#if defined(LT_WINDOWS)
     const std::string kLibName = "openh264-2.4.0-win64.dll";
+#else  // defined(LT_WINDOWS)
+    // 结构体的布局跟着版本变, 要加载和编译时的头文件同一个包里的库
+    const std::string kLibName = "libopenh264.so";
+#endif // defined(LT_WINDOWS)
     openh264_lib_ = ltlib::DynamicLibrary::load(kLibName);
     if (openh264_lib_ == nullptr) {
         LOG(ERR) << "Load library " << kLibName << " failed";
@@ -251,6 +378,40 @@ bool OpenH264EncoderImpl::loadApi() {
     return true;
 }
 
+void OpenH264EncoderImpl::resolveOptions() {
+    using SliceMode = OpenH264Encoder::SliceMode;
+    if (options_.threads == 0) {
+        // 抓屏和颜色转换也要CPU, 留一半的核
+        options_.threads = std::clamp(std::thread::hardware_concurrency() / 2, 1u, kMaxThreads);
+    }
+    options_.threads = std::clamp(options_.threads, 1u, kMaxThreads);
+    switch (options_.slice_mode) {
+    case SliceMode::Single:
+        // 一个slice没法拆给多个线程
+        options_.threads = 1;
+        options_.slice_count = 1;
+        break;
+    case SliceMode::Fixed:
+        if (options_.slice_count == 0) {
+            options_.slice_count = options_.threads;
+        }
+        options_.slice_count = std::clamp(options_.slice_count, 1u, kMaxSlices);
+        break;
+    case SliceMode::SizeLimited:
+        // 小于这个值OpenH264会拒绝初始化
+        options_.max_slice_bytes = std::max(options_.max_slice_bytes, 500u);
+        options_.slice_count = 0;
+        break;
+    default:
+        break;
+    }
+    if (options_.ltr) {
+        options_.ltr_count = std::clamp(options_.ltr_count, 1u, kMaxLtr);
+        options_.ltr_mark_period = std::max(options_.ltr_mark_period, 1u);
+    }
+    options_.temporal_layers = std::clamp(options_.temporal_layers, 1u, kMaxTemporalLayers);
+}
+
 void OpenH264EncoderImpl::generateEncodeParams(const OpenH264ParamsHelper& helper,
                                                SEncParamExt& params) {
     params.iPicWidth = helper.width();
@@ -263,21 +424,50 @@ void OpenH264EncoderImpl::generateEncodeParams(const OpenH264ParamsHelper& helpe
     params.bEnableFrameSkip = false;
     params.uiIntraPeriod = 0;
     params.uiMaxNalSize = 0;
-    params.iMultipleThreadIdc = 1;
-    params.iTemporalLayerNum = 1;
-    params.iNumRefFrame = 1;
+    params.iMultipleThreadIdc = static_cast<unsigned short>(options_.threads);
+    params.iTemporalLayerNum = static_cast<int>(options_.temporal_layers);
+    // 和OpenH264按GOP(2^(层数-1)帧)算出来的短期参考帧数一致
+    const int short_term_refs = std::max(1, (1 << (options_.temporal_layers - 1)) / 2);
+    params.iNumRefFrame = short_term_refs;
+    params.bEnableLongTermReference = options_.ltr;
+    if (options_.ltr) {
+        params.iLTRRefNum = static_cast<int>(options_.ltr_count);
+        params.iLtrMarkPeriod = options_.ltr_mark_period;
+        // 除了LTR还要留短期参考帧
+        params.iNumRefFrame = static_cast<int>(options_.ltr_count) + short_term_refs;
+    }
     params.sSpatialLayers[0].iVideoWidth = params.iPicWidth;
     params.sSpatialLayers[0].iVideoHeight = params.iPicHeight;
     params.sSpatialLayers[0].fFrameRate = params.fMaxFrameRate;
     params.sSpatialLayers[0].iSpatialBitrate = params.iTargetBitrate;
     params.sSpatialLayers[0].iMaxSpatialBitrate = params.iMaxBitrate;
-    params.sSpatialLayers[0].sSliceArgument.uiSliceNum = 1;
-    params.sSpatialLayers[0].sSliceArgument.uiSliceMode = SM_SINGLE_SLICE;
+    SSliceArgument& slice = params.sSpatialLayers[0].sSliceArgument;
+    switch (options_.slice_mode) {
+    case OpenH264Encoder::SliceMode::Fixed:
+        slice.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+        slice.uiSliceNum = options_.slice_count;
+        break;
+    case OpenH264Encoder::SliceMode::SizeLimited:
+        slice.uiSliceMode = SM_SIZELIMITED_SLICE;
+        slice.uiSliceSizeConstraint = options_.max_slice_bytes;
+        params.uiMaxNalSize = options_.max_slice_bytes;
+        break;
+    case OpenH264Encoder::SliceMode::Single:
+    default:
+        slice.uiSliceMode = SM_SINGLE_SLICE;
+        slice.uiSliceNum = 1;
+        break;
+    }
 }
 
 std::unique_ptr<OpenH264Encoder> OpenH264Encoder::create(const EncodeParamsHelper& params) {
+    return create(params, Options{});
+}
+
+std::unique_ptr<OpenH264Encoder> OpenH264Encoder::create(const EncodeParamsHelper& params,
+                                                         const Options& options) {
     auto encoder = std::make_unique<OpenH264Encoder>();
-    auto impl = std::make_shared<OpenH264EncoderImpl>(params);
+    auto impl = std::make_shared<OpenH264EncoderImpl>(params, options);
     if (!impl->init()) {
         return nullptr;
     }
@@ -289,6 +479,14 @@ void OpenH264Encoder::reconfigure(const ReconfigureParams& params) {
     impl_->reconfigure(params);
 }
 
+bool OpenH264Encoder::changeResolution(uint32_t width, uint32_t height) {
+    if (!impl_->changeResolution(width, height)) {
+        return false;
+    }
+    requestKeyframe();
+    return true;
+}
+
 CaptureFormat OpenH264Encoder::captureFormat() const {
     return CaptureFormat::MEM_I420;
 }
@@ -305,6 +503,30 @@ uint32_t OpenH264Encoder::height() const {
     return impl_->height();
 }
 
+uint32_t OpenH264Encoder::threads() const {
+    return impl_->threads();
+}
+
+OpenH264Encoder::SliceMode OpenH264Encoder::sliceMode() const {
+    return impl_->sliceMode();
+}
+
+bool OpenH264Encoder::ltrEnabled() const {
+    return impl_->ltrEnabled();
+}
+
+void OpenH264Encoder::onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success) {
+    impl_->onLtrMarked(idr_pic_id, frame_num, success);
+}
+
+void OpenH264Encoder::requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num,
+                                         uint32_t current_frame_num) {
+    if (!impl_->ltrEnabled() ||
+        !impl_->requestLtrRecovery(idr_pic_id, ltr_frame_num, current_frame_num)) {
+        requestKeyframe();
+    }
+}
+
 std::shared_ptr<ltproto::client2worker::VideoFrame>
 OpenH264Encoder::encodeFrame(void* input_frame) {
     return impl_->encodeOneFrame(input_frame, needKeyframe());
@@ -41,16 +41,52 @@ namespace video {
 
 class OpenH264EncoderImpl;
 class OpenH264Encoder : public Encoder {
+public:
+    enum class SliceMode {
+        // 一帧一个slice, 只能单线程编码
+        Single,
+        // 按宏块行分成slice_count个slice, 分给多个线程编码
+        Fixed,
+        // 每个slice尽量不超过max_slice_bytes. 只是限制NAL的大小, 整帧编完才一起输出
+        SizeLimited,
+    };
+    // 默认和以前一样: 单线程, 一帧一个slice, 不开LTR, 不分层. 其它的都要调用方显式打开
+    struct Options {
+        // 0表示用一半的核
+        uint32_t threads = 1;
+        SliceMode slice_mode = SliceMode::Single;
+        // Fixed时的slice数, 0表示和线程数一样
+        uint32_t slice_count = 0;
+        // SizeLimited时每个slice的上限
+        uint32_t max_slice_bytes = 1200;
+        // 长期参考帧, 客户端解码出错时参考最后一个确认过的LTR编P帧, 不用发IDR
+        bool ltr = false;
+        uint32_t ltr_count = 2;
+        // 隔多少帧标记一个LTR
+        uint32_t ltr_mark_period = 30;
+        // 时域分层数, 大于1时每帧的层号写在slice前面的前缀NAL(类型14)里. 拥塞时传输层先丢
+        // 最高层, 2层时丢掉一半的帧, 剩下的照样能解码
+        uint32_t temporal_layers = 1;
+    };
+
 public:
     static std::unique_ptr<OpenH264Encoder> create(const EncodeParamsHelper& params);
+    static std::unique_ptr<OpenH264Encoder> create(const EncodeParamsHelper& params,
+                                                   const Options& options);
     ~OpenH264Encoder() override = default;
 
-
     void reconfigure(const ReconfigureParams& params) override;
+    bool changeResolution(uint32_t width, uint32_t height) override;
     CaptureFormat captureFormat() const override;
     VideoCodecType codecType() const override;
     uint32_t width() const override;
     uint32_t height() const override;
+    uint32_t threads() const;
+    SliceMode sliceMode() const;
+    bool ltrEnabled() const override;
+    void onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success) override;
+    void requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num,
+                            uint32_t current_frame_num) override;
     std::shared_ptr<ltproto::client2worker::VideoFrame> encodeFrame(void* input_frame) override;
 
 private:
@@ -0,0 +1,400 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ltlib/times.h>
+#include <video/capturer/synthetic_video_capturer.h>
+#include <video/decoder/openh264_decoder.h>
+#include <video/drpipeline/ltr_tracker.h>
+#include <video/h264/h264_parser.h>
+
+#include "openh264_encoder.h"
+
+using lt::video::EncodeParamsHelper;
+using lt::video::H264RefParser;
+using lt::video::LtrTracker;
+using lt::video::OpenH264Decoder;
+using lt::video::OpenH264Encoder;
+using lt::video::SyntheticVideoCapturer;
+
+namespace {
+
+constexpr uint32_t kWidth = 1920;
+constexpr uint32_t kHeight = 1080;
+
+std::unique_ptr<OpenH264Encoder> makeEncoder(uint32_t threads, OpenH264Encoder::SliceMode mode,
+                                             uint32_t slice_count = 0) {
+    EncodeParamsHelper params{nullptr, nullptr,   -1,        lt::VideoCodecType::H264_420_SOFT,
+                              kWidth,  kHeight,   30,        8'000'000, true};
+    OpenH264Encoder::Options options{};
+    options.threads = threads;
+    options.slice_mode = mode;
+    options.slice_count = slice_count;
+    return OpenH264Encoder::create(params, options);
+}
+
+std::unique_ptr<SyntheticVideoCapturer> makeCapturer(SyntheticVideoCapturer::Pattern pattern) {
+    SyntheticVideoCapturer::Params params{};
+    params.width = kWidth;
+    params.height = kHeight;
+    params.fps = 0;
+    params.pattern = pattern;
+    params.cursor = false;
+    auto capturer = SyntheticVideoCapturer::create(params);
+    if (capturer != nullptr) {
+        capturer->start();
+    }
+    return capturer;
+}
+
+// 码流里每个slice NAL的大小(带起始码). OpenH264只输出4字节的起始码
+std::vector<uint32_t> sliceSizes(const std::string& bitstream) {
+    constexpr uint8_t kStartCode[] = {0, 0, 0, 1};
+    constexpr size_t kStartCodeSize = sizeof(kStartCode);
+    std::vector<size_t> starts;
+    for (size_t pos = bitstream.find(reinterpret_cast<const char*>(kStartCode), 0, kStartCodeSize);
+         pos != std::string::npos;
+         pos = bitstream.find(reinterpret_cast<const char*>(kStartCode), pos + kStartCodeSize,
+                              kStartCodeSize)) {
+        starts.push_back(pos);
+    }
+    std::vector<uint32_t> sizes;
+    for (size_t i = 0; i < starts.size(); i++) {
+        const size_t end = i + 1 < starts.size() ? starts[i + 1] : bitstream.size();
+        if (end <= starts[i] + kStartCodeSize) {
+            continue;
+        }
+        const uint8_t nal_type = static_cast<uint8_t>(bitstream[starts[i] + kStartCodeSize]) & 0x1f;
+        // 1: 非IDR slice, 5: IDR slice
+        if (nal_type == 1 || nal_type == 5) {
+            sizes.push_back(static_cast<uint32_t>(end - starts[i]));
+        }
+    }
+    return sizes;
+}
+
+// 跳过第一个关键帧, 统计后面P帧的平均编码耗时
+double benchEncodeMs(OpenH264Encoder& encoder, SyntheticVideoCapturer& capturer, int frames) {
+    double encode_ms = 0;
+    for (int i = 0; i <= frames; i++) {
+        auto frame = capturer.capture();
+        if (!frame.has_value()) {
+            return 0;
+        }
+        const int64_t start_us = ltlib::steady_now_us();
+        auto encoded = encoder.encode(frame.value());
+        const int64_t encode_us = ltlib::steady_now_us() - start_us;
+        capturer.doneWithFrame();
+        if (encoded == nullptr || i == 0) {
+            continue;
+        }
+        encode_ms += encode_us / 1000.0 / frames;
+    }
+    return encode_ms;
+}
+
+} // namespace
+
+// 不传Options时和以前的编码器一样: 单线程单slice, 没有LTR, 码流里没有前缀NAL
+TEST(OpenH264EncoderTest, DefaultOptions) {
+    EncodeParamsHelper params{nullptr, nullptr,   -1,        lt::VideoCodecType::H264_420_SOFT,
+                              kWidth,  kHeight,   30,        8'000'000, true};
+    auto encoder = OpenH264Encoder::create(params);
+    if (encoder == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    EXPECT_EQ(encoder->threads(), 1u);
+    EXPECT_EQ(encoder->sliceMode(), OpenH264Encoder::SliceMode::Single);
+    EXPECT_FALSE(encoder->ltrEnabled());
+    auto capturer = makeCapturer(SyntheticVideoCapturer::Pattern::ScrollingText);
+    ASSERT_NE(capturer, nullptr);
+    for (int i = 0; i < 5; i++) {
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        auto encoded = encoder->encode(frame.value());
+        capturer->doneWithFrame();
+        ASSERT_NE(encoded, nullptr);
+        const std::string& bitstream = encoded->frame();
+        EXPECT_FALSE(lt::video::parseH264TemporalId(
+                         reinterpret_cast<const uint8_t*>(bitstream.data()), bitstream.size())
+                         .has_value())
+            << "frame " << i;
+        EXPECT_EQ(sliceSizes(bitstream).size(), 1u) << "frame " << i;
+    }
+}
+
+TEST(OpenH264EncoderTest, FixedSlices) {
+    auto encoder = makeEncoder(4, OpenH264Encoder::SliceMode::Fixed, 4);
+    if (encoder == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    auto capturer = makeCapturer(SyntheticVideoCapturer::Pattern::ScrollingText);
+    ASSERT_NE(capturer, nullptr);
+    EXPECT_GE(encoder->threads(), 1u);
+    for (int i = 0; i < 5; i++) {
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        auto encoded = encoder->encode(frame.value());
+        capturer->doneWithFrame();
+        ASSERT_NE(encoded, nullptr);
+        if (!encoded->is_keyframe()) {
+            EXPECT_EQ(sliceSizes(encoded->frame()).size(), 4u) << "frame " << i;
+        }
+    }
+}
+
+TEST(OpenH264EncoderTest, SizeLimitedSlices) {
+    auto encoder = makeEncoder(2, OpenH264Encoder::SliceMode::SizeLimited);
+    if (encoder == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    auto capturer = makeCapturer(SyntheticVideoCapturer::Pattern::ScrollingText);
+    ASSERT_NE(capturer, nullptr);
+    std::vector<uint32_t> sizes;
+    for (int i = 0; i < 5; i++) {
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        auto encoded = encoder->encode(frame.value());
+        capturer->doneWithFrame();
+        ASSERT_NE(encoded, nullptr);
+        auto frame_sizes = sliceSizes(encoded->frame());
+        sizes.insert(sizes.end(), frame_sizes.begin(), frame_sizes.end());
+    }
+    ASSERT_GT(sizes.size(), 5u);
+    // 宏块是整个放进slice的, 允许稍微超出一点
+    for (auto size : sizes) {
+        EXPECT_LT(size, OpenH264Encoder::Options{}.max_slice_bytes * 3 / 2);
+    }
+}
+
+TEST(OpenH264EncoderTest, SingleSliceIsSingleThreaded) {
+    auto encoder = makeEncoder(4, OpenH264Encoder::SliceMode::Single);
+    if (encoder == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    EXPECT_EQ(encoder->threads(), 1u);
+    EXPECT_EQ(encoder->sliceMode(), OpenH264Encoder::SliceMode::Single);
+}
+
+// 1080p下不同线程数和slice模式的编码耗时
+TEST(OpenH264EncoderTest, ThreadScaling) {
+    if (makeEncoder(1, OpenH264Encoder::SliceMode::Single) == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    constexpr int kFrames = 60;
+    const struct {
+        const char* name;
+        SyntheticVideoCapturer::Pattern pattern;
+    } contents[] = {
+        {"scrolling_text", SyntheticVideoCapturer::Pattern::ScrollingText},
+        {"noise", SyntheticVideoCapturer::Pattern::Noise},
+    };
+    const struct {
+        const char* name;
+        OpenH264Encoder::SliceMode mode;
+    } modes[] = {
+        {"single", OpenH264Encoder::SliceMode::Single},
+        {"fixed", OpenH264Encoder::SliceMode::Fixed},
+        {"size_limited", OpenH264Encoder::SliceMode::SizeLimited},
+    };
+    printf("%-16s %-14s %8s %12s\n", "content", "mode", "threads", "encode(ms)");
+    for (auto& content : contents) {
+        for (auto& mode : modes) {
+            for (uint32_t threads : {1u, 2u, 4u}) {
+                if (mode.mode == OpenH264Encoder::SliceMode::Single && threads != 1) {
+                    continue;
+                }
+                auto encoder = makeEncoder(threads, mode.mode);
+                auto capturer = makeCapturer(content.pattern);
+                ASSERT_NE(encoder, nullptr);
+                ASSERT_NE(capturer, nullptr);
+                const double encode_ms = benchEncodeMs(*encoder, *capturer, kFrames);
+                printf("%-16s %-14s %8u %12.2f\n", content.name, mode.name, encoder->threads(),
+                       encode_ms);
+            }
+        }
+    }
+}
+
+// 确认过的LTR收到恢复请求后, 下一帧是参考LTR的P帧而不是IDR
+TEST(OpenH264EncoderTest, LtrRecovery) {
+    EncodeParamsHelper params{nullptr, nullptr,   -1,        lt::VideoCodecType::H264_420_SOFT,
+                              kWidth,  kHeight,   30,        8'000'000, true};
+    OpenH264Encoder::Options options{};
+    options.ltr = true;
+    options.ltr_mark_period = 10;
+    auto encoder = OpenH264Encoder::create(params, options);
+    if (encoder == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    ASSERT_TRUE(encoder->ltrEnabled());
+    auto capturer = makeCapturer(SyntheticVideoCapturer::Pattern::ScrollingText);
+    ASSERT_NE(capturer, nullptr);
+    H264RefParser parser;
+    auto encode = [&]() {
+        auto frame = capturer->capture();
+        EXPECT_TRUE(frame.has_value());
+        auto encoded = encoder->encode(frame.value());
+        capturer->doneWithFrame();
+        EXPECT_NE(encoded, nullptr);
+        const std::string& bitstream = encoded->frame();
+        auto info =
+            parser.parse(reinterpret_cast<const uint8_t*>(bitstream.data()), bitstream.size());
+        EXPECT_TRUE(info.has_value());
+        return std::make_pair(info.value_or(lt::video::H264RefInfo{}), bitstream.size());
+    };
+    std::optional<lt::video::H264RefInfo> ltr;
+    uint32_t p_frame_size = 0;
+    uint32_t last_frame_num = 0;
+    for (int i = 0; i < 40; i++) {
+        auto [info, size] = encode();
+        last_frame_num = info.frame_num;
+        p_frame_size = static_cast<uint32_t>(size);
+        if (info.long_term_mark) {
+            ltr = info;
+            encoder->onLtrMarked(info.idr_pic_id, info.frame_num, true);
+        }
+    }
+    ASSERT_TRUE(ltr.has_value());
+    encoder->requestLtrRecovery(ltr->idr_pic_id, ltr->frame_num, last_frame_num);
+    auto [info, size] = encode();
+    EXPECT_FALSE(info.idr);
+    EXPECT_TRUE(info.refs_long_term);
+    printf("p frame %u bytes, ltr recovery frame %zu bytes\n", p_frame_size, size);
+
+    encoder->requestKeyframe();
+    EXPECT_TRUE(encode().first.idr);
+}
+
+// 丢掉高层的帧之后剩下的码流用OpenH264解码, 不能有任何解码错误. 客户端的LtrTracker只看码流,
+// 要认出这些缺的帧没有人参考, 而真的丢了一个基本层帧时要认出来
+TEST(OpenH264EncoderTest, TemporalLayerDrop) {
+    constexpr uint32_t kFrames = 64;
+    for (uint32_t layers : {2u, 3u}) {
+        EncodeParamsHelper params{nullptr, nullptr,   -1,        lt::VideoCodecType::H264_420_SOFT,
+                                  kWidth,  kHeight,   30,        8'000'000, true};
+        OpenH264Encoder::Options options{};
+        options.temporal_layers = layers;
+        options.ltr = true;
+        auto encoder = OpenH264Encoder::create(params, options);
+        if (encoder == nullptr) {
+            GTEST_SKIP() << "OpenH264 not available";
+        }
+        auto capturer = makeCapturer(SyntheticVideoCapturer::Pattern::ScrollingText);
+        ASSERT_NE(capturer, nullptr);
+        std::vector<std::string> bitstreams;
+        std::vector<uint8_t> temporal_ids;
+        for (uint32_t i = 0; i < kFrames; i++) {
+            auto frame = capturer->capture();
+            ASSERT_TRUE(frame.has_value());
+            auto encoded = encoder->encode(frame.value());
+            capturer->doneWithFrame();
+            ASSERT_NE(encoded, nullptr);
+            const std::string& bitstream = encoded->frame();
+            auto temporal_id = lt::video::parseH264TemporalId(
+                reinterpret_cast<const uint8_t*>(bitstream.data()), bitstream.size());
+            ASSERT_TRUE(temporal_id.has_value()) << "frame " << i;
+            ASSERT_LT(temporal_id.value(), layers);
+            EXPECT_EQ(encoded->is_keyframe(), i == 0);
+            bitstreams.push_back(bitstream);
+            temporal_ids.push_back(temporal_id.value());
+        }
+        // 只保留层号小于max_temporal_id的帧, layers表示一帧都不丢
+        for (uint32_t max_temporal_id = 1; max_temporal_id <= layers; max_temporal_id++) {
+            OpenH264Decoder decoder{{lt::VideoCodecType::H264_420_SOFT, kWidth, kHeight, nullptr,
+                                     nullptr, lt::VaType::D3D11}};
+            ASSERT_TRUE(decoder.init());
+            LtrTracker tracker{LtrTracker::Params{}};
+            uint32_t decoded = 0;
+            for (uint32_t i = 0; i < kFrames; i++) {
+                if (temporal_ids[i] >= max_temporal_id) {
+                    continue;
+                }
+                auto data = reinterpret_cast<const uint8_t*>(bitstreams[i].data());
+                auto size = static_cast<uint32_t>(bitstreams[i].size());
+                EXPECT_TRUE(tracker.onFrame(i, data, size, 0))
+                    << "layers " << layers << ", max temporal id " << max_temporal_id
+                    << ", frame " << i;
+                auto result = decoder.decode(data, size);
+                EXPECT_EQ(result.status, lt::video::DecodeStatus::Success2)
+                    << "layers " << layers << ", max temporal id " << max_temporal_id
+                    << ", frame " << i;
+                tracker.onDecoded(i, result.status == lt::video::DecodeStatus::Success2, 0);
+                decoded++;
+            }
+            EXPECT_TRUE(tracker.supported());
+            EXPECT_FALSE(tracker.broken());
+            // 每去掉一层帧率减半
+            EXPECT_EQ(decoded, kFrames >> (layers - max_temporal_id));
+            printf("layers %u, keep temporal id < %u: decoded %u/%u frames\n", layers,
+                   max_temporal_id, decoded, kFrames);
+        }
+        // 丢掉第二个周期开头的基本层帧, 紧跟着的增强层帧就参考它
+        const uint32_t lost = 1u << (layers - 1);
+        ASSERT_EQ(temporal_ids[lost], 0);
+        LtrTracker tracker{LtrTracker::Params{}};
+        for (uint32_t i = 0; i <= lost + 1; i++) {
+            if (i == lost) {
+                continue;
+            }
+            tracker.onFrame(i, reinterpret_cast<const uint8_t*>(bitstreams[i].data()),
+                            bitstreams[i].size(), 0);
+            tracker.onDecoded(i, true, 0);
+        }
+        EXPECT_TRUE(tracker.broken()) << "layers " << layers;
+    }
+}
+
+// 编码中途换分辨率不重建编码器, 新分辨率的第一帧是关键帧, 帧号接着往下走
+TEST(OpenH264EncoderTest, ChangeResolution) {
+    constexpr uint32_t kNewWidth = 1280;
+    constexpr uint32_t kNewHeight = 720;
+    auto encoder = makeEncoder(1, OpenH264Encoder::SliceMode::Single);
+    if (encoder == nullptr) {
+        GTEST_SKIP() << "OpenH264 not available";
+    }
+    auto capturer = makeCapturer(SyntheticVideoCapturer::Pattern::ScrollingText);
+    ASSERT_NE(capturer, nullptr);
+    std::unique_ptr<OpenH264Decoder> decoder;
+    uint32_t decoder_width = 0;
+    std::optional<uint64_t> last_picture_id;
+    for (int i = 0; i < 40; i++) {
+        if (i == 20) {
+            ASSERT_TRUE(capturer->changeResolution(kNewWidth, kNewHeight));
+        }
+        auto frame = capturer->capture();
+        ASSERT_TRUE(frame.has_value());
+        if (frame->width != encoder->width()) {
+            ASSERT_TRUE(encoder->changeResolution(frame->width, frame->height));
+        }
+        auto encoded = encoder->encode(frame.value());
+        capturer->doneWithFrame();
+        ASSERT_NE(encoded, nullptr);
+        const uint32_t width = i < 20 ? kWidth : kNewWidth;
+        EXPECT_EQ(encoded->width(), width);
+        EXPECT_EQ(encoded->is_keyframe(), i == 0 || i == 20) << "frame " << i;
+        if (last_picture_id.has_value()) {
+            EXPECT_EQ(encoded->picture_id(), last_picture_id.value() + 1);
+        }
+        last_picture_id = encoded->picture_id();
+        // 和客户端一样, 拿到新分辨率的关键帧时重建解码器
+        if (encoded->width() != decoder_width) {
+            ASSERT_TRUE(encoded->is_keyframe());
+            decoder_width = encoded->width();
+            decoder = std::make_unique<OpenH264Decoder>(
+                lt::video::Decoder::Params{lt::VideoCodecType::H264_420_SOFT, encoded->width(),
+                                           encoded->height(), nullptr, nullptr, lt::VaType::D3D11});
+            ASSERT_TRUE(decoder->init());
+        }
+        const std::string& bitstream = encoded->frame();
+        auto result = decoder->decode(reinterpret_cast<const uint8_t*>(bitstream.data()),
+                                      static_cast<uint32_t>(bitstream.size()));
+        EXPECT_EQ(result.status, lt::video::DecodeStatus::Success2) << "frame " << i;
+    }
+}
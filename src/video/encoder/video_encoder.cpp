@@ -28,25 +28,28 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#if defined(LT_WINDOWS)
 #include <d3d11_1.h>
 #include <dxgi1_3.h>
 #include <wrl/client.h>
+#endif // defined(LT_WINDOWS)
 
 #include <ltlib/logging.h>
 
 #include <ltlib/strings.h>
 #include <ltlib/times.h>
 
+#if defined(LT_WINDOWS)
 #include "amd_encoder.h"
 #include "intel_encoder.h"
 #include "nvidia_encoder.h"
+#endif // defined(LT_WINDOWS)
+#include "openh264_encoder.h"
 #include "params_helper.h"
 #include "video_encoder.h"
 
+// 硬编只有Windows上有, 其它平台只编OpenH264, 给测试和基准用
 #if defined(LT_WINDOWS)
-#include "openh264_encoder.h"
-#endif // defined(LT_WINDOWS)
-
 using Microsoft::WRL::ComPtr;
 
 namespace {
@@ -207,29 +210,44 @@ std::unique_ptr<lt::video::Encoder> doCreateHard(const lt::video::Encoder::InitP
 }
 
 } // namespace
+#endif // defined(LT_WINDOWS)
 
 namespace lt {
 
 namespace video {
 
 std::unique_ptr<Encoder> Encoder::createHard(const InitParams& params) {
+#if defined(LT_WINDOWS)
     if (!params.validate()) {
         LOG(ERR) << "Create Hard VideoEncoder failed: invalid parameters";
         return nullptr;
     }
     return doCreateHard(params);
+#else  // defined(LT_WINDOWS)
+    (void)params;
+    return nullptr;
+#endif // defined(LT_WINDOWS)
+}
+
+VideoFramePool makeVideoFramePool() {
+    // 管道和发送队列里最多压着几帧
+    constexpr size_t kCapacity = 8;
+    return VideoFramePool{kCapacity,
+                          []() { return std::make_shared<ltproto::client2worker::VideoFrame>(); }};
 }
 
 std::unique_ptr<Encoder> Encoder::createSoft(const InitParams& params) {
-#if defined(LT_WINDOWS)
     EncodeParamsHelper params_helper{params.device,     params.context,     params.luid,
                                      params.codec_type, params.width,       params.height,
                                      params.freq,       params.bitrate_bps, true};
-    return OpenH264Encoder::create(params_helper);
-#else  // defined(LT_WINDOWS)
-    (void)params;
-    return nullptr;
-#endif // defined(LT_WINDOWS)
+    OpenH264Encoder::Options options{};
+    options.threads = params.soft_threads;
+    // 一个slice只能单线程编
+    options.slice_mode = params.soft_threads == 1 ? OpenH264Encoder::SliceMode::Single
+                                                  : OpenH264Encoder::SliceMode::Fixed;
+    options.ltr = params.ltr;
+    options.temporal_layers = params.temporal_layers;
+    return OpenH264Encoder::create(params_helper, options);
 }
 
 bool Encoder::needKeyframe() {
@@ -272,6 +290,35 @@ bool Encoder::doneFrame2() const {
     return false;
 }
 
+bool Encoder::ltrEnabled() const {
+    return false;
+}
+
+void Encoder::onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success) {
+    (void)idr_pic_id;
+    (void)frame_num;
+    (void)success;
+}
+
+void Encoder::requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num,
+                                 uint32_t current_frame_num) {
+    (void)idr_pic_id;
+    (void)ltr_frame_num;
+    (void)current_frame_num;
+    requestKeyframe();
+}
+
+bool Encoder::changeResolution(uint32_t width, uint32_t height) {
+    (void)width;
+    (void)height;
+    return false;
+}
+
+void Encoder::continueFrom(const Encoder& previous) {
+    frame_id_ = previous.frame_id_;
+    first_frame_ = previous.first_frame_;
+}
+
 bool Encoder::InitParams::validate() const {
     if (this->width == 0 || this->height == 0 || this->bitrate_bps == 0 ||
         this->device == nullptr || this->context == nullptr || this->freq == 0 ||
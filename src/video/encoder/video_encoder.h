@@ -38,6 +38,7 @@
 
 #include <ltproto/client2worker/video_frame.pb.h>
 
+#include <ltlib/object_pool.h>
 #include <transport/transport.h>
 #include <video/capturer/video_capturer.h>
 
@@ -45,6 +46,11 @@ namespace lt {
 
 namespace video {
 
+// 编码输出的VideoFrame池, 只在编码线程get(). 发送完被放掉后回到池子, Clear()保留码流字符串
+// 的容量, 稳定状态下编码输出不再分配内存
+using VideoFramePool = ltlib::ObjectPool<ltproto::client2worker::VideoFrame>;
+VideoFramePool makeVideoFramePool();
+
 class Encoder {
 public:
     struct InitParams {
@@ -58,6 +64,10 @@ public:
         uint32_t height = 0;
         uint32_t bitrate_bps = 0;
         uint32_t freq = 0;
+        // 以下只对软编生效, 默认都不开. 线程数0表示用一半的核, 多线程时按线程数切slice
+        uint32_t soft_threads = 1;
+        bool ltr = false;
+        uint32_t temporal_layers = 1;
 
         bool validate() const;
     };
@@ -80,6 +90,16 @@ public:
     std::shared_ptr<ltproto::client2worker::VideoFrame> encode(const Capturer::Frame& input_frame);
     virtual bool doneFrame1() const;
     virtual bool doneFrame2() const;
+    // 长期参考帧(LTR), 目前只有OpenH264支持. 不支持时恢复请求退化成请求关键帧
+    virtual bool ltrEnabled() const;
+    virtual void onLtrMarked(uint32_t idr_pic_id, uint32_t frame_num, bool success);
+    virtual void requestLtrRecovery(uint32_t idr_pic_id, uint32_t ltr_frame_num,
+                                    uint32_t current_frame_num);
+    // 不重建编码器直接换分辨率, 下一帧是新分辨率的关键帧. 目前只有OpenH264支持,
+    // 不支持时返回false, 由调用方用新分辨率重新创建编码器
+    virtual bool changeResolution(uint32_t width, uint32_t height);
+    // 重新创建的编码器接着旧编码器的picture_id往下编, 对端的确认和丢包判断不会乱
+    void continueFrom(const Encoder& previous);
 
     // static std::vector<VideoCodecType> checkSupportedCodecs(uint32_t width, uint32_t height);
     // static std::vector<VideoCodecType> checkSupportedCodecsWithLuid(int64_t luid, uint32_t width,
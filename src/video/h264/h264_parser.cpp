@@ -0,0 +1,464 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "h264_parser.h"
+
+namespace {
+
+constexpr uint8_t kNalSlice = 1;
+constexpr uint8_t kNalIdrSlice = 5;
+constexpr uint8_t kNalSps = 7;
+constexpr uint8_t kNalPps = 8;
+constexpr uint8_t kNalPrefix = 14;
+constexpr uint8_t kNalSliceExtension = 20;
+
+constexpr uint32_t kSliceP = 0;
+constexpr uint32_t kSliceB = 1;
+constexpr uint32_t kSliceI = 2;
+constexpr uint32_t kSliceSP = 3;
+constexpr uint32_t kSliceSI = 4;
+
+constexpr uint32_t kMaxRefIdx = 32;
+// 重排和MMCO的条目数上限, 防止坏数据死循环
+constexpr uint32_t kMaxOperations = 64;
+
+// 从offset开始找下一个起始码, 返回起始码后第一个字节的位置, 找不到返回size
+size_t findStartCode(const uint8_t* data, size_t size, size_t offset) {
+    for (size_t i = offset; i + 2 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            return i + 3;
+        }
+    }
+    return size;
+}
+
+} // namespace
+
+namespace lt {
+
+namespace video {
+
+// 读RBSP, 顺便跳过防竞争字节. 读越界后ok()返回false, 之后读到的都是0
+class H264RefParser::BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size)
+        : data_{data}
+        , size_{size} {}
+
+    bool ok() const { return ok_; }
+
+    uint32_t u(uint32_t bits) {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < bits; i++) {
+            value = (value << 1) | bit();
+        }
+        return value;
+    }
+
+    bool flag() { return bit() != 0; }
+
+    uint32_t ue() {
+        uint32_t zeros = 0;
+        while (bit() == 0) {
+            if (!ok_ || ++zeros > 31) {
+                ok_ = false;
+                return 0;
+            }
+        }
+        if (zeros == 0) {
+            return 0;
+        }
+        return ((1u << zeros) - 1) + u(zeros);
+    }
+
+    int32_t se() {
+        const uint32_t value = ue();
+        return (value & 1) ? static_cast<int32_t>((value + 1) / 2)
+                           : -static_cast<int32_t>(value / 2);
+    }
+
+private:
+    uint32_t bit() {
+        if (bits_left_ == 0 && !loadByte()) {
+            ok_ = false;
+            return 0;
+        }
+        bits_left_--;
+        return (current_ >> bits_left_) & 1;
+    }
+
+    bool loadByte() {
+        if (zeros_ >= 2 && pos_ < size_ && data_[pos_] == 0x03) {
+            pos_++;
+            zeros_ = 0;
+        }
+        if (pos_ >= size_) {
+            return false;
+        }
+        current_ = data_[pos_++];
+        zeros_ = current_ == 0 ? zeros_ + 1 : 0;
+        bits_left_ = 8;
+        return true;
+    }
+
+private:
+    const uint8_t* data_;
+    const size_t size_;
+    size_t pos_ = 0;
+    uint32_t zeros_ = 0;
+    uint8_t current_ = 0;
+    uint32_t bits_left_ = 0;
+    bool ok_ = true;
+};
+
+H264PrefixNal makeH264PrefixNal(uint8_t temporal_id, uint8_t nal_ref_idc, bool idr) {
+    H264PrefixNal nal{0, 0, 0, 1};
+    nal[4] = static_cast<uint8_t>(((nal_ref_idc & 0x03) << 5) | kNalPrefix);
+    // svc_extension_flag=1, idr_flag, priority_id=0
+    nal[5] = static_cast<uint8_t>(0x80 | (idr ? 0x40 : 0));
+    // no_inter_layer_pred_flag=1, dependency_id=0, quality_id=0
+    nal[6] = 0x80;
+    // temporal_id, use_ref_base_pic_flag=0, discardable_flag, output_flag=1,
+    // reserved_three_2bits
+    nal[7] = static_cast<uint8_t>(((temporal_id & 0x07) << 5) | (nal_ref_idc == 0 ? 0x08 : 0) |
+                                  0x04 | 0x03);
+    // prefix_nal_unit_svc(): 参考帧要先写store_ref_base_pic_flag=0和
+    // additional_prefix_nal_unit_extension_flag=0, 然后是rbsp_trailing_bits
+    nal[8] = nal_ref_idc == 0 ? 0x80 : 0x20;
+    return nal;
+}
+
+std::optional<uint8_t> parseH264TemporalId(const uint8_t* data, size_t size) {
+    if (data == nullptr) {
+        return std::nullopt;
+    }
+    size_t begin = findStartCode(data, size, 0);
+    while (begin < size) {
+        const auto nal_type = static_cast<uint8_t>(data[begin] & 0x1f);
+        if (nal_type == kNalSlice || nal_type == kNalIdrSlice) {
+            return std::nullopt;
+        }
+        // svc_extension_flag为1时扩展头第一个字节不为0, 前三个字节里不会有防竞争字节
+        if ((nal_type == kNalPrefix || nal_type == kNalSliceExtension) && begin + 3 < size &&
+            (data[begin + 1] & 0x80) != 0) {
+            return static_cast<uint8_t>(data[begin + 3] >> 5);
+        }
+        begin = findStartCode(data, size, begin);
+    }
+    return std::nullopt;
+}
+
+std::optional<H264RefInfo> H264RefParser::parse(const uint8_t* data, size_t size) {
+    if (data == nullptr) {
+        return std::nullopt;
+    }
+    size_t begin = findStartCode(data, size, 0);
+    while (begin < size) {
+        const uint8_t header = data[begin];
+        const auto nal_ref_idc = static_cast<uint8_t>((header >> 5) & 0x03);
+        const auto nal_type = static_cast<uint8_t>(header & 0x1f);
+        if (nal_type == kNalSlice || nal_type == kNalIdrSlice) {
+            // 只读slice头, 不用扫一遍整个slice去找它的结尾
+            BitReader reader{data + begin + 1, size - begin - 1};
+            return parseSlice(reader, nal_ref_idc, nal_type == kNalIdrSlice);
+        }
+        const size_t next = findStartCode(data, size, begin);
+        // 去掉下一个起始码以及4字节起始码多出来的0
+        size_t end = next == size ? size : next - 3;
+        while (end > begin && data[end - 1] == 0) {
+            end--;
+        }
+        BitReader reader{data + begin + 1, end - begin - 1};
+        if (nal_type == kNalSps) {
+            parseSps(reader);
+        }
+        else if (nal_type == kNalPps) {
+            parsePps(reader);
+        }
+        begin = next;
+    }
+    return std::nullopt;
+}
+
+bool H264RefParser::parseSps(BitReader& reader) {
+    const uint32_t profile_idc = reader.u(8);
+    reader.u(16); // constraint_set_flags, level_idc
+    const uint32_t sps_id = reader.ue();
+    if (sps_id >= sps_.size()) {
+        return false;
+    }
+    Sps sps{};
+    switch (profile_idc) {
+    case 100:
+    case 110:
+    case 122:
+    case 244:
+    case 44:
+    case 83:
+    case 86:
+    case 118:
+    case 128:
+    case 138:
+    case 139:
+    case 134:
+    case 135:
+    {
+        sps.chroma_format_idc = reader.ue();
+        if (sps.chroma_format_idc == 3) {
+            sps.separate_colour_plane = reader.flag();
+        }
+        reader.ue(); // bit_depth_luma_minus8
+        reader.ue(); // bit_depth_chroma_minus8
+        reader.flag(); // qpprime_y_zero_transform_bypass_flag
+        if (reader.flag()) {
+            const uint32_t lists = sps.chroma_format_idc == 3 ? 12 : 8;
+            for (uint32_t i = 0; i < lists; i++) {
+                if (!reader.flag()) {
+                    continue;
+                }
+                const uint32_t list_size = i < 6 ? 16 : 64;
+                int32_t last = 8;
+                int32_t next = 8;
+                for (uint32_t j = 0; j < list_size && next != 0; j++) {
+                    next = (last + reader.se() + 256) % 256;
+                    last = next == 0 ? last : next;
+                }
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    sps.log2_max_frame_num = reader.ue() + 4;
+    sps.pic_order_cnt_type = reader.ue();
+    if (sps.pic_order_cnt_type == 0) {
+        sps.log2_max_poc_lsb = reader.ue() + 4;
+    }
+    else if (sps.pic_order_cnt_type == 1) {
+        sps.delta_pic_order_always_zero = reader.flag();
+        reader.se(); // offset_for_non_ref_pic
+        reader.se(); // offset_for_top_to_bottom_field
+        const uint32_t cycle = reader.ue();
+        if (cycle > 255) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cycle; i++) {
+            reader.se();
+        }
+    }
+    reader.ue();   // max_num_ref_frames
+    reader.flag(); // gaps_in_frame_num_value_allowed_flag
+    reader.ue();   // pic_width_in_mbs_minus1
+    reader.ue();   // pic_height_in_map_units_minus1
+    sps.frame_mbs_only = reader.flag();
+    if (!reader.ok() || sps.log2_max_frame_num > 16 || sps.log2_max_poc_lsb > 16 ||
+        sps.pic_order_cnt_type > 2) {
+        return false;
+    }
+    sps_[sps_id] = sps;
+    return true;
+}
+
+bool H264RefParser::parsePps(BitReader& reader) {
+    const uint32_t pps_id = reader.ue();
+    Pps pps{};
+    pps.sps_id = reader.ue();
+    if (pps_id >= pps_.size() || pps.sps_id >= sps_.size()) {
+        return false;
+    }
+    reader.flag(); // entropy_coding_mode_flag
+    pps.bottom_field_pic_order_in_frame_present = reader.flag();
+    if (reader.ue() != 0) {
+        // num_slice_groups_minus1, 只有Extended profile会用
+        return false;
+    }
+    pps.num_ref_idx_l0_default = reader.ue() + 1;
+    pps.num_ref_idx_l1_default = reader.ue() + 1;
+    pps.weighted_pred = reader.flag();
+    pps.weighted_bipred_idc = reader.u(2);
+    reader.se();   // pic_init_qp_minus26
+    reader.se();   // pic_init_qs_minus26
+    reader.se();   // chroma_qp_index_offset
+    reader.flag(); // deblocking_filter_control_present_flag
+    reader.flag(); // constrained_intra_pred_flag
+    pps.redundant_pic_cnt_present = reader.flag();
+    if (!reader.ok() || pps.num_ref_idx_l0_default > kMaxRefIdx ||
+        pps.num_ref_idx_l1_default > kMaxRefIdx) {
+        return false;
+    }
+    pps_[pps_id] = pps;
+    return true;
+}
+
+std::optional<H264RefInfo> H264RefParser::parseSlice(BitReader& reader, uint8_t nal_ref_idc,
+                                                     bool idr) {
+    reader.ue(); // first_mb_in_slice
+    const uint32_t slice_type = reader.ue() % 5;
+    const uint32_t pps_id = reader.ue();
+    if (pps_id >= pps_.size() || !pps_[pps_id].has_value() ||
+        !sps_[pps_[pps_id]->sps_id].has_value()) {
+        return std::nullopt;
+    }
+    const Pps& pps = pps_[pps_id].value();
+    const Sps& sps = sps_[pps.sps_id].value();
+    H264RefInfo info{};
+    info.idr = idr;
+    info.reference = nal_ref_idc != 0;
+    if (sps.separate_colour_plane) {
+        reader.u(2); // colour_plane_id
+    }
+    info.frame_num = reader.u(sps.log2_max_frame_num);
+    bool field_pic = false;
+    if (!sps.frame_mbs_only) {
+        field_pic = reader.flag();
+        if (field_pic) {
+            reader.flag(); // bottom_field_flag
+        }
+    }
+    if (idr) {
+        info.idr_pic_id = reader.ue();
+    }
+    if (sps.pic_order_cnt_type == 0) {
+        reader.u(sps.log2_max_poc_lsb);
+        if (pps.bottom_field_pic_order_in_frame_present && !field_pic) {
+            reader.se(); // delta_pic_order_cnt_bottom
+        }
+    }
+    else if (sps.pic_order_cnt_type == 1 && !sps.delta_pic_order_always_zero) {
+        reader.se();
+        if (pps.bottom_field_pic_order_in_frame_present && !field_pic) {
+            reader.se();
+        }
+    }
+    if (pps.redundant_pic_cnt_present) {
+        reader.ue();
+    }
+    const bool is_p = slice_type == kSliceP || slice_type == kSliceSP;
+    const bool is_b = slice_type == kSliceB;
+    if (is_b) {
+        reader.flag(); // direct_spatial_mv_pred_flag
+    }
+    uint32_t num_ref_idx[2] = {pps.num_ref_idx_l0_default, pps.num_ref_idx_l1_default};
+    if ((is_p || is_b) && reader.flag()) {
+        num_ref_idx[0] = reader.ue() + 1;
+        if (is_b) {
+            num_ref_idx[1] = reader.ue() + 1;
+        }
+    }
+    if (num_ref_idx[0] > kMaxRefIdx || num_ref_idx[1] > kMaxRefIdx) {
+        return std::nullopt;
+    }
+    const uint32_t lists = is_b ? 2 : (slice_type == kSliceI || slice_type == kSliceSI ? 0 : 1);
+    // ref_pic_list_modification()
+    for (uint32_t list = 0; list < lists; list++) {
+        if (!reader.flag()) {
+            continue;
+        }
+        for (uint32_t i = 0;; i++) {
+            const uint32_t idc = reader.ue();
+            if (idc == 3) {
+                break;
+            }
+            if (idc > 3 || i >= kMaxOperations || !reader.ok()) {
+                return std::nullopt;
+            }
+            // 0/1: abs_diff_pic_num_minus1, 2: long_term_pic_num
+            reader.ue();
+            info.refs_long_term |= idc == 2;
+        }
+    }
+    // pred_weight_table()
+    if ((pps.weighted_pred && is_p) || (pps.weighted_bipred_idc == 1 && is_b)) {
+        const uint32_t chroma_array_type = sps.separate_colour_plane ? 0 : sps.chroma_format_idc;
+        reader.ue(); // luma_log2_weight_denom
+        if (chroma_array_type != 0) {
+            reader.ue(); // chroma_log2_weight_denom
+        }
+        for (uint32_t list = 0; list < lists; list++) {
+            for (uint32_t i = 0; i < num_ref_idx[list]; i++) {
+                if (reader.flag()) {
+                    reader.se();
+                    reader.se();
+                }
+                if (chroma_array_type != 0 && reader.flag()) {
+                    for (int j = 0; j < 4; j++) {
+                        reader.se();
+                    }
+                }
+            }
+        }
+    }
+    // dec_ref_pic_marking()
+    if (info.reference) {
+        if (idr) {
+            reader.flag(); // no_output_of_prior_pics_flag
+            info.long_term_mark = reader.flag();
+        }
+        else if (reader.flag()) {
+            for (uint32_t i = 0;; i++) {
+                const uint32_t op = reader.ue();
+                if (op == 0) {
+                    break;
+                }
+                if (op > 6 || i >= kMaxOperations || !reader.ok()) {
+                    return std::nullopt;
+                }
+                if (op == 1 || op == 3) {
+                    reader.ue(); // difference_of_pic_nums_minus1
+                }
+                if (op == 2) {
+                    reader.ue(); // long_term_pic_num
+                }
+                if (op == 3 || op == 6) {
+                    reader.ue(); // long_term_frame_idx
+                }
+                if (op == 4) {
+                    reader.ue(); // max_long_term_frame_idx_plus1
+                }
+                info.long_term_mark |= op == 6;
+            }
+        }
+    }
+    if (!reader.ok()) {
+        return std::nullopt;
+    }
+    if (idr) {
+        last_idr_pic_id_ = info.idr_pic_id;
+    }
+    else {
+        info.idr_pic_id = last_idr_pic_id_;
+    }
+    return info;
+}
+
+} // namespace video
+
+} // namespace lt
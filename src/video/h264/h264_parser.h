@@ -0,0 +1,106 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace lt {
+
+namespace video {
+
+// 时域分层时每帧的slice前面带一个前缀NAL(type 14), 里面只有temporal_id有意义.
+// 不认识SVC的解码器会直接跳过这种NAL. 4字节起始码+1字节NAL头+3字节SVC扩展头+1字节结尾
+using H264PrefixNal = std::array<uint8_t, 9>;
+
+// nal_ref_idc和idr要和后面的slice一致. 不被参考的帧(nal_ref_idc为0)同时标记成discardable
+H264PrefixNal makeH264PrefixNal(uint8_t temporal_id, uint8_t nal_ref_idc, bool idr);
+
+// 第一个slice之前的前缀NAL里的temporal_id, 没有前缀NAL时返回nullopt. 不需要SPS/PPS
+std::optional<uint8_t> parseH264TemporalId(const uint8_t* data, size_t size);
+
+// 一帧H.264码流里和参考关系有关的信息
+struct H264RefInfo {
+    bool idr = false;
+    // nal_ref_idc不为0
+    bool reference = false;
+    // 当前所在IDR周期的idr_pic_id. P帧里没有这个字段, 沿用最近一个IDR的
+    uint32_t idr_pic_id = 0;
+    uint32_t frame_num = 0;
+    // 这一帧被标记成了长期参考帧(IDR的long_term_reference_flag, 或者MMCO 6)
+    bool long_term_mark = false;
+    // 参考列表重排时用到了长期参考帧
+    bool refs_long_term = false;
+};
+
+// 从Annex B码流里解析出长期参考帧相关的字段, 编码端和解码端共用. 会记住码流里出现过的
+// SPS/PPS, 所以同一路码流要用同一个对象按顺序喂进来. 不支持slice group和MVC,
+// 只看每帧的第一个slice
+class H264RefParser {
+public:
+    std::optional<H264RefInfo> parse(const uint8_t* data, size_t size);
+
+private:
+    struct Sps {
+        uint32_t chroma_format_idc = 1;
+        bool separate_colour_plane = false;
+        uint32_t log2_max_frame_num = 4;
+        uint32_t pic_order_cnt_type = 0;
+        uint32_t log2_max_poc_lsb = 4;
+        bool delta_pic_order_always_zero = false;
+        bool frame_mbs_only = true;
+    };
+    struct Pps {
+        uint32_t sps_id = 0;
+        bool bottom_field_pic_order_in_frame_present = false;
+        uint32_t num_ref_idx_l0_default = 1;
+        uint32_t num_ref_idx_l1_default = 1;
+        bool weighted_pred = false;
+        uint32_t weighted_bipred_idc = 0;
+        bool redundant_pic_cnt_present = false;
+    };
+    class BitReader;
+
+private:
+    bool parseSps(BitReader& reader);
+    bool parsePps(BitReader& reader);
+    std::optional<H264RefInfo> parseSlice(BitReader& reader, uint8_t nal_ref_idc, bool idr);
+
+private:
+    std::array<std::optional<Sps>, 32> sps_;
+    std::array<std::optional<Pps>, 256> pps_;
+    uint32_t last_idr_pic_id_ = 0;
+};
+
+} // namespace video
+
+} // namespace lt
@@ -30,9 +30,12 @@
 
 #include "worker_streaming.h"
 
+#include <algorithm>
+
 #include <ltproto/client2worker/audio_data.pb.h>
 #include <ltproto/client2worker/change_streaming_params.pb.h>
 #include <ltproto/client2worker/change_streaming_params_ack.pb.h>
+#include <ltproto/client2worker/video_frame.pb.h>
 #include <ltproto/common/keep_alive_ack.pb.h>
 #include <ltproto/common/streaming_params.pb.h>
 #include <ltproto/ltproto.h>
@@ -44,6 +47,7 @@
 #include <ltlib/logging.h>
 #include <ltlib/system.h>
 #include <ltlib/times.h>
+#include <video/h264/h264_parser.h>
 
 namespace {
 
@@ -214,7 +218,12 @@ int32_t WorkerStreaming::init() {
         LOG(ERR) << "Init pipe client failed";
         return kExitCodeInitWorkerFailed;
     }
+    frame_ring_ = ltlib::SharedFrameRing::open(kFrameRingPrefix + pipe_name_);
+    if (frame_ring_ == nullptr) {
+        LOG(WARNING) << "Open shared frame ring failed, send frames through pipe";
+    }
     getUserMaxMbps();
+    loadSoftEncoderSettings();
 #if 0 // 引入多屏支持后，协商变得很麻烦
     if (need_negotiate_) {
         if (!negotiateAllParameters()) {
@@ -378,12 +387,18 @@ int32_t WorkerStreaming::negotiateStreamParameters() {
     video_params.height = static_cast<uint32_t>(monitors_[monitor_index_].height);
     video_params.client_refresh_rate = client_refresh_rate_;
     video_params.max_mbps = max_mbps_;
+    video_params.soft_encoder_threads = soft_encoder_threads_;
+    video_params.enable_ltr = enable_ltr_;
+    video_params.temporal_layers = temporal_layers_;
     video_params.monitor = monitors_[monitor_index_];
     video_params.send_message = std::bind(&WorkerStreaming::sendPipeMessageFromOtherThread, this,
                                           std::placeholders::_1, std::placeholders::_2);
     video_params.register_message_handler =
         std::bind(&WorkerStreaming::registerMessageHandler, this, std::placeholders::_1,
                   std::placeholders::_2);
+    video_params.on_resolution_changed = std::bind(&WorkerStreaming::onVideoResolutionChanged,
+                                                   this, std::placeholders::_1,
+                                                   std::placeholders::_2);
     auto video = lt::video::CaptureEncodePipeline::create(video_params);
     if (video == nullptr) {
         LOGF(ERR, "Create VideoCaptureEncodePipeline failed");
@@ -401,6 +416,7 @@ int32_t WorkerStreaming::negotiateStreamParameters() {
     LOG(INFO) << "Negotiated video codec:" << toString(video->codec());
 
     negotiated_params_ = negotiated_params;
+    negotiated_video_codec_type_ = video->codec();
     video_ = std::move(video);
     audio_ = std::move(audio);
     return kExitCodeOK;
@@ -416,6 +432,22 @@ void WorkerStreaming::getUserMaxMbps() {
     LOG(INFO) << "Loaded max_mbps " << max_mbps_;
 }
 
+void WorkerStreaming::loadSoftEncoderSettings() {
+    auto settings = ltlib::Settings::create(ltlib::Settings::Storage::Sqlite);
+    if (settings == nullptr) {
+        LOG(WARNING) << "Create Settings failed, soft encoder will use default options";
+        return;
+    }
+    // 都是OpenH264的选项, 不设置时和以前一样单线程、不开LTR、不分层
+    int64_t threads = settings->getInteger("soft_encoder_threads").value_or(1);
+    soft_encoder_threads_ = static_cast<uint32_t>(std::clamp<int64_t>(threads, 0, 4));
+    enable_ltr_ = settings->getBoolean("enable_ltr").value_or(false);
+    int64_t layers = settings->getInteger("temporal_layers").value_or(1);
+    temporal_layers_ = static_cast<uint32_t>(std::clamp<int64_t>(layers, 1, 4));
+    LOG(INFO) << "Loaded soft_encoder_threads " << soft_encoder_threads_ << ", enable_ltr "
+              << enable_ltr_ << ", temporal_layers " << temporal_layers_;
+}
+
 void WorkerStreaming::mainLoop(const std::function<void()>& i_am_alive) {
     LOG(INFO) << "Worker enter main loop";
     ioloop_->run(i_am_alive);
@@ -478,9 +510,67 @@ bool WorkerStreaming::sendPipeMessage(uint32_t type,
     if (!connected_to_service_) {
         return false;
     }
+    if (type == ltproto::type::kVideoFrame || type == ltproto::type::kAudioData) {
+        return sendMediaFrame(type, msg);
+    }
     return pipe_client_->send(type, msg);
 }
 
+bool WorkerStreaming::sendMediaFrame(uint32_t type,
+                                     const std::shared_ptr<google::protobuf::MessageLite>& msg) {
+    ltlib::MediaHeader header{};
+    const std::string* payload = nullptr;
+    if (type == ltproto::type::kVideoFrame) {
+        auto video_frame = std::static_pointer_cast<ltproto::client2worker::VideoFrame>(msg);
+        header.kind = ltlib::MediaHeader::Kind::Video;
+        header.flags = video_frame->is_keyframe() ? ltlib::MediaHeader::kFlagKeyframe : 0;
+        header.codec = static_cast<uint8_t>(negotiated_video_codec_type_);
+        header.frame_id = video_frame->picture_id();
+        if (isAVC(negotiated_video_codec_type_)) {
+            // 分层编码时层号在码流的前缀NAL里, 传输层拥塞时靠它决定先丢哪些帧
+            const std::string& bitstream = video_frame->frame();
+            auto temporal_id = lt::video::parseH264TemporalId(
+                reinterpret_cast<const uint8_t*>(bitstream.data()), bitstream.size());
+            header.temporal_id = temporal_id.value_or(0);
+        }
+        header.width = video_frame->width();
+        header.height = video_frame->height();
+        header.capture_timestamp_us = video_frame->capture_timestamp_us();
+        header.start_encode_timestamp_us = video_frame->start_encode_timestamp_us();
+        header.end_encode_timestamp_us = video_frame->end_encode_timestamp_us();
+        payload = &video_frame->frame();
+    }
+    else {
+        auto audio_data = std::static_pointer_cast<ltproto::client2worker::AudioData>(msg);
+        header.kind = ltlib::MediaHeader::Kind::Audio;
+        header.codec = static_cast<uint8_t>(audio_codec_type_);
+        payload = &audio_data->data();
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(payload->data());
+    uint32_t size = static_cast<uint32_t>(payload->size());
+    // 优先放进共享内存, 管道里只传头和描述符. 环满了或者帧太大, 数据跟在头后面走管道
+    std::optional<ltlib::SharedFrameRing::Descriptor> desc;
+    std::string desc_bytes;
+    if (frame_ring_ != nullptr) {
+        desc = frame_ring_->write(data, size);
+    }
+    if (desc.has_value()) {
+        desc_bytes = frame_ring_->toBytes(desc.value());
+        header.flags |= ltlib::MediaHeader::kFlagSharedMemory;
+        data = reinterpret_cast<const uint8_t*>(desc_bytes.data());
+        size = static_cast<uint32_t>(desc_bytes.size());
+    }
+    uint32_t frame_size = 0;
+    auto frame = ltlib::encode_media_frame(header, data, size, frame_size);
+    if (!pipe_client_->send(frame, frame_size)) {
+        if (desc.has_value()) {
+            frame_ring_->abort(desc.value());
+        }
+        return false;
+    }
+    return true;
+}
+
 // FIXME: 返回值
 bool WorkerStreaming::sendPipeMessageFromOtherThread(
     uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg) {
@@ -515,6 +605,27 @@ void WorkerStreaming::onCapturedAudioData(
     postTask([this, audio_data]() { sendPipeMessage(ltproto::type::kAudioData, audio_data); });
 }
 
+void WorkerStreaming::onVideoResolutionChanged(uint32_t width, uint32_t height) {
+    // 抓屏线程回调, 视频流水线已经自己换好了编码器, 这里只需要让输入按新的分辨率换算坐标
+    postTask([this, width, height]() {
+        LOG(INFO) << "Video resolution changed to " << width << "x" << height;
+        auto monitors = ltlib::enumMonitors();
+        const std::string& name = monitors_[monitor_index_].name;
+        for (size_t i = 0; i < monitors.size(); i++) {
+            if (monitors[i].name != name) {
+                continue;
+            }
+            monitors_ = monitors;
+            monitor_index_ = static_cast<uint32_t>(i);
+            if (input_) {
+                input_->changeMonitor(monitors_[monitor_index_]);
+            }
+            return;
+        }
+        LOG(WARNING) << "Can't find monitor " << name << " after resolution changed";
+    });
+}
+
 void WorkerStreaming::onPipeMessage(uint32_t type,
                                     std::shared_ptr<google::protobuf::MessageLite> msg) {
     dispatchServiceMessage(type, msg);
@@ -38,7 +38,9 @@
 
 #include <ltlib/io/client.h>
 #include <ltlib/io/ioloop.h>
+#include <ltlib/io/media_frame.h>
 #include <ltlib/settings.h>
+#include <ltlib/shared_frame_ring.h>
 #include <ltlib/system.h>
 #include <ltlib/threads.h>
 
@@ -84,6 +86,7 @@ private:
     bool negotiateAllParameters();
     int32_t negotiateStreamParameters();
     void getUserMaxMbps();
+    void loadSoftEncoderSettings();
     void mainLoop(const std::function<void()>& i_am_alive);
     void stop(int exit_code);
     void postTask(const std::function<void()>& task);
@@ -92,6 +95,7 @@ private:
     void dispatchServiceMessage(uint32_t type,
                                 const std::shared_ptr<google::protobuf::MessageLite>& msg);
     bool sendPipeMessage(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    bool sendMediaFrame(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg);
     bool sendPipeMessageFromOtherThread(uint32_t type,
                                         const std::shared_ptr<google::protobuf::MessageLite>& msg);
     void printStats();
@@ -99,6 +103,7 @@ private:
     void updateInput();
     // TODO: AUDIO和VIDEO INPUT一样改成通用的接口
     void onCapturedAudioData(std::shared_ptr<google::protobuf::MessageLite> audio_data);
+    void onVideoResolutionChanged(uint32_t width, uint32_t height);
 
     // pipe message handlers
     void onPipeMessage(uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg);
@@ -129,6 +134,7 @@ private:
     std::shared_ptr<google::protobuf::MessageLite> negotiated_params_;
     std::unique_ptr<ltlib::IOLoop> ioloop_;
     std::unique_ptr<ltlib::Client> pipe_client_;
+    std::unique_ptr<ltlib::SharedFrameRing> frame_ring_;
     std::unique_ptr<ltlib::BlockingThread> thread_;
     int64_t last_time_received_from_service_;
     std::unique_ptr<lt::video::CaptureEncodePipeline> video_;
@@ -137,6 +143,9 @@ private:
     std::unique_ptr<ltlib::Settings> settings_;
     std::vector<ltlib::Monitor> monitors_;
     uint32_t max_mbps_ = 0;
+    uint32_t soft_encoder_threads_ = 1;
+    bool enable_ltr_ = false;
+    uint32_t temporal_layers_ = 1;
     bool stoped_ = false;
 };
 } // namespace worker